@@ -25,6 +25,7 @@
 #include "AppManager.h"
 #include "AppManagerPrivate.h"
 
+#include <algorithm> // std::max
 #include <clocale>
 #include <csignal>
 #include <cstddef>
@@ -74,6 +75,7 @@
 #include "Engine/GroupOutput.h"
 #include "Engine/LibraryBinary.h"
 #include "Engine/Log.h"
+#include "Engine/MemoryPool.h"
 #include "Engine/Node.h"
 #include "Engine/OfxImageEffectInstance.h"
 #include "Engine/OfxEffectInstance.h"
@@ -276,6 +278,8 @@ AppManager::load(int &argc,
     }
 
     _imp->idealThreadCount = QThread::idealThreadCount();
+    ///The thread starting a parallel loop takes part in it
+    _imp->taskScheduler.reset( new TaskScheduler( std::max(0, _imp->idealThreadCount - 1) ) );
     QThreadPool::globalInstance()->setExpiryTimeout(-1); //< make threads never exit on their own
     //otherwise it might crash with thread local storage
 
@@ -348,6 +352,12 @@ AppManager::~AppManager()
 
     ///Caches may have launched some threads to delete images, wait for them to be done
     QThreadPool::globalInstance()->waitForDone();
+    if (_imp->taskScheduler) {
+        _imp->taskScheduler->quitWorkers();
+    }
+
+    ///Finish writing the images of the persistent store while the caches still hold them
+    _imp->_persistentImageStore->quitThread();
     
     ///Kill caches now because decreaseNCacheFilesOpened can be called
     _imp->_nodeCache->waitForDeleterThread();
@@ -567,9 +577,24 @@ AppManager::loadInternalAfterInitGui(const CLArgs& cl)
         
         U64 maxDiskCacheNode = _imp->_settings->getMaximumDiskCacheNodeSize();
         
-        _imp->_nodeCache.reset( new Cache<Image>("NodeCache",NATRON_CACHE_VERSION, maxCacheRAM - playbackSize,1.) );
+        // Split the caches that are accessed by all render threads so they do not serialize on a single lock.
+        // The DiskCache is only accessed by DiskCache nodes and keeps a single lock.
+        int nShards = _imp->_settings->getNumberOfCacheShards();
+        if (nShards <= 0) {
+            nShards = 1;
+            while (nShards < _imp->idealThreadCount) {
+                nShards *= 2;
+            }
+        }
+        
+        _imp->_nodeCache.reset( new Cache<Image>("NodeCache",NATRON_CACHE_VERSION, maxCacheRAM - playbackSize,1., nShards) );
         _imp->_diskCache.reset( new Cache<Image>("DiskCache",NATRON_CACHE_VERSION, maxDiskCacheNode,0.) );
-        _imp->_viewerCache.reset( new Cache<FrameEntry>("ViewerCache",NATRON_CACHE_VERSION,viewerCacheSize,(double)playbackSize / (double)viewerCacheSize) );
+        _imp->_viewerCache.reset( new Cache<FrameEntry>("ViewerCache",NATRON_CACHE_VERSION,viewerCacheSize,(double)playbackSize / (double)viewerCacheSize, nShards) );
+        setCompressedCacheMaximumSize( _imp->_settings->getRamCompressedCacheMaximumPercent() );
+        setImageCacheEvictionPolicy( _imp->_settings->getImageCacheEvictionPolicy() );
+        setPersistentImageStoreLocation( _imp->_settings->getPersistentImageStorePath() );
+        setPersistentImageStoreMaximumSize( _imp->_settings->getMaximumPersistentImageStoreSize() );
+        setUseTransparentHugePages( _imp->_settings->isTransparentHugePagesEnabled() );
     } catch (std::logic_error) {
         // ignore
     }
@@ -817,6 +842,8 @@ AppManager::clearAllCaches()
     clearDiskCache();
     clearNodeCache();
 
+    ///Give back to the system the memory of the images that was kept for reuse
+    MemoryPool::trim();
  
     ///for each app instance clear all its nodes cache
     for (std::map<int,AppInstanceRef>::iterator it = copy.begin(); it != copy.end(); ++it) {
@@ -916,7 +943,7 @@ AppManager::setApplicationsCachesMaximumMemoryPercent(double p)
     U64 playbackSize = maxCacheRAM * _imp->_settings->getRamPlaybackMaximumPercent();
 
     _imp->_nodeCache->setMaximumCacheSize(maxCacheRAM - playbackSize);
-    _imp->_nodeCache->setMaximumInMemorySize(1);
+    setCompressedCacheMaximumSize( _imp->_settings->getRamCompressedCacheMaximumPercent() );
     U64 maxDiskCacheSize = _imp->_settings->getMaximumViewerDiskCacheSize();
     _imp->_viewerCache->setMaximumInMemorySize( (double)playbackSize / (double)maxDiskCacheSize );
 }
@@ -944,11 +971,44 @@ AppManager::setPlaybackCacheMaximumSize(double p)
     U64 playbackSize = maxCacheRAM * p;
 
     _imp->_nodeCache->setMaximumCacheSize(maxCacheRAM - playbackSize);
-    _imp->_nodeCache->setMaximumInMemorySize(1);
+    setCompressedCacheMaximumSize( _imp->_settings->getRamCompressedCacheMaximumPercent() );
     U64 maxDiskCacheSize = _imp->_settings->getMaximumViewerDiskCacheSize();
     _imp->_viewerCache->setMaximumInMemorySize( (double)playbackSize / (double)maxDiskCacheSize );
 }
 
+void
+AppManager::setCompressedCacheMaximumSize(double p)
+{
+    ///The compressed images are kept within the RAM budget of the NodeCache
+    _imp->_nodeCache->setMaximumInMemorySize(1. - p);
+    _imp->_nodeCache->setMaximumCompressedSize(p);
+}
+
+void
+AppManager::setImageCacheEvictionPolicy(CacheEvictionPolicyEnum policy)
+{
+    _imp->_nodeCache->setEvictionPolicy(policy);
+    _imp->_diskCache->setEvictionPolicy(policy);
+}
+
+void
+AppManager::setPersistentImageStoreLocation(const std::string & path)
+{
+    _imp->_persistentImageStore->setLocation(path);
+}
+
+void
+AppManager::setPersistentImageStoreMaximumSize(U64 size)
+{
+    _imp->_persistentImageStore->setMaximumSize(size);
+}
+
+void
+AppManager::setUseTransparentHugePages(bool enabled)
+{
+    MemoryPool::setHugePagesEnabled(enabled);
+}
+
 void
 AppManager::loadAllPlugins()
 {
@@ -1711,48 +1771,48 @@ AppManager::getMemoryStatsForCacheEntryHolder(const CacheEntryHolder* holder,
                                        std::size_t* ramOccupied,
                                        std::size_t* diskOccupied) const
 {
-    assert(holder);
+    CacheEntryHolderStats stats;
+    getMemoryStatsForCacheEntryHolder(holder, &stats);
     
-    *ramOccupied = 0;
-    *diskOccupied = 0;
+    *ramOccupied = stats.ramOccupied + stats.compressedOccupied;
+    *diskOccupied = stats.diskOccupied;
+}
+
+void
+AppManager::getMemoryStatsForCacheEntryHolder(const CacheEntryHolder* holder,
+                                              CacheEntryHolderStats* stats) const
+{
+    assert(holder);
     
-    std::size_t viewerCacheMem = 0;
-    std::size_t viewerCacheDisk = 0;
-    std::size_t diskCacheMem = 0;
-    std::size_t diskCacheDisk = 0;
-    std::size_t nodeCacheMem = 0;
-    std::size_t nodeCacheDisk = 0;
+    *stats = CacheEntryHolderStats();
     
     const Node* isNode = dynamic_cast<const Node*>(holder);
     if (isNode) {
         ViewerInstance* isViewer = isNode->isEffectViewer();
         if (isViewer) {
-            _imp->_viewerCache->getMemoryStatsForCacheEntryHolder(holder, &viewerCacheMem, &viewerCacheDisk);
+            _imp->_viewerCache->getMemoryStatsForCacheEntryHolder(holder, stats);
         }
     }
-    _imp->_diskCache->getMemoryStatsForCacheEntryHolder(holder, &diskCacheMem, &diskCacheDisk);
-    _imp->_nodeCache->getMemoryStatsForCacheEntryHolder(holder, &nodeCacheMem, &nodeCacheDisk);
-    
-    *ramOccupied = diskCacheMem + viewerCacheMem + nodeCacheMem;
-    *diskOccupied = diskCacheDisk + viewerCacheDisk + nodeCacheDisk;
+    _imp->_diskCache->getMemoryStatsForCacheEntryHolder(holder, stats);
+    _imp->_nodeCache->getMemoryStatsForCacheEntryHolder(holder, stats);
 }
 
 void
-AppManager::removeAllImagesFromCacheWithMatchingIDAndDifferentKey(const CacheEntryHolder* holder, U64 treeVersion)
+AppManager::removeAllImagesFromCacheWithMatchingIDAndKey(const CacheEntryHolder* holder, U64 treeVersion)
 {
-    _imp->_nodeCache->removeAllEntriesWithDifferentNodeHashForHolderPublic(holder, treeVersion);
+    _imp->_nodeCache->removeAllEntriesWithNodeHashForHolderPublic(holder, treeVersion);
 }
 
 void
-AppManager::removeAllImagesFromDiskCacheWithMatchingIDAndDifferentKey(const CacheEntryHolder* holder, U64 treeVersion)
+AppManager::removeAllImagesFromDiskCacheWithMatchingIDAndKey(const CacheEntryHolder* holder, U64 treeVersion)
 {
-    _imp->_diskCache->removeAllEntriesWithDifferentNodeHashForHolderPublic(holder, treeVersion);
+    _imp->_diskCache->removeAllEntriesWithNodeHashForHolderPublic(holder, treeVersion);
 }
 
 void
-AppManager::removeAllTexturesFromCacheWithMatchingIDAndDifferentKey(const CacheEntryHolder* holder, U64 treeVersion)
+AppManager::removeAllTexturesFromCacheWithMatchingIDAndKey(const CacheEntryHolder* holder, U64 treeVersion)
 {
-    _imp->_viewerCache->removeAllEntriesWithDifferentNodeHashForHolderPublic(holder, treeVersion);
+    _imp->_viewerCache->removeAllEntriesWithNodeHashForHolderPublic(holder, treeVersion);
 }
 
 void
@@ -1805,6 +1865,56 @@ AppManager::getImageOrCreate_diskCache(const ImageKey & key,const boost::shared_
     return _imp->_diskCache->getOrCreate(key, params, returnValue);
 }
 
+bool
+AppManager::isPersistentImageStoreEnabled() const
+{
+    return _imp->_persistentImageStore->isEnabled();
+}
+
+bool
+AppManager::getImage_persistentStore(const ImageKey & key,
+                                     U64 contentHash,
+                                     std::list<boost::shared_ptr<Image> >* returnValue) const
+{
+    if ( !_imp->_persistentImageStore->isEnabled() ) {
+        return false;
+    }
+    std::list<StoredImageInfo> stored;
+    if ( !_imp->_persistentImageStore->lookup(PersistentImageStore::getStoreKey(key, contentHash), &stored) ) {
+        return false;
+    }
+
+    for (std::list<StoredImageInfo>::iterator it = stored.begin(); it != stored.end(); ++it) {
+        ///Load the image in the NodeCache, so that it is only read once per session
+        boost::shared_ptr<Image> image;
+        if ( _imp->_nodeCache->getOrCreate(key, it->params, &image) ) {
+            ///Another thread loaded it in the meantime
+            returnValue->push_back(image);
+            continue;
+        }
+        if (!image) {
+            continue;
+        }
+        image->allocateMemory();
+        if ( !PersistentImageStore::readPixels(it->filePath, image.get()) ) {
+            qDebug() << "Failed to read" << it->filePath.c_str() << "from the persistent image store";
+            _imp->_nodeCache->removeEntry(image);
+            continue;
+        }
+        image->markForRendered( image->getBounds() );
+        returnValue->push_back(image);
+    }
+
+    return !returnValue->empty();
+}
+
+void
+AppManager::storeImageInPersistentStore(const boost::shared_ptr<Image> & image,
+                                        U64 contentHash)
+{
+    _imp->_persistentImageStore->store( image, PersistentImageStore::getStoreKey(image->getKey(), contentHash) );
+}
+
 
 bool
 AppManager::getTexture(const FrameKey & key,
@@ -1844,7 +1954,7 @@ AppManager::isAggressiveCachingEnabled() const
 U64
 AppManager::getCachesTotalMemorySize() const
 {
-    return _imp->_viewerCache->getMemoryCacheSize() + _imp->_nodeCache->getMemoryCacheSize();
+    return _imp->_viewerCache->getMemoryCacheSize() + _imp->_nodeCache->getMemoryCacheSize() + _imp->_nodeCache->getCompressedCacheSize();
 }
 
 CacheSignalEmitter*
@@ -2013,6 +2123,14 @@ AppManager::getTotalNodesMemoryRegistered() const
     return _imp->_nodesGlobalMemoryUse;
 }
 
+void
+AppManager::notifyPluginMemoryAllocated(qint64 nBytes)
+{
+    if (_imp->_nodeCache) {
+        _imp->_nodeCache->notifyExternalMemoryChanged(nBytes);
+    }
+}
+
 QString
 AppManager::getErrorLog_mt_safe() const
 {
@@ -2145,7 +2263,7 @@ AppManager::checkCacheFreeMemoryIsGoodEnough()
             qDebug() << "Total system free RAM is below the threshold:" << printAsRAM(totalFreeRAM)
                      << ", clearing least recently used NodeCache image...";
 #endif
-            if (!_imp->_nodeCache->evictLRUInMemoryEntry()) {
+            if ( !_imp->_nodeCache->evictLRUInMemoryEntry() && !_imp->_nodeCache->evictLRUCompressedEntry() ) {
                 break;
             }
         }
@@ -2182,8 +2300,14 @@ AppManager::getOCIOConfigPath() const
 void
 AppManager::setNThreadsToRender(int nThreads)
 {
-    QMutexLocker l(&_imp->nThreadsMutex);
-    _imp->nThreadsToRender = nThreads;
+    {
+        QMutexLocker l(&_imp->nThreadsMutex);
+        _imp->nThreadsToRender = nThreads;
+    }
+    if (_imp->taskScheduler) {
+        ///-1 means rendering in a single thread, 0 means using all cores
+        _imp->taskScheduler->setMaximumConcurrency(nThreads == -1 ? 1 : nThreads);
+    }
 }
 
 void
@@ -2823,6 +2947,12 @@ AppManager::getOFXHost() const
     return _imp->ofxHost.get();
 }
 
+TaskScheduler*
+AppManager::getTaskScheduler() const
+{
+    return _imp->taskScheduler.get();
+}
+
 void
 Dialogs::errorDialog(const std::string & title,
             const std::string & message,
@@ -195,6 +195,21 @@ public:
     
     bool getImageOrCreate_diskCache(const ImageKey & key,const boost::shared_ptr<ImageParams>& params,
                           boost::shared_ptr<Image>* returnValue) const;
+
+    bool isPersistentImageStoreEnabled() const;
+
+    /**
+     * @brief Looks-up the persistent image store for images of the given key, contentHash being the content hash of the
+     * node at the time and view of the key (@see Node::computeContentHash()). The images found are read into the NodeCache.
+     * Returns false if the store is disabled or has no image for this key.
+     **/
+    bool getImage_persistentStore(const ImageKey & key,U64 contentHash,std::list<boost::shared_ptr<Image> >* returnValue) const;
+
+    /**
+     * @brief Writes an entirely rendered image of the NodeCache to the persistent image store, in a separate thread.
+     * Does nothing if the store is disabled.
+     **/
+    void storeImageInPersistentStore(const boost::shared_ptr<Image> & image, U64 contentHash);
     
     static bool
     getImageFromCache(const ImageKey & key,
@@ -261,6 +276,25 @@ public:
 
     void setPlaybackCacheMaximumSize(double p);
 
+    /**
+     * @brief Sets the part of the NodeCache RAM where evicted images are kept compressed, 0 to disable it.
+     **/
+    void setCompressedCacheMaximumSize(double p);
+
+    /**
+     * @brief Sets how the NodeCache and the DiskCache choose the images to evict when they are full.
+     **/
+    void setImageCacheEvictionPolicy(CacheEvictionPolicyEnum policy);
+
+    /**
+     * @brief Sets the directory of the persistent image store, an empty path disables it.
+     **/
+    void setPersistentImageStoreLocation(const std::string & path);
+
+    void setPersistentImageStoreMaximumSize(U64 size);
+
+    void setUseTransparentHugePages(bool enabled);
+
     void removeFromNodeCache(const boost::shared_ptr<Image> & image);
     void removeFromViewerCache(const boost::shared_ptr<FrameEntry> & texture);
     
@@ -270,9 +304,9 @@ public:
      * @brief Given the following tree version, removes all images from the node cache with a matching
      * tree version. This is useful to wipe the cache for one particular node.
      **/
-    void  removeAllImagesFromCacheWithMatchingIDAndDifferentKey(const CacheEntryHolder* holder, U64 treeVersion);
-    void  removeAllImagesFromDiskCacheWithMatchingIDAndDifferentKey(const CacheEntryHolder* holder, U64 treeVersion);
-    void  removeAllTexturesFromCacheWithMatchingIDAndDifferentKey(const CacheEntryHolder* holder, U64 treeVersion);
+    void  removeAllImagesFromCacheWithMatchingIDAndKey(const CacheEntryHolder* holder, U64 treeVersion);
+    void  removeAllImagesFromDiskCacheWithMatchingIDAndKey(const CacheEntryHolder* holder, U64 treeVersion);
+    void  removeAllTexturesFromCacheWithMatchingIDAndKey(const CacheEntryHolder* holder, U64 treeVersion);
     
     void removeAllCacheEntriesForHolder(const CacheEntryHolder* holder, bool blocking);
 
@@ -473,6 +507,12 @@ public:
     void getMemoryStatsForCacheEntryHolder(const CacheEntryHolder* holder,
                                            std::size_t* ramOccupied,
                                            std::size_t* diskOccupied) const;
+
+    /**
+     * @brief Same as above, but also reports the compressed portion of the caches and the hits in each portion.
+     **/
+    void getMemoryStatsForCacheEntryHolder(const CacheEntryHolder* holder,
+                                           CacheEntryHolderStats* stats) const;
     
     static std::string isImageFileSupportedByNatron(const std::string& ext);
     
@@ -484,6 +524,11 @@ public:
     AppTLS* getAppTLS() const;
     
     const OfxHost* getOFXHost() const;
+
+    /**
+     * @brief Returns the scheduler running the parallel loops of the renders
+     **/
+    TaskScheduler* getTaskScheduler() const;
     
     bool hasThreadsRendering() const;
     
@@ -545,6 +590,12 @@ public Q_SLOTS:
 
     qint64 getTotalNodesMemoryRegistered() const;
 
+    /**
+     * @brief Called by PluginMemory when plug-ins allocate (nBytes > 0) or free (nBytes < 0) memory, which counts
+     * against the maximum size of the node cache. Thread-safe.
+     **/
+    void notifyPluginMemoryAllocated(qint64 nBytes);
+
     void onMaxPanelsOpenedChanged(int maxPanels);
     
     void onQueueRendersChanged(bool queuingEnabled);
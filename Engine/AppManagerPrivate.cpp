@@ -87,6 +87,7 @@ AppManagerPrivate::AppManagerPrivate()
 , _nodeCache()
 , _diskCache()
 , _viewerCache()
+, _persistentImageStore( new PersistentImageStore() )
 , diskCachesLocationMutex()
 , diskCachesLocation()
 ,_backgroundIPC(0)
@@ -99,6 +100,7 @@ AppManagerPrivate::AppManagerPrivate()
 ,currentCacheFilesCount(0)
 ,currentCacheFilesCountMutex()
 ,idealThreadCount(0)
+,taskScheduler()
 ,nThreadsToRender(0)
 ,nThreadsPerEffect(0)
 ,useThreadPool(true)
@@ -357,32 +359,11 @@ AppManagerPrivate::checkForCacheDiskStructure(const QString & cachePath)
 
         return false;
     }
+    /*check if there's 256 subfolders, otherwise reset cache.
+       Most entries are stored in the pack files at the root of the cache folder, there is no need
+       to list the content of the subfolders.*/
     QDir directory(cachePath);
-    QStringList files = directory.entryList(QDir::AllDirs);
-
-
-    /*Now counting actual data files in the cache*/
-    /*check if there's 256 subfolders, otherwise reset cache.*/
-    int count = 0; // -1 because of the restoreFile
-    int subFolderCount = 0;
-    for (int i = 0; i < files.size(); ++i) {
-        QString subFolder(cachePath);
-        subFolder.append( QDir::separator() );
-        subFolder.append(files[i]);
-        if ( ( subFolder.right(1) == QString(".") ) || ( subFolder.right(2) == QString("..") ) ) {
-            continue;
-        }
-        QDir d(subFolder);
-        if ( d.exists() ) {
-            ++subFolderCount;
-            QStringList items = d.entryList();
-            for (int j = 0; j < items.size(); ++j) {
-                if ( ( items[j] != QString(".") ) && ( items[j] != QString("..") ) ) {
-                    ++count;
-                }
-            }
-        }
-    }
+    int subFolderCount = directory.entryList(QDir::AllDirs | QDir::NoDotAndDotDot).size();
     if (subFolderCount < 256) {
         qDebug() << cachePath << "doesn't contain sub-folders indexed from 00 to FF. Reseting.";
         cleanUpCacheDiskStructure(cachePath);
@@ -49,6 +49,8 @@
 #include "Engine/FrameEntry.h"
 #include "Engine/Image.h"
 #include "Engine/EngineFwd.h"
+#include "Engine/PersistentImageStore.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/TLSHolder.h"
 
 NATRON_NAMESPACE_ENTER;
@@ -72,6 +74,7 @@ struct AppManagerPrivate
     boost::shared_ptr<Cache<Image> >  _nodeCache; //< Images cache
     boost::shared_ptr<Cache<Image> >  _diskCache; //< Images disk cache (used by DiskCache nodes)
     boost::shared_ptr<Cache<FrameEntry> > _viewerCache; //< Viewer textures cache
+    boost::scoped_ptr<PersistentImageStore> _persistentImageStore; //< Images shared across sessions, disabled unless a location is set
     
     mutable QMutex diskCachesLocationMutex;
     QString diskCachesLocation;
@@ -91,6 +94,8 @@ struct AppManagerPrivate
     std::string currentOCIOConfigPath; //< the currentOCIO config path
     
     int idealThreadCount; // return value of QThread::idealThreadCount() cached here
+
+    boost::scoped_ptr<TaskScheduler> taskScheduler; // runs the parallel loops of the renders, created once idealThreadCount is known
     
     int nThreadsToRender; // the value held by the corresponding Knob in the Settings, stored here for faster access (3 RW lock vs 1 mutex here)
     int nThreadsPerEffect;  // the value held by the corresponding Knob in the Settings, stored here for faster access (3 RW lock vs 1 mutex here)
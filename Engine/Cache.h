@@ -32,6 +32,8 @@
 #include <fstream>
 #include <functional>
 #include <list>
+#include <map>
+#include <string>
 #include <cstddef>
 #include <utility>
 #include <algorithm> // min, max
@@ -49,6 +51,7 @@ GCC_DIAG_OFF(deprecated)
 GCC_DIAG_ON(deprecated)
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
 #include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
 #endif
 
 #include "Engine/AppManager.h" //for access to settings
@@ -57,6 +60,7 @@ GCC_DIAG_ON(deprecated)
 #include "Engine/LRUHashTable.h"
 #include "Engine/StandardPaths.h"
 #include "Engine/ImageLocker.h"
+#include "Engine/Timer.h"
 #include "Global/MemoryInfo.h"
 #include "Engine/EngineFwd.h"
 
@@ -309,7 +313,7 @@ private:
                     front = _requestsQueues.front();
                     _requestsQueues.pop_front();
                 }
-                cache->removeAllEntriesWithDifferentNodeHashForHolderPrivate(front.holderID, front.nodeHash, front.removeAll);
+                cache->removeAllEntriesWithNodeHashForHolderPrivate(front.holderID, front.nodeHash, front.removeAll);
             }
         }
     }
@@ -370,6 +374,76 @@ Q_SIGNALS:
 };
 
 
+/**
+ * @brief Counters of contention on the cache locks. Only contended acquisitions are timed
+ * so that the uncontended path stays a single tryLock().
+ **/
+struct CacheLockStats
+{
+    boost::atomic<U64> nLocks; // total number of acquisitions
+    boost::atomic<U64> nContendedLocks; // acquisitions that had to wait for another thread
+    boost::atomic<U64> waitMicroSeconds; // total time spent waiting on contended acquisitions
+
+    CacheLockStats()
+        : nLocks(0)
+        , nContendedLocks(0)
+        , waitMicroSeconds(0)
+    {
+    }
+
+    void reset()
+    {
+        nLocks = 0;
+        nContendedLocks = 0;
+        waitMicroSeconds = 0;
+    }
+};
+
+/**
+ * @brief Same as QMutexLocker, except that the time spent waiting for the mutex is recorded into the given stats.
+ **/
+class CacheMutexLocker
+{
+    QMutex* _mutex;
+
+public:
+
+    CacheMutexLocker(QMutex* mutex,
+                     CacheLockStats* stats)
+        : _mutex(mutex)
+    {
+        stats->nLocks.fetch_add(1, boost::memory_order_relaxed);
+        if ( _mutex->tryLock() ) {
+            return;
+        }
+        TimeLapse waitTimer;
+        _mutex->lock();
+        stats->nContendedLocks.fetch_add(1, boost::memory_order_relaxed);
+        stats->waitMicroSeconds.fetch_add( (U64)(waitTimer.getTimeElapsedReset() * 1e6), boost::memory_order_relaxed );
+    }
+
+    ~CacheMutexLocker()
+    {
+        _mutex->unlock();
+    }
+};
+
+/**
+ * @brief Subtracts amount from value without ever going below 0.
+ **/
+inline void
+cacheAtomicSubtractClamped(boost::atomic<std::size_t>& value,
+                           std::size_t amount)
+{
+    std::size_t cur = value.load();
+    std::size_t next;
+
+    do {
+        next = amount > cur ? 0 : cur - amount;
+    } while ( !value.compare_exchange_weak(cur, next) );
+}
+
+
 /*
  * ValueType must be derived of CacheEntryHelper
  */
@@ -394,7 +468,6 @@ public:
 
 public:
 
-
 #ifdef USE_VARIADIC_TEMPLATES
 
 #ifdef NATRON_CACHE_USE_BOOST
@@ -455,25 +528,57 @@ public:
 
 #endif // USE_VARIADIC_TEMPLATES
 
+
 private:
 
+    /**
+     * @brief Entries are distributed across shards according to their hash key. Each shard has its own
+     * LRU containers and locks so that threads accessing entries of different shards never wait on each other.
+     * A cache with a single shard behaves exactly like a cache with one global lock.
+     **/
+    struct CacheShard
+    {
+        QMutex lock; //protects memoryCache, compressedCache, diskCache & holderStats
+        QMutex getLock; //prevents get() and getOrCreate() to be called simultaneously for entries of this shard
+        CacheContainer memoryCache;
+        CacheContainer compressedCache; //entries evicted from memoryCache whose buffer was compressed in RAM
+        CacheContainer diskCache;
+        std::map<std::string, CacheEntryHolderStats> holderStats; //look-ups per holder ID, the occupancy is not stored here
+        CacheLockStats lockStats; //acquisitions of lock & getLock: per shard so that the threads of different shards do not share it
+
+        CacheShard()
+            : lock()
+            , getLock()
+            , memoryCache()
+            , compressedCache()
+            , diskCache()
+            , holderStats()
+            , lockStats()
+        {
+        }
+    };
+
+    typedef boost::shared_ptr<CacheShard> CacheShardPtr;
+
 
     std::size_t _maximumInMemorySize;     // the maximum size of the in-memory portion of the cache.(in % of the maximum cache size)
     std::size_t _maximumCacheSize;     // maximum size allowed for the cache
+    std::size_t _maximumCompressedSize;     // the maximum size of the compressed portion of the cache, 0 to disable it
 
     /*mutable because we need to change modify it in the sealEntryInternal function which
          is called by an external object that have a const ref to the cache.
      */
-    mutable std::size_t _memoryCacheSize;     // current size of the cache in bytes
-    mutable std::size_t _diskCacheSize;
-    mutable QMutex _sizeLock; // protects _memoryCacheSize & _diskCacheSize & _maximumInMemorySize & _maximumCacheSize
-    mutable QMutex _lock; //protects _memoryCache & _diskCache
-    mutable QMutex _getLock;  //prevents get() and getOrCreate() to be called simultaneously
-
-    /*These 2 are mutable because we need to modify the LRU list even
-         when we call get() and we want this function to be const.*/
-    mutable CacheContainer _memoryCache;
-    mutable CacheContainer _diskCache;
+    mutable boost::atomic<std::size_t> _memoryCacheSize;     // current size of the cache in bytes
+    mutable boost::atomic<std::size_t> _diskCacheSize;
+    mutable boost::atomic<std::size_t> _compressedCacheSize;
+    boost::atomic<std::size_t> _externalMemorySize; // memory allocated outside of the cache that counts against _maximumInMemorySize
+    mutable QMutex _sizeLock; // protects _maximumInMemorySize, _maximumCacheSize & _maximumCompressedSize and is used along with _memoryFullCondition
+
+    /*The shards are never added nor removed after construction. The containers they hold are modified
+         even when we call get() because of the LRU list and we want this function to be const.*/
+    std::vector<CacheShardPtr> _shards;
+    mutable boost::atomic<unsigned int> _evictionCursor; // shard from which the next LRU eviction not tied to a shard starts
+    boost::shared_ptr<CachePackStore> _packStore; // where the disk entries live, shared with the entries so it outlives them
     const std::string _cacheName;
     const unsigned int _version;
 
@@ -491,23 +596,31 @@ private:
 public:
 
 
+    /**
+     * @param nShards The number of independent portions the cache is split into. 1 means
+     * that all accesses to the cache are serialized by the same lock.
+     **/
     Cache(const std::string & cacheName
           ,
           unsigned int version
           ,
           U64 maximumCacheSize      // total size
           ,
-          double maximumInMemoryPercentage)      //how much should live in RAM
+          double maximumInMemoryPercentage      //how much should live in RAM
+          ,
+          unsigned int nShards = 1)
         : CacheAPI()
         , _maximumInMemorySize(maximumCacheSize * maximumInMemoryPercentage)
         , _maximumCacheSize(maximumCacheSize)
+        , _maximumCompressedSize(0)
         , _memoryCacheSize(0)
         , _diskCacheSize(0)
+        , _compressedCacheSize(0)
+        , _externalMemorySize(0)
         , _sizeLock()
-        , _lock()
-        , _getLock()
-        , _memoryCache()
-        , _diskCache()
+        , _shards()
+        , _evictionCursor(0)
+        , _packStore(new CachePackStore)
         , _cacheName(cacheName)
         , _version(version)
         , _signalEmitter(new CacheSignalEmitter)
@@ -517,15 +630,22 @@ public:
         , _memoryFullCondition()
         , _cleanerThread(this)
     {
+        nShards = std::max(nShards, 1U);
+        _shards.resize(nShards);
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            _shards[i].reset(new CacheShard);
+        }
     }
 
     virtual ~Cache()
     {
-        QMutexLocker locker(&_lock);
-
         _tearingDown = true;
-        _memoryCache.clear();
-        _diskCache.clear();
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            QMutexLocker locker(&_shards[i]->lock);
+            _shards[i]->memoryCache.clear();
+            _shards[i]->compressedCache.clear();
+            _shards[i]->diskCache.clear();
+        }
         delete _signalEmitter;
     }
 
@@ -535,6 +655,95 @@ public:
         _cleanerThread.quitThread();
     }
 
+    std::size_t getNumShards() const
+    {
+        return _shards.size();
+    }
+
+    /**
+     * @brief Memory allocated outside of the cache (e.g: by plug-ins for their temporary buffers) that counts against
+     * the maximum in-memory size: entries are evicted to make room for it when new entries are created.
+     * @param diff The number of bytes allocated, negative when they are freed.
+     **/
+    void notifyExternalMemoryChanged(qint64 diff)
+    {
+        if (diff < 0) {
+            cacheAtomicSubtractClamped(_externalMemorySize, (std::size_t)-diff);
+        } else {
+            _externalMemorySize += (std::size_t)diff;
+        }
+    }
+
+    std::size_t getExternalMemorySize() const
+    {
+        return _externalMemorySize.load();
+    }
+
+    /**
+     * @brief Set how the cache chooses the entries to evict when it is full. With eCacheEvictionPolicyGreedyDualSize
+     * the time entries took to be computed (@see CacheEntryHelper::addRecomputeCost) is weighed against their
+     * size and recency so that expensive results are kept longer than cheap ones.
+     **/
+    void setEvictionPolicy(CacheEvictionPolicyEnum policy)
+    {
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            QMutexLocker locker(&_shards[i]->lock);
+            _shards[i]->memoryCache.setEvictionPolicy(policy);
+            _shards[i]->compressedCache.setEvictionPolicy(policy);
+            _shards[i]->diskCache.setEvictionPolicy(policy);
+        }
+    }
+
+    CacheEvictionPolicyEnum getEvictionPolicy() const
+    {
+        QMutexLocker locker(&_shards[0]->lock);
+
+        return _shards[0]->memoryCache.getEvictionPolicy();
+    }
+
+    virtual boost::shared_ptr<CachePackStore> getPackStore() const OVERRIDE FINAL
+    {
+        return _packStore;
+    }
+
+    /**
+     * @brief Returns the number of pack files of the cache, their size on disk and the bytes used by entries.
+     **/
+    void getPackStats(std::size_t* nPacks,
+                      U64* reservedBytes,
+                      U64* usedBytes) const
+    {
+        _packStore->getStats(nPacks, reservedBytes, usedBytes);
+    }
+
+    /**
+     * @brief Returns the number of acquisitions of the cache locks, how many of them had to wait for another
+     * thread and the total time spent waiting (in seconds) since the cache creation or the last call to resetLockStats().
+     **/
+    void getLockStats(U64* nLocks,
+                      U64* nContendedLocks,
+                      double* waitSeconds) const
+    {
+        U64 waitMicroSeconds = 0;
+
+        *nLocks = 0;
+        *nContendedLocks = 0;
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            const CacheLockStats & stats = _shards[i]->lockStats;
+            *nLocks += stats.nLocks.load();
+            *nContendedLocks += stats.nContendedLocks.load();
+            waitMicroSeconds += stats.waitMicroSeconds.load();
+        }
+        *waitSeconds = waitMicroSeconds / 1e6;
+    }
+
+    void resetLockStats()
+    {
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            _shards[i]->lockStats.reset();
+        }
+    }
+
     /**
      * @brief Look-up the cache for an entry whose key matches the params.
      * @param params The key identifying the entry we're looking for.
@@ -549,22 +758,115 @@ public:
     bool get(const typename EntryType::key_type & key,
              std::list<EntryTypePtr>* returnValue) const
     {
-        ///Be atomic, so it cannot be created by another thread in the meantime
-        QMutexLocker getlocker(&_getLock);
+        CacheShard& shard = getShard( key.getHash() );
 
-        ///lock the cache before reading it.
-        QMutexLocker locker(&_lock);
+        ///Be atomic, so it cannot be created by another thread in the meantime
+        CacheMutexLocker getlocker(&shard.getLock, &shard.lockStats);
 
-        return getInternal(key, returnValue);
+        return getFromShard(shard, key, returnValue);
     } // get
 
 private:
 
-    void createInternal(const typename EntryType::key_type & key,
+    CacheShard& getShard(hash_type hash) const
+    {
+        if (_shards.size() == 1) {
+            return *_shards.front();
+        }
+        // Fold the high bits of the hash so that keys only differing by their high bits are still spread
+        U64 h = (U64)hash;
+
+        return *_shards[(std::size_t)( (h ^ (h >> 32) ) % _shards.size() )];
+    }
+
+    std::size_t getShardIndex(const CacheShard& shard) const
+    {
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            if (_shards[i].get() == &shard) {
+                return i;
+            }
+        }
+        assert(false);
+
+        return 0;
+    }
+
+    /**
+     * @brief Evicts the LRU entry of the in-memory portion of the shard at index firstShard.
+     * If nothing can be evicted from that shard, other shards are tried in turn.
+     * The lock of each shard is taken only while evicting from it, the evicted entry is compressed once it is released.
+     **/
+    bool tryEvictEntryFromAnyShard(std::size_t firstShard,
+                                   std::list<EntryTypePtr> & entriesToBeDeleted) const
+    {
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[(firstShard + i) % _shards.size()];
+            bool evicted;
+            {
+                CacheMutexLocker locker(&shard.lock, &shard.lockStats);
+                evicted = tryEvictEntry(shard, entriesToBeDeleted);
+            }
+            if (evicted) {
+                compressEvictedEntries(entriesToBeDeleted);
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Drops the LRU entry of the compressed portion of the shard at index firstShard.
+     * If nothing can be dropped from that shard, other shards are tried in turn.
+     **/
+    bool tryEvictCompressedEntryFromAnyShard(std::size_t firstShard,
+                                             std::list<EntryTypePtr> & entriesToBeDeleted) const
+    {
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[(firstShard + i) % _shards.size()];
+            CacheMutexLocker locker(&shard.lock, &shard.lockStats);
+            std::pair<hash_type, EntryTypePtr> evicted = shard.compressedCache.evict();
+            if (evicted.second) {
+                entriesToBeDeleted.push_back(evicted.second);
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Looks up the shard for the key, the caller holding shard.getLock only. An entry found in the compressed
+     * portion is decompressed out of shard.lock so that the other threads of the shard do not wait for it.
+     **/
+    bool getFromShard(CacheShard& shard,
+                      const typename EntryType::key_type & key,
+                      std::list<EntryTypePtr>* returnValue) const
+    {
+        ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
+        std::list<EntryTypePtr> entriesToBeDeleted;
+        EntryTypePtr compressedEntry;
+        bool found;
+        {
+            CacheMutexLocker locker(&shard.lock, &shard.lockStats);
+            found = getInternal(shard, key, returnValue, &compressedEntry, entriesToBeDeleted);
+        }
+        if (compressedEntry) {
+            found = decompressEntry(shard, key, compressedEntry, returnValue, entriesToBeDeleted);
+        }
+        compressEvictedEntries(entriesToBeDeleted);
+
+        return found;
+    }
+
+    void createInternal(CacheShard& shard,
+                        const typename EntryType::key_type & key,
                         const ParamsTypePtr & params,
                         EntryTypePtr* returnValue) const
     {
-        //_lock must not be taken here
+        //shard.lock must not be taken here
 
         ///Before allocating the memory check that there's enough space to fit in memory
         appPTR->checkCacheFreeMemoryIsGoodEnough();
@@ -586,18 +888,18 @@ private:
         U64 memoryCacheSize, maximumInMemorySize;
         {
             QMutexLocker k(&_sizeLock);
-            memoryCacheSize = _memoryCacheSize;
+            memoryCacheSize = _memoryCacheSize + _externalMemorySize;
             maximumInMemorySize = std::max( (std::size_t)1, _maximumInMemorySize );
         }
         {
-            QMutexLocker locker(&_lock);
             std::list<EntryTypePtr> entriesToBeDeleted;
             double occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
+            std::size_t shardIndex = getShardIndex(shard);
             ///While the current cache size can't fit the new entry, erase the last recently used entries.
             ///Also if the total free RAM is under the limit of the system free RAM to keep free, erase LRU entries.
             while (occupationPercentage > NATRON_CACHE_LIMIT_PERCENT) {
                 std::list<EntryTypePtr> deleted;
-                if ( !tryEvictEntry(deleted) ) {
+                if ( !tryEvictEntryFromAnyShard(shardIndex, deleted) ) {
                     break;
                 }
 
@@ -605,7 +907,7 @@ private:
                 //in tryEvictEntry
                 {
                     QMutexLocker k(&_sizeLock);
-                    memoryCacheSize = _memoryCacheSize;
+                    memoryCacheSize = _memoryCacheSize + _externalMemorySize;
                     maximumInMemorySize = std::max( (std::size_t)1, _maximumInMemorySize );
                 }
 
@@ -639,7 +941,7 @@ private:
             }
         }
         {
-            QMutexLocker locker(&_lock);
+            CacheMutexLocker locker(&shard.lock, &shard.lockStats);
             StorageModeEnum storage;
             if (params->getCost() == 0) {
                 storage = eStorageModeRAM;
@@ -664,7 +966,7 @@ private:
             }
 
             if (*returnValue) {
-                sealEntry(*returnValue, true);
+                sealEntry(shard, *returnValue, true);
             }
         }
     } // createInternal
@@ -674,13 +976,15 @@ public:
     void swapOrInsert(const EntryTypePtr& entryToBeEvicted,
                       const EntryTypePtr& newEntry)
     {
-        QMutexLocker locker(&_lock);
-        
         const typename EntryType::key_type& key = entryToBeEvicted->getKey();
         typename EntryType::hash_type hash = entryToBeEvicted->getHashKey();
+        CacheShard& shard = getShard(hash);
+
+        CacheMutexLocker locker(&shard.lock, &shard.lockStats);
+        
         ///find a matching value in the internal memory container
-        CacheIterator memoryCached = _memoryCache(hash);
-        if (memoryCached != _memoryCache.end()) {
+        CacheIterator memoryCached = shard.memoryCache(hash);
+        if (memoryCached != shard.memoryCache.end()) {
             std::list<EntryTypePtr> & ret = getValueFromIterator(memoryCached);
             for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                 if ( (*it)->getKey() == key && (*it)->getParams() == entryToBeEvicted->getParams()) {
@@ -692,8 +996,8 @@ public:
             ret.push_back(newEntry);
         } else {
             ///Look in disk cache
-            CacheIterator diskCached = _diskCache(hash);
-            if (diskCached != _diskCache.end()) {
+            CacheIterator diskCached = shard.diskCache(hash);
+            if (diskCached != shard.diskCache.end()) {
                 ///Remove the old entry
                 std::list<EntryTypePtr> & ret = getValueFromIterator(diskCached);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
@@ -705,7 +1009,7 @@ public:
 
             }
             ///Insert in mem cache
-            _memoryCache.insert(hash, newEntry);
+            shard.memoryCache.insert(hash, newEntry);
         }
     }
 
@@ -744,15 +1048,12 @@ public:
         ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
         ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
 
+        CacheShard& shard = getShard( key.getHash() );
         {
             ///Be atomic, so it cannot be created by another thread in the meantime
-            QMutexLocker getlocker(&_getLock);
+            CacheMutexLocker getlocker(&shard.getLock, &shard.lockStats);
             std::list<EntryTypePtr> entries;
-            bool didGetSucceed;
-            {
-                QMutexLocker locker(&_lock);
-                didGetSucceed = getInternal(key, &entries);
-            }
+            bool didGetSucceed = getFromShard(shard, key, &entries);
             if (didGetSucceed) {
                 for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
                     if (*(*it)->getParams() == *params) {
@@ -763,7 +1064,7 @@ public:
                 }
             }
 
-            createInternal(key, params, returnValue);
+            createInternal(shard, key, params, returnValue);
 
             return false;
         } // getlocker
@@ -781,15 +1082,21 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-        std::pair<hash_type, EntryTypePtr> evictedFromMemory = _memoryCache.evict();
-        while (evictedFromMemory.second) {
-            if ( evictedFromMemory.second->isStoredOnDisk() ) {
-                evictedFromMemory.second->removeAnyBackingFile();
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[i];
+            QMutexLocker locker(&shard.lock);
+            std::pair<hash_type, EntryTypePtr> evictedFromMemory = shard.memoryCache.evict();
+            while (evictedFromMemory.second) {
+                if ( evictedFromMemory.second->isStoredOnDisk() ) {
+                    evictedFromMemory.second->removeAnyBackingFile();
+                }
+                evictedFromMemory = shard.memoryCache.evict();
             }
-            evictedFromMemory = _memoryCache.evict();
+            clearCompressedPortion(shard);
         }
 
+        _packStore->releaseUnusedPacks();
+
         if (_signalEmitter) {
             _signalEmitter->blockSignals(false);
             _signalEmitter->emitSignalClearedInMemoryPortion();
@@ -806,18 +1113,22 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-
-        /// An entry which has a use_count greater than 1 is not removable:
-        /// The backing file must not be removed because it might be read/written to
-        /// at the same time. The best we can do is just let it here in the cache.
-        std::pair<hash_type, EntryTypePtr> evictedFromDisk = _diskCache.evict();
-        //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
-        //we'll let the user of these entries purge the extra entries left in the cache later on
-        while (evictedFromDisk.second) {
-            evictedFromDisk.second->removeAnyBackingFile();
-            evictedFromDisk = _diskCache.evict();
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[i];
+            QMutexLocker locker(&shard.lock);
+
+            /// An entry which has a use_count greater than 1 is not removable:
+            /// The backing file must not be removed because it might be read/written to
+            /// at the same time. The best we can do is just let it here in the cache.
+            std::pair<hash_type, EntryTypePtr> evictedFromDisk = shard.diskCache.evict();
+            //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
+            //we'll let the user of these entries purge the extra entries left in the cache later on
+            while (evictedFromDisk.second) {
+                evictedFromDisk.second->removeAnyBackingFile();
+                evictedFromDisk = shard.diskCache.evict();
+            }
         }
+        _packStore->releaseUnusedPacks();
 
 
         _signalEmitter->blockSignals(false);
@@ -833,49 +1144,53 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-        std::pair<hash_type, EntryTypePtr> evictedFromMemory = _memoryCache.evict();
-        while (evictedFromMemory.second) {
-            ///move back the entry on disk if it can be store on disk
-            if ( evictedFromMemory.second->isStoredOnDisk() ) {
-                evictedFromMemory.second->deallocate();
-                /*insert it back into the disk portion */
-
-                U64 diskCacheSize, maximumCacheSize;
-                {
-                    QMutexLocker k(&_sizeLock);
-                    diskCacheSize = _diskCacheSize;
-                    maximumCacheSize = _maximumCacheSize;
-                }
-
-                /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
-                while (diskCacheSize + evictedFromMemory.second->size() >= maximumCacheSize) {
-                    {
-                        std::pair<hash_type, EntryTypePtr> evictedFromDisk = _diskCache.evict();
-                        //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
-                        //we'll let the user of these entries purge the extra entries left in the cache later on
-                        if (!evictedFromDisk.second) {
-                            break;
-                        }
-                        ///Erase the file from the disk if we reach the limit.
-                        evictedFromDisk.second->removeAnyBackingFile();
-                    }
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[i];
+            QMutexLocker locker(&shard.lock);
+            std::pair<hash_type, EntryTypePtr> evictedFromMemory = shard.memoryCache.evict();
+            while (evictedFromMemory.second) {
+                ///move back the entry on disk if it can be store on disk
+                if ( evictedFromMemory.second->isStoredOnDisk() ) {
+                    evictedFromMemory.second->deallocate();
+                    /*insert it back into the disk portion */
+
+                    U64 diskCacheSize, maximumCacheSize;
                     {
                         QMutexLocker k(&_sizeLock);
                         diskCacheSize = _diskCacheSize;
                         maximumCacheSize = _maximumCacheSize;
                     }
-                }
 
-                /*update the disk cache size*/
-                CacheIterator existingDiskCacheEntry = _diskCache( evictedFromMemory.second->getHashKey() );
-                /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
-                if ( existingDiskCacheEntry == _diskCache.end() ) {
-                    _diskCache.insert(evictedFromMemory.second->getHashKey(), evictedFromMemory.second);
+                    /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
+                    while (diskCacheSize + evictedFromMemory.second->size() >= maximumCacheSize) {
+                        {
+                            std::pair<hash_type, EntryTypePtr> evictedFromDisk = shard.diskCache.evict();
+                            //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
+                            //we'll let the user of these entries purge the extra entries left in the cache later on
+                            if (!evictedFromDisk.second) {
+                                break;
+                            }
+                            ///Erase the file from the disk if we reach the limit.
+                            evictedFromDisk.second->removeAnyBackingFile();
+                        }
+                        {
+                            QMutexLocker k(&_sizeLock);
+                            diskCacheSize = _diskCacheSize;
+                            maximumCacheSize = _maximumCacheSize;
+                        }
+                    }
+
+                    /*update the disk cache size*/
+                    CacheIterator existingDiskCacheEntry = shard.diskCache( evictedFromMemory.second->getHashKey() );
+                    /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
+                    if ( existingDiskCacheEntry == shard.diskCache.end() ) {
+                        shard.diskCache.insert(evictedFromMemory.second->getHashKey(), evictedFromMemory.second);
+                    }
                 }
-            }
 
-            evictedFromMemory = _memoryCache.evict();
+                evictedFromMemory = shard.memoryCache.evict();
+            }
+            clearCompressedPortion(shard);
         }
 
         _signalEmitter->blockSignals(false);
@@ -891,26 +1206,30 @@ public:
         std::list<EntryTypePtr> entriesToBeDeleted;
 
         {
-            QMutexLocker locker(&_lock);
             U64 memoryCacheSize, maximumInMemorySize;
             {
                 QMutexLocker k(&_sizeLock);
-                memoryCacheSize = _memoryCacheSize;
+                memoryCacheSize = _memoryCacheSize + _externalMemorySize;
                 maximumInMemorySize = std::max( (std::size_t)1, _maximumInMemorySize );
             }
             double occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
+            //Size of the evicted entries that are still counted in _memoryCacheSize until they get destroyed
+            std::size_t pendingDeletionSize = 0;
             while (occupationPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
                 std::list<EntryTypePtr> deleted;
-                if ( !tryEvictEntry(deleted) ) {
+                if ( !tryEvictEntryFromAnyShard(_evictionCursor.fetch_add(1) % _shards.size(), deleted) ) {
                     break;
                 }
 
                 for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
-                    if ( !(*it)->isStoredOnDisk() ) {
-                        memoryCacheSize -= (*it)->size();
+                    if ( !(*it)->isStoredOnDisk() && !(*it)->isCompressed() ) {
+                        pendingDeletionSize += (*it)->size();
                     }
                     entriesToBeDeleted.push_back(*it);
                 }
+                //Entries that were compressed instead of deleted have already left _memoryCacheSize
+                memoryCacheSize = _memoryCacheSize + _externalMemorySize;
+                memoryCacheSize = pendingDeletionSize > memoryCacheSize ? 0 : memoryCacheSize - pendingDeletionSize;
                 occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
             }
         }
@@ -923,15 +1242,19 @@ public:
      **/
     void getCopy(std::list<EntryTypePtr>* copy) const
     {
-        QMutexLocker locker(&_lock);
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[i];
+            QMutexLocker locker(&shard.lock);
 
-        for (CacheIterator it = _memoryCache.begin(); it != _memoryCache.end(); ++it) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
-            copy->insert( copy->end(), entries.begin(), entries.end() );
-        }
-        for (CacheIterator it = _diskCache.begin(); it != _diskCache.end(); ++it) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
-            copy->insert( copy->end(), entries.begin(), entries.end() );
+            for (CacheIterator it = shard.memoryCache.begin(); it != shard.memoryCache.end(); ++it) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+                copy->insert( copy->end(), entries.begin(), entries.end() );
+            }
+            for (CacheIterator it = shard.diskCache.begin(); it != shard.diskCache.end(); ++it) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+                copy->insert( copy->end(), entries.begin(), entries.end() );
+            }
+            ///The entries of the compressed portion are left out: their buffer is not usable until get() decompresses them
         }
     }
 
@@ -945,13 +1268,20 @@ public:
         ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
         ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
         std::list<EntryTypePtr> entriesToBeDeleted;
-        bool ret;
-        {
-            QMutexLocker locker(&_lock);
-            ret = tryEvictEntry(entriesToBeDeleted);
-        }
 
-        return ret;
+        return tryEvictEntryFromAnyShard(_evictionCursor.fetch_add(1) % _shards.size(), entriesToBeDeleted);
+    }
+
+    /**
+     * @brief Drops the last recently used entry from the compressed portion of the cache.
+     * Returns false if there's nothing left to drop.
+     **/
+    bool evictLRUCompressedEntry() const
+    {
+        ///The entry is freed here, out of the lock
+        std::list<EntryTypePtr> entriesToBeDeleted;
+
+        return tryEvictCompressedEntryFromAnyShard(_evictionCursor.fetch_add(1) % _shards.size(), entriesToBeDeleted);
     }
 
     /**
@@ -961,20 +1291,27 @@ public:
      **/
     bool evictLRUDiskEntry() const
     {
-        QMutexLocker locker(&_lock);
-        std::pair<hash_type, EntryTypePtr> evicted = _diskCache.evict();
+        std::size_t firstShard = _evictionCursor.fetch_add(1) % _shards.size();
 
-        //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
-        //we'll let the user of these entries purge the extra entries left in the cache later on
-        if (!evicted.second) {
-            return false;
-        }
-        /*if it is stored on disk, remove it from memory*/
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[(firstShard + i) % _shards.size()];
+            CacheMutexLocker locker(&shard.lock, &shard.lockStats);
+            std::pair<hash_type, EntryTypePtr> evicted = shard.diskCache.evict();
 
-        assert( evicted.second.unique() );
-        evicted.second->removeAnyBackingFile();
+            //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
+            //we'll let the user of these entries purge the extra entries left in the cache later on
+            if (!evicted.second) {
+                continue;
+            }
+            /*if it is stored on disk, remove it from memory*/
 
-        return true;
+            assert( evicted.second.unique() );
+            evicted.second->removeAnyBackingFile();
+
+            return true;
+        }
+
+        return false;
     }
 
     /**
@@ -984,9 +1321,6 @@ public:
     virtual void notifyEntrySizeChanged(std::size_t oldSize,
                                         std::size_t newSize) const OVERRIDE FINAL
     {
-        ///The entry has notified it's memory layout has changed, it must have been due to an action from the cache
-        QMutexLocker k(&_sizeLock);
-
         ///This function can only be called for RAM buffers or while a memory mapped file is mapped into the RAM, so
         ///we just have to modify the RAM size.
 
@@ -994,7 +1328,7 @@ public:
         qint64 diff = (qint64)newSize - (qint64)oldSize;
 
         if (diff < 0) {
-            _memoryCacheSize = diff > (qint64)_memoryCacheSize ? 0 : _memoryCacheSize + diff;
+            cacheAtomicSubtractClamped(_memoryCacheSize, (std::size_t)-diff);
         } else {
             _memoryCacheSize += diff;
         }
@@ -1010,16 +1344,9 @@ public:
                                       std::size_t size,
                                       StorageModeEnum storage) const OVERRIDE FINAL
     {
-        ///The entry has notified it's memory layout has changed, it must have been due to an action from the cache, hence the
-        ///lock should already be taken.
-        QMutexLocker k(&_sizeLock);
-
+        Q_UNUSED(storage);
         _memoryCacheSize += size;
         _signalEmitter->emitAddedEntry(time);
-
-        if (storage == eStorageModeDisk) {
-            appPTR->increaseNCacheFilesOpened();
-        }
 #ifdef NATRON_DEBUG_CACHE
         qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
 #endif
@@ -1032,15 +1359,13 @@ public:
                                       std::size_t size,
                                       StorageModeEnum storage) const OVERRIDE FINAL
     {
-        QMutexLocker k(&_sizeLock);
-
         if (storage == eStorageModeRAM) {
-            _memoryCacheSize = size > _memoryCacheSize ? 0 : _memoryCacheSize - size;
+            cacheAtomicSubtractClamped(_memoryCacheSize, size);
 #ifdef NATRON_DEBUG_CACHE
             qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
 #endif
         } else if (storage == eStorageModeDisk) {
-            _diskCacheSize = size > _diskCacheSize ? 0 : _diskCacheSize - size;
+            cacheAtomicSubtractClamped(_diskCacheSize, size);
 #ifdef NATRON_DEBUG_CACHE
             qDebug() << cacheName().c_str() << " disk size: " << printAsRAM(_diskCacheSize);
 #endif
@@ -1069,28 +1394,23 @@ public:
         if (_tearingDown) {
             return;
         }
-        QMutexLocker k(&_sizeLock);
 
         assert(oldStorage != newStorage);
         assert(newStorage != eStorageModeNone);
         if (oldStorage == eStorageModeRAM) {
-            _memoryCacheSize = size > _memoryCacheSize ? 0 : _memoryCacheSize - size;
+            cacheAtomicSubtractClamped(_memoryCacheSize, size);
             _diskCacheSize += size;
 #ifdef NATRON_DEBUG_CACHE
             qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
             qDebug() << cacheName().c_str() << " disk size: " << printAsRAM(_diskCacheSize);
 #endif
-            ///We switched from RAM to DISK that means the MemoryFile object has been destroyed hence the file has been closed.
-            appPTR->decreaseNCacheFilesOpened();
         } else if (oldStorage == eStorageModeDisk) {
             _memoryCacheSize += size;
-            _diskCacheSize = size > _diskCacheSize ? 0 : _diskCacheSize - size;
+            cacheAtomicSubtractClamped(_diskCacheSize, size);
 #ifdef NATRON_DEBUG_CACHE
             qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
             qDebug() << cacheName().c_str() << " disk size: " << printAsRAM(_diskCacheSize);
 #endif
-            ///We switched from DISK to RAM that means the MemoryFile object has been created and the file opened
-            appPTR->increaseNCacheFilesOpened();
         } else {
             if (newStorage == eStorageModeRAM) {
                 _memoryCacheSize += size;
@@ -1102,11 +1422,53 @@ public:
         _signalEmitter->emitEntryStorageChanged(time, (int)oldStorage, (int)newStorage);
     }
 
+    virtual void notifyEntryCompressionChanged(bool compressed,
+                                               std::size_t ramSize,
+                                               std::size_t compressedSize) const OVERRIDE FINAL
+    {
+        if (compressed) {
+            cacheAtomicSubtractClamped(_memoryCacheSize, ramSize);
+            _compressedCacheSize += compressedSize;
+        } else {
+            _memoryCacheSize += ramSize;
+            cacheAtomicSubtractClamped(_compressedCacheSize, compressedSize);
+        }
+#ifdef NATRON_DEBUG_CACHE
+        qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
+        qDebug() << cacheName().c_str() << " compressed size: " << printAsRAM(_compressedCacheSize);
+#endif
+    }
+
+    virtual void notifyCompressedEntryDestroyed(double time,
+                                                std::size_t compressedSize) const OVERRIDE FINAL
+    {
+        cacheAtomicSubtractClamped(_compressedCacheSize, compressedSize);
+#ifdef NATRON_DEBUG_CACHE
+        qDebug() << cacheName().c_str() << " compressed size: " << printAsRAM(_compressedCacheSize);
+#endif
+        _signalEmitter->emitRemovedEntry(time, (int)eStorageModeRAM);
+    }
+
+    virtual void backingFileOpened() const OVERRIDE FINAL
+    {
+        appPTR->increaseNCacheFilesOpened();
+    }
+
     virtual void backingFileClosed() const OVERRIDE FINAL
     {
         appPTR->decreaseNCacheFilesOpened();
     }
 
+    virtual void notifyEntryRecomputeCostChanged(U64 hashKey) const OVERRIDE FINAL
+    {
+        CacheShard& shard = getShard(hashKey);
+        CacheMutexLocker locker(&shard.lock, &shard.lockStats);
+
+        shard.memoryCache.refreshPriority(hashKey);
+        shard.compressedCache.refreshPriority(hashKey);
+        shard.diskCache.refreshPriority(hashKey);
+    }
+
     // const data member: no need to take the lock
     const std::string & cacheName() const
     {
@@ -1159,6 +1521,24 @@ public:
         _maximumInMemorySize = _maximumCacheSize * percentage;
     }
 
+    /**
+     * @brief Entries evicted from the in-memory portion that are not stored on disk are compressed
+     * and kept in RAM in a portion of at most this size (in % of the maximum cache size) instead of being destroyed.
+     * 0 disables the compressed portion.
+     **/
+    void setMaximumCompressedSize(double percentage)
+    {
+        QMutexLocker k(&_sizeLock);
+
+        _maximumCompressedSize = _maximumCacheSize * percentage;
+    }
+
+    std::size_t getMaximumCompressedSize() const
+    {
+        QMutexLocker k(&_sizeLock);
+        return _maximumCompressedSize;
+    }
+
     std::size_t getMaximumSize() const
     {
         QMutexLocker k(&_sizeLock);
@@ -1173,16 +1553,19 @@ public:
 
     std::size_t getMemoryCacheSize() const
     {
-        QMutexLocker k(&_sizeLock);
         return _memoryCacheSize;
     }
 
     std::size_t getDiskCacheSize() const
     {
-        QMutexLocker k(&_sizeLock);
         return _diskCacheSize;
     }
 
+    std::size_t getCompressedCacheSize() const
+    {
+        return _compressedCacheSize;
+    }
+
     CacheSignalEmitter* activateSignalEmitter() const
     {
         return _signalEmitter;
@@ -1200,9 +1583,10 @@ public:
         std::list<EntryTypePtr> toRemove;
 
         {
-            QMutexLocker l(&_lock);
-            CacheIterator existingEntry = _memoryCache( entry->getHashKey() );
-            if ( existingEntry != _memoryCache.end() ) {
+            CacheShard& shard = getShard( entry->getHashKey() );
+            CacheMutexLocker l(&shard.lock, &shard.lockStats);
+            CacheIterator existingEntry = shard.memoryCache( entry->getHashKey() );
+            if ( existingEntry != shard.memoryCache.end() ) {
                 std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                     if ( (*it)->getKey() == entry->getKey() ) {
@@ -1212,11 +1596,23 @@ public:
                     }
                 }
                 if ( ret.empty() ) {
-                    _memoryCache.erase(existingEntry);
+                    shard.memoryCache.erase(existingEntry);
+                }
+            } else if ( ( existingEntry = shard.compressedCache( entry->getHashKey() ) ) != shard.compressedCache.end() ) {
+                std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
+                for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
+                    if ( (*it)->getKey() == entry->getKey() ) {
+                        toRemove.push_back(*it);
+                        ret.erase(it);
+                        break;
+                    }
+                }
+                if ( ret.empty() ) {
+                    shard.compressedCache.erase(existingEntry);
                 }
             } else {
-                existingEntry = _diskCache( entry->getHashKey() );
-                if ( existingEntry != _diskCache.end() ) {
+                existingEntry = shard.diskCache( entry->getHashKey() );
+                if ( existingEntry != shard.diskCache.end() ) {
                     std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                     for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                         if ( (*it)->getKey() == entry->getKey() ) {
@@ -1226,11 +1622,11 @@ public:
                         }
                     }
                     if ( ret.empty() ) {
-                        _diskCache.erase(existingEntry);
+                        shard.diskCache.erase(existingEntry);
                     }
                 }
             }
-        } // QMutexLocker l(&_lock);
+        } // CacheMutexLocker l(&shard.lock);
         if ( !toRemove.empty() ) {
             _deleterThread.appendToQueue(toRemove);
 
@@ -1244,25 +1640,32 @@ public:
     {
         std::list<EntryTypePtr> toRemove;
         {
-            QMutexLocker l(&_lock);
-            CacheIterator existingEntry = _memoryCache( hash);
-            if ( existingEntry != _memoryCache.end() ) {
+            CacheShard& shard = getShard(hash);
+            CacheMutexLocker l(&shard.lock, &shard.lockStats);
+            CacheIterator existingEntry = shard.memoryCache( hash);
+            if ( existingEntry != shard.memoryCache.end() ) {
+                std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
+                for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
+                    toRemove.push_back(*it);
+                }
+                shard.memoryCache.erase(existingEntry);
+            } else if ( ( existingEntry = shard.compressedCache(hash) ) != shard.compressedCache.end() ) {
                 std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                     toRemove.push_back(*it);
                 }
-                _memoryCache.erase(existingEntry);
+                shard.compressedCache.erase(existingEntry);
             } else {
-                existingEntry = _diskCache( hash );
-                if ( existingEntry != _diskCache.end() ) {
+                existingEntry = shard.diskCache( hash );
+                if ( existingEntry != shard.diskCache.end() ) {
                     std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                     for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                         toRemove.push_back(*it);
                     }
-                    _diskCache.erase(existingEntry);
+                    shard.diskCache.erase(existingEntry);
                 }
             }
-        } // QMutexLocker l(&_lock);
+        } // CacheMutexLocker l(&shard.lock);
 
         if ( !toRemove.empty() ) {
             _deleterThread.appendToQueue(toRemove);
@@ -1281,8 +1684,8 @@ public:
     /*Restores the cache from disk.*/
     void restore(const CacheTOC & tableOfContents);
 
-    void removeAllEntriesWithDifferentNodeHashForHolderPublic(const CacheEntryHolder* holder,
-                                                              U64 nodeHash)
+    void removeAllEntriesWithNodeHashForHolderPublic(const CacheEntryHolder* holder,
+                                                     U64 nodeHash)
     {
         _cleanerThread.appendToQueue(holder->getCacheID(), nodeHash, false);
     }
@@ -1290,100 +1693,87 @@ public:
     void removeAllEntriesForHolderPublic(const CacheEntryHolder* holder, bool blocking)
     {
         if (blocking) {
-            removeAllEntriesWithDifferentNodeHashForHolderPrivate(holder->getCacheID(), 0, true);
+            removeAllEntriesWithNodeHashForHolderPrivate(holder->getCacheID(), 0, true);
         } else {
             _cleanerThread.appendToQueue(holder->getCacheID(), 0, true);
         }
     }
     
+    /**
+     * @brief Adds to stats the memory occupied by the entries of the holder in each portion of the cache
+     * and how its look-ups were satisfied.
+     **/
     void getMemoryStatsForCacheEntryHolder(const CacheEntryHolder* holder,
-                                      std::size_t* ramOccupied,
-                                      std::size_t* diskOccupied) const
+                                           CacheEntryHolderStats* stats) const
     {
-        *ramOccupied = 0;
-        *diskOccupied= 0;
-        
         std::string holderID = holder->getCacheID();
         
-        QMutexLocker locker(&_lock);
-        
-        for (CacheIterator memIt = _memoryCache.begin(); memIt != _memoryCache.end(); ++memIt) {
-            std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
-            if ( !entries.empty() ) {
-                
-                const EntryTypePtr & front = entries.front();
-                
-                if (front->getKey().getCacheHolderID() == holderID) {
-                    for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
-                        *ramOccupied += (*it)->size();
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[i];
+            QMutexLocker locker(&shard.lock);
+            
+            for (CacheIterator memIt = shard.memoryCache.begin(); memIt != shard.memoryCache.end(); ++memIt) {
+                std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
+                if ( !entries.empty() ) {
+                    
+                    const EntryTypePtr & front = entries.front();
+                    
+                    if (front->getKey().getCacheHolderID() == holderID) {
+                        for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
+                            stats->ramOccupied += (*it)->size();
+                        }
                     }
                 }
             }
-        }
-        
-        for (CacheIterator memIt = _diskCache.begin(); memIt != _diskCache.end(); ++memIt) {
-            std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
-            if ( !entries.empty() ) {
-                
-                const EntryTypePtr & front = entries.front();
-                
-                if (front->getKey().getCacheHolderID() == holderID) {
+
+            for (CacheIterator cIt = shard.compressedCache.begin(); cIt != shard.compressedCache.end(); ++cIt) {
+                std::list<EntryTypePtr> & entries = getValueFromIterator(cIt);
+                if ( !entries.empty() && (entries.front()->getKey().getCacheHolderID() == holderID) ) {
                     for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
-                        *diskOccupied += (*it)->size();
+                        stats->compressedOccupied += (*it)->getCompressedSize();
                     }
                 }
             }
-        }
-    }
-
-private:
-
-    virtual void removeAllEntriesWithDifferentNodeHashForHolderPrivate(const std::string & holderID,
-                                                                       U64 nodeHash,
-                                                                       bool removeAll) OVERRIDE FINAL
-    {
-        std::list<EntryTypePtr> toDelete;
-        CacheContainer newMemCache, newDiskCache;
-        {
-            QMutexLocker locker(&_lock);
-
-            for (CacheIterator memIt = _memoryCache.begin(); memIt != _memoryCache.end(); ++memIt) {
+            
+            for (CacheIterator memIt = shard.diskCache.begin(); memIt != shard.diskCache.end(); ++memIt) {
                 std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
                 if ( !entries.empty() ) {
+                    
                     const EntryTypePtr & front = entries.front();
-
-                    if ( (front->getKey().getCacheHolderID() == holderID) &&
-                         ( ( front->getKey().getTreeVersion() != nodeHash) || removeAll ) ) {
+                    
+                    if (front->getKey().getCacheHolderID() == holderID) {
                         for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
-                            toDelete.push_back(*it);
+                            stats->diskOccupied += (*it)->size();
                         }
-                    } else {
-                        typename EntryType::hash_type hash = front->getHashKey();
-                        newMemCache.insert(hash, entries);
                     }
                 }
             }
 
-            for (CacheIterator dIt = _diskCache.begin(); dIt != _diskCache.end(); ++dIt) {
-                std::list<EntryTypePtr> & entries = getValueFromIterator(dIt);
-                if ( !entries.empty() ) {
-                    const EntryTypePtr & front = entries.front();
-
-                    if ( (front->getKey().getCacheHolderID() == holderID) &&
-                         ( ( front->getKey().getTreeVersion() != nodeHash) || removeAll ) ) {
-                        for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
-                            toDelete.push_back(*it);
-                        }
-                    } else {
-                        typename EntryType::hash_type hash = front->getHashKey();
-                        newDiskCache.insert(hash, entries);
-                    }
-                }
+            typename std::map<std::string, CacheEntryHolderStats>::const_iterator foundStats = shard.holderStats.find(holderID);
+            if ( foundStats != shard.holderStats.end() ) {
+                stats->memoryHits += foundStats->second.memoryHits;
+                stats->compressedHits += foundStats->second.compressedHits;
+                stats->diskHits += foundStats->second.diskHits;
+                stats->misses += foundStats->second.misses;
             }
+        }
+    }
+
+private:
+
+    virtual void removeAllEntriesWithNodeHashForHolderPrivate(const std::string & holderID,
+                                                              U64 nodeHash,
+                                                              bool removeAll) OVERRIDE FINAL
+    {
+        std::list<EntryTypePtr> toDelete;
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            CacheShard& shard = *_shards[i];
+            CacheMutexLocker locker(&shard.lock, &shard.lockStats);
 
-            _memoryCache = newMemCache;
-            _diskCache = newDiskCache;
-        } // QMutexLocker locker(&_lock);
+            removeEntriesOfHolder(holderID, nodeHash, removeAll, &shard.memoryCache, &toDelete);
+            removeEntriesOfHolder(holderID, nodeHash, removeAll, &shard.compressedCache, &toDelete);
+            removeEntriesOfHolder(holderID, nodeHash, removeAll, &shard.diskCache, &toDelete);
+        } // for each shard
 
         if ( !toDelete.empty() ) {
             _deleterThread.appendToQueue(toDelete);
@@ -1392,18 +1782,66 @@ private:
             ///that the separate thread will delete
             toDelete.clear();
         }
-    } // removeAllEntriesWithDifferentNodeHashForHolderPrivate
+    } // removeAllEntriesWithNodeHashForHolderPrivate
+
+    /**
+     * @brief Moves to toDelete the entries of container that match the holderID and have the given nodeHash.
+     * The other entries are left in place: their recency and the inflation of the GreedyDual-Size policy are kept.
+     * @param removeAll If true, remove the entries of the holder whatever their nodeHash
+     **/
+    static void removeEntriesOfHolder(const std::string & holderID,
+                                      U64 nodeHash,
+                                      bool removeAll,
+                                      CacheContainer* container,
+                                      std::list<EntryTypePtr>* toDelete)
+    {
+        CacheIterator it = container->begin();
+
+        while ( it != container->end() ) {
+            std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+            if ( entries.empty() ||
+                 ( ( entries.front()->getKey().getCacheHolderID() == holderID) &&
+                   ( ( entries.front()->getKey().getTreeVersion() == nodeHash) || removeAll ) ) ) {
+                toDelete->insert( toDelete->end(), entries.begin(), entries.end() );
+                container->erase(it++);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    /**
+     * @brief Drops all the entries of the compressed portion of the shard that are not used elsewhere.
+     **/
+    void clearCompressedPortion(CacheShard& shard)
+    {
+        assert( !shard.lock.tryLock() );
+        std::pair<hash_type, EntryTypePtr> evicted = shard.compressedCache.evict();
+        while (evicted.second) {
+            evicted = shard.compressedCache.evict();
+        }
+    }
 
-    bool getInternal(const typename EntryType::key_type & key,
-                     std::list<EntryTypePtr>* returnValue) const
+    /**
+     * @brief Looks up the shard for the key. An entry found in the compressed portion is removed from it and returned in
+     * compressedEntry instead of returnValue: the caller decompresses it with decompressEntry() once shard.lock is released.
+     * The entries evicted to make room for an entry read back from the disk are appended to entriesToBeDeleted.
+     **/
+    bool getInternal(CacheShard& shard,
+                     const typename EntryType::key_type & key,
+                     std::list<EntryTypePtr>* returnValue,
+                     EntryTypePtr* compressedEntry,
+                     std::list<EntryTypePtr> & entriesToBeDeleted) const
     {
         ///Private should be locked
-        assert( !_lock.tryLock() );
+        assert( !shard.lock.tryLock() );
+
+        CacheEntryHolderStats& stats = shard.holderStats[key.getCacheHolderID()];
 
         ///find a matching value in the internal memory container
-        CacheIterator memoryCached = _memoryCache( key.getHash() );
+        CacheIterator memoryCached = shard.memoryCache( key.getHash() );
 
-        if ( memoryCached != _memoryCache.end() ) {
+        if ( memoryCached != shard.memoryCache.end() ) {
             ///we found something with a matching hash key. There may be several entries linked to
             ///this key, we need to find one with matching params
             std::list<EntryTypePtr> & ret = getValueFromIterator(memoryCached);
@@ -1419,109 +1857,201 @@ private:
                 }
             }
 
-            return returnValue->size() > 0;
-        } else {
-            ///fallback on the disk cache internal container
-            CacheIterator diskCached = _diskCache( key.getHash() );
+            if ( returnValue->empty() ) {
+                ++stats.misses;
 
-            if ( diskCached == _diskCache.end() ) {
-                /*the entry was neither in memory or disk, just allocate a new one*/
                 return false;
-            } else {
-                /*we found something with a matching hash key. There may be several entries linked to
-                   this key, we need to find one with matching values(operator ==)*/
-                std::list<EntryTypePtr> & ret = getValueFromIterator(diskCached);
+            }
+            ++stats.memoryHits;
 
-                for (typename std::list<EntryTypePtr>::iterator it = ret.begin();
-                     it != ret.end(); ++it) {
-                    if ( (*it)->getKey() == key ) {
-                        /*If we found 1 entry in the list that has exactly the same key params,
-                           we re-open the mapping to the RAM put the entry
-                           back into the memoryCache.*/
-
-                        try {
-                            (*it)->reOpenFileMapping();
-                        } catch (const std::exception & e) {
-                            qDebug() << "Error while reopening cache file: " << e.what();
-                            ret.erase(it);
+            return true;
+        }
 
-                            return false;
-                        } catch (...) {
-                            qDebug() << "Error while reopening cache file";
-                            ret.erase(it);
+        ///fallback on the compressed portion
+        CacheIterator compressedCached = shard.compressedCache( key.getHash() );
+        if ( compressedCached != shard.compressedCache.end() ) {
+            std::list<EntryTypePtr> & ret = getValueFromIterator(compressedCached);
+            for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
+                if ( (*it)->getKey() == key ) {
+                    ///The other threads do not find it until it is decompressed and put back into the RAM
+                    *compressedEntry = *it;
+                    ret.erase(it);
+                    if ( ret.empty() ) {
+                        shard.compressedCache.erase(compressedCached);
+                    }
 
-                            return false;
-                        }
+                    return false;
+                }
+            }
+        }
 
-                        //put it back into the RAM
-                        _memoryCache.insert( (*it)->getHashKey(), *it );
-                        
+        ///fallback on the disk cache internal container
+        CacheIterator diskCached = shard.diskCache( key.getHash() );
 
-                        U64 memoryCacheSize, maximumInMemorySize;
-                        {
-                            QMutexLocker k(&_sizeLock);
-                            memoryCacheSize = _memoryCacheSize;
-                            maximumInMemorySize = _maximumInMemorySize;
-                        }
-                        std::list<EntryTypePtr> entriesToBeDeleted;
+        if ( diskCached == shard.diskCache.end() ) {
+            /*the entry was neither in memory or disk, just allocate a new one*/
+            ++stats.misses;
 
-                        //now clear extra entries from the disk cache so it doesn't exceed the RAM limit.
-                        while (memoryCacheSize > maximumInMemorySize) {
-                            if ( !tryEvictEntry(entriesToBeDeleted) ) {
-                                break;
-                            }
+            return false;
+        }
 
-                            {
-                                QMutexLocker k(&_sizeLock);
-                                memoryCacheSize = _memoryCacheSize;
-                                maximumInMemorySize = _maximumInMemorySize;
-                            }
-                        }
+        /*we found something with a matching hash key. There may be several entries linked to
+           this key, we need to find one with matching values(operator ==)*/
+        std::list<EntryTypePtr> & ret = getValueFromIterator(diskCached);
+
+        for (typename std::list<EntryTypePtr>::iterator it = ret.begin();
+             it != ret.end(); ++it) {
+            if ( (*it)->getKey() == key ) {
+                /*If we found 1 entry in the list that has exactly the same key params,
+                   we re-open the mapping to the RAM put the entry
+                   back into the memoryCache.*/
+
+                try {
+                    (*it)->reOpenFileMapping();
+                } catch (const std::exception & e) {
+                    qDebug() << "Error while reopening cache file: " << e.what();
+                    ret.erase(it);
+                    ++stats.misses;
 
-                        returnValue->push_back(*it);
-                        ret.erase(it);
-                        ///Q_EMIT te added signal otherwise when first reading something that's already cached
-                        ///the timeline wouldn't update
-                        if (_signalEmitter) {
-                            _signalEmitter->emitAddedEntry( key.getTime() );
-                        }
-                        
-                        ///Remove it from the disk cache
-                        _diskCache.erase(diskCached);
-                        
-                        return true;
-                    }
+                    return false;
+                } catch (...) {
+                    qDebug() << "Error while reopening cache file";
+                    ret.erase(it);
+                    ++stats.misses;
+
+                    return false;
                 }
 
-                /*if we reache here it means no entries linked to the hash key matches the params,then
-                   we allocate a new one*/
-                return false;
+                //put it back into the RAM
+                shard.memoryCache.insert( (*it)->getHashKey(), *it );
+
+                evictInMemoryEntriesExceedingLimit(shard, entriesToBeDeleted);
+
+                returnValue->push_back(*it);
+                ret.erase(it);
+                ///Q_EMIT te added signal otherwise when first reading something that's already cached
+                ///the timeline wouldn't update
+                if (_signalEmitter) {
+                    _signalEmitter->emitAddedEntry( key.getTime() );
+                }
+
+                ///Remove it from the disk cache
+                shard.diskCache.erase(diskCached);
+                ++stats.diskHits;
+
+                return true;
             }
         }
+
+        /*if we reache here it means no entries linked to the hash key matches the params,then
+           we allocate a new one*/
+        ++stats.misses;
+
+        return false;
     } // getInternal
 
+    /**
+     * @brief Decompresses an entry that getInternal() removed from the compressed portion of the shard and puts it back
+     * into the in-memory portion. shard.lock must not be held: it is only taken once the entry is decompressed.
+     **/
+    bool decompressEntry(CacheShard& shard,
+                         const typename EntryType::key_type & key,
+                         const EntryTypePtr & entry,
+                         std::list<EntryTypePtr>* returnValue,
+                         std::list<EntryTypePtr> & entriesToBeDeleted) const
+    {
+        bool decompressed;
+        try {
+            decompressed = entry->decompressData();
+        } catch (const std::bad_alloc & e) {
+            decompressed = false;
+        }
+
+        CacheMutexLocker locker(&shard.lock, &shard.lockStats);
+        CacheEntryHolderStats& stats = shard.holderStats[key.getCacheHolderID()];
+        if (!decompressed) {
+            qDebug() << "Error while decompressing cache entry";
+            ++stats.misses;
+
+            return false;
+        }
+
+        //put it back into the RAM
+        sealEntry(shard, entry, true);
+
+        evictInMemoryEntriesExceedingLimit(shard, entriesToBeDeleted);
+
+        returnValue->push_back(entry);
+        if (_signalEmitter) {
+            _signalEmitter->emitAddedEntry( key.getTime() );
+        }
+        ++stats.compressedHits;
+
+        return true;
+    }
+
+    /**
+     * @brief Evicts LRU entries of the in-memory portion of the shard while the in-memory portion of the cache exceeds its limit.
+     * The memory allocated outside of the cache (@see notifyExternalMemoryChanged) counts against the limit as well.
+     * Only the shard of the caller is locked, so only evict from that shard.
+     * The evicted entries are compressed by compressEvictedEntries() once the caller released the lock.
+     **/
+    void evictInMemoryEntriesExceedingLimit(CacheShard& shard,
+                                            std::list<EntryTypePtr> & entriesToBeDeleted) const
+    {
+        U64 memoryCacheSize, maximumInMemorySize;
+        {
+            QMutexLocker k(&_sizeLock);
+            memoryCacheSize = _memoryCacheSize + _externalMemorySize;
+            maximumInMemorySize = _maximumInMemorySize;
+        }
+
+        //Size of the evicted entries that are still counted in _memoryCacheSize until they get compressed or destroyed
+        U64 pendingSize = 0;
+        while (memoryCacheSize > maximumInMemorySize) {
+            std::list<EntryTypePtr> evicted;
+            if ( !tryEvictEntry(shard, evicted) ) {
+                break;
+            }
+            for (typename std::list<EntryTypePtr>::iterator it = evicted.begin(); it != evicted.end(); ++it) {
+                if ( !(*it)->isStoredOnDisk() && !(*it)->isCompressed() ) {
+                    pendingSize += (*it)->size();
+                }
+            }
+            entriesToBeDeleted.splice(entriesToBeDeleted.end(), evicted);
+
+            {
+                QMutexLocker k(&_sizeLock);
+                memoryCacheSize = _memoryCacheSize + _externalMemorySize;
+                maximumInMemorySize = _maximumInMemorySize;
+            }
+            memoryCacheSize = pendingSize > memoryCacheSize ? 0 : memoryCacheSize - pendingSize;
+        }
+    }
+
     /** @brief Inserts into the cache an entry that was previously allocated by the createInternal()
      * function. This is called directly by createInternal() if the allocation was successful
      **/
-    void sealEntry(const EntryTypePtr & entry,
+    void sealEntry(CacheShard& shard,
+                   const EntryTypePtr & entry,
                    bool inMemory) const
     {
-        assert( !_lock.tryLock() );   // must be locked
+        assert( !shard.lock.tryLock() );   // must be locked
         typename EntryType::hash_type hash = entry->getHashKey();
 
         if (inMemory) {
             /*if the entry doesn't exist on the memory cache,make a new list and insert it*/
-            CacheIterator existingEntry = _memoryCache(hash);
-            if ( existingEntry == _memoryCache.end() ) {
-                _memoryCache.insert(hash, entry);
+            CacheIterator existingEntry = shard.memoryCache(hash);
+            if ( existingEntry == shard.memoryCache.end() ) {
+                shard.memoryCache.insert(hash, entry);
             } else {
                 /*append to the existing list*/
                 getValueFromIterator(existingEntry).push_back(entry);
             }
         } else {
-            CacheIterator existingEntry = _diskCache(hash);
-            if ( existingEntry == _diskCache.end() ) {
-                _diskCache.insert(hash, entry);
+            CacheIterator existingEntry = shard.diskCache(hash);
+            if ( existingEntry == shard.diskCache.end() ) {
+                shard.diskCache.insert(hash, entry);
             } else {
                 /*append to the existing list*/
                 getValueFromIterator(existingEntry).push_back(entry);
@@ -1529,10 +2059,11 @@ private:
         }
     }
 
-    bool tryEvictEntry(std::list<EntryTypePtr> & entriesToBeDeleted) const
+    bool tryEvictEntry(CacheShard& shard,
+                       std::list<EntryTypePtr> & entriesToBeDeleted) const
     {
-        assert( !_lock.tryLock() );
-        std::pair<hash_type, EntryTypePtr> evicted = _memoryCache.evict();
+        assert( !shard.lock.tryLock() );
+        std::pair<hash_type, EntryTypePtr> evicted = shard.memoryCache.evict();
         //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
         //we'll let the user of these entries purge the extra entries left in the cache later on
         if (!evicted.second) {
@@ -1541,6 +2072,7 @@ private:
         /*if it is stored on disk, remove it from memory*/
 
         if (!evicted.second->isStoredOnDisk()) {
+            ///compressEvictedEntries() moves it to the compressed portion once the caller released the lock
             entriesToBeDeleted.push_back(evicted.second);
         } else {
             assert( evicted.second.unique() );
@@ -1561,7 +2093,7 @@ private:
             /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
             while ( ( diskCacheSize  + evicted.second->size() ) >= (maximumCacheSize - maximumInMemorySize) ) {
 
-                std::pair<hash_type, EntryTypePtr> evictedFromDisk = _diskCache.evict();
+                std::pair<hash_type, EntryTypePtr> evictedFromDisk = shard.diskCache.evict();
                 //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
                 //we'll let the user of these entries purge the extra entries left in the cache later on
                 if (!evictedFromDisk.second) {
@@ -1585,10 +2117,10 @@ private:
                 diskCacheSize -= fsize;
             }
 
-            CacheIterator existingDiskCacheEntry = _diskCache(evicted.first);
+            CacheIterator existingDiskCacheEntry = shard.diskCache(evicted.first);
             /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
-            if ( existingDiskCacheEntry == _diskCache.end() ) {
-                _diskCache.insert(evicted.first, evicted.second);
+            if ( existingDiskCacheEntry == shard.diskCache.end() ) {
+                shard.diskCache.insert(evicted.first, evicted.second);
             } else {   /*append to the existing list*/
                 getValueFromIterator(existingDiskCacheEntry).push_back(evicted.second);
             }
@@ -1596,6 +2128,67 @@ private:
 
         return true;
     } // tryEvictEntry
+
+    /**
+     * @brief Moves the entries evicted from the in-memory portion to the compressed portion of their shard, dropping the
+     * LRU entries of the compressed portion of any shard to make room for them. The entries which cannot be compressed
+     * are left in entriesToBeDeleted, with the dropped ones.
+     * No shard lock may be held: the buffers are encoded out of the locks, which are only taken to insert and drop entries.
+     **/
+    void compressEvictedEntries(std::list<EntryTypePtr> & entriesToBeDeleted) const
+    {
+        std::size_t maximumCompressedSize;
+        {
+            QMutexLocker k(&_sizeLock);
+            maximumCompressedSize = _maximumCompressedSize;
+        }
+        if (maximumCompressedSize == 0) {
+            return;
+        }
+
+        std::list<EntryTypePtr> droppedEntries;
+        for (typename std::list<EntryTypePtr>::iterator it = entriesToBeDeleted.begin(); it != entriesToBeDeleted.end();) {
+            ///The entries dropped from the disk or the compressed portion are deleted
+            if ( (*it)->isStoredOnDisk() || (*it)->isCompressed() || !(*it)->compressData() ) {
+                ++it;
+                continue;
+            }
+            std::size_t entrySize = (*it)->getCompressedSize();
+            if (entrySize > maximumCompressedSize) {
+                ++it;
+                continue;
+            }
+            EntryTypePtr entry = *it;
+            it = entriesToBeDeleted.erase(it);
+
+            hash_type hash = entry->getHashKey();
+            CacheShard& shard = getShard(hash);
+            {
+                CacheMutexLocker locker(&shard.lock, &shard.lockStats);
+                CacheIterator existingCompressedEntry = shard.compressedCache(hash);
+                if ( existingCompressedEntry == shard.compressedCache.end() ) {
+                    shard.compressedCache.insert(hash, entry);
+                } else {
+                    getValueFromIterator(existingCompressedEntry).push_back(entry);
+                }
+            }
+
+            ///compressData() already added the entry to _compressedCacheSize. The dropped entries are destroyed later on,
+            ///so keep track of the size they free ourselves
+            std::size_t compressedCacheSize = _compressedCacheSize;
+            compressedCacheSize = entrySize > compressedCacheSize ? 0 : compressedCacheSize - entrySize;
+            ///The shard of the entry is tried last: the entry may be the only one there
+            std::size_t firstShard = ( getShardIndex(shard) + 1 ) % _shards.size();
+            while (compressedCacheSize + entrySize > maximumCompressedSize) {
+                if ( !tryEvictCompressedEntryFromAnyShard(firstShard, droppedEntries) ) {
+                    break;
+                }
+                std::size_t droppedSize = droppedEntries.back()->getCompressedSize();
+                compressedCacheSize = droppedSize > compressedCacheSize ? 0 : compressedCacheSize - droppedSize;
+            }
+        }
+        entriesToBeDeleted.splice(entriesToBeDeleted.end(), droppedEntries);
+    } // compressEvictedEntries
 };
 
 NATRON_NAMESPACE_EXIT;
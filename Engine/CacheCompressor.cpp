@@ -0,0 +1,347 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "CacheCompressor.h"
+
+#include <cstring> // memcpy
+#include <cassert>
+#include <algorithm> // min
+
+#include "Global/GlobalDefines.h"
+
+// Size of the hash table of the compressor (in bits): 16k entries fit in the L1/L2 caches
+#define CACHE_COMPRESSOR_HASH_LOG 14
+
+// Minimum length of a match, the match length is stored minus this value
+#define CACHE_COMPRESSOR_MIN_MATCH 4
+
+// The last bytes of the input are always stored as literals so that the match search never reads past the end
+#define CACHE_COMPRESSOR_LAST_LITERALS 5
+
+// Matches are encoded with a 16 bit offset
+#define CACHE_COMPRESSOR_MAX_OFFSET 65535
+
+// After that many failed match searches in a row the compressor starts skipping bytes to get through
+// incompressible data (e.g: noise) quickly
+#define CACHE_COMPRESSOR_SKIP_TRIGGER 6
+
+NATRON_NAMESPACE_ENTER;
+
+namespace CacheCompressor {
+
+/*
+ * Compressed stream format: a list of sequences, each made of
+ * - a token byte: the high 4 bits are the number of literals, the low 4 bits the match length minus CACHE_COMPRESSOR_MIN_MATCH.
+ *   A value of 15 means that the length continues in the following bytes: each byte is added to the length
+ *   until a byte different from 255 is found.
+ * - the extra bytes of the literals length, if any
+ * - the literals
+ * - the match offset, 2 bytes little-endian
+ * - the extra bytes of the match length, if any
+ * The last sequence only has literals and ends the stream.
+ */
+
+static inline U32
+read32(const unsigned char* p)
+{
+    U32 v;
+
+    std::memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+static inline U32
+hashSequence(U32 sequence)
+{
+    return (sequence * 2654435761U) >> (32 - CACHE_COMPRESSOR_HASH_LOG);
+}
+
+static inline void
+writeLength(std::size_t length,
+            unsigned char** op)
+{
+    while (length >= 255) {
+        *(*op)++ = 255;
+        length -= 255;
+    }
+    *(*op)++ = (unsigned char)length;
+}
+
+static inline bool
+readLength(const unsigned char** ip,
+           const unsigned char* iend,
+           std::size_t* length)
+{
+    unsigned char b;
+
+    do {
+        if (*ip >= iend) {
+            return false;
+        }
+        b = *(*ip)++;
+        *length += b;
+    } while (b == 255);
+
+    return true;
+}
+
+static void
+writeSequence(const unsigned char* literals,
+              std::size_t nLiterals,
+              std::size_t offset,
+              std::size_t matchLength,
+              unsigned char** op)
+{
+    unsigned char* token = (*op)++;
+
+    *token = (unsigned char)( (nLiterals >= 15 ? 15 : nLiterals) << 4 );
+    if (nLiterals >= 15) {
+        writeLength(nLiterals - 15, op);
+    }
+    if (nLiterals) {
+        std::memcpy(*op, literals, nLiterals);
+        *op += nLiterals;
+    }
+    if (offset == 0) {
+        // last sequence
+        return;
+    }
+    assert(matchLength >= CACHE_COMPRESSOR_MIN_MATCH);
+    matchLength -= CACHE_COMPRESSOR_MIN_MATCH;
+    *token |= (unsigned char)(matchLength >= 15 ? 15 : matchLength);
+    *(*op)++ = (unsigned char)(offset & 0xff);
+    *(*op)++ = (unsigned char)(offset >> 8);
+    if (matchLength >= 15) {
+        writeLength(matchLength - 15, op);
+    }
+}
+
+static std::size_t
+lzCompress(const unsigned char* src,
+           std::size_t size,
+           unsigned char* dst)
+{
+    const unsigned char* ip = src;
+    const unsigned char* anchor = src;
+    const unsigned char* iend = src + size;
+    unsigned char* op = dst;
+
+    if (size > CACHE_COMPRESSOR_MIN_MATCH + CACHE_COMPRESSOR_LAST_LITERALS) {
+        const unsigned char* matchLimit = iend - CACHE_COMPRESSOR_LAST_LITERALS;
+        const unsigned char* searchLimit = matchLimit - CACHE_COMPRESSOR_MIN_MATCH;
+        std::vector<U32> table(1 << CACHE_COMPRESSOR_HASH_LOG, 0);
+        unsigned int nMisses = 0;
+
+        while (ip <= searchLimit) {
+            U32 sequence = read32(ip);
+            U32 h = hashSequence(sequence);
+            const unsigned char* ref = src + table[h];
+            table[h] = (U32)(ip - src);
+
+            if ( (ref >= ip) || ( (std::size_t)(ip - ref) > CACHE_COMPRESSOR_MAX_OFFSET ) || (read32(ref) != sequence) ) {
+                ip += 1 + (nMisses++ >> CACHE_COMPRESSOR_SKIP_TRIGGER);
+                continue;
+            }
+            nMisses = 0;
+
+            // extend the match backwards over the pending literals
+            while ( (ip > anchor) && (ref > src) && (ip[-1] == ref[-1]) ) {
+                --ip;
+                --ref;
+            }
+
+            // and forwards, 8 bytes at a time while possible
+            const unsigned char* mp = ip + CACHE_COMPRESSOR_MIN_MATCH;
+            const unsigned char* rp = ref + CACHE_COMPRESSOR_MIN_MATCH;
+            while ( (mp + 8 <= matchLimit) && (std::memcmp(mp, rp, 8) == 0) ) {
+                mp += 8;
+                rp += 8;
+            }
+            while ( (mp < matchLimit) && (*mp == *rp) ) {
+                ++mp;
+                ++rp;
+            }
+
+            writeSequence(anchor, ip - anchor, ip - ref, mp - ip, &op);
+            ip = mp;
+            anchor = ip;
+        }
+    }
+
+    writeSequence(anchor, iend - anchor, 0, 0, &op);
+
+    return op - dst;
+}
+
+static bool
+lzDecompress(const unsigned char* src,
+             std::size_t compressedSize,
+             unsigned char* dst,
+             std::size_t size)
+{
+    const unsigned char* ip = src;
+    const unsigned char* iend = src + compressedSize;
+    unsigned char* op = dst;
+    unsigned char* oend = dst + size;
+
+    while (ip < iend) {
+        unsigned int token = *ip++;
+        std::size_t nLiterals = token >> 4;
+        if ( (nLiterals == 15) && !readLength(&ip, iend, &nLiterals) ) {
+            return false;
+        }
+        if ( ( nLiterals > (std::size_t)(iend - ip) ) || ( nLiterals > (std::size_t)(oend - op) ) ) {
+            return false;
+        }
+        if (nLiterals) {
+            std::memcpy(op, ip, nLiterals);
+            op += nLiterals;
+            ip += nLiterals;
+        }
+        if (ip == iend) {
+            // last sequence
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return false;
+        }
+        std::size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if ( (offset == 0) || ( offset > (std::size_t)(op - dst) ) ) {
+            return false;
+        }
+        std::size_t matchLength = token & 15;
+        if ( (matchLength == 15) && !readLength(&ip, iend, &matchLength) ) {
+            return false;
+        }
+        matchLength += CACHE_COMPRESSOR_MIN_MATCH;
+        if ( matchLength > (std::size_t)(oend - op) ) {
+            return false;
+        }
+        const unsigned char* ref = op - offset;
+        if (offset >= matchLength) {
+            std::memcpy(op, ref, matchLength);
+            op += matchLength;
+        } else {
+            // overlapping match: it repeats the last offset bytes, the repeated pattern doubles at each copy
+            unsigned char* mend = op + matchLength;
+            while (op < mend) {
+                std::size_t n = std::min( (std::size_t)(op - ref), (std::size_t)(mend - op) );
+                std::memcpy(op, ref, n);
+                op += n;
+            }
+        }
+    }
+
+    return op == oend;
+}
+
+static bool
+canShuffle(std::size_t size,
+           int elementSize)
+{
+    return elementSize > 1 && size >= (std::size_t)elementSize && (size % elementSize) == 0;
+}
+
+static void
+shuffle(const unsigned char* src,
+        std::size_t size,
+        int elementSize,
+        unsigned char* dst)
+{
+    std::size_t nElements = size / elementSize;
+
+    for (int b = 0; b < elementSize; ++b) {
+        const unsigned char* s = src + b;
+        unsigned char* d = dst + b * nElements;
+        for (std::size_t i = 0; i < nElements; ++i, s += elementSize) {
+            d[i] = *s;
+        }
+    }
+}
+
+static void
+unshuffle(const unsigned char* src,
+          std::size_t size,
+          int elementSize,
+          unsigned char* dst)
+{
+    std::size_t nElements = size / elementSize;
+
+    for (int b = 0; b < elementSize; ++b) {
+        const unsigned char* s = src + b * nElements;
+        unsigned char* d = dst + b;
+        for (std::size_t i = 0; i < nElements; ++i, d += elementSize) {
+            *d = s[i];
+        }
+    }
+}
+
+std::size_t
+compress(const unsigned char* src,
+         std::size_t size,
+         int elementSize,
+         std::vector<unsigned char>* dst)
+{
+    // worst case: all literals, one extra length byte every 255 literals
+    dst->resize(size + size / 255 + 16);
+
+    std::size_t compressedSize;
+    if ( canShuffle(size, elementSize) ) {
+        std::vector<unsigned char> shuffled(size);
+        shuffle(src, size, elementSize, &shuffled[0]);
+        compressedSize = lzCompress(&shuffled[0], size, &(*dst)[0]);
+    } else {
+        compressedSize = lzCompress(src, size, &(*dst)[0]);
+    }
+    assert( compressedSize <= dst->size() );
+    dst->resize(compressedSize);
+
+    return compressedSize;
+}
+
+bool
+decompress(const unsigned char* src,
+           std::size_t compressedSize,
+           int elementSize,
+           unsigned char* dst,
+           std::size_t size)
+{
+    if ( !canShuffle(size, elementSize) ) {
+        return lzDecompress(src, compressedSize, dst, size);
+    }
+    std::vector<unsigned char> shuffled(size);
+    if ( !lzDecompress(src, compressedSize, &shuffled[0], size) ) {
+        return false;
+    }
+    unshuffle(&shuffled[0], size, elementSize, dst);
+
+    return true;
+}
+
+} // namespace CacheCompressor
+
+NATRON_NAMESPACE_EXIT;
@@ -0,0 +1,63 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_CACHECOMPRESSOR_H
+#define NATRON_ENGINE_CACHECOMPRESSOR_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+#include <vector>
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief A fast lossless codec used to keep the entries evicted from the in-memory portion of the caches in RAM
+ * in a compressed form. It is a LZ77 scheme with a single-probe hash table, in the spirit of LZ4, tuned for
+ * speed rather than ratio.
+ * Before compression, the bytes of the elements of the buffer are regrouped by significance (the first byte of all
+ * elements, then the second byte, ...) so that the slowly varying exponent and high bytes of the float and short
+ * images form long runs that the LZ stage can match.
+ **/
+namespace CacheCompressor {
+
+/**
+ * @brief Compresses size bytes from src into dst (which is resized accordingly).
+ * @param elementSize The size in bytes of one element of the buffer, e.g: 4 for float images, 1 to disable the shuffling.
+ * @returns The size of the compressed data.
+ **/
+std::size_t compress(const unsigned char* src, std::size_t size, int elementSize, std::vector<unsigned char>* dst);
+
+/**
+ * @brief Decompresses the compressedSize bytes of src to exactly size bytes into dst.
+ * elementSize must be the same as the one given to compress().
+ * @returns False if the compressed data are corrupted.
+ **/
+bool decompress(const unsigned char* src, std::size_t compressedSize, int elementSize, unsigned char* dst, std::size_t size);
+
+} // namespace CacheCompressor
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_CACHECOMPRESSOR_H
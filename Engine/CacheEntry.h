@@ -50,7 +50,10 @@
 #endif
 #include "Engine/Hash64.h"
 #include "Engine/CacheEntryHolder.h"
+#include "Engine/CacheCompressor.h"
+#include "Engine/CachePackStore.h"
 #include "Engine/MemoryFile.h"
+#include "Engine/MemoryPool.h"
 #include "Engine/NonKeyParams.h"
 #include <SequenceParsing.h> // for removePath
 #include "Engine/EngineFwd.h"
@@ -61,6 +64,7 @@ NATRON_NAMESPACE_ENTER;
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////BUFFER////////////////////////////////////////////////////
 
+///A buffer in RAM, the memory comes from the MemoryPool
 template <typename T>
 class RamBuffer
 {
@@ -102,40 +106,33 @@ public:
         if (size == 0) {
             return;
         }
-        count = size;
-        if (data) {
-            free(data);
-            data = 0;
-        }
-        if (count == 0) {
-            return;
-        }
-        data = (T*)malloc(size * sizeof(T));
+        clear();
+        data = (T*)MemoryPool::allocate(size * sizeof(T));
         if (!data) {
             throw std::bad_alloc();
         }
+        count = size;
     }
     
     void clear()
     {
-        count = 0;
         if (data) {
-            free(data);
+            MemoryPool::deallocate(data, count * sizeof(T));
             data = 0;
         }
+        count = 0;
     }
     
     ~RamBuffer()
     {
-        if (data) {
-            free(data);
-            data = 0;
-        }
+        clear();
     }
 };
 
 /** @brief Buffer represents  an internal buffer that can be allocated on different devices.
  * For now the class is simple and can only be either on disk using mmap or in RAM using malloc.
+ * On disk, the data lives either in a slot of a pack file shared with other entries (see CachePackStore)
+ * or in a file of its own when it could not be packed.
  * The cost parameter given to the allocate() function is a hint that the Buffer classes uses
  * to select a device to use. By default -1 means it should not allocate any memory,
  * 0 means RAM and >= 1 means the data will be stored on disk using mmap. We could see this
@@ -157,7 +154,13 @@ public:
     Buffer()
     : _path()
     , _buffer()
+    , _compressedData()
+    , _compressedCount(0)
     , _backingFile()
+    , _packStore()
+    , _packSlot()
+    , _packSize(0)
+    , _packData(0)
     , _storageMode(eStorageModeRAM)
     {
     }
@@ -205,6 +208,35 @@ public:
         }
     }
 
+    /**
+     * @brief Allocates the buffer on disk in a slot of a pack file of the given directory.
+     * Returns false if the store could not provide a slot, in which case the buffer is left untouched.
+     **/
+    bool allocateInPack(U64 count,
+                        const boost::shared_ptr<CachePackStore>& packStore,
+                        const std::string& directory)
+    {
+        assert( !isAllocated() && !_packSlot.isValid() );
+        if ( !packStore || (count == 0) ) {
+            return false;
+        }
+        U64 bytes = count * sizeof(DataType);
+        if ( !packStore->allocate(directory, bytes, &_packSlot) ) {
+            return false;
+        }
+        _packData = packStore->getData(_packSlot);
+        if (!_packData) {
+            packStore->release(&_packSlot);
+
+            return false;
+        }
+        _packStore = packStore;
+        _packSize = bytes;
+        _storageMode = eStorageModeDisk;
+
+        return true;
+    }
+
     /**
      * @brief Reallocates the internal buffer so that it countains "count" elements of the DataType.
      * Content defined in the previous portions of the buffer will be kept.
@@ -217,8 +249,7 @@ public:
             assert(_buffer.size() > 0); // could be 0 if we allocate 0...
             _buffer.resize(count);
         } else if (_storageMode == eStorageModeDisk) {
-            assert(_backingFile);
-            _backingFile->resize( count * sizeof(DataType) );
+            resizeDiskStorage( count * sizeof(DataType) );
         }
     }
     
@@ -231,21 +262,25 @@ public:
             if (other._storageMode == eStorageModeRAM) {
                 _buffer.swap(other._buffer);
             } else {
-                _buffer.resize(other._backingFile->size() / sizeof(DataType));
-                const char* src = other._backingFile->data();
+                _buffer.resize(other.size() / sizeof(DataType));
+                const char* src = (const char*)other.readable();
                 char* dst = (char*)_buffer.getData();
-                memcpy(dst,src,other._backingFile->size());
+                memcpy(dst,src,other.size());
             }
         } else if (_storageMode == eStorageModeDisk) {
             if (other._storageMode == eStorageModeDisk) {
-                assert(_backingFile);
+                assert(_backingFile || _packData);
                 _backingFile.swap(other._backingFile);
                 _path = other._path;
+                _packStore.swap(other._packStore);
+                std::swap(_packSlot, other._packSlot);
+                std::swap(_packSize, other._packSize);
+                std::swap(_packData, other._packData);
             } else {
-                _backingFile->resize(other._buffer.size() * sizeof(DataType));
-				assert(_backingFile->data());
+                resizeDiskStorage(other._buffer.size() * sizeof(DataType));
+                assert(readable());
                 const char* src = (const char*)other._buffer.getData();
-                char* dst = (char*)_backingFile->data();
+                char* dst = (char*)writable();
                 memcpy(dst,src,other._buffer.size() * sizeof(DataType));
             }
         }
@@ -258,7 +293,15 @@ public:
 
     void reOpenFileMapping() const
     {
-        assert(!_backingFile && _storageMode == eStorageModeDisk);
+        assert(!_backingFile && !_packData && _storageMode == eStorageModeDisk);
+        if ( _packSlot.isValid() ) {
+            _packData = _packStore->getData(_packSlot);
+            if (!_packData) {
+                throw std::bad_alloc();
+            }
+
+            return;
+        }
         try{
             _backingFile.reset( new MemoryFile(_path,MemoryFile::eFileOpenModeEnumIfExistsKeepElseCreate) );
         } catch (const std::exception & e) {
@@ -273,11 +316,38 @@ public:
         _storageMode = eStorageModeDisk;
     }
 
+    void restoreBufferFromPack(const boost::shared_ptr<CachePackStore>& packStore,
+                               const CachePackSlot& slot,
+                               U64 size)
+    {
+        _packStore = packStore;
+        _packSlot = slot;
+        _packSize = size;
+        _storageMode = eStorageModeDisk;
+    }
+
+    const CachePackSlot& getPackSlot() const
+    {
+        return _packSlot;
+    }
+
+    /**
+     * @brief True if the buffer lives on disk in a file of its own rather than in a pack file
+     **/
+    bool hasOwnBackingFile() const
+    {
+        return _storageMode == eStorageModeDisk && !_packSlot.isValid();
+    }
+
     void deallocate()
     {
         if (_storageMode == eStorageModeRAM) {
             _buffer.clear();
+            std::vector<unsigned char>().swap(_compressedData);
+            _compressedCount = 0;
         } else {
+            // The pack file stays mapped, it is synced when the cache is saved
+            _packData = 0;
             if (_backingFile) {
                 bool flushOk = _backingFile->flush();
                 _backingFile.reset();
@@ -291,7 +361,14 @@ public:
     bool removeAnyBackingFile() const
     {
         if (_storageMode == eStorageModeDisk) {
-            if (_backingFile) {
+            if ( _packSlot.isValid() ) {
+                // the pack file stays opened for the other entries
+                _packData = 0;
+                _packStore->release(&_packSlot);
+                _packSize = 0;
+
+                return false;
+            } else if (_backingFile) {
                 _backingFile->remove();
                 _backingFile.reset();
                 return true;
@@ -311,6 +388,8 @@ public:
     {
         if (_storageMode == eStorageModeRAM) {
             return _buffer.size() * sizeof(DataType);
+        } else if ( _packSlot.isValid() ) {
+            return _packData ? _packSize : 0;
         } else {
             return _backingFile ? _backingFile->size() : 0;
         }
@@ -318,13 +397,15 @@ public:
 
     bool isAllocated() const
     {
-        return (_buffer.size() > 0) || ( _backingFile && _backingFile->data() );
+        return (_buffer.size() > 0) || _packData || ( _backingFile && _backingFile->data() );
     }
 
     DataType* writable()
     {
         if (_storageMode == eStorageModeDisk) {
-            if (_backingFile) {
+            if (_packData) {
+                return (DataType*)_packData;
+            } else if (_backingFile) {
                 return (DataType*)_backingFile->data();
             } else {
                 return NULL;
@@ -337,6 +418,9 @@ public:
     const DataType* readable() const
     {
         if (_storageMode == eStorageModeDisk) {
+            if (_packData) {
+                return (const DataType*)_packData;
+            }
             return _backingFile ? (const DataType*)_backingFile->data() : 0;
         } else {
             return _buffer.getData();
@@ -348,14 +432,112 @@ public:
         return _storageMode;
     }
 
+    /**
+     * @brief Replaces the RAM buffer by a compressed copy of its content, see CacheCompressor.
+     * Returns false and leaves the buffer untouched if the buffer is not in RAM or if it does not
+     * compress to at most NATRON_CACHE_COMPRESSION_MAX_RATIO of its size.
+     * @param elementSize The size in bytes of one element of the data (e.g: 4 for a float image)
+     **/
+    bool compress(int elementSize)
+    {
+        if ( (_storageMode != eStorageModeRAM) || (_buffer.size() == 0) || isCompressed() ) {
+            return false;
+        }
+        std::size_t bytes = _buffer.size() * sizeof(DataType);
+        std::vector<unsigned char> compressed;
+        std::size_t compressedSize = CacheCompressor::compress( (const unsigned char*)_buffer.getData(), bytes, elementSize, &compressed );
+        if ( compressedSize > (bytes * NATRON_CACHE_COMPRESSION_MAX_RATIO) ) {
+            return false;
+        }
+        // copy so that the capacity matches the compressed size
+        std::vector<unsigned char>(compressed).swap(_compressedData);
+        _compressedCount = _buffer.size();
+        _buffer.clear();
+
+        return true;
+    }
+
+    /**
+     * @brief Restores the RAM buffer from its compressed copy.
+     * WARNING: This function throws a std::bad_alloc if the allocation fails.
+     * @returns False if the compressed data are corrupted, in which case the buffer is left empty.
+     **/
+    bool decompress(int elementSize)
+    {
+        assert( isCompressed() );
+        _buffer.resize(_compressedCount);
+        bool ok = CacheCompressor::decompress(&_compressedData[0], _compressedData.size(), elementSize,
+                                              (unsigned char*)_buffer.getData(), _compressedCount * sizeof(DataType));
+        if (!ok) {
+            _buffer.clear();
+        }
+        std::vector<unsigned char>().swap(_compressedData);
+        _compressedCount = 0;
+
+        return ok;
+    }
+
+    bool isCompressed() const
+    {
+        return !_compressedData.empty();
+    }
+
+    /**
+     * @brief Returns the size in bytes of the compressed copy of the buffer, 0 if it is not compressed.
+     **/
+    std::size_t getCompressedSize() const
+    {
+        return _compressedData.size();
+    }
+
 private:
 
+    /**
+     * @brief Resizes the disk storage to the given number of bytes, keeping the content.
+     * A packed buffer that outgrows its slot is moved to a new slot.
+     **/
+    void resizeDiskStorage(U64 bytes)
+    {
+        if ( _packSlot.isValid() ) {
+            assert(_packData);
+            if (bytes <= _packSlot.capacity) {
+                _packSize = bytes;
+
+                return;
+            }
+            CachePackSlot newSlot;
+            if ( !_packStore->allocate(_packSlot.directory, bytes, &newSlot) ) {
+                throw std::bad_alloc();
+            }
+            char* newData = _packStore->getData(newSlot);
+            assert(newData);
+            memcpy(newData, _packData, _packSize);
+            _packStore->release(&_packSlot);
+            _packSlot = newSlot;
+            _packSize = bytes;
+            _packData = newData;
+        } else {
+            assert(_backingFile);
+            _backingFile->resize(bytes);
+        }
+    }
+
     std::string _path;
     RamBuffer<DataType> _buffer;
 
+    ///Set when the RAM buffer has been compressed, in which case _buffer is empty
+    std::vector<unsigned char> _compressedData;
+    U64 _compressedCount; //< the number of elements of the buffer before compression
+
     /*mutable so the reOpenFileMapping function can reopen the mmaped file. It doesn't
        change the underlying data*/
     mutable boost::scoped_ptr<MemoryFile> _backingFile;
+
+    ///Set when the data lives in a pack file, in which case _path and _backingFile are not used
+    boost::shared_ptr<CachePackStore> _packStore;
+    mutable CachePackSlot _packSlot;
+    mutable U64 _packSize;
+    mutable char* _packData; //< NULL if the slot is not mapped
     StorageModeEnum _storageMode;
 };
 
@@ -391,7 +573,13 @@ public:
     virtual void notifyMemoryDeallocated() const = 0;
 
     /**
-     * @brief To be called when a backing file has been closed
+     * @brief To be called when an entry opened a backing file of its own. The entries living in a pack file
+     * do not call it: the CachePackStore counts its packs instead.
+     **/
+    virtual void backingFileOpened() const = 0;
+
+    /**
+     * @brief To be called when a backing file opened with backingFileOpened() has been closed
      **/
     virtual void backingFileClosed() const = 0;
 
@@ -401,12 +589,35 @@ public:
      **/
     virtual void notifyEntryStorageChanged(StorageModeEnum oldStorage,StorageModeEnum newStorage,
                                            double time,size_t size) const = 0;
+
+    /**
+     * @brief To be called whenever the buffer of an entry is compressed or decompressed.
+     * @param ramSize The size of the entry when it is not compressed
+     * @param compressedSize The size of the entry while it is compressed
+     **/
+    virtual void notifyEntryCompressionChanged(bool compressed, size_t ramSize, size_t compressedSize) const = 0;
+
+    /**
+     * @brief To be called by a CacheEntry on destruction if its buffer is compressed.
+     **/
+    virtual void notifyCompressedEntryDestroyed(double time, size_t compressedSize) const = 0;
     
     /**
-     * @brief Remove from the cache all entries that matches the holderID and have a different nodeHash than the given one.
-     * @param removeAll If true, remove even entries that match the nodeHash
+     * @brief To be called whenever the recompute cost of an entry changed, so that the eviction policy takes it into account.
+     **/
+    virtual void notifyEntryRecomputeCostChanged(U64 hashKey) const = 0;
+
+    /**
+     * @brief Remove from the cache all entries that matches the holderID and have the given nodeHash.
+     * @param removeAll If true, remove the entries of the holder whatever their nodeHash
+     **/
+    virtual void removeAllEntriesWithNodeHashForHolderPrivate(const std::string& holderID, U64 nodeHash, bool removeAll) = 0;
+
+    /**
+     * @brief Returns the store in which the disk entries of the cache are packed, or NULL if each entry
+     * should be stored in a file of its own.
      **/
-    virtual void removeAllEntriesWithDifferentNodeHashForHolderPrivate(const std::string& holderID, U64 nodeHash, bool removeAll) = 0;
+    virtual boost::shared_ptr<CachePackStore> getPackStore() const = 0;
     
     
 #ifdef DEBUG
@@ -520,6 +731,8 @@ public:
     , _entryLock(QReadWriteLock::Recursive)
     , _requestedStorage(eStorageModeNone)
     , _removeBackingFileBeforeDestruction(false)
+    , _recomputeCostMutex()
+    , _recomputeCost(0.)
     {
     }
 
@@ -542,6 +755,8 @@ public:
     , _entryLock(QReadWriteLock::Recursive)
     , _requestedStorage(storage)
     , _removeBackingFileBeforeDestruction(false)
+    , _recomputeCostMutex()
+    , _recomputeCost(0.)
     {
     }
 
@@ -598,6 +813,9 @@ public:
         
         if (_cache) {
             _cache->notifyEntryAllocated( getTime(),size(),_data.getStorageMode() );
+            if ( _data.hasOwnBackingFile() ) {
+                _cache->backingFileOpened();
+            }
         }
     }
     
@@ -627,6 +845,27 @@ public:
         }
     }
 
+    /**
+     * @brief Same as restoreMetaDataFromFile() for entries that were stored in a pack file.
+     * The slot must have been reserved in the pack store of the cache beforehand.
+     **/
+    void restoreMetaDataFromPack(const CachePackSlot& slot, std::size_t size)
+    {
+        if (!_cache || _requestedStorage != eStorageModeDisk) {
+            return;
+        }
+
+        {
+            QWriteLocker k(&_entryLock);
+
+            _data.restoreBufferFromPack(_cache->getPackStore(), slot, size);
+
+            onMemoryAllocated(true);
+        }
+
+        _cache->notifyEntryStorageChanged(eStorageModeNone, eStorageModeDisk, getTime(),size);
+    }
+
     /**
      * @brief Called right away once the buffer is allocated. Used in debug mode to initialize image with a default color.
      * @param diskRestoration If true, this is called by restoreMetaDataFromFile() and the memory is in fact not allocated, this should
@@ -636,6 +875,16 @@ public:
     {
     }
 
+    /**
+     * @brief Returns the size in bytes of one element of the data held by the entry, so that compressData()
+     * can regroup the bytes of same significance. Derived classes whose DataType is not the real type
+     * of the data should override it.
+     **/
+    virtual int getDataElementSize() const
+    {
+        return (int)sizeof(DataType);
+    }
+
 
     const KeyType & getKey() const OVERRIDE FINAL
     {
@@ -646,6 +895,14 @@ public:
         return _data.getFilePath();
     }
 
+    /**
+     * @brief Returns the location of the entry in the pack files of the cache. The slot is invalid
+     * if the entry is not stored in a pack file.
+     **/
+    const CachePackSlot& getPackSlot() const {
+        return _data.getPackSlot();
+    }
+
     typename AbstractCacheEntry<KeyType>::hash_type getHashKey() const OVERRIDE FINAL
     {
         return _key.getHash();
@@ -694,6 +951,9 @@ public:
         }
         if (_cache) {
             _cache->notifyEntryStorageChanged( eStorageModeDisk, eStorageModeRAM,getTime(), size() );
+            if ( _data.hasOwnBackingFile() ) {
+                _cache->backingFileOpened();
+            }
         }
     }
 
@@ -704,6 +964,7 @@ public:
     {
         std::size_t sz = size();
         bool dataAllocated = _data.isAllocated();
+        std::size_t compressedSize = _data.getCompressedSize();
         double time = getTime();
         {
             QWriteLocker k(&_entryLock);
@@ -711,9 +972,14 @@ public:
             _data.deallocate();
         }
         if (_cache) {
-            if ( isStoredOnDisk() ) {
+            if (compressedSize > 0) {
+                _cache->notifyCompressedEntryDestroyed(time, sz + compressedSize);
+            } else if ( isStoredOnDisk() ) {
                 if (dataAllocated) {
                     _cache->notifyEntryStorageChanged( eStorageModeRAM, eStorageModeDisk, time, sz );
+                    if ( _data.hasOwnBackingFile() ) {
+                        _cache->backingFileClosed();
+                    }
                 }
             } else {
                 if (dataAllocated) {
@@ -786,6 +1052,84 @@ public:
         }
     }
     
+    /**
+     * @brief Compresses the buffer of an entry living in RAM to make room in the cache, see Buffer::compress().
+     * The entry must not be used elsewhere while compressed: it has to be decompressed before being handed out.
+     * @returns False if the entry was left untouched.
+     **/
+    bool compressData()
+    {
+        std::size_t oldSize = size();
+        {
+            QWriteLocker k(&_entryLock);
+            if ( !_data.compress( getDataElementSize() ) ) {
+                return false;
+            }
+        }
+        if (_cache) {
+            _cache->notifyEntryCompressionChanged( true, oldSize, size() + _data.getCompressedSize() );
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Restores the buffer compressed by compressData().
+     * WARNING: This function throws a std::bad_alloc if the allocation fails.
+     * @returns False if the compressed data were corrupted, the entry is then no longer allocated.
+     **/
+    bool decompressData()
+    {
+        std::size_t compressedSize = size() + _data.getCompressedSize();
+        bool ok;
+        {
+            QWriteLocker k(&_entryLock);
+            ok = _data.decompress( getDataElementSize() );
+        }
+        if (_cache) {
+            _cache->notifyEntryCompressionChanged( false, ok ? size() : 0, compressedSize );
+        }
+
+        return ok;
+    }
+
+    bool isCompressed() const
+    {
+        QReadLocker k(&_entryLock);
+        return _data.isCompressed();
+    }
+
+    /**
+     * @brief Returns the size in bytes of the entry in the compressed portion of the cache.
+     **/
+    std::size_t getCompressedSize() const
+    {
+        return size() + _data.getCompressedSize();
+    }
+
+    /**
+     * @brief Reads the buffer of an entry stored on disk once so that the system loads its pages in RAM
+     * before the entry is actually used.
+     **/
+    void prefetchData() const
+    {
+        if (!isStoredOnDisk()) {
+            return;
+        }
+        QReadLocker k(&_entryLock);
+        const volatile char* data = (const volatile char*)_data.readable();
+        std::size_t dataSize = _data.size();
+        if (!data || dataSize == 0) {
+            return;
+        }
+        char sum = 0;
+        for (std::size_t i = 0; i < dataSize; i += 4096) {
+            sum ^= data[i];
+        }
+        sum ^= data[dataSize - 1];
+        Q_UNUSED(sum);
+    }
+
     /**
      * @brief To be called when an entry is going to be removed from the cache entirely.
      **/
@@ -799,6 +1143,28 @@ public:
         return _key.getTime();
     }
 
+    /**
+     * @brief Adds time (in seconds) spent computing the data of this entry. This is what it would cost to
+     * compute it again if it were evicted from the cache. @see eCacheEvictionPolicyGreedyDualSize
+     **/
+    void addRecomputeCost(double seconds)
+    {
+        {
+            QMutexLocker k(&_recomputeCostMutex);
+            _recomputeCost += seconds;
+        }
+        ///The priority of the entry was computed when it was inserted in the cache, before it was rendered
+        if (_cache) {
+            _cache->notifyEntryRecomputeCostChanged( getHashKey() );
+        }
+    }
+
+    double getRecomputeCost() const
+    {
+        QMutexLocker k(&_recomputeCostMutex);
+        return _recomputeCost;
+    }
+
     boost::shared_ptr<ParamsType> getParams() const WARN_UNUSED_RETURN
     {
         return _params;
@@ -859,6 +1225,11 @@ private:
         
         if (storage == eStorageModeDisk) {
             
+            ///Try to store the entry in a pack file first, this avoids creating a file per entry
+            if ( _cache && _data.allocateInPack(count, _cache->getPackStore(), path) ) {
+                return;
+            }
+
             typename AbstractCacheEntry<KeyType>::hash_type hashKey = getHashKey();
             try {
                 fileName = generateStringFromHash(path,hashKey);
@@ -914,6 +1285,8 @@ protected:
     mutable QReadWriteLock _entryLock;
     StorageModeEnum _requestedStorage;
     bool _removeBackingFileBeforeDestruction;
+    mutable QMutex _recomputeCostMutex;
+    double _recomputeCost; //< protected by _recomputeCostMutex
 };
 
 NATRON_NAMESPACE_EXIT;
@@ -28,11 +28,44 @@
 #include "Global/Macros.h"
 
 #include <string>
+#include <cstddef>
 
+#include "Global/GlobalDefines.h"
 #include "Engine/EngineFwd.h"
 
 NATRON_NAMESPACE_ENTER;
 
+/**
+ * @brief The memory occupied in the caches by the entries of a CacheEntryHolder and in which portion
+ * of the caches its look-ups were satisfied.
+ **/
+struct CacheEntryHolderStats
+{
+    std::size_t ramOccupied;
+    std::size_t compressedOccupied; // in RAM too, but compressed
+    std::size_t diskOccupied;
+    U64 memoryHits;
+    U64 compressedHits; // the entry had to be decompressed
+    U64 diskHits; // the entry had to be mapped back from its file
+    U64 misses;
+
+    CacheEntryHolderStats()
+        : ramOccupied(0)
+        , compressedOccupied(0)
+        , diskOccupied(0)
+        , memoryHits(0)
+        , compressedHits(0)
+        , diskHits(0)
+        , misses(0)
+    {
+    }
+
+    U64 getNumLookups() const
+    {
+        return memoryHits + compressedHits + diskHits + misses;
+    }
+};
+
 /**
  * @brief Public interface for all elements that can own something in the cache
  **/
@@ -0,0 +1,393 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "CachePackStore.h"
+
+#include <map>
+#include <list>
+#include <sstream>
+#include <iostream>
+#include <cassert>
+#include <stdexcept>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/shared_ptr.hpp>
+#endif
+
+#include <QtCore/QMutex>
+
+#include "Engine/AppManager.h"
+#include "Engine/MemoryFile.h"
+
+NATRON_NAMESPACE_ENTER;
+
+struct CachePackFile
+{
+    std::string directory;
+    int index;
+    boost::scoped_ptr<MemoryFile> file;
+    U64 size;
+    U64 usedBytes;
+
+    ///The free extents of the file, indexed by offset to merge neighbours and by length to find the best fit.
+    ///Both maps always hold the same extents.
+    std::map<U64, U64> freeByOffset;
+    std::multimap<U64, U64> freeByLength;
+
+    CachePackFile()
+    : directory()
+    , index(-1)
+    , file()
+    , size(0)
+    , usedBytes(0)
+    , freeByOffset()
+    , freeByLength()
+    {
+    }
+
+    void initFreeList()
+    {
+        freeByOffset.clear();
+        freeByLength.clear();
+        usedBytes = 0;
+        addFreeExtent(0, size);
+    }
+
+    void addFreeExtent(U64 offset, U64 length)
+    {
+        if (length == 0) {
+            return;
+        }
+        freeByOffset.insert( std::make_pair(offset, length) );
+        freeByLength.insert( std::make_pair(length, offset) );
+    }
+
+    void removeFreeExtent(std::map<U64, U64>::iterator it)
+    {
+        std::pair<std::multimap<U64, U64>::iterator, std::multimap<U64, U64>::iterator> range = freeByLength.equal_range(it->second);
+        for (std::multimap<U64, U64>::iterator it2 = range.first; it2 != range.second; ++it2) {
+            if (it2->second == it->first) {
+                freeByLength.erase(it2);
+                break;
+            }
+        }
+        freeByOffset.erase(it);
+    }
+
+    bool allocate(U64 length, U64* offset)
+    {
+        std::multimap<U64, U64>::iterator found = freeByLength.lower_bound(length);
+        if ( found == freeByLength.end() ) {
+            return false;
+        }
+        U64 extentOffset = found->second;
+        U64 extentLength = found->first;
+        removeFreeExtent( freeByOffset.find(extentOffset) );
+        addFreeExtent(extentOffset + length, extentLength - length);
+        usedBytes += length;
+        *offset = extentOffset;
+
+        return true;
+    }
+
+    bool reserve(U64 offset, U64 length)
+    {
+        if ( (offset + length) > size ) {
+            return false;
+        }
+        // find the free extent containing offset
+        std::map<U64, U64>::iterator it = freeByOffset.upper_bound(offset);
+        if ( it == freeByOffset.begin() ) {
+            return false;
+        }
+        --it;
+        U64 extentOffset = it->first;
+        U64 extentLength = it->second;
+        if ( (offset + length) > (extentOffset + extentLength) ) {
+            return false;
+        }
+        removeFreeExtent(it);
+        addFreeExtent(extentOffset, offset - extentOffset);
+        addFreeExtent(offset + length, (extentOffset + extentLength) - (offset + length));
+        usedBytes += length;
+
+        return true;
+    }
+
+    void release(U64 offset, U64 length)
+    {
+        assert(usedBytes >= length);
+        usedBytes -= length;
+
+        // merge with the previous and next free extents
+        std::map<U64, U64>::iterator next = freeByOffset.lower_bound(offset);
+        if ( next != freeByOffset.end() && (next->first == offset + length) ) {
+            length += next->second;
+            removeFreeExtent(next);
+        }
+        next = freeByOffset.lower_bound(offset);
+        if ( next != freeByOffset.begin() ) {
+            std::map<U64, U64>::iterator prev = next;
+            --prev;
+            if ( (prev->first + prev->second) == offset ) {
+                offset = prev->first;
+                length += prev->second;
+                removeFreeExtent(prev);
+            }
+        }
+        addFreeExtent(offset, length);
+    }
+};
+
+typedef boost::shared_ptr<CachePackFile> CachePackFilePtr;
+
+struct CachePackStorePrivate
+{
+    U64 packFileSize;
+    mutable QMutex lock;
+    std::list<CachePackFilePtr> packs;
+
+    CachePackStorePrivate(U64 packFileSize)
+    : packFileSize(packFileSize)
+    , lock()
+    , packs()
+    {
+    }
+
+    CachePackFile* findPack(const std::string& directory,
+                            int index) const
+    {
+        for (std::list<CachePackFilePtr>::const_iterator it = packs.begin(); it != packs.end(); ++it) {
+            if ( ( (*it)->index == index ) && ( (*it)->directory == directory ) ) {
+                return it->get();
+            }
+        }
+
+        return 0;
+    }
+
+    CachePackFile* openPack(const std::string& directory,
+                            int index,
+                            bool create)
+    {
+        CachePackFilePtr pack(new CachePackFile);
+        pack->directory = directory;
+        pack->index = index;
+        std::string filePath = CachePackStore::getPackFilePath(directory, index);
+        try {
+            if (create) {
+                // the file is sparse: disk space is only used when pages are written
+                pack->file.reset( new MemoryFile(filePath, packFileSize, MemoryFile::eFileOpenModeEnumIfExistsTruncateElseCreate) );
+            } else {
+                pack->file.reset( new MemoryFile(filePath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseFail) );
+            }
+        } catch (const std::exception & e) {
+            std::cerr << e.what() << std::endl;
+
+            return 0;
+        }
+        pack->size = pack->file->size();
+        if ( !pack->file->data() || (pack->size == 0) ) {
+            return 0;
+        }
+        pack->initFreeList();
+        packs.push_back(pack);
+        // a pack keeps its file opened for its whole lifetime: it counts as one opened cache file, whatever the
+        // number of entries it holds
+        if (appPTR) {
+            appPTR->increaseNCacheFilesOpened();
+        }
+
+        return pack.get();
+    }
+
+    void closePack(std::list<CachePackFilePtr>::iterator it)
+    {
+        packs.erase(it);
+        if (appPTR) {
+            appPTR->decreaseNCacheFilesOpened();
+        }
+    }
+};
+
+CachePackStore::CachePackStore(U64 packFileSize)
+    : _imp( new CachePackStorePrivate(packFileSize) )
+{
+}
+
+CachePackStore::~CachePackStore()
+{
+    flush();
+    while ( !_imp->packs.empty() ) {
+        _imp->closePack( _imp->packs.begin() );
+    }
+}
+
+std::string
+CachePackStore::getPackFilePath(const std::string& directory,
+                                int packIndex)
+{
+    std::stringstream ss;
+    ss << directory << "pack_" << packIndex << "." NATRON_CACHE_FILE_EXT;
+
+    return ss.str();
+}
+
+bool
+CachePackStore::allocate(const std::string& directory,
+                         U64 size,
+                         CachePackSlot* slot)
+{
+    assert(slot && !slot->isValid());
+    if ( directory.empty() || (size == 0) ) {
+        return false;
+    }
+    U64 capacity = ( (size + NATRON_CACHE_PACK_BLOCK_SIZE - 1) / NATRON_CACHE_PACK_BLOCK_SIZE ) * NATRON_CACHE_PACK_BLOCK_SIZE;
+    if (capacity > _imp->packFileSize) {
+        return false;
+    }
+
+    QMutexLocker k(&_imp->lock);
+    CachePackFile* pack = 0;
+    U64 offset = 0;
+    for (std::list<CachePackFilePtr>::iterator it = _imp->packs.begin(); it != _imp->packs.end(); ++it) {
+        if ( ( (*it)->directory == directory ) && (*it)->allocate(capacity, &offset) ) {
+            pack = it->get();
+            break;
+        }
+    }
+    if (!pack) {
+        int index = 0;
+        while ( _imp->findPack(directory, index) ) {
+            ++index;
+        }
+        pack = _imp->openPack(directory, index, true);
+        if ( !pack || !pack->allocate(capacity, &offset) ) {
+            return false;
+        }
+    }
+    slot->directory = directory;
+    slot->packIndex = pack->index;
+    slot->offset = offset;
+    slot->capacity = capacity;
+
+    return true;
+}
+
+void
+CachePackStore::release(CachePackSlot* slot)
+{
+    if ( !slot->isValid() ) {
+        return;
+    }
+    {
+        QMutexLocker k(&_imp->lock);
+        CachePackFile* pack = _imp->findPack(slot->directory, slot->packIndex);
+        if (pack) {
+            pack->release(slot->offset, slot->capacity);
+        }
+    }
+    slot->packIndex = -1;
+    slot->offset = 0;
+    slot->capacity = 0;
+}
+
+char*
+CachePackStore::getData(const CachePackSlot& slot) const
+{
+    if ( !slot.isValid() ) {
+        return 0;
+    }
+    QMutexLocker k(&_imp->lock);
+    CachePackFile* pack = _imp->findPack(slot.directory, slot.packIndex);
+    if ( !pack || ( (slot.offset + slot.capacity) > pack->size ) ) {
+        return 0;
+    }
+
+    return pack->file->data() + slot.offset;
+}
+
+bool
+CachePackStore::restoreSlot(const CachePackSlot& slot)
+{
+    if ( !slot.isValid() || (slot.capacity == 0) ) {
+        return false;
+    }
+    QMutexLocker k(&_imp->lock);
+    CachePackFile* pack = _imp->findPack(slot.directory, slot.packIndex);
+    if (!pack) {
+        pack = _imp->openPack(slot.directory, slot.packIndex, false);
+        if (!pack) {
+            return false;
+        }
+    }
+
+    return pack->reserve(slot.offset, slot.capacity);
+}
+
+bool
+CachePackStore::flush()
+{
+    QMutexLocker k(&_imp->lock);
+    bool ok = true;
+    for (std::list<CachePackFilePtr>::iterator it = _imp->packs.begin(); it != _imp->packs.end(); ++it) {
+        if ( !(*it)->file->flush() ) {
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+void
+CachePackStore::releaseUnusedPacks()
+{
+    QMutexLocker k(&_imp->lock);
+    std::list<CachePackFilePtr>::iterator it = _imp->packs.begin();
+    while ( it != _imp->packs.end() ) {
+        if ( (*it)->usedBytes == 0 ) {
+            (*it)->file->remove();
+            _imp->closePack(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void
+CachePackStore::getStats(std::size_t* nPacks,
+                         U64* reservedBytes,
+                         U64* usedBytes) const
+{
+    QMutexLocker k(&_imp->lock);
+    *nPacks = _imp->packs.size();
+    *reservedBytes = 0;
+    *usedBytes = 0;
+    for (std::list<CachePackFilePtr>::const_iterator it = _imp->packs.begin(); it != _imp->packs.end(); ++it) {
+        *reservedBytes += (*it)->size;
+        *usedBytes += (*it)->usedBytes;
+    }
+}
+
+NATRON_NAMESPACE_EXIT;
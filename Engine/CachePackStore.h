@@ -0,0 +1,137 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_CACHEPACKSTORE_H
+#define NATRON_ENGINE_CACHEPACKSTORE_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <string>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Global/GlobalDefines.h"
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief The location of a disk cache entry in a pack file.
+ **/
+struct CachePackSlot
+{
+    std::string directory; //< the cache directory containing the pack file, ending with a separator
+    int packIndex; //< index of the pack file in the directory, -1 if the slot is not allocated
+    U64 offset; //< offset in bytes of the entry from the start of the pack file
+    U64 capacity; //< number of bytes reserved for the entry, a multiple of NATRON_CACHE_PACK_BLOCK_SIZE
+
+    CachePackSlot()
+    : directory()
+    , packIndex(-1)
+    , offset(0)
+    , capacity(0)
+    {
+    }
+
+    bool isValid() const
+    {
+        return packIndex != -1;
+    }
+};
+
+struct CachePackStorePrivate;
+
+/**
+ * @brief Stores the disk cache entries of a Cache in a few large memory-mapped files (the packs) instead of
+ * one file per entry. Each pack is mapped once for its whole lifetime and carved into blocks of
+ * NATRON_CACHE_PACK_BLOCK_SIZE bytes with a best-fit free-list, so that creating, evicting and
+ * re-opening an entry never touches the file-system metadata.
+ * The position of each entry is saved in the table of contents of the cache, which is enough to
+ * rebuild the free-lists when restoring the cache.
+ * Each opened pack counts as a single file in the limit of opened cache files of the AppManager, the
+ * entries it holds do not count.
+ *
+ * This class is MT-safe.
+ **/
+class CachePackStore
+{
+public:
+
+    CachePackStore(U64 packFileSize = NATRON_CACHE_PACK_FILE_SIZE);
+
+    ~CachePackStore();
+
+    /**
+     * @brief Reserves size bytes in a pack file of the given directory, creating a new pack file if needed.
+     * Returns false if the entry cannot be packed (e.g: it is larger than a pack file or the pack file
+     * could not be created), in which case the caller should store it in a file of its own.
+     **/
+    bool allocate(const std::string& directory, U64 size, CachePackSlot* slot);
+
+    /**
+     * @brief Gives back the space of the slot to the free-list. The slot is invalidated.
+     **/
+    void release(CachePackSlot* slot);
+
+    /**
+     * @brief Returns a pointer to the beginning of the slot in the mapped pack file or NULL if the
+     * slot does not belong to an opened pack.
+     **/
+    char* getData(const CachePackSlot& slot) const;
+
+    /**
+     * @brief Marks the slot of an entry read from the table of contents of the cache as used, opening
+     * its pack file if needed. Returns false if the pack file does not exist or the slot overlaps another one.
+     **/
+    bool restoreSlot(const CachePackSlot& slot);
+
+    /**
+     * @brief Ensures that all pack files are in sync with the data in memory.
+     **/
+    bool flush();
+
+    /**
+     * @brief Closes the pack files that no entry uses anymore. To be called when the cache was cleared
+     * so that the files can be removed from the disk.
+     **/
+    void releaseUnusedPacks();
+
+    /**
+     * @brief Returns the number of opened pack files, the bytes they occupy on disk and the bytes
+     * used by entries.
+     **/
+    void getStats(std::size_t* nPacks, U64* reservedBytes, U64* usedBytes) const;
+
+    static std::string getPackFilePath(const std::string& directory, int packIndex);
+
+private:
+
+    boost::scoped_ptr<CachePackStorePrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_CACHEPACKSTORE_H
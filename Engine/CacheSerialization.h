@@ -53,7 +53,8 @@ GCC_DIAG_ON(unused-parameter)
 
 // Note: these classes are used for cache serialization and do not have to maintain backward compatibility
 #define SERIALIZED_ENTRY_INTRODUCES_SIZE 2
-#define SERIALIZED_ENTRY_VERSION SERIALIZED_ENTRY_INTRODUCES_SIZE
+#define SERIALIZED_ENTRY_INTRODUCES_PACK 3
+#define SERIALIZED_ENTRY_VERSION SERIALIZED_ENTRY_INTRODUCES_PACK
 
 //Beyond that percentage of occupation, the cache will start evicting LRU entries
 #define NATRON_CACHE_LIMIT_PERCENT 0.9
@@ -69,27 +70,37 @@ template<typename EntryType>
 void Cache<EntryType>::save(CacheTOC* tableOfContents)
 {
     clearInMemoryPortion(false);
-    QMutexLocker l(&_lock);     // must be locked
-
-    for (CacheIterator it = _diskCache.begin(); it != _diskCache.end(); ++it) {
-        std::list<EntryTypePtr> & listOfValues  = getValueFromIterator(it);
-        for (typename std::list<EntryTypePtr>::const_iterator it2 = listOfValues.begin(); it2 != listOfValues.end(); ++it2) {
-            if ( (*it2)->isStoredOnDisk() ) {
-                SerializedEntry serialization;
-                serialization.hash = (*it2)->getHashKey();
-                serialization.params = (*it2)->getParams();
-                serialization.key = (*it2)->getKey();
-                serialization.size = (*it2)->dataSize();
-                serialization.filePath = (*it2)->getFilePath();
-                tableOfContents->push_back(serialization);
+    for (std::size_t i = 0; i < _shards.size(); ++i) {
+        CacheShard& shard = *_shards[i];
+        QMutexLocker l(&shard.lock);     // must be locked
+
+        for (CacheIterator it = shard.diskCache.begin(); it != shard.diskCache.end(); ++it) {
+            std::list<EntryTypePtr> & listOfValues  = getValueFromIterator(it);
+            for (typename std::list<EntryTypePtr>::const_iterator it2 = listOfValues.begin(); it2 != listOfValues.end(); ++it2) {
+                if ( (*it2)->isStoredOnDisk() ) {
+                    SerializedEntry serialization;
+                    serialization.hash = (*it2)->getHashKey();
+                    serialization.params = (*it2)->getParams();
+                    serialization.key = (*it2)->getKey();
+                    serialization.size = (*it2)->dataSize();
+                    serialization.filePath = (*it2)->getFilePath();
+                    const CachePackSlot& slot = (*it2)->getPackSlot();
+                    serialization.packIndex = slot.packIndex;
+                    serialization.packOffset = slot.offset;
+                    serialization.packCapacity = slot.capacity;
+                    tableOfContents->push_back(serialization);
 #ifdef DEBUG
-                if (!CacheAPI::checkFileNameMatchesHash(serialization.filePath, serialization.hash)) {
-                    qDebug() << "WARNING: Cache entry filename is not the same as the serialized hash key";
-                }
+                    if ( !slot.isValid() && !CacheAPI::checkFileNameMatchesHash(serialization.filePath, serialization.hash) ) {
+                        qDebug() << "WARNING: Cache entry filename is not the same as the serialized hash key";
+                    }
 #endif
+                }
             }
         }
     }
+    if ( !_packStore->flush() ) {
+        qDebug() << "WARNING: Failed to flush the cache pack files";
+    }
 }
 
 
@@ -117,8 +128,20 @@ void Cache<EntryType>::restore(const CacheTOC & tableOfContents)
             qDebug() << "WARNING: serialized hash key different than the restored one";
         }
 
+        CachePackSlot slot;
+        if (it->packIndex != -1) {
+            slot.directory = getCachePath().toStdString();
+            slot.directory += '/';
+            slot.packIndex = it->packIndex;
+            slot.offset = it->packOffset;
+            slot.capacity = it->packCapacity;
+            if ( !_packStore->restoreSlot(slot) ) {
+                qDebug() << "WARNING: Could not restore cache entry from pack file" << CachePackStore::getPackFilePath(slot.directory, slot.packIndex).c_str();
+                continue;
+            }
+        }
 #ifdef DEBUG
-        if (!checkFileNameMatchesHash(it->filePath, it->hash)) {
+        else if (!checkFileNameMatchesHash(it->filePath, it->hash)) {
             qDebug() << "WARNING: Cache entry filename is not the same as the serialized hash key";
         }
 #endif
@@ -128,18 +151,26 @@ void Cache<EntryType>::restore(const CacheTOC & tableOfContents)
         StorageModeEnum storage = eStorageModeDisk;
 
         try {
-            value = new EntryType(it->key,it->params,this,storage,it->filePath);
+            value = new EntryType(it->key,it->params,this,storage,slot.isValid() ? slot.directory : it->filePath);
 
             ///This will not put the entry back into RAM, instead we just insert back the entry into the disk cache
-            value->restoreMetaDataFromFile(it->size);
+            if ( slot.isValid() ) {
+                value->restoreMetaDataFromPack(slot, it->size);
+            } else {
+                value->restoreMetaDataFromFile(it->size);
+            }
         } catch (const std::exception & e) {
             qDebug() << e.what();
+            if ( slot.isValid() ) {
+                _packStore->release(&slot);
+            }
             continue;
         }
 
         {
-            QMutexLocker locker(&_lock);
-            sealEntry(EntryTypePtr(value), false);
+            CacheShard& shard = getShard( value->getHashKey() );
+            QMutexLocker locker(&shard.lock);
+            sealEntry(shard, EntryTypePtr(value), false);
         }
     }
 }
@@ -152,6 +183,9 @@ struct Cache<EntryType>::SerializedEntry
     ParamsTypePtr params;
     std::size_t size; //< the data size in bytes
     std::string filePath; //< we need to serialize it as several entries can have the same hash, hence we index them
+    int packIndex; //< the pack file containing the entry, -1 if the entry is stored in filePath
+    U64 packOffset;
+    U64 packCapacity;
 
     SerializedEntry()
     : hash(0)
@@ -159,6 +193,9 @@ struct Cache<EntryType>::SerializedEntry
     , params()
     , size(0)
     , filePath()
+    , packIndex(-1)
+    , packOffset(0)
+    , packCapacity(0)
     {
 
     }
@@ -172,6 +209,9 @@ struct Cache<EntryType>::SerializedEntry
         ar & ::boost::serialization::make_nvp("Params",params);
         ar & ::boost::serialization::make_nvp("Size",size);
         ar & ::boost::serialization::make_nvp("Filename",filePath);
+        ar & ::boost::serialization::make_nvp("PackIndex",packIndex);
+        ar & ::boost::serialization::make_nvp("PackOffset",packOffset);
+        ar & ::boost::serialization::make_nvp("PackCapacity",packCapacity);
     }
 };
 
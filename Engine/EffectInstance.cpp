@@ -1355,6 +1355,13 @@ EffectInstance::getImageFromCacheAndConvertIfNeeded(bool useCache,
 
     if (!isCached) {
         isCached = !useDiskCache ? AppManager::getImageFromCache(key, &cachedImages) : AppManager::getImageFromDiskCache(key, &cachedImages);
+        if ( !isCached && !useDiskCache && appPTR->isPersistentImageStoreEnabled() ) {
+            ///The image may have been rendered by a previous session or another computer sharing the persistent store
+            U64 contentHash;
+            if ( getNode()->computeContentHash(key._time, ViewIdx(key._view), &contentHash) ) {
+                isCached = appPTR->getImage_persistentStore(key, contentHash, &cachedImages);
+            }
+        }
     }
 
     if (stats && stats->isInDepthProfilingEnabled() && !isCached) {
@@ -1828,8 +1835,10 @@ EffectInstance::Implementation::tiledRenderingFunctor(EffectInstance::Implementa
                                  args.processChannels,
                                  args.planes);
     
-    //Exit of the host frame threading thread
-    appPTR->getAppTLS()->cleanupTLSForThread();
+    //Exit of the host frame threading thread. The TaskScheduler also runs tiles in the calling thread, whose TLS must be kept
+    if (callingThread != curThread) {
+        appPTR->getAppTLS()->cleanupTLSForThread();
+    }
     
     return ret;
 }
@@ -2114,15 +2123,13 @@ EffectInstance::Implementation::renderHandler(const EffectDataTLSPtr& tls,
                                               const std::bitset<4>& processChannels,
                                               const boost::shared_ptr<Image> & originalInputImage,
                                               const boost::shared_ptr<Image> & maskImage,
-                                              const ImagePremultiplicationEnum originalImagePremultiplication,
+                                              const ImagePremultiplicationEnum /*originalImagePremultiplication*/,
                                               ImagePlanesToRender & planes)
 {
-    boost::shared_ptr<TimeLapse> timeRecorder;
+    ///The render time is also recorded when not profiling: it is the cost the cache weighs when evicting images
+    boost::shared_ptr<TimeLapse> timeRecorder( new TimeLapse() );
 
     const boost::shared_ptr<ParallelRenderArgs>& frameArgs = tls->frameArgs.back();
-    if (frameArgs->stats) {
-        timeRecorder.reset( new TimeLapse() );
-    }
 
     const EffectInstance::PlaneToRender & firstPlane = planes.planes.begin()->second;
     const double time = tls->currentRenderArgs.time;
@@ -2460,10 +2467,8 @@ EffectInstance::Implementation::renderHandler(const EffectDataTLSPtr& tls,
                 }
                 
                 if (mappedOriginalInputImage) {
-                    it->second.tmpImage->copyUnProcessedChannels(renderMappedRectToRender, planes.outputPremult, originalImagePremultiplication, processChannels, mappedOriginalInputImage);
-                    if (useMaskMix) {
-                        it->second.tmpImage->applyMaskMix(renderMappedRectToRender, maskImage.get(), mappedOriginalInputImage.get(), doMask, false, mix);
-                    }
+                    it->second.tmpImage->copyUnProcessedChannelsAndApplyMaskMix(renderMappedRectToRender, processChannels, mappedOriginalInputImage,
+                                                                                useMaskMix, maskImage.get(), doMask, false, mix);
                 }
                 if ( ( it->second.fullscaleImage->getComponents() != it->second.tmpImage->getComponents() ) ||
                     ( it->second.fullscaleImage->getBitDepth() != it->second.tmpImage->getBitDepth() ) ) {
@@ -2524,10 +2529,8 @@ EffectInstance::Implementation::renderHandler(const EffectDataTLSPtr& tls,
                     }
                 }
 
-                it->second.downscaleImage->copyUnProcessedChannels(actionArgs.roi, planes.outputPremult, originalImagePremultiplication, processChannels, originalInputImage);
-                if (useMaskMix) {
-                    it->second.downscaleImage->applyMaskMix(actionArgs.roi, maskImage.get(), originalInputImage.get(), doMask, false, mix);
-                }
+                it->second.downscaleImage->copyUnProcessedChannelsAndApplyMaskMix(actionArgs.roi, processChannels, originalInputImage,
+                                                                                  useMaskMix, maskImage.get(), doMask, false, mix);
                 it->second.downscaleImage->markForRendered(downscaledRectToRender);
                 
                 
@@ -2539,6 +2542,12 @@ EffectInstance::Implementation::renderHandler(const EffectDataTLSPtr& tls,
         }
     } // for (std::map<ImageComponents,PlaneToRender>::const_iterator it = outputPlanes.begin(); it != outputPlanes.end(); ++it) {
 
+    ///Planes are rendered by the same action, share the time spent among them
+    const double recomputeCost = timeRecorder->getTimeSinceCreation() / outputPlanes.size();
+    for (std::map<ImageComponents, EffectInstance::PlaneToRender>::const_iterator it = outputPlanes.begin(); it != outputPlanes.end(); ++it) {
+        it->second.fullscaleImage->addRecomputeCost(recomputeCost);
+    }
+
 
     return eRenderingFunctorRetOK;
 } // tiledRenderingFunctor
@@ -4374,10 +4383,10 @@ EffectInstance::getNearestNonIdentity(double time)
 
 
 void
-EffectInstance::onNodeHashChanged(U64 hash)
+EffectInstance::onNodeHashInvalidated()
 {
-    ///Invalidate actions cache
-    _imp->actionsCache.invalidateAll(hash);
+    ///Invalidate actions cache: the results of the previous hashes can no longer be used
+    _imp->actionsCache.clearAll();
 
     const KnobsVec & knobs = getKnobs();
     for (KnobsVec::const_iterator it = knobs.begin(); it != knobs.end(); ++it) {
@@ -279,6 +279,15 @@ public:
      **/
     virtual int getMinorVersion() const WARN_UNUSED_RETURN = 0;
 
+    /**
+     * @brief Appends to the hash what identifies the build of the plugin beyond its major and minor versions, so that
+     * the content hash of the node changes when the plugin is updated (@see Node::computeContentHash()).
+     * The plugins built in Natron are identified by the version of Natron.
+     **/
+    virtual void appendPluginVersionToHash(Hash64* /*hash*/) const
+    {
+    }
+
     /**
      * @brief Is this node an input node ? An input node means
      * it has no input.
@@ -1310,10 +1319,10 @@ public:
     bool getThreadLocalNeededComponents(boost::shared_ptr<ComponentsNeededMap>* neededComps) const;
 
     /**
-     * @brief Called when the associated node's hash has changed.
+     * @brief Called when the associated node's hash is invalidated, before it is recomputed.
      * This is always called on the main-thread.
      **/
-    void onNodeHashChanged(U64 hash);
+    void onNodeHashInvalidated();
 
     void resetTotalTimeSpentRendering();
 
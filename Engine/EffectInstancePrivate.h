@@ -299,6 +299,19 @@ struct EffectInstance::Implementation
     
     RenderingFunctorRetEnum tiledRenderingFunctor(TiledRenderingFunctorArgs & args,  const RectToRender & specificData,
                                                   const QThread* callingThread);
+
+    /**
+     * @brief Renders rects[index] and stores the result in results[index], this is an iteration of the TaskScheduler loop
+     * rendering the rects of an eRenderSafetyFullySafeFrame effect.
+     **/
+    void tiledRenderingFunctorAt(TiledRenderingFunctorArgs* args,
+                                 const std::vector<RectToRender>* rects,
+                                 const QThread* callingThread,
+                                 std::vector<RenderingFunctorRetEnum>* results,
+                                 unsigned int index)
+    {
+        (*results)[index] = tiledRenderingFunctor( *args, (*rects)[index], callingThread );
+    }
     
     RenderingFunctorRetEnum tiledRenderingFunctor(const RectToRender & rectToRender,
                                                   const bool renderFullScaleThenDownscale,
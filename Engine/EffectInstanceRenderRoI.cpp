@@ -35,7 +35,6 @@
 #include <boost/scoped_ptr.hpp>
 
 #include <QtCore/QThreadPool>
-#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QCoreApplication>
 #include <QtCore/QtConcurrentRun>
@@ -71,6 +70,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/RotoContext.h"
 #include "Engine/RotoDrawableItem.h"
 #include "Engine/Settings.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/Timer.h"
 #include "Engine/Transform.h"
 #include "Engine/ViewIdx.h"
@@ -1561,6 +1561,19 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
                 ccImgCache->swapOrInsert(it->second.cacheSwapImage, it->second.fullscaleImage);
             }
         }
+
+        ///Share the rendered image with the next sessions. This is only done for renders to disk: interactive renders
+        ///change too often to be worth keeping
+        if ( createInCache && !byPassCache && !useDiskCacheNode && hasSomethingToRender && !renderAborted &&
+             (renderRetCode == eRenderRoIStatusImageRendered) && frameArgs->isSequentialRender &&
+             appPTR->isPersistentImageStoreEnabled() ) {
+            ///The content hash is only valid if nothing changed since the render started
+            U64 contentHash;
+            if ( ( getNode()->getHashValue() == it->second.fullscaleImage->getKey()._nodeHashKey ) &&
+                 getNode()->computeContentHash(args.time, args.view, &contentHash) ) {
+                appPTR->storeImageInPersistentStore(it->second.fullscaleImage, contentHash);
+            }
+        }
         
         //We have to return the downscale image, so make sure it has been computed
         if ( (renderRetCode != eRenderRoIStatusRenderFailed) &&
@@ -1692,7 +1705,6 @@ EffectInstance::renderRoIInternal(double time,
         ///Also check that the number of threads indicating by the settings are appropriate for this render mode.
         if ( !frameArgs->tilesSupported || (nbThreads == -1) || (nbThreads == 1) ||
             ( (nbThreads == 0) && (appPTR->getHardwareIdealThreadCount() == 1) ) ||
-            ( QThreadPool::globalInstance()->activeThreadCount() >= QThreadPool::globalInstance()->maxThreadCount() ) ||
             isRotoPaintNode() ) {
             safety = eRenderSafetyFullySafe;
         }
@@ -1780,14 +1792,24 @@ EffectInstance::renderRoIInternal(double time,
 #else
 
 
-            QFuture<RenderingFunctorRetEnum> ret = QtConcurrent::mapped( planesToRender->rectsToRender,
-                                                                        boost::bind(&EffectInstance::Implementation::tiledRenderingFunctor,
-                                                                                    _imp.get(),
-                                                                                    *tiledArgs,
-                                                                                    _1,
-                                                                                    currentThread) );
-            ret.waitForFinished();
-            QFuture<EffectInstance::RenderingFunctorRetEnum>::const_iterator it2;
+            ///The rects are rendered by the TaskScheduler: if the renders of the inputs started in the tiles are also split into
+            ///tiles, they use the idle workers instead of waiting for a thread or running in a single thread
+            std::vector<RectToRender> rects( planesToRender->rectsToRender.begin(), planesToRender->rectsToRender.end() );
+            std::vector<EffectInstance::RenderingFunctorRetEnum> ret( rects.size(), eRenderingFunctorRetFailed );
+            try {
+                appPTR->getTaskScheduler()->parallelFor( rects.size(),
+                                                         boost::bind(&EffectInstance::Implementation::tiledRenderingFunctorAt,
+                                                                     _imp.get(),
+                                                                     tiledArgs.get(),
+                                                                     &rects,
+                                                                     currentThread,
+                                                                     &ret,
+                                                                     _1) );
+            } catch (const std::exception & e) {
+                qDebug() << getScriptName_mt_safe().c_str() << "failed to render a tile:" << e.what();
+                std::fill(ret.begin(), ret.end(), eRenderingFunctorRetFailed);
+            }
+            std::vector<EffectInstance::RenderingFunctorRetEnum>::const_iterator it2;
 
 #endif
             for (it2 = ret.begin(); it2 != ret.end(); ++it2) {
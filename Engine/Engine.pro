@@ -80,6 +80,8 @@ SOURCES += \
     BezierCP.cpp \
     BlockingBackgroundRender.cpp \
     Cache.cpp \
+    CacheCompressor.cpp \
+    CachePackStore.cpp \
     CLArgs.cpp \
     CoonsRegularization.cpp \
     Curve.cpp \
@@ -101,12 +103,14 @@ SOURCES += \
     GroupOutput.cpp \
     Hash64.cpp \
     HistogramCPU.cpp \
+    HistogramKernels.cpp \
     Image.cpp \
     ImageConvert.cpp \
     ImageCopyChannels.cpp \
     ImageComponents.cpp \
     ImageKey.cpp \
     ImageMaskMix.cpp \
+    ImageMinMax.cpp \
     ImageParamsSerialization.cpp \
     Interpolation.cpp \
     Knob.cpp \
@@ -118,6 +122,8 @@ SOURCES += \
     Log.cpp \
     Lut.cpp \
     MemoryFile.cpp \
+    MemoryPool.cpp \
+    MipMapKernels.cpp \
     Node.cpp \
     NodeGroup.cpp \
     NodeMetadata.cpp \
@@ -136,8 +142,12 @@ SOURCES += \
     OutputEffectInstance.cpp \
     OutputSchedulerThread.cpp \
     ParallelRenderArgs.cpp \
+    ParallelRenderController.cpp \
+    PersistentImageStore.cpp \
+    PixelConversion.cpp \
     Plugin.cpp \
     PluginMemory.cpp \
+    PostRenderKernels.cpp \
     PrecompNode.cpp \
     ProcessHandler.cpp \
     Project.cpp \
@@ -157,18 +167,22 @@ SOURCES += \
     RotoItem.cpp \
     RotoLayer.cpp \
     RotoPaint.cpp \
+    RotoShapeRasterizer.cpp \
     RotoSmear.cpp \
     RotoStrokeItem.cpp \
     ScriptObject.cpp \
     Settings.cpp \
+    SimdSupport.cpp \
     StandardPaths.cpp \
     StringAnimationManager.cpp \
+    TaskScheduler.cpp \
     TextureRect.cpp \
     TimeLine.cpp \
     Timer.cpp \
     TLSHolder.cpp \
     Transform.cpp \
     ViewerInstance.cpp \
+    ViewerTextureConversion.cpp \
     ../Global/ProcInfo.cpp \
     ../libs/SequenceParsing/SequenceParsing.cpp \
     NatronEngine/natronengine_module_wrapper.cpp \
@@ -227,8 +241,10 @@ HEADERS += \
     BufferableObject.h \
     CLArgs.h \
     Cache.h \
+    CacheCompressor.h \
     CacheEntry.h \
     CacheEntryHolder.h \
+    CachePackStore.h \
     CacheSerialization.h \
     CoonsRegularization.h \
     Curve.h \
@@ -257,11 +273,13 @@ HEADERS += \
     GroupOutput.h \
     Hash64.h \
     HistogramCPU.h \
+    HistogramKernels.h \
     ImageInfo.h \
     Image.h \
     ImageComponents.h \
     ImageKey.h \
     ImageLocker.h \
+    ImageMinMax.h \
     ImageSerialization.h \
     ImageParams.h \
     ImageParamsSerialization.h \
@@ -279,7 +297,9 @@ HEADERS += \
     LRUHashTable.h \
     Lut.h \
     MemoryFile.h \
+    MemoryPool.h \
     MergingEnum.h \
+    MipMapKernels.h \
     Node.h \
     NodeGroup.h \
     NodeGroupSerialization.h \
@@ -302,8 +322,12 @@ HEADERS += \
     OutputSchedulerThread.h \
     OverlaySupport.h \
     ParallelRenderArgs.h \
+    ParallelRenderController.h \
+    PersistentImageStore.h \
+    PixelConversion.h \
     Plugin.h \
     PluginMemory.h \
+    PostRenderKernels.h \
     PrecompNode.h \
     ProcessHandler.h \
     Project.h \
@@ -332,14 +356,17 @@ HEADERS += \
     RotoItemSerialization.h \
     RotoPaint.h \
     RotoPoint.h \
+    RotoShapeRasterizer.h \
     RotoSmear.h \
     RotoStrokeItem.h \
     RotoStrokeItemSerialization.h \
     ScriptObject.h \
     Settings.h \
+    SimdSupport.h \
     Singleton.h \
     StandardPaths.h \
     StringAnimationManager.h \
+    TaskScheduler.h \
     TextureRect.h \
     TextureRectSerialization.h \
     ThreadStorage.h \
@@ -354,6 +381,7 @@ HEADERS += \
     VariantSerialization.h \
     ViewerInstance.h \
     ViewerInstancePrivate.h \
+    ViewerTextureConversion.h \
     ViewIdx.h \
     ../Global/Enums.h \
     ../Global/GitVersion.h \
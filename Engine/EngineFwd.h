@@ -106,6 +106,7 @@ class BufferableObject;
 class ButtonParam;
 class CLArgs;
 class CacheEntryHolder;
+struct CacheEntryHolderStats;
 class CacheSignalEmitter;
 struct CreateNodeArgs;
 class ChoiceExtraData;
@@ -180,6 +181,7 @@ class OutputFileParam;
 class OverlaySupport;
 class PageParam;
 class ParallelRenderArgsSetter;
+class ParallelRenderController;
 class Param;
 class ParametricParam;
 class PathParam;
@@ -205,12 +207,14 @@ class RotoItem;
 class RotoItemSerialization;
 class RotoLayer;
 class RotoPoint;
+class RotoShapeRasterizer;
 class RotoStrokeItem;
 class SeparatorParam;
 class Settings;
 class StringAnimationManager;
 class StringParam;
 class TLSHolderBase;
+class TaskScheduler;
 class TextureRect;
 class TimeLine;
 class UserParamHolder;
@@ -46,7 +46,8 @@ GCC_DIAG_ON(unused-parameter)
 #define FRAME_KEY_HANDLE_FP_CORRECTLY 6
 #define FRAME_KEY_INTRODUCES_DRAFT 7
 #define FRAME_KEY_INTRODUCES_CACHE_HOLDER_ID 8
-#define FRAME_KEY_VERSION FRAME_KEY_INTRODUCES_CACHE_HOLDER_ID
+#define FRAME_KEY_INTRODUCES_DISPLAY_INDEPENDENT 9
+#define FRAME_KEY_VERSION FRAME_KEY_INTRODUCES_DISPLAY_INDEPENDENT
 
 NATRON_NAMESPACE_ENTER;
 
@@ -94,6 +95,11 @@ FrameKey::serialize(Archive & ar,
     if (version >= FRAME_KEY_INTRODUCES_CACHE_HOLDER_ID) {
         ar & ::boost::serialization::make_nvp("HolderID",_holderID);
     }
+    if (version >= FRAME_KEY_INTRODUCES_DISPLAY_INDEPENDENT) {
+        ar & ::boost::serialization::make_nvp("DisplayIndependent", _displayIndependent);
+    } else {
+        _displayIndependent = false;
+    }
 }
 
 NATRON_NAMESPACE_EXIT;
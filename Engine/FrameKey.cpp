@@ -46,6 +46,7 @@ FrameKey::FrameKey()
 , _layer()
 , _alphaChannelFullName()
 , _useShaders(false)
+, _displayIndependent(false)
 , _draftMode(false)
 {
     _scale.x = _scale.y = 0.;
@@ -66,6 +67,7 @@ FrameKey::FrameKey(const CacheEntryHolder* holder,
                    const ImageComponents& layer,
                    const std::string& alphaChannelFullName,
                    bool useShaders,
+                   bool displayIndependent,
                    bool draftMode)
 : KeyHelper<U64>(holder)
 , _time(time)
@@ -82,6 +84,7 @@ FrameKey::FrameKey(const CacheEntryHolder* holder,
 , _layer(layer)
 , _alphaChannelFullName(alphaChannelFullName)
 , _useShaders(useShaders)
+, _displayIndependent(displayIndependent)
 , _draftMode(draftMode)
 {
 }
@@ -91,11 +94,12 @@ FrameKey::fillHash(Hash64* hash) const
 {
     hash->append(_time);
     hash->append(_treeVersion);
-    if (!_useShaders) {
+    if ( !isDisplayIndependent() ) {
         hash->append(_gain);
         hash->append(_gamma);
         hash->append(_lut);
     }
+    hash->append(_displayIndependent);
     hash->append(_bitDepth);
     hash->append(_channels);
     hash->append(_view);
@@ -128,7 +132,8 @@ FrameKey::operator==(const FrameKey & other) const
     _treeVersion == other._treeVersion &&
     ((_gain == other._gain &&
     _gamma == other._gamma && 
-      _lut == other._lut) || (_useShaders && other._useShaders)) &&
+      _lut == other._lut) || (isDisplayIndependent() && other.isDisplayIndependent())) &&
+    _displayIndependent == other._displayIndependent &&
     _bitDepth == other._bitDepth &&
     _channels == other._channels &&
     _view == other._view &&
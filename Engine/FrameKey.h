@@ -54,6 +54,7 @@ public:
              const ImageComponents& layer,
              const std::string& alphaChannelFullName,
              bool useShaders,
+             bool displayIndependent,
              bool draftMode);
 
     void fillHash(Hash64* hash) const;
@@ -65,6 +66,15 @@ public:
         return _time;
     };
 
+    /**
+     * @brief Changes the time of the key, e.g: to look-up the same texture at another frame.
+     **/
+    void setTime(SequenceTime time)
+    {
+        _time = time;
+        resetHash();
+    }
+
     int getBitDepth() const WARN_UNUSED_RETURN
     {
         return _bitDepth;
@@ -115,6 +125,15 @@ public:
         return _textureRect;
     }
 
+    /**
+     * @brief True if the texture is float and the gain, gamma and colorspace of the viewer are applied to it when it is
+     * displayed rather than when it is rendered, whether by the shaders or by the CPU.
+     **/
+    bool isDisplayIndependent() const WARN_UNUSED_RETURN
+    {
+        return _useShaders || _displayIndependent;
+    }
+
     template<class Archive>
     void serialize(Archive & ar, const unsigned int version);
 
@@ -133,6 +152,7 @@ private:
     ImageComponents _layer;
     std::string _alphaChannelFullName; /// e.g: color.a , only used if _channels if A
     bool _useShaders;
+    bool _displayIndependent; /// the display transform is applied by the CPU, the texture is not clamped to [0,1]
     bool _draftMode;
 };
 
@@ -24,36 +24,112 @@
 
 #include "Hash64.h"
 
-#include <algorithm>  // for std::for_each
 #include <cassert>
 #include <stdexcept>
 
-#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
-#include <boost/crc.hpp>
-#endif
 #include <QtCore/QString>
 
 #include "Engine/Node.h"
 
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
 NATRON_NAMESPACE_ENTER;
 
+namespace {
+
+inline U64
+rotl64(U64 x,
+       int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline U64
+xxhRound(U64 acc,
+         U64 input)
+{
+    acc += input * XXH_PRIME64_2;
+    acc = rotl64(acc, 31);
+
+    return acc * XXH_PRIME64_1;
+}
+
+inline U64
+xxhMergeRound(U64 acc,
+              U64 val)
+{
+    acc ^= xxhRound(0, val);
+
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+} // anon namespace
+
+void
+Hash64::resetState()
+{
+    _stripeSize = 0;
+    _nValues = 0;
+    _lanes[0] = XXH_PRIME64_1 + XXH_PRIME64_2;
+    _lanes[1] = XXH_PRIME64_2;
+    _lanes[2] = 0;
+    _lanes[3] = 0 - XXH_PRIME64_1;
+}
+
+void
+Hash64::processStripe()
+{
+    assert(_stripeSize == 4);
+    _lanes[0] = xxhRound(_lanes[0], _stripe[0]);
+    _lanes[1] = xxhRound(_lanes[1], _stripe[1]);
+    _lanes[2] = xxhRound(_lanes[2], _stripe[2]);
+    _lanes[3] = xxhRound(_lanes[3], _stripe[3]);
+    _stripeSize = 0;
+    _nValues += 4;
+}
+
 void
 Hash64::computeHash()
 {
-    if ( node_values.empty() ) {
+    U64 nValues = _nValues + _stripeSize;
+    if (nValues == 0) {
         return;
     }
 
-    const unsigned char* data = reinterpret_cast<const unsigned char*>( &node_values.front() );
-    boost::crc_optimal<64,0x42F0E1EBA9EA3693ULL,0,0,false,false> crc_64;
-    crc_64 = std::for_each( data, data + node_values.size() * sizeof(node_values[0]), crc_64 );
-    hash = crc_64();
-}
+    // This is the finalization of XXH64 for an input of nValues * 8 bytes, the values being read as little-endian
+    U64 h;
+    if (_nValues > 0) {
+        h = rotl64(_lanes[0], 1) + rotl64(_lanes[1], 7) + rotl64(_lanes[2], 12) + rotl64(_lanes[3], 18);
+        h = xxhMergeRound(h, _lanes[0]);
+        h = xxhMergeRound(h, _lanes[1]);
+        h = xxhMergeRound(h, _lanes[2]);
+        h = xxhMergeRound(h, _lanes[3]);
+    } else {
+        h = XXH_PRIME64_5;
+    }
+    h += nValues * sizeof(U64);
+
+    for (unsigned int i = 0; i < _stripeSize; ++i) {
+        h ^= xxhRound(0, _stripe[i]);
+        h = rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+
+    hash = h;
+} // Hash64::computeHash
 
 void
 Hash64::reset()
 {
-    node_values.clear();
+    resetState();
     hash = 0;
 }
 
@@ -61,9 +137,23 @@ void
 Hash64_appendQString(Hash64* hash,
                      const QString & str)
 {
-    for (int i = 0; i < str.size(); ++i) {
-        hash->append<unsigned short>( str.at(i).unicode() );
+    const QChar* data = str.constData();
+    int size = str.size();
+
+    int i = 0;
+    for (; i + 4 <= size; i += 4) {
+        hash->appendU64( (U64)data[i].unicode() | ( (U64)data[i + 1].unicode() << 16 ) |
+                         ( (U64)data[i + 2].unicode() << 32 ) | ( (U64)data[i + 3].unicode() << 48 ) );
+    }
+    if (i < size) {
+        U64 last = 0;
+        for (int shift = 0; i < size; ++i, shift += 16) {
+            last |= (U64)data[i].unicode() << shift;
+        }
+        hash->appendU64(last);
     }
+    // Without the length "ab" + "c" and "a" + "bc" would give the same hash
+    hash->appendU64( (U64)size );
 }
 
 NATRON_NAMESPACE_EXIT;
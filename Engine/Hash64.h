@@ -35,22 +35,20 @@
 
 NATRON_NAMESPACE_ENTER;
 
-/*The hash of a Node is the checksum of the vector of data containing:
+/*The hash of a Node is the checksum of the sequence of data containing:
     - the values of the current knob for this node + the name of the node
     - the hash values for the  tree upstream
+   Each value is mixed into the hash state as soon as it is appended, so that no buffer of the values is kept.
  */
 
 class Hash64
 {
 public:
-    Hash64()
-    {
-        hash = 0;
-    }
 
-    ~Hash64()
+    Hash64()
+        : hash(0)
     {
-        node_values.clear();
+        resetState();
     }
 
     U64 value() const
@@ -58,6 +56,10 @@ public:
         return hash;
     }
 
+    /**
+     * @brief Computes the hash of all the values appended since the last reset(). More values may be appended afterwards
+     * and computeHash() called again.
+     **/
     void computeHash();
 
     void reset();
@@ -82,7 +84,15 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
     template<typename T>
     void append(T value)
     {
-        node_values.push_back( toU64(value) );
+        appendU64( toU64(value) );
+    }
+
+    void appendU64(U64 value)
+    {
+        _stripe[_stripeSize++] = value;
+        if (_stripeSize == 4) {
+            processStripe();
+        }
     }
 
     bool operator== (const Hash64 & h) const
@@ -111,10 +121,20 @@ private:
         };
     };
 
+    void resetState();
+
+    void processStripe();
+
     U64 hash;
-    std::vector<U64> node_values;
+    U64 _lanes[4]; //< XXH64 accumulators
+    U64 _stripe[4]; //< values not yet mixed into the lanes
+    unsigned int _stripeSize;
+    U64 _nValues; //< number of values mixed into the lanes
 };
 
+/**
+ * @brief Appends the UTF-16 characters of the string, 4 characters being packed per value, then the length of the string.
+ **/
 void Hash64_appendQString(Hash64* hash, const QString & str);
 
 NATRON_NAMESPACE_EXIT;
@@ -31,7 +31,14 @@
 #include <QMutex>
 #include <QWaitCondition>
 
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/bind.hpp>
+#endif
+
+#include "Engine/AppManager.h"
+#include "Engine/HistogramKernels.h"
 #include "Engine/Image.h"
+#include "Engine/TaskScheduler.h"
 
 NATRON_NAMESPACE_ENTER;
 
@@ -217,73 +224,76 @@ HistogramCPU::getMostRecentlyProducedHistogram(std::vector<float>* histogram1,
     return true;
 }
 
-///putting these in an anonymous namespace will yield this error on gcc 4.2:
-///"function has not external linkage"
-struct pix_red
+static void
+binRowsAt(const HistogramPass* pass,
+          std::vector<std::vector<U32> >* partialCounts,
+          unsigned int index)
 {
-    static float val(const float *pix)
-    {
-        return pix[0];
-    }
-};
+    std::vector<U32> & counts = (*partialCounts)[index];
 
-struct pix_green
-{
-    static float val(const float *pix)
-    {
-        return pix[1];
-    }
-};
+    counts.assign(pass->nChannels * (pass->nBins + 1), 0);
 
-struct pix_blue
-{
-    static float val(const float *pix)
-    {
-        return pix[2];
+    int y1 = (int)( (qint64)pass->height * index / pass->nChunks );
+    int y2 = (int)( (qint64)pass->height * (index + 1) / pass->nChunks );
+    const float* row = pass->pixels + (std::size_t)y1 * pass->rowElements;
+    for (int y = y1; y < y2; ++y, row += pass->rowElements) {
+        HistogramKernels::binRow(*pass, row, &counts[0]);
     }
-};
-
-struct pix_alpha
-{
-    static float val(const float *pix)
-    {
-        return pix[3];
-    }
-};
+}
 
-struct pix_lum
+/**
+ * @brief Computes the histograms of the given channels with nBins bins in a single pass over the image of the request.
+ * The rows are split among the threads of the TaskScheduler, which each count in their own histograms.
+ **/
+static void
+computeHistograms(const HistogramRequest & request,
+                  int nBins,
+                  int nChannels,
+                  const HistogramChannelEnum* channels,
+                  std::vector<float>* histos)
 {
-    static float val(const float *pix)
-    {
-        return 0.299 * pix[0] + 0.587 * pix[1] + 0.114 * pix[2];
+    for (int c = 0; c < nChannels; ++c) {
+        histos[c].assign(nBins, 0.f);
     }
-};
-
-
-template <float pix_func(const float*)>
-void
-computeHisto(const HistogramRequest & request,
-             int upscale,
-             std::vector<float> *histo)
-{
-    assert(histo);
-    histo->resize(request.binsCount * upscale);
-    std::fill(histo->begin(), histo->end(), 0.f);
-    double binSize = (request.vmax - request.vmin) / histo->size();
 
     ///Images come from the viewer which is in float.
     assert(request.image->getBitDepth() == eImageBitDepthFloat);
 
+    RectI rect;
+    if ( !request.rect.intersect(request.image->getBounds(), &rect) || (request.vmax <= request.vmin) ) {
+        return;
+    }
+
     Image::ReadAccess acc = request.image->getReadRights();
-    
-    for (int y = request.rect.bottom(); y < request.rect.top(); ++y) {
-        for (int x = request.rect.left(); x < request.rect.right(); ++x) {
-            const float *pix = (const float*)acc.pixelAt(x, y);
-            float v = pix_func(pix);
-            if ( (request.vmin <= v) && (v < request.vmax) ) {
-                int index = (int)( (v - request.vmin) / binSize );
-                assert( 0 <= index && index < (int)histo->size() );
-                (*histo)[index] += 1.f;
+    HistogramPass pass;
+    pass.pixels = (const float*)acc.pixelAt(rect.x1, rect.y1);
+    if (!pass.pixels) {
+        return;
+    }
+    pass.rowElements = (int)request.image->getRowElements();
+    pass.nComps = (int)request.image->getComponentsCount();
+    pass.width = rect.width();
+    pass.height = rect.height();
+    pass.nBins = nBins;
+    pass.vmin = (float)request.vmin;
+    pass.vmax = (float)request.vmax;
+    pass.scale = (float)(nBins / (request.vmax - request.vmin));
+    pass.nChannels = nChannels;
+    for (int c = 0; c < nChannels; ++c) {
+        pass.channels[c] = channels[c];
+    }
+
+    // a few chunks per thread so that they balance out
+    pass.nChunks = (unsigned int)std::max( 1, std::min( pass.height, appPTR->getHardwareIdealThreadCount() * 4 ) );
+    std::vector<std::vector<U32> > partialCounts(pass.nChunks);
+    appPTR->getTaskScheduler()->parallelFor( pass.nChunks, boost::bind(&binRowsAt, &pass, &partialCounts, _1) );
+
+    for (unsigned int i = 0; i < pass.nChunks; ++i) {
+        const U32* counts = &partialCounts[i][0];
+        for (int c = 0; c < nChannels; ++c, ++counts) {
+            std::vector<float> & histo = histos[c];
+            for (int b = 0; b < nBins; ++b, ++counts) {
+                histo[b] += *counts;
             }
         }
     }
@@ -425,65 +435,15 @@ iir_1d_filter(SrcIterator src,
     }
 } // iir_1d_filter
 
+/**
+ * @brief Smooths the histogram computed with upscale times more bins and downsamples it to the bins of the request
+ **/
 static void
-computeHistogramStatic(const HistogramRequest & request,
-                       boost::shared_ptr<FinishedHistogram> ret,
-                       int histogramIndex)
+smoothHistogram(const HistogramRequest & request,
+                int upscale,
+                std::vector<float> & histo_upscaled,
+                std::vector<float>* histo)
 {
-    const int upscale = 5;
-    std::vector<float> *histo = 0;
-
-    switch (histogramIndex) {
-    case 1:
-        histo = &ret->histogram1;
-        break;
-    case 2:
-        histo = &ret->histogram2;
-        break;
-    case 3:
-        histo = &ret->histogram3;
-        break;
-    default:
-        break;
-    }
-    assert(histo);
-    if (!histo) {
-        return;
-    }
-
-    /// keep the mode parameter in sync with Histogram::DisplayModeEnum
-
-    int mode = request.mode;
-
-    ///if the mode is RGB, adjust the mode to either R,G or B depending on the histogram index
-    if (mode == 0) {
-        mode = histogramIndex + 2;
-    }
-
-    ret->pixelsCount = request.rect.area();
-    // a histogram with upscale more bins
-    std::vector<float> histo_upscaled;
-    switch (mode) {
-    case 1:     //< A
-        computeHisto<&pix_alpha::val>(request, upscale, &histo_upscaled);
-        break;
-    case 2:     //<Y
-        computeHisto<&pix_lum::val>(request, upscale, &histo_upscaled);
-        break;
-    case 3:     //< R
-        computeHisto<&pix_red::val>(request, upscale, &histo_upscaled);
-        break;
-    case 4:     //< G
-        computeHisto<&pix_green::val>(request, upscale, &histo_upscaled);
-        break;
-    case 5:     //< B
-        computeHisto<&pix_blue::val>(request, upscale, &histo_upscaled);
-        break;
-
-    default:
-        assert(false);
-        break;
-    }
     double sigma = upscale;
     if (request.smoothingKernelSize > 1) {
         sigma *= request.smoothingKernelSize;
@@ -508,7 +468,57 @@ computeHistogramStatic(const HistogramRequest & request,
             std::advance (it_in,upscale);
         }
     }
-} // computeHistogramStatic
+} // smoothHistogram
+
+static void
+computeHistogramsStatic(const HistogramRequest & request,
+                        boost::shared_ptr<FinishedHistogram> ret)
+{
+    const int upscale = 5;
+
+    /// keep the mode parameter in sync with Histogram::DisplayModeEnum
+    HistogramChannelEnum channels[3];
+    int nChannels = 1;
+
+    switch (request.mode) {
+    case 0:     //< RGB
+        channels[0] = eHistogramChannelR;
+        channels[1] = eHistogramChannelG;
+        channels[2] = eHistogramChannelB;
+        nChannels = 3;
+        break;
+    case 1:     //< A
+        channels[0] = eHistogramChannelA;
+        break;
+    case 2:     //<Y
+        channels[0] = eHistogramChannelY;
+        break;
+    case 3:     //< R
+        channels[0] = eHistogramChannelR;
+        break;
+    case 4:     //< G
+        channels[0] = eHistogramChannelG;
+        break;
+    case 5:     //< B
+        channels[0] = eHistogramChannelB;
+        break;
+    default:
+        assert(false);     //< unknown case.
+
+        return;
+    }
+
+    ret->pixelsCount = request.rect.area();
+
+    // histograms with upscale more bins
+    std::vector<float> histos_upscaled[3];
+    computeHistograms(request, request.binsCount * upscale, nChannels, channels, histos_upscaled);
+
+    std::vector<float>* histos[3] = { &ret->histogram1, &ret->histogram2, &ret->histogram3 };
+    for (int c = 0; c < nChannels; ++c) {
+        smoothHistogram(request, upscale, histos_upscaled[c], histos[c]);
+    }
+} // computeHistogramsStatic
 
 void
 HistogramCPU::run()
@@ -546,23 +556,7 @@ HistogramCPU::run()
         ret->mipMapLevel = request.image->getMipMapLevel();
 
 
-        switch (request.mode) {
-        case 0:     //< RGB
-            computeHistogramStatic(request, ret, 1);
-            computeHistogramStatic(request, ret, 2);
-            computeHistogramStatic(request, ret, 3);
-            break;
-        case 1:
-        case 2:
-        case 3:
-        case 4:
-        case 5:
-            computeHistogramStatic(request, ret, 1);
-            break;
-        default:
-            assert(false);     //< unknown case.
-            break;
-        }
+        computeHistogramsStatic(request, ret);
 
 
         {
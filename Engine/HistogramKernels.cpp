@@ -0,0 +1,145 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "HistogramKernels.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "Engine/SimdSupport.h"
+
+#ifdef NATRON_SIMD_X86
+#include <immintrin.h>
+#endif
+
+NATRON_NAMESPACE_ENTER;
+
+static inline float
+getChannelValue(const float* pix,
+                int nComps,
+                HistogramChannelEnum channel)
+{
+    switch (channel) {
+    case eHistogramChannelA:
+        if (nComps == 1) {
+            return pix[0];
+        }
+
+        return nComps == 4 ? pix[3] : 1.f;
+    case eHistogramChannelY: {
+        if (nComps < 3) {
+            return 0.f;
+        }
+
+        return 0.299f * pix[0] + 0.587f * pix[1] + 0.114f * pix[2];
+    }
+    default:
+
+        return ( (int)channel < nComps && nComps > 1 ) ? pix[channel] : 0.f;
+    }
+}
+
+static inline int
+getBinIndex(const HistogramPass & pass,
+            float v)
+{
+    // NaNs are out of the range too
+    if ( !( (pass.vmin <= v) && (v < pass.vmax) ) ) {
+        return pass.nBins;
+    }
+
+    return std::min( (int)( (v - pass.vmin) * pass.scale ), pass.nBins - 1 );
+}
+
+void
+HistogramKernels::binRowScalar(const HistogramPass & pass,
+                               const float* pix,
+                               U32* counts)
+{
+    for (int x = 0; x < pass.width; ++x, pix += pass.nComps) {
+        for (int c = 0; c < pass.nChannels; ++c) {
+            ++counts[c * (pass.nBins + 1) + getBinIndex( pass, getChannelValue(pix, pass.nComps, pass.channels[c]) )];
+        }
+    }
+}
+
+#ifdef NATRON_SIMD_X86
+/// Computes the bin indices of the 4 components of each RGBA pixel at once, or of its luminance in all lanes
+NATRON_SIMD_TARGET_SSE41
+static void
+binRowRGBASSE41(const HistogramPass & pass,
+                const float* pix,
+                U32* counts)
+{
+    assert(pass.nComps == 4);
+    const __m128 vmin = _mm_set1_ps(pass.vmin);
+    const __m128 vmax = _mm_set1_ps(pass.vmax);
+    const __m128 scale = _mm_set1_ps(pass.scale);
+    const __m128 lumWeights = _mm_setr_ps(0.299f, 0.587f, 0.114f, 0.f);
+    const __m128i maxIndex = _mm_set1_epi32(pass.nBins - 1);
+    const __m128i outIndex = _mm_set1_epi32(pass.nBins);
+    const bool luminance = pass.channels[0] == eHistogramChannelY;
+    int lanes[3];
+    U32* histos[3];
+
+    for (int c = 0; c < pass.nChannels; ++c) {
+        lanes[c] = luminance ? 0 : (int)pass.channels[c];
+        histos[c] = counts + c * (pass.nBins + 1);
+    }
+
+    for (int x = 0; x < pass.width; ++x, pix += 4) {
+        __m128 v = _mm_loadu_ps(pix);
+        if (luminance) {
+            v = _mm_dp_ps(v, lumWeights, 0x7F);
+        }
+        __m128 valid = _mm_and_ps( _mm_cmpge_ps(v, vmin), _mm_cmplt_ps(v, vmax) );
+        // zero the invalid positions so that the conversion does not overflow
+        __m128 pos = _mm_and_ps( _mm_mul_ps( _mm_sub_ps(v, vmin), scale ), valid );
+        __m128i index = _mm_min_epi32(_mm_cvttps_epi32(pos), maxIndex);
+        index = _mm_blendv_epi8( outIndex, index, _mm_castps_si128(valid) );
+        int indices[4];
+        _mm_storeu_si128( (__m128i*)indices, index );
+        for (int c = 0; c < pass.nChannels; ++c) {
+            ++histos[c][indices[lanes[c]]];
+        }
+    }
+}
+#endif
+
+void
+HistogramKernels::binRow(const HistogramPass & pass,
+                         const float* pix,
+                         U32* counts)
+{
+#ifdef NATRON_SIMD_X86
+    if ( (pass.nComps == 4) && (getSimdLevel() >= eSimdLevelSSE41) ) {
+        binRowRGBASSE41(pass, pix, counts);
+
+        return;
+    }
+#endif
+    binRowScalar(pass, pix, counts);
+}
+
+NATRON_NAMESPACE_EXIT;
@@ -0,0 +1,85 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_HISTOGRAMKERNELS_H
+#define NATRON_ENGINE_HISTOGRAMKERNELS_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include "Global/GlobalDefines.h"
+
+NATRON_NAMESPACE_ENTER;
+
+/// The channels of which HistogramCPU computes histograms, in the order of the components of RGBA images
+enum HistogramChannelEnum
+{
+    eHistogramChannelR = 0,
+    eHistogramChannelG,
+    eHistogramChannelB,
+    eHistogramChannelA,
+    eHistogramChannelY
+};
+
+/**
+ * @brief One pass over the pixels of a request computing the histograms of up to 3 channels at once.
+ * Each histogram has nBins + 1 bins: the last one counts the values out of [vmin, vmax) and is discarded.
+ **/
+struct HistogramPass
+{
+    const float* pixels; //< the first pixel of the first row
+    int rowElements;
+    int nComps;
+    int width;
+    int height;
+    int nBins;
+    float vmin;
+    float vmax;
+    float scale; //< nBins / (vmax - vmin)
+    int nChannels;
+    HistogramChannelEnum channels[3];
+    unsigned int nChunks;
+};
+
+/**
+ * @brief The kernels counting the pixels of a row in the bins of a HistogramPass, used by HistogramCPU.
+ * A value is binned as in the viewer: a missing R, G or B is 0, a missing alpha is 1 and a single component is alpha.
+ * NaNs and the values out of [vmin, vmax) go to the last bin.
+ **/
+namespace HistogramKernels {
+
+/**
+ * @brief Adds the width pixels starting at pix to counts, which holds the nChannels histograms of the pass one after the other.
+ * RGBA rows are done by SSE4.1 when available (@see getSimdLevel()).
+ **/
+void binRow(const HistogramPass & pass, const float* pix, U32* counts);
+
+/**
+ * @brief Same as binRow() without the vectorized kernels, for any number of components.
+ **/
+void binRowScalar(const HistogramPass & pass, const float* pix, U32* counts);
+} // namespace HistogramKernels
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_HISTOGRAMKERNELS_H
@@ -31,177 +31,186 @@
 #include <QDebug>
 
 #include "Engine/AppManager.h"
+#include "Engine/ImageMinMax.h"
+#include "Engine/MipMapKernels.h"
 #include "Engine/ViewIdx.h"
 
 NATRON_NAMESPACE_ENTER;
 
-#define BM_GET(i,j) &_map[( i - _bounds.bottom() ) * _bounds.width() + ( j - _bounds.left() )]
-
 #define PIXEL_UNAVAILABLE 2
 
-template <int trimap>
-RectI minimalNonMarkedBbox_internal(const RectI& roi, const RectI& _bounds,const std::vector<char>& _map,
-                                    bool* isBeingRenderedElsewhere)
+/**
+ * @brief Returns the index of the tile containing the coordinate v, rounding towards -infinity.
+ **/
+static inline int
+bitmapTileIndex(int v)
 {
-    RectI bbox;
-    assert(_bounds.contains(roi));
-    bbox = roi;
-    
-    //find bottom
-    for (int i = bbox.bottom(); i < bbox.top(); ++i) {
-        const char* buf = BM_GET(i, bbox.left());
+    return v >= 0 ? v / NATRON_BITMAP_TILE_SIZE : -( (-v + NATRON_BITMAP_TILE_SIZE - 1) / NATRON_BITMAP_TILE_SIZE );
+}
+
+static inline int
+bitmapTileStart(int v)
+{
+    return bitmapTileIndex(v) * NATRON_BITMAP_TILE_SIZE;
+}
+
+enum BitmapEdgeEnum
+{
+    eBitmapEdgeBottom = 0,
+    eBitmapEdgeTop,
+    eBitmapEdgeLeft,
+    eBitmapEdgeRight
+};
+
+static inline void
+setBitmapEdge(BitmapEdgeEnum edge,
+              int value,
+              RectI* rect)
+{
+    switch (edge) {
+        case eBitmapEdgeBottom:
+            rect->y1 = value;
+            break;
+        case eBitmapEdgeTop:
+            rect->y2 = value;
+            break;
+        case eBitmapEdgeLeft:
+            rect->x1 = value;
+            break;
+        case eBitmapEdgeRight:
+            rect->x2 = value;
+            break;
+    }
+}
+
+/*
+ * Moves the given edge of rect inwards as long as the rows (bottom/top) or columns (left/right) it crosses do not contain
+ * any of the states in stopMask. A whole band of lines lying in the same row or column of tiles is crossed at once
+ * when it does not contain any of the states in stopMask, otherwise the band is scanned line by line.
+ * Returns the states that were met in the crossed lines and sets stopLineStates to the states of the line that
+ * stopped the edge, or 0 if rect became empty.
+ */
+static unsigned int
+shrinkBitmapEdge(const Bitmap& bm,
+                 BitmapEdgeEnum edge,
+                 unsigned int stopMask,
+                 RectI* rect,
+                 unsigned int* stopLineStates)
+{
+    const bool vertical = edge == eBitmapEdgeBottom || edge == eBitmapEdgeTop;
+    const bool forward = edge == eBitmapEdgeBottom || edge == eBitmapEdgeLeft;
+    unsigned int crossed = 0;
+    *stopLineStates = 0;
+    
+    for (;;) {
+        int lo = vertical ? rect->y1 : rect->x1;
+        int hi = vertical ? rect->y2 : rect->x2;
+        if (lo >= hi) {
+            break;
+        }
         
-        if (trimap) {
-            
-            const char* lineEnd = buf + bbox.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (!*buf) {
-                    buf = 0;
-                    break;
-                } else if (*buf == PIXEL_UNAVAILABLE) {
-                    metUnavailablePixel = true;
-                }
-                ++buf;
-            }
-            if (!buf) {
-                break;
-            } else if (metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag if the whole row is not 0
-                ++bbox.y1;
-            } else {
-                ++bbox.y1;
-            }
+        int bandLo,bandHi;
+        if (forward) {
+            bandLo = lo;
+            bandHi = std::min(hi, bitmapTileStart(lo) + NATRON_BITMAP_TILE_SIZE);
         } else {
-            
-            const char* lineEnd = buf + bbox.width();
-            while (buf < lineEnd) {
-                if (!*buf || *buf == PIXEL_UNAVAILABLE) {
-                    buf = 0;
-                    break;
-                }
-                ++buf;
-            }
-            if (!buf) {
-                break;
-            } else {
-                ++bbox.y1;
-            }
+            bandLo = std::max(lo, bitmapTileStart(hi - 1));
+            bandHi = hi;
         }
-    }
-    
-    //find top (will do zero iteration if the bbox is already empty)
-    for (int i = bbox.top() - 1; i >= bbox.bottom(); --i) {
-        const char* buf = BM_GET(i, bbox.left());
         
-        if (trimap) {
-            
-            const char* lineEnd = buf + bbox.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (!*buf) {
-                    buf = 0;
-                    break;
-                } else if (*buf == PIXEL_UNAVAILABLE) {
-                    metUnavailablePixel = true;
-                }
-                ++buf;
-            }
-            if (!buf) {
-                break;
-            } else if (metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag if the whole row is not 0
-                --bbox.y2;
-            } else {
-                --bbox.y2;
-            }
-            
-        } else {
-            
-            const char* lineEnd = buf + bbox.width();
-            while (buf < lineEnd) {
-                if (!*buf || *buf == PIXEL_UNAVAILABLE) {
-                    buf = 0;
-                    break;
-                }
-                ++buf;
-            }
-            if (!buf) {
-                break;
-            } else {
-                --bbox.y2;
+        RectI band = vertical ? RectI(rect->x1, bandLo, rect->x2, bandHi) : RectI(bandLo, rect->y1, bandHi, rect->y2);
+        unsigned int states = bm.getStatesInRect(band);
+        if ( !(states & stopMask) ) {
+            crossed |= states;
+            setBitmapEdge(edge, forward ? bandHi : bandLo, rect);
+            continue;
+        }
+        for (int i = 0; i < bandHi - bandLo; ++i) {
+            int line = forward ? bandLo + i : bandHi - 1 - i;
+            RectI lineRect = vertical ? RectI(rect->x1, line, rect->x2, line + 1) : RectI(line, rect->y1, line + 1, rect->y2);
+            states = bm.getStatesInRect(lineRect);
+            if (states & stopMask) {
+                *stopLineStates = states;
+                return crossed;
             }
+            crossed |= states;
+            setBitmapEdge(edge, forward ? line + 1 : line, rect);
         }
     }
-    
-    // avoid making bbox.width() iterations for nothing
-    if ( bbox.isNull() ) {
-        return bbox;
-    }
-    
-    //find left
-    for (int j = bbox.left(); j < bbox.right(); ++j) {
-        const char* pix = BM_GET(bbox.bottom(), j);
-
-        bool metUnavailablePixel = false;
+    return crossed;
+}
 
-        for (int i = bbox.bottom(); i < bbox.top(); ++i, pix += _bounds.width()) {
-            if (!*pix) {
-                pix = 0;
-                break;
-            }
-            
-            else if (*pix == PIXEL_UNAVAILABLE) {
-                if (trimap) {
-                    metUnavailablePixel = true;
-                } else {
-                    pix = 0;
-                    break;
-                }
-            }
-            
-        }
-        if (pix) {
-            ++bbox.x1;
-            if (trimap && metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag is the whole column is not 0
-            }
-        } else {
+/*
+ * Returns true if the first pixel of the line at the given edge of rect that is either rendered or being rendered is
+ * being rendered. Rows are scanned from left to right and columns from bottom to top.
+ */
+static bool
+isFirstMarkedPixelUnavailable(const Bitmap& bm,
+                              BitmapEdgeEnum edge,
+                              const RectI& rect)
+{
+    const bool vertical = edge == eBitmapEdgeBottom || edge == eBitmapEdgeTop;
+    int line;
+    switch (edge) {
+        case eBitmapEdgeBottom:
+            line = rect.y1;
+            break;
+        case eBitmapEdgeTop:
+            line = rect.y2 - 1;
+            break;
+        case eBitmapEdgeLeft:
+            line = rect.x1;
+            break;
+        case eBitmapEdgeRight:
+        default:
+            line = rect.x2 - 1;
             break;
-        }
     }
-    
-    //find right
-    for (int j = bbox.right() - 1; j >= bbox.left(); --j) {
-        const char* pix = BM_GET(bbox.bottom(), j);
-
-        bool metUnavailablePixel = false;
-
-        for (int i = bbox.bottom(); i < bbox.top(); ++i, pix += _bounds.width()) {
-            if (!*pix) {
-                pix = 0;
-                break;
-            }
-
-            else if (*pix == PIXEL_UNAVAILABLE) {
-                if (trimap) {
-                    metUnavailablePixel = true;
-                } else {
-                    pix = 0;
-                    break;
-                }
-            }
-
+    int start = vertical ? rect.x1 : rect.y1;
+    int end = vertical ? rect.x2 : rect.y2;
+    for (int i = start; i < end; ++i) {
+        char state = vertical ? bm.getPixelState(i, line) : bm.getPixelState(line, i);
+        if (state == 1) {
+            return false;
+        } else if (state == PIXEL_UNAVAILABLE) {
+            return true;
         }
-        if (pix) {
-            --bbox.x2;
-            if (trimap && metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag is the whole column is not 0
-            }
+    }
+    return false;
+}
 
-        } else {
-            break;
-        }
+template <int trimap>
+RectI minimalNonMarkedBbox_internal(const RectI& roi, const Bitmap& bm,
+                                    bool* isBeingRenderedElsewhere)
+{
+    RectI bbox;
+    assert(bm.getBounds().contains(roi));
+    bbox = roi;
+    
+    // A line may be removed from the bbox if it has no pixel to render. With the trimap, pixels being rendered
+    // elsewhere are not to be rendered by the caller, but it must be told to wait for them.
+    const unsigned int stopMask = trimap ? (unsigned int)Bitmap::eBitmapStateNotRendered :
+                                           (unsigned int)(Bitmap::eBitmapStateNotRendered | Bitmap::eBitmapStateUnavailable);
+    unsigned int stopLineStates;
+    unsigned int crossed = 0;
+    
+    //find bottom
+    crossed |= shrinkBitmapEdge(bm, eBitmapEdgeBottom, stopMask, &bbox, &stopLineStates);
+    
+    //find top (will do zero iteration if the bbox is already empty)
+    crossed |= shrinkBitmapEdge(bm, eBitmapEdgeTop, stopMask, &bbox, &stopLineStates);
+    
+    // avoid making bbox.width() iterations for nothing
+    if ( !bbox.isNull() ) {
+        //find left
+        crossed |= shrinkBitmapEdge(bm, eBitmapEdgeLeft, stopMask, &bbox, &stopLineStates);
+        
+        //find right
+        crossed |= shrinkBitmapEdge(bm, eBitmapEdgeRight, stopMask, &bbox, &stopLineStates);
+    }
+    
+    if (trimap && (crossed & Bitmap::eBitmapStateUnavailable)) {
+        *isBeingRenderedElsewhere = true; //< only flag if a whole row or column is not 0
     }
     
     return bbox;
@@ -211,9 +220,11 @@ RectI minimalNonMarkedBbox_internal(const RectI& roi, const RectI& _bounds,const
 
 template <int trimap>
 void
-minimalNonMarkedRects_internal(const RectI & roi,const RectI& _bounds, const std::vector<char>& _map,
+minimalNonMarkedRects_internal(const RectI & roi,const Bitmap& bm,
                                std::list<RectI>& ret,bool* isBeingRenderedElsewhere)
 {
+    const RectI& _bounds = bm.getBounds();
+    
     ///Any out of bounds portion is pushed to the rectangles to render
     RectI intersection;
     roi.intersect(_bounds, &intersection);
@@ -247,7 +258,7 @@ minimalNonMarkedRects_internal(const RectI & roi,const RectI& _bounds, const std
         return;
     }
     
-    RectI bboxM = minimalNonMarkedBbox_internal<trimap>(intersection, _bounds, _map, isBeingRenderedElsewhere);
+    RectI bboxM = minimalNonMarkedBbox_internal<trimap>(intersection, bm, isBeingRenderedElsewhere);
     assert((trimap && isBeingRenderedElsewhere) || (!trimap && !isBeingRenderedElsewhere));
     
     //#define NATRON_BITMAP_DISABLE_OPTIMIZATION
@@ -281,44 +292,20 @@ minimalNonMarkedRects_internal(const RectI & roi,const RectI& _bounds, const std
     // CXXXXXXXXXXDDD
     // AAAAAAAAAAAAAA
     
+    // A line belongs to A, B, C or D if it has no rendered pixel. With the trimap, a line with pixels being
+    // rendered elsewhere stops the search too, and the caller is told to wait for them.
+    const unsigned int stopMask = trimap ? (unsigned int)(Bitmap::eBitmapStateRendered | Bitmap::eBitmapStateUnavailable) :
+                                           (unsigned int)Bitmap::eBitmapStateRendered;
+    unsigned int stopLineStates;
+    
     // First, find if there's an "A" rectangle, and push it to the result
     //find bottom
     RectI bboxX = bboxM;
     RectI bboxA = bboxX;
+    shrinkBitmapEdge(bm, eBitmapEdgeBottom, stopMask, &bboxX, &stopLineStates);
     bboxA.set_top( bboxX.bottom() );
-    for (int i = bboxX.bottom(); i < bboxX.top(); ++i) {
-        const char* buf = BM_GET(i, bboxX.left());
-        if (trimap) {
-            const char* lineEnd = buf + bboxX.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (*buf == 1) {
-                    buf = 0;
-                    break;
-                } else if (*buf == PIXEL_UNAVAILABLE && trimap) {
-                    buf = 0;
-                    metUnavailablePixel = true;
-                    break;
-                }
-                ++buf;
-            }
-            if (buf) {
-                ++bboxX.y1;
-                bboxA.y2 = bboxX.y1;
-            } else {
-                if (metUnavailablePixel) {
-                    *isBeingRenderedElsewhere = true;
-                }
-                break;
-            }
-        } else {
-            if ( !memchr( buf, 1, bboxX.width() ) ) {
-                ++bboxX.y1;
-                bboxA.y2 = bboxX.y1;
-            } else {
-                break;
-            }
-        }
+    if (trimap && (stopLineStates & Bitmap::eBitmapStateUnavailable) && isFirstMarkedPixelUnavailable(bm, eBitmapEdgeBottom, bboxX)) {
+        *isBeingRenderedElsewhere = true;
     }
     if ( !bboxA.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxA);
@@ -327,112 +314,38 @@ minimalNonMarkedRects_internal(const RectI & roi,const RectI& _bounds, const std
     // Now, find the "B" rectangle
     //find top
     RectI bboxB = bboxX;
+    shrinkBitmapEdge(bm, eBitmapEdgeTop, stopMask, &bboxX, &stopLineStates);
     bboxB.set_bottom( bboxX.top() );
-    for (int i = bboxX.top() - 1; i >= bboxX.bottom(); --i) {
-        const char* buf = BM_GET(i, bboxX.left());
-        
-        if (trimap) {
-            const char* lineEnd = buf + bboxX.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (*buf == 1) {
-                    buf = 0;
-                    break;
-                } else if (*buf == PIXEL_UNAVAILABLE && trimap) {
-                    buf = 0;
-                    metUnavailablePixel = true;
-                    break;
-                }
-                ++buf;
-            }
-            if (buf) {
-                --bboxX.y2;
-                bboxB.y1 = bboxX.y2;
-            } else {
-                if (metUnavailablePixel) {
-                    *isBeingRenderedElsewhere = true;
-                }
-                break;
-            }
-        } else {
-            if ( !memchr( buf, 1, bboxX.width() ) ) {
-                --bboxX.y2;
-                bboxB.y1 = bboxX.y2;
-            } else {
-                break;
-            }
-            
-        }
+    if (trimap && (stopLineStates & Bitmap::eBitmapStateUnavailable) && isFirstMarkedPixelUnavailable(bm, eBitmapEdgeTop, bboxX)) {
+        *isBeingRenderedElsewhere = true;
     }
     if ( !bboxB.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxB);
     }
     
-	//find left
-	RectI bboxC = bboxX;
-	bboxC.set_right( bboxX.left() );
-	if (bboxX.bottom() < bboxX.top()) {
-		for (int j = bboxX.left(); j < bboxX.right(); ++j) {
-			const char* pix = BM_GET(bboxX.bottom(), j);
-
-			bool metUnavailablePixel = false;
-
-			for (int i = bboxX.bottom(); i < bboxX.top(); ++i, pix += _bounds.width()) {
-				if (*pix == 1) {
-					pix = 0;
-					break;
-				} else if (trimap && *pix == PIXEL_UNAVAILABLE) {
-					pix = 0;
-					metUnavailablePixel = true;
-					break;
-				}
-			}
-			if (pix) {
-                ++bboxX.x1;
-                bboxC.x2 = bboxX.x1;
-			} else {
-				if (metUnavailablePixel) {
-					*isBeingRenderedElsewhere = true;
-				}
-				break;
-			}
-		}
-	}
+    //find left
+    RectI bboxC = bboxX;
+    if (bboxX.bottom() < bboxX.top()) {
+        shrinkBitmapEdge(bm, eBitmapEdgeLeft, stopMask, &bboxX, &stopLineStates);
+        if (trimap && (stopLineStates & Bitmap::eBitmapStateUnavailable) && isFirstMarkedPixelUnavailable(bm, eBitmapEdgeLeft, bboxX)) {
+            *isBeingRenderedElsewhere = true;
+        }
+    }
+    bboxC.set_right( bboxX.left() );
     if ( !bboxC.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxC);
     }
 
-	//find right
-	RectI bboxD = bboxX;
-	bboxD.set_left( bboxX.right() );
-	if (bboxX.bottom() < bboxX.top()) {
-		for (int j = bboxX.right() - 1; j >= bboxX.left(); --j) {
-			const char* pix = BM_GET(bboxX.bottom(), j);
-
-			bool metUnavailablePixel = false;
-
-			for (int i = bboxX.bottom(); i < bboxX.top(); ++i, pix += _bounds.width()) {
-				if (*pix == 1) {
-					pix = 0;
-					break;
-				} else if (trimap && *pix == PIXEL_UNAVAILABLE) {
-					pix = 0;
-					metUnavailablePixel = true;
-					break;
-				}
-			}
-			if (pix) {
-                --bboxX.x2;
-                bboxD.x1 = bboxX.x2;
-			} else {
-				if (metUnavailablePixel) {
-					*isBeingRenderedElsewhere = true;
-				}
-				break;
-			}
-		}
-	}
-	if ( !bboxD.isNull() ) { // empty boxes should not be pushed
+    //find right
+    RectI bboxD = bboxX;
+    if (bboxX.bottom() < bboxX.top()) {
+        shrinkBitmapEdge(bm, eBitmapEdgeRight, stopMask, &bboxX, &stopLineStates);
+        if (trimap && (stopLineStates & Bitmap::eBitmapStateUnavailable) && isFirstMarkedPixelUnavailable(bm, eBitmapEdgeRight, bboxX)) {
+            *isBeingRenderedElsewhere = true;
+        }
+    }
+    bboxD.set_left( bboxX.right() );
+    if ( !bboxD.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxD);
     }
     
@@ -457,7 +370,7 @@ minimalNonMarkedRects_internal(const RectI & roi,const RectI& _bounds, const std
     assert( bboxD.bottom() == bboxX.bottom() );
     
     // get the bounding box of what's left (the X rectangle in the drawing above)
-    bboxX = minimalNonMarkedBbox_internal<trimap>(bboxX,_bounds,_map,isBeingRenderedElsewhere);
+    bboxX = minimalNonMarkedBbox_internal<trimap>(bboxX,bm,isBeingRenderedElsewhere);
     
     if ( !bboxX.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxX);
@@ -475,9 +388,9 @@ Bitmap::minimalNonMarkedBbox(const RectI & roi) const
         if (!roi.intersect(_dirtyZone, &realRoi)) {
             return RectI();
         }
-        return minimalNonMarkedBbox_internal<0>(realRoi, _bounds, _map, NULL);
+        return minimalNonMarkedBbox_internal<0>(realRoi, *this, NULL);
     } else {
-        return minimalNonMarkedBbox_internal<0>(roi, _bounds, _map, NULL);
+        return minimalNonMarkedBbox_internal<0>(roi, *this, NULL);
     }
 }
 
@@ -489,9 +402,9 @@ Bitmap::minimalNonMarkedRects(const RectI & roi,std::list<RectI>& ret) const
         if (!roi.intersect(_dirtyZone, &realRoi)) {
             return;
         }
-        minimalNonMarkedRects_internal<0>(realRoi, _bounds, _map,ret , NULL);
+        minimalNonMarkedRects_internal<0>(realRoi, *this, ret , NULL);
     } else {
-        minimalNonMarkedRects_internal<0>(roi, _bounds, _map,ret , NULL);
+        minimalNonMarkedRects_internal<0>(roi, *this, ret , NULL);
     }
 }
 
@@ -505,9 +418,9 @@ Bitmap::minimalNonMarkedBbox_trimap(const RectI & roi,bool* isBeingRenderedElsew
             *isBeingRenderedElsewhere = false;
             return RectI();
         }
-        return minimalNonMarkedBbox_internal<1>(realRoi, _bounds, _map, isBeingRenderedElsewhere);
+        return minimalNonMarkedBbox_internal<1>(realRoi, *this, isBeingRenderedElsewhere);
     } else {
-        return minimalNonMarkedBbox_internal<1>(roi, _bounds, _map, isBeingRenderedElsewhere);
+        return minimalNonMarkedBbox_internal<1>(roi, *this, isBeingRenderedElsewhere);
     }
 }
 
@@ -521,76 +434,298 @@ Bitmap::minimalNonMarkedRects_trimap(const RectI & roi,std::list<RectI>& ret,boo
             *isBeingRenderedElsewhere = false;
             return;
         }
-        minimalNonMarkedRects_internal<1>(realRoi, _bounds, _map ,ret , isBeingRenderedElsewhere);
+        minimalNonMarkedRects_internal<1>(realRoi, *this ,ret , isBeingRenderedElsewhere);
     } else {
-        minimalNonMarkedRects_internal<1>(roi, _bounds, _map ,ret , isBeingRenderedElsewhere);
+        minimalNonMarkedRects_internal<1>(roi, *this ,ret , isBeingRenderedElsewhere);
     }
 } 
 #endif
 
 void
-Bitmap::markForRendered(const RectI & roi)
+Bitmap::initialize(const RectI & bounds)
+{
+    _bounds = bounds;
+    if ( _bounds.isNull() ) {
+        _tileX1 = _tileY1 = 0;
+        _nTilesX = _nTilesY = 0;
+        _tiles.clear();
+        return;
+    }
+    _tileX1 = bitmapTileIndex(_bounds.x1);
+    _tileY1 = bitmapTileIndex(_bounds.y1);
+    _nTilesX = bitmapTileIndex(_bounds.x2 - 1) - _tileX1 + 1;
+    _nTilesY = bitmapTileIndex(_bounds.y2 - 1) - _tileY1 + 1;
+    
+    std::vector<Tile> tiles(_nTilesX * _nTilesY);
+    _tiles.swap(tiles);
+}
+
+RectI
+Bitmap::getTileRect(int tx,int ty) const
+{
+    RectI tileRect(tx * NATRON_BITMAP_TILE_SIZE, ty * NATRON_BITMAP_TILE_SIZE,
+                   (tx + 1) * NATRON_BITMAP_TILE_SIZE, (ty + 1) * NATRON_BITMAP_TILE_SIZE);
+    tileRect.intersect(_bounds, &tileRect);
+    return tileRect;
+}
+
+char*
+Bitmap::getTilePixels(Tile& tile)
+{
+    if (tile.state != eTileStateMixed) {
+        tile.pixels.assign(NATRON_BITMAP_TILE_SIZE * NATRON_BITMAP_TILE_SIZE, tile.state);
+        tile.state = eTileStateMixed;
+    }
+    return &tile.pixels.front();
+}
+
+void
+Bitmap::updateTileState(Tile& tile,const RectI& tileRect,int tx,int ty)
+{
+    assert(tile.state == eTileStateMixed);
+    int nRendered = 0;
+    int nUnavailable = 0;
+    const char* row = &tile.pixels[(tileRect.y1 - ty * NATRON_BITMAP_TILE_SIZE) * NATRON_BITMAP_TILE_SIZE + (tileRect.x1 - tx * NATRON_BITMAP_TILE_SIZE)];
+    int w = tileRect.width();
+    for (int y = tileRect.y1; y < tileRect.y2; ++y, row += NATRON_BITMAP_TILE_SIZE) {
+        for (int x = 0; x < w; ++x) {
+            if (row[x] == 1) {
+                ++nRendered;
+            } else if (row[x] == PIXEL_UNAVAILABLE) {
+                ++nUnavailable;
+            }
+        }
+    }
+    int area = (int)tileRect.area();
+    char uniformState = eTileStateMixed;
+    if (nRendered == area) {
+        uniformState = eTileStateRendered;
+    } else if (nUnavailable == area) {
+        uniformState = eTileStateUnavailable;
+    } else if (nRendered == 0 && nUnavailable == 0) {
+        uniformState = eTileStateNotRendered;
+    }
+    if (uniformState != eTileStateMixed) {
+        tile.state = uniformState;
+        tile.nRendered = tile.nUnavailable = 0;
+        std::vector<char>().swap(tile.pixels);
+    } else {
+        tile.nRendered = (unsigned short)nRendered;
+        tile.nUnavailable = (unsigned short)nUnavailable;
+    }
+}
+
+void
+Bitmap::fillTile(Tile& tile,const RectI& tileRect,int tx,int ty,const RectI& roi,char value)
 {
-    char* buf = BM_GET(roi.bottom(), roi.left());
-    int w = _bounds.width();
-    int roiw = roi.width();
-    for (int i = roi.y1; i < roi.y2; ++i, buf += w) {
-        memset( buf, 1, roiw);
+    if (tile.state == value) {
+        return;
+    }
+    if (roi == tileRect) {
+        tile.state = value;
+        tile.nRendered = tile.nUnavailable = 0;
+        std::vector<char>().swap(tile.pixels);
+        return;
+    }
+    char* row = getTilePixels(tile) + (roi.y1 - ty * NATRON_BITMAP_TILE_SIZE) * NATRON_BITMAP_TILE_SIZE + (roi.x1 - tx * NATRON_BITMAP_TILE_SIZE);
+    int w = roi.width();
+    for (int y = roi.y1; y < roi.y2; ++y, row += NATRON_BITMAP_TILE_SIZE) {
+        memset(row, value, w);
+    }
+    updateTileState(tile, tileRect, tx, ty);
+}
+
+void
+Bitmap::fill(const RectI& roi,char value)
+{
+    RectI area;
+    if ( !roi.intersect(_bounds, &area) ) {
+        return;
+    }
+    int tx1 = bitmapTileIndex(area.x1);
+    int tx2 = bitmapTileIndex(area.x2 - 1) + 1;
+    int ty1 = bitmapTileIndex(area.y1);
+    int ty2 = bitmapTileIndex(area.y2 - 1) + 1;
+    for (int ty = ty1; ty < ty2; ++ty) {
+        for (int tx = tx1; tx < tx2; ++tx) {
+            RectI tileRect = getTileRect(tx, ty);
+            RectI tileRoI;
+            area.intersect(tileRect, &tileRoI);
+            fillTile(getTile(tx, ty), tileRect, tx, ty, tileRoI, value);
+        }
     }
 }
 
+void
+Bitmap::markForRendered(const RectI & roi)
+{
+    fill(roi, 1);
+}
+
 #if NATRON_ENABLE_TRIMAP
 void
 Bitmap::markForRendering(const RectI & roi)
 {
-    char* buf = BM_GET(roi.bottom(), roi.left());
-    int w = _bounds.width();
-    int roiw = roi.width();
-    for (int i = roi.y1; i < roi.y2; ++i, buf += w) {
-        memset( buf, PIXEL_UNAVAILABLE , roiw );
-    }
+    fill(roi, PIXEL_UNAVAILABLE);
 }
 #endif
 
 void
 Bitmap::clear(const RectI& roi)
 {
-    char* buf = BM_GET(roi.bottom(), roi.left());
-    int w = _bounds.width();
-    int roiw = roi.width();
-    for (int i = roi.y1; i < roi.y2; ++i, buf += w) {
-        memset( buf, 0 , roiw );
-    }
+    fill(roi, 0);
 }
 
 void
 Bitmap::swap(Bitmap& other)
 {
-    _map.swap(other._map);
-    _bounds = other._bounds;
+    _tiles.swap(other._tiles);
+    std::swap(_bounds, other._bounds);
+    std::swap(_tileX1, other._tileX1);
+    std::swap(_tileY1, other._tileY1);
+    std::swap(_nTilesX, other._nTilesX);
+    std::swap(_nTilesY, other._nTilesY);
     _dirtyZone.clear();//merge(other._dirtyZone);
     _dirtyZoneSet = false;
 }
 
-const char*
-Bitmap::getBitmapAt(int x,
-                            int y) const
+char
+Bitmap::getPixelState(int x,
+                      int y) const
 {
-    if ( ( x >= _bounds.left() ) && ( x < _bounds.right() ) && ( y >= _bounds.bottom() ) && ( y < _bounds.top() ) ) {
-        return BM_GET(y,x);
-    } else {
-        return NULL;
+    assert( ( x >= _bounds.left() ) && ( x < _bounds.right() ) && ( y >= _bounds.bottom() ) && ( y < _bounds.top() ) );
+    int tx = bitmapTileIndex(x);
+    int ty = bitmapTileIndex(y);
+    const Tile& tile = getTile(tx, ty);
+    if (tile.state != eTileStateMixed) {
+        return tile.state;
     }
+    return tile.pixels[(y - ty * NATRON_BITMAP_TILE_SIZE) * NATRON_BITMAP_TILE_SIZE + (x - tx * NATRON_BITMAP_TILE_SIZE)];
 }
 
-char*
-Bitmap::getBitmapAt(int x,
-                            int y)
+unsigned int
+Bitmap::getStatesInRect(const RectI& roi) const
+{
+    RectI area;
+    if ( !roi.intersect(_bounds, &area) ) {
+        return 0;
+    }
+    unsigned int states = 0;
+    int tx1 = bitmapTileIndex(area.x1);
+    int tx2 = bitmapTileIndex(area.x2 - 1) + 1;
+    int ty1 = bitmapTileIndex(area.y1);
+    int ty2 = bitmapTileIndex(area.y2 - 1) + 1;
+    for (int ty = ty1; ty < ty2; ++ty) {
+        for (int tx = tx1; tx < tx2; ++tx) {
+            const Tile& tile = getTile(tx, ty);
+            if (tile.state != eTileStateMixed) {
+                states |= (1 << tile.state);
+            } else {
+                RectI tileRect = getTileRect(tx, ty);
+                RectI tileRoI;
+                area.intersect(tileRect, &tileRoI);
+                if (tileRoI == tileRect) {
+                    // the counters are enough
+                    if (tile.nRendered) {
+                        states |= eBitmapStateRendered;
+                    }
+                    if (tile.nUnavailable) {
+                        states |= eBitmapStateUnavailable;
+                    }
+                    if ( (int)tile.nRendered + (int)tile.nUnavailable < (int)tileRect.area() ) {
+                        states |= eBitmapStateNotRendered;
+                    }
+                } else {
+                    const char* row = &tile.pixels[(tileRoI.y1 - ty * NATRON_BITMAP_TILE_SIZE) * NATRON_BITMAP_TILE_SIZE + (tileRoI.x1 - tx * NATRON_BITMAP_TILE_SIZE)];
+                    int w = tileRoI.width();
+                    for (int y = tileRoI.y1; y < tileRoI.y2 && states != eBitmapStateAll; ++y, row += NATRON_BITMAP_TILE_SIZE) {
+                        for (int x = 0; x < w; ++x) {
+                            states |= (1 << row[x]);
+                        }
+                    }
+                }
+            }
+            if (states == eBitmapStateAll) {
+                return states;
+            }
+        }
+    }
+    return states;
+}
+
+void
+Bitmap::halveRoI(const RectI& dstRoI,
+                 Bitmap* output) const
 {
-    if ( ( x >= _bounds.left() ) && ( x < _bounds.right() ) && ( y >= _bounds.bottom() ) && ( y < _bounds.top() ) ) {
-        return BM_GET(y,x);
-    } else {
-        return NULL;
+    downscaleRoI(dstRoI, 1, _bounds, output);
+}
+
+void
+Bitmap::downscaleRoI(const RectI& dstRoI,
+                     unsigned int levels,
+                     const RectI& srcRoI,
+                     Bitmap* output) const
+{
+    RectI area;
+    if ( !dstRoI.intersect(output->_bounds, &area) ) {
+        return;
+    }
+    RectI srcArea;
+    if ( !srcRoI.intersect(_bounds, &srcArea) ) {
+        return;
+    }
+    const int scale = 1 << levels;
+    int tx1 = bitmapTileIndex(area.x1);
+    int tx2 = bitmapTileIndex(area.x2 - 1) + 1;
+    int ty1 = bitmapTileIndex(area.y1);
+    int ty2 = bitmapTileIndex(area.y2 - 1) + 1;
+    for (int ty = ty1; ty < ty2; ++ty) {
+        for (int tx = tx1; tx < tx2; ++tx) {
+            RectI tileRect = output->getTileRect(tx, ty);
+            RectI tileRoI;
+            area.intersect(tileRect, &tileRoI);
+            Tile& tile = output->getTile(tx, ty);
+            
+            RectI srcRect(tileRoI.x1 * scale, tileRoI.y1 * scale, tileRoI.x2 * scale, tileRoI.y2 * scale);
+            unsigned int states = srcRect.intersect(srcArea, &srcRect) ? getStatesInRect(srcRect) : 0;
+            if (states == eBitmapStateRendered) {
+                output->fillTile(tile, tileRect, tx, ty, tileRoI, 1);
+                continue;
+            } else if ( !(states & eBitmapStateRendered) ) {
+                output->fillTile(tile, tileRect, tx, ty, tileRoI, 0);
+                continue;
+            }
+            
+            /*
+             A destination pixel is rendered if all the source pixels it covers are rendered.
+             With the trimap, the only correct solution is to convert pixels being rendered to 0 otherwise the caller
+             would have to wait for the original fullscale image render to be finished and then re-downscale again.
+             */
+            char* dstRow = output->getTilePixels(tile) + (tileRoI.y1 - ty * NATRON_BITMAP_TILE_SIZE) * NATRON_BITMAP_TILE_SIZE;
+            for (int y = tileRoI.y1; y < tileRoI.y2; ++y, dstRow += NATRON_BITMAP_TILE_SIZE) {
+                for (int x = tileRoI.x1; x < tileRoI.x2; ++x) {
+                    char value = 1;
+                    int nPicked = 0;
+                    for (int srcy = y * scale; srcy < (y + 1) * scale && value; ++srcy) {
+                        if (srcy < srcArea.y1 || srcy >= srcArea.y2) {
+                            continue;
+                        }
+                        for (int srcx = x * scale; srcx < (x + 1) * scale; ++srcx) {
+                            if (srcx < srcArea.x1 || srcx >= srcArea.x2) {
+                                continue;
+                            }
+                            ++nPicked;
+                            if (getPixelState(srcx, srcy) != 1) {
+                                value = 0;
+                                break;
+                            }
+                        }
+                    }
+                    dstRow[x - tx * NATRON_BITMAP_TILE_SIZE] = nPicked ? value : 0;
+                }
+            }
+            output->updateTileState(tile, tileRect, tx, ty);
+        }
     }
 }
 
@@ -603,9 +738,10 @@ Image::printUnrenderedPixels(const RectI& roi) const
     }
     QReadLocker k(&_entryLock);
     
-    const char* bm = _bitmap.getBitmapAt(roi.x1, roi.y1);
-    int roiw = roi.x2 - roi.x1;
-    int boundsW = _bitmap.getBounds().width();
+    RectI area;
+    if ( !roi.intersect(_bitmap.getBounds(), &area) ) {
+        return;
+    }
     
     RectD bboxUnrendered;
     bboxUnrendered.setupInfinity();
@@ -615,10 +751,10 @@ Image::printUnrenderedPixels(const RectI& roi) const
     bool hasUnrendered = false;
     bool hasUnavailable = false;
     
-    for (int y = roi.y1; y < roi.y2; ++y,
-         bm += (boundsW - roiw)) {
-        for (int x = roi.x1; x < roi.x2; ++x,++bm) {
-            if (*bm == 0) {
+    for (int y = area.y1; y < area.y2; ++y) {
+        for (int x = area.x1; x < area.x2; ++x) {
+            char state = _bitmap.getPixelState(x, y);
+            if (state == 0) {
                 if (x < bboxUnrendered.x1) {
                     bboxUnrendered.x1 = x;
                 }
@@ -632,7 +768,7 @@ Image::printUnrenderedPixels(const RectI& roi) const
                     bboxUnrendered.y2 = y;
                 }
                 hasUnrendered = true;
-            } else if (*bm == PIXEL_UNAVAILABLE) {
+            } else if (state == PIXEL_UNAVAILABLE) {
                 if (x < bboxUnavailable.x1) {
                     bboxUnavailable.x1 = x;
                 }
@@ -987,9 +1123,7 @@ Image::resizeInternal(const Image* srcImg,
             std::size_t memsize = a * pixelSize;
             memset(pix, 0, memsize);
             if (setBitmapTo1 && (*outputImage)->usesBitMap()) {
-                char* bm = wacc.bitmapAt(aRect.x1, aRect.y1);
-                assert(bm);
-                memset(bm, 1, a);
+                (*outputImage)->_bitmap.markForRendered(aRect);
             }
         }
         if (!cRect.isNull()) {
@@ -999,9 +1133,7 @@ Image::resizeInternal(const Image* srcImg,
             std::size_t memsize = a * pixelSize;
             memset(pix, 0, memsize);
             if (setBitmapTo1 && (*outputImage)->usesBitMap()) {
-                char* bm = (char*)wacc.bitmapAt(cRect.x1, cRect.y1);
-                assert(bm);
-                memset(bm, 1, a);
+                (*outputImage)->_bitmap.markForRendered(cRect);
             }
         }
         if (!bRect.isNull()) {
@@ -1013,13 +1145,11 @@ Image::resizeInternal(const Image* srcImg,
             int bw = bRect.width();
             std::size_t rectRowSize = bw * pixelSize;
             
-            char* bm = (setBitmapTo1 && (*outputImage)->usesBitMap()) ? wacc.bitmapAt(bRect.x1, bRect.y1) : 0;
             for (int y = bRect.y1; y < bRect.y2; ++y, pix += rowsize) {
                 memset(pix, 0, rectRowSize);
-                if (bm) {
-                    memset(bm, 1, bw);
-                    bm += mw;
-                }
+            }
+            if (setBitmapTo1 && (*outputImage)->usesBitMap()) {
+                (*outputImage)->_bitmap.markForRendered(bRect);
             }
         }
         if (!dRect.isNull()) {
@@ -1031,13 +1161,11 @@ Image::resizeInternal(const Image* srcImg,
             int dw = dRect.width();
             std::size_t rectRowSize = dw * pixelSize;
             
-            char* bm = (setBitmapTo1 && (*outputImage)->usesBitMap()) ? wacc.bitmapAt(dRect.x1, dRect.y1) : 0;
             for (int y = dRect.y1; y < dRect.y2; ++y, pix += rowsize) {
                 memset(pix, 0, rectRowSize);
-                if (bm) {
-                    memset(bm, 1, dw);
-                    bm += mw;
-                }
+            }
+            if (setBitmapTo1 && (*outputImage)->usesBitMap()) {
+                (*outputImage)->_bitmap.markForRendered(dRect);
             }
         }
         
@@ -1497,10 +1625,8 @@ Image::halveRoIForDepth(const RectI & roi,
     ///The source rectangle, intersected to this image region of definition in pixels
     const RectI &srcBounds = _bounds;
     const RectI &dstBounds = output->_bounds;
-    const RectI &srcBmBounds = _bitmap.getBounds();
-    const RectI &dstBmBounds = output->_bitmap.getBounds();
     assert(!copyBitMap || usesBitMap());
-    assert(!usesBitMap() ||(srcBmBounds == srcBounds && dstBmBounds == dstBounds));
+    assert(!usesBitMap() ||(_bitmap.getBounds() == srcBounds && output->_bitmap.getBounds() == dstBounds));
 
     // the srcRoD of the output should be enclosed in half the roi.
     // It does not have to be exactly half of the input.
@@ -1526,113 +1652,28 @@ Image::halveRoIForDepth(const RectI & roi,
   
     
     const PIX* const srcPixels      = (const PIX*)pixelAt(srcBounds.x1,   srcBounds.y1);
-    const char* const srcBmPixels   = _bitmap.getBitmapAt(srcBmBounds.x1, srcBmBounds.y1);
     PIX* const dstPixels          = (PIX*)output->pixelAt(dstBounds.x1,   dstBounds.y1);
-    char* const dstBmPixels = output->_bitmap.getBitmapAt(dstBmBounds.x1, dstBmBounds.y1);
 
     int srcRowSize = srcBounds.width() * nComponents;
     int dstRowSize = dstBounds.width() * nComponents;
 
-    // offset pointers so that srcData and dstData correspond to pixel (0,0)
-    const PIX* const srcData = srcPixels - (srcBounds.x1 * nComponents + srcRowSize * srcBounds.y1);
-    PIX* const dstData       = dstPixels - (dstBounds.x1 * nComponents + dstRowSize * dstBounds.y1);
-
-    const int srcBmRowSize = srcBmBounds.width();
-    const int dstBmRowSize = dstBmBounds.width();
-
-    const char* const srcBmData = srcBmPixels - (srcBmBounds.x1 + srcBmRowSize * srcBmBounds.y1);
-    char* const dstBmData       = dstBmPixels - (dstBmBounds.x1 + dstBmRowSize * dstBmBounds.y1);
-
     for (int y = dstRoI.y1; y < dstRoI.y2; ++y) {
-        const PIX* const srcLineStart    = srcData + y * 2 * srcRowSize;
-        PIX* const dstLineStart          = dstData + y     * dstRowSize;
-        const char* const srcBmLineStart = srcBmData + y * 2 * srcBmRowSize;
-        char* const dstBmLineStart       = dstBmData + y     * dstBmRowSize;
-
         // The current dst row, at y, covers the src rows y*2 (thisRow) and y*2+1 (nextRow).
         // Check that if are within srcBounds.
         int srcy = y * 2;
         bool pickThisRow = srcBounds.y1 <= (srcy + 0) && (srcy + 0) < srcBounds.y2;
         bool pickNextRow = srcBounds.y1 <= (srcy + 1) && (srcy + 1) < srcBounds.y2;
+        assert(pickThisRow || pickNextRow);
 
-        int sumH = (int)pickNextRow + (int)pickThisRow;
-        assert(sumH == 1 || sumH == 2);
-        
-        for (int x = dstRoI.x1; x < dstRoI.x2; ++x) {
-            const PIX* const srcPixStart    = srcLineStart   + x * 2 * nComponents;
-            const char* const srcBmPixStart = srcBmLineStart + x * 2;
-            PIX* const dstPixStart          = dstLineStart   + x * nComponents;
-            char* const dstBmPixStart       = dstBmLineStart + x;
-
-            // The current dst col, at y, covers the src cols x*2 (thisCol) and x*2+1 (nextCol).
-            // Check that if are within srcBounds.
-            int srcx = x * 2;
-            bool pickThisCol = srcBounds.x1 <= (srcx + 0) && (srcx + 0) < srcBounds.x2;
-            bool pickNextCol = srcBounds.x1 <= (srcx + 1) && (srcx + 1) < srcBounds.x2;
-
-            int sumW = (int)pickThisCol + (int)pickNextCol;
-            assert(sumW == 1 || sumW == 2);
-            const int sum = sumW * sumH;
-            assert(0 < sum && sum <= 4);
-
-            if (sum == 0) {// never happens
-                for (int k = 0; k < nComponents; ++k) {
-                    dstPixStart[k] = 0;
-                }
-                if (copyBitMap) {
-                    dstBmPixStart[0] = 0;
-                }
-                continue;
-            }
+        const PIX* thisRow = pickThisRow ? srcPixels + (srcy - srcBounds.y1) * srcRowSize : NULL;
+        const PIX* nextRow = pickNextRow ? srcPixels + (srcy + 1 - srcBounds.y1) * srcRowSize : NULL;
+        PIX* dstRow = dstPixels + (y - dstBounds.y1) * dstRowSize + (dstRoI.x1 - dstBounds.x1) * nComponents;
 
-            for (int k = 0; k < nComponents; ++k) {
-                ///a b
-                ///c d
-
-                const PIX a = (pickThisCol && pickThisRow) ? *(srcPixStart + k) : 0;
-                const PIX b = (pickNextCol && pickThisRow) ? *(srcPixStart + k + nComponents) : 0;
-                const PIX c = (pickThisCol && pickNextRow) ? *(srcPixStart + k + srcRowSize): 0;
-                const PIX d = (pickNextCol && pickNextRow) ? *(srcPixStart + k + srcRowSize  + nComponents)  : 0;
-                
-                assert(sumW == 2 || (sumW == 1 && ((a == 0 && c == 0) || (b == 0 && d == 0))));
-                assert(sumH == 2 || (sumH == 1 && ((a == 0 && b == 0) || (c == 0 && d == 0))));
-                dstPixStart[k] = (a + b + c + d) / sum;
-            }
-            
-            if (copyBitMap) {
-                ///a b
-                ///c d
-
-                char a = (pickThisCol && pickThisRow) ? *(srcBmPixStart) : 0;
-                char b = (pickNextCol && pickThisRow) ? *(srcBmPixStart + 1) : 0;
-                char c = (pickThisCol && pickNextRow) ? *(srcBmPixStart + srcBmRowSize): 0;
-                char d = (pickNextCol && pickNextRow) ? *(srcBmPixStart + srcBmRowSize  + 1)  : 0;
-#if NATRON_ENABLE_TRIMAP
-                /*
-                 The only correct solution is to convert pixels being rendered to 0 otherwise the caller
-                 would have to wait for the original fullscale image render to be finished and then re-downscale again.
-                 */
-                if (a == PIXEL_UNAVAILABLE) {
-                    a = 0;
-                }
-                if (b == PIXEL_UNAVAILABLE) {
-                    b = 0;
-                }
-                if (c == PIXEL_UNAVAILABLE) {
-                    c = 0;
-                }
-                if (d == PIXEL_UNAVAILABLE) {
-                    d = 0;
-                }
-#endif
-                assert(sumW == 2 || (sumW == 1 && ((a == 0 && c == 0) || (b == 0 && d == 0))));
-                assert(sumH == 2 || (sumH == 1 && ((a == 0 && b == 0) || (c == 0 && d == 0))));
-                assert(a + b + c + d <= sum); // bitmaps are 0 or 1
-                // the following is an integer division, the result can be 0 or 1
-                dstBmPixStart[0] = (a + b + c + d) / sum;
-                assert(dstBmPixStart[0] == 0 || dstBmPixStart[0] == 1);
-            }
-        }
+        MipMapKernels::halveRow<PIX>(nComponents, thisRow, nextRow, srcBounds.x1, srcBounds.x2, dstRow, dstRoI.x1, dstRoI.x2);
+    }
+
+    if (copyBitMap) {
+        _bitmap.halveRoI(dstRoI, &output->_bitmap);
     }
 
 } // halveRoIForDepth
@@ -1758,20 +1799,15 @@ Image::downscaleMipMap(const RectD& dstRod,
 
     assert(_bounds.x1 <= roi.x1 && roi.x2 <= _bounds.x2 &&
            _bounds.y1 <= roi.y1 && roi.y2 <= _bounds.y2);
-    double par = getPixelAspectRatio();
 //    RectD roiCanonical;
 //    roi.toCanonical(fromLevel, par , dstRod, &roiCanonical);
 //    RectI dstRoI;
 //    roiCanonical.toPixelEnclosing(toLevel, par , &dstRoI);
     unsigned int downscaleLvls = toLevel - fromLevel;
 
-    assert(!copyBitMap || _bitmap.getBitmap());
+    assert(!copyBitMap || usesBitMap());
     
     RectI dstRoI  = roi.downscalePowerOfTwoSmallestEnclosing(downscaleLvls);
-    
-    ImagePtr tmpImg( new Image( getComponents(), dstRod, dstRoI, toLevel, par, getBitDepth(), getPremultiplication(), getFieldingOrder(), true) );
-
-    buildMipMapLevel( dstRod, roi, downscaleLvls, copyBitMap, tmpImg.get() );
 
     // check that the downscaled mipmap is inside the output image (it may not be equal to it)
     assert(dstRoI.x1 >= output->_bounds.x1);
@@ -1779,8 +1815,8 @@ Image::downscaleMipMap(const RectD& dstRod,
     assert(dstRoI.y1 >= output->_bounds.y1);
     assert(dstRoI.y2 <= output->_bounds.y2);
 
-    ///Now copy the result of tmpImg into the output image
-    output->pasteFrom(*tmpImg, dstRoI, copyBitMap);
+    ///The levels are built directly into the output image
+    buildMipMapLevel( dstRod, roi, downscaleLvls, copyBitMap, output );
 }
 
 
@@ -1795,6 +1831,13 @@ Image::checkForNaNs(const RectI& roi)
     
     unsigned int compsCount = getComponentsCount();
 
+    ///Most images have no NaN: find out with the vectorized read-only reduction before replacing them
+    ImageMinMaxResult minMax;
+    ImageMinMax::findComponentsMinMax( (const float*)pixelAt(roi.x1, roi.y1), compsCount * _bounds.width(), compsCount * roi.width(), roi.height(), &minMax );
+    if (!minMax.hasNaN) {
+        return false;
+    }
+
     bool hasnan = false;
     for (int y = roi.y1; y < roi.y2; ++y) {
         
@@ -1862,36 +1905,16 @@ Image::upscaleMipMapForDepth(const RectI & roi,
     int yi = srcRoi.y1;
     int ycount; // how many lines should be filled
     for (int yo = dstRoi.y1; yo < dstRoi.y2; ++yi, src += srcRowSize, yo += ycount, dst += ycount * dstRowSize) {
-        const PIX * const srcLineStart = src;
         PIX * const dstLineBatchStart = dst;
         ycount = scale - (yo - yi * scale); // how many lines should be filled
         ycount = std::min(ycount, dstRoi.y2 - yo);
         assert(0 < ycount && ycount <= scale);
-        int xi = srcRoi.x1;
-        int xcount = 0; // how many pixels should be filled
-        const PIX * srcPix = srcLineStart;
-        PIX * dstPixFirst = dstLineBatchStart;
         // fill the first line
-        for (int xo = dstRoi.x1; xo < dstRoi.x2; ++xi, srcPix += components, xo += xcount, dstPixFirst += xcount * components) {
-            xcount = scale - (xo - xi * scale);
-            xcount = std::min(xcount, dstRoi.x2 - xo);
-            //assert(0 < xcount && xcount <= scale);
-            // replicate srcPix as many times as necessary
-            PIX * dstPix = dstPixFirst;
-            //assert((srcPix-(PIX*)pixelAt(srcRoi.x1, srcRoi.y1)) % components == 0);
-            for (int i = 0; i < xcount; ++i, dstPix += components) {
-                assert( ( dstPix - (PIX*)output->pixelAt(dstRoi.x1, dstRoi.y1) ) % components == 0 );
-                assert(dstPix >= (PIX*)output->pixelAt(xo, yo) && dstPix < (PIX*)output->pixelAt(xo, yo) + xcount * components);
-                for (int c = 0; c < components; ++c) {
-                    dstPix[c] = srcPix[c];
-                }
-            }
-            //assert(dstPix == dstPixFirst + xcount*components);
-        }
+        MipMapKernels::upscaleRow<PIX>(components, src, srcRoi.x1, dstLineBatchStart, dstRoi.x1, dstRoi.x2, scale);
         PIX * dstLineStart = dstLineBatchStart + dstRowSize; // first line was filled already
         // now replicate the line as many times as necessary
         for (int i = 1; i < ycount; ++i, dstLineStart += dstRowSize) {
-            std::copy(dstLineBatchStart, dstLineBatchStart + dstRowSize, dstLineStart);
+            std::copy(dstLineBatchStart, dstLineBatchStart + dstRoi.width() * components, dstLineStart);
         }
     }
 } // upscaleMipMapForDepth
@@ -1949,7 +1972,17 @@ Image::scaleBoxForDepth(const RectI & roi,
          ( srcRoi.x2 == 2 * dstBounds.x2) &&
          ( srcRoi.y1 == 2 * dstBounds.y1) &&
          ( srcRoi.y2 == 2 * dstBounds.y2) ) {
-        halveRoI(srcRoi, false, output);
+        ///The locks are already taken: do not go through halveRoI
+        int nComponents = getComponents().getNumComponents();
+        MipMapKernels::buildMipMapLevel<PIX>(nComponents,
+                                             (const PIX*)pixelAt(srcBounds.x1, srcBounds.y1),
+                                             srcBounds.width() * nComponents,
+                                             srcBounds,
+                                             srcRoi,
+                                             1,
+                                             (PIX*)output->pixelAt(dstBounds.x1, dstBounds.y1),
+                                             dstBounds.width() * nComponents,
+                                             dstBounds);
 
         return;
     }
@@ -2174,6 +2207,47 @@ Image::scaleBox(const RectI & roi,
     }
 }
 
+template <typename PIX>
+void
+Image::buildMipMapLevelForDepth(const RectI & roi,
+                                unsigned int level,
+                                bool copyBitMap,
+                                Image* output) const
+{
+    assert(level > 0);
+
+    QWriteLocker k1(&output->_entryLock);
+    QReadLocker k2(&_entryLock);
+
+    int nComponents = getComponents().getNumComponents();
+    RectI srcRoI;
+    if ( (nComponents == 0) || !roi.intersect(_bounds, &srcRoI) ) {
+        return;
+    }
+
+    const RectI & srcBounds = _bounds;
+    const RectI & dstBounds = output->_bounds;
+
+    ///All the levels are built in a single pass over the rows of this image, without allocating the intermediate levels
+    MipMapKernels::buildMipMapLevel<PIX>(nComponents,
+                                         (const PIX*)pixelAt(srcBounds.x1, srcBounds.y1),
+                                         srcBounds.width() * nComponents,
+                                         srcBounds,
+                                         srcRoI,
+                                         level,
+                                         (PIX*)output->pixelAt(dstBounds.x1, dstBounds.y1),
+                                         dstBounds.width() * nComponents,
+                                         dstBounds);
+
+    if (copyBitMap) {
+        assert( usesBitMap() );
+        ///The first level covers the source pixels around the roi up to even coordinates, the next ones only cover the previous level
+        RectI firstLevel = srcRoI.downscalePowerOfTwoSmallestEnclosing(1);
+        RectI coveredRoI(firstLevel.x1 * 2, firstLevel.y1 * 2, firstLevel.x2 * 2, firstLevel.y2 * 2);
+        _bitmap.downscaleRoI(srcRoI.downscalePowerOfTwoSmallestEnclosing(level), level, coveredRoI, &output->_bitmap);
+    }
+} // buildMipMapLevelForDepth
+
 // code proofread and fixed by @devernay on 8/8/2014
 void
 Image::buildMipMapLevel(const RectD& dstRoD,
@@ -2182,6 +2256,8 @@ Image::buildMipMapLevel(const RectD& dstRoD,
                         bool copyBitMap,
                         Image* output) const
 {
+    Q_UNUSED(dstRoD);
+
     ///The last mip map level we will make with closestPo2
     RectI lastLevelRoI = roi.downscalePowerOfTwoSmallestEnclosing(level);
 
@@ -2197,43 +2273,21 @@ Image::buildMipMapLevel(const RectD& dstRoD,
         return;
     }
 
-    const Image* srcImg = this;
-    Image* dstImg = NULL;
-    bool mustFreeSrc = false;
-    RectI previousRoI = roi;
-    ///Build all the mipmap levels until we reach the one we are interested in
-    for (unsigned int i = 1; i <= level; ++i) {
-        ///Halve the smallest enclosing po2 rect as we need to render a minimum of the renderWindow
-        RectI halvedRoI = previousRoI.downscalePowerOfTwoSmallestEnclosing(1);
-
-        ///Allocate an image with half the size of the source image
-        dstImg = new Image( getComponents(), dstRoD, halvedRoI, getMipMapLevel() + i, getPixelAspectRatio(),getBitDepth(), getPremultiplication(), getFieldingOrder(), true);
-
-        ///Half the source image into dstImg.
-        ///We pass the closestPo2 roi which might not be the entire size of the source image
-        ///If the source image'sroi was originally a po2.
-        srcImg->halveRoI(previousRoI, copyBitMap, dstImg);
-
-        ///Clean-up, we should use shared_ptrs for safety
-        if (mustFreeSrc) {
-            delete srcImg;
-        }
-
-        ///Switch for next pass
-        previousRoI = halvedRoI;
-        srcImg = dstImg;
-        mustFreeSrc = true;
-
-    }
-
-    assert(srcImg->getBounds() == lastLevelRoI);
-
-    ///Finally copy the last mipmap level into output.
-    output->pasteFrom( *srcImg, srcImg->getBounds() , copyBitMap);
-
-    ///Clean-up, we should use shared_ptrs for safety
-    if (mustFreeSrc) {
-        delete srcImg;
+    switch ( getBitDepth() ) {
+    case eImageBitDepthByte:
+        buildMipMapLevelForDepth<unsigned char>(roi, level, copyBitMap, output);
+        break;
+    case eImageBitDepthShort:
+        buildMipMapLevelForDepth<unsigned short>(roi, level, copyBitMap, output);
+        break;
+    case eImageBitDepthHalf:
+        assert(false);
+        break;
+    case eImageBitDepthFloat:
+        buildMipMapLevelForDepth<float>(roi, level, copyBitMap, output);
+        break;
+    case eImageBitDepthNone:
+        break;
     }
 } // buildMipMapLevel
 
@@ -2267,15 +2321,7 @@ Image::copyBitmapRowPortion(int x1, int x2,int y, const Image& other)
 void
 Bitmap::copyRowPortion(int x1,int x2,int y,const Bitmap& other)
 {
-    const char* srcBitmap = other.getBitmapAt(x1, y);
-    char* dstBitmap = getBitmapAt(x1, y);
-    const char* end = dstBitmap + (x2 - x1);
-    while (dstBitmap < end) {
-        *dstBitmap = /**srcBitmap == PIXEL_UNAVAILABLE ? 0 : */*srcBitmap;
-        ++dstBitmap;
-        ++srcBitmap;
-    }
-    
+    copyBitmapPortion(RectI(x1, y, x2, y + 1), other);
 }
 
 void
@@ -2291,23 +2337,38 @@ Bitmap::copyBitmapPortion(const RectI& roi, const Bitmap& other)
     assert(roi.x1 >= _bounds.x1 && roi.x2 <= _bounds.x2 && roi.y1 >= _bounds.y1 && roi.y2 <= _bounds.y2);
     assert(roi.x1 >= other._bounds.x1 && roi.x2 <= other._bounds.x2 && roi.y1 >= other._bounds.y1 && roi.y2 <= other._bounds.y2);
     
-    int srcRowSize = other._bounds.width();
-    int dstRowSize = _bounds.width();
-    
-    const char* srcBitmap = other.getBitmapAt(roi.x1, roi.y1);
-    char* dstBitmap = getBitmapAt(roi.x1, roi.y1);
+    if ( roi.isNull() ) {
+        return;
+    }
     
-    for (int y = roi.y1; y < roi.y2; ++y,
-         srcBitmap += srcRowSize,
-         dstBitmap += dstRowSize) {
-        
-        const char* srcCur = srcBitmap;
-        const char* srcEnd = srcBitmap + roi.width();
-        char* dstCur = dstBitmap;
-        while (srcCur < srcEnd) {
-            *dstCur = /**srcCur == PIXEL_UNAVAILABLE ? 0 : */*srcCur;
-            ++srcCur;
-            ++dstCur;
+    // Both bitmaps share the same tile grid: uniform source tiles are copied without looking at the pixels,
+    // and the per-pixel maps of mixed tiles can be copied row by row at the same offsets.
+    int tx1 = bitmapTileIndex(roi.x1);
+    int tx2 = bitmapTileIndex(roi.x2 - 1) + 1;
+    int ty1 = bitmapTileIndex(roi.y1);
+    int ty2 = bitmapTileIndex(roi.y2 - 1) + 1;
+    for (int ty = ty1; ty < ty2; ++ty) {
+        for (int tx = tx1; tx < tx2; ++tx) {
+            RectI tileRect = getTileRect(tx, ty);
+            RectI tileRoI;
+            roi.intersect(tileRect, &tileRoI);
+            Tile& dstTile = getTile(tx, ty);
+            const Tile& srcTile = other.getTile(tx, ty);
+            if (srcTile.state != eTileStateMixed) {
+                fillTile(dstTile, tileRect, tx, ty, tileRoI, srcTile.state);
+                continue;
+            }
+            
+            std::size_t offset = (tileRoI.y1 - ty * NATRON_BITMAP_TILE_SIZE) * NATRON_BITMAP_TILE_SIZE + (tileRoI.x1 - tx * NATRON_BITMAP_TILE_SIZE);
+            const char* srcRow = &srcTile.pixels[offset];
+            char* dstRow = getTilePixels(dstTile) + offset;
+            int w = tileRoI.width();
+            for (int y = tileRoI.y1; y < tileRoI.y2; ++y,
+                 srcRow += NATRON_BITMAP_TILE_SIZE,
+                 dstRow += NATRON_BITMAP_TILE_SIZE) {
+                memcpy(dstRow, srcRow, w);
+            }
+            updateTileState(dstTile, tileRect, tx, ty);
         }
     }
 }
@@ -27,6 +27,7 @@
 
 #include <list>
 #include <map>
+#include <vector>
 #include <algorithm> // min, max
 #include <bitset>
 
@@ -61,12 +62,38 @@ public:
     }
 };
 
+/**
+ * @brief Holds the render state of each pixel of an image: 0 if not rendered, 1 if rendered and, when
+ * NATRON_ENABLE_TRIMAP is set, 2 if the pixel is being rendered by another thread.
+ * The state is stored per tile of NATRON_BITMAP_TILE_SIZE x NATRON_BITMAP_TILE_SIZE pixels: a tile whose pixels
+ * all share the same state only stores that state, and a per-pixel map is allocated only for tiles that are
+ * partially marked (typically the tiles crossed by the border of a render window). Each tile also counts its
+ * rendered and unavailable pixels so that most queries never have to look at individual pixels.
+ * Tiles are aligned on multiples of NATRON_BITMAP_TILE_SIZE in pixel coordinates, hence 2 bitmaps of the
+ * same mipmap level always share the same tile grid whatever their bounds.
+ **/
 class Bitmap
 {
 public:
+
+    /**
+     * @brief Flags returned by getStatesInRect()
+     **/
+    enum BitmapStateFlagEnum
+    {
+        eBitmapStateNotRendered = 0x1,
+        eBitmapStateRendered = 0x2,
+        eBitmapStateUnavailable = 0x4,
+        eBitmapStateAll = 0x7
+    };
+
     Bitmap(const RectI & bounds)
-    : _bounds(bounds)
-    , _map( bounds.area() )
+    : _bounds()
+    , _tileX1(0)
+    , _tileY1(0)
+    , _nTilesX(0)
+    , _nTilesY(0)
+    , _tiles()
     , _dirtyZone()
     , _dirtyZoneSet(false)
     {
@@ -74,24 +101,22 @@ public:
         // "identities" images (i.e: images that are just a link to another image). See EffectInstance :
         // "!!!Note that if isIdentity is true it will allocate an empty image object with 0 bytes of data."
         //assert(!rod.isNull());
-        std::fill(_map.begin(), _map.end(), 0);
+        initialize(bounds);
     }
 
     Bitmap()
     : _bounds()
-    , _map()
+    , _tileX1(0)
+    , _tileY1(0)
+    , _nTilesX(0)
+    , _nTilesY(0)
+    , _tiles()
     , _dirtyZone()
     , _dirtyZoneSet(false)
     {
     }
 
-    void initialize(const RectI & bounds)
-    {
-        _bounds = bounds;
-        _map.resize( _bounds.area() );
-
-        std::fill(_map.begin(), _map.end(), 0);
-    }
+    void initialize(const RectI & bounds);
 
     ~Bitmap()
     {
@@ -100,7 +125,7 @@ public:
 
     void setTo1()
     {
-        std::fill(_map.begin(),_map.end(),1);
+        fill(_bounds, 1);
     }
 
     const RectI & getBounds() const
@@ -129,31 +154,105 @@ public:
 
     void swap(Bitmap& other);
 
-    const char* getBitmap() const
-    {
-        return &_map.front();
-    }
+    /**
+     * @brief Returns the state (0, 1 or 2) of the pixel at (x,y) which must lie in the bounds.
+     **/
+    char getPixelState(int x,int y) const;
 
-    char* getBitmap()
+    /**
+     * @brief Returns a combination of BitmapStateFlagEnum telling which states can be found in the pixels of roi.
+     * The roi is clipped to the bounds.
+     **/
+    unsigned int getStatesInRect(const RectI& roi) const;
+
+    /**
+     * @brief Returns the memory used by the tiles descriptors. The per-pixel maps of partially marked tiles
+     * come and go while rendering and are not accounted for, so that the size of an image stays the same
+     * during its lifetime in the cache.
+     **/
+    std::size_t getStorageSize() const
     {
-        return &_map.front();
+        return _tiles.size() * sizeof(Tile);
     }
 
-    const char* getBitmapAt(int x,int y) const;
-    char* getBitmapAt(int x,int y);
-
     void copyRowPortion(int x1,int x2,int y,const Bitmap& other);
 
     void copyBitmapPortion(const RectI& roi, const Bitmap& other);
 
+    /**
+     * @brief Downscales the portion of this bitmap covered by dstRoI (expressed at the level of output) into output.
+     * A destination pixel is rendered only if all the source pixels it covers are rendered.
+     **/
+    void halveRoI(const RectI& dstRoI, Bitmap* output) const;
+
+    /**
+     * @brief Same as halveRoI but downscales by 2^levels at once, only taking into account the source pixels in srcRoI.
+     * The result is the same as halving levels times, each intermediate level covering the source pixels in srcRoI.
+     **/
+    void downscaleRoI(const RectI& dstRoI, unsigned int levels, const RectI& srcRoI, Bitmap* output) const;
+
     void setDirtyZone(const RectI& zone) {
         _dirtyZone = zone;
         _dirtyZoneSet = true;
     }
 
 private:
+
+    enum TileStateEnum
+    {
+        eTileStateNotRendered = 0,
+        eTileStateRendered = 1,
+        eTileStateUnavailable = 2,
+        eTileStateMixed = 3 //< pixels have different states, look at Tile::pixels
+    };
+
+    struct Tile
+    {
+        char state;
+        ///Only meaningful when state == eTileStateMixed
+        unsigned short nRendered;
+        unsigned short nUnavailable;
+        ///NATRON_BITMAP_TILE_SIZE * NATRON_BITMAP_TILE_SIZE pixels, only allocated when state == eTileStateMixed
+        std::vector<char> pixels;
+
+        Tile()
+        : state(eTileStateNotRendered)
+        , nRendered(0)
+        , nUnavailable(0)
+        , pixels()
+        {
+        }
+    };
+
+    const Tile& getTile(int tx,int ty) const
+    {
+        return _tiles[(ty - _tileY1) * _nTilesX + (tx - _tileX1)];
+    }
+
+    Tile& getTile(int tx,int ty)
+    {
+        return _tiles[(ty - _tileY1) * _nTilesX + (tx - _tileX1)];
+    }
+
+    ///The rectangle covered by the tile (tx,ty), clipped to the bounds
+    RectI getTileRect(int tx,int ty) const;
+
+    void fill(const RectI& roi,char value);
+
+    void fillTile(Tile& tile,const RectI& tileRect,int tx,int ty,const RectI& roi,char value);
+
+    ///Allocates the per-pixel map of the tile if needed. updateTileState must be called once the pixels are modified.
+    char* getTilePixels(Tile& tile);
+
+    ///Recounts the states of the pixels of a mixed tile and releases its per-pixel map if they are all the same.
+    void updateTileState(Tile& tile,const RectI& tileRect,int tx,int ty);
+
     RectI _bounds;
-    std::vector<char> _map;
+
+    ///Index of the bottom-left tile and number of tiles in each direction
+    int _tileX1,_tileY1;
+    int _nTilesX,_nTilesY;
+    std::vector<Tile> _tiles;
 
     /**
      * This represents the zone that has potentially something to render. In minimalNonMarkedRects
@@ -288,13 +387,18 @@ public:
         std::size_t dt = dataSize();
 
         bool got = _entryLock.tryLockForRead();
-        dt += _bitmap.getBounds().area();
+        dt += _bitmap.getStorageSize();
         if (got) {
             _entryLock.unlock();
         }
         return dt;
     }
 
+    virtual int getDataElementSize() const OVERRIDE FINAL
+    {
+        return getSizeOfForBitDepth(_bitDepth);
+    }
+
 
     ///Overriden from BufferableObject
     virtual std::size_t sizeInRAM() const OVERRIDE FINAL
@@ -393,12 +497,6 @@ public:
             assert(img);
             return img->pixelAt(x, y);
         }
-
-        const char* bitmapAt(int x, int y) const
-        {
-            assert(img);
-            return img->getBitmapAt(x, y);
-        }
     };
 
     /**
@@ -438,12 +536,6 @@ public:
         {
             return img->pixelAt(x, y);
         }
-
-        char* bitmapAt(int x, int y) const
-        {
-            assert(img);
-            return img->getBitmapAt(x, y);
-        }
     };
 
     ReadAccess getReadRights() const
@@ -466,18 +558,6 @@ private:
      * of an image.
      **/
 
-    const char* getBitmapAt(int x,
-                            int y) const
-    {
-        return this->_bitmap.getBitmapAt(x,y);
-    }
-
-    char* getBitmapAt(int x,
-                      int y)
-    {
-        return this->_bitmap.getBitmapAt(x,y);
-    }
-
     /**
      * @brief Access pixels. The pointer must be cast to the appropriate type afterwards.
      **/
@@ -515,67 +595,6 @@ private:
         _entryLock.unlock();
     }
 
-
-    template <typename SRCPIX,typename DSTPIX,int srcMaxValue,int dstMaxValue>
-    static void
-    convertToFormatInternal_sameComps(const RectI & renderWindow,
-                                      const Image & srcImg,
-                                      Image & dstImg,
-                                      ViewerColorSpaceEnum srcColorSpace,
-                                      ViewerColorSpaceEnum dstColorSpace,
-                                      bool copyBitmap);
-
-    template <typename SRCPIX,typename DSTPIX,int srcMaxValue,int dstMaxValue,int srcNComps,int dstNComps>
-    static void
-    convertToFormatInternal(const RectI & renderWindow,
-                            const Image & srcImg,
-                            Image & dstImg,
-                            ViewerColorSpaceEnum srcColorSpace,
-                            ViewerColorSpaceEnum dstColorSpace,
-                            int channelForAlpha,
-                            bool useAlpha0,
-                            bool copyBitmap,
-                            bool requiresUnpremult);
-
-
-
-    template <typename SRCPIX,typename DSTPIX,int srcMaxValue,int dstMaxValue,int srcNComps,int dstNComps,
-    bool requiresUnpremult>
-    static void convertToFormatInternalForUnpremult(const RectI & renderWindow,
-                                                    const Image & srcImg,
-                                                    Image & dstImg,
-                                                    ViewerColorSpaceEnum srcColorSpace,
-                                                    ViewerColorSpaceEnum dstColorSpace,
-                                                    bool useAlpha0,
-                                                    bool copyBitmap,
-                                                    int channelForAlpha);
-
-
-    template <typename SRCPIX,typename DSTPIX,int srcMaxValue,int dstMaxValue,int srcNComps,int dstNComps,
-    bool requiresUnpremult, bool useColorspaces>
-    static void convertToFormatInternalForColorSpace(const RectI & renderWindow,
-                                                     const Image & srcImg,
-                                                     Image & dstImg,
-                                                     bool copyBitmap,
-                                                     bool useAlpha0,
-                                                     ViewerColorSpaceEnum srcColorSpace,
-                                                     ViewerColorSpaceEnum dstColorSpace,
-                                                     int channelForAlpha);
-
-
-
-
-    template <typename SRCPIX,typename DSTPIX,int srcMaxValue,int dstMaxValue>
-    static void
-    convertToFormatInternalForDepth(const RectI & renderWindow,
-                                    const Image & srcImg,
-                                    Image & dstImg,
-                                    ViewerColorSpaceEnum srcColorSpace,
-                                    ViewerColorSpaceEnum dstColorSpace,
-                                    int channelForAlpha,
-                                    bool useAlpha0,
-                                    bool copyBitmap,
-                                    bool requiresUnpremult);
 public:
 
 
@@ -831,6 +850,19 @@ public:
                       bool maskInvert,
                       float mix);
 
+    /**
+     * @brief Same as copyUnProcessedChannels() followed by applyMaskMix() if maskMix is true, but in a single pass over
+     * the rows of the roi (@see PostRenderKernels). This is what is done to the output of the host-side masked effects.
+     **/
+    void copyUnProcessedChannelsAndApplyMaskMix(const RectI& roi,
+                                                std::bitset<4> processChannels,
+                                                const boost::shared_ptr<Image>& originalImage,
+                                                bool maskMix,
+                                                const Image* maskImg,
+                                                bool masked,
+                                                bool maskInvert,
+                                                float mix);
+
     /**
      * @brief returns true if image contains NaNs or infinite values, and fix them.
      */
@@ -852,88 +884,15 @@ public:
 
 private:
 
-    template<int srcNComps, int dstNComps, typename PIX, int maxValue, bool masked, bool maskInvert>
-    void applyMaskMixForMaskInvert(const RectI& roi,
-                                   const Image* maskImg,
-                                   const Image* originalImg,
-                                   float mix);
-
-
-    template<int srcNComps, int dstNComps, typename PIX, int maxValue, bool masked>
-    void applyMaskMixForMasked(const RectI& roi,
-                               const Image* maskImg,
-                               const Image* originalImg,
-                               bool maskInvert,
-                               float mix);
-
-    template<int srcNComps, int dstNComps, typename PIX, int maxValue>
-    void applyMaskMixForDepth(const RectI& roi,
-                              const Image* maskImg,
-                              const Image* originalImg,
-                              bool masked,
-                              bool maskInvert,
-                              float mix);
-
-
-
-    template<int srcNComps, int dstNComps>
-    void applyMaskMixForDstComponents(const RectI& roi,
-                                      const Image* maskImg,
-                                      const Image* originalImg,
-                                      bool masked,
-                                      bool maskInvert,
-                                      float mix);
-
-    template<int srcNComps>
-    void applyMaskMixForSrcComponents(const RectI& roi,
-                                      const Image* maskImg,
-                                      const Image* originalImg,
-                                      bool masked,
-                                      bool maskInvert,
-                                      float mix);
-
-    template <typename PIX, int maxValue, int srcNComps, int dstNComps, bool doR, bool doG, bool doB, bool doA, bool premult, bool originalPremult>
-    void copyUnProcessedChannelsForPremult(std::bitset<4> processChannels,
-                                           const RectI& roi,
-                                           const boost::shared_ptr<Image>& originalImage);
-
-    template <typename PIX, int maxValue, int srcNComps, int dstNComps>
-    void copyUnProcessedChannelsForPremult(bool premult, bool originalPremult,
-                                           std::bitset<4> processChannels,
-                                           const RectI& roi,
-                                           const boost::shared_ptr<Image>& originalImage);
-
-    template <typename PIX, int maxValue, int srcNComps, int dstNComps, bool doR, bool doG, bool doB, bool doA>
-    void copyUnProcessedChannelsForChannels(std::bitset<4> processChannels,
-                                            bool premult,
-                                            const RectI& roi,
-                                            const boost::shared_ptr<Image>& originalImage,
-                                            bool originalPremult);
-
-    template <typename PIX, int maxValue, int srcNComps, int dstNComps>
-    void copyUnProcessedChannelsForChannels(std::bitset<4> processChannels,
-                                            bool premult,
-                                            const RectI& roi,
-                                            const boost::shared_ptr<Image>& originalImage,
-                                            bool originalPremult);
-
-
-
-    template <typename PIX, int maxValue,int srcNComps, int dstNComps>
-    void copyUnProcessedChannelsForComponents(bool premult,
-                                              const RectI& roi,
-                                              std::bitset<4> processChannels,
-                                              const boost::shared_ptr<Image>& originalImage,
-                                              bool originalPremult);
-
-    template <typename PIX, int maxValue>
-    void copyUnProcessedChannelsForDepth(bool premult,
-                                         const RectI& roi,
-                                         std::bitset<4> processChannels,
-                                         const boost::shared_ptr<Image>& originalImage,
-                                         bool originalPremult);
-
-
+    void applyPostRenderPass(const RectI& roi,
+                             std::bitset<4> processChannels,
+                             const Image* originalImg,
+                             bool copyChannels,
+                             bool maskMix,
+                             const Image* maskImg,
+                             bool masked,
+                             bool maskInvert,
+                             float mix);
 
     /**
      * @brief Given the output buffer,the region of interest and the mip map level, this
@@ -957,6 +916,12 @@ private:
                           bool copyBitMap,
                           Image* output) const;
 
+    template <typename PIX>
+    void buildMipMapLevelForDepth(const RectI & roi,
+                                  unsigned int level,
+                                  bool copyBitMap,
+                                  Image* output) const;
+
     /**
      * @brief Same as halveRoI but for 1D only (either width == 1 or height == 1)
      **/
@@ -27,223 +27,106 @@
 #include <cassert>
 #include <stdexcept>
 
-NATRON_NAMESPACE_ENTER;
+#include <QDebug>
 
-template<int srcNComps, int dstNComps, typename PIX, int maxValue, bool masked, bool maskInvert>
-void
-Image::applyMaskMixForMaskInvert(const RectI& roi,
-                                 const Image* maskImg,
-                                 const Image* originalImg,
-                                 float mix)
-{
-    PIX* dst_pixels = (PIX*)pixelAt(roi.x1, roi.y1);
-    
-    unsigned int dstRowElements = _bounds.width() * getComponentsCount();
-    
-    for (int y = roi.y1; y < roi.y2; ++y,
-         dst_pixels += (dstRowElements - (roi.x2 - roi.x1) * dstNComps)) { // 1 row stride minus what was done at previous iteration
-        
-        for (int x = roi.x1; x < roi.x2; ++x,
-             dst_pixels += dstNComps) {
-            
-            const PIX* src_pixels = originalImg ? (const PIX*)originalImg->pixelAt(x,y) : 0;
-            
-            float maskScale = 1.f;
-            if (!masked) {
-                // just mix
-                float alpha = mix;
-                if (src_pixels) {
-                    for (int c = 0; c < dstNComps; ++c) {
-                        if (c < srcNComps) {
-                            float v = float(dst_pixels[c]) * alpha + (1.f - alpha) * float(src_pixels[c]);
-                            dst_pixels[c] = clampIfInt<PIX>(v);
-                        }
-                        
-                    }
-                } else {
-                    for (int c = 0; c < dstNComps; ++c) {
-                        float v = float(dst_pixels[c]) * alpha;
-                        dst_pixels[c] = clampIfInt<PIX>(v);
-                    }
-                }
-                
-            } else {
-                const PIX* maskPixels = maskImg ? (const PIX*)maskImg->pixelAt(x,y) : 0;
-                // figure the scale factor from that pixel
-                if (maskPixels == 0) {
-                    maskScale = maskInvert ? 1.f : 0.f;
-                } else {
-                    maskScale = *maskPixels / float(maxValue);
-                    if (maskInvert) {
-                        maskScale = 1.f - maskScale;
-                    }
-                }
-                float alpha = mix * maskScale;
-                if (src_pixels) {
-                    for (int c = 0; c < dstNComps; ++c) {
-                        if (c < srcNComps) {
-                            float v = float(dst_pixels[c]) * alpha + (1.f - alpha) * float(src_pixels[c]);
-                            dst_pixels[c] = clampIfInt<PIX>(v);
-                        }
-                        
-                    }
-                } else {
-                    for (int c = 0; c < dstNComps; ++c) {
-                        float v = float(dst_pixels[c]) * alpha;
-                        dst_pixels[c] = clampIfInt<PIX>(v);
-                    }
-                }
-            }
-            
-            
-            
-        }
-    }
-}
+#include "Engine/PostRenderKernels.h"
 
+NATRON_NAMESPACE_ENTER;
 
-template<int srcNComps, int dstNComps, typename PIX, int maxValue, bool masked>
 void
-Image::applyMaskMixForMasked(const RectI& roi,
-                             const Image* maskImg,
-                             const Image* originalImg,
-                             bool maskInvert,
-                             float mix)
+Image::applyMaskMix(const RectI& roi,
+                    const Image* maskImg,
+                    const Image* originalImg,
+                    bool masked,
+                    bool maskInvert,
+                    float mix)
 {
-    if (maskInvert) {
-        applyMaskMixForMaskInvert<srcNComps,dstNComps, PIX, maxValue, masked, true>(roi, maskImg, originalImg, mix);
-    } else {
-        applyMaskMixForMaskInvert<srcNComps,dstNComps, PIX, maxValue, masked, false>(roi, maskImg, originalImg, mix);
-    }
+    applyPostRenderPass(roi, std::bitset<4>(), originalImg, false, true, maskImg, masked, maskInvert, mix);
 }
 
-template<int srcNComps, int dstNComps, typename PIX, int maxValue>
 void
-Image::applyMaskMixForDepth(const RectI& roi,
-                            const Image* maskImg,
-                            const Image* originalImg,
-                            bool masked,
-                            bool maskInvert,
-                            float mix)
+Image::copyUnProcessedChannelsAndApplyMaskMix(const RectI& roi,
+                                              const std::bitset<4> processChannels,
+                                              const ImagePtr& originalImage,
+                                              bool maskMix,
+                                              const Image* maskImg,
+                                              bool masked,
+                                              bool maskInvert,
+                                              float mix)
 {
-    if (masked) {
-        applyMaskMixForMasked<srcNComps,dstNComps, PIX, maxValue, true>(roi, maskImg, originalImg, maskInvert, mix);
-    } else {
-        applyMaskMixForMasked<srcNComps,dstNComps, PIX, maxValue, false>(roi, maskImg, originalImg, maskInvert, mix);
-    }
-    
+    applyPostRenderPass(roi, processChannels, originalImage.get(), true, maskMix, maskImg, masked, maskInvert, mix);
 }
 
-
-template<int srcNComps, int dstNComps>
 void
-Image::applyMaskMixForDstComponents(const RectI& roi,
-                                    const Image* maskImg,
-                                    const Image* originalImg,
-                                    bool masked,
-                                    bool maskInvert,
-                                    float mix)
+Image::applyPostRenderPass(const RectI& roi,
+                           const std::bitset<4> processChannels,
+                           const Image* originalImg,
+                           bool copyChannels,
+                           bool maskMix,
+                           const Image* maskImg,
+                           bool masked,
+                           bool maskInvert,
+                           float mix)
 {
-    ImageBitDepthEnum depth = getBitDepth();
-    switch (depth) {
-        case eImageBitDepthByte:
-            applyMaskMixForDepth<srcNComps,dstNComps, unsigned char , 255>(roi, maskImg, originalImg, masked, maskInvert, mix);
-            break;
-        case eImageBitDepthShort:
-            applyMaskMixForDepth<srcNComps,dstNComps, unsigned short , 65535>(roi, maskImg, originalImg, masked, maskInvert, mix);
-            break;
-        case eImageBitDepthFloat:
-            applyMaskMixForDepth<srcNComps,dstNComps, float, 1>(roi, maskImg, originalImg, masked, maskInvert, mix);
-            break;
-        default:
-            assert(false);
-            break;
+    if ( copyChannels && !canCallCopyUnProcessedChannels(processChannels) ) {
+        copyChannels = false;
     }
-    
-}
-
-template<int srcNComps>
-void
-Image::applyMaskMixForSrcComponents(const RectI& roi,
-                                    const Image* maskImg,
-                                    const Image* originalImg,
-                                    bool masked,
-                                    bool maskInvert,
-                                    float mix)
-{
-    int dstNComps = getComponentsCount();
-    assert(0 < dstNComps && dstNComps <= 4);
-    switch (dstNComps) {
-        //case 0:
-        //    applyMaskMixForDstComponents<srcNComps,0>(roi, maskImg, originalImg, masked, maskInvert, mix);
-        //    break;
-        case 1:
-            applyMaskMixForDstComponents<srcNComps,1>(roi, maskImg, originalImg, masked, maskInvert, mix);
-            break;
-        case 2:
-            applyMaskMixForDstComponents<srcNComps,2>(roi, maskImg, originalImg, masked, maskInvert, mix);
-            break;
-        case 3:
-            applyMaskMixForDstComponents<srcNComps,3>(roi, maskImg, originalImg, masked, maskInvert, mix);
-            break;
-        case 4:
-            applyMaskMixForDstComponents<srcNComps,4>(roi, maskImg, originalImg, masked, maskInvert, mix);
-            break;
-        default:
-            break;
+    if ( copyChannels && originalImg && ( getMipMapLevel() != originalImg->getMipMapLevel() ) ) {
+        qDebug() << "WARNING: attempting to call copyUnProcessedChannels on images with different mipMapLevel";
+        copyChannels = false;
     }
-}
-
-void
-Image::applyMaskMix(const RectI& roi,
-                    const Image* maskImg,
-                    const Image* originalImg,
-                    bool masked,
-                    bool maskInvert,
-                    float mix)
-{
-    ///!masked && mix == 1 has nothing to do
-    if (!masked && mix == 1) {
+    ///!masked && mix == 1 has nothing to do, and there is nothing to mix without the original image
+    if ( !originalImg || (!masked && mix == 1) ) {
+        maskMix = false;
+    }
+    if (!copyChannels && !maskMix) {
         return;
     }
-    
+
     QWriteLocker k(&_entryLock);
     boost::shared_ptr<QReadLocker> originalLock;
     boost::shared_ptr<QReadLocker> maskLock;
     if (originalImg) {
-        originalLock.reset(new QReadLocker(&originalImg->_entryLock));
+        originalLock.reset( new QReadLocker(&originalImg->_entryLock) );
     }
-    if (maskImg) {
-        maskLock.reset(new QReadLocker(&maskImg->_entryLock));
+    if (maskMix && masked && maskImg) {
+        maskLock.reset( new QReadLocker(&maskImg->_entryLock) );
     }
     RectI realRoI;
-    roi.intersect(_bounds, &realRoI);
-    
-    assert(!originalImg || getBitDepth() == originalImg->getBitDepth());
-    assert(!masked || !maskImg || maskImg->getComponents() == ImageComponents::getAlphaComponents());
-    
-    int srcNComps = originalImg ? (int)originalImg->getComponentsCount() : 0;
-    //assert(0 < srcNComps && srcNComps <= 4);
-    switch (srcNComps) {
-        //case 0:
-        //    applyMaskMixForSrcComponents<0>(realRoI, maskImg, originalImg, masked, maskInvert, mix);
-        //    break;
-        case 1:
-            applyMaskMixForSrcComponents<1>(realRoI, maskImg, originalImg, masked, maskInvert, mix);
-            break;
-        case 2:
-            applyMaskMixForSrcComponents<2>(realRoI, maskImg, originalImg, masked, maskInvert, mix);
-            break;
-        case 3:
-            applyMaskMixForSrcComponents<3>(realRoI, maskImg, originalImg, masked, maskInvert, mix);
-            break;
-        case 4:
-            applyMaskMixForSrcComponents<4>(realRoI, maskImg, originalImg, masked, maskInvert, mix);
-            break;
-        default:
-            break;
+    if ( !roi.intersect(_bounds, &realRoI) ) {
+        return;
     }
-    
-}
+
+    assert( !originalImg || getBitDepth() == originalImg->getBitDepth() );
+    assert( !maskMix || !masked || !maskImg || (maskImg->getComponents() == ImageComponents::getAlphaComponents() &&
+                                                 getBitDepth() == maskImg->getBitDepth()) );
+
+    void* dstPixels = pixelAt(_bounds.x1, _bounds.y1);
+    if (!dstPixels) {
+        return;
+    }
+    const void* srcPixels = originalImg ? originalImg->pixelAt(originalImg->_bounds.x1, originalImg->_bounds.y1) : 0;
+    const void* maskPixels = (maskMix && masked && maskImg) ? maskImg->pixelAt(maskImg->_bounds.x1, maskImg->_bounds.y1) : 0;
+
+    PostRenderArgs args;
+    args.depth = getBitDepth();
+    args.dstNComps = (int)getComponentsCount();
+    args.srcNComps = originalImg ? (int)originalImg->getComponentsCount() : 0;
+    args.copyChannels = copyChannels;
+    args.processChannels = processChannels;
+    args.maskMix = maskMix;
+    args.masked = masked;
+    args.maskInvert = maskInvert;
+    args.mix = mix;
+
+    PostRenderKernels::processRows(args,
+                                   realRoI,
+                                   dstPixels,
+                                   _bounds,
+                                   srcPixels,
+                                   originalImg ? originalImg->_bounds : RectI(),
+                                   maskPixels,
+                                   maskPixels ? maskImg->_bounds : RectI());
+} // applyPostRenderPass
 
 NATRON_NAMESPACE_EXIT;
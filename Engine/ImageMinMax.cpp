@@ -0,0 +1,561 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+
+#include "ImageMinMax.h"
+
+#include <cstddef>
+#include <cassert>
+
+#include "Engine/SimdSupport.h"
+
+#ifdef NATRON_SIMD_X86
+#include <immintrin.h>
+#endif
+
+NATRON_NAMESPACE_ENTER;
+
+namespace {
+
+inline void
+accumulate(float v,
+           float & vmin,
+           float & vmax,
+           bool & hasNaN)
+{
+    if (v != v) {
+        hasNaN = true;
+
+        return;
+    }
+    if (v < vmin) {
+        vmin = v;
+    }
+    if (v > vmax) {
+        vmax = v;
+    }
+}
+
+/// The channels of a pixel of nComps components as displayed by the viewer
+template <int nComps>
+inline float
+getR(const float* pix)
+{
+    return nComps >= 2 ? pix[0] : 0.f;
+}
+
+template <int nComps>
+inline float
+getG(const float* pix)
+{
+    return nComps >= 2 ? pix[1] : 0.f;
+}
+
+template <int nComps>
+inline float
+getB(const float* pix)
+{
+    return nComps >= 3 ? pix[2] : 0.f;
+}
+
+template <int nComps>
+inline float
+getA(const float* pix)
+{
+    return nComps == 1 ? pix[0] : (nComps == 4 ? pix[3] : 1.f);
+}
+
+template <int nComps>
+inline float
+getY(const float* pix)
+{
+    return 0.299f * getR<nComps>(pix) + 0.587f * getG<nComps>(pix) + 0.114f * getB<nComps>(pix);
+}
+
+template <int nComps, DisplayChannelsEnum channels>
+void
+findChannelsMinMaxScalar(const float* pixels,
+                         int rowElements,
+                         int width,
+                         int height,
+                         ImageMinMaxResult* result)
+{
+    float vmin = result->vmin;
+    float vmax = result->vmax;
+    bool hasNaN = result->hasNaN;
+
+    for (int y = 0; y < height; ++y) {
+        const float* pix = pixels + (std::size_t)y * rowElements;
+        for (int x = 0; x < width; ++x, pix += nComps) {
+            switch (channels) {
+            case eDisplayChannelsRGB:
+                accumulate(getR<nComps>(pix), vmin, vmax, hasNaN);
+                accumulate(getG<nComps>(pix), vmin, vmax, hasNaN);
+                accumulate(getB<nComps>(pix), vmin, vmax, hasNaN);
+                break;
+            case eDisplayChannelsR:
+                accumulate(getR<nComps>(pix), vmin, vmax, hasNaN);
+                break;
+            case eDisplayChannelsG:
+                accumulate(getG<nComps>(pix), vmin, vmax, hasNaN);
+                break;
+            case eDisplayChannelsB:
+                accumulate(getB<nComps>(pix), vmin, vmax, hasNaN);
+                break;
+            case eDisplayChannelsA:
+                accumulate(getA<nComps>(pix), vmin, vmax, hasNaN);
+                break;
+            case eDisplayChannelsY:
+                accumulate(getY<nComps>(pix), vmin, vmax, hasNaN);
+                break;
+            default:
+                accumulate(0.f, vmin, vmax, hasNaN);
+                break;
+            }
+        }
+    }
+    result->vmin = vmin;
+    result->vmax = vmax;
+    result->hasNaN = hasNaN;
+}
+
+template <int nComps>
+void
+findChannelsMinMaxScalarForComps(const float* pixels,
+                                 int rowElements,
+                                 int width,
+                                 int height,
+                                 DisplayChannelsEnum channels,
+                                 ImageMinMaxResult* result)
+{
+    switch (channels) {
+    case eDisplayChannelsRGB:
+        findChannelsMinMaxScalar<nComps, eDisplayChannelsRGB>(pixels, rowElements, width, height, result);
+        break;
+    case eDisplayChannelsR:
+        findChannelsMinMaxScalar<nComps, eDisplayChannelsR>(pixels, rowElements, width, height, result);
+        break;
+    case eDisplayChannelsG:
+        findChannelsMinMaxScalar<nComps, eDisplayChannelsG>(pixels, rowElements, width, height, result);
+        break;
+    case eDisplayChannelsB:
+        findChannelsMinMaxScalar<nComps, eDisplayChannelsB>(pixels, rowElements, width, height, result);
+        break;
+    case eDisplayChannelsA:
+        findChannelsMinMaxScalar<nComps, eDisplayChannelsA>(pixels, rowElements, width, height, result);
+        break;
+    case eDisplayChannelsY:
+        findChannelsMinMaxScalar<nComps, eDisplayChannelsY>(pixels, rowElements, width, height, result);
+        break;
+    default:
+        findChannelsMinMaxScalar<nComps, eDisplayChannelsMatte>(pixels, rowElements, width, height, result);
+        break;
+    }
+}
+
+void
+findComponentsMinMaxScalar(const float* pixels,
+                           int rowElements,
+                           int rowLength,
+                           int height,
+                           ImageMinMaxResult* result)
+{
+    float vmin = result->vmin;
+    float vmax = result->vmax;
+    bool hasNaN = result->hasNaN;
+
+    for (int y = 0; y < height; ++y) {
+        const float* src = pixels + (std::size_t)y * rowElements;
+        for (int x = 0; x < rowLength; ++x) {
+            accumulate(src[x], vmin, vmax, hasNaN);
+        }
+    }
+    result->vmin = vmin;
+    result->vmax = vmax;
+    result->hasNaN = hasNaN;
+}
+
+#ifdef NATRON_SIMD_X86
+
+/// Merges the lanes of the accumulators selected by laneMask (bit i for lane i) into the result
+void
+mergeLanes(const float* vmin,
+           const float* vmax,
+           const int* nan,
+           int nLanes,
+           unsigned int laneMask,
+           ImageMinMaxResult* result)
+{
+    for (int i = 0; i < nLanes; ++i) {
+        if ( !( laneMask & (1u << (i % 4)) ) ) {
+            continue;
+        }
+        if (vmin[i] < result->vmin) {
+            result->vmin = vmin[i];
+        }
+        if (vmax[i] > result->vmax) {
+            result->vmax = vmax[i];
+        }
+        if (nan[i]) {
+            result->hasNaN = true;
+        }
+    }
+}
+
+// _mm_min_ps(v, acc) and _mm_max_ps(v, acc) return acc when v is NaN, which is how NaNs are left out of the reductions.
+
+NATRON_SIMD_TARGET_SSE41
+void
+findComponentsMinMaxSSE41(const float* pixels,
+                          int rowElements,
+                          int rowLength,
+                          int height,
+                          ImageMinMaxResult* result)
+{
+    __m128 vmin0 = _mm_set1_ps(result->vmin);
+    __m128 vmax0 = _mm_set1_ps(result->vmax);
+    __m128 vmin1 = vmin0;
+    __m128 vmax1 = vmax0;
+    __m128 nan = _mm_setzero_ps();
+    ImageMinMaxResult tail;
+
+    for (int y = 0; y < height; ++y) {
+        const float* src = pixels + (std::size_t)y * rowElements;
+        int x = 0;
+        for (; x + 8 <= rowLength; x += 8) {
+            __m128 v0 = _mm_loadu_ps(src + x);
+            __m128 v1 = _mm_loadu_ps(src + x + 4);
+            nan = _mm_or_ps( nan, _mm_or_ps( _mm_cmpunord_ps(v0, v0), _mm_cmpunord_ps(v1, v1) ) );
+            vmin0 = _mm_min_ps(v0, vmin0);
+            vmax0 = _mm_max_ps(v0, vmax0);
+            vmin1 = _mm_min_ps(v1, vmin1);
+            vmax1 = _mm_max_ps(v1, vmax1);
+        }
+        for (; x < rowLength; ++x) {
+            accumulate(src[x], tail.vmin, tail.vmax, tail.hasNaN);
+        }
+    }
+
+    float vmin[4], vmax[4];
+    int isNaN[4];
+    _mm_storeu_ps( vmin, _mm_min_ps(vmin0, vmin1) );
+    _mm_storeu_ps( vmax, _mm_max_ps(vmax0, vmax1) );
+    _mm_storeu_si128( (__m128i*)isNaN, _mm_castps_si128(nan) );
+    mergeLanes(vmin, vmax, isNaN, 4, 0xF, result);
+    result->merge(tail);
+}
+
+NATRON_SIMD_TARGET_AVX2
+void
+findComponentsMinMaxAVX2(const float* pixels,
+                         int rowElements,
+                         int rowLength,
+                         int height,
+                         ImageMinMaxResult* result)
+{
+    __m256 vmin0 = _mm256_set1_ps(result->vmin);
+    __m256 vmax0 = _mm256_set1_ps(result->vmax);
+    __m256 vmin1 = vmin0;
+    __m256 vmax1 = vmax0;
+    __m256 nan = _mm256_setzero_ps();
+    ImageMinMaxResult tail;
+
+    for (int y = 0; y < height; ++y) {
+        const float* src = pixels + (std::size_t)y * rowElements;
+        int x = 0;
+        for (; x + 16 <= rowLength; x += 16) {
+            __m256 v0 = _mm256_loadu_ps(src + x);
+            __m256 v1 = _mm256_loadu_ps(src + x + 8);
+            nan = _mm256_or_ps( nan, _mm256_or_ps( _mm256_cmp_ps(v0, v0, _CMP_UNORD_Q), _mm256_cmp_ps(v1, v1, _CMP_UNORD_Q) ) );
+            vmin0 = _mm256_min_ps(v0, vmin0);
+            vmax0 = _mm256_max_ps(v0, vmax0);
+            vmin1 = _mm256_min_ps(v1, vmin1);
+            vmax1 = _mm256_max_ps(v1, vmax1);
+        }
+        for (; x < rowLength; ++x) {
+            accumulate(src[x], tail.vmin, tail.vmax, tail.hasNaN);
+        }
+    }
+
+    float vmin[8], vmax[8];
+    int isNaN[8];
+    _mm256_storeu_ps( vmin, _mm256_min_ps(vmin0, vmin1) );
+    _mm256_storeu_ps( vmax, _mm256_max_ps(vmax0, vmax1) );
+    _mm256_storeu_si256( (__m256i*)isNaN, _mm256_castps_si256(nan) );
+    mergeLanes(vmin, vmax, isNaN, 8, 0xF, result);
+    result->merge(tail);
+}
+
+/**
+ * @brief Reduces the components of RGBA pixels selected by laneMask: 0x7 for RGB, 0x1, 0x2, 0x4 or 0x8 for a single channel.
+ * The min and max are accumulated per component and only the selected ones are merged at the end.
+ **/
+NATRON_SIMD_TARGET_SSE41
+void
+findRGBAMinMaxSSE41(const float* pixels,
+                    int rowElements,
+                    int width,
+                    int height,
+                    unsigned int laneMask,
+                    ImageMinMaxResult* result)
+{
+    __m128 vmin0 = _mm_set1_ps(result->vmin);
+    __m128 vmax0 = _mm_set1_ps(result->vmax);
+    __m128 vmin1 = vmin0;
+    __m128 vmax1 = vmax0;
+    __m128 nan = _mm_setzero_ps();
+
+    for (int y = 0; y < height; ++y) {
+        const float* pix = pixels + (std::size_t)y * rowElements;
+        int x = 0;
+        for (; x + 2 <= width; x += 2, pix += 8) {
+            __m128 v0 = _mm_loadu_ps(pix);
+            __m128 v1 = _mm_loadu_ps(pix + 4);
+            nan = _mm_or_ps( nan, _mm_or_ps( _mm_cmpunord_ps(v0, v0), _mm_cmpunord_ps(v1, v1) ) );
+            vmin0 = _mm_min_ps(v0, vmin0);
+            vmax0 = _mm_max_ps(v0, vmax0);
+            vmin1 = _mm_min_ps(v1, vmin1);
+            vmax1 = _mm_max_ps(v1, vmax1);
+        }
+        if (x < width) {
+            __m128 v = _mm_loadu_ps(pix);
+            nan = _mm_or_ps( nan, _mm_cmpunord_ps(v, v) );
+            vmin0 = _mm_min_ps(v, vmin0);
+            vmax0 = _mm_max_ps(v, vmax0);
+        }
+    }
+
+    float vmin[4], vmax[4];
+    int isNaN[4];
+    _mm_storeu_ps( vmin, _mm_min_ps(vmin0, vmin1) );
+    _mm_storeu_ps( vmax, _mm_max_ps(vmax0, vmax1) );
+    _mm_storeu_si128( (__m128i*)isNaN, _mm_castps_si128(nan) );
+    mergeLanes(vmin, vmax, isNaN, 4, laneMask, result);
+}
+
+NATRON_SIMD_TARGET_AVX2
+void
+findRGBAMinMaxAVX2(const float* pixels,
+                   int rowElements,
+                   int width,
+                   int height,
+                   unsigned int laneMask,
+                   ImageMinMaxResult* result)
+{
+    __m256 vmin0 = _mm256_set1_ps(result->vmin);
+    __m256 vmax0 = _mm256_set1_ps(result->vmax);
+    __m256 vmin1 = vmin0;
+    __m256 vmax1 = vmax0;
+    __m256 nan = _mm256_setzero_ps();
+    ImageMinMaxResult tail;
+
+    for (int y = 0; y < height; ++y) {
+        const float* pix = pixels + (std::size_t)y * rowElements;
+        int x = 0;
+        for (; x + 4 <= width; x += 4, pix += 16) {
+            __m256 v0 = _mm256_loadu_ps(pix);
+            __m256 v1 = _mm256_loadu_ps(pix + 8);
+            nan = _mm256_or_ps( nan, _mm256_or_ps( _mm256_cmp_ps(v0, v0, _CMP_UNORD_Q), _mm256_cmp_ps(v1, v1, _CMP_UNORD_Q) ) );
+            vmin0 = _mm256_min_ps(v0, vmin0);
+            vmax0 = _mm256_max_ps(v0, vmax0);
+            vmin1 = _mm256_min_ps(v1, vmin1);
+            vmax1 = _mm256_max_ps(v1, vmax1);
+        }
+        for (; x < width; ++x, pix += 4) {
+            for (int c = 0; c < 4; ++c) {
+                if ( laneMask & (1u << c) ) {
+                    accumulate(pix[c], tail.vmin, tail.vmax, tail.hasNaN);
+                }
+            }
+        }
+    }
+
+    float vmin[8], vmax[8];
+    int isNaN[8];
+    _mm256_storeu_ps( vmin, _mm256_min_ps(vmin0, vmin1) );
+    _mm256_storeu_ps( vmax, _mm256_max_ps(vmax0, vmax1) );
+    _mm256_storeu_si256( (__m256i*)isNaN, _mm256_castps_si256(nan) );
+    mergeLanes(vmin, vmax, isNaN, 8, laneMask, result);
+    result->merge(tail);
+}
+
+/// Reduces the luminance of RGBA pixels, computed for 4 pixels at once after transposing them to planar R, G, B
+NATRON_SIMD_TARGET_SSE41
+void
+findRGBALuminanceMinMaxSSE41(const float* pixels,
+                             int rowElements,
+                             int width,
+                             int height,
+                             ImageMinMaxResult* result)
+{
+    const __m128 wr = _mm_set1_ps(0.299f);
+    const __m128 wg = _mm_set1_ps(0.587f);
+    const __m128 wb = _mm_set1_ps(0.114f);
+    __m128 vmin = _mm_set1_ps(result->vmin);
+    __m128 vmax = _mm_set1_ps(result->vmax);
+    __m128 nan = _mm_setzero_ps();
+    ImageMinMaxResult tail;
+
+    for (int y = 0; y < height; ++y) {
+        const float* pix = pixels + (std::size_t)y * rowElements;
+        int x = 0;
+        for (; x + 4 <= width; x += 4, pix += 16) {
+            __m128 r = _mm_loadu_ps(pix);
+            __m128 g = _mm_loadu_ps(pix + 4);
+            __m128 b = _mm_loadu_ps(pix + 8);
+            __m128 a = _mm_loadu_ps(pix + 12);
+            _MM_TRANSPOSE4_PS(r, g, b, a);
+            __m128 lum = _mm_add_ps( _mm_add_ps( _mm_mul_ps(r, wr), _mm_mul_ps(g, wg) ), _mm_mul_ps(b, wb) );
+            nan = _mm_or_ps( nan, _mm_cmpunord_ps(lum, lum) );
+            vmin = _mm_min_ps(lum, vmin);
+            vmax = _mm_max_ps(lum, vmax);
+        }
+        for (; x < width; ++x, pix += 4) {
+            accumulate(getY<4>(pix), tail.vmin, tail.vmax, tail.hasNaN);
+        }
+    }
+
+    float vmins[4], vmaxs[4];
+    int isNaN[4];
+    _mm_storeu_ps(vmins, vmin);
+    _mm_storeu_ps(vmaxs, vmax);
+    _mm_storeu_si128( (__m128i*)isNaN, _mm_castps_si128(nan) );
+    mergeLanes(vmins, vmaxs, isNaN, 4, 0xF, result);
+    result->merge(tail);
+}
+
+#endif // NATRON_SIMD_X86
+} // anon namespace
+
+namespace ImageMinMax {
+
+void
+findChannelsMinMax(const float* pixels,
+                   int rowElements,
+                   int width,
+                   int height,
+                   int nComps,
+                   DisplayChannelsEnum channels,
+                   ImageMinMaxResult* result)
+{
+    assert(result);
+    if ( (width <= 0) || (height <= 0) ) {
+        return;
+    }
+
+    // The channels stored contiguously in the rows: reduce them as a flat array of floats
+    if ( ( (nComps == 3) && (channels == eDisplayChannelsRGB) ) ||
+         ( (nComps == 1) && (channels == eDisplayChannelsA) ) ) {
+        findComponentsMinMax(pixels, rowElements, width * nComps, height, result);
+
+        return;
+    }
+
+#ifdef NATRON_SIMD_X86
+    SimdLevelEnum level = getSimdLevel();
+    if ( (nComps == 4) && (level >= eSimdLevelSSE41) ) {
+        unsigned int laneMask = 0;
+        switch (channels) {
+        case eDisplayChannelsRGB:
+            laneMask = 0x7;
+            break;
+        case eDisplayChannelsR:
+            laneMask = 0x1;
+            break;
+        case eDisplayChannelsG:
+            laneMask = 0x2;
+            break;
+        case eDisplayChannelsB:
+            laneMask = 0x4;
+            break;
+        case eDisplayChannelsA:
+            laneMask = 0x8;
+            break;
+        case eDisplayChannelsY:
+            findRGBALuminanceMinMaxSSE41(pixels, rowElements, width, height, result);
+
+            return;
+        default:
+            break;
+        }
+        if (laneMask) {
+            if (level >= eSimdLevelAVX2) {
+                findRGBAMinMaxAVX2(pixels, rowElements, width, height, laneMask, result);
+            } else {
+                findRGBAMinMaxSSE41(pixels, rowElements, width, height, laneMask, result);
+            }
+
+            return;
+        }
+    }
+#endif
+
+    switch (nComps) {
+    case 1:
+        findChannelsMinMaxScalarForComps<1>(pixels, rowElements, width, height, channels, result);
+        break;
+    case 2:
+        findChannelsMinMaxScalarForComps<2>(pixels, rowElements, width, height, channels, result);
+        break;
+    case 3:
+        findChannelsMinMaxScalarForComps<3>(pixels, rowElements, width, height, channels, result);
+        break;
+    case 4:
+        findChannelsMinMaxScalarForComps<4>(pixels, rowElements, width, height, channels, result);
+        break;
+    default:
+        // no pixel data to read, every value is 0
+        findChannelsMinMaxScalar<0, eDisplayChannelsMatte>(pixels, rowElements, width, height, result);
+        break;
+    }
+} // findChannelsMinMax
+
+void
+findComponentsMinMax(const float* pixels,
+                     int rowElements,
+                     int rowLength,
+                     int height,
+                     ImageMinMaxResult* result)
+{
+    assert(result);
+    if ( (rowLength <= 0) || (height <= 0) ) {
+        return;
+    }
+#ifdef NATRON_SIMD_X86
+    SimdLevelEnum level = getSimdLevel();
+    if (level >= eSimdLevelAVX2) {
+        findComponentsMinMaxAVX2(pixels, rowElements, rowLength, height, result);
+
+        return;
+    } else if (level >= eSimdLevelSSE41) {
+        findComponentsMinMaxSSE41(pixels, rowElements, rowLength, height, result);
+
+        return;
+    }
+#endif
+    findComponentsMinMaxScalar(pixels, rowElements, rowLength, height, result);
+}
+} // namespace ImageMinMax
+
+NATRON_NAMESPACE_EXIT;
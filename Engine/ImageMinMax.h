@@ -0,0 +1,98 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_IMAGEMINMAX_H
+#define NATRON_ENGINE_IMAGEMINMAX_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <limits>
+
+#include "Global/Enums.h"
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief The result of a min/max reduction over the values of float pixels. NaNs are not taken into account in the
+ * min and max, they only set hasNaN. vmin > vmax if no value was reduced.
+ **/
+struct ImageMinMaxResult
+{
+    float vmin;
+    float vmax;
+    bool hasNaN;
+
+    ImageMinMaxResult()
+        : vmin( std::numeric_limits<float>::infinity() )
+        , vmax( -std::numeric_limits<float>::infinity() )
+        , hasNaN(false)
+    {
+    }
+
+    void merge(const ImageMinMaxResult & other)
+    {
+        if (other.vmin < vmin) {
+            vmin = other.vmin;
+        }
+        if (other.vmax > vmax) {
+            vmax = other.vmax;
+        }
+        hasNaN |= other.hasNaN;
+    }
+};
+
+/**
+ * @brief Vectorized min/max reductions over the rows of a float image, used by the auto-contrast of the viewer and
+ * Image::checkForNaNs(). The kernels are specialized on the number of components and the channels, the SSE4.1 and AVX2
+ * implementations are selected at runtime (@see getSimdLevel()). The functions merge their result into the given one
+ * so that the reductions of several parts of an image may be combined.
+ **/
+namespace ImageMinMax {
+
+/**
+ * @brief Reduces the values displayed by the viewer for the given channels: the min and max of R, G and B for
+ * eDisplayChannelsRGB, the luminance for eDisplayChannelsY, else the value of the channel. As in the viewer, a
+ * missing R, G or B is 0, a missing alpha is 1 and a single component is alpha. eDisplayChannelsMatte yields 0.
+ **/
+void findChannelsMinMax(const float* pixels,
+                        int rowElements,
+                        int width,
+                        int height,
+                        int nComps,
+                        DisplayChannelsEnum channels,
+                        ImageMinMaxResult* result);
+
+/**
+ * @brief Reduces all the components of height rows of rowLength floats, i.e: width * nComps.
+ **/
+void findComponentsMinMax(const float* pixels,
+                          int rowElements,
+                          int rowLength,
+                          int height,
+                          ImageMinMaxResult* result);
+} // namespace ImageMinMax
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_IMAGEMINMAX_H
@@ -45,6 +45,7 @@
 #include <map>
 #include <list>
 #include <utility>
+#include <cassert>
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
 CLANG_DIAG_OFF(unknown-pragmas)
 CLANG_DIAG_OFF(redeclared-class-member)
@@ -59,6 +60,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #endif
 
 #include "Engine/EngineFwd.h"
+#include "Global/GlobalDefines.h"
 
 
 //#define USE_VARIADIC_TEMPLATES
@@ -93,7 +95,126 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
  * defined otherwise it will not compile. (no std::unordered_map
  * support on c++98)
  *
+ * The c++98 tables evict the least recently used entries first unless they are
+ * given the eCacheEvictionPolicyGreedyDualSize policy (@see GreedyDualSizePriorities).
+ *
+ **/
+
+/**
+ * @brief Priorities of the keys of a LRU table when it uses the GreedyDual-Size policy (eCacheEvictionPolicyGreedyDualSize).
+ * Each key is given the priority H = L + cost / size where cost is the time (in seconds) it took to compute the values
+ * stored under the key and size their size in bytes. The key with the lowest priority is evicted first and L (the inflation)
+ * is raised to its priority, so that expensive entries that are not accessed anymore still end-up being evicted.
+ * Keys that have the same priority are ordered by recency: if all costs are 0 this is exactly a LRU.
+ *
+ * The values stored must provide getRecomputeCost() and size() through operator->.
  **/
+template <typename K>
+class GreedyDualSizePriorities
+{
+public:
+
+    typedef std::multimap<double, K> priority_map;
+    typedef typename priority_map::iterator iterator;
+
+    GreedyDualSizePriorities()
+        : _priorities()
+        , _keys()
+        , _inflation(0.)
+    {
+    }
+
+    GreedyDualSizePriorities(const GreedyDualSizePriorities & other)
+        : _priorities(other._priorities)
+        , _keys()
+        , _inflation(other._inflation)
+    {
+        rebuildKeys();
+    }
+
+    GreedyDualSizePriorities & operator=(const GreedyDualSizePriorities & other)
+    {
+        if (this != &other) {
+            _priorities = other._priorities;
+            _inflation = other._inflation;
+            rebuildKeys();
+        }
+
+        return *this;
+    }
+
+    iterator begin()
+    {
+        return _priorities.begin();
+    }
+
+    iterator end()
+    {
+        return _priorities.end();
+    }
+
+    /**
+     * @brief Gives the key the highest priority among keys of the same cost: to be called whenever the key
+     * is accessed or the values stored under it change.
+     **/
+    template <typename LIST>
+    void touch(const K & k,
+               const LIST & values)
+    {
+        double cost = 0.;
+        double size = 0.;
+
+        for (typename LIST::const_iterator it = values.begin(); it != values.end(); ++it) {
+            cost += (*it)->getRecomputeCost();
+            size += (*it)->size();
+        }
+        double priority = _inflation + (size > 0. ? cost / size : cost);
+        typename std::map<K, iterator>::iterator found = _keys.find(k);
+        if ( found != _keys.end() ) {
+            _priorities.erase(found->second);
+            found->second = _priorities.insert( std::make_pair(priority, k) );
+        } else {
+            _keys.insert( std::make_pair( k, _priorities.insert( std::make_pair(priority, k) ) ) );
+        }
+    }
+
+    void remove(const K & k)
+    {
+        typename std::map<K, iterator>::iterator found = _keys.find(k);
+
+        if ( found != _keys.end() ) {
+            _priorities.erase(found->second);
+            _keys.erase(found);
+        }
+    }
+
+    ///Must be called when a value of the key pointed to by it is evicted, before the key is touched or removed
+    void onEvicted(iterator it)
+    {
+        _inflation = it->first;
+    }
+
+    void clear()
+    {
+        _priorities.clear();
+        _keys.clear();
+        _inflation = 0.;
+    }
+
+private:
+
+    void rebuildKeys()
+    {
+        _keys.clear();
+        for (iterator it = _priorities.begin(); it != _priorities.end(); ++it) {
+            _keys.insert( std::make_pair(it->second, it) );
+        }
+    }
+
+    priority_map _priorities;
+    std::map<K, iterator> _keys;
+    double _inflation;
+};
 
 #ifdef USE_VARIADIC_TEMPLATES // c++11 is defined as well as unordered_map
 
@@ -361,10 +482,34 @@ public:
 
     // Constuctor specifies the cached function and
     // the maximum number of records to be stored
-    StlLRUHashTable()
+    explicit StlLRUHashTable(CacheEvictionPolicyEnum policy = eCacheEvictionPolicyLRU)
+        : _key_tracker()
+        , _key_to_value()
+        , _policy(policy)
+        , _priorities()
     {
     }
 
+    CacheEvictionPolicyEnum getEvictionPolicy() const
+    {
+        return _policy;
+    }
+
+    void setEvictionPolicy(CacheEvictionPolicyEnum policy)
+    {
+        if (policy == _policy) {
+            return;
+        }
+        _policy = policy;
+        _priorities.clear();
+        if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+            // Start from the least recently used key so that keys of equal priority keep their recency order
+            for (typename key_tracker_type::iterator it = _key_tracker.begin(); it != _key_tracker.end(); ++it) {
+                _priorities.touch( *it, _key_to_value.find(*it)->second.first );
+            }
+        }
+    }
+
     // Obtain value of the cached function for k
     typename key_to_value_type::iterator operator()(const key_type & k)
     {
@@ -375,13 +520,31 @@ public:
             // Update access record by moving
             // accessed key to back of list
             _key_tracker.splice(_key_tracker.end(),_key_tracker,(*it).second.second);
+            if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+                _priorities.touch(k, it->second.first);
+            }
         }
 
         return it;
     }
 
+    // Recompute the priority of k after the recompute cost of one of its values changed
+    void refreshPriority(const key_type & k)
+    {
+        if (_policy != eCacheEvictionPolicyGreedyDualSize) {
+            return;
+        }
+        typename key_to_value_type::iterator it = _key_to_value.find(k);
+        if ( it != _key_to_value.end() ) {
+            _priorities.touch(k, it->second.first);
+        }
+    }
+
     void erase(typename key_to_value_type::iterator it)
     {
+        if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+            _priorities.remove(it->first);
+        }
         _key_tracker.erase(it->second.second);
         _key_to_value.erase(it);
     }
@@ -401,6 +564,9 @@ public:
     {
         typename key_tracker_type::iterator it = _key_tracker.insert(_key_tracker.end(),k);
         _key_to_value.insert( std::make_pair( k,std::make_pair(list,it) ) );
+        if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+            _priorities.touch(k, list);
+        }
     }
 
     // Record a fresh key-value pair in the cache
@@ -410,6 +576,9 @@ public:
         typename key_to_value_type::iterator found =  _key_to_value.find(k);
         if ( found != _key_to_value.end() ) {
             found->second.first.push_back(v);
+            if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+                _priorities.touch(k, found->second.first);
+            }
         } else {
             value_type list;
             list.push_back(v);
@@ -417,6 +586,9 @@ public:
             // linked to the usage record.
             typename key_tracker_type::iterator it = _key_tracker.insert(_key_tracker.end(),k);
             _key_to_value.insert( std::make_pair( k,std::make_pair(list,it) ) );
+            if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+                _priorities.touch(k, list);
+            }
         }
     }
 
@@ -424,11 +596,16 @@ public:
     {
         _key_to_value.clear();
         _key_tracker.clear();
+        _priorities.clear();
     }
 
-    // Purge the least-recently-used element in the cache
+    // Purge the least-recently-used element in the cache, or the one with the lowest
+    // priority when using the GreedyDual-Size policy
     std::pair<key_type,V> evict()
     {
+        if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+            return evictLowestPriority();
+        }
         // Assert method is never called when cache is empty
         assert( !_key_tracker.empty() );
         // Identify least recently used key
@@ -459,11 +636,43 @@ public:
     }
 
 private:
+
+    std::pair<key_type,V> evictLowestPriority()
+    {
+        for (typename GreedyDualSizePriorities<key_type>::iterator p = _priorities.begin(); p != _priorities.end(); ++p) {
+            const typename key_to_value_type::iterator it = _key_to_value.find(p->second);
+            assert( it != _key_to_value.end() );
+            for (typename std::list<V>::iterator it2 = it->second.first.begin(); it2 != it->second.first.end(); ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    std::pair<key_type,V> ret = std::make_pair(it->first,*it2);
+                    _priorities.onEvicted(p);
+                    if (it->second.first.size() == 1) {
+                        _priorities.remove(it->first);
+                        _key_tracker.erase(it->second.second);
+                        _key_to_value.erase(it);
+                    } else {
+                        it->second.first.erase(it2);
+                        _priorities.touch(it->first, it->second.first);
+                    }
+
+                    return ret;
+                }
+            }
+        }
+
+        return std::make_pair( key_type(),V() );
+    }
+
     // Key access history
     key_tracker_type _key_tracker;
 
     // Key-to-value lookup
     key_to_value_type _key_to_value;
+
+    CacheEvictionPolicyEnum _policy;
+
+    // Only maintained with the GreedyDual-Size policy
+    GreedyDualSizePriorities<key_type> _priorities;
 };
 
 #  else // NATRON_CACHE_USE_BOOST
@@ -477,8 +686,31 @@ public:
     typedef std::list<V> value_type;
     typedef boost::bimaps::bimap<boost::bimaps::unordered_set_of<key_type>,boost::bimaps::list_of<value_type> > container_type;
 
-    BoostLRUHashTable()
+    explicit BoostLRUHashTable(CacheEvictionPolicyEnum policy = eCacheEvictionPolicyLRU)
+        : _container()
+        , _policy(policy)
+        , _priorities()
+    {
+    }
+
+    CacheEvictionPolicyEnum getEvictionPolicy() const
     {
+        return _policy;
+    }
+
+    void setEvictionPolicy(CacheEvictionPolicyEnum policy)
+    {
+        if (policy == _policy) {
+            return;
+        }
+        _policy = policy;
+        _priorities.clear();
+        if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+            // Start from the least recently used key so that keys of equal priority keep their recency order
+            for (typename container_type::right_iterator it = _container.right.begin(); it != _container.right.end(); ++it) {
+                _priorities.touch(it->second, it->first);
+            }
+        }
     }
 
     typename container_type::left_iterator operator()(const key_type & k)
@@ -489,13 +721,31 @@ public:
             // We do have it:
             // Update the access record view.
             _container.right.relocate( _container.right.end(),_container.project_right(it) );
+            if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+                _priorities.touch(k, it->second);
+            }
         }
 
         return it;
     }
 
+    // Recompute the priority of k after the recompute cost of one of its values changed
+    void refreshPriority(const key_type & k)
+    {
+        if (_policy != eCacheEvictionPolicyGreedyDualSize) {
+            return;
+        }
+        typename container_type::left_iterator it = _container.left.find(k);
+        if ( it != _container.left.end() ) {
+            _priorities.touch(k, it->second);
+        }
+    }
+
     void erase(typename container_type::left_iterator it)
     {
+        if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+            _priorities.remove(it->first);
+        }
         _container.left.erase(it);
     }
 
@@ -515,6 +765,9 @@ public:
                 const value_type& list)
     {
         _container.insert(typename container_type::value_type(k,list));
+        if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+            _priorities.touch(k, list);
+        }
     }
     
     void insert(const key_type & k,
@@ -526,20 +779,30 @@ public:
         typename container_type::left_iterator found = this->operator ()(k);
         if ( found != _container.left.end() ) {
             found->second.push_back(v);
+            if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+                _priorities.touch(k, found->second);
+            }
         } else {
             value_type list;
             list.push_back(v);
             _container.insert( typename container_type::value_type(k,list) );
+            if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+                _priorities.touch(k, list);
+            }
         }
     }
 
     void clear()
     {
         _container.clear();
+        _priorities.clear();
     }
 
     std::pair<key_type,V> evict()
     {
+        if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+            return evictLowestPriority();
+        }
         typename container_type::right_iterator it = _container.right.begin();
         while ( it != _container.right.end() ) {
             for (typename std::list<V>::iterator it2 = it->first.begin(); it2 != it->first.end(); ++it2) {
@@ -566,7 +829,37 @@ public:
     }
 
 private:
+
+    std::pair<key_type,V> evictLowestPriority()
+    {
+        for (typename GreedyDualSizePriorities<key_type>::iterator p = _priorities.begin(); p != _priorities.end(); ++p) {
+            typename container_type::left_iterator it = _container.left.find(p->second);
+            assert( it != _container.left.end() );
+            for (typename std::list<V>::iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    std::pair<key_type,V> ret = std::make_pair(it->first,*it2);
+                    _priorities.onEvicted(p);
+                    if (it->second.size() == 1) {
+                        _priorities.remove(it->first);
+                        _container.left.erase(it);
+                    } else {
+                        it->second.erase(it2);
+                        _priorities.touch(it->first, it->second);
+                    }
+
+                    return ret;
+                }
+            }
+        }
+
+        return std::make_pair( key_type(),V() );
+    }
+
     container_type _container;
+    CacheEvictionPolicyEnum _policy;
+
+    // Only maintained with the GreedyDual-Size policy
+    GreedyDualSizePriorities<key_type> _priorities;
 };
 
 #    else // !NATRON_CACHE_USE_HASH
@@ -579,10 +872,33 @@ public:
     typedef V value_type;
     typedef boost::bimaps::bimap<boost::bimaps::set_of<key_type>,boost::bimaps::list_of<value_type> > container_type;
 
-    BoostLRUHashTable()
+    explicit BoostLRUHashTable(CacheEvictionPolicyEnum policy = eCacheEvictionPolicyLRU)
+        : _container()
+        , _policy(policy)
+        , _priorities()
     {
     }
 
+    CacheEvictionPolicyEnum getEvictionPolicy() const
+    {
+        return _policy;
+    }
+
+    void setEvictionPolicy(CacheEvictionPolicyEnum policy)
+    {
+        if (policy == _policy) {
+            return;
+        }
+        _policy = policy;
+        _priorities.clear();
+        if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+            // Start from the least recently used key so that keys of equal priority keep their recency order
+            for (typename container_type::right_iterator it = _container.right.begin(); it != _container.right.end(); ++it) {
+                _priorities.touch(it->second, it->first);
+            }
+        }
+    }
+
     typename container_type::left_iterator operator()(const key_type & k)
     {
         // Attempt to find existing record
@@ -591,13 +907,31 @@ public:
             // We do have it:
             // Update the access record view.
             _container.right.relocate( _container.right.end(),_container.project_right(it) );
+            if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+                _priorities.touch(k, it->second);
+            }
         }
 
         return it;
     }
 
+    // Recompute the priority of k after the recompute cost of one of its values changed
+    void refreshPriority(const key_type & k)
+    {
+        if (_policy != eCacheEvictionPolicyGreedyDualSize) {
+            return;
+        }
+        typename container_type::left_iterator it = _container.left.find(k);
+        if ( it != _container.left.end() ) {
+            _priorities.touch(k, it->second);
+        }
+    }
+
     void erase(typename container_type::left_iterator it)
     {
+        if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+            _priorities.remove(it->first);
+        }
         _container.left.erase(it);
     }
 
@@ -617,6 +951,9 @@ public:
                 const value_type& list)
     {
         _container.insert(typename container_type::value_type(k,list));
+        if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+            _priorities.touch(k, list);
+        }
     }
     
 
@@ -629,20 +966,30 @@ public:
         typename container_type::left_iterator found = this->operator ()(k);
         if ( found != _container.left.end() ) {
             found->second.push_back(v);
+            if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+                _priorities.touch(k, found->second);
+            }
         } else {
             value_type list;
             list.push_back(v);
             _container.insert( typename container_type::value_type(k,list) );
+            if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+                _priorities.touch(k, list);
+            }
         }
     }
 
     void clear()
     {
         _container.clear();
+        _priorities.clear();
     }
 
     std::pair<key_type,V> evict()
     {
+        if (_policy == eCacheEvictionPolicyGreedyDualSize) {
+            return evictLowestPriority();
+        }
         typename container_type::right_iterator it = _container.right.begin();
         while ( it != _container.right.end() ) {
             for (typename std::list<V>::iterator it2 = it->first.begin(); it2 != it->first.end(); ++it2) {
@@ -669,7 +1016,37 @@ public:
     }
 
 private:
+
+    std::pair<key_type,V> evictLowestPriority()
+    {
+        for (typename GreedyDualSizePriorities<key_type>::iterator p = _priorities.begin(); p != _priorities.end(); ++p) {
+            typename container_type::left_iterator it = _container.left.find(p->second);
+            assert( it != _container.left.end() );
+            for (typename std::list<V>::iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    std::pair<key_type,V> ret = std::make_pair(it->first,*it2);
+                    _priorities.onEvicted(p);
+                    if (it->second.size() == 1) {
+                        _priorities.remove(it->first);
+                        _container.left.erase(it);
+                    } else {
+                        it->second.erase(it2);
+                        _priorities.touch(it->first, it->second);
+                    }
+
+                    return ret;
+                }
+            }
+        }
+
+        return std::make_pair( key_type(),V() );
+    }
+
     container_type _container;
+    CacheEvictionPolicyEnum _policy;
+
+    // Only maintained with the GreedyDual-Size policy
+    GreedyDualSizePriorities<key_type> _priorities;
 };
 
 #    endif // !NATRON_CACHE_USE_HASH
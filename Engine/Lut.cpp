@@ -24,12 +24,21 @@
 
 #include "Lut.h"
 
+#include <vector>
+#include <limits>
+#include <cstdlib> // rand
 #include <cstring> // for memcpy
 #include <algorithm> // min, max
 #include <cassert>
 #include <stdexcept>
 
+#include "Global/GlobalDefines.h"
 #include "Engine/RectI.h"
+#include "Engine/SimdSupport.h"
+
+#ifdef NATRON_SIMD_X86
+#include <immintrin.h>
+#endif
 
 /*
  * The to_byte* and from_byte* functions implement and generalize the algorithm
@@ -128,6 +137,481 @@ index_to_float(const unsigned short i)
     return tmp.f;
 }
 
+/// The float whose 16 most significant bits are i and the others 0, for the tables of the interpolations.
+/// Infinities and NaNs turn into the largest possible legal float so that the interpolations next to them stay finite.
+static float
+hipart_to_float(const U32 i)
+{
+    if ( ( i >= 0x7f80) && ( i < 0x8000) ) {
+        return std::numeric_limits<float>::max();
+    }
+    if (i >= 0xff80) {
+        return -std::numeric_limits<float>::max();
+    }
+    U32 bits = i << 16;
+    float f;
+    std::memcpy( &f, &bits, sizeof(float) );
+
+    return f;
+}
+
+/// Infinite values of the transfer functions turn into the largest possible legal float, for the same reason
+static float
+clampInfinite(const float f)
+{
+    return std::max( -std::numeric_limits<float>::max(), std::min(f, std::numeric_limits<float>::max()) );
+}
+
+namespace {
+
+/// The bits of a float: the 16 most significant ones are the index of the float in the tables indexed by hipart()
+inline U32
+floatBits(float f)
+{
+    U32 bits;
+
+    std::memcpy( &bits, &f, sizeof(float) );
+
+    return bits;
+}
+
+/// Interpolates linearly a table holding the values of a function at the floats whose 16 least significant bits are 0.
+/// Between two such floats the value of a float is linear in its 16 least significant bits.
+inline float
+interpolate(const float* table,
+            float v)
+{
+    U32 bits = floatBits(v);
+    U32 i = bits >> 16;
+    float t = (float)(bits & 0xffff) * (1.f / 0x10000);
+
+    return table[i] + (table[i + 1] - table[i]) * t;
+}
+
+void
+toUint8xxRowScalar(const unsigned short* table,
+                   const float* src,
+                   int x1,
+                   int n,
+                   unsigned short* dst)
+{
+    for (int i = x1; i < n; ++i) {
+        dst[i] = table[floatBits(src[i]) >> 16];
+    }
+}
+
+void
+interpolateRowScalar(const float* table,
+                     const float* src,
+                     int x1,
+                     int n,
+                     float* dst)
+{
+    for (int i = x1; i < n; ++i) {
+        dst[i] = interpolate(table, src[i]);
+    }
+}
+
+void
+interpolateToUint16RowScalar(const float* table,
+                             const float* src,
+                             int x1,
+                             int n,
+                             unsigned short* dst)
+{
+    for (int i = x1; i < n; ++i) {
+        dst[i] = (unsigned short)floatToInt<65536>( interpolate(table, src[i]) );
+    }
+}
+
+void
+byteToFloatRowScalar(const float* table,
+                     const unsigned char* src,
+                     int x1,
+                     int n,
+                     float* dst)
+{
+    for (int i = x1; i < n; ++i) {
+        dst[i] = table[src[i]];
+    }
+}
+
+void
+uint16ToFloatRowScalar(const unsigned short* src,
+                       int x1,
+                       int n,
+                       float* dst)
+{
+    for (int i = x1; i < n; ++i) {
+        dst[i] = intToFloat<65536>(src[i]);
+    }
+}
+
+#ifdef NATRON_SIMD_X86
+
+/// interpolate() of the 4 lanes. SSE4.1 has no gather, the table entries are loaded one by one.
+NATRON_SIMD_TARGET_SSE41
+inline __m128
+interpolateSSE41(const float* table,
+                 __m128 v)
+{
+    __m128i bits = _mm_castps_si128(v);
+    __m128i idx = _mm_srli_epi32(bits, 16);
+    __m128 t = _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( bits, _mm_set1_epi32(0xffff) ) ), _mm_set1_ps(1.f / 0x10000) );
+    const float* p0 = table + _mm_cvtsi128_si32(idx);
+    const float* p1 = table + _mm_extract_epi32(idx, 1);
+    const float* p2 = table + _mm_extract_epi32(idx, 2);
+    const float* p3 = table + _mm_extract_epi32(idx, 3);
+    __m128 lo = _mm_setr_ps(p0[0], p1[0], p2[0], p3[0]);
+    __m128 hi = _mm_setr_ps(p0[1], p1[1], p2[1], p3[1]);
+
+    return _mm_add_ps( lo, _mm_mul_ps(_mm_sub_ps(hi, lo), t) );
+}
+
+/// floatToInt<65536> of the 4 lanes. The rounding is exact: floatToInt adds 0.5 in double precision
+NATRON_SIMD_TARGET_SSE41
+inline __m128i
+quantizeUint16SSE41(__m128 v)
+{
+    __m128 p = _mm_mul_ps( _mm_min_ps( _mm_max_ps( v, _mm_setzero_ps() ), _mm_set1_ps(1.f) ), _mm_set1_ps(65535.f) );
+    __m128i i = _mm_cvttps_epi32(p);
+    __m128 frac = _mm_sub_ps( p, _mm_cvtepi32_ps(i) );
+
+    return _mm_sub_epi32( i, _mm_castps_si128( _mm_cmpge_ps( frac, _mm_set1_ps(0.5f) ) ) );
+}
+
+NATRON_SIMD_TARGET_SSE41
+void
+interpolateRowSSE41(const float* table,
+                    const float* src,
+                    int n,
+                    float* dst)
+{
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps( dst + i, interpolateSSE41( table, _mm_loadu_ps(src + i) ) );
+    }
+    interpolateRowScalar(table, src, i, n, dst);
+}
+
+NATRON_SIMD_TARGET_SSE41
+void
+interpolateToUint16RowSSE41(const float* table,
+                            const float* src,
+                            int n,
+                            unsigned short* dst)
+{
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = quantizeUint16SSE41( interpolateSSE41( table, _mm_loadu_ps(src + i) ) );
+        _mm_storel_epi64( (__m128i*)(dst + i), _mm_packus_epi32(v, v) );
+    }
+    interpolateToUint16RowScalar(table, src, i, n, dst);
+}
+
+NATRON_SIMD_TARGET_SSE41
+void
+uint16ToFloatRowSSE41(const unsigned short* src,
+                      int n,
+                      float* dst)
+{
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_cvtepu16_epi32( _mm_loadl_epi64( (const __m128i*)(src + i) ) );
+        _mm_storeu_ps( dst + i, _mm_div_ps( _mm_cvtepi32_ps(v), _mm_set1_ps(65535.f) ) );
+    }
+    uint16ToFloatRowScalar(src, i, n, dst);
+}
+
+/// interpolate() of the 8 lanes
+NATRON_SIMD_TARGET_AVX2
+inline __m256
+interpolateAVX2(const float* table,
+                __m256 v)
+{
+    __m256i bits = _mm256_castps_si256(v);
+    __m256i idx = _mm256_srli_epi32(bits, 16);
+    __m256 t = _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_and_si256( bits, _mm256_set1_epi32(0xffff) ) ), _mm256_set1_ps(1.f / 0x10000) );
+    __m256 lo = _mm256_i32gather_ps(table, idx, 4);
+    __m256 hi = _mm256_i32gather_ps(table + 1, idx, 4);
+
+    return _mm256_add_ps( lo, _mm256_mul_ps(_mm256_sub_ps(hi, lo), t) );
+}
+
+/// floatToInt<65536> of the 8 lanes, @see quantizeUint16SSE41()
+NATRON_SIMD_TARGET_AVX2
+inline __m256i
+quantizeUint16AVX2(__m256 v)
+{
+    __m256 p = _mm256_mul_ps( _mm256_min_ps( _mm256_max_ps( v, _mm256_setzero_ps() ), _mm256_set1_ps(1.f) ), _mm256_set1_ps(65535.f) );
+    __m256i i = _mm256_cvttps_epi32(p);
+    __m256 frac = _mm256_sub_ps( p, _mm256_cvtepi32_ps(i) );
+
+    return _mm256_sub_epi32( i, _mm256_castps_si256( _mm256_cmp_ps(frac, _mm256_set1_ps(0.5f), _CMP_GE_OQ) ) );
+}
+
+/// Stores 8 32-bit integers in [0, 65535]
+NATRON_SIMD_TARGET_AVX2
+inline void
+storeUint16AVX2(__m256i v,
+                unsigned short* p)
+{
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), 0x08);
+
+    _mm_storeu_si128( (__m128i*)p, _mm256_castsi256_si128(packed) );
+}
+
+NATRON_SIMD_TARGET_AVX2
+void
+toUint8xxRowAVX2(const unsigned short* table,
+                 const float* src,
+                 int n,
+                 unsigned short* dst)
+{
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i idx = _mm256_srli_epi32(_mm256_castps_si256( _mm256_loadu_ps(src + i) ), 16);
+        // 32-bit loads of the 16-bit entries: the entry after the last one of the table is padding
+        __m256i v = _mm256_i32gather_epi32( (const int*)table, idx, 2 );
+        storeUint16AVX2(_mm256_and_si256( v, _mm256_set1_epi32(0xffff) ), dst + i);
+    }
+    toUint8xxRowScalar(table, src, i, n, dst);
+}
+
+NATRON_SIMD_TARGET_AVX2
+void
+interpolateRowAVX2(const float* table,
+                   const float* src,
+                   int n,
+                   float* dst)
+{
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps( dst + i, interpolateAVX2( table, _mm256_loadu_ps(src + i) ) );
+    }
+    interpolateRowScalar(table, src, i, n, dst);
+}
+
+NATRON_SIMD_TARGET_AVX2
+void
+interpolateToUint16RowAVX2(const float* table,
+                           const float* src,
+                           int n,
+                           unsigned short* dst)
+{
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        storeUint16AVX2(quantizeUint16AVX2( interpolateAVX2( table, _mm256_loadu_ps(src + i) ) ), dst + i);
+    }
+    interpolateToUint16RowScalar(table, src, i, n, dst);
+}
+
+NATRON_SIMD_TARGET_AVX2
+void
+byteToFloatRowAVX2(const float* table,
+                   const unsigned char* src,
+                   int n,
+                   float* dst)
+{
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i idx = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)(src + i) ) );
+        _mm256_storeu_ps( dst + i, _mm256_i32gather_ps(table, idx, 4) );
+    }
+    byteToFloatRowScalar(table, src, i, n, dst);
+}
+
+NATRON_SIMD_TARGET_AVX2
+void
+uint16ToFloatRowAVX2(const unsigned short* src,
+                     int n,
+                     float* dst)
+{
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)(src + i) ) );
+        _mm256_storeu_ps( dst + i, _mm256_div_ps( _mm256_cvtepi32_ps(v), _mm256_set1_ps(65535.f) ) );
+    }
+    uint16ToFloatRowScalar(src, i, n, dst);
+}
+
+#endif // NATRON_SIMD_X86
+
+/// Looks up n linear floats in the table of toColorSpaceUint8xxFromLinearFloatFast(). Without gather SSE4.1 does
+/// not do better than the scalar code.
+void
+toUint8xxRow(const unsigned short* table,
+             const float* src,
+             int n,
+             unsigned short* dst)
+{
+#ifdef NATRON_SIMD_X86
+    if (getSimdLevel() == eSimdLevelAVX2) {
+        toUint8xxRowAVX2(table, src, n, dst);
+
+        return;
+    }
+#endif
+    toUint8xxRowScalar(table, src, 0, n, dst);
+}
+
+/// Converts n floats with interpolate()
+void
+interpolateRow(const float* table,
+               const float* src,
+               int n,
+               float* dst)
+{
+    switch ( getSimdLevel() ) {
+#ifdef NATRON_SIMD_X86
+    case eSimdLevelAVX2:
+        interpolateRowAVX2(table, src, n, dst);
+        break;
+    case eSimdLevelSSE41:
+        interpolateRowSSE41(table, src, n, dst);
+        break;
+#endif
+    default:
+        interpolateRowScalar(table, src, 0, n, dst);
+        break;
+    }
+}
+
+/// Converts n floats with interpolate() and quantizes them to 16 bits
+void
+interpolateToUint16Row(const float* table,
+                       const float* src,
+                       int n,
+                       unsigned short* dst)
+{
+    switch ( getSimdLevel() ) {
+#ifdef NATRON_SIMD_X86
+    case eSimdLevelAVX2:
+        interpolateToUint16RowAVX2(table, src, n, dst);
+        break;
+    case eSimdLevelSSE41:
+        interpolateToUint16RowSSE41(table, src, n, dst);
+        break;
+#endif
+    default:
+        interpolateToUint16RowScalar(table, src, 0, n, dst);
+        break;
+    }
+}
+
+/// Looks up n bytes in the table of fromColorSpaceUint8ToLinearFloatFast()
+void
+byteToFloatRow(const float* table,
+               const unsigned char* src,
+               int n,
+               float* dst)
+{
+#ifdef NATRON_SIMD_X86
+    if (getSimdLevel() == eSimdLevelAVX2) {
+        byteToFloatRowAVX2(table, src, n, dst);
+
+        return;
+    }
+#endif
+    byteToFloatRowScalar(table, src, 0, n, dst);
+}
+
+/// Converts n shorts with intToFloat<65536>
+void
+uint16ToFloatRow(const unsigned short* src,
+                 int n,
+                 float* dst)
+{
+    switch ( getSimdLevel() ) {
+#ifdef NATRON_SIMD_X86
+    case eSimdLevelAVX2:
+        uint16ToFloatRowAVX2(src, n, dst);
+        break;
+    case eSimdLevelSSE41:
+        uint16ToFloatRowSSE41(src, n, dst);
+        break;
+#endif
+    default:
+        uint16ToFloatRowScalar(src, 0, n, dst);
+        break;
+    }
+}
+
+/// Writes the bytes of W values in [0, 0xff00], diffusing the quantization error forwards and backwards from start
+void
+ditherRow(const unsigned short* from,
+          int inDelta,
+          int W,
+          int start,
+          unsigned char* to,
+          int outDelta)
+{
+    /* go fowards from starting point to end of line: */
+    unsigned error = 0x80;
+
+    for (int x = start; x < W; ++x) {
+        error = (error & 0xff) + from[x * inDelta];
+        assert(error < 0x10000);
+        to[x * outDelta] = (unsigned char)(error >> 8);
+    }
+    /* go backwards from starting point to start of line: */
+    error = 0x80;
+    for (int x = start - 1; x >= 0; --x) {
+        error = (error & 0xff) + from[x * inDelta];
+        assert(error < 0x10000);
+        to[x * outDelta] = (unsigned char)(error >> 8);
+    }
+}
+
+/// The W values of a planar buffer, multiplied by the alpha if any, as a contiguous row
+const float*
+getPlanarRow(const float* from,
+             int W,
+             const float* alpha,
+             int inDelta,
+             std::vector<float>* buffer)
+{
+    if ( !alpha && (inDelta == 1) ) {
+        return from;
+    }
+    buffer->resize(W);
+    for (int i = 0; i < W; ++i) {
+        (*buffer)[i] = alpha ? from[i * inDelta] * alpha[i * inDelta] : from[i * inDelta];
+    }
+
+    return &(*buffer)[0];
+}
+
+/// The R, G and B of the pixels [x1, x2) of a row of packed pixels, multiplied by the alpha if inAOffset is not -1
+void
+getPackedRGBRow(const float* src_pixels,
+                int x1,
+                int x2,
+                int inPackingSize,
+                int inROffset,
+                int inGOffset,
+                int inBOffset,
+                int inAOffset,
+                float* rgb)
+{
+    for (int x = x1; x < x2; ++x, rgb += 3) {
+        const float* p = src_pixels + x * inPackingSize;
+        float a = inAOffset != -1 ? p[inAOffset] : 1.f;
+        rgb[0] = p[inROffset] * a;
+        rgb[1] = p[inGOffset] * a;
+        rgb[2] = p[inBOffset] * a;
+    }
+}
+} // anon namespace
+
 ///initialize the singleton
 LutManager LutManager::m_instance = LutManager();
 LutManager::LutManager()
@@ -231,17 +715,21 @@ Lut::fromColorSpaceUint8ToLinearFloatFast(unsigned char v) const
     return fromFunc_uint8_to_float[v];
 }
 
-#ifdef DEAD_CODE
-// It is not recommended to use this function, because the output is quantized
-// If one really needs float, one has to use the full function (or OpenColorIO)
 float
 Lut::toColorSpaceFloatFromLinearFloatFast(float v) const
 {
     assert(init_);
 
-    return Color::intToFloat<0xff01>(toFunc_hipart_to_uint8xx[hipart(v)]);
+    return interpolate(toFunc_hipart_to_float, v);
+}
+
+float
+Lut::fromColorSpaceFloatToLinearFloatFast(float v) const
+{
+    assert(init_);
+
+    return interpolate(fromFunc_hipart_to_float, v);
 }
-#endif // DEAD_CODE
 
 unsigned char
 Lut::toColorSpaceUint8FromLinearFloatFast(float v) const
@@ -340,9 +828,15 @@ Lut::fillTables() const
         int i = hipart(f);
         toFunc_hipart_to_uint8xx[i] = Color::charToUint8xx(b);
     }
+    toFunc_hipart_to_uint8xx[0x10000] = toFunc_hipart_to_uint8xx[0xffff];
+    // fill the tables of the interpolations, the last entry is only read by the interpolation of the last index
+    for (U32 i = 0; i <= 0x10000; ++i) {
+        float inp = hipart_to_float(i);
+        toFunc_hipart_to_float[i] = clampInfinite( _toFunc(inp) );
+        fromFunc_hipart_to_float[i] = clampInfinite( _fromFunc(inp) );
+    }
 }
 
-#ifdef DEAD_CODE
 void
 Lut::to_byte_planar(unsigned char* to,
                     const float* from,
@@ -351,62 +845,42 @@ Lut::to_byte_planar(unsigned char* to,
                     int inDelta,
                     int outDelta) const
 {
+    if (W <= 0) {
+        return;
+    }
     validate();
-    unsigned char *end = to + W * outDelta;
+    std::vector<float> buffer;
+    const float* linear = getPlanarRow(from, W, alpha, inDelta, &buffer);
+    std::vector<unsigned short> encoded(W);
+    toUint8xxRow(toFunc_hipart_to_uint8xx, linear, W, &encoded[0]);
     // coverity[dont_call]
-    int start = rand() % W;
-    const float *q;
-    unsigned char *p;
-    unsigned error;
-    if (!alpha) {
-        /* go fowards from starting point to end of line: */
-        error = 0x80;
-        for (p = to + start * outDelta, q = from + start * inDelta; p < end; p += outDelta, q += inDelta) {
-            error = (error & 0xff) + toFunc_hipart_to_uint8xx[hipart(*q)];
-            *p = (unsigned char)(error >> 8);
-        }
-        /* go backwards from starting point to start of line: */
-        error = 0x80;
-        for (p = to + (start - 1) * outDelta, q = from + start * inDelta; p >= to; p -= outDelta) {
-            q -= inDelta;
-            error = (error & 0xff) + toFunc_hipart_to_uint8xx[hipart(*q)];
-            *p = (unsigned char)(error >> 8);
-        }
-    } else {
-        const float *a = alpha;
-        /* go fowards from starting point to end of line: */
-        error = 0x80;
-        for (p = to + start * outDelta, q = from + start * inDelta, a += start * inDelta; p < end; p += outDelta, q += inDelta, a += inDelta) {
-            const float v = *q * *a;
-            error = (error & 0xff) + toFunc_hipart_to_uint8xx[hipart(v)];
-            ++a;
-            *p = (unsigned char)(error >> 8);
-        }
-        /* go backwards from starting point to start of line: */
-        error = 0x80;
-        for (p = to + (start - 1) * outDelta, q = from + start * inDelta, a = alpha + start * inDelta; p >= to; p -= outDelta) {
-            const float v = *q * *a;
-            q -= inDelta;
-            q -= inDelta;
-            error = (error & 0xff) + toFunc_hipart_to_uint8xx[hipart(v)];
-            *p = (unsigned char)(error >> 8);
-        }
-    }
+    ditherRow(&encoded[0], 1, W, rand() % W, to, outDelta);
 }
-#endif // DEAD_CODE
 
-#ifdef DEAD_CODE
 void
-Lut::to_short_planar(unsigned short* /*to*/,
-                     const float* /*from*/,
-                     int /*W*/,
-                     const float* /*alpha*/,
-                     int /*inDelta*/,
-                     int /*outDelta*/) const
+Lut::to_short_planar(unsigned short* to,
+                     const float* from,
+                     int W,
+                     const float* alpha,
+                     int inDelta,
+                     int outDelta) const
 {
-    throw std::runtime_error("Lut::to_short_planar not implemented yet.");
+    if (W <= 0) {
+        return;
+    }
+    validate();
+    std::vector<float> buffer;
+    const float* linear = getPlanarRow(from, W, alpha, inDelta, &buffer);
+    if (outDelta == 1) {
+        interpolateToUint16Row(toFunc_hipart_to_float, linear, W, to);
+    } else {
+        std::vector<unsigned short> encoded(W);
+        interpolateToUint16Row(toFunc_hipart_to_float, linear, W, &encoded[0]);
+        for (int i = 0; i < W; ++i) {
+            to[i * outDelta] = encoded[i];
+        }
+    }
 }
-#endif // DEAD_CODE
 
 void
 Lut::to_float_planar(float* to,
@@ -416,14 +890,19 @@ Lut::to_float_planar(float* to,
                      int inDelta,
                      int outDelta) const
 {
+    if (W <= 0) {
+        return;
+    }
     validate();
-    if (!alpha) {
-        for (int f = 0,t = 0; f < W; f += inDelta, t += outDelta) {
-            to[t] = toColorSpaceFloatFromLinearFloat(from[f]);
-        }
+    std::vector<float> buffer;
+    const float* linear = getPlanarRow(from, W, alpha, inDelta, &buffer);
+    if (outDelta == 1) {
+        interpolateRow(toFunc_hipart_to_float, linear, W, to);
     } else {
-        for (int f = 0,t = 0; f < W; f += inDelta, t += outDelta) {
-            to[t] = toColorSpaceFloatFromLinearFloat(from[f] * alpha[f]);
+        std::vector<float> encoded(W);
+        interpolateRow(toFunc_hipart_to_float, linear, W, &encoded[0]);
+        for (int i = 0; i < W; ++i) {
+            to[i * outDelta] = encoded[i];
         }
     }
 }
@@ -460,11 +939,13 @@ Lut::to_byte_packed(unsigned char* to,
 
     validate();
 
+    ///Each row is converted to 8.8 fixed point values at once, the error diffusion is done afterwards
+    const int width = rect.x2 - rect.x1;
+    std::vector<float> rgb(width * 3);
+    std::vector<unsigned short> rgb8xx(width * 3);
     for (int y = rect.y1; y < rect.y2; ++y) {
         // coverity[dont_call]
-        int start = rand() % (rect.x2 - rect.x1) + rect.x1;
-        unsigned error_r, error_g, error_b;
-        error_r = error_g = error_b = 0x80;
+        int start = rand() % width;
         int srcY = y;
         if (!invertY) {
             srcY = srcBounds.y2 - y - 1;
@@ -474,59 +955,83 @@ Lut::to_byte_packed(unsigned char* to,
         int dstY = dstBounds.y2 - y - 1;
         const float *src_pixels = from + (srcY * (srcBounds.x2 - srcBounds.x1) * inPackingSize);
         unsigned char *dst_pixels = to + (dstY * (dstBounds.x2 - dstBounds.x1) * outPackingSize);
-        /* go fowards from starting point to end of line: */
-        for (int x = start; x < rect.x2; ++x) {
-            int inCol = x * inPackingSize;
-            int outCol = x * outPackingSize;
-            float a = (inputHasAlpha && premult) ? src_pixels[inCol + inAOffset] : 1.f;
-            error_r = (error_r & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inROffset] * a)];
-            error_g = (error_g & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inGOffset] * a)];
-            error_b = (error_b & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inBOffset] * a)];
-            assert(error_r < 0x10000 && error_g < 0x10000 && error_b < 0x10000);
-            dst_pixels[outCol + outROffset] = (unsigned char)(error_r >> 8);
-            dst_pixels[outCol + outGOffset] = (unsigned char)(error_g >> 8);
-            dst_pixels[outCol + outBOffset] = (unsigned char)(error_b >> 8);
-            if (outputHasAlpha) {
+        getPackedRGBRow(src_pixels, rect.x1, rect.x2, inPackingSize, inROffset, inGOffset, inBOffset,
+                        (inputHasAlpha && premult) ? inAOffset : -1, &rgb[0]);
+        toUint8xxRow(toFunc_hipart_to_uint8xx, &rgb[0], width * 3, &rgb8xx[0]);
+        unsigned char* dst_row = dst_pixels + rect.x1 * outPackingSize;
+        ditherRow(&rgb8xx[0], 3, width, start, dst_row + outROffset, outPackingSize);
+        ditherRow(&rgb8xx[1], 3, width, start, dst_row + outGOffset, outPackingSize);
+        ditherRow(&rgb8xx[2], 3, width, start, dst_row + outBOffset, outPackingSize);
+        if (outputHasAlpha) {
+            for (int x = rect.x1; x < rect.x2; ++x) {
+                float a = (inputHasAlpha && premult) ? src_pixels[x * inPackingSize + inAOffset] : 1.f;
                 // alpha is linear and should not be dithered
-                dst_pixels[outCol + outAOffset] = floatToInt<256>(a);
+                dst_pixels[x * outPackingSize + outAOffset] = floatToInt<256>(a);
             }
         }
-        /* go backwards from starting point to start of line: */
-        error_r = error_g = error_b = 0x80;
-        for (int x = start - 1; x >= rect.x1; --x) {
-            int inCol = x * inPackingSize;
+    }
+} // to_byte_packed
+
+void
+Lut::to_short_packed(unsigned short* to,
+                     const float* from,
+                     const RectI & conversionRect,
+                     const RectI & srcBounds,
+                     const RectI & dstBounds,
+                     PixelPackingEnum inputPacking,
+                     PixelPackingEnum outputPacking,
+                     bool invertY,
+                     bool premult) const
+{
+    ///clip the conversion rect to srcBounds and dstBounds
+    RectI rect = conversionRect;
+
+    if ( !clip(&rect,srcBounds) || !clip(&rect,dstBounds) ) {
+        return;
+    }
+
+    bool inputHasAlpha = inputPacking == ePixelPackingBGRA || inputPacking == ePixelPackingRGBA;
+    bool outputHasAlpha = outputPacking == ePixelPackingBGRA || outputPacking == ePixelPackingRGBA;
+    int inROffset, inGOffset, inBOffset, inAOffset;
+    int outROffset, outGOffset, outBOffset, outAOffset;
+    getOffsetsForPacking(inputPacking, &inROffset, &inGOffset, &inBOffset, &inAOffset);
+    getOffsetsForPacking(outputPacking, &outROffset, &outGOffset, &outBOffset, &outAOffset);
+
+    int inPackingSize,outPackingSize;
+    inPackingSize = inputHasAlpha ? 4 : 3;
+    outPackingSize = outputHasAlpha ? 4 : 3;
+
+    validate();
+
+    const int width = rect.x2 - rect.x1;
+    std::vector<float> rgb(width * 3);
+    std::vector<unsigned short> rgb16(width * 3);
+    for (int y = rect.y1; y < rect.y2; ++y) {
+        int srcY = y;
+        if (invertY) {
+            srcY = srcBounds.y2 - y - 1;
+        }
+
+        int dstY = dstBounds.y2 - y - 1;
+        const float *src_pixels = from + (srcY * (srcBounds.x2 - srcBounds.x1) * inPackingSize);
+        unsigned short *dst_pixels = to + (dstY * (dstBounds.x2 - dstBounds.x1) * outPackingSize);
+        getPackedRGBRow(src_pixels, rect.x1, rect.x2, inPackingSize, inROffset, inGOffset, inBOffset,
+                        (inputHasAlpha && premult) ? inAOffset : -1, &rgb[0]);
+        interpolateToUint16Row(toFunc_hipart_to_float, &rgb[0], width * 3, &rgb16[0]);
+        for (int x = rect.x1; x < rect.x2; ++x) {
             int outCol = x * outPackingSize;
-            float a = (inputHasAlpha && premult) ? src_pixels[inCol + inAOffset] : 1.f;
-            error_r = (error_r & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inROffset] * a)];
-            error_g = (error_g & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inGOffset] * a)];
-            error_b = (error_b & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inBOffset] * a)];
-            assert(error_r < 0x10000 && error_g < 0x10000 && error_b < 0x10000);
-            dst_pixels[outCol + outROffset] = (unsigned char)(error_r >> 8);
-            dst_pixels[outCol + outGOffset] = (unsigned char)(error_g >> 8);
-            dst_pixels[outCol + outBOffset] = (unsigned char)(error_b >> 8);
+            const unsigned short* p = &rgb16[(x - rect.x1) * 3];
+            dst_pixels[outCol + outROffset] = p[0];
+            dst_pixels[outCol + outGOffset] = p[1];
+            dst_pixels[outCol + outBOffset] = p[2];
             if (outputHasAlpha) {
-                // alpha is linear and should not be dithered
-                dst_pixels[outCol + outAOffset] = floatToInt<256>(a);
+                float a = (inputHasAlpha && premult) ? src_pixels[x * inPackingSize + inAOffset] : 1.f;
+                // alpha is linear
+                dst_pixels[outCol + outAOffset] = floatToInt<65536>(a);
             }
         }
     }
-} // to_byte_packed
-
-#ifdef DEAD_CODE
-void
-Lut::to_short_packed(unsigned short* /*to*/,
-                     const float* /*from*/,
-                     const RectI & /*conversionRect*/,
-                     const RectI & /*srcBounds*/,
-                     const RectI & /*dstBounds*/,
-                     PixelPackingEnum /*inputPacking*/,
-                     PixelPackingEnum /*outputPacking*/,
-                     bool /*invertY*/,
-                     bool /*premult*/) const
-{
-    throw std::runtime_error("Lut::to_short_packed not implemented yet.");
-}
-#endif // DEAD_CODE
+} // to_short_packed
 
 void
 Lut::to_float_packed(float* to,
@@ -559,6 +1064,8 @@ Lut::to_float_packed(float* to,
 
     validate();
 
+    const int width = rect.x2 - rect.x1;
+    std::vector<float> rgb(width * 3);
     for (int y = rect.y1; y < rect.y2; ++y) {
         int srcY = y;
         if (invertY) {
@@ -568,21 +1075,22 @@ Lut::to_float_packed(float* to,
         int dstY = dstBounds.y2 - y - 1;
         const float *src_pixels = from + (srcY * (srcBounds.x2 - srcBounds.x1) * inPackingSize);
         float *dst_pixels = to + (dstY * (dstBounds.x2 - dstBounds.x1) * outPackingSize);
-        /* go fowards from starting point to end of line: */
+        getPackedRGBRow(src_pixels, rect.x1, rect.x2, inPackingSize, inROffset, inGOffset, inBOffset,
+                        (inputHasAlpha && premult) ? inAOffset : -1, &rgb[0]);
+        interpolateRow(toFunc_hipart_to_float, &rgb[0], width * 3, &rgb[0]);
         for (int x = rect.x1; x < rect.x2; ++x) {
-            int inCol = x * inPackingSize;
             int outCol = x * outPackingSize;
-            float a = (inputHasAlpha && premult) ? src_pixels[inCol + inAOffset] : 1.f;;
-            dst_pixels[outCol + outROffset] = toColorSpaceFloatFromLinearFloat(src_pixels[inCol + inROffset] * a);
-            dst_pixels[outCol + outGOffset] = toColorSpaceFloatFromLinearFloat(src_pixels[inCol + inGOffset] * a);
-            dst_pixels[outCol + outBOffset] = toColorSpaceFloatFromLinearFloat(src_pixels[inCol + inBOffset] * a);
+            const float* p = &rgb[(x - rect.x1) * 3];
+            dst_pixels[outCol + outROffset] = p[0];
+            dst_pixels[outCol + outGOffset] = p[1];
+            dst_pixels[outCol + outBOffset] = p[2];
             if (outputHasAlpha) {
                 // alpha is linear and should not be dithered
-                dst_pixels[outCol + outAOffset] = a;
+                dst_pixels[outCol + outAOffset] = (inputHasAlpha && premult) ? src_pixels[x * inPackingSize + inAOffset] : 1.f;
             }
         }
     }
-}
+} // to_float_packed
 
 void
 Lut::from_byte_planar(float* to,
@@ -594,25 +1102,52 @@ Lut::from_byte_planar(float* to,
 {
     validate();
     if (!alpha) {
-        for (int f = 0,t = 0; f < W; f += inDelta, t += outDelta) {
-            to[f] = fromFunc_uint8_to_float[(int)from[f]];
+        if ( (inDelta == 1) && (outDelta == 1) ) {
+            byteToFloatRow(fromFunc_uint8_to_float, from, W, to);
+        } else {
+            for (int i = 0; i < W; ++i) {
+                to[i * outDelta] = fromFunc_uint8_to_float[from[i * inDelta]];
+            }
         }
     } else {
-        for (int f = 0,t = 0; f < W; f += inDelta, t += outDelta) {
-            to[t] = alpha[f] <= 0 ? 0 : Color::intToFloat<256>(fromFunc_uint8_to_float[(from[f] * 255 + 128) / alpha[f]] * alpha[f]);
+        for (int i = 0; i < W; ++i) {
+            int a = alpha[i * inDelta];
+            // unpremultiply in 8 bits, rounded
+            to[i * outDelta] = a == 0 ? 0.f : fromFunc_uint8_to_float[std::min(255, (from[i * inDelta] * 255 + a / 2) / a)] * Color::intToFloat<256>(a);
         }
     }
 }
 
 void
-Lut::from_short_planar(float* /*to*/,
-                       const unsigned short* /*from*/,
-                       int /*W*/,
-                       const unsigned short*/* alpha*/,
-                       int /*inDelta*/,
-                       int /* outDelta*/) const
+Lut::from_short_planar(float* to,
+                       const unsigned short* from,
+                       int W,
+                       const unsigned short* alpha,
+                       int inDelta,
+                       int outDelta) const
 {
-    throw std::runtime_error("Lut::from_short_planar not implemented yet.");
+    if (W <= 0) {
+        return;
+    }
+    validate();
+    std::vector<float> values(W);
+    if ( !alpha && (inDelta == 1) ) {
+        uint16ToFloatRow(from, W, &values[0]);
+    } else {
+        for (int i = 0; i < W; ++i) {
+            float v = Color::intToFloat<65536>(from[i * inDelta]);
+            if (alpha) {
+                float a = Color::intToFloat<65536>(alpha[i * inDelta]);
+                v = a <= 0.f ? 0.f : v / a;
+            }
+            values[i] = v;
+        }
+    }
+    interpolateRow(fromFunc_hipart_to_float, &values[0], W, &values[0]);
+    for (int i = 0; i < W; ++i) {
+        float a = alpha ? Color::intToFloat<65536>(alpha[i * inDelta]) : 1.f;
+        to[i * outDelta] = a <= 0.f ? 0.f : values[i] * a;
+    }
 }
 
 void
@@ -623,16 +1158,24 @@ Lut::from_float_planar(float* to,
                        int inDelta,
                        int outDelta) const
 {
+    if (W <= 0) {
+        return;
+    }
     validate();
-    if (!alpha) {
-        for (int f = 0,t = 0; f < W; f += inDelta, t += outDelta) {
-            to[t] = fromColorSpaceFloatToLinearFloat(from[f]);
-        }
-    } else {
-        for (int f = 0,t = 0; f < W; f += inDelta, t += outDelta) {
-            float a = alpha[f];
-            to[t] = a <= 0. ? 0. : fromColorSpaceFloatToLinearFloat(from[f] / a) * a;
-        }
+    if ( !alpha && (inDelta == 1) && (outDelta == 1) ) {
+        interpolateRow(fromFunc_hipart_to_float, from, W, to);
+
+        return;
+    }
+    std::vector<float> values(W);
+    for (int i = 0; i < W; ++i) {
+        float a = alpha ? alpha[i * inDelta] : 1.f;
+        values[i] = a <= 0.f ? 0.f : from[i * inDelta] / a;
+    }
+    interpolateRow(fromFunc_hipart_to_float, &values[0], W, &values[0]);
+    for (int i = 0; i < W; ++i) {
+        float a = alpha ? alpha[i * inDelta] : 1.f;
+        to[i * outDelta] = a <= 0.f ? 0.f : values[i] * a;
     }
 }
 
@@ -670,6 +1213,8 @@ Lut::from_byte_packed(float* to,
     outPackingSize = outputHasAlpha ? 4 : 3;
 
     validate();
+    ///Without premultiplication all the bytes of a row are looked up at once
+    std::vector<float> values( (rect.x2 - rect.x1) * inPackingSize );
     for (int y = rect.y1; y < rect.y2; ++y) {
         int srcY = y;
         if (invertY) {
@@ -678,6 +1223,9 @@ Lut::from_byte_packed(float* to,
 
         const unsigned char *src_pixels = from + (srcY * (srcBounds.x2 - srcBounds.x1) * inPackingSize);
         float *dst_pixels = to + (y * (dstBounds.x2 - dstBounds.x1) * outPackingSize);
+        if ( !(inputHasAlpha && premult) ) {
+            byteToFloatRow( fromFunc_uint8_to_float, src_pixels + rect.x1 * inPackingSize, (int)values.size(), &values[0] );
+        }
         for (int x = rect.x1; x < rect.x2; ++x) {
             int inCol = x * inPackingSize;
             int outCol = x * outPackingSize;
@@ -698,17 +1246,13 @@ Lut::from_byte_packed(float* to,
                     dst_pixels[outCol + outAOffset] = a;
                 }
             } else {
-                int r8 = 0, g8 = 0, b8 = 0;
-                r8 = src_pixels[inCol + inROffset];
-                g8 = src_pixels[inCol + inGOffset];
-                b8 = src_pixels[inCol + inBOffset];
-                assert(r8 >= 0 && r8 < 256 && g8 >= 0 && g8 < 256 && b8 >= 0 && b8 < 256);
-                dst_pixels[outCol + outROffset] = fromFunc_uint8_to_float[r8];
-                dst_pixels[outCol + outGOffset] = fromFunc_uint8_to_float[g8];
-                dst_pixels[outCol + outBOffset] = fromFunc_uint8_to_float[b8];
+                const float* p = &values[(x - rect.x1) * inPackingSize];
+                dst_pixels[outCol + outROffset] = p[inROffset];
+                dst_pixels[outCol + outGOffset] = p[inGOffset];
+                dst_pixels[outCol + outBOffset] = p[inBOffset];
                 if (outputHasAlpha) {
                     // alpha is linear
-                    float a = Color::intToFloat<256>(src_pixels[inCol + inAOffset]);
+                    float a = inputHasAlpha ? Color::intToFloat<256>(src_pixels[inCol + inAOffset]) : 1.f;
                     dst_pixels[outCol + outAOffset] = a;
                 }
             }
@@ -717,18 +1261,73 @@ Lut::from_byte_packed(float* to,
 } // from_byte_packed
 
 void
-Lut::from_short_packed(float* /*to*/,
-                       const unsigned short* /*from*/,
-                       const RectI & /*conversionRect*/,
-                       const RectI & /*srcBounds*/,
-                       const RectI & /*dstBounds*/,
-                       PixelPackingEnum /*inputPacking*/,
-                       PixelPackingEnum /*outputPacking*/,
-                       bool /*invertY*/,
-                       bool /*premult*/) const
+Lut::from_short_packed(float* to,
+                       const unsigned short* from,
+                       const RectI & conversionRect,
+                       const RectI & srcBounds,
+                       const RectI & dstBounds,
+                       PixelPackingEnum inputPacking,
+                       PixelPackingEnum outputPacking,
+                       bool invertY,
+                       bool premult) const
 {
-    throw std::runtime_error("Lut::from_short_packed not implemented yet.");
-}
+    if ( ( inputPacking == ePixelPackingPLANAR) || ( outputPacking == ePixelPackingPLANAR) ) {
+        throw std::runtime_error("Invalid pixel format.");
+    }
+
+    ///clip the conversion rect to srcBounds and dstBounds
+    RectI rect = conversionRect;
+    if ( !clip(&rect,srcBounds) || !clip(&rect,dstBounds) ) {
+        return;
+    }
+
+
+    bool inputHasAlpha = inputPacking == ePixelPackingBGRA || inputPacking == ePixelPackingRGBA;
+    bool outputHasAlpha = outputPacking == ePixelPackingBGRA || outputPacking == ePixelPackingRGBA;
+    int inROffset, inGOffset, inBOffset, inAOffset;
+    int outROffset, outGOffset, outBOffset, outAOffset;
+    getOffsetsForPacking(inputPacking, &inROffset, &inGOffset, &inBOffset, &inAOffset);
+    getOffsetsForPacking(outputPacking, &outROffset, &outGOffset, &outBOffset, &outAOffset);
+
+    int inPackingSize,outPackingSize;
+    inPackingSize = inputHasAlpha ? 4 : 3;
+    outPackingSize = outputHasAlpha ? 4 : 3;
+
+    validate();
+    const int width = rect.x2 - rect.x1;
+    std::vector<float> values(width * inPackingSize);
+    std::vector<float> rgb(width * 3);
+    for (int y = rect.y1; y < rect.y2; ++y) {
+        int srcY = y;
+        if (invertY) {
+            srcY = srcBounds.y2 - y - 1;
+        }
+
+        const unsigned short *src_pixels = from + (srcY * (srcBounds.x2 - srcBounds.x1) * inPackingSize);
+        float *dst_pixels = to + (y * (dstBounds.x2 - dstBounds.x1) * outPackingSize);
+        uint16ToFloatRow( src_pixels + rect.x1 * inPackingSize, (int)values.size(), &values[0] );
+        for (int x = 0; x < width; ++x) {
+            const float* p = &values[x * inPackingSize];
+            float a = (inputHasAlpha && premult) ? p[inAOffset] : 1.f;
+            rgb[x * 3] = a > 0 ? p[inROffset] / a : 0.f;
+            rgb[x * 3 + 1] = a > 0 ? p[inGOffset] / a : 0.f;
+            rgb[x * 3 + 2] = a > 0 ? p[inBOffset] / a : 0.f;
+        }
+        interpolateRow(fromFunc_hipart_to_float, &rgb[0], width * 3, &rgb[0]);
+        for (int x = 0; x < width; ++x) {
+            const float* p = &values[x * inPackingSize];
+            float a = (inputHasAlpha && premult) ? p[inAOffset] : 1.f;
+            int outCol = (rect.x1 + x) * outPackingSize;
+            dst_pixels[outCol + outROffset] = rgb[x * 3] * a;
+            dst_pixels[outCol + outGOffset] = rgb[x * 3 + 1] * a;
+            dst_pixels[outCol + outBOffset] = rgb[x * 3 + 2] * a;
+            if (outputHasAlpha) {
+                // alpha is linear
+                dst_pixels[outCol + outAOffset] = inputHasAlpha ? p[inAOffset] : 1.f;
+            }
+        }
+    }
+} // from_short_packed
 
 void
 Lut::from_float_packed(float* to,
@@ -765,6 +1364,8 @@ Lut::from_float_packed(float* to,
 
     validate();
 
+    const int width = rect.x2 - rect.x1;
+    std::vector<float> rgb(width * 3);
     for (int y = rect.y1; y < rect.y2; ++y) {
         int srcY = y;
         if (invertY) {
@@ -774,17 +1375,23 @@ Lut::from_float_packed(float* to,
         float *dst_pixels = to + (y * (dstBounds.x2 - dstBounds.x1) * outPackingSize);
         for (int x = rect.x1; x < rect.x2; ++x) {
             int inCol = x * inPackingSize;
-            int outCol = x * outPackingSize;
-            float a = (inputHasAlpha && premult) ? src_pixels[inCol + inAOffset] : 1.f;;
-            float rf = 0., gf = 0., bf = 0.;
+            float a = (inputHasAlpha && premult) ? src_pixels[inCol + inAOffset] : 1.f;
+            float* p = &rgb[(x - rect.x1) * 3];
+            p[0] = p[1] = p[2] = 0.f;
             if (a > 0.) {
-                rf = src_pixels[inCol + inROffset] / a;
-                gf = src_pixels[inCol + inGOffset] / a;
-                bf = src_pixels[inCol + inBOffset] / a;
+                p[0] = src_pixels[inCol + inROffset] / a;
+                p[1] = src_pixels[inCol + inGOffset] / a;
+                p[2] = src_pixels[inCol + inBOffset] / a;
             }
-            dst_pixels[outCol + outROffset] = fromColorSpaceFloatToLinearFloat(rf) * a;
-            dst_pixels[outCol + outGOffset] = fromColorSpaceFloatToLinearFloat(gf) * a;
-            dst_pixels[outCol + outBOffset] = fromColorSpaceFloatToLinearFloat(bf) * a;
+        }
+        interpolateRow(fromFunc_hipart_to_float, &rgb[0], width * 3, &rgb[0]);
+        for (int x = rect.x1; x < rect.x2; ++x) {
+            int outCol = x * outPackingSize;
+            float a = (inputHasAlpha && premult) ? src_pixels[x * inPackingSize + inAOffset] : 1.f;
+            const float* p = &rgb[(x - rect.x1) * 3];
+            dst_pixels[outCol + outROffset] = p[0] * a;
+            dst_pixels[outCol + outGOffset] = p[1] * a;
+            dst_pixels[outCol + outBOffset] = p[2] * a;
             if (outputHasAlpha) {
                 // alpha is linear
                 dst_pixels[outCol + outAOffset] = a;
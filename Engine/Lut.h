@@ -33,6 +33,7 @@
 #include "Global/Macros.h"
 
 #include <cmath>
+#include <cassert>
 #include <map>
 #include <string>
 
@@ -132,8 +133,10 @@ class Lut
 
     /// the fast lookup tables are mutable, because they are automatically initialized post-construction,
     /// and never change afterwards
-    mutable unsigned short toFunc_hipart_to_uint8xx[0x10000];         /// contains  2^16 = 65536 values between 0-255
+    mutable unsigned short toFunc_hipart_to_uint8xx[0x10001];         /// contains  2^16 = 65536 values between 0-255, the last one is padding for the vectorized lookups
     mutable float fromFunc_uint8_to_float[256];         /// values between 0-1.f
+    mutable float toFunc_hipart_to_float[0x10001];         /// toFunc of the floats whose 16 least significant bits are 0, for the interpolation
+    mutable float fromFunc_hipart_to_float[0x10001];         /// fromFunc of the floats whose 16 least significant bits are 0, for the interpolation
     mutable bool init_;         ///< false if the tables are not yet initialized
     mutable QMutex _lock;         ///< protects init_
 
@@ -192,12 +195,18 @@ public:
         return _name;
     }
 
-    /* @brief Converts a float ranging in [0 - 1.f] in linear color-space using the look-up tables.
-     * @return A float in [0 - 1.f] in the destination color-space.
+    /* @brief Converts a float in linear color-space using the look-up tables.
+     * @return A float in the destination color-space.
+     * The function is interpolated linearly between the floats whose 16 least significant bits are 0: the relative error
+     * is in the order of 1e-5 for the built-in color-spaces, more next to the discontinuities of piecewise functions.
+     */
+    float toColorSpaceFloatFromLinearFloatFast(float v) const;
+
+    /* @brief Converts a float in the destination color-space to linear color-space using the look-up tables.
+     * @return A float in linear color-space.
+     * @see toColorSpaceFloatFromLinearFloatFast(float)
      */
-    // It is not recommended to use this function, because the output is quantized
-    // If one really needs float, one has to use the full function (or OpenColorIO)
-    //float toColorSpaceFloatFromLinearFloatFast(float v) const;
+    float fromColorSpaceFloatToLinearFloatFast(float v) const;
 
     /* @brief Converts a float ranging in [0 - 1.f] in linear color-space using the look-up tables.
      * @return A byte in [0 - 255] in the destination color-space.
@@ -209,6 +218,16 @@ public:
      */
     unsigned short toColorSpaceUint8xxFromLinearFloatFast(float v) const;
 
+    /* @brief Returns the table used by toColorSpaceUint8xxFromLinearFloatFast(), indexed by the 16 most significant bits of
+     * the float. This is for the vectorized conversions which compute the indices themselves.
+     */
+    const unsigned short* getUint8xxTable() const
+    {
+        assert(init_);
+
+        return toFunc_hipart_to_uint8xx;
+    }
+
     /* @brief Converts a float ranging in [0 - 1.f] in linear color-space using the look-up tables.
      * @return An unsigned short in [0 - 65535] in the destination color-space.
      * This function uses localluy linear approximations of the transfer function.
@@ -226,12 +245,13 @@ public:
     float fromColorSpaceUint16ToLinearFloatFast(unsigned short v) const;
 
 
-    /////@TODO the following functions expects a float input buffer, one could extend it to cover all bitdepths.
+    /////the following functions expects a float input buffer.
+    /////They use the look-up tables, through SSE4.1 or AVX2 kernels if the CPU has them (@see getSimdLevel()).
 
     /**
      * @brief Convert an array of linear floating point pixel values to an
      * array of destination lut values, with error diffusion to avoid posterizing
-     * artifacts.
+     * artifacts for the bytes. Shorts and floats are not dithered.
      *
      * \a W is the number of pixels to convert.
      * \a inDelta is the distance between the input elements
@@ -243,10 +263,10 @@ public:
      * \a alpha is a pointer to an extra alpha planar buffer if you want to premultiply by alpha the from channel.
      * The input and output buffers must not overlap in memory.
      **/
-    //void to_byte_planar(unsigned char* to, const float* from,int W,const float* alpha = NULL,
-    //                    int inDelta = 1, int outDelta = 1) const;
-    //void to_short_planar(unsigned short* to, const float* from,int W,const float* alpha = NULL,
-    //                     int inDelta = 1, int outDelta = 1) const;
+    void to_byte_planar(unsigned char* to, const float* from,int W,const float* alpha = NULL,
+                        int inDelta = 1, int outDelta = 1) const;
+    void to_short_planar(unsigned short* to, const float* from,int W,const float* alpha = NULL,
+                         int inDelta = 1, int outDelta = 1) const;
     void to_float_planar(float* to, const float* from,int W,const float* alpha = NULL,
                          int inDelta = 1, int outDelta = 1) const;
 
@@ -279,15 +299,15 @@ public:
     void to_byte_packed(unsigned char* to, const float* from,const RectI & conversionRect,
                         const RectI & srcRoD,const RectI & dstRoD,
                         PixelPackingEnum inputPacking,PixelPackingEnum outputPacking,bool invertY,bool premult) const; // used by QtWriter
-    //void to_short_packed(unsigned short* to, const float* from,const RectI & conversionRect,
-    //                     const RectI & srcRoD,const RectI & dstRoD,
-    //                     PixelPackingEnum inputPacking,PixelPackingEnum outputPacking,bool invertY,bool premult) const;
+    void to_short_packed(unsigned short* to, const float* from,const RectI & conversionRect,
+                         const RectI & srcRoD,const RectI & dstRoD,
+                         PixelPackingEnum inputPacking,PixelPackingEnum outputPacking,bool invertY,bool premult) const;
     void to_float_packed(float* to, const float* from,const RectI & conversionRect,
                          const RectI & srcRoD,const RectI & dstRoD,
                          PixelPackingEnum inputPacking,PixelPackingEnum outputPacking,bool invertY,bool premult) const;
 
 
-    /////@TODO the following functions expects a float output buffer, one could extend it to cover all bitdepths.
+    /////the following functions expects a float output buffer. They use the look-up tables like the to_X functions.
 
     /**
      * @brief Convert from a buffer in the input color-space to the output color-space.
@@ -0,0 +1,357 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "MemoryPool.h"
+
+#include <map>
+#include <vector>
+#include <cstdlib>
+#include <cassert>
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <malloc.h> // _aligned_malloc
+#else
+#include <sys/mman.h> // madvise
+#endif
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/atomic.hpp>
+#endif
+
+#include <QtCore/QMutex>
+#include <QtCore/QThreadStorage>
+
+#define kMemoryPoolCacheLineSize 64
+#define kMemoryPoolPageSize 4096
+#define kMemoryPoolHugePageSize (2 * 1024 * 1024)
+
+///Blocks larger than this are allocated exactly and given back to the system as soon as they are freed
+#define kMemoryPoolMaxPooledBlockSize ( (std::size_t)512 * 1024 * 1024 )
+
+///Each thread keeps up to kMemoryPoolThreadCacheBlocksPerClass blocks of each size up to kMemoryPoolMaxThreadCachedBlockSize,
+///for at most kMemoryPoolMaxThreadCacheSize bytes
+#define kMemoryPoolMaxThreadCachedBlockSize (1024 * 1024)
+#define kMemoryPoolThreadCacheBlocksPerClass 4
+#define kMemoryPoolMaxThreadCacheSize (8 * 1024 * 1024)
+
+///Default value of MemoryPool::setMaximumRetainedSize
+#define kMemoryPoolDefaultMaxRetainedSize ( (std::size_t)256 * 1024 * 1024 )
+
+NATRON_NAMESPACE_ENTER;
+
+namespace {
+
+typedef std::map<std::size_t, std::vector<void*> > FreeBlocksMap;
+
+struct MemoryPoolData
+{
+    QMutex lock; //< protects freeBlocks and retainedBytes
+    FreeBlocksMap freeBlocks; //< free blocks per block size
+    std::size_t retainedBytes; //< total size of freeBlocks
+    boost::atomic<std::size_t> maxRetainedBytes;
+    boost::atomic<bool> hugePagesEnabled;
+    boost::atomic<U64> reservedBytes;
+    boost::atomic<U64> usedBytes;
+    boost::atomic<U64> nAllocations;
+    boost::atomic<U64> nReused;
+
+    MemoryPoolData()
+        : lock()
+        , freeBlocks()
+        , retainedBytes(0)
+        , maxRetainedBytes(kMemoryPoolDefaultMaxRetainedSize)
+        , hugePagesEnabled(false)
+        , reservedBytes(0)
+        , usedBytes(0)
+        , nAllocations(0)
+        , nReused(0)
+    {
+    }
+};
+
+///The pool is never destroyed: blocks may still be freed by the destructors of static objects and of the threads' caches
+static MemoryPoolData&
+getPool()
+{
+    static MemoryPoolData* pool = new MemoryPoolData;
+
+    return *pool;
+}
+
+static void*
+systemAllocate(std::size_t blockSize,
+               bool hugePages)
+{
+    std::size_t alignment = kMemoryPoolCacheLineSize;
+
+    if ( hugePages && (blockSize >= kMemoryPoolHugePageSize) ) {
+        alignment = kMemoryPoolHugePageSize;
+    } else if (blockSize >= kMemoryPoolPageSize) {
+        alignment = kMemoryPoolPageSize;
+    }
+
+    void* ptr = 0;
+#if defined(_WIN32)
+    ptr = _aligned_malloc(blockSize, alignment);
+#else
+    if (posix_memalign(&ptr, alignment, blockSize) != 0) {
+        ptr = 0;
+    }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if ( ptr && (alignment == kMemoryPoolHugePageSize) ) {
+        // only a hint, the kernel may ignore it
+        madvise(ptr, blockSize, MADV_HUGEPAGE);
+    }
+#endif
+#endif
+
+    return ptr;
+}
+
+static void
+systemFree(void* ptr)
+{
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+static void
+releaseBlocks(MemoryPoolData & pool,
+              FreeBlocksMap & blocks)
+{
+    for (FreeBlocksMap::iterator it = blocks.begin(); it != blocks.end(); ++it) {
+        for (std::size_t i = 0; i < it->second.size(); ++i) {
+            systemFree(it->second[i]);
+            pool.reservedBytes.fetch_sub(it->first);
+        }
+    }
+    blocks.clear();
+}
+
+///Puts a free block back in the pool, or gives it back to the system if the pool retains too much memory already
+static void
+returnBlockToPool(MemoryPoolData & pool,
+                  void* ptr,
+                  std::size_t blockSize)
+{
+    if (blockSize <= kMemoryPoolMaxPooledBlockSize) {
+        QMutexLocker k(&pool.lock);
+        if ( pool.retainedBytes + blockSize <= pool.maxRetainedBytes.load() ) {
+            pool.freeBlocks[blockSize].push_back(ptr);
+            pool.retainedBytes += blockSize;
+
+            return;
+        }
+    }
+    systemFree(ptr);
+    pool.reservedBytes.fetch_sub(blockSize);
+}
+
+struct ThreadCache
+{
+    FreeBlocksMap blocks;
+    std::size_t cachedBytes;
+
+    ThreadCache()
+        : blocks()
+        , cachedBytes(0)
+    {
+    }
+
+    ~ThreadCache()
+    {
+        MemoryPoolData & pool = getPool();
+
+        for (FreeBlocksMap::iterator it = blocks.begin(); it != blocks.end(); ++it) {
+            for (std::size_t i = 0; i < it->second.size(); ++i) {
+                returnBlockToPool(pool, it->second[i], it->first);
+            }
+        }
+    }
+};
+
+///Qt deletes the cache of a thread when the thread exits, which hands its blocks back to the pool
+static ThreadCache*
+getThreadCache()
+{
+    static QThreadStorage<ThreadCache*>* caches = new QThreadStorage<ThreadCache*>;
+
+    if ( !caches->hasLocalData() ) {
+        caches->setLocalData(new ThreadCache);
+    }
+
+    return caches->localData();
+}
+} // anon namespace
+
+std::size_t
+MemoryPool::getBlockSize(std::size_t nBytes)
+{
+    if (nBytes <= kMemoryPoolCacheLineSize) {
+        return kMemoryPoolCacheLineSize;
+    }
+    if (nBytes > kMemoryPoolMaxPooledBlockSize) {
+        return ( (nBytes + kMemoryPoolPageSize - 1) / kMemoryPoolPageSize ) * kMemoryPoolPageSize;
+    }
+
+    // p is the largest power of 2 below nBytes, the classes between p and 2p are 8 steps apart
+    std::size_t p = kMemoryPoolCacheLineSize;
+    while (p * 2 < nBytes) {
+        p *= 2;
+    }
+    std::size_t step = std::max( (std::size_t)kMemoryPoolCacheLineSize, p / 8 );
+
+    return ( (nBytes + step - 1) / step ) * step;
+}
+
+void*
+MemoryPool::allocate(std::size_t nBytes)
+{
+    MemoryPoolData & pool = getPool();
+    std::size_t blockSize = getBlockSize(nBytes);
+    void* ptr = 0;
+
+    pool.nAllocations.fetch_add(1);
+
+    if (blockSize <= kMemoryPoolMaxThreadCachedBlockSize) {
+        ThreadCache* cache = getThreadCache();
+        FreeBlocksMap::iterator found = cache->blocks.find(blockSize);
+        if ( ( found != cache->blocks.end() ) && !found->second.empty() ) {
+            ptr = found->second.back();
+            found->second.pop_back();
+            cache->cachedBytes -= blockSize;
+        }
+    }
+    if ( !ptr && (blockSize <= kMemoryPoolMaxPooledBlockSize) ) {
+        QMutexLocker k(&pool.lock);
+        FreeBlocksMap::iterator found = pool.freeBlocks.find(blockSize);
+        if ( ( found != pool.freeBlocks.end() ) && !found->second.empty() ) {
+            ptr = found->second.back();
+            found->second.pop_back();
+            pool.retainedBytes -= blockSize;
+        }
+    }
+
+    if (ptr) {
+        pool.nReused.fetch_add(1);
+    } else {
+        bool hugePages = pool.hugePagesEnabled.load();
+        ptr = systemAllocate(blockSize, hugePages);
+        if (!ptr) {
+            // the free blocks of other sizes may be enough to satisfy the allocation
+            trim();
+            ptr = systemAllocate(blockSize, hugePages);
+            if (!ptr) {
+                return 0;
+            }
+        }
+        pool.reservedBytes.fetch_add(blockSize);
+    }
+    pool.usedBytes.fetch_add(nBytes);
+
+    return ptr;
+} // MemoryPool::allocate
+
+void
+MemoryPool::deallocate(void* ptr,
+                       std::size_t nBytes)
+{
+    if (!ptr) {
+        return;
+    }
+
+    MemoryPoolData & pool = getPool();
+    std::size_t blockSize = getBlockSize(nBytes);
+
+    pool.usedBytes.fetch_sub(nBytes);
+
+    if (blockSize <= kMemoryPoolMaxThreadCachedBlockSize) {
+        ThreadCache* cache = getThreadCache();
+        std::vector<void*> & blocks = cache->blocks[blockSize];
+        if ( (blocks.size() < kMemoryPoolThreadCacheBlocksPerClass) &&
+             (cache->cachedBytes + blockSize <= kMemoryPoolMaxThreadCacheSize) ) {
+            blocks.push_back(ptr);
+            cache->cachedBytes += blockSize;
+
+            return;
+        }
+    }
+    returnBlockToPool(pool, ptr, blockSize);
+}
+
+void
+MemoryPool::setMaximumRetainedSize(std::size_t nBytes)
+{
+    MemoryPoolData & pool = getPool();
+
+    pool.maxRetainedBytes.store(nBytes);
+
+    // Give back the blocks beyond the new limit, largest first
+    QMutexLocker k(&pool.lock);
+    for (FreeBlocksMap::reverse_iterator it = pool.freeBlocks.rbegin(); it != pool.freeBlocks.rend() && pool.retainedBytes > nBytes; ++it) {
+        while ( !it->second.empty() && (pool.retainedBytes > nBytes) ) {
+            systemFree( it->second.back() );
+            it->second.pop_back();
+            pool.retainedBytes -= it->first;
+            pool.reservedBytes.fetch_sub(it->first);
+        }
+    }
+}
+
+void
+MemoryPool::setHugePagesEnabled(bool enabled)
+{
+    getPool().hugePagesEnabled.store(enabled);
+}
+
+void
+MemoryPool::trim()
+{
+    MemoryPoolData & pool = getPool();
+    ThreadCache* cache = getThreadCache();
+
+    releaseBlocks(pool, cache->blocks);
+    cache->cachedBytes = 0;
+
+    QMutexLocker k(&pool.lock);
+    releaseBlocks(pool, pool.freeBlocks);
+    pool.retainedBytes = 0;
+}
+
+void
+MemoryPool::getStats(MemoryPoolStats* stats)
+{
+    MemoryPoolData & pool = getPool();
+
+    stats->reservedBytes = pool.reservedBytes.load();
+    stats->usedBytes = pool.usedBytes.load();
+    stats->nAllocations = pool.nAllocations.load();
+    stats->nReused = pool.nReused.load();
+}
+
+NATRON_NAMESPACE_EXIT;
@@ -0,0 +1,104 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_MEMORYPOOL_H
+#define NATRON_ENGINE_MEMORYPOOL_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+
+#include "Global/GlobalDefines.h"
+
+NATRON_NAMESPACE_ENTER;
+
+struct MemoryPoolStats
+{
+    U64 reservedBytes; //< bytes obtained from the system, including the blocks kept for reuse
+    U64 usedBytes; //< bytes requested by the live allocations
+    U64 nAllocations; //< number of calls to allocate() since the application started
+    U64 nReused; //< number of those calls served by a block kept for reuse
+
+    MemoryPoolStats()
+        : reservedBytes(0)
+        , usedBytes(0)
+        , nAllocations(0)
+        , nReused(0)
+    {
+    }
+};
+
+/**
+ * @brief The allocator of the pixel buffers of the cache entries (see RamBuffer).
+ * Sizes are rounded up to a size class (8 classes per power of 2, so at most 12.5% is wasted) and freed blocks are
+ * kept in a free list per class to be handed out again, so that the images of a playback session, which mostly have
+ * the same few sizes, do not go through the system allocator and do not fragment the heap.
+ * Each thread keeps a few small blocks of its own to avoid taking the lock of the pool.
+ *
+ * Blocks are 64-byte aligned (a cache line, which is enough for aligned AVX-512 loads), blocks of a page or more are
+ * page aligned, and blocks of 2MB or more are aligned on 2MB and may be backed by transparent huge pages on Linux.
+ *
+ * All functions are thread-safe.
+ **/
+class MemoryPool
+{
+public:
+
+    /**
+     * @brief Returns a block of at least nBytes, or NULL if the system is out of memory.
+     **/
+    static void* allocate(std::size_t nBytes);
+
+    /**
+     * @brief Gives back a block returned by allocate(nBytes): nBytes must be the size given to allocate().
+     **/
+    static void deallocate(void* ptr, std::size_t nBytes);
+
+    /**
+     * @brief Returns the size of the block actually reserved for an allocation of nBytes
+     **/
+    static std::size_t getBlockSize(std::size_t nBytes);
+
+    /**
+     * @brief The free blocks beyond this size in bytes are given back to the system
+     **/
+    static void setMaximumRetainedSize(std::size_t nBytes);
+
+    /**
+     * @brief If true, blocks of 2MB or more are advised to be backed by huge pages. Only effective on Linux with
+     * transparent huge pages set to "madvise" or "always".
+     **/
+    static void setHugePagesEnabled(bool enabled);
+
+    /**
+     * @brief Gives back to the system all the free blocks of the pool and of the calling thread
+     **/
+    static void trim();
+
+    static void getStats(MemoryPoolStats* stats);
+};
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_MEMORYPOOL_H
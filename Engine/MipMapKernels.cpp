@@ -0,0 +1,440 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+
+#include "MipMapKernels.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstring> // memcpy
+#include <cassert>
+
+#include "Engine/SimdSupport.h"
+
+#ifdef NATRON_SIMD_X86
+#include <immintrin.h>
+#endif
+
+NATRON_NAMESPACE_ENTER;
+
+namespace {
+
+/// Halves the source pixels covered by the destination pixel x, the same way as the former Image::halveRoIForDepth loop
+template <typename PIX>
+inline void
+halvePixel(int nComps,
+           const PIX* row0,
+           const PIX* row1,
+           int srcX1,
+           int srcX2,
+           int x,
+           PIX* dstPix)
+{
+    // The destination pixel x covers the source columns 2x (thisCol) and 2x+1 (nextCol)
+    int srcx = x * 2;
+    bool pickThisCol = srcX1 <= srcx && srcx < srcX2;
+    bool pickNextCol = srcX1 <= (srcx + 1) && (srcx + 1) < srcX2;
+    int sumW = (int)pickThisCol + (int)pickNextCol;
+    int sumH = (int)(row0 != 0) + (int)(row1 != 0);
+    const int sum = sumW * sumH;
+
+    if (sum == 0) {
+        for (int k = 0; k < nComps; ++k) {
+            dstPix[k] = 0;
+        }
+
+        return;
+    }
+
+    const PIX* thisCol0 = row0 ? row0 + (srcx - srcX1) * nComps : 0;
+    const PIX* thisCol1 = row1 ? row1 + (srcx - srcX1) * nComps : 0;
+    for (int k = 0; k < nComps; ++k) {
+        ///a b
+        ///c d
+        const PIX a = (pickThisCol && row0) ? thisCol0[k] : 0;
+        const PIX b = (pickNextCol && row0) ? thisCol0[k + nComps] : 0;
+        const PIX c = (pickThisCol && row1) ? thisCol1[k] : 0;
+        const PIX d = (pickNextCol && row1) ? thisCol1[k + nComps] : 0;
+
+        dstPix[k] = (a + b + c + d) / sum;
+    }
+}
+
+#ifdef NATRON_SIMD_X86
+
+/**
+ * @brief Loads 4 components in the 32-bit lanes of a vector, floats or integers, and stores the sum of 4 pixels divided
+ * by 4. The integer lanes are reinterpreted as floats so that the same shuffles apply to all the depths.
+ **/
+template <typename PIX>
+struct HalveSSE41;
+
+template <>
+struct HalveSSE41<float>
+{
+    NATRON_SIMD_TARGET_SSE41
+    static inline __m128 load(const float* p)
+    {
+        return _mm_loadu_ps(p);
+    }
+
+    NATRON_SIMD_TARGET_SSE41
+    static inline __m128 add(__m128 a,
+                             __m128 b)
+    {
+        return _mm_add_ps(a, b);
+    }
+
+    NATRON_SIMD_TARGET_SSE41
+    static inline void store(float* p,
+                             __m128 sum)
+    {
+        // multiplying by 0.25 is exactly the same as dividing by 4
+        _mm_storeu_ps( p, _mm_mul_ps( sum, _mm_set1_ps(0.25f) ) );
+    }
+};
+
+template <>
+struct HalveSSE41<unsigned short>
+{
+    NATRON_SIMD_TARGET_SSE41
+    static inline __m128 load(const unsigned short* p)
+    {
+        return _mm_castsi128_ps( _mm_cvtepu16_epi32( _mm_loadl_epi64( (const __m128i*)p ) ) );
+    }
+
+    NATRON_SIMD_TARGET_SSE41
+    static inline __m128 add(__m128 a,
+                             __m128 b)
+    {
+        return _mm_castsi128_ps( _mm_add_epi32( _mm_castps_si128(a), _mm_castps_si128(b) ) );
+    }
+
+    NATRON_SIMD_TARGET_SSE41
+    static inline void store(unsigned short* p,
+                             __m128 sum)
+    {
+        __m128i v = _mm_srli_epi32(_mm_castps_si128(sum), 2);
+        _mm_storel_epi64( (__m128i*)p, _mm_packus_epi32(v, v) );
+    }
+};
+
+template <>
+struct HalveSSE41<unsigned char>
+{
+    NATRON_SIMD_TARGET_SSE41
+    static inline __m128 load(const unsigned char* p)
+    {
+        int v;
+        std::memcpy( &v, p, sizeof(v) );
+
+        return _mm_castsi128_ps( _mm_cvtepu8_epi32( _mm_cvtsi32_si128(v) ) );
+    }
+
+    NATRON_SIMD_TARGET_SSE41
+    static inline __m128 add(__m128 a,
+                             __m128 b)
+    {
+        return _mm_castsi128_ps( _mm_add_epi32( _mm_castps_si128(a), _mm_castps_si128(b) ) );
+    }
+
+    NATRON_SIMD_TARGET_SSE41
+    static inline void store(unsigned char* p,
+                             __m128 sum)
+    {
+        __m128i v = _mm_srli_epi32(_mm_castps_si128(sum), 2);
+        v = _mm_packus_epi32(v, v);
+        v = _mm_packus_epi16(v, v);
+        int r = _mm_cvtsi128_si32(v);
+        std::memcpy( p, &r, sizeof(r) );
+    }
+};
+
+/**
+ * @brief Halves the width destination pixels of which the 4 source pixels exist, row0 and row1 pointing to the source
+ * pixel of the first one. The pixels are split in the even (a, c) and odd (b, d) source columns which are summed in the
+ * same order as halvePixel. Returns the number of pixels done, the remaining ones are left to halvePixel.
+ **/
+template <typename PIX>
+NATRON_SIMD_TARGET_SSE41
+int
+halveRowSSE41(int nComps,
+              const PIX* row0,
+              const PIX* row1,
+              PIX* dst,
+              int width)
+{
+    typedef HalveSSE41<PIX> T;
+    int x = 0;
+
+    switch (nComps) {
+    case 1:
+        // 4 pixels per iteration
+        for (; x + 4 <= width; x += 4) {
+            __m128 lo0 = T::load(row0 + 2 * x);
+            __m128 hi0 = T::load(row0 + 2 * x + 4);
+            __m128 lo1 = T::load(row1 + 2 * x);
+            __m128 hi1 = T::load(row1 + 2 * x + 4);
+            __m128 a = _mm_shuffle_ps( lo0, hi0, _MM_SHUFFLE(2, 0, 2, 0) );
+            __m128 b = _mm_shuffle_ps( lo0, hi0, _MM_SHUFFLE(3, 1, 3, 1) );
+            __m128 c = _mm_shuffle_ps( lo1, hi1, _MM_SHUFFLE(2, 0, 2, 0) );
+            __m128 d = _mm_shuffle_ps( lo1, hi1, _MM_SHUFFLE(3, 1, 3, 1) );
+            T::store( dst + x, T::add( T::add( T::add(a, b), c ), d ) );
+        }
+        break;
+    case 2:
+        // 2 pixels per iteration
+        for (; x + 2 <= width; x += 2) {
+            __m128 lo0 = T::load(row0 + 4 * x);
+            __m128 hi0 = T::load(row0 + 4 * x + 4);
+            __m128 lo1 = T::load(row1 + 4 * x);
+            __m128 hi1 = T::load(row1 + 4 * x + 4);
+            __m128 a = _mm_shuffle_ps( lo0, hi0, _MM_SHUFFLE(1, 0, 1, 0) );
+            __m128 b = _mm_shuffle_ps( lo0, hi0, _MM_SHUFFLE(3, 2, 3, 2) );
+            __m128 c = _mm_shuffle_ps( lo1, hi1, _MM_SHUFFLE(1, 0, 1, 0) );
+            __m128 d = _mm_shuffle_ps( lo1, hi1, _MM_SHUFFLE(3, 2, 3, 2) );
+            T::store( dst + 2 * x, T::add( T::add( T::add(a, b), c ), d ) );
+        }
+        break;
+    case 3:
+        // 1 pixel per iteration, loading and storing 4 components: the 4th one belongs to the next pixel, which is
+        // overwritten by the next iteration. The last pixel is left to halvePixel so as not to go past the rows.
+        for (; x + 1 < width; ++x) {
+            __m128 a = T::load(row0 + 6 * x);
+            __m128 b = T::load(row0 + 6 * x + 3);
+            __m128 c = T::load(row1 + 6 * x);
+            __m128 d = T::load(row1 + 6 * x + 3);
+            T::store( dst + 3 * x, T::add( T::add( T::add(a, b), c ), d ) );
+        }
+        break;
+    case 4:
+        // 1 pixel per iteration
+        for (; x < width; ++x) {
+            __m128 a = T::load(row0 + 8 * x);
+            __m128 b = T::load(row0 + 8 * x + 4);
+            __m128 c = T::load(row1 + 8 * x);
+            __m128 d = T::load(row1 + 8 * x + 4);
+            T::store( dst + 4 * x, T::add( T::add( T::add(a, b), c ), d ) );
+        }
+        break;
+    default:
+        break;
+    }
+
+    return x;
+} // halveRowSSE41
+
+#endif // NATRON_SIMD_X86
+
+/// The row y of the level k of MipMapKernels::buildMipMapLevel: in the source for the level 0, in the rows kept otherwise
+template <typename PIX>
+inline const PIX*
+getLevelRow(unsigned int k,
+            int y,
+            const PIX* src,
+            int srcRowElements,
+            const RectI & srcBounds,
+            const std::vector<std::vector<PIX> > & rows)
+{
+    if (k == 0) {
+        return src + (y - srcBounds.y1) * srcRowElements;
+    }
+
+    return &rows[2 * k + (y & 1)][0];
+}
+
+/// floor(x / scale) for a positive scale
+inline int
+floorDiv(int x,
+         int scale)
+{
+    return x >= 0 ? x / scale : -( (-x + scale - 1) / scale );
+}
+
+template <typename PIX, int nComps>
+void
+upscaleRowForComps(const PIX* src,
+                   int srcX1,
+                   PIX* dst,
+                   int dstX1,
+                   int dstX2,
+                   int scale)
+{
+    int x = dstX1;
+
+    while (x < dstX2) {
+        // the destination may start a bit before the upscaled source because of rounding, repeat the first pixel then
+        int srcx = std::max( srcX1, floorDiv(x, scale) );
+        int end = std::min(dstX2, (srcx + 1) * scale);
+        const PIX* srcPix = src + (srcx - srcX1) * nComps;
+        for (; x < end; ++x, dst += nComps) {
+            for (int c = 0; c < nComps; ++c) {
+                dst[c] = srcPix[c];
+            }
+        }
+    }
+}
+} // anon namespace
+
+namespace MipMapKernels {
+
+template <typename PIX>
+void
+halveRow(int nComps,
+         const PIX* row0,
+         const PIX* row1,
+         int srcX1,
+         int srcX2,
+         PIX* dst,
+         int dstX1,
+         int dstX2)
+{
+    assert(row0 || row1);
+    int x = dstX1;
+
+#ifdef NATRON_SIMD_X86
+    // The destination pixels of which the 4 source pixels exist
+    int x1 = std::max(dstX1, (srcX1 + 1) >> 1);
+    int x2 = std::min(dstX2, srcX2 >> 1);
+    if ( row0 && row1 && (x1 < x2) && (getSimdLevel() >= eSimdLevelSSE41) ) {
+        for (; x < x1; ++x) {
+            halvePixel(nComps, row0, row1, srcX1, srcX2, x, dst + (x - dstX1) * nComps);
+        }
+        int srcOffset = (2 * x - srcX1) * nComps;
+        x += halveRowSSE41<PIX>(nComps, row0 + srcOffset, row1 + srcOffset, dst + (x - dstX1) * nComps, x2 - x);
+    }
+#endif
+
+    for (; x < dstX2; ++x) {
+        halvePixel(nComps, row0, row1, srcX1, srcX2, x, dst + (x - dstX1) * nComps);
+    }
+}
+
+template <typename PIX>
+void
+buildMipMapLevel(int nComps,
+                 const PIX* src,
+                 int srcRowElements,
+                 const RectI & srcBounds,
+                 const RectI & roi,
+                 unsigned int levels,
+                 PIX* dst,
+                 int dstRowElements,
+                 const RectI & dstBounds)
+{
+    // The roi of each level
+    std::vector<RectI> rois(levels + 1);
+    if ( !roi.intersect(srcBounds, &rois[0]) ) {
+        return;
+    }
+    for (unsigned int k = 1; k <= levels; ++k) {
+        rois[k] = rois[k - 1].downscalePowerOfTwoSmallestEnclosing(1);
+    }
+    const RectI & last = rois[levels];
+    assert( dstBounds.contains(last) );
+
+    PIX* const dstData = dst + (last.y1 - dstBounds.y1) * dstRowElements + (last.x1 - dstBounds.x1) * nComps;
+    if (levels == 0) {
+        for (int y = last.y1; y < last.y2; ++y) {
+            const PIX* srcRow = src + (y - srcBounds.y1) * srcRowElements + (last.x1 - srcBounds.x1) * nComps;
+            std::copy( srcRow, srcRow + last.width() * nComps, dstData + (y - last.y1) * dstRowElements );
+        }
+
+        return;
+    }
+
+    // The rows of the first level are read in the source, where they may extend beyond the roi
+    RectI srcRows = srcBounds;
+    srcRows.y1 = std::max(srcBounds.y1, 2 * rois[1].y1);
+    srcRows.y2 = std::min(srcBounds.y2, 2 * rois[1].y2);
+
+    // The last 2 rows of the intermediate levels 1 to levels - 1, row y of level k is rows[2 * k + (y & 1)]
+    std::vector<std::vector<PIX> > rows(2 * levels);
+    for (unsigned int k = 1; k < levels; ++k) {
+        rows[2 * k].resize(rois[k].width() * nComps);
+        rows[2 * k + 1].resize(rois[k].width() * nComps);
+    }
+
+    for (int y = srcRows.y1; y < srcRows.y2; ++y) {
+        // Push the row y of the source down the levels as long as it completes a pair of rows
+        unsigned int k = 0;
+        int ky = y;
+        while (k < levels) {
+            const RectI & from = (k == 0) ? srcRows : rois[k];
+            if ( !(ky & 1) && (ky != from.y2 - 1) ) {
+                // wait for the next row
+                break;
+            }
+            int dy = ky >> 1;
+            const PIX* row0 = (2 * dy >= from.y1) ? getLevelRow(k, 2 * dy, src, srcRowElements, srcBounds, rows) : NULL;
+            const PIX* row1 = (2 * dy + 1 < from.y2) ? getLevelRow(k, 2 * dy + 1, src, srcRowElements, srcBounds, rows) : NULL;
+            PIX* out = (k + 1 == levels) ? dstData + (dy - last.y1) * dstRowElements : &rows[2 * (k + 1) + (dy & 1)][0];
+            halveRow<PIX>(nComps, row0, row1, from.x1, from.x2, out, rois[k + 1].x1, rois[k + 1].x2);
+            ++k;
+            ky = dy;
+        }
+    }
+} // buildMipMapLevel
+
+template <typename PIX>
+void
+upscaleRow(int nComps,
+           const PIX* src,
+           int srcX1,
+           PIX* dst,
+           int dstX1,
+           int dstX2,
+           int scale)
+{
+    assert(scale > 0);
+    switch (nComps) {
+    case 1:
+        upscaleRowForComps<PIX, 1>(src, srcX1, dst, dstX1, dstX2, scale);
+        break;
+    case 2:
+        upscaleRowForComps<PIX, 2>(src, srcX1, dst, dstX1, dstX2, scale);
+        break;
+    case 3:
+        upscaleRowForComps<PIX, 3>(src, srcX1, dst, dstX1, dstX2, scale);
+        break;
+    case 4:
+        upscaleRowForComps<PIX, 4>(src, srcX1, dst, dstX1, dstX2, scale);
+        break;
+    default:
+        break;
+    }
+}
+
+template void halveRow<unsigned char>(int, const unsigned char*, const unsigned char*, int, int, unsigned char*, int, int);
+template void halveRow<unsigned short>(int, const unsigned short*, const unsigned short*, int, int, unsigned short*, int, int);
+template void halveRow<float>(int, const float*, const float*, int, int, float*, int, int);
+template void buildMipMapLevel<unsigned char>(int, const unsigned char*, int, const RectI &, const RectI &, unsigned int, unsigned char*, int, const RectI &);
+template void buildMipMapLevel<unsigned short>(int, const unsigned short*, int, const RectI &, const RectI &, unsigned int, unsigned short*, int, const RectI &);
+template void buildMipMapLevel<float>(int, const float*, int, const RectI &, const RectI &, unsigned int, float*, int, const RectI &);
+template void upscaleRow<unsigned char>(int, const unsigned char*, int, unsigned char*, int, int, int);
+template void upscaleRow<unsigned short>(int, const unsigned short*, int, unsigned short*, int, int, int);
+template void upscaleRow<float>(int, const float*, int, float*, int, int, int);
+} // namespace MipMapKernels
+
+NATRON_NAMESPACE_EXIT;
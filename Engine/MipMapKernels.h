@@ -0,0 +1,95 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_MIPMAPKERNELS_H
+#define NATRON_ENGINE_MIPMAPKERNELS_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include "Engine/RectI.h"
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief The kernels building the mipmap levels of images, on raw rows of unsigned char, unsigned short or float pixels
+ * of 1 to 4 components. The 2x2 box filter gives exactly the same result as the per-pixel loop it replaces: a destination
+ * pixel at (x,y) is the average of the source pixels (2x,2y), (2x+1,2y), (2x,2y+1) and (2x+1,2y+1) that exist, the sum
+ * being divided by their count (an integer division for integer pixels). The SSE4.1 implementation is selected at runtime
+ * (@see getSimdLevel()).
+ **/
+namespace MipMapKernels {
+
+/**
+ * @brief Halves the source rows row0 (at y = 2 * dstY) and row1 (at y = 2 * dstY + 1) into the pixels [dstX1, dstX2) of dst.
+ * The source rows hold the pixels [srcX1, srcX2) and point to the pixel at srcX1, dst points to the pixel at dstX1.
+ * row0 or row1 is NULL if that row does not exist, but not both.
+ **/
+template <typename PIX>
+void halveRow(int nComps,
+              const PIX* row0,
+              const PIX* row1,
+              int srcX1,
+              int srcX2,
+              PIX* dst,
+              int dstX1,
+              int dstX2);
+
+/**
+ * @brief Builds the mipmap level of the roi of the source, levels levels below it, in a single pass over the source rows:
+ * only the two last rows of each intermediate level are kept. The result is the same as halving the roi and then the
+ * intermediate levels one after another, each level covering roi.downscalePowerOfTwoSmallestEnclosing(level).
+ * The first level reads the pixels of srcBounds around the roi as well.
+ *
+ * src points to the pixel at (srcBounds.x1, srcBounds.y1), dst to the pixel at (dstBounds.x1, dstBounds.y1): the rows of
+ * srcRowElements and dstRowElements elements go upwards. dstBounds must contain the last level.
+ **/
+template <typename PIX>
+void buildMipMapLevel(int nComps,
+                      const PIX* src,
+                      int srcRowElements,
+                      const RectI & srcBounds,
+                      const RectI & roi,
+                      unsigned int levels,
+                      PIX* dst,
+                      int dstRowElements,
+                      const RectI & dstBounds);
+
+/**
+ * @brief Replicates scale times each pixel of a source row to fill the pixels [dstX1, dstX2) of dst. The source row points
+ * to the pixel at srcX1 and dst to the pixel at dstX1. The destination pixel x is the source pixel floor(x / scale), or the
+ * pixel at srcX1 if that is before it.
+ **/
+template <typename PIX>
+void upscaleRow(int nComps,
+                const PIX* src,
+                int srcX1,
+                PIX* dst,
+                int dstX1,
+                int dstX2,
+                int scale);
+} // namespace MipMapKernels
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_MIPMAPKERNELS_H
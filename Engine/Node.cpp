@@ -29,6 +29,7 @@
 #include <algorithm> // min, max
 #include <bitset>
 #include <cassert>
+#include <cstring> // memcpy
 #include <stdexcept>
 
 #include <boost/scoped_ptr.hpp>
@@ -36,6 +37,9 @@
 #include <QtCore/QDebug>
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
 #include <QtCore/QWaitCondition>
 #include <QtCore/QTextStream>
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
@@ -50,6 +54,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/AppInstance.h"
 #include "Engine/AppManager.h"
 #include "Engine/Backdrop.h"
+#include "Engine/Curve.h"
 #include "Engine/DiskCacheNode.h"
 #include "Engine/Dot.h"
 #include "Engine/EffectInstance.h"
@@ -65,6 +70,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/LibraryBinary.h"
 #include "Engine/Log.h"
 #include "Engine/Lut.h"
+#include "Engine/MemoryPool.h"
 #include "Engine/NodeGroup.h"
 #include "Engine/NodeGuiI.h"
 #include "Engine/NodeSerialization.h"
@@ -244,6 +250,15 @@ struct Node::Implementation
     , renderInstancesSharedMutex(QMutex::Recursive)
     , knobsAge(0)
     , knobsAgeMutex()
+    , hash()
+    , hashDirty(false)
+    , hashInvalidationGeneration(0)
+    , hashInvalidationPass(0)
+    , hashComputationMutex()
+    , contentHashesMutex()
+    , contentHashes()
+    , contentHashesNodeHash(0)
+    , contentHashesSettingsHash(0)
     , masterNodeMutex()
     , masterNode()
     , nodeLinks()
@@ -437,8 +452,16 @@ struct Node::Implementation
     //only 1 clone can render at any time
     
     U64 knobsAge; //< the age of the knobs in this effect. It gets incremented every times the effect has its evaluate() function called.
-    mutable QReadWriteLock knobsAgeMutex; //< protects knobsAge and hash
-    Hash64 hash; //< recomputed everytime knobsAge is changed.
+    mutable QReadWriteLock knobsAgeMutex; //< protects knobsAge, hash, hashDirty and hashInvalidationGeneration
+    Hash64 hash; //< recomputed lazily by getHashValue() when hashDirty is set
+    bool hashDirty; //< set when the knobs age or the hash of a node upstream changed
+    U64 hashInvalidationGeneration; //< incremented every time hashDirty is set, so a recomputation concurrent to an invalidation does not clear it
+    U64 hashInvalidationPass; //< the last invalidation pass that visited this node, only accessed on the main thread
+    mutable QMutex hashComputationMutex; //< held while the hash is recomputed
+    mutable QMutex contentHashesMutex; //< protects contentHashes, contentHashesNodeHash and contentHashesSettingsHash
+    std::map<std::pair<double, int>, std::pair<bool, U64> > contentHashes; //< results of computeContentHash() per time and view, false if it failed
+    U64 contentHashesNodeHash; //< the node hash contentHashes were computed with
+    U64 contentHashesSettingsHash; //< the hash of the settings contentHashes were computed with
     
     mutable QMutex masterNodeMutex; //< protects masterNode and nodeLinks
     NodeWPtr masterNode; //< this points to the master when the node is a clone
@@ -1247,11 +1270,277 @@ Node::getChildrenMultiInstance(NodesList* children) const
 U64
 Node::getHashValue() const
 {
+    {
+        QReadLocker l(&_imp->knobsAgeMutex);
+        if (!_imp->hashDirty) {
+            return _imp->hash.value();
+        }
+    }
+
+    ///The node or one of its inputs changed since the hash was last computed: recompute it now that it is needed.
+    ///A single thread recomputes it, the others wait for its result
+    QMutexLocker k(&_imp->hashComputationMutex);
+    {
+        QReadLocker l(&_imp->knobsAgeMutex);
+        if (!_imp->hashDirty) {
+            return _imp->hash.value();
+        }
+    }
+    ignore_result( const_cast<Node*>(this)->computeHashInternal() );
+
     QReadLocker l(&_imp->knobsAgeMutex);
-    
+
     return _imp->hash.value();
 }
 
+///Above that many images (a node at a frame) upstream whose content hash is not known yet, the content hash is not
+///computed: walking such graphs on a look-up of the persistent image store would cost more than it saves
+#define NATRON_CONTENT_HASH_MAX_IMAGES 4096
+
+static void
+appendCurveToContentHash(const Curve & curve,
+                         Hash64* hash)
+{
+    KeyFrameSet keys = curve.getKeyFrames_mt_safe();
+
+    hash->append( (U64)keys.size() );
+    for (KeyFrameSet::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+        hash->append( it->getTime() );
+        hash->append( it->getValue() );
+        hash->append( it->getLeftDerivative() );
+        hash->append( it->getRightDerivative() );
+        hash->append( (int)it->getInterpolation() );
+    }
+}
+
+static void
+appendKnobsToContentHash(const std::vector<KnobPtr> & knobs,
+                         double time,
+                         ViewIdx view,
+                         Project* project,
+                         Hash64* hash)
+{
+    for (std::vector<KnobPtr>::const_iterator it = knobs.begin(); it != knobs.end(); ++it) {
+        KnobI* knob = it->get();
+        Knob<int>* isInt = dynamic_cast<Knob<int>*>(knob);
+        Knob<bool>* isBool = dynamic_cast<Knob<bool>*>(knob);
+        Knob<double>* isDouble = dynamic_cast<Knob<double>*>(knob);
+        Knob<std::string>* isString = dynamic_cast<Knob<std::string>*>(knob);
+        if ( (!isInt && !isBool && !isDouble && !isString) || !knob->getEvaluateOnChange() ) {
+            // pages, groups, buttons and separators have no value, the other knobs which do not trigger a render
+            // (e.g: the save date of the project) do not change the images
+            continue;
+        }
+        Hash64_appendQString( hash, QString::fromUtf8( knob->getName().c_str() ) );
+        int nDims = knob->getDimension();
+        for (int i = 0; i < nDims; ++i) {
+            ///The value at the time of the image, with the links and the expressions resolved...
+            if (isInt) {
+                hash->append( isInt->getValueAtTime(time, i, view) );
+            } else if (isBool) {
+                hash->append( isBool->getValueAtTime(time, i, view) );
+            } else if (isDouble) {
+                hash->append( isDouble->getValueAtTime(time, i, view) );
+            } else {
+                Hash64_appendQString( hash, QString::fromUtf8( isString->getValueAtTime(time, i, view).c_str() ) );
+            }
+            ///...and the animation, since an effect may read its parameters at other times
+            boost::shared_ptr<Curve> curve = knob->getCurve(view, i);
+            if (curve) {
+                appendCurveToContentHash(*curve, hash);
+            }
+        }
+        KnobParametric* isParametric = dynamic_cast<KnobParametric*>(knob);
+        if (isParametric) {
+            for (int i = 0; i < nDims; ++i) {
+                boost::shared_ptr<Curve> curve = isParametric->getParametricCurve(i);
+                if (curve) {
+                    appendCurveToContentHash(*curve, hash);
+                }
+            }
+        }
+        KnobFile* isFile = dynamic_cast<KnobFile*>(knob);
+        if (isFile) {
+            ///A file may be replaced on disk while the project does not change
+            std::string filename = isFile->getFileName( (int)std::floor(time + 0.5), view );
+            project->canonicalizePath(filename);
+            QFileInfo info( QString::fromUtf8( filename.c_str() ) );
+            bool exists = info.exists();
+            hash->append( exists ? info.size() : (qint64)-1 );
+            hash->append( exists ? info.lastModified().toMSecsSinceEpoch() : (qint64)0 );
+        }
+    }
+}
+
+namespace {
+///The hash of the OpenColorIO config, which is only read again when its file changes
+struct OCIOConfigHash
+{
+    QMutex lock;
+    QString filePath;
+    qint64 size;
+    qint64 lastModified;
+    U64 hash;
+
+    OCIOConfigHash()
+        : lock()
+        , filePath()
+        , size(-1)
+        , lastModified(0)
+        , hash(0)
+    {
+    }
+};
+
+OCIOConfigHash ocioConfigHash;
+} // anon namespace
+
+/**
+ * @brief Returns a hash of the settings which change the images without changing the node hash: the OpenColorIO config
+ * selected in the preferences, which is used by the OCIO plugins and the Readers and Writers, and its contents.
+ **/
+static U64
+getSettingsContentHash()
+{
+    QString filePath = QString::fromUtf8( qgetenv(NATRON_OCIO_ENV_VAR_NAME).constData() );
+    QFileInfo info(filePath);
+    bool exists = !filePath.isEmpty() && info.exists();
+    qint64 size = exists ? info.size() : -1;
+    qint64 lastModified = exists ? info.lastModified().toMSecsSinceEpoch() : 0;
+
+    QMutexLocker k(&ocioConfigHash.lock);
+    if ( (filePath == ocioConfigHash.filePath) && (size == ocioConfigHash.size) && (lastModified == ocioConfigHash.lastModified) ) {
+        return ocioConfigHash.hash;
+    }
+
+    Hash64 hash;
+    Hash64_appendQString(&hash, filePath);
+    if (exists) {
+        QFile file(filePath);
+        if ( file.open(QIODevice::ReadOnly) ) {
+            QByteArray contents = file.readAll();
+            const char* data = contents.constData();
+            int i = 0;
+            for (; i + 8 <= contents.size(); i += 8) {
+                U64 value;
+                std::memcpy(&value, data + i, sizeof(value));
+                hash.appendU64(value);
+            }
+            U64 last = 0;
+            for (int shift = 0; i < contents.size(); ++i, shift += 8) {
+                last |= (U64)(unsigned char)data[i] << shift;
+            }
+            hash.appendU64(last);
+            hash.append( (U64)contents.size() );
+        }
+    }
+    hash.computeHash();
+    ocioConfigHash.filePath = filePath;
+    ocioConfigHash.size = size;
+    ocioConfigHash.lastModified = lastModified;
+    ocioConfigHash.hash = hash.value();
+
+    return ocioConfigHash.hash;
+}
+
+bool
+Node::computeContentHashInternal(double time,
+                                 ViewIdx view,
+                                 U64 settingsHash,
+                                 int* nImagesLeft,
+                                 U64* contentHash)
+{
+    ///The content hash only changes with the node hash and the settings, except when a file read is replaced on disk
+    ///during the session, which the NodeCache does not notice either
+    U64 nodeHash = getHashValue();
+    std::pair<double, int> memoKey( time, (int)view );
+    {
+        QMutexLocker k(&_imp->contentHashesMutex);
+        if ( (_imp->contentHashesNodeHash != nodeHash) || (_imp->contentHashesSettingsHash != settingsHash) ) {
+            _imp->contentHashes.clear();
+            _imp->contentHashesNodeHash = nodeHash;
+            _imp->contentHashesSettingsHash = settingsHash;
+        }
+        std::map<std::pair<double, int>, std::pair<bool, U64> >::const_iterator found = _imp->contentHashes.find(memoKey);
+        if ( found != _imp->contentHashes.end() ) {
+            *contentHash = found->second.second;
+
+            return found->second.first;
+        }
+    }
+    if (*nImagesLeft <= 0) {
+        return false;
+    }
+    --*nImagesLeft;
+
+    bool ok = true;
+    Hash64 hash;
+    EffectInstPtr effect = getEffectInstance();
+    ///The Roto shapes and the paint strokes are not held by knobs, neither is the project of a PrecompNode
+    if ( !effect || getRotoContext() || getAttachedRotoItem() || dynamic_cast<PrecompNode*>( effect.get() ) ) {
+        ok = false;
+    } else {
+        hash.append( (U64)NATRON_VERSION_ENCODED );
+        Hash64_appendQString( &hash, QString::fromUtf8( getPluginID().c_str() ) );
+        hash.append( getMajorVersion() );
+        hash.append( getMinorVersion() );
+        effect->appendPluginVersionToHash(&hash);
+        hash.append(settingsHash);
+        hash.append(time);
+        hash.append( (int)view );
+
+        boost::shared_ptr<Project> project = getApp()->getProject();
+        appendKnobsToContentHash(project->getKnobs(), time, view, project.get(), &hash);
+        appendKnobsToContentHash(effect->getKnobs(), time, view, project.get(), &hash);
+
+        ///The inputs at the frames they are needed
+        FramesNeededMap framesNeeded = effect->getFramesNeeded_public(nodeHash, time, view, 0);
+        for (FramesNeededMap::const_iterator it = framesNeeded.begin(); ok && it != framesNeeded.end(); ++it) {
+            NodePtr input = getInput(it->first);
+            if (!input) {
+                continue;
+            }
+            hash.append(it->first);
+            for (FrameRangesMap::const_iterator it2 = it->second.begin(); ok && it2 != it->second.end(); ++it2) {
+                for (std::size_t i = 0; ok && i < it2->second.size(); ++i) {
+                    const RangeD & range = it2->second[i];
+                    for (double f = range.min; ok && f <= range.max; f += 1.) {
+                        U64 inputHash = 0;
+                        ok = input->computeContentHashInternal(f, it2->first, settingsHash, nImagesLeft, &inputHash);
+                        hash.append(inputHash);
+                    }
+                }
+            }
+        }
+    }
+
+    ///Failing because too many images were visited says nothing about the node: the next call goes further upstream
+    ///since the hashes computed meanwhile are remembered
+    if (!ok && *nImagesLeft <= 0) {
+        return false;
+    }
+    hash.computeHash();
+    *contentHash = ok ? hash.value() : 0;
+    {
+        QMutexLocker k(&_imp->contentHashesMutex);
+        if ( (_imp->contentHashesNodeHash == nodeHash) && (_imp->contentHashesSettingsHash == settingsHash) ) {
+            _imp->contentHashes[memoKey] = std::make_pair(ok, *contentHash);
+        }
+    }
+
+    return ok;
+} // Node::computeContentHashInternal
+
+bool
+Node::computeContentHash(double time,
+                         ViewIdx view,
+                         U64* hash)
+{
+    int nImagesLeft = NATRON_CONTENT_HASH_MAX_IMAGES;
+
+    return computeContentHashInternal(time, view, getSettingsContentHash(), &nImagesLeft, hash);
+}
+
 std::string
 Node::getCacheID() const
 {
@@ -1265,11 +1554,53 @@ Node::computeHashInternal()
     if (!_imp->effect) {
         return false;
     }
-    ///Always called in the main thread
-    assert( QThread::currentThread() == qApp->thread() );
     if (!_imp->inputsInitialized) {
         qDebug() << "Node::computeHash(): inputs not initialized";
     }
+
+    U64 generation;
+    {
+        QReadLocker l(&_imp->knobsAgeMutex);
+        generation = _imp->hashInvalidationGeneration;
+    }
+
+    ///Get the hash of all inputs first: they may have to be recomputed as well and we must not hold our lock meanwhile
+    std::vector<U64> inputsHash;
+    boost::shared_ptr<RotoDrawableItem> attachedStroke = _imp->paintStroke.lock();
+    NodePtr attachedStrokeContextNode;
+    if (attachedStroke) {
+        attachedStrokeContextNode = attachedStroke->getContext()->getNode();
+    }
+    {
+        ViewerInstance* isViewer = dynamic_cast<ViewerInstance*>(_imp->effect.get());
+        
+        if (isViewer) {
+            int activeInput[2];
+            isViewer->getActiveInputs(activeInput[0], activeInput[1]);
+            
+            for (int i = 0; i < 2; ++i) {
+                NodePtr input = getInput(activeInput[i]);
+                if (input) {
+                    inputsHash.push_back( input->getHashValue() );
+                }
+            }
+        } else {
+            for (U32 i = 0; i < _imp->inputs.size(); ++i) {
+                NodePtr input = getInput(i);
+                if (input) {
+                    
+                    //Since the rotopaint node is connected to the internal nodes of the tree, don't change their hash
+                    if (attachedStroke && input == attachedStrokeContextNode) {
+                        continue;
+                    }
+                    ///Add the index of the input to its hash.
+                    ///Explanation: if we didn't add this, just switching inputs would produce a similar
+                    ///hash.
+                    inputsHash.push_back(input->getHashValue() + i);
+                }
+            }
+        }
+    }
     
     U64 oldHash,newHash;
     {
@@ -1284,52 +1615,14 @@ Node::computeHashInternal()
         _imp->hash.append(_imp->knobsAge);
         
         ///append all inputs hash
-        boost::shared_ptr<RotoDrawableItem> attachedStroke = _imp->paintStroke.lock();
-        NodePtr attachedStrokeContextNode;
-        if (attachedStroke) {
-            attachedStrokeContextNode = attachedStroke->getContext()->getNode();
-        }
-        {
-            ViewerInstance* isViewer = dynamic_cast<ViewerInstance*>(_imp->effect.get());
-            
-            if (isViewer) {
-                int activeInput[2];
-                isViewer->getActiveInputs(activeInput[0], activeInput[1]);
-                
-                for (int i = 0; i < 2; ++i) {
-                    NodePtr input = getInput(activeInput[i]);
-                    if (input) {
-                        _imp->hash.append(input->getHashValue() );
-                    }
-                }
-            } else {
-                for (U32 i = 0; i < _imp->inputs.size(); ++i) {
-                    NodePtr input = getInput(i);
-                    if (input) {
-                        
-                        //Since the rotopaint node is connected to the internal nodes of the tree, don't change their hash
-                        if (attachedStroke && input == attachedStrokeContextNode) {
-                            continue;
-                        }
-                        ///Add the index of the input to its hash.
-                        ///Explanation: if we didn't add this, just switching inputs would produce a similar
-                        ///hash.
-                        _imp->hash.append(input->getHashValue() + i);
-                    }
-                }
-            }
+        for (std::size_t i = 0; i < inputsHash.size(); ++i) {
+            _imp->hash.append(inputsHash[i]);
         }
         
         // We do not append the roto age any longer since now every tool in the RotoContext is backed-up by nodes which
         // have their own age. Instead each action in the Rotocontext is followed by a incrementNodesAge() call so that each
         // node respecitively have their hash correctly set.
         
-        //        boost::shared_ptr<RotoContext> roto = attachedStroke ? attachedStroke->getContext() : getRotoContext();
-        //        if (roto) {
-        //            U64 rotoAge = roto->getAge();
-        //            _imp->hash.append(rotoAge);
-        //        }
-        
         ///Also append the effect's label to distinguish 2 instances with the same parameters
         Hash64_appendQString( &_imp->hash, QString( getScriptName().c_str() ) );
         
@@ -1341,82 +1634,96 @@ Node::computeHashInternal()
         _imp->hash.computeHash();
         
         newHash = _imp->hash.value();
+
+        ///If the node was invalidated again while computing, it must be recomputed on the next request
+        if (generation == _imp->hashInvalidationGeneration) {
+            _imp->hashDirty = false;
+        }
         
     } // QWriteLocker l(&_imp->knobsAgeMutex);
     
-    bool hashChanged = oldHash != newHash;
-
-    if (hashChanged) {
-        _imp->effect->onNodeHashChanged(newHash);
-        if (_imp->nodeCreated && !getApp()->getProject()->isProjectClosing()) {
-            /*
-             * We changed the node hash. That means all cache entries for this node with a different hash
-             * are impossible to re-create again. Just discard them all. This is done in a separate thread.
-             */
-            removeAllImagesFromCacheWithMatchingIDAndDifferentKey(newHash);
-        }
-    }
-
-    return hashChanged;
+    ///The caches were already invalidated by invalidateHashes() on the main thread
+    return oldHash != newHash;
 }
 
 
 void
-Node::computeHashRecursive(std::list<Node*>& marked)
+Node::invalidateHashes(const std::list<Node*>& nodes)
 {
-    if (std::find(marked.begin(), marked.end(), this) != marked.end()) {
-        return;
-    }
-    
-    bool hasChanged = computeHashInternal();
-    marked.push_back(this);
-    if (!hasChanged) {
-        //Nothing changed, no need to recurse on outputs
-        return;
-    }
-    
-    
-    bool isRotoPaint = _imp->effect->isRotoPaintNode();
-    
-    ///call it on all the outputs
-    NodesList outputs;
-    getOutputsWithGroupRedirection(outputs);
-    for (NodesList::iterator it = outputs.begin(); it != outputs.end(); ++it) {
-        assert(*it);
-        
-        //Since the rotopaint node is connected to the internal nodes of the tree, don't change their hash
-        boost::shared_ptr<RotoDrawableItem> attachedStroke = (*it)->getAttachedRotoItem();
-        if (isRotoPaint && attachedStroke && attachedStroke->getContext()->getNode().get() == this) {
+    ///Always called in the main thread
+    assert( QThread::currentThread() == qApp->thread() );
+
+    ///Each pass has its own number: a node was already visited by this pass if it holds the same number
+    static U64 invalidationPass = 0;
+    ++invalidationPass;
+
+    std::vector<Node*> toVisit( nodes.begin(), nodes.end() );
+    while ( !toVisit.empty() ) {
+        Node* node = toVisit.back();
+        toVisit.pop_back();
+        if (node->_imp->hashInvalidationPass == invalidationPass) {
             continue;
         }
-        (*it)->computeHashRecursive(marked);
-    }
-    
-    
-    ///If the node has a rotopaint tree, compute the hash of the nodes in the tree
-    if (_imp->rotoContext) {
-        NodesList allItems;
-        _imp->rotoContext->getRotoPaintTreeNodes(&allItems);
-        for (NodesList::iterator it = allItems.begin(); it!=allItems.end(); ++it) {
-            (*it)->computeHashRecursive(marked);
+        node->_imp->hashInvalidationPass = invalidationPass;
+        U64 oldHash;
+        {
+            QWriteLocker l(&node->_imp->knobsAgeMutex);
+            oldHash = node->_imp->hash.value();
+            node->_imp->hashDirty = true;
+            ++node->_imp->hashInvalidationGeneration;
+        }
+        
+        if (node->_imp->effect) {
+            node->_imp->effect->onNodeHashInvalidated();
+            if ( oldHash && node->_imp->nodeCreated && !node->getApp()->getProject()->isProjectClosing() ) {
+                /*
+                 * The node hash is going to change. That means all cache entries for this node with the current hash
+                 * are impossible to re-create again. Just discard them all. This is done in a separate thread.
+                 */
+                node->removeAllImagesFromCacheWithMatchingIDAndKey(oldHash);
+            }
         }
         
+        bool isRotoPaint = node->_imp->effect && node->_imp->effect->isRotoPaintNode();
+        
+        ///Invalidate all the outputs
+        NodesList outputs;
+        node->getOutputsWithGroupRedirection(outputs);
+        for (NodesList::iterator it = outputs.begin(); it != outputs.end(); ++it) {
+            assert(*it);
+            
+            //Since the rotopaint node is connected to the internal nodes of the tree, don't change their hash
+            boost::shared_ptr<RotoDrawableItem> attachedStroke = (*it)->getAttachedRotoItem();
+            if (isRotoPaint && attachedStroke && attachedStroke->getContext()->getNode().get() == node) {
+                continue;
+            }
+            toVisit.push_back( it->get() );
+        }
+        
+        ///If the node has a rotopaint tree, invalidate the nodes in the tree
+        if (node->_imp->rotoContext) {
+            NodesList allItems;
+            node->_imp->rotoContext->getRotoPaintTreeNodes(&allItems);
+            for (NodesList::iterator it = allItems.begin(); it != allItems.end(); ++it) {
+                toVisit.push_back( it->get() );
+            }
+        }
     }
 }
 
 void
-Node::removeAllImagesFromCacheWithMatchingIDAndDifferentKey(U64 nodeHashKey)
+Node::removeAllImagesFromCacheWithMatchingIDAndKey(U64 nodeHashKey)
 {
     boost::shared_ptr<Project> proj = getApp()->getProject();
     if (proj->isProjectClosing() || proj->isLoadingProject()) {
         return;
     }
-    appPTR->removeAllImagesFromCacheWithMatchingIDAndDifferentKey(this, nodeHashKey);
-    appPTR->removeAllImagesFromDiskCacheWithMatchingIDAndDifferentKey(this, nodeHashKey);
+    appPTR->removeAllImagesFromCacheWithMatchingIDAndKey(this, nodeHashKey);
+    appPTR->removeAllImagesFromDiskCacheWithMatchingIDAndKey(this, nodeHashKey);
     ViewerInstance* isViewer = dynamic_cast<ViewerInstance*>(_imp->effect.get());
     if (isViewer) {
         //Also remove from viewer cache
-        appPTR->removeAllTexturesFromCacheWithMatchingIDAndDifferentKey(this, nodeHashKey);
+        appPTR->removeAllTexturesFromCacheWithMatchingIDAndKey(this, nodeHashKey);
     }
 }
 
@@ -1444,8 +1751,9 @@ Node::computeHash()
         Q_EMIT mustComputeHashOnMainThread();
         return;
     }
-    std::list<Node*> marked;
-    computeHashRecursive(marked);
+    std::list<Node*> nodes;
+    nodes.push_back(this);
+    invalidateHashes(nodes);
     
 } // computeHash
 
@@ -2703,13 +3011,30 @@ Node::isActivated() const
 std::string
 Node::makeCacheInfo() const
 {
-    std::size_t ram,disk;
-    appPTR->getMemoryStatsForCacheEntryHolder(this, &ram, &disk);
-    QString ramSizeStr = printAsRAM((U64)ram);
-    QString diskSizeStr = printAsRAM((U64)disk);
+    CacheEntryHolderStats stats;
+    appPTR->getMemoryStatsForCacheEntryHolder(this, &stats);
+    QString ramSizeStr = printAsRAM((U64)stats.ramOccupied);
+    QString compressedSizeStr = printAsRAM((U64)stats.compressedOccupied);
+    QString diskSizeStr = printAsRAM((U64)stats.diskOccupied);
     
     std::stringstream ss;
-    ss << "<b><font color=\"green\">Cache occupancy:</font></b> RAM: " << ramSizeStr.toStdString() << " / Disk: " << diskSizeStr.toStdString();
+    ss << "<b><font color=\"green\">Cache occupancy:</font></b> RAM: " << ramSizeStr.toStdString();
+    if (stats.compressedOccupied > 0) {
+        ss << " (+ " << compressedSizeStr.toStdString() << " compressed)";
+    }
+    ss << " / Disk: " << diskSizeStr.toStdString();
+    U64 nLookups = stats.getNumLookups();
+    if (nLookups > 0) {
+        ss << "<br /><b><font color=\"green\">Cache hits:</font></b> RAM: " << (100 * stats.memoryHits) / nLookups << "%"
+           << " / Compressed: " << (100 * stats.compressedHits) / nLookups << "%"
+           << " / Disk: " << (100 * stats.diskHits) / nLookups << "%";
+    }
+
+    ///The memory of the images of all nodes: what the images use and what is reserved from the system, including the blocks kept for reuse
+    MemoryPoolStats poolStats;
+    MemoryPool::getStats(&poolStats);
+    ss << "<br /><b><font color=\"green\">Image memory (all nodes):</font></b> Used: " << printAsRAM(poolStats.usedBytes).toStdString()
+       << " / Reserved: " << printAsRAM(poolStats.reservedBytes).toStdString();
     return ss.str();
 }
 
@@ -7254,12 +7579,13 @@ Node::onEffectKnobValueChanged(KnobI* what,
             ///When a group is disabled we have to force a hash change of all nodes inside otherwise the image will stay cached
             
             NodesList nodes = isGroup->getNodes();
-            std::list<Node*> markedNodes;
+            std::list<Node*> nodesToInvalidate;
             for (NodesList::iterator it = nodes.begin(); it != nodes.end(); ++it) {
                 //This will not trigger a hash recomputation
                 (*it)->incrementKnobsAge_internal();
-                (*it)->computeHashRecursive(markedNodes);
+                nodesToInvalidate.push_back( it->get() );
             }
+            invalidateHashes(nodesToInvalidate);
         }
         
     } else if ( what == _imp->nodeLabelKnob.lock().get() ) {
@@ -8493,6 +8819,7 @@ Node::refreshAllInputRelatedData(bool /*canChangeValues*/,const std::vector<Node
     if (getApp()->getProject()->isLoadingProject()) {
         //When loading the project, refresh the hash of the nodes in a recursive manner in the proper order
         //for the disk cache to work
+        QMutexLocker k(&_imp->hashComputationMutex);
         hasChanged |= computeHashInternal();
     }
 
@@ -206,9 +206,21 @@ public:
 
     /**
      * @brief Returns the hash value of the node, or 0 if it has never been computed.
+     * If the node or a node upstream changed since the hash was last computed, it is recomputed first.
      **/
     U64 getHashValue() const;
 
+    /**
+     * @brief Computes a hash of the images rendered by the node at the given time and view which, unlike the node hash,
+     * only depends on what they are made of: the plug-in and its full version, the OpenColorIO config of the settings,
+     * the values and animation of the knobs of the node and of the project, the size and date of the files read, and the
+     * same hash of the inputs at the frames they are needed. It identifies the images of the PersistentImageStore across
+     * sessions and computers.
+     * Returns false if the node or a node upstream renders data which is not held by knobs (e.g: Roto shapes).
+     * The results are remembered until the node hash or the OpenColorIO config changes.
+     **/
+    bool computeContentHash(double time, ViewIdx view, U64* hash);
+
     virtual std::string getCacheID() const OVERRIDE FINAL;
 
     /**
@@ -1123,7 +1135,7 @@ public:
 
     double getHostMixingValue(double time, ViewIdx view) const;
     
-    void removeAllImagesFromCacheWithMatchingIDAndDifferentKey(U64 nodeHashKey);
+    void removeAllImagesFromCacheWithMatchingIDAndKey(U64 nodeHashKey);
     void removeAllImagesFromCache(bool blocking);
     
     bool isDraftModeUsed() const;
@@ -1156,13 +1168,24 @@ public:
     
 private:
     
-    void computeHashRecursive(std::list<Node*>& marked);
+    /**
+     * @brief Marks the hash of the given nodes and of all the nodes downstream as dirty in a single pass.
+     * The hashes are recomputed by getHashValue() when they are needed.
+     **/
+    static void invalidateHashes(const std::list<Node*>& nodes);
     
     /**
-     * @brief Refreshes the node hash depending on its context (knobs age, inputs etc...)
+     * @brief Refreshes the node hash depending on its context (knobs age, inputs etc...). The hash of the inputs is
+     * recomputed first if needed. The caller must hold the hash computation mutex of the node.
      * @return True if the hash has changed, false otherwise
      **/
     bool computeHashInternal() WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Implementation of computeContentHash(): fails once nImagesLeft content hashes which were not remembered
+     * have been computed.
+     **/
+    bool computeContentHashInternal(double time, ViewIdx view, U64 settingsHash, int* nImagesLeft, U64* contentHash);
     
     void refreshEnabledKnobsLabel(const ImageComponents& layer);
     
@@ -1317,8 +1340,8 @@ Q_SIGNALS:
 protected:
 
     /**
-     * @brief Recompute the hash value of this node and notify all the clone effects that the values they store in their
-     * knobs is dirty and that they should refresh it by cloning the live instance.
+     * @brief Marks the hash value of this node and of the nodes downstream as dirty, it will be recomputed the next time
+     * it is needed.
      **/
     void computeHash();
 
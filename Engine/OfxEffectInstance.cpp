@@ -60,6 +60,7 @@ CLANG_DIAG_ON(unknown-pragmas)
 
 #include "Engine/AppInstance.h"
 #include "Engine/AppManager.h"
+#include "Engine/Hash64.h"
 #include "Engine/KnobFile.h"
 #include "Engine/KnobTypes.h"
 #include "Engine/Node.h"
@@ -2419,6 +2420,30 @@ OfxEffectInstance::getMinorVersion() const
     return effectInstance()->getPlugin()->getVersionMinor();
 }
 
+void
+OfxEffectInstance::appendPluginVersionToHash(Hash64* hash) const
+{
+    OFX::Host::ImageEffect::ImageEffectPlugin* p = effectInstance()->getPlugin();
+    const OFX::Host::Property::Set & props = p->getDescriptor().getProps();
+
+    ///The micro and build versions and the version label are optional
+    try {
+        int nDims = props.getDimension(kOfxPropVersion);
+        hash->append(nDims);
+        for (int i = 0; i < nDims; ++i) {
+            hash->append( props.getIntProperty(kOfxPropVersion, i) );
+        }
+        Hash64_appendQString( hash, QString::fromUtf8( props.getStringProperty(kOfxPropVersionLabel).c_str() ) );
+    } catch (OFX::Host::Property::Exception) {
+    }
+
+    ///A plugin may be rebuilt without changing its version. The date of the binary is not used: it differs between
+    ///the computers sharing the PersistentImageStore
+    if ( p->getBinary() ) {
+        hash->append( (U64)p->getBinary()->getFileSize() );
+    }
+}
+
 bool
 OfxEffectInstance::supportsRenderQuality() const
 {
@@ -132,6 +132,7 @@ public:
     /********OVERRIDEN FROM EFFECT INSTANCE*************/
     virtual int getMajorVersion() const OVERRIDE FINAL WARN_UNUSED_RETURN;
     virtual int getMinorVersion() const OVERRIDE FINAL WARN_UNUSED_RETURN;
+    virtual void appendPluginVersionToHash(Hash64* hash) const OVERRIDE FINAL;
     virtual bool isGenerator() const OVERRIDE FINAL WARN_UNUSED_RETURN;
     virtual bool isReader() const OVERRIDE FINAL WARN_UNUSED_RETURN;
     virtual bool isWriter() const OVERRIDE FINAL WARN_UNUSED_RETURN;
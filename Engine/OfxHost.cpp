@@ -44,7 +44,6 @@ CLANG_DIAG_ON(deprecated-register)
 #ifdef OFX_SUPPORTS_MULTITHREAD
 #include <QtCore/QThread>
 #include <QtCore/QThreadStorage>
-#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
 // /usr/local/include/boost/bind/arg.hpp:37:9: warning: unused typedef 'boost_static_assert_typedef_37' [-Wunused-local-typedef]
 #include <boost/bind.hpp>
@@ -100,6 +99,7 @@ CLANG_DIAG_ON(unknown-pragmas)
 #include "Engine/Settings.h"
 #include "Engine/StandardPaths.h"
 #include "Engine/TLSHolder.h"
+#include "Engine/TaskScheduler.h"
 
 //An effect may not use more than this amount of threads
 #define NATRON_MULTI_THREAD_SUITE_MAX_NUM_CPU 4
@@ -993,8 +993,8 @@ OfxHost::setThreadAsActionCaller(OfxImageEffectInstance* instance, bool actionCa
 
 namespace {
     
-///Using QtConcurrent doesn't work with The Foundry Furnace plug-ins because they expect fresh threads
-///to be created. As QtConcurrent's thread-pool recycles thread, it seems to make Furnace crash.
+///Using a thread-pool doesn't work with The Foundry Furnace plug-ins because they expect fresh threads
+///to be created. As the TaskScheduler recycles threads, it seems to make Furnace crash.
 ///We think this is because Furnace must keep an internal thread-local state that becomes then dirty
 ///if we re-use the same thread.
 
@@ -1033,7 +1033,16 @@ threadFunctionWrapper(OfxThreadFunctionV1 func,
     return ret;
 }
 
-    
+static void
+threadFunctionWrapperAt(OfxThreadFunctionV1 func,
+                        unsigned int threadIndex,
+                        unsigned int threadMax,
+                        const QThread* spawnerThread,
+                        void *customArg,
+                        std::vector<OfxStatus>* status)
+{
+    (*status)[threadIndex] = threadFunctionWrapper(func, threadIndex, threadMax, spawnerThread, customArg);
+}
 
     
 class OfxThread
@@ -1136,19 +1145,17 @@ OfxHost::multiThread(OfxThreadFunctionV1 func,
     
     if (useThreadPool) {
         
-        std::vector<unsigned int> threadIndexes(nThreads);
-        for (unsigned int i = 0; i < nThreads; ++i) {
-            threadIndexes[i] = i;
+        std::vector<OfxStatus> status(nThreads, kOfxStatFailed); // by default, a thread fails
+
+        ///The scheduler runs the iterations in its workers and in this thread, nested calls from within func do not deadlock
+        /// DON'T set the maximum concurrency of the scheduler, this is a global application setting, and see the documentation excerpt above
+        try {
+            appPTR->getTaskScheduler()->parallelFor( nThreads, boost::bind(threadFunctionWrapperAt, func, _1, nThreads, spawnerThread, customArg, &status), maxConcurrentThread );
+        } catch (...) {
+            return kOfxStatFailed;
         }
-        
-        /// DON'T set the maximum thread count, this is a global application setting, and see the documentation excerpt above
-        //QThreadPool::globalInstance()->setMaxThreadCount(nThreads);
-        QFuture<OfxStatus> future = QtConcurrent::mapped( threadIndexes, boost::bind(threadFunctionWrapper,func, _1, nThreads, spawnerThread, customArg) );
-        future.waitForFinished();
-        ///DON'T reset back to the original value the maximum thread count
-        //QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
-        
-        for (QFuture<OfxStatus>::const_iterator it = future.begin(); it != future.end(); ++it) {
+
+        for (std::vector<OfxStatus>::const_iterator it = status.begin(); it != status.end(); ++it) {
             OfxStatus stat = *it;
             if (stat != kOfxStatOK) {
                 return stat;
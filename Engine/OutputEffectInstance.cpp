@@ -62,6 +62,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/FStreamsSupport.h"
 #include "Engine/OfxImageEffectInstance.h"
 #include "Engine/OutputSchedulerThread.h"
+#include "Engine/ParallelRenderController.h"
 #include "Engine/PluginMemory.h"
 #include "Engine/Project.h"
 #include "Engine/RenderStats.h"
@@ -501,6 +502,17 @@ OutputEffectInstance::reportStats(int time,
     }
 
     *ofile << "Time spent to render frame (wall clock time): " << Timer::printAsTime(wallTime, false).toStdString() << std::endl;
+    const ParallelRenderController* parallelRenders = _engine ? _engine->getParallelRenderController() : 0;
+    if (parallelRenders) {
+        *ofile << "Parallel renders: " << parallelRenders->getParallelRenders() << " (" << parallelRenders->getFramesPerSecond()
+               << " frames/sec measured over the last frames)" << std::endl;
+        std::list<ParallelRenderDecision> decisions = parallelRenders->getDecisions();
+        if ( !decisions.empty() ) {
+            const ParallelRenderDecision & decision = decisions.back();
+            *ofile << "Last change of the parallel renders: " << decision.nParallelRenders << " at " << Timer::printAsTime(decision.time, false).toStdString()
+                   << " (" << decision.reason << ", " << decision.framesPerSecond << " frames/sec, memory pressure " << decision.memoryPressure << ")" << std::endl;
+        }
+    }
     for (std::map<NodePtr, NodeRenderStats >::const_iterator it = stats.begin(); it != stats.end(); ++it) {
         *ofile << "------------------------------- " << it->first->getScriptName_mt_safe() << "------------------------------- " << std::endl;
         *ofile << "Time spent rendering: " << Timer::printAsTime(it->second.getTotalTimeSpentRendering(), false).toStdString() << std::endl;
@@ -26,9 +26,11 @@
 
 #include <iostream>
 #include <set>
+#include <map>
 #include <list>
 #include <algorithm> // min, max
 #include <cassert>
+#include <limits>
 #include <stdexcept>
 
 #include <boost/scoped_ptr.hpp>
@@ -49,10 +51,13 @@
 #include "Engine/AppManager.h"
 #include "Engine/AppInstance.h"
 #include "Engine/EffectInstance.h"
+#include "Engine/FrameEntry.h"
+#include "Engine/FrameKey.h"
 #include "Engine/Image.h"
 #include "Engine/KnobFile.h"
 #include "Engine/Node.h"
 #include "Engine/OpenGLViewerI.h"
+#include "Engine/ParallelRenderController.h"
 #include "Engine/Project.h"
 #include "Engine/RenderStats.h"
 #include "Engine/RotoContext.h"
@@ -168,17 +173,18 @@ struct ProducedFrame
     bool isAborted;
 };
 
-#ifndef NATRON_PLAYBACK_USES_THREAD_POOL
-static bool isBufferFull(int nbBufferedElement, int hardwardIdealThreadCount)
-{
-    return nbBufferedElement >= hardwardIdealThreadCount * 3;
-}
-#endif
+///When the user setting is 0, the frames rendered ahead of a writer may take this part of the total RAM
+#define kWriterBufferRAMFraction 0.1
+
+///Above this memory pressure the available RAM is down to the part that must be kept free and the caches are evicting:
+///the render threads do not render ahead of the writer. This is the threshold of the ParallelRenderController.
+#define kWriterBufferHighMemoryPressure 0.98
 
 struct OutputSchedulerThreadPrivate
 {
     
     FrameBuffer buf; //the frames rendered by the worker threads that needs to be rendered in order by the output device
+    std::size_t bufferedBytes; //the RAM taken by the frames in buf
     QWaitCondition bufCondition;
     mutable QMutex bufMutex;
     
@@ -266,6 +272,10 @@ struct OutputSchedulerThreadPrivate
  
     boost::weak_ptr<OutputEffectInstance> outputEffect; //< The effect used as output device
     RenderEngine* engine;
+
+    ///Chooses the number of parallel renders when the user setting is 0, from the frames rendered since renderClock started
+    ParallelRenderController parallelRenderController;
+    TimeLapse renderClock;
     
 #ifdef NATRON_SCHEDULER_SPAWN_THREADS_WITH_TIMER
     QTimer threadSpawnsTimer;
@@ -278,6 +288,7 @@ struct OutputSchedulerThreadPrivate
     
     OutputSchedulerThreadPrivate(RenderEngine* engine,const boost::shared_ptr<OutputEffectInstance>& effect,OutputSchedulerThread::ProcessFrameModeEnum mode)
     : buf()
+    , bufferedBytes(0)
     , bufCondition()
     , bufMutex()
     , working(false)
@@ -322,6 +333,8 @@ struct OutputSchedulerThreadPrivate
     , lastFramePushedIndex(0)
     , outputEffect(effect)
     , engine(engine)
+    , parallelRenderController()
+    , renderClock()
 #ifdef NATRON_SCHEDULER_SPAWN_THREADS_WITH_TIMER
     , threadSpawnsTimer()
     , lastRecordedFPSMutex()
@@ -345,6 +358,9 @@ struct OutputSchedulerThreadPrivate
         k.frame = image;
         k.stats = stats;
         std::pair<FrameBuffer::iterator,bool> ret = buf.insert(k);
+        if (ret.second && image) {
+            bufferedBytes += image->sizeInRAM();
+        }
         return ret.second;
     }
     
@@ -355,6 +371,7 @@ struct OutputSchedulerThreadPrivate
         assert(!bufMutex.tryLock());
         
         FrameBuffer newBuf;
+        bufferedBytes = 0;
         for (FrameBuffer::iterator it = buf.begin(); it != buf.end(); ++it) {
             
             if (it->time == time) {
@@ -363,10 +380,35 @@ struct OutputSchedulerThreadPrivate
                 }
             } else {
                 newBuf.insert(*it);
+                if (it->frame) {
+                    bufferedBytes += it->frame->sizeInRAM();
+                }
             }
         }
         buf = newBuf;
     }
+    
+    bool isFrameBuffered(double time) const
+    {
+        ///Private, shouldn't lock
+        assert(!bufMutex.tryLock());
+        
+        for (FrameBuffer::const_iterator it = buf.begin(); it != buf.end(); ++it) {
+            if (it->time == time) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    void clearBuffer()
+    {
+        ///Private, shouldn't lock
+        assert(!bufMutex.tryLock());
+        
+        buf.clear();
+        bufferedBytes = 0;
+    }
   
     
     void appendRunnable(RenderThreadTask* runnable)
@@ -783,6 +825,23 @@ OutputSchedulerThread::pushFramesToRender(int nThreads)
 }
 
 
+bool
+OutputSchedulerThread::isBufferFull() const
+{
+    int maxFrames;
+    std::size_t maxBytes;
+    getBufferLimits(&maxFrames, &maxBytes);
+    
+    QMutexLocker k(&_imp->bufMutex);
+    
+    ///Never stop while the buffer is empty: the frame expected by the output device might not be rendered yet.
+    ///Otherwise it is being rendered, since the frames are picked in order.
+    if (_imp->buf.empty()) {
+        return false;
+    }
+    return (maxFrames > 0 && (int)_imp->buf.size() >= maxFrames) || (maxBytes > 0 && _imp->bufferedBytes >= maxBytes);
+}
+
 int
 OutputSchedulerThread::pickFrameToRender(RenderThreadTask* thread,bool* enableRenderStats, std::vector<ViewIdx>* viewsToRender)
 {
@@ -797,17 +856,13 @@ OutputSchedulerThread::pickFrameToRender(RenderThreadTask* thread,bool* enableRe
         _imp->allRenderThreadsInactiveCond.wakeOne();
     }
     
-    ///Simple heuristic to limit the size of the internal buffer.
+    ///Limit the size of the internal buffer.
     ///If the buffer grows too much, we will keep shared ptr to images, hence keep them in RAM which
     ///can lead to RAM issue for the end user.
     ///We can end up in this situation for very simple graphs where the rendering of the output node (the writer or viewer)
     ///is much slower than things upstream, hence the buffer grows quickly, and fills up the RAM.
-    int nbThreadsHardware = appPTR->getHardwareIdealThreadCount();
-    bool bufferFull;
-    {
-        QMutexLocker k(&_imp->bufMutex);
-        bufferFull = isBufferFull((int)_imp->buf.size(),nbThreadsHardware);
-    }
+    ///The scheduler thread wakes us up each time it takes a frame from the buffer.
+    bool bufferFull = isBufferFull();
     
     QMutexLocker l(&_imp->framesToRenderMutex);
     while ((bufferFull || _imp->framesToRender.empty()) && !thread->mustQuit() ) {
@@ -817,10 +872,7 @@ OutputSchedulerThread::pickFrameToRender(RenderThreadTask* thread,bool* enableRe
         
         
         _imp->framesToRenderNotEmptyCond.wait(&_imp->framesToRenderMutex);
-        {
-            QMutexLocker k(&_imp->bufMutex);
-            bufferFull = isBufferFull((int)_imp->buf.size(),nbThreadsHardware);
-        }
+        bufferFull = isBufferFull();
         
     }
     
@@ -1054,6 +1106,13 @@ OutputSchedulerThread::startRender()
         _imp->working = true;
     }
 
+    ///Start with a render per 2 cores, the tiles of the frames use the other cores
+    {
+        int idealThreadCount = std::max(1, appPTR->getHardwareIdealThreadCount());
+        _imp->parallelRenderController.reset(std::max(1, idealThreadCount / 2), 1, idealThreadCount * 2,
+                                             _imp->renderClock.getTimeSinceCreation());
+    }
+
 #ifndef NATRON_PLAYBACK_USES_THREAD_POOL
     int nThreads;
     {
@@ -1217,7 +1276,7 @@ OutputSchedulerThread::stopRender()
         
         {
             QMutexLocker k(&_imp->bufMutex);
-            _imp->buf.clear();
+            _imp->clearBuffer();
         }
 
         
@@ -1447,14 +1506,16 @@ OutputSchedulerThread::run()
            
             if (!renderFinished && !isAbortRequested) {
                 
+                int nextExpectedTime = timelineGetTime();
                 QMutexLocker bufLocker (&_imp->bufMutex);
-                ///Wait here for more frames to be rendered, we will be woken up once appendToBuffer(...) is called
-                if (_imp->buf.empty()) {
+                ///Wait here for more frames to be rendered, we will be woken up once appendToBuffer(...) is called.
+                ///The buffer may hold frames rendered ahead of the expected one, do not spin until it is rendered.
+                if ( _imp->buf.empty() || !_imp->isFrameBuffered(nextExpectedTime) ) {
                     _imp->bufCondition.wait(&_imp->bufMutex);
                 }
                 /*else {
                     
-                    if (isBufferFull((int)_imp->buf.size(),appPTR->getHardwareIdealThreadCount())) {
+                    if (isBufferFull()) {
                         qDebug() << "PLAYBACK STALL detected: Internal buffer is full but frame" << expectedTimeToRender
                         << "is still expected to be rendered. Stopping render.";
                         assert(false);
@@ -1481,30 +1542,27 @@ void
 OutputSchedulerThread::adjustNumberOfThreads(int* newNThreads, int *lastNThreads)
 {
     ///////////
-    /////If we were analysing the CPU activity, now set the appropriate number of threads to render.
+    /////Set the number of threads to render chosen by the user or measured by the ParallelRenderController.
     int optimalNThreads;
     
     ///How many parallel renders the user wants
     int userSettingParallelThreads = appPTR->getCurrentSettings()->getNumberOfParallelRenders();
     
-    ///How many threads are running in the application
-    int runningThreads = appPTR->getNRunningThreads() + QThreadPool::globalInstance()->activeThreadCount();
-    
     ///How many current threads are used by THIS renderer
     int currentParallelRenders = getNRenderThreads();
     *lastNThreads = currentParallelRenders;
     
     if (userSettingParallelThreads == 0) {
-        ///User wants it to be automatically computed, do a simple heuristic: launch as many parallel renders
-        ///as there are cores
-        optimalNThreads = appPTR->getHardwareIdealThreadCount();
+        ///User wants it to be automatically computed: the number of parallel renders which gave the best throughput
+        ///so far, see notifyFrameRendered()
+        optimalNThreads = _imp->parallelRenderController.getParallelRenders();
     } else {
         optimalNThreads = userSettingParallelThreads;
     }
     optimalNThreads = std::max(1,optimalNThreads);
 
 
-    if ((runningThreads < optimalNThreads && currentParallelRenders < optimalNThreads) || currentParallelRenders == 0) {
+    if (currentParallelRenders < optimalNThreads) {
      
         ////////
         ///Launch 1 thread
@@ -1513,7 +1571,7 @@ OutputSchedulerThread::adjustNumberOfThreads(int* newNThreads, int *lastNThreads
         _imp->appendRunnable(createRunnable());
         *newNThreads = currentParallelRenders +  1;
         
-    } else if (runningThreads > optimalNThreads && currentParallelRenders > optimalNThreads) {
+    } else if (currentParallelRenders > optimalNThreads) {
         ////////
         ///Stop 1 thread
         stopRenderThreads(1);
@@ -1522,7 +1580,7 @@ OutputSchedulerThread::adjustNumberOfThreads(int* newNThreads, int *lastNThreads
     } else {
         /////////
         ///Keep the current count
-        *newNThreads = std::max(1,currentParallelRenders);
+        *newNThreads = currentParallelRenders;
     }
 }
 #endif
@@ -1551,6 +1609,18 @@ OutputSchedulerThread::notifyFrameRendered(int frame,
     bool isBackground = appPTR->isBackground();
     int nbCurParallelRenders = 1;
 
+    if (viewIndex == viewsToRender[viewsToRender.size() - 1] || viewIndex == -1) {
+        double memoryPressure = ParallelRenderController::getCurrentMemoryPressure();
+        if ( _imp->parallelRenderController.notifyFrameRendered(_imp->renderClock.getTimeSinceCreation(), memoryPressure) &&
+             (appPTR->getCurrentSettings()->getNumberOfParallelRenders() == 0) ) {
+            std::list<ParallelRenderDecision> decisions = _imp->parallelRenderController.getDecisions();
+            const ParallelRenderDecision & decision = decisions.back();
+            qDebug() << effect->getScriptName_mt_safe().c_str() << "parallel renders:" << decision.nParallelRenders
+                     << '(' << decision.reason.c_str() << ',' << decision.framesPerSecond << "frames/sec, memory pressure"
+                     << decision.memoryPressure << ')';
+        }
+    }
+
     if (policy == eSchedulingPolicyFFA) {
         
         QMutexLocker l(&_imp->runArgsMutex);
@@ -1633,6 +1703,7 @@ OutputSchedulerThread::notifyFrameRendered(int frame,
             QString timeRemainingStr = Timer::printAsTime(timeRemaining, true);
             ts << "\nTime elapsed for frame: " << timeSpentStr;
             ts << "\nTime remaining: " << timeRemainingStr;
+            ts << "\nParallel renders: " << QString::number(nbCurParallelRenders);
         }
         appPTR->writeToOutputPipe(longMessage,kFrameRenderedStringShort + frameStr + kProgressChangedStringShort + QString::number(percentage));
     }
@@ -1832,7 +1903,7 @@ OutputSchedulerThread::abortRendering(bool autoRestart,bool blocking)
             
             {
                 QMutexLocker k(&_imp->bufMutex);
-                _imp->buf.clear();
+                _imp->clearBuffer();
             }*/
             
             if (isMainThread) {
@@ -2073,6 +2144,31 @@ OutputSchedulerThread::getViewsRequestedToRender() const
     return _imp->livingRunArgs.viewsToRender;
 }
 
+void
+OutputSchedulerThread::getFramesRequestedToRenderAfter(int frame, int nFrames, std::vector<int>* frames) const
+{
+    RenderDirectionEnum direction;
+    int firstFrame,lastFrame,frameStep;
+    {
+        QMutexLocker l(&_imp->runArgsMutex);
+        direction = _imp->livingRunArgs.timelineDirection;
+        firstFrame = _imp->livingRunArgs.firstFrame;
+        lastFrame = _imp->livingRunArgs.lastFrame;
+        frameStep = _imp->livingRunArgs.frameStep;
+    }
+    if (firstFrame == lastFrame || frameStep < 1) {
+        return;
+    }
+    PlaybackModeEnum pMode = _imp->engine->getPlaybackMode();
+    for (int i = 0; i < nFrames; ++i) {
+        if (!OutputSchedulerThreadPrivate::getNextFrameInSequence(pMode, direction, frame,
+                                                                  firstFrame, lastFrame, frameStep, &frame, &direction)) {
+            break;
+        }
+        frames->push_back(frame);
+    }
+}
+
 int
 OutputSchedulerThread::getNRenderThreads() const
 {
@@ -2080,6 +2176,12 @@ OutputSchedulerThread::getNRenderThreads() const
     return (int)_imp->renderThreads.size();
 }
 
+const ParallelRenderController&
+OutputSchedulerThread::getParallelRenderController() const
+{
+    return _imp->parallelRenderController;
+}
+
 int
 OutputSchedulerThread::getNActiveRenderThreads() const
 {
@@ -2134,6 +2236,13 @@ OutputSchedulerThread::getEngine() const
     return _imp->engine;
 }
 
+void
+OutputSchedulerThread::getBufferLimits(int* maxFrames, std::size_t* maxBytes) const
+{
+    *maxFrames = appPTR->getHardwareIdealThreadCount() * 3;
+    *maxBytes = 0;
+}
+
 
 void
 OutputSchedulerThread::runCallbackWithVariables(const QString& callback)
@@ -2843,21 +2952,263 @@ DefaultScheduler::onRenderStopped(bool aborted)
 
 }
 
+void
+DefaultScheduler::getBufferLimits(int* maxFrames, std::size_t* maxBytes) const
+{
+    ///The writer processes the frames one after another in this thread: a sequential writer (e.g: a movie encoder) is often
+    ///much slower than the render of a frame by the render threads. Let them render ahead of the writer whatever the number
+    ///of frames, as long as the frames waiting to be written fit in the buffer size, so that large frames do not fill up the RAM.
+    *maxFrames = 0;
+    U64 bufferSize = appPTR->getCurrentSettings()->getWriterBufferSize();
+    if (bufferSize == 0) {
+        bufferSize = (U64)( getSystemTotalRAM() * kWriterBufferRAMFraction );
+    }
+    
+    ///The run-ahead is only bounded by the buffer size, unless the RAM actually runs out (the page cache is not counted
+    ///as used, @see ParallelRenderController::getCurrentMemoryPressure()): then only render the frame expected by the writer
+    if (ParallelRenderController::getCurrentMemoryPressure() >= kWriterBufferHighMemoryPressure) {
+        bufferSize = 1;
+    }
+    *maxBytes = (std::size_t)std::min( bufferSize, (U64)std::numeric_limits<std::size_t>::max() );
+}
+
 ////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////
 //////////////////////// ViewerDisplayScheduler ////////////
 
 
+/**
+ * @brief Brings in RAM the textures of the ViewerCache that will be displayed next during playback so that
+ * the render threads do not have to wait for them to be read from the disk.
+ * The textures are looked-up with the key of the last texture displayed, only the time changes. The textures found
+ * are held until they are displayed so that the cache cannot put them back on disk in-between.
+ **/
+class ViewerCacheReadAhead : public QThread
+{
+    struct TextureReadAhead
+    {
+        bool hasKey;
+        FrameKey key; //< key of the last texture looked-up, only the time differs for the next frames
+        std::set<int> requested; //< frames already queued for the current key
+        std::map<int, boost::shared_ptr<FrameEntry> > fetched; //< textures loaded in RAM waiting to be displayed
+
+        TextureReadAhead()
+        : hasKey(false)
+        , key()
+        , requested()
+        , fetched()
+        {
+        }
+    };
+
+    mutable QMutex _lock; //< protects all members below
+    QWaitCondition _requestsNotEmptyCond;
+    TextureReadAhead _textures[2];
+    std::list<std::pair<int, int> > _requests; //< texture index, time
+    U64 _nHot, _nCold;
+    bool _mustQuit;
+
+public:
+
+    ViewerCacheReadAhead()
+    : QThread()
+    , _lock()
+    , _requestsNotEmptyCond()
+    , _requests()
+    , _nHot(0)
+    , _nCold(0)
+    , _mustQuit(false)
+    {
+        setObjectName("ViewerCacheReadAhead");
+    }
+
+    virtual ~ViewerCacheReadAhead()
+    {
+    }
+
+    void quitThread()
+    {
+        if (!isRunning()) {
+            return;
+        }
+        {
+            QMutexLocker k(&_lock);
+            _mustQuit = true;
+            _requestsNotEmptyCond.wakeOne();
+        }
+        wait();
+    }
+
+    /**
+     * @brief Called when the texture at the given time was looked-up by a render thread. upcomingFrames are the
+     * frames that will be displayed next, in order.
+     **/
+    void onTextureLookedUp(int time, int textureIndex, const FrameKey& key, bool isCached, const std::vector<int>& upcomingFrames)
+    {
+        assert(textureIndex == 0 || textureIndex == 1);
+        {
+            QMutexLocker k(&_lock);
+            TextureReadAhead& tex = _textures[textureIndex];
+            std::map<int, boost::shared_ptr<FrameEntry> >::iterator found = tex.fetched.find(time);
+            if (isCached) {
+                if (found != tex.fetched.end()) {
+                    ++_nHot;
+                } else {
+                    ++_nCold;
+                }
+            }
+            if (found != tex.fetched.end()) {
+                tex.fetched.erase(found);
+            }
+
+            FrameKey timeIndependentKey = key;
+            timeIndependentKey.setTime(tex.key.getTime());
+            if (!tex.hasKey || !(timeIndependentKey == tex.key)) {
+                // the viewer settings or the tree changed: the textures fetched are not the ones that will be displayed
+                tex.hasKey = true;
+                tex.fetched.clear();
+                tex.requested.clear();
+                std::list<std::pair<int, int> >::iterator it = _requests.begin();
+                while (it != _requests.end()) {
+                    if (it->first == textureIndex) {
+                        it = _requests.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+            tex.key = key;
+
+            // forget about the frames that left the read-ahead window
+            std::set<int> window(upcomingFrames.begin(), upcomingFrames.end());
+            for (std::map<int, boost::shared_ptr<FrameEntry> >::iterator it = tex.fetched.begin(); it != tex.fetched.end();) {
+                if (window.find(it->first) == window.end()) {
+                    tex.fetched.erase(it++);
+                } else {
+                    ++it;
+                }
+            }
+            for (std::set<int>::iterator it = tex.requested.begin(); it != tex.requested.end();) {
+                if (window.find(*it) == window.end()) {
+                    tex.requested.erase(it++);
+                } else {
+                    ++it;
+                }
+            }
+
+            for (std::vector<int>::const_iterator it = upcomingFrames.begin(); it != upcomingFrames.end(); ++it) {
+                if (tex.requested.insert(*it).second) {
+                    _requests.push_back(std::make_pair(textureIndex, *it));
+                }
+            }
+            if (_requests.empty()) {
+                return;
+            }
+            _requestsNotEmptyCond.wakeOne();
+        }
+        if (!isRunning()) {
+            start(QThread::LowPriority);
+        }
+    }
+
+    /**
+     * @brief Releases all textures held and pending requests. If resetStats is true the hot/cold counters are reset too.
+     **/
+    void clear(bool resetStats)
+    {
+        QMutexLocker k(&_lock);
+        for (int i = 0; i < 2; ++i) {
+            _textures[i].hasKey = false;
+            _textures[i].requested.clear();
+            _textures[i].fetched.clear();
+        }
+        _requests.clear();
+        if (resetStats) {
+            _nHot = _nCold = 0;
+        }
+    }
+
+    void getStats(U64* nHot, U64* nCold) const
+    {
+        QMutexLocker k(&_lock);
+        *nHot = _nHot;
+        *nCold = _nCold;
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        for (;;) {
+            int textureIndex, time;
+            FrameKey key;
+            {
+                QMutexLocker k(&_lock);
+                while (_requests.empty() && !_mustQuit) {
+                    _requestsNotEmptyCond.wait(&_lock);
+                }
+                if (_mustQuit) {
+                    _mustQuit = false;
+                    return;
+                }
+                textureIndex = _requests.front().first;
+                time = _requests.front().second;
+                _requests.pop_front();
+                key = _textures[textureIndex].key;
+            }
+            key.setTime(time);
+
+            // This moves the texture to the in-memory portion of the cache if it was on disk
+            boost::shared_ptr<FrameEntry> entry;
+            if (!AppManager::getTextureFromCache(key, &entry) || !entry) {
+                continue;
+            }
+            // Fault the pages in now rather than on the render thread
+            entry->prefetchData();
+
+            QMutexLocker k(&_lock);
+            TextureReadAhead& tex = _textures[textureIndex];
+            // the request may have been cancelled meanwhile
+            if (tex.requested.find(time) != tex.requested.end()) {
+                FrameKey fetchedKey = tex.key;
+                fetchedKey.setTime(time);
+                if (fetchedKey == key) {
+                    tex.fetched[time] = entry;
+                }
+            }
+        }
+    }
+};
+
+
 ViewerDisplayScheduler::ViewerDisplayScheduler(RenderEngine* engine, const boost::shared_ptr<ViewerInstance>& viewer)
 : OutputSchedulerThread(engine,viewer,eProcessFrameByMainThread) //< OpenGL rendering is done on the main-thread
 , _viewer(viewer)
+, _readAhead(new ViewerCacheReadAhead)
 {
     
 }
 
 ViewerDisplayScheduler::~ViewerDisplayScheduler()
 {
-    
+    _readAhead->quitThread();
+}
+
+void
+ViewerDisplayScheduler::notifyTextureLookedUp(int time, int textureIndex, const FrameKey& key, bool isCached)
+{
+    int nFrames = appPTR->getCurrentSettings()->getPlaybackReadAheadFrames();
+    std::vector<int> upcomingFrames;
+    if (nFrames > 0) {
+        getFramesRequestedToRenderAfter(time, nFrames, &upcomingFrames);
+    }
+    _readAhead->onTextureLookedUp(time, textureIndex, key, isCached, upcomingFrames);
+}
+
+void
+ViewerDisplayScheduler::getReadAheadStats(U64* nHotTextures, U64* nColdTextures) const
+{
+    _readAhead->getStats(nHotTextures, nColdTextures);
 }
 
 
@@ -2925,24 +3276,27 @@ class ViewerRenderFrameRunnable : public RenderThreadTask
 {
   
     boost::weak_ptr<ViewerInstance> _viewer;
+    ViewerDisplayScheduler* _displayScheduler;
     
 public:
     
 #ifndef NATRON_PLAYBACK_USES_THREAD_POOL
-    ViewerRenderFrameRunnable(const boost::shared_ptr<ViewerInstance>& viewer,OutputSchedulerThread* scheduler)
+    ViewerRenderFrameRunnable(const boost::shared_ptr<ViewerInstance>& viewer,ViewerDisplayScheduler* scheduler)
     : RenderThreadTask(viewer,scheduler)
     , _viewer(viewer)
+    , _displayScheduler(scheduler)
     {
         
     }
 #else
     ViewerRenderFrameRunnable(const boost::shared_ptr<ViewerInstance>& viewer,
-                              OutputSchedulerThread* scheduler,
+                              ViewerDisplayScheduler* scheduler,
                               const int frame,
                               const bool useRenderStarts,
                               const std::vector<int>& viewsToRender)
     : RenderThreadTask(viewer,scheduler, frame, useRenderStarts, viewsToRender)
     , _viewer(viewer)
+    , _displayScheduler(scheduler)
     {
         
     }
@@ -2986,6 +3340,10 @@ private:
         for (int i = 0; i < 2; ++i) {
             args[i].reset(new ViewerArgs);
             status[i] = viewer->getRenderViewerArgsAndCheckCache_public(time, true, true, view, i, viewerHash, NodePtr(), true, stats, args[i].get());
+            if (args[i]->key) {
+                bool isCached = args[i]->params && args[i]->params->cachedFrame;
+                _displayScheduler->notifyTextureLookedUp(time, i, *args[i]->key, isCached);
+            }
             clearTexture[i] = status[i] == ViewerInstance::eViewerRenderRetCodeFail || status[i] == ViewerInstance::eViewerRenderRetCodeBlack;
             if (clearTexture[i]) {
                 //Just clear the viewer, nothing to do
@@ -3070,9 +3428,25 @@ ViewerDisplayScheduler::handleRenderFailure(const std::string& /*errorMessage*/)
     _viewer.lock()->disconnectViewer();
 }
 
+void
+ViewerDisplayScheduler::aboutToStartRender()
+{
+    _readAhead->clear(true);
+}
+
 void
 ViewerDisplayScheduler::onRenderStopped(bool /*/aborted*/)
 {
+    ///Release the textures loaded in advance, they may never be displayed
+    _readAhead->clear(false);
+#ifdef DEBUG
+    U64 nHot, nCold;
+    _readAhead->getStats(&nHot, &nCold);
+    if (nHot + nCold > 0) {
+        qDebug() << "Playback cache read-ahead:" << nHot << "textures served from RAM," << nCold << "read from the cache by the render threads";
+    }
+#endif
+    
     ///Refresh all previews in the tree
     boost::shared_ptr<ViewerInstance> viewer = _viewer.lock();
     viewer->getNode()->refreshPreviewsRecursivelyUpstream(viewer->getTimeline()->currentFrame());
@@ -3369,6 +3743,12 @@ RenderEngine::setDesiredFPS(double d)
     _imp->scheduler->setDesiredFPS(d);
 }
 
+const ParallelRenderController*
+RenderEngine::getParallelRenderController() const
+{
+    return _imp->scheduler ? &_imp->scheduler->getParallelRenderController() : 0;
+}
+
 double
 RenderEngine::getDesiredFPS() const
 {
@@ -251,6 +251,12 @@ public:
      * This can only be called on the scheduler thread (this)
      **/
     std::vector<ViewIdx> getViewsRequestedToRender() const;
+
+    /**
+     * @brief Returns in frames at most nFrames frames that will be rendered after the given frame, according to
+     * the frame range and direction set in the livingRunArgs and the playback mode.
+     **/
+    void getFramesRequestedToRenderAfter(int frame, int nFrames, std::vector<int>* frames) const;
     
     /**
      * @brief Returns the current number of render threads
@@ -261,6 +267,11 @@ public:
      * @brief Returns the current number of render threads doing work
      **/
     int getNActiveRenderThreads() const;
+
+    /**
+     * @brief Returns the controller of the number of parallel renders, which measures the throughput of the renders
+     **/
+    const ParallelRenderController& getParallelRenderController() const;
     
 #ifndef NATRON_PLAYBACK_USES_THREAD_POOL
     /**
@@ -409,6 +420,13 @@ protected:
      **/
     virtual void onRenderStopped(bool /*aborted*/) {}
     
+    /**
+     * @brief Returns how much the render threads may render ahead of the output device: they stop picking new frames
+     * while the frames waiting in the buffer reach maxFrames or take maxBytes of RAM. A limit of 0 means no limit.
+     * By default the buffer holds at most 3 frames per hardware thread.
+     **/
+    virtual void getBufferLimits(int* maxFrames, std::size_t* maxBytes) const;
+    
     RenderEngine* getEngine() const;
     
     
@@ -435,7 +453,14 @@ private:
     void pushAllFrameRange();
     
     /**
-     * @brief Starts/stops more threads according to CPU activity and user preferences 
+     * @brief Returns true if the render threads must wait for the output device to process the frames in the buffer
+     * @see getBufferLimits()
+     **/
+    bool isBufferFull() const;
+    
+    /**
+     * @brief Starts/stops one thread to get closer to the number of parallel renders set by the user, or chosen
+     * by the ParallelRenderController from the measured throughput if the user setting is 0
      * @param optimalNThreads[out] Will be set to the new number of threads
      **/
     void adjustNumberOfThreads(int* newNThreads, int *lastNThreads);
@@ -495,13 +520,14 @@ private:
     
     virtual void onRenderStopped(bool aborted) OVERRIDE FINAL;
     
-
+    virtual void getBufferLimits(int* maxFrames, std::size_t* maxBytes) const OVERRIDE FINAL;
     
     boost::weak_ptr<OutputEffectInstance> _effect;
 };
 
 
 class ViewerInstance;
+class ViewerCacheReadAhead;
 class ViewerDisplayScheduler : public OutputSchedulerThread
 {
     
@@ -511,6 +537,18 @@ public:
     
     virtual ~ViewerDisplayScheduler();
     
+    /**
+     * @brief Called by the render threads once the texture of the given frame has been looked-up in the ViewerCache.
+     * The texture key is used to bring in RAM the textures of the frames that will be displayed next
+     * when they are in the disk portion of the cache.
+     **/
+    void notifyTextureLookedUp(int time, int textureIndex, const FrameKey& key, bool isCached);
+    
+    /**
+     * @brief Returns how many cached textures were displayed since the start of the playback, either already loaded
+     * in RAM by the read-ahead (hot) or read by the render threads themselves (cold).
+     **/
+    void getReadAheadStats(U64* nHotTextures, U64* nColdTextures) const;
     
 private:
 
@@ -538,9 +576,12 @@ private:
     
     virtual int getLastRenderedTime() const OVERRIDE FINAL WARN_UNUSED_RETURN;
     
+    virtual void aboutToStartRender() OVERRIDE FINAL;
+    
     virtual void onRenderStopped(bool aborted) OVERRIDE FINAL;
     
     boost::weak_ptr<ViewerInstance> _viewer;
+    boost::scoped_ptr<ViewerCacheReadAhead> _readAhead;
 };
 
 /**
@@ -677,6 +718,11 @@ public:
      * @brief Returns the desired user FPS that the internal scheduler should stick to
      **/
     double getDesiredFPS() const;
+
+    /**
+     * @brief Returns the controller of the number of parallel renders of the scheduler, NULL if it was not created yet
+     **/
+    const ParallelRenderController* getParallelRenderController() const;
     
     /**
      * @brief Quit all processing, making sure all threads are finished.
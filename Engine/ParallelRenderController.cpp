@@ -0,0 +1,284 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "ParallelRenderController.h"
+
+#include <algorithm>
+
+#include "Global/MemoryInfo.h"
+
+#include "Engine/AppManager.h"
+#include "Engine/Settings.h"
+#include "Engine/Timer.h"
+
+///A window lasts at least this number of frames, and 2 frames per parallel render
+#define kParallelRenderMinFramesPerWindow 4
+
+///A window lasts at least this long (in seconds), so that the measure is not only the latency of a few frames
+#define kParallelRenderMinWindowDuration 0.5
+
+///Below this relative change the throughput of 2 windows is considered the same
+#define kParallelRenderMinGain 0.05
+
+///The number of windows the count is kept after the throughput stopped improving, before another count is tried
+#define kParallelRenderWindowsToHold 4
+
+///Above this memory pressure a render is removed
+#define kParallelRenderHighMemoryPressure 0.98
+
+///The number of decisions remembered for the render stats
+#define kParallelRenderMaxDecisions 100
+
+///The memory pressure is sampled at most once per this duration (in seconds): reading it parses /proc/meminfo
+#define kParallelRenderMemoryPressureSampleInterval 0.1
+
+NATRON_NAMESPACE_ENTER;
+
+ParallelRenderController::ParallelRenderController()
+    : _lock()
+    , _nParallelRenders(1)
+    , _minParallelRenders(1)
+    , _maxParallelRenders(1)
+    , _direction(1)
+    , _previousFPS(0)
+    , _lastFPS(0)
+    , _nWindowsToHold(0)
+    , _startTime(0)
+    , _windowStart(0)
+    , _windowFrames(0)
+    , _windowMemoryPressure(0)
+    , _decisions()
+{
+}
+
+ParallelRenderController::~ParallelRenderController()
+{
+}
+
+void
+ParallelRenderController::reset(int nParallelRenders,
+                                int minParallelRenders,
+                                int maxParallelRenders,
+                                double time)
+{
+    QMutexLocker k(&_lock);
+
+    _minParallelRenders = std::max(1, minParallelRenders);
+    _maxParallelRenders = std::max(_minParallelRenders, maxParallelRenders);
+    _nParallelRenders = std::min( std::max(nParallelRenders, _minParallelRenders), _maxParallelRenders );
+    _direction = 1;
+    _previousFPS = 0;
+    _lastFPS = 0;
+    _nWindowsToHold = 0;
+    _startTime = time;
+    _windowStart = time;
+    _windowFrames = 0;
+    _windowMemoryPressure = 0;
+    _decisions.clear();
+}
+
+bool
+ParallelRenderController::notifyFrameRendered(double time,
+                                              double memoryPressure)
+{
+    QMutexLocker k(&_lock);
+
+    ++_windowFrames;
+    _windowMemoryPressure = std::max(_windowMemoryPressure, memoryPressure);
+
+    double duration = time - _windowStart;
+    if ( ( _windowFrames < std::max(kParallelRenderMinFramesPerWindow, 2 * _nParallelRenders) ) ||
+         ( duration < kParallelRenderMinWindowDuration) ) {
+        return false;
+    }
+
+    double measuredFPS = _windowFrames / duration;
+    double fps = measuredFPS;
+    int nParallelRenders = _nParallelRenders;
+    std::string reason;
+
+    if (_windowMemoryPressure >= kParallelRenderHighMemoryPressure) {
+        // The caches are evicting: fewer frames in memory at once, the throughput of this window is not a reference
+        _direction = -1;
+        _nWindowsToHold = kParallelRenderWindowsToHold;
+        nParallelRenders = std::max(_minParallelRenders, _nParallelRenders - 1);
+        reason = "memory pressure";
+        fps = 0;
+    } else if (_nWindowsToHold > 0) {
+        --_nWindowsToHold;
+        if (_nWindowsToHold == 0) {
+            nParallelRenders = _nParallelRenders + _direction;
+            reason = "trying another count";
+        }
+    } else if (_previousFPS == 0) {
+        nParallelRenders = _nParallelRenders + _direction;
+        reason = "first measure";
+    } else if (fps > _previousFPS * (1. + kParallelRenderMinGain) ) {
+        // The last move helped, keep going
+        nParallelRenders = _nParallelRenders + _direction;
+        reason = "throughput improved";
+    } else if (fps < _previousFPS * (1. - kParallelRenderMinGain) ) {
+        // The last move hurt, go back and stay there for a while. The next try goes the other way.
+        nParallelRenders = _nParallelRenders - _direction;
+        _direction = -_direction;
+        _nWindowsToHold = kParallelRenderWindowsToHold;
+        reason = "throughput dropped";
+    } else if (_direction > 0) {
+        // The render added did not help, it only costs memory
+        nParallelRenders = _nParallelRenders - 1;
+        _nWindowsToHold = kParallelRenderWindowsToHold;
+        reason = "no gain";
+    } else {
+        // The render removed was not useful, keep removing
+        nParallelRenders = _nParallelRenders - 1;
+        reason = "no loss";
+    }
+
+    if ( (nParallelRenders < _minParallelRenders) || (nParallelRenders > _maxParallelRenders) ) {
+        // At a bound, the next try goes the other way
+        nParallelRenders = _nParallelRenders;
+        _direction = -_direction;
+        _nWindowsToHold = kParallelRenderWindowsToHold;
+    }
+
+    _previousFPS = fps;
+    _lastFPS = measuredFPS;
+    _windowStart = time;
+    _windowFrames = 0;
+    double windowMemoryPressure = _windowMemoryPressure;
+    _windowMemoryPressure = 0;
+
+    if (nParallelRenders == _nParallelRenders) {
+        return false;
+    }
+    _nParallelRenders = nParallelRenders;
+    addDecision(time, measuredFPS, windowMemoryPressure, reason);
+
+    return true;
+} // ParallelRenderController::notifyFrameRendered
+
+void
+ParallelRenderController::addDecision(double time,
+                                      double fps,
+                                      double memoryPressure,
+                                      const std::string & reason)
+{
+    //Private - should be locked
+    ParallelRenderDecision decision;
+
+    decision.time = time - _startTime;
+    decision.nParallelRenders = _nParallelRenders;
+    decision.framesPerSecond = fps;
+    decision.memoryPressure = memoryPressure;
+    decision.reason = reason;
+    _decisions.push_back(decision);
+    if ( (int)_decisions.size() > kParallelRenderMaxDecisions ) {
+        _decisions.pop_front();
+    }
+}
+
+int
+ParallelRenderController::getParallelRenders() const
+{
+    QMutexLocker k(&_lock);
+
+    return _nParallelRenders;
+}
+
+double
+ParallelRenderController::getFramesPerSecond() const
+{
+    QMutexLocker k(&_lock);
+
+    return _lastFPS;
+}
+
+std::list<ParallelRenderDecision>
+ParallelRenderController::getDecisions() const
+{
+    QMutexLocker k(&_lock);
+
+    return _decisions;
+}
+
+namespace {
+///The last sample of the memory pressure, shared by all the render threads
+struct MemoryPressureSample
+{
+    QMutex lock;
+    bool valid;
+    timeval time;
+    double pressure;
+
+    MemoryPressureSample()
+        : lock()
+        , valid(false)
+        , time()
+        , pressure(0.)
+    {
+    }
+};
+
+MemoryPressureSample memoryPressureSample;
+} // anon namespace
+
+double
+ParallelRenderController::getCurrentMemoryPressure()
+{
+    timeval now;
+
+    gettimeofday(&now, 0);
+
+    QMutexLocker k(&memoryPressureSample.lock);
+    if (memoryPressureSample.valid) {
+        double age = (now.tv_sec - memoryPressureSample.time.tv_sec) + (now.tv_usec - memoryPressureSample.time.tv_usec) * 1e-6;
+        // age < 0 if the clock was set back
+        if ( (age >= 0.) && (age < kParallelRenderMemoryPressureSampleInterval) ) {
+            return memoryPressureSample.pressure;
+        }
+    }
+    memoryPressureSample.pressure = computeMemoryPressure( (double)getSystemTotalRAM(), (double)getAmountAvailablePhysicalRAM(),
+                                                           appPTR->getCurrentSettings()->getUnreachableRamPercent() );
+    memoryPressureSample.time = now;
+    memoryPressureSample.valid = true;
+
+    return memoryPressureSample.pressure;
+}
+
+double
+ParallelRenderController::computeMemoryPressure(double totalRAM,
+                                                double availableRAM,
+                                                double ramToKeepFreePercent)
+{
+    double ramToKeepFree = totalRAM * ramToKeepFreePercent;
+
+    if (totalRAM <= ramToKeepFree) {
+        return 0.;
+    }
+    double freeRAM = availableRAM - ramToKeepFree;
+
+    return std::min( 1., std::max(0., 1. - freeRAM / (totalRAM - ramToKeepFree) ) );
+}
+
+NATRON_NAMESPACE_EXIT;
@@ -0,0 +1,150 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_PARALLELRENDERCONTROLLER_H
+#define NATRON_ENGINE_PARALLELRENDERCONTROLLER_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <list>
+#include <string>
+
+#include <QtCore/QMutex>
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief A change of the number of parallel renders decided by the ParallelRenderController
+ **/
+struct ParallelRenderDecision
+{
+    double time; //< seconds since the render started
+    int nParallelRenders; //< the new number of parallel renders
+    double framesPerSecond; //< the throughput measured over the window which led to the decision
+    double memoryPressure; //< the highest memory pressure of the window
+    std::string reason;
+
+    ParallelRenderDecision()
+        : time(0)
+        , nParallelRenders(0)
+        , framesPerSecond(0)
+        , memoryPressure(0)
+        , reason()
+    {
+    }
+};
+
+/**
+ * @brief Chooses the number of frames rendered in parallel by the OutputSchedulerThread from the measured throughput.
+ *
+ * The completed frames are counted over windows of at least 2 frames per parallel render: at the end of a window the
+ * frames per second are compared with those of the previous window. The number of parallel renders keeps moving by one
+ * in the same direction while the throughput improves and goes back when it gets worse (hill-climbing). When it does not
+ * change the throughput the fewer renders are kept, since they use less memory, and another count is tried a few windows
+ * later in case the graph or the machine load changed. This takes into account what the thread count alone does not: the
+ * memory bandwidth, the caches and the threads started by the plug-ins and the tiles of each frame.
+ *
+ * When the memory pressure reaches the part of the RAM that must be kept free, one render is removed whatever the throughput.
+ *
+ * This class is MT-safe: the render threads notify the frames they rendered.
+ **/
+class ParallelRenderController
+{
+public:
+
+    ParallelRenderController();
+
+    ~ParallelRenderController();
+
+    /**
+     * @brief Starts a new render with nParallelRenders, which may then go from minParallelRenders to maxParallelRenders.
+     **/
+    void reset(int nParallelRenders,
+               int minParallelRenders,
+               int maxParallelRenders,
+               double time);
+
+    /**
+     * @brief Counts a frame rendered at the given time (in seconds), the memory pressure being sampled at the same time.
+     * @returns True if the number of parallel renders changed.
+     **/
+    bool notifyFrameRendered(double time,
+                             double memoryPressure);
+
+    int getParallelRenders() const;
+
+    /**
+     * @brief The throughput of the last complete window, 0 if there is none yet
+     **/
+    double getFramesPerSecond() const;
+
+    /**
+     * @brief The changes of the number of parallel renders since reset(), oldest first
+     **/
+    std::list<ParallelRenderDecision> getDecisions() const;
+
+    /**
+     * @brief Returns the part of the RAM in use, 1 meaning that the available RAM is down to the part the user wants to keep free
+     * (@see Settings::getUnreachableRamPercent()), in which case the caches start evicting. The page cache is not counted as
+     * used: the kernel gives it back on demand (@see getAmountAvailablePhysicalRAM()).
+     * This is called by every render thread: the RAM is sampled at most once per kParallelRenderMemoryPressureSampleInterval
+     * and the last sample is returned in between.
+     **/
+    static double getCurrentMemoryPressure();
+
+    /**
+     * @brief The memory pressure of a machine with totalRAM bytes, of which availableRAM can still be allocated and
+     * ramToKeepFreePercent must be kept free.
+     **/
+    static double computeMemoryPressure(double totalRAM,
+                                        double availableRAM,
+                                        double ramToKeepFreePercent);
+
+private:
+
+    void addDecision(double time,
+                     double fps,
+                     double memoryPressure,
+                     const std::string & reason);
+
+    mutable QMutex _lock;
+    int _nParallelRenders;
+    int _minParallelRenders;
+    int _maxParallelRenders;
+    int _direction; //< +1 or -1, the direction of the next move
+    double _previousFPS; //< the throughput the next window is compared with, 0 if there is none
+    double _lastFPS; //< the throughput of the last window
+    int _nWindowsToHold; //< while > 0 the count is kept, then a move is tried again
+    double _startTime;
+    double _windowStart;
+    int _windowFrames;
+    double _windowMemoryPressure;
+    std::list<ParallelRenderDecision> _decisions;
+};
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_PARALLELRENDERCONTROLLER_H
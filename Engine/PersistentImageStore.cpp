@@ -0,0 +1,687 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "PersistentImageStore.h"
+
+#include <map>
+#include <vector>
+#include <sstream>
+#include <iomanip>
+#include <cassert>
+#include <stdexcept>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QDebug>
+
+#include "Engine/CacheCompressor.h"
+#include "Engine/FStreamsSupport.h"
+#include "Engine/Hash64.h"
+#include "Engine/Image.h"
+#include "Engine/ImageSerialization.h"
+#include "Engine/ImageParamsSerialization.h"
+#include "Engine/NonKeyParamsSerialization.h"
+#include "Engine/RectDSerialization.h"
+#include "Engine/RectISerialization.h"
+
+///"NTPI" when read as little-endian, files written on a machine with a different endianness are ignored
+#define NATRON_PERSISTENT_IMAGE_STORE_MAGIC 0x4950544e
+
+///Above that many images waiting to be written, new images are not stored
+#define NATRON_PERSISTENT_IMAGE_STORE_MAX_PENDING_WRITES 32
+
+///A key which was not found is not looked up again in the directory during this many milliseconds, after which
+///another process may have stored it
+#define NATRON_PERSISTENT_IMAGE_STORE_MISS_LIFETIME_MS 10000
+
+///Above that many keys remembered as not found, they are all forgotten
+#define NATRON_PERSISTENT_IMAGE_STORE_MAX_MISSES 65536
+
+NATRON_NAMESPACE_ENTER;
+
+namespace {
+
+/*
+ * Layout of a file of the store:
+ * - 4 U32: magic, version, size of the header in bytes, reserved
+ * - the header: a binary archive of the store key, the ImageParams, the bitdepth and the pixel aspect ratio
+ * - 2 U64: size of the pixels in bytes, size of the data that follows
+ * - the pixels, compressed with CacheCompressor unless both sizes are equal
+ */
+
+std::string
+hashToString(U64 hash)
+{
+    std::stringstream ss;
+
+    ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+
+    return ss.str();
+}
+
+/**
+ * @brief All the images of a key live in the same directory, so that a look-up lists a single small directory.
+ * The directories are spread in 256 sub-directories to keep each of them small.
+ **/
+std::string
+getKeyDirectory(const std::string & location,
+                U64 keyHash)
+{
+    std::string hashStr = hashToString(keyHash);
+
+    return location + hashStr.substr(0, 2) + '/' + hashStr + '/';
+}
+
+/**
+ * @brief Images of the same key are identified by their mipmap level, bitdepth and components
+ **/
+std::string
+getImageFileName(const ImageParams & params)
+{
+    Hash64 compsHash;
+    const ImageComponents & comps = params.getComponents();
+
+    Hash64_appendQString( &compsHash, QString::fromUtf8( comps.getLayerName().c_str() ) );
+    Hash64_appendQString( &compsHash, QString::fromUtf8( comps.getComponentsGlobalName().c_str() ) );
+    compsHash.computeHash();
+
+    std::stringstream ss;
+    ss << 'm' << params.getMipMapLevel() << "_d" << (int)params.getBitDepth() << '_' << hashToString( compsHash.value() ) << "." NATRON_PERSISTENT_IMAGE_STORE_FILE_EXT;
+
+    return ss.str();
+}
+
+bool
+readHeader(std::istream & is,
+           ImageKey* key,
+           boost::shared_ptr<ImageParams>* params)
+{
+    U32 preamble[4];
+
+    is.read( (char*)preamble, sizeof(preamble) );
+    if ( !is || (preamble[0] != NATRON_PERSISTENT_IMAGE_STORE_MAGIC) || (preamble[1] != NATRON_PERSISTENT_IMAGE_STORE_VERSION) ||
+         (preamble[2] == 0) || (preamble[2] > 1024 * 1024) ) {
+        return false;
+    }
+    std::string header(preamble[2], '\0');
+    is.read(&header[0], header.size());
+    if (!is) {
+        return false;
+    }
+
+    try {
+        std::istringstream ss(header);
+        boost::archive::binary_iarchive iArchive(ss);
+        ImageParams p;
+        int bitdepth;
+        double par;
+        iArchive >> *key;
+        iArchive >> p;
+        iArchive >> bitdepth;
+        iArchive >> par;
+        params->reset( new ImageParams(p.getCost(), p.getRoD(), par, p.getMipMapLevel(), p.getBounds(), (ImageBitDepthEnum)bitdepth,
+                                       p.getFieldingOrder(), p.getPremultiplication(), p.isRodProjectFormat(), p.getComponents()) );
+    } catch (const std::exception & e) {
+        qDebug() << "Failed to read the header of a persistent image:" << e.what();
+
+        return false;
+    }
+
+    return true;
+}
+
+bool
+readHeader(const std::string & filePath,
+           ImageKey* key,
+           boost::shared_ptr<ImageParams>* params)
+{
+    boost::shared_ptr<std::istream> ifile = FStreamsSupport::open_ifstream(filePath, std::ios_base::in | std::ios_base::binary);
+
+    if (!ifile) {
+        return false;
+    }
+
+    return readHeader(*ifile, key, params);
+}
+} // anon namespace
+
+/**
+ * @brief Writes the images queued by PersistentImageStore::store(), so that the render threads never wait on the disk
+ * or the network.
+ **/
+class PersistentImageStoreWriterThread
+    : public QThread
+{
+    PersistentImageStore* _store;
+    mutable QMutex _queueMutex;
+    std::list<std::pair<ImagePtr, ImageKey> > _queue;
+    QWaitCondition _queueNotEmptyCond;
+    QMutex _mustQuitMutex;
+    QWaitCondition _mustQuitCond;
+    bool _mustQuit;
+
+public:
+
+    PersistentImageStoreWriterThread(PersistentImageStore* store)
+        : QThread()
+        , _store(store)
+        , _queueMutex()
+        , _queue()
+        , _queueNotEmptyCond()
+        , _mustQuitMutex()
+        , _mustQuitCond()
+        , _mustQuit(false)
+    {
+        setObjectName("PersistentImageStoreWriter");
+    }
+
+    virtual ~PersistentImageStoreWriterThread()
+    {
+    }
+
+    void appendToQueue(const ImagePtr & image,
+                       const ImageKey & storeKey)
+    {
+        {
+            QMutexLocker k(&_queueMutex);
+            if (_queue.size() >= NATRON_PERSISTENT_IMAGE_STORE_MAX_PENDING_WRITES) {
+                // The images in the queue cannot be evicted from the cache, do not hold too many of them
+                return;
+            }
+            _queue.push_back( std::make_pair(image, storeKey) );
+        }
+        if ( !isRunning() ) {
+            start();
+        } else {
+            QMutexLocker k(&_queueMutex);
+            _queueNotEmptyCond.wakeOne();
+        }
+    }
+
+    void quitThread()
+    {
+        if ( !isRunning() ) {
+            return;
+        }
+        QMutexLocker k(&_mustQuitMutex);
+        assert(!_mustQuit);
+        _mustQuit = true;
+
+        {
+            QMutexLocker k2(&_queueMutex);
+            _queue.push_back( std::make_pair( ImagePtr(), ImageKey() ) );
+            _queueNotEmptyCond.wakeOne();
+        }
+        while (_mustQuit) {
+            _mustQuitCond.wait(&_mustQuitMutex);
+        }
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        for (;; ) {
+            bool quit;
+            {
+                QMutexLocker k(&_mustQuitMutex);
+                quit = _mustQuit;
+            }
+
+            std::pair<ImagePtr, ImageKey> front;
+            {
+                QMutexLocker k(&_queueMutex);
+                if ( quit && ( _queue.empty() || ( (_queue.size() == 1) && !_queue.front().first ) ) ) {
+                    _queue.clear();
+                    k.unlock();
+                    QMutexLocker k2(&_mustQuitMutex);
+                    assert(_mustQuit);
+                    _mustQuit = false;
+                    _mustQuitCond.wakeOne();
+
+                    return;
+                }
+                while ( _queue.empty() ) {
+                    _queueNotEmptyCond.wait(&_queueMutex);
+                }
+
+                assert( !_queue.empty() );
+                front = _queue.front();
+                _queue.pop_front();
+            }
+            if (front.first) {
+                _store->storeBlocking(*front.first, front.second);
+            }
+        }
+    }
+};
+
+struct PersistentImageStorePrivate
+{
+    mutable QMutex lock; //< protects location, maximumSize, currentSize, currentSizeKnown and misses
+    std::string location; //< ends with a separator, empty when the store is disabled
+    U64 maximumSize;
+    U64 currentSize;
+    bool currentSizeKnown; //< false until the store directory has been scanned
+    std::map<U64, qint64> misses; //< hash of the store keys not found by lookup() and the time of the look-up
+    boost::scoped_ptr<PersistentImageStoreWriterThread> writer;
+
+    PersistentImageStorePrivate(PersistentImageStore* store)
+        : lock()
+        , location()
+        , maximumSize(0)
+        , currentSize(0)
+        , currentSizeKnown(false)
+        , misses()
+        , writer( new PersistentImageStoreWriterThread(store) )
+    {
+    }
+
+    void onFileWritten(const std::string & writtenLocation, U64 fileSize);
+
+    void onMiss(const std::string & lookupLocation, U64 keyHash, qint64 time);
+};
+
+PersistentImageStore::PersistentImageStore()
+    : _imp( new PersistentImageStorePrivate(this) )
+{
+}
+
+PersistentImageStore::~PersistentImageStore()
+{
+    quitThread();
+}
+
+void
+PersistentImageStore::setLocation(const std::string & path)
+{
+    std::string location = path;
+
+    if ( !location.empty() && (location[location.size() - 1] != '/') && (location[location.size() - 1] != '\\') ) {
+        location += '/';
+    }
+    if ( !location.empty() ) {
+        QDir().mkpath( QString::fromUtf8( location.c_str() ) );
+    }
+    QMutexLocker k(&_imp->lock);
+    if (location != _imp->location) {
+        _imp->location = location;
+        _imp->currentSize = 0;
+        _imp->currentSizeKnown = false;
+        _imp->misses.clear();
+    }
+}
+
+std::string
+PersistentImageStore::getLocation() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return _imp->location;
+}
+
+bool
+PersistentImageStore::isEnabled() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return !_imp->location.empty();
+}
+
+void
+PersistentImageStore::setMaximumSize(U64 size)
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->maximumSize = size;
+}
+
+ImageKey
+PersistentImageStore::getStoreKey(const ImageKey & key,
+                                  U64 contentHash)
+{
+    return ImageKey(0, contentHash, key._frameVaryingOrAnimated, key._time, ViewIdx(key._view), key._pixelAspect, key._draftMode, key._fullScaleWithDownscaleInputs);
+}
+
+bool
+PersistentImageStore::lookup(const ImageKey & storeKey,
+                             std::list<StoredImageInfo>* images) const
+{
+    std::string location;
+    U64 keyHash = storeKey.getHash();
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    {
+        QMutexLocker k(&_imp->lock);
+        location = _imp->location;
+        if ( location.empty() ) {
+            return false;
+        }
+        // Most look-ups miss, do not list the directory again for each of them
+        std::map<U64, qint64>::iterator foundMiss = _imp->misses.find(keyHash);
+        if ( foundMiss != _imp->misses.end() ) {
+            if ( (now >= foundMiss->second) && (now - foundMiss->second < NATRON_PERSISTENT_IMAGE_STORE_MISS_LIFETIME_MS) ) {
+                return false;
+            }
+            _imp->misses.erase(foundMiss);
+        }
+    }
+
+    QDir dir( QString::fromUtf8( getKeyDirectory(location, keyHash).c_str() ) );
+    if ( !dir.exists() ) {
+        _imp->onMiss(location, keyHash, now);
+
+        return false;
+    }
+
+    // Files being written have a temporary extension and are not listed
+    QStringList files = dir.entryList(QStringList( QString::fromUtf8("*." NATRON_PERSISTENT_IMAGE_STORE_FILE_EXT) ), QDir::Files);
+    bool found = false;
+    for (QStringList::const_iterator it = files.begin(); it != files.end(); ++it) {
+        StoredImageInfo info;
+        info.filePath = dir.absoluteFilePath(*it).toStdString();
+        ImageKey storedKey;
+        // Also check the key itself in case 2 keys have the same hash
+        if ( readHeader(info.filePath, &storedKey, &info.params) && (storedKey == storeKey) ) {
+            images->push_back(info);
+            found = true;
+        }
+    }
+    if (!found) {
+        _imp->onMiss(location, keyHash, now);
+    }
+
+    return found;
+}
+
+bool
+PersistentImageStore::readPixels(const std::string & filePath,
+                                 Image* image)
+{
+    assert(image);
+    boost::shared_ptr<std::istream> ifile = FStreamsSupport::open_ifstream(filePath, std::ios_base::in | std::ios_base::binary);
+    if (!ifile) {
+        return false;
+    }
+
+    ImageKey storedKey;
+    boost::shared_ptr<ImageParams> storedParams;
+    if ( !readHeader(*ifile, &storedKey, &storedParams) ) {
+        return false;
+    }
+
+    const RectI & bounds = storedParams->getBounds();
+    if ( ( image->getBounds() != bounds ) || ( image->getBitDepth() != storedParams->getBitDepth() ) ||
+         ( image->getComponents() != storedParams->getComponents() ) ) {
+        return false;
+    }
+
+    U64 sizes[2];
+    ifile->read( (char*)sizes, sizeof(sizes) );
+    if (!*ifile) {
+        return false;
+    }
+
+    int elementSize = getSizeOfForBitDepth( storedParams->getBitDepth() );
+    U64 rawSize = bounds.area() * storedParams->getComponents().getNumComponents() * elementSize;
+    if ( (sizes[0] != rawSize) || (sizes[1] > rawSize) || (rawSize == 0) ) {
+        return false;
+    }
+
+    Image::WriteAccess acc = image->getWriteRights();
+    unsigned char* pixels = acc.pixelAt(bounds.x1, bounds.y1);
+    if (!pixels) {
+        return false;
+    }
+
+    if (sizes[1] == rawSize) {
+        ifile->read( (char*)pixels, rawSize );
+
+        return (U64)ifile->gcount() == rawSize;
+    }
+
+    std::vector<unsigned char> compressed(sizes[1]);
+    ifile->read( (char*)&compressed[0], compressed.size() );
+    if ( (U64)ifile->gcount() != sizes[1] ) {
+        return false;
+    }
+
+    return CacheCompressor::decompress(&compressed[0], compressed.size(), elementSize, pixels, rawSize);
+} // PersistentImageStore::readPixels
+
+void
+PersistentImageStore::store(const ImagePtr & image,
+                            const ImageKey & storeKey)
+{
+    if ( !image || !isEnabled() ) {
+        return;
+    }
+    _imp->writer->appendToQueue(image, storeKey);
+}
+
+bool
+PersistentImageStore::storeBlocking(const Image & image,
+                                    const ImageKey & storeKey)
+{
+    std::string location = getLocation();
+
+    if ( location.empty() ) {
+        return false;
+    }
+
+    const ImageKey & key = storeKey;
+    const RectI & bounds = image.getBounds();
+
+    // Draft renders are of lower quality, another session is better off rendering the image again
+    if ( key._draftMode || bounds.isNull() ) {
+        return false;
+    }
+    std::list<RectI> restToRender;
+    image.getRestToRender(bounds, restToRender);
+    if ( !restToRender.empty() ) {
+        return false;
+    }
+
+    boost::shared_ptr<ImageParams> params = image.getParams();
+    std::string directory = getKeyDirectory( location, key.getHash() );
+    std::string filePath = directory + getImageFileName(*params);
+
+    // Do not write again an image that was already stored with bounds at least as large
+    {
+        ImageKey storedKey;
+        boost::shared_ptr<ImageParams> storedParams;
+        if ( readHeader(filePath, &storedKey, &storedParams) && (storedKey == key) && storedParams->getBounds().contains(bounds) ) {
+            return false;
+        }
+    }
+
+    std::string header;
+    try {
+        std::ostringstream ss;
+        {
+            boost::archive::binary_oarchive oArchive(ss);
+            int bitdepth = (int)image.getBitDepth();
+            double par = image.getPixelAspectRatio();
+            oArchive << key;
+            oArchive << *params;
+            oArchive << bitdepth;
+            oArchive << par;
+        }
+        header = ss.str();
+    } catch (const std::exception & e) {
+        qDebug() << "Failed to serialize the header of a persistent image:" << e.what();
+
+        return false;
+    }
+
+    int elementSize = getSizeOfForBitDepth( image.getBitDepth() );
+    U64 sizes[2];
+    sizes[0] = bounds.area() * image.getComponentsCount() * elementSize;
+    std::vector<unsigned char> data;
+    {
+        Image::ReadAccess acc = image.getReadRights();
+        const unsigned char* pixels = acc.pixelAt(bounds.x1, bounds.y1);
+        if (!pixels) {
+            return false;
+        }
+        sizes[1] = CacheCompressor::compress(pixels, sizes[0], elementSize, &data);
+        if ( (sizes[1] == 0) || (sizes[1] >= sizes[0]) ) {
+            data.assign(pixels, pixels + sizes[0]);
+            sizes[1] = sizes[0];
+        }
+    }
+
+    QString qDirectory = QString::fromUtf8( directory.c_str() );
+    QString qFilePath = QString::fromUtf8( filePath.c_str() );
+    if ( !QDir().mkpath(qDirectory) ) {
+        return false;
+    }
+
+    // Several processes, possibly on several machines, may write the same image at the same time: write to a name
+    // unique to this process and rename it, the last rename wins and readers never see a partial file.
+    static QAtomicInt tmpCounter;
+    std::stringstream tmpSs;
+    tmpSs << filePath << '.' << QCoreApplication::applicationPid() << '.' << QDateTime::currentMSecsSinceEpoch()
+          << '.' << tmpCounter.fetchAndAddRelaxed(1) << ".tmp";
+    std::string tmpFilePath = tmpSs.str();
+    QString qTmpFilePath = QString::fromUtf8( tmpFilePath.c_str() );
+    {
+        boost::shared_ptr<std::ostream> ofile = FStreamsSupport::open_ofstream(tmpFilePath, std::ios_base::out | std::ios_base::binary);
+        if (!ofile) {
+            return false;
+        }
+        U32 preamble[4] = { NATRON_PERSISTENT_IMAGE_STORE_MAGIC, NATRON_PERSISTENT_IMAGE_STORE_VERSION, (U32)header.size(), 0 };
+        ofile->write( (const char*)preamble, sizeof(preamble) );
+        ofile->write( header.c_str(), header.size() );
+        ofile->write( (const char*)sizes, sizeof(sizes) );
+        ofile->write( (const char*)&data[0], data.size() );
+        ofile->flush();
+        if (!*ofile) {
+            ofile.reset();
+            QFile::remove(qTmpFilePath);
+
+            return false;
+        }
+    }
+    if ( !QFile::rename(qTmpFilePath, qFilePath) ) {
+        // QFile::rename does not overwrite
+        QFile::remove(qFilePath);
+        if ( !QFile::rename(qTmpFilePath, qFilePath) ) {
+            QFile::remove(qTmpFilePath);
+
+            return false;
+        }
+    }
+
+    {
+        QMutexLocker k(&_imp->lock);
+        _imp->misses.erase( key.getHash() );
+    }
+    _imp->onFileWritten( location, sizeof(U32) * 4 + header.size() + sizeof(sizes) + data.size() );
+
+    return true;
+} // PersistentImageStore::storeBlocking
+
+void
+PersistentImageStorePrivate::onMiss(const std::string & lookupLocation,
+                                    U64 keyHash,
+                                    qint64 time)
+{
+    QMutexLocker k(&lock);
+
+    if (lookupLocation != location) {
+        return;
+    }
+    if (misses.size() >= NATRON_PERSISTENT_IMAGE_STORE_MAX_MISSES) {
+        misses.clear();
+    }
+    misses[keyHash] = time;
+}
+
+void
+PersistentImageStorePrivate::onFileWritten(const std::string & writtenLocation,
+                                           U64 fileSize)
+{
+    U64 maxSize;
+    {
+        QMutexLocker k(&lock);
+        if ( (writtenLocation != location) || (maximumSize == 0) ) {
+            return;
+        }
+        maxSize = maximumSize;
+        if (currentSizeKnown) {
+            currentSize += fileSize;
+            if (currentSize <= maxSize) {
+                return;
+            }
+        }
+    }
+
+    // The size of the store is unknown or exceeds the limit: scan the directory. Other processes write to it too,
+    // so this is also where their images are accounted for.
+    std::multimap<qint64, std::pair<QString, qint64> > filesByDate;
+    U64 totalSize = 0;
+    QDirIterator it(QString::fromUtf8( writtenLocation.c_str() ),
+                    QStringList( QString::fromUtf8("*." NATRON_PERSISTENT_IMAGE_STORE_FILE_EXT) ),
+                    QDir::Files,
+                    QDirIterator::Subdirectories);
+    while ( it.hasNext() ) {
+        it.next();
+        QFileInfo info = it.fileInfo();
+        totalSize += info.size();
+        filesByDate.insert( std::make_pair( info.lastModified().toMSecsSinceEpoch(), std::make_pair( info.absoluteFilePath(), info.size() ) ) );
+    }
+
+    if (totalSize > maxSize) {
+        // Remove the least recently written images until the store is back under 90% of its maximum size
+        U64 targetSize = maxSize * 0.9;
+        for (std::multimap<qint64, std::pair<QString, qint64> >::iterator it2 = filesByDate.begin();
+             it2 != filesByDate.end() && totalSize > targetSize; ++it2) {
+            if ( QFile::remove(it2->second.first) ) {
+                totalSize -= it2->second.second;
+            }
+        }
+    }
+
+    QMutexLocker k(&lock);
+    if (writtenLocation == location) {
+        currentSize = totalSize;
+        currentSizeKnown = true;
+    }
+} // PersistentImageStorePrivate::onFileWritten
+
+void
+PersistentImageStore::quitThread()
+{
+    _imp->writer->quitThread();
+}
+
+NATRON_NAMESPACE_EXIT;
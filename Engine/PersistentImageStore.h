@@ -0,0 +1,134 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_PERSISTENTIMAGESTORE_H
+#define NATRON_ENGINE_PERSISTENTIMAGESTORE_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <list>
+#include <string>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Global/GlobalDefines.h"
+#include "Engine/EngineFwd.h"
+
+///Increment when the layout of the files changes, files of other versions are ignored
+#define NATRON_PERSISTENT_IMAGE_STORE_VERSION 2
+
+///Extension of the files of the store
+#define NATRON_PERSISTENT_IMAGE_STORE_FILE_EXT "ntpi"
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief An image stored in the PersistentImageStore, as returned by PersistentImageStore::lookup()
+ **/
+struct StoredImageInfo
+{
+    std::string filePath;
+    boost::shared_ptr<ImageParams> params;
+};
+
+struct PersistentImageStorePrivate;
+
+/**
+ * @brief A content-addressed store of rendered images in a directory, which outlives the NodeCache.
+ * Images are filed under their store key: their ImageKey in which the node hash, which depends on the session, is
+ * replaced by the content hash of the node (@see Node::computeContentHash()). Another session opening the same project,
+ * possibly on another machine sharing the directory (e.g: over NFS), finds the images instead of rendering them again,
+ * as long as the parameters, the plug-ins and the files read did not change.
+ *
+ * Files are written under a temporary name and then renamed, so that readers never see a partially written
+ * image. They are never modified afterwards, only replaced by an image of the same key covering larger bounds
+ * or removed when the store exceeds its maximum size.
+ **/
+class PersistentImageStore
+{
+public:
+
+    PersistentImageStore();
+
+    ~PersistentImageStore();
+
+    /**
+     * @brief Set the directory of the store. An empty path disables the store.
+     **/
+    void setLocation(const std::string & path);
+
+    std::string getLocation() const;
+
+    bool isEnabled() const;
+
+    /**
+     * @brief When the store grows beyond this size in bytes, the least recently written images are removed.
+     * The size is only approximate since other processes may write to the same directory. 0 means no limit.
+     **/
+    void setMaximumSize(U64 size);
+
+    /**
+     * @brief Returns the key under which the images of the given key are stored, contentHash being the content hash of
+     * the node at the time and view of the key.
+     **/
+    static ImageKey getStoreKey(const ImageKey & key, U64 contentHash);
+
+    /**
+     * @brief Returns the images stored for the given store key, whatever their mipmap level, bitdepth or components.
+     * A key which is not found is not looked up again in the directory for a few seconds, unless this store writes it.
+     **/
+    bool lookup(const ImageKey & storeKey, std::list<StoredImageInfo>* images) const;
+
+    /**
+     * @brief Reads the pixels of a stored image into the given image, which must be allocated with the params returned by lookup().
+     **/
+    static bool readPixels(const std::string & filePath, Image* image);
+
+    /**
+     * @brief Writes the image to the store under the given store key in a separate thread. This does nothing if the image
+     * is not entirely rendered or if the store already has it.
+     **/
+    void store(const boost::shared_ptr<Image> & image, const ImageKey & storeKey);
+
+    /**
+     * @brief Same as store() but the image is written in the calling thread. Returns false if the image was not written.
+     **/
+    bool storeBlocking(const Image & image, const ImageKey & storeKey);
+
+    /**
+     * @brief Waits for the pending writes and stops the writer thread.
+     **/
+    void quitThread();
+
+private:
+
+    boost::scoped_ptr<PersistentImageStorePrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_PERSISTENTIMAGESTORE_H
@@ -0,0 +1,872 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "PixelConversion.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstdlib> // rand
+#include <cstring> // memcpy
+#include <cassert>
+
+#include "Global/GlobalDefines.h"
+#include "Engine/Lut.h"
+#include "Engine/SimdSupport.h"
+
+#ifdef NATRON_SIMD_X86
+#include <immintrin.h>
+#endif
+
+NATRON_NAMESPACE_ENTER;
+
+namespace {
+
+/// Same as Image::convertPixelDepth to float
+inline float
+toFloat(unsigned char v)
+{
+    return Color::intToFloat<256>(v);
+}
+
+inline float
+toFloat(unsigned short v)
+{
+    return Color::intToFloat<65536>(v);
+}
+
+inline float
+toFloat(float v)
+{
+    return v;
+}
+
+/// Same as Image::convertPixelDepth from float
+template <typename DSTPIX>
+DSTPIX fromFloat(float v);
+
+template <>
+inline unsigned char
+fromFloat<unsigned char>(float v)
+{
+    return (unsigned char)Color::floatToInt<256>(v);
+}
+
+template <>
+inline unsigned short
+fromFloat<unsigned short>(float v)
+{
+    return (unsigned short)Color::floatToInt<65536>(v);
+}
+
+template <>
+inline float
+fromFloat<float>(float v)
+{
+    return v;
+}
+
+/// Same as Image::convertPixelDepth
+template <typename SRCPIX, typename DSTPIX>
+inline DSTPIX
+convertDepth(SRCPIX v)
+{
+    return fromFloat<DSTPIX>( toFloat(v) );
+}
+
+template <>
+inline unsigned char
+convertDepth<unsigned char, unsigned char>(unsigned char v)
+{
+    return v;
+}
+
+template <>
+inline unsigned short
+convertDepth<unsigned char, unsigned short>(unsigned char v)
+{
+    return Color::charToUint16(v);
+}
+
+template <>
+inline unsigned char
+convertDepth<unsigned short, unsigned char>(unsigned short v)
+{
+    return Color::uint16ToChar(v);
+}
+
+template <>
+inline unsigned short
+convertDepth<unsigned short, unsigned short>(unsigned short v)
+{
+    return v;
+}
+
+/// Same as Color::floatToInt<scale + 1>
+inline unsigned short
+quantize(float v,
+         float scale)
+{
+    if (v <= 0) {
+        return 0;
+    } else if (v >= 1.) {
+        return (unsigned short)scale;
+    }
+
+    return (unsigned short)(v * scale + 0.5);
+}
+
+/// The index of a float in Lut::getUint8xxTable(): its 16 most significant bits
+inline unsigned short
+floatHiPart(float v)
+{
+    union
+    {
+        float f;
+        U32 u;
+    } tmp;
+
+    tmp.f = v;
+
+    return (unsigned short)(tmp.u >> 16);
+}
+
+/// The conversions of the color-space luts to linear
+inline float
+toLinear(const Color::Lut* lut,
+         unsigned char v)
+{
+    return lut->fromColorSpaceUint8ToLinearFloatFast(v);
+}
+
+inline float
+toLinear(const Color::Lut* lut,
+         unsigned short v)
+{
+    return lut->fromColorSpaceUint16ToLinearFloatFast(v);
+}
+
+inline float
+toLinear(const Color::Lut* lut,
+         float v)
+{
+    return lut->fromColorSpaceFloatToLinearFloat(v);
+}
+
+template <typename SRCPIX, typename DSTPIX>
+void
+convertDepthRowScalar(const SRCPIX* src,
+                      int x1,
+                      int n,
+                      DSTPIX* dst)
+{
+    for (int i = x1; i < n; ++i) {
+        dst[i] = convertDepth<SRCPIX, DSTPIX>(src[i]);
+    }
+}
+
+void
+quantizeRowScalar(const float* src,
+                  int x1,
+                  int n,
+                  float scale,
+                  unsigned short* dst)
+{
+    for (int i = x1; i < n; ++i) {
+        dst[i] = quantize(src[i], scale);
+    }
+}
+
+#ifdef NATRON_SIMD_X86
+
+/// 4 values as 32-bit integers
+NATRON_SIMD_TARGET_SSE41
+inline __m128i
+loadIntsSSE41(const unsigned char* p)
+{
+    int v;
+
+    std::memcpy(&v, p, sizeof(int));
+
+    return _mm_cvtepu8_epi32( _mm_cvtsi32_si128(v) );
+}
+
+NATRON_SIMD_TARGET_SSE41
+inline __m128i
+loadIntsSSE41(const unsigned short* p)
+{
+    return _mm_cvtepu16_epi32( _mm_loadl_epi64( (const __m128i*)p ) );
+}
+
+NATRON_SIMD_TARGET_SSE41
+inline void
+storeIntsSSE41(__m128i v,
+               unsigned char* p)
+{
+    int b = _mm_cvtsi128_si32( _mm_packus_epi16( _mm_packus_epi32(v, v), v ) );
+
+    std::memcpy(p, &b, sizeof(int));
+}
+
+NATRON_SIMD_TARGET_SSE41
+inline void
+storeIntsSSE41(__m128i v,
+               unsigned short* p)
+{
+    _mm_storel_epi64( (__m128i*)p, _mm_packus_epi32(v, v) );
+}
+
+/// quantize() of the 4 lanes. The rounding is exact: floatToInt adds 0.5 in double precision
+NATRON_SIMD_TARGET_SSE41
+inline __m128i
+quantizeSSE41(__m128 v,
+              float scale)
+{
+    __m128 p = _mm_mul_ps( _mm_min_ps( _mm_max_ps( v, _mm_setzero_ps() ), _mm_set1_ps(1.f) ), _mm_set1_ps(scale) );
+    __m128i i = _mm_cvttps_epi32(p);
+    __m128 frac = _mm_sub_ps( p, _mm_cvtepi32_ps(i) );
+
+    return _mm_sub_epi32( i, _mm_castps_si128( _mm_cmpge_ps( frac, _mm_set1_ps(0.5f) ) ) );
+}
+
+/// Converts 4 values like convertDepth()
+template <typename SRCPIX, typename DSTPIX>
+struct DepthSSE41;
+
+template <>
+struct DepthSSE41<unsigned char, unsigned short>
+{
+    NATRON_SIMD_TARGET_SSE41
+    static inline void convert(const unsigned char* src,
+                        unsigned short* dst)
+    {
+        __m128i v = loadIntsSSE41(src);
+
+        storeIntsSSE41(_mm_or_si128(_mm_slli_epi32(v, 8), v), dst);
+    }
+};
+
+template <>
+struct DepthSSE41<unsigned short, unsigned char>
+{
+    NATRON_SIMD_TARGET_SSE41
+    static inline void convert(const unsigned short* src,
+                        unsigned char* dst)
+    {
+        __m128i v = _mm_add_epi32( loadIntsSSE41(src), _mm_set1_epi32(128) );
+
+        storeIntsSSE41(_mm_srli_epi32(_mm_sub_epi32( v, _mm_srli_epi32(v, 8) ), 8), dst);
+    }
+};
+
+template <>
+struct DepthSSE41<unsigned char, float>
+{
+    NATRON_SIMD_TARGET_SSE41
+    static inline void convert(const unsigned char* src,
+                        float* dst)
+    {
+        _mm_storeu_ps( dst, _mm_div_ps( _mm_cvtepi32_ps( loadIntsSSE41(src) ), _mm_set1_ps(255.f) ) );
+    }
+};
+
+template <>
+struct DepthSSE41<unsigned short, float>
+{
+    NATRON_SIMD_TARGET_SSE41
+    static inline void convert(const unsigned short* src,
+                        float* dst)
+    {
+        _mm_storeu_ps( dst, _mm_div_ps( _mm_cvtepi32_ps( loadIntsSSE41(src) ), _mm_set1_ps(65535.f) ) );
+    }
+};
+
+template <>
+struct DepthSSE41<float, unsigned char>
+{
+    NATRON_SIMD_TARGET_SSE41
+    static inline void convert(const float* src,
+                        unsigned char* dst)
+    {
+        storeIntsSSE41(quantizeSSE41(_mm_loadu_ps(src), 255.f), dst);
+    }
+};
+
+template <>
+struct DepthSSE41<float, unsigned short>
+{
+    NATRON_SIMD_TARGET_SSE41
+    static inline void convert(const float* src,
+                        unsigned short* dst)
+    {
+        storeIntsSSE41(quantizeSSE41(_mm_loadu_ps(src), 65535.f), dst);
+    }
+};
+
+template <typename SRCPIX, typename DSTPIX>
+NATRON_SIMD_TARGET_SSE41
+void
+convertDepthRowSSE41(const SRCPIX* src,
+                     int n,
+                     DSTPIX* dst)
+{
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        DepthSSE41<SRCPIX, DSTPIX>::convert(src + i, dst + i);
+    }
+    convertDepthRowScalar(src, i, n, dst);
+}
+
+NATRON_SIMD_TARGET_SSE41
+void
+quantizeRowSSE41(const float* src,
+                 int n,
+                 float scale,
+                 unsigned short* dst)
+{
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        storeIntsSSE41(quantizeSSE41(_mm_loadu_ps(src + i), scale), dst + i);
+    }
+    quantizeRowScalar(src, i, n, scale, dst);
+}
+
+/// 8 values as 32-bit integers
+NATRON_SIMD_TARGET_AVX2
+inline __m256i
+loadIntsAVX2(const unsigned char* p)
+{
+    return _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)p ) );
+}
+
+NATRON_SIMD_TARGET_AVX2
+inline __m256i
+loadIntsAVX2(const unsigned short* p)
+{
+    return _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)p ) );
+}
+
+/// The 8 lanes saturated to 16 bits, in order
+NATRON_SIMD_TARGET_AVX2
+inline __m128i
+packIntsAVX2(__m256i v)
+{
+    return _mm_packus_epi32( _mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1) );
+}
+
+NATRON_SIMD_TARGET_AVX2
+inline void
+storeIntsAVX2(__m256i v,
+              unsigned char* p)
+{
+    __m128i w = packIntsAVX2(v);
+
+    _mm_storel_epi64( (__m128i*)p, _mm_packus_epi16(w, w) );
+}
+
+NATRON_SIMD_TARGET_AVX2
+inline void
+storeIntsAVX2(__m256i v,
+              unsigned short* p)
+{
+    _mm_storeu_si128( (__m128i*)p, packIntsAVX2(v) );
+}
+
+/// quantize() of the 8 lanes, @see quantizeSSE41()
+NATRON_SIMD_TARGET_AVX2
+inline __m256i
+quantizeAVX2(__m256 v,
+             float scale)
+{
+    __m256 p = _mm256_mul_ps( _mm256_min_ps( _mm256_max_ps( v, _mm256_setzero_ps() ), _mm256_set1_ps(1.f) ), _mm256_set1_ps(scale) );
+    __m256i i = _mm256_cvttps_epi32(p);
+    __m256 frac = _mm256_sub_ps( p, _mm256_cvtepi32_ps(i) );
+
+    return _mm256_sub_epi32( i, _mm256_castps_si256( _mm256_cmp_ps(frac, _mm256_set1_ps(0.5f), _CMP_GE_OQ) ) );
+}
+
+/// Converts 8 values like convertDepth()
+template <typename SRCPIX, typename DSTPIX>
+struct DepthAVX2;
+
+template <>
+struct DepthAVX2<unsigned char, unsigned short>
+{
+    NATRON_SIMD_TARGET_AVX2
+    static inline void convert(const unsigned char* src,
+                        unsigned short* dst)
+    {
+        __m256i v = loadIntsAVX2(src);
+
+        storeIntsAVX2(_mm256_or_si256(_mm256_slli_epi32(v, 8), v), dst);
+    }
+};
+
+template <>
+struct DepthAVX2<unsigned short, unsigned char>
+{
+    NATRON_SIMD_TARGET_AVX2
+    static inline void convert(const unsigned short* src,
+                        unsigned char* dst)
+    {
+        __m256i v = _mm256_add_epi32( loadIntsAVX2(src), _mm256_set1_epi32(128) );
+
+        storeIntsAVX2(_mm256_srli_epi32(_mm256_sub_epi32( v, _mm256_srli_epi32(v, 8) ), 8), dst);
+    }
+};
+
+template <>
+struct DepthAVX2<unsigned char, float>
+{
+    NATRON_SIMD_TARGET_AVX2
+    static inline void convert(const unsigned char* src,
+                        float* dst)
+    {
+        _mm256_storeu_ps( dst, _mm256_div_ps( _mm256_cvtepi32_ps( loadIntsAVX2(src) ), _mm256_set1_ps(255.f) ) );
+    }
+};
+
+template <>
+struct DepthAVX2<unsigned short, float>
+{
+    NATRON_SIMD_TARGET_AVX2
+    static inline void convert(const unsigned short* src,
+                        float* dst)
+    {
+        _mm256_storeu_ps( dst, _mm256_div_ps( _mm256_cvtepi32_ps( loadIntsAVX2(src) ), _mm256_set1_ps(65535.f) ) );
+    }
+};
+
+template <>
+struct DepthAVX2<float, unsigned char>
+{
+    NATRON_SIMD_TARGET_AVX2
+    static inline void convert(const float* src,
+                        unsigned char* dst)
+    {
+        storeIntsAVX2(quantizeAVX2(_mm256_loadu_ps(src), 255.f), dst);
+    }
+};
+
+template <>
+struct DepthAVX2<float, unsigned short>
+{
+    NATRON_SIMD_TARGET_AVX2
+    static inline void convert(const float* src,
+                        unsigned short* dst)
+    {
+        storeIntsAVX2(quantizeAVX2(_mm256_loadu_ps(src), 65535.f), dst);
+    }
+};
+
+template <typename SRCPIX, typename DSTPIX>
+NATRON_SIMD_TARGET_AVX2
+void
+convertDepthRowAVX2(const SRCPIX* src,
+                    int n,
+                    DSTPIX* dst)
+{
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        DepthAVX2<SRCPIX, DSTPIX>::convert(src + i, dst + i);
+    }
+    convertDepthRowScalar(src, i, n, dst);
+}
+
+NATRON_SIMD_TARGET_AVX2
+void
+quantizeRowAVX2(const float* src,
+                int n,
+                float scale,
+                unsigned short* dst)
+{
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        storeIntsAVX2(quantizeAVX2(_mm256_loadu_ps(src + i), scale), dst + i);
+    }
+    quantizeRowScalar(src, i, n, scale, dst);
+}
+
+#endif // NATRON_SIMD_X86
+
+/// Converts n values like convertDepth()
+template <typename SRCPIX, typename DSTPIX>
+void
+convertDepthRow(const SRCPIX* src,
+                int n,
+                DSTPIX* dst,
+                SimdLevelEnum level)
+{
+    switch (level) {
+#ifdef NATRON_SIMD_X86
+    case eSimdLevelAVX2:
+        convertDepthRowAVX2(src, n, dst);
+        break;
+    case eSimdLevelSSE41:
+        convertDepthRowSSE41(src, n, dst);
+        break;
+#endif
+    default:
+        convertDepthRowScalar(src, 0, n, dst);
+        break;
+    }
+}
+
+template <typename PIX>
+void
+convertDepthRow(const PIX* src,
+                int n,
+                PIX* dst,
+                SimdLevelEnum /*level*/)
+{
+    std::memcpy( dst, src, n * sizeof(PIX) );
+}
+
+/// Converts n values like quantize()
+void
+quantizeRow(const float* src,
+            int n,
+            float scale,
+            unsigned short* dst,
+            SimdLevelEnum level)
+{
+    switch (level) {
+#ifdef NATRON_SIMD_X86
+    case eSimdLevelAVX2:
+        quantizeRowAVX2(src, n, scale, dst);
+        break;
+    case eSimdLevelSSE41:
+        quantizeRowSSE41(src, n, scale, dst);
+        break;
+#endif
+    default:
+        quantizeRowScalar(src, 0, n, scale, dst);
+        break;
+    }
+}
+
+/**
+ * @brief Converts linear values to the depth and color-space of the destination. Bytes are encoded as values in
+ * [0, 0xff00] on which the error diffusion is done.
+ **/
+template <typename DSTPIX>
+struct ColorEncoder;
+
+template <>
+struct ColorEncoder<unsigned char>
+{
+    typedef unsigned short EncodedType;
+
+    static void encodeRow(const Color::Lut* lut,
+                          const float* src,
+                          int n,
+                          unsigned short* dst,
+                          SimdLevelEnum level)
+    {
+        if (!lut) {
+            quantizeRow(src, n, 65280.f, dst, level);
+        } else {
+            const unsigned short* table = lut->getUint8xxTable();
+            for (int i = 0; i < n; ++i) {
+                dst[i] = table[floatHiPart(src[i])];
+            }
+        }
+    }
+};
+
+template <>
+struct ColorEncoder<unsigned short>
+{
+    typedef unsigned short EncodedType;
+
+    static void encodeRow(const Color::Lut* lut,
+                          const float* src,
+                          int n,
+                          unsigned short* dst,
+                          SimdLevelEnum level)
+    {
+        if (!lut) {
+            quantizeRow(src, n, 65535.f, dst, level);
+        } else {
+            for (int i = 0; i < n; ++i) {
+                dst[i] = lut->toColorSpaceUint16FromLinearFloatFast(src[i]);
+            }
+        }
+    }
+};
+
+template <>
+struct ColorEncoder<float>
+{
+    typedef float EncodedType;
+
+    static void encodeRow(const Color::Lut* lut,
+                          const float* src,
+                          int n,
+                          float* dst,
+                          SimdLevelEnum /*level*/)
+    {
+        if (!lut) {
+            std::memcpy( dst, src, n * sizeof(float) );
+        } else {
+            for (int i = 0; i < n; ++i) {
+                dst[i] = lut->toColorSpaceFloatFromLinearFloat(src[i]);
+            }
+        }
+    }
+};
+
+/**
+ * @brief Writes the encoded color channels of a row and its alpha to the destination. srcN is the number of components
+ * of the source and of the encoded values.
+ **/
+template <typename SRCPIX, typename DSTPIX, typename ENCODED>
+void
+writeColorRow(const PixelConversionArgs & args,
+              const SRCPIX* src,
+              const ENCODED* encoded,
+              ENCODED encodedZero,
+              int width,
+              DSTPIX* dst)
+{
+    const int srcN = args.srcNComps;
+    const int dstN = args.dstNComps;
+    const int nColors = std::min(dstN, 3);
+    const DSTPIX alpha = fromFloat<DSTPIX>(args.useAlpha0 ? 0.f : 1.f);
+
+    for (int x = 0; x < width; ++x, src += srcN, encoded += srcN, dst += dstN) {
+        for (int k = 0; k < nColors; ++k) {
+            dst[k] = (DSTPIX)(k < srcN ? encoded[k] : encodedZero);
+        }
+        if (dstN == 4) {
+            dst[3] = srcN == 4 ? convertDepth<SRCPIX, DSTPIX>(src[3]) : alpha;
+        }
+    }
+}
+
+/// Same as above for bytes, with the error diffusion of the color channels
+template <typename SRCPIX>
+void
+writeColorRow(const PixelConversionArgs & args,
+              const SRCPIX* src,
+              const unsigned short* encoded,
+              unsigned short encodedZero,
+              int width,
+              unsigned char* dst)
+{
+    const int srcN = args.srcNComps;
+    const int dstN = args.dstNComps;
+    const int nColors = std::min(dstN, 3);
+    const unsigned char alpha = fromFloat<unsigned char>(args.useAlpha0 ? 0.f : 1.f);
+    // coverity[dont_call]
+    const int start = rand() % width;
+
+    ///Twice the loop, from start to the end of the row and from start - 1 to its beginning
+    for (int backward = 0; backward < 2; ++backward) {
+        const int end = backward ? -1 : width;
+        const int step = backward ? -1 : 1;
+        unsigned error[3] = {
+            0x80, 0x80, 0x80
+        };
+        for (int x = backward ? start - 1 : start; x != end; x += step) {
+            const unsigned short* e = encoded + x * srcN;
+            unsigned char* d = dst + x * dstN;
+            for (int k = 0; k < nColors; ++k) {
+                error[k] = (error[k] & 0xff) + (k < srcN ? e[k] : encodedZero);
+                d[k] = (unsigned char)(error[k] >> 8);
+            }
+            if (dstN == 4) {
+                d[3] = srcN == 4 ? convertDepth<SRCPIX, unsigned char>(src[x * srcN + 3]) : alpha;
+            }
+        }
+    }
+}
+
+template <typename SRCPIX, typename DSTPIX>
+void
+convertRowsForDepth(const PixelConversionArgs & args,
+                    const SRCPIX* src,
+                    int srcRowElements,
+                    int width,
+                    int height,
+                    DSTPIX* dst,
+                    int dstRowElements)
+{
+    const int srcN = args.srcNComps;
+    const int dstN = args.dstNComps;
+    const SimdLevelEnum level = getSimdLevel();
+
+    if ( (dstN == 1) && (srcN != 1) ) {
+        ///Only the channel for alpha is converted
+        int channel = args.channelForAlpha;
+        if (channel == -1) {
+            channel = srcN == 4 ? 3 : -1;
+        } else if (channel >= srcN) {
+            channel = -1;
+        }
+        std::vector<SRCPIX> channelRow(width);
+        for (int y = 0; y < height; ++y, src += srcRowElements, dst += dstRowElements) {
+            if (channel == -1) {
+                std::fill(dst, dst + width, DSTPIX(0));
+            } else {
+                for (int x = 0; x < width; ++x) {
+                    channelRow[x] = src[x * srcN + channel];
+                }
+                convertDepthRow(&channelRow[0], width, dst, level);
+            }
+        }
+
+        return;
+    }
+
+    if ( (srcN == 1) && (dstN != 1) ) {
+        ///The single channel is copied to all channels
+        std::vector<DSTPIX> channelRow(width);
+        for (int y = 0; y < height; ++y, src += srcRowElements, dst += dstRowElements) {
+            convertDepthRow(src, width, &channelRow[0], level);
+            for (int x = 0; x < width; ++x) {
+                std::fill(dst + x * dstN, dst + (x + 1) * dstN, channelRow[x]);
+            }
+        }
+
+        return;
+    }
+
+    if ( (srcN == dstN) && !args.srcLut && !args.dstLut && !args.unpremult ) {
+        ///Only the depth changes
+        for (int y = 0; y < height; ++y, src += srcRowElements, dst += dstRowElements) {
+            convertDepthRow(src, width * srcN, dst, level);
+        }
+
+        return;
+    }
+
+    ///The color channels go through linear, the rows are converted to linear and then encoded in the destination
+    ///depth and color-space with the same layout as the source
+    assert( !args.unpremult || (srcN == 4) );
+    typedef typename ColorEncoder<DSTPIX>::EncodedType EncodedType;
+    const int nColors = std::min(srcN, 3);
+    std::vector<float> linear(width * srcN);
+    std::vector<EncodedType> encoded(width * srcN);
+    // the color channels missing in the source
+    const float linearZero = args.srcLut ? toLinear( args.srcLut, SRCPIX(0) ) : 0.f;
+    EncodedType encodedZero;
+    ColorEncoder<DSTPIX>::encodeRow(args.dstLut, &linearZero, 1, &encodedZero, eSimdLevelNone);
+
+    for (int y = 0; y < height; ++y, src += srcRowElements, dst += dstRowElements) {
+        if (args.unpremult) {
+            convertDepthRow(src, width * srcN, &linear[0], level);
+            for (int x = 0; x < width; ++x) {
+                float* p = &linear[x * srcN];
+                const float a = p[3];
+                for (int k = 0; k < 3; ++k) {
+                    const float v = a == 0.f ? 0.f : p[k] / a;
+                    p[k] = args.srcLut ? args.srcLut->fromColorSpaceFloatToLinearFloat(v) : v;
+                }
+            }
+        } else if (args.srcLut) {
+            for (int x = 0; x < width; ++x) {
+                const SRCPIX* s = src + x * srcN;
+                float* p = &linear[x * srcN];
+                for (int k = 0; k < nColors; ++k) {
+                    p[k] = toLinear(args.srcLut, s[k]);
+                }
+                if (srcN == 4) {
+                    p[3] = toFloat(s[3]);
+                }
+            }
+        } else {
+            convertDepthRow(src, width * srcN, &linear[0], level);
+        }
+        ColorEncoder<DSTPIX>::encodeRow(args.dstLut, &linear[0], width * srcN, &encoded[0], level);
+        writeColorRow(args, src, &encoded[0], encodedZero, width, dst);
+    }
+} // convertRowsForDepth
+
+template <typename SRCPIX>
+void
+convertRowsForSrcDepth(const PixelConversionArgs & args,
+                       const SRCPIX* src,
+                       int srcRowElements,
+                       int width,
+                       int height,
+                       void* dst,
+                       int dstRowElements)
+{
+    switch (args.dstDepth) {
+    case eImageBitDepthByte:
+        convertRowsForDepth(args, src, srcRowElements, width, height, (unsigned char*)dst, dstRowElements);
+        break;
+    case eImageBitDepthShort:
+        convertRowsForDepth(args, src, srcRowElements, width, height, (unsigned short*)dst, dstRowElements);
+        break;
+    case eImageBitDepthFloat:
+        convertRowsForDepth(args, src, srcRowElements, width, height, (float*)dst, dstRowElements);
+        break;
+    case eImageBitDepthHalf:
+    case eImageBitDepthNone:
+        assert(false);
+        break;
+    }
+}
+} // anon namespace
+
+namespace PixelConversion {
+
+void
+convertRows(const PixelConversionArgs & args,
+            const void* src,
+            int srcRowElements,
+            int width,
+            int height,
+            void* dst,
+            int dstRowElements)
+{
+    assert(args.srcNComps >= 1 && args.srcNComps <= 4 && args.dstNComps >= 1 && args.dstNComps <= 4);
+    if ( (width <= 0) || (height <= 0) ) {
+        return;
+    }
+
+    switch (args.srcDepth) {
+    case eImageBitDepthByte:
+        convertRowsForSrcDepth(args, (const unsigned char*)src, srcRowElements, width, height, dst, dstRowElements);
+        break;
+    case eImageBitDepthShort:
+        convertRowsForSrcDepth(args, (const unsigned short*)src, srcRowElements, width, height, dst, dstRowElements);
+        break;
+    case eImageBitDepthFloat:
+        convertRowsForSrcDepth(args, (const float*)src, srcRowElements, width, height, dst, dstRowElements);
+        break;
+    case eImageBitDepthHalf:
+    case eImageBitDepthNone:
+        assert(false);
+        break;
+    }
+}
+} // namespace PixelConversion
+
+NATRON_NAMESPACE_EXIT;
@@ -0,0 +1,95 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_PIXELCONVERSION_H
+#define NATRON_ENGINE_PIXELCONVERSION_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include "Global/Enums.h"
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief The source and destination formats of a conversion of pixels
+ **/
+struct PixelConversionArgs
+{
+    ImageBitDepthEnum srcDepth; //< byte, short or float
+    int srcNComps;
+    const Color::Lut* srcLut; //< the color-space of the source, NULL if linear. It must be validated.
+    ImageBitDepthEnum dstDepth; //< byte, short or float
+    int dstNComps;
+    const Color::Lut* dstLut; //< the color-space of the destination, NULL if linear. It must be validated.
+    bool unpremult; //< RGBA source only: the color channels are divided by the alpha before being converted to linear
+    int channelForAlpha; //< the source channel converted to a single channel destination, -1 for the alpha of an RGBA source
+    bool useAlpha0; //< the alpha added to a source without alpha is 0 instead of 1
+
+    PixelConversionArgs()
+        : srcDepth(eImageBitDepthFloat)
+        , srcNComps(4)
+        , srcLut(0)
+        , dstDepth(eImageBitDepthFloat)
+        , dstNComps(4)
+        , dstLut(0)
+        , unpremult(false)
+        , channelForAlpha(-1)
+        , useAlpha0(false)
+    {
+    }
+};
+
+/**
+ * @brief Conversions of rows of pixels between bit depths, components and color-spaces, used by Image::convertToFormat()
+ * and by the viewer. They produce the same output as the former per-pixel conversion of Image:
+ * - A single channel destination gets the channelForAlpha of the source, or 0 if the source does not have it.
+ * - A single channel source is copied to all the channels of the destination.
+ * - Between the same components without color-space the components are only converted to the destination depth, like
+ * Image::convertPixelDepth().
+ * - Otherwise the color channels (the 3 first ones) are converted to linear and then to the destination color-space, those
+ * missing in the source being 0. 8-bit outputs are dithered by error diffusion, starting at rand() % width on each row. The
+ * alpha is converted to the destination depth, or set to 1 (0 with useAlpha0) if the source does not have one.
+ *
+ * The bit depths and the linear conversions are done by SSE4.1 or AVX2 kernels selected at runtime (@see getSimdLevel()),
+ * the color-spaces through the tables of the luts.
+ **/
+namespace PixelConversion {
+
+/**
+ * @brief Converts height rows of width pixels. src and dst point to the first pixel of the first row and the rows are
+ * srcRowElements and dstRowElements components apart. The source and destination must not overlap.
+ **/
+void convertRows(const PixelConversionArgs & args,
+                 const void* src,
+                 int srcRowElements,
+                 int width,
+                 int height,
+                 void* dst,
+                 int dstRowElements);
+} // namespace PixelConversion
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_PIXELCONVERSION_H
@@ -28,28 +28,31 @@
 #include <cassert>
 #include <stdexcept>
 
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/atomic.hpp>
+#endif
+
 #include "Global/Macros.h"
-CLANG_DIAG_OFF(deprecated)
-#include <QMutex>
-CLANG_DIAG_ON(deprecated)
+#include "Engine/AppManager.h"
 #include "Engine/EffectInstance.h"
-#include "Engine/CacheEntry.h"
+#include "Engine/MemoryPool.h"
 
 NATRON_NAMESPACE_ENTER;
 
 struct PluginMemory::Implementation
 {
     Implementation(const EffectInstPtr& effect_)
-        : data()
+        : data(0)
+          , size(0)
           , locked(0)
-          , mutex()
           , effect(effect_)
     {
     }
 
-    RamBuffer<char> data;
-    int locked;
-    QMutex mutex;
+    ///Only modified by alloc() and freeMem()
+    char* data;
+    std::size_t size;
+    boost::atomic<int> locked;
     EffectInstWPtr effect;
 };
 
@@ -67,65 +70,82 @@ PluginMemory::~PluginMemory()
     if (e) {
         e->removePluginMemoryPointer(this);
     }
+    freeMem();
 }
 
 bool
 PluginMemory::alloc(size_t nBytes)
 {
-    QMutexLocker l(&_imp->mutex);
-
-    if (_imp->locked) {
+    if (_imp->locked.load() > 0) {
         return false;
-    } else {
-        _imp->data.resize(nBytes);
-        EffectInstPtr e = _imp->effect.lock();
-        if (e) {
-            e->registerPluginMemory( _imp->data.size() );
-        }
-
+    }
+    if (nBytes == 0) {
         return true;
     }
+
+    ///The memory comes from the pool of the images: buffers allocated for each render are recycled
+    char* newData = (char*)MemoryPool::allocate(nBytes);
+    if (!newData) {
+        throw std::bad_alloc();
+    }
+    freeMem();
+    _imp->data = newData;
+    _imp->size = nBytes;
+
+    EffectInstPtr e = _imp->effect.lock();
+    if (e) {
+        e->registerPluginMemory(nBytes);
+    }
+    ///Count it in the budget of the node cache so that the cache makes room for it
+    if (appPTR) {
+        appPTR->notifyPluginMemoryAllocated( (qint64)nBytes );
+    }
+
+    return true;
 }
 
 void
 PluginMemory::freeMem()
 {
-    QMutexLocker l(&_imp->mutex);
+    if (!_imp->data) {
+        _imp->locked = 0;
+
+        return;
+    }
+
     EffectInstPtr e = _imp->effect.lock();
     if (e) {
-        e->unregisterPluginMemory( _imp->data.size() );
+        e->unregisterPluginMemory(_imp->size);
+    }
+    if (appPTR) {
+        appPTR->notifyPluginMemoryAllocated( -(qint64)_imp->size );
     }
-    _imp->data.clear();
+    MemoryPool::deallocate(_imp->data, _imp->size);
+    _imp->data = 0;
+    _imp->size = 0;
     _imp->locked = 0;
 }
 
 void*
 PluginMemory::getPtr()
 {
-    QMutexLocker l(&_imp->mutex);
-
-    assert(_imp->data.size() == 0 || (_imp->data.size() > 0 && _imp->data.getData()));
-
-    return (void*)( _imp->data.getData() );
+    return (void*)_imp->data;
 }
 
 void
 PluginMemory::lock()
 {
-    QMutexLocker l(&_imp->mutex);
-
-    ++_imp->locked;
+    _imp->locked.fetch_add(1);
 }
 
 void
 PluginMemory::unlock()
 {
-    QMutexLocker l(&_imp->mutex);
-
     // http://openfx.sourceforge.net/Documentation/1.3/ofxProgrammingReference.html#OfxImageEffectSuiteV1_imageMemoryUnlock
     // "Also note, if you unlock a completely unlocked handle, it has no effect (ie: the lock count can't be negative)."
-    if (_imp->locked > 0) {
-        --_imp->locked;
+    int cur = _imp->locked.load();
+
+    while ( cur > 0 && !_imp->locked.compare_exchange_weak(cur, cur - 1) ) {
     }
 }
 
@@ -34,6 +34,13 @@
 
 NATRON_NAMESPACE_ENTER;
 
+/**
+ * @brief Memory allocated by a plug-in (e.g: with the OpenFX memory suite). It is taken from the MemoryPool
+ * and counts against the maximum size of the node cache.
+ * alloc() and freeMem() must not be called concurrently with other functions on the same object, which is the case
+ * for the memory suite since the host allocates the memory before handing out the handle: getPtr(), lock() and unlock()
+ * do not take any lock.
+ **/
 class PluginMemory
 {
 public:
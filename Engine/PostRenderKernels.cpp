@@ -0,0 +1,655 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "PostRenderKernels.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cassert>
+
+#include "Engine/SimdSupport.h"
+
+#ifdef NATRON_SIMD_X86
+#include <immintrin.h>
+#endif
+
+NATRON_NAMESPACE_ENTER;
+
+namespace {
+
+/// Same as Image::clampIfInt
+template <typename PIX>
+PIX clampIfInt(float v);
+
+template <>
+inline unsigned char
+clampIfInt<unsigned char>(float v)
+{
+    return (unsigned char)std::min(std::max(v, 0.f), 255.f);
+}
+
+template <>
+inline unsigned short
+clampIfInt<unsigned short>(float v)
+{
+    return (unsigned short)std::min(std::max(v, 0.f), 65535.f);
+}
+
+template <>
+inline float
+clampIfInt<float>(float v)
+{
+    return v;
+}
+
+/// The weight of the output where there is no mask pixel
+template <bool masked, bool maskInvert>
+inline float
+alphaOutsideMask(float mix)
+{
+    return masked ? mix * (maskInvert ? 1.f : 0.f) : mix;
+}
+
+template <typename PIX, int maxValue, bool maskInvert>
+inline float
+alphaFromMask(PIX maskValue,
+              float mix)
+{
+    float maskScale = maskValue / float(maxValue);
+
+    if (maskInvert) {
+        maskScale = 1.f - maskScale;
+    }
+
+    return mix * maskScale;
+}
+
+/// Copies the channels of src to the pixels [x1, n) of dst, src being NULL where there is no original pixel
+template <typename PIX, int maxValue, int srcNComps, int dstNComps, bool doR, bool doG, bool doB, bool doA>
+void
+copyChannelsRowScalar(const PIX* src,
+                      int x1,
+                      int n,
+                      PIX* dst)
+{
+    for (int x = x1; x < n; ++x) {
+        const PIX* srcPix = src ? src + x * srcNComps : 0;
+        PIX* dstPix = dst + x * dstNComps;
+        if (doR) {
+            dstPix[0] = (srcPix && 0 < srcNComps) ? srcPix[0] : PIX(0);
+        }
+        if (doG) {
+            dstPix[1] = (srcPix && 1 < srcNComps) ? srcPix[1] : PIX(0);
+        }
+        if (doB) {
+            dstPix[2] = (srcPix && 2 < srcNComps) ? srcPix[2] : PIX(0);
+        }
+        if (doA) {
+            PIX srcA = srcPix ? PIX(maxValue) : PIX(0); // be opaque for anything that doesn't contain alpha
+            if ( srcPix && ( (srcNComps == 1) || (srcNComps == 4) ) ) {
+                srcA = srcPix[srcNComps - 1];
+            }
+            dstPix[dstNComps - 1] = srcA;
+        }
+    }
+}
+
+/// Mixes the pixels [x1, n) of dst with src. src is NULL where there is no original pixel, mask where there is no mask pixel.
+template <typename PIX, int maxValue, int srcNComps, int dstNComps, bool masked, bool maskInvert>
+void
+maskMixRowScalar(const PIX* src,
+                 const PIX* mask,
+                 int x1,
+                 int n,
+                 float mix,
+                 PIX* dst)
+{
+    for (int x = x1; x < n; ++x) {
+        float alpha = (masked && mask) ? alphaFromMask<PIX, maxValue, maskInvert>(mask[x], mix) : alphaOutsideMask<masked, maskInvert>(mix);
+        PIX* dstPix = dst + x * dstNComps;
+        if (src) {
+            const PIX* srcPix = src + x * srcNComps;
+            for (int c = 0; c < dstNComps; ++c) {
+                if (c < srcNComps) {
+                    float v = float(dstPix[c]) * alpha + (1.f - alpha) * float(srcPix[c]);
+                    dstPix[c] = clampIfInt<PIX>(v);
+                }
+            }
+        } else {
+            for (int c = 0; c < dstNComps; ++c) {
+                float v = float(dstPix[c]) * alpha;
+                dstPix[c] = clampIfInt<PIX>(v);
+            }
+        }
+    }
+}
+
+#ifdef NATRON_SIMD_X86
+
+/// The _mm_blend_ps mask of the channels copied
+template <bool doR, bool doG, bool doB, bool doA>
+struct ChannelsBlendMask
+{
+    enum { value = (doR ? 1 : 0) | (doG ? 2 : 0) | (doB ? 4 : 0) | (doA ? 8 : 0) };
+};
+
+template <bool doR, bool doG, bool doB, bool doA>
+NATRON_SIMD_TARGET_SSE41
+void
+copyChannelsRowRGBASSE41(const float* src,
+                         int n,
+                         float* dst)
+{
+    if (src) {
+        for (int x = 0; x < n; ++x) {
+            _mm_storeu_ps( dst + 4 * x, _mm_blend_ps( _mm_loadu_ps(dst + 4 * x), _mm_loadu_ps(src + 4 * x), ChannelsBlendMask<doR, doG, doB, doA>::value ) );
+        }
+    } else {
+        for (int x = 0; x < n; ++x) {
+            _mm_storeu_ps( dst + 4 * x, _mm_blend_ps( _mm_loadu_ps(dst + 4 * x), _mm_setzero_ps(), ChannelsBlendMask<doR, doG, doB, doA>::value ) );
+        }
+    }
+}
+
+/// dst * alpha + src * (1 - alpha) for an RGBA pixel, alpha being in the 4 lanes
+NATRON_SIMD_TARGET_SSE41
+inline void
+mixPixelSSE41(const float* src,
+              __m128 alpha,
+              float* dst)
+{
+    __m128 d = _mm_loadu_ps(dst);
+    __m128 s = _mm_loadu_ps(src);
+
+    _mm_storeu_ps( dst, _mm_add_ps( _mm_mul_ps(d, alpha), _mm_mul_ps( _mm_sub_ps(_mm_set1_ps(1.f), alpha), s ) ) );
+}
+
+template <bool masked, bool maskInvert>
+NATRON_SIMD_TARGET_SSE41
+void
+maskMixRowRGBASSE41(const float* src,
+                    const float* mask,
+                    int n,
+                    float mix,
+                    float* dst)
+{
+    int x = 0;
+
+    if (masked && mask) {
+        __m128 vmix = _mm_set1_ps(mix);
+        for (; x + 4 <= n; x += 4) {
+            __m128 m = _mm_loadu_ps(mask + x);
+            if (maskInvert) {
+                m = _mm_sub_ps(_mm_set1_ps(1.f), m);
+            }
+            __m128 alpha = _mm_mul_ps(vmix, m);
+            mixPixelSSE41( src + 4 * x, _mm_shuffle_ps( alpha, alpha, _MM_SHUFFLE(0, 0, 0, 0) ), dst + 4 * x );
+            mixPixelSSE41( src + 4 * x + 4, _mm_shuffle_ps( alpha, alpha, _MM_SHUFFLE(1, 1, 1, 1) ), dst + 4 * x + 4 );
+            mixPixelSSE41( src + 4 * x + 8, _mm_shuffle_ps( alpha, alpha, _MM_SHUFFLE(2, 2, 2, 2) ), dst + 4 * x + 8 );
+            mixPixelSSE41( src + 4 * x + 12, _mm_shuffle_ps( alpha, alpha, _MM_SHUFFLE(3, 3, 3, 3) ), dst + 4 * x + 12 );
+        }
+    } else {
+        __m128 alpha = _mm_set1_ps( alphaOutsideMask<masked, maskInvert>(mix) );
+        for (; x < n; ++x) {
+            mixPixelSSE41(src + 4 * x, alpha, dst + 4 * x);
+        }
+    }
+    maskMixRowScalar<float, 1, 4, 4, masked, maskInvert>(src, mask, x, n, mix, dst);
+}
+
+template <bool doR, bool doG, bool doB, bool doA>
+NATRON_SIMD_TARGET_AVX2
+void
+copyChannelsRowRGBAAVX2(const float* src,
+                        int n,
+                        float* dst)
+{
+    const int blend = ChannelsBlendMask<doR, doG, doB, doA>::value | (ChannelsBlendMask<doR, doG, doB, doA>::value << 4);
+    int x = 0;
+
+    if (src) {
+        for (; x + 2 <= n; x += 2) {
+            _mm256_storeu_ps( dst + 4 * x, _mm256_blend_ps( _mm256_loadu_ps(dst + 4 * x), _mm256_loadu_ps(src + 4 * x), blend ) );
+        }
+    } else {
+        for (; x + 2 <= n; x += 2) {
+            _mm256_storeu_ps( dst + 4 * x, _mm256_blend_ps( _mm256_loadu_ps(dst + 4 * x), _mm256_setzero_ps(), blend ) );
+        }
+    }
+    copyChannelsRowScalar<float, 1, 4, 4, doR, doG, doB, doA>(src, x, n, dst);
+}
+
+/// The same as mixPixelSSE41 for 2 RGBA pixels
+NATRON_SIMD_TARGET_AVX2
+inline void
+mixPixelsAVX2(const float* src,
+              __m256 alpha,
+              float* dst)
+{
+    __m256 d = _mm256_loadu_ps(dst);
+    __m256 s = _mm256_loadu_ps(src);
+
+    _mm256_storeu_ps( dst, _mm256_add_ps( _mm256_mul_ps(d, alpha), _mm256_mul_ps( _mm256_sub_ps(_mm256_set1_ps(1.f), alpha), s ) ) );
+}
+
+template <bool masked, bool maskInvert>
+NATRON_SIMD_TARGET_AVX2
+void
+maskMixRowRGBAAVX2(const float* src,
+                   const float* mask,
+                   int n,
+                   float mix,
+                   float* dst)
+{
+    int x = 0;
+
+    if (masked && mask) {
+        __m256 vmix = _mm256_set1_ps(mix);
+        for (; x + 8 <= n; x += 8) {
+            __m256 m = _mm256_loadu_ps(mask + x);
+            if (maskInvert) {
+                m = _mm256_sub_ps(_mm256_set1_ps(1.f), m);
+            }
+            __m256 alpha = _mm256_mul_ps(vmix, m);
+            // Each pair of pixels gets the alpha of its 2 pixels in the 2 halves
+            mixPixelsAVX2( src + 4 * x, _mm256_permutevar8x32_ps( alpha, _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1) ), dst + 4 * x );
+            mixPixelsAVX2( src + 4 * x + 8, _mm256_permutevar8x32_ps( alpha, _mm256_setr_epi32(2, 2, 2, 2, 3, 3, 3, 3) ), dst + 4 * x + 8 );
+            mixPixelsAVX2( src + 4 * x + 16, _mm256_permutevar8x32_ps( alpha, _mm256_setr_epi32(4, 4, 4, 4, 5, 5, 5, 5) ), dst + 4 * x + 16 );
+            mixPixelsAVX2( src + 4 * x + 24, _mm256_permutevar8x32_ps( alpha, _mm256_setr_epi32(6, 6, 6, 6, 7, 7, 7, 7) ), dst + 4 * x + 24 );
+        }
+    } else {
+        __m256 alpha = _mm256_set1_ps( alphaOutsideMask<masked, maskInvert>(mix) );
+        for (; x + 2 <= n; x += 2) {
+            mixPixelsAVX2(src + 4 * x, alpha, dst + 4 * x);
+        }
+    }
+    maskMixRowScalar<float, 1, 4, 4, masked, maskInvert>(src, mask, x, n, mix, dst);
+}
+
+#endif // NATRON_SIMD_X86
+
+/// Copies the channels of n pixels, like copyChannelsRowScalar()
+template <typename PIX, int maxValue, int srcNComps, int dstNComps, bool doR, bool doG, bool doB, bool doA>
+struct CopyChannelsRow
+{
+    static void run(const PIX* src,
+                    int n,
+                    PIX* dst,
+                    SimdLevelEnum /*level*/)
+    {
+        copyChannelsRowScalar<PIX, maxValue, srcNComps, dstNComps, doR, doG, doB, doA>(src, 0, n, dst);
+    }
+};
+
+template <bool doR, bool doG, bool doB, bool doA>
+struct CopyChannelsRow<float, 1, 4, 4, doR, doG, doB, doA>
+{
+    static void run(const float* src,
+                    int n,
+                    float* dst,
+                    SimdLevelEnum level)
+    {
+        switch (level) {
+#ifdef NATRON_SIMD_X86
+        case eSimdLevelAVX2:
+            copyChannelsRowRGBAAVX2<doR, doG, doB, doA>(src, n, dst);
+            break;
+        case eSimdLevelSSE41:
+            copyChannelsRowRGBASSE41<doR, doG, doB, doA>(src, n, dst);
+            break;
+#endif
+        default:
+            copyChannelsRowScalar<float, 1, 4, 4, doR, doG, doB, doA>(src, 0, n, dst);
+            break;
+        }
+    }
+};
+
+/// Mixes n pixels, like maskMixRowScalar()
+template <typename PIX, int maxValue, int srcNComps, int dstNComps, bool masked, bool maskInvert>
+struct MaskMixRow
+{
+    static void run(const PIX* src,
+                    const PIX* mask,
+                    int n,
+                    float mix,
+                    PIX* dst,
+                    SimdLevelEnum /*level*/)
+    {
+        maskMixRowScalar<PIX, maxValue, srcNComps, dstNComps, masked, maskInvert>(src, mask, 0, n, mix, dst);
+    }
+};
+
+template <bool masked, bool maskInvert>
+struct MaskMixRow<float, 1, 4, 4, masked, maskInvert>
+{
+    static void run(const float* src,
+                    const float* mask,
+                    int n,
+                    float mix,
+                    float* dst,
+                    SimdLevelEnum level)
+    {
+        // Outside of the original image the kernels would not save much
+        if (!src) {
+            level = eSimdLevelNone;
+        }
+        switch (level) {
+#ifdef NATRON_SIMD_X86
+        case eSimdLevelAVX2:
+            maskMixRowRGBAAVX2<masked, maskInvert>(src, mask, n, mix, dst);
+            break;
+        case eSimdLevelSSE41:
+            maskMixRowRGBASSE41<masked, maskInvert>(src, mask, n, mix, dst);
+            break;
+#endif
+        default:
+            maskMixRowScalar<float, 1, 4, 4, masked, maskInvert>(src, mask, 0, n, mix, dst);
+            break;
+        }
+    }
+};
+
+template <typename PIX>
+struct RowFunctions
+{
+    typedef void (*CopyChannelsFunc)(const PIX* src, int n, PIX* dst, SimdLevelEnum level);
+    typedef void (*MaskMixFunc)(const PIX* src, const PIX* mask, int n, float mix, PIX* dst, SimdLevelEnum level);
+};
+
+/// channels has the bit c set if the channel c is copied. The channels the destination does not have are ignored,
+/// so that the row functions of the same channels are only instantiated once.
+template <typename PIX, int maxValue, int srcNComps, int dstNComps, int channels>
+typename RowFunctions<PIX>::CopyChannelsFunc
+getCopyChannelsRowFor()
+{
+    return &CopyChannelsRow<PIX, maxValue, srcNComps, dstNComps,
+                            (channels & 1) && (dstNComps >= 2),
+                            (channels & 2) && (dstNComps >= 2),
+                            (channels & 4) && (dstNComps >= 3),
+                            (channels & 8) && (dstNComps == 1 || dstNComps == 4)>::run;
+}
+
+template <typename PIX, int maxValue, int srcNComps, int dstNComps>
+typename RowFunctions<PIX>::CopyChannelsFunc
+getCopyChannelsRow(const PostRenderArgs & args)
+{
+    if (!args.copyChannels) {
+        return 0;
+    }
+    int channels = 0;
+    if ( !args.processChannels[0] && (dstNComps >= 2) ) {
+        channels |= 1;
+    }
+    if ( !args.processChannels[1] && (dstNComps >= 2) ) {
+        channels |= 2;
+    }
+    if ( !args.processChannels[2] && (dstNComps >= 3) ) {
+        channels |= 4;
+    }
+    if ( !args.processChannels[3] && ( (dstNComps == 1) || (dstNComps == 4) ) ) {
+        channels |= 8;
+    }
+    switch (channels) {
+    case 1:
+        return getCopyChannelsRowFor<PIX, maxValue, srcNComps, dstNComps, 1>();
+    case 2:
+        return getCopyChannelsRowFor<PIX, maxValue, srcNComps, dstNComps, 2>();
+    case 3:
+        return getCopyChannelsRowFor<PIX, maxValue, srcNComps, dstNComps, 3>();
+    case 4:
+        return getCopyChannelsRowFor<PIX, maxValue, srcNComps, dstNComps, 4>();
+    case 5:
+        return getCopyChannelsRowFor<PIX, maxValue, srcNComps, dstNComps, 5>();
+    case 6:
+        return getCopyChannelsRowFor<PIX, maxValue, srcNComps, dstNComps, 6>();
+    case 7:
+        return getCopyChannelsRowFor<PIX, maxValue, srcNComps, dstNComps, 7>();
+    case 8:
+        return getCopyChannelsRowFor<PIX, maxValue, srcNComps, dstNComps, 8>();
+    case 9:
+        return getCopyChannelsRowFor<PIX, maxValue, srcNComps, dstNComps, 9>();
+    case 10:
+        return getCopyChannelsRowFor<PIX, maxValue, srcNComps, dstNComps, 10>();
+    case 11:
+        return getCopyChannelsRowFor<PIX, maxValue, srcNComps, dstNComps, 11>();
+    case 12:
+        return getCopyChannelsRowFor<PIX, maxValue, srcNComps, dstNComps, 12>();
+    case 13:
+        return getCopyChannelsRowFor<PIX, maxValue, srcNComps, dstNComps, 13>();
+    case 14:
+        return getCopyChannelsRowFor<PIX, maxValue, srcNComps, dstNComps, 14>();
+    case 15:
+        return getCopyChannelsRowFor<PIX, maxValue, srcNComps, dstNComps, 15>();
+    default:
+        // all the channels were processed
+        return 0;
+    }
+}
+
+template <typename PIX, int maxValue, int srcNComps, int dstNComps>
+typename RowFunctions<PIX>::MaskMixFunc
+getMaskMixRow(const PostRenderArgs & args)
+{
+    if ( !args.maskMix || (srcNComps == 0) ) {
+        return 0;
+    }
+    if (!args.masked) {
+        return &MaskMixRow<PIX, maxValue, srcNComps, dstNComps, false, false>::run;
+    } else if (args.maskInvert) {
+        return &MaskMixRow<PIX, maxValue, srcNComps, dstNComps, true, true>::run;
+    } else {
+        return &MaskMixRow<PIX, maxValue, srcNComps, dstNComps, true, false>::run;
+    }
+}
+
+inline int
+clampToRange(int x,
+             int x1,
+             int x2)
+{
+    return std::min(std::max(x, x1), x2);
+}
+
+template <typename PIX>
+inline PIX*
+pixelAt(PIX* data,
+        const RectI & bounds,
+        int nComps,
+        int x,
+        int y)
+{
+    return data + ( (std::ptrdiff_t)(y - bounds.y1) * bounds.width() + (x - bounds.x1) ) * nComps;
+}
+
+template <typename PIX, int maxValue, int srcNComps, int dstNComps>
+void
+processRowsForComponents(const PostRenderArgs & args,
+                         const RectI & roi,
+                         PIX* dst,
+                         const RectI & dstBounds,
+                         const PIX* src,
+                         const RectI & srcBounds,
+                         const PIX* mask,
+                         const RectI & maskBounds)
+{
+    typename RowFunctions<PIX>::CopyChannelsFunc copyChannelsRow = getCopyChannelsRow<PIX, maxValue, srcNComps, dstNComps>(args);
+    typename RowFunctions<PIX>::MaskMixFunc maskMixRow = getMaskMixRow<PIX, maxValue, srcNComps, dstNComps>(args);
+
+    if (!copyChannelsRow && !maskMixRow) {
+        return;
+    }
+    if ( !args.masked || !maskMixRow ) {
+        mask = 0;
+    }
+
+    const SimdLevelEnum level = getSimdLevel();
+
+    // The columns where the original image and the mask start and end split the rows in at most 5 segments,
+    // each of them being entirely inside or outside of the 2 images
+    int xs[6] = {
+        roi.x1, roi.x2, roi.x1, roi.x1, roi.x1, roi.x1
+    };
+    if (src) {
+        xs[2] = clampToRange(srcBounds.x1, roi.x1, roi.x2);
+        xs[3] = clampToRange(srcBounds.x2, roi.x1, roi.x2);
+    }
+    if (mask) {
+        xs[4] = clampToRange(maskBounds.x1, roi.x1, roi.x2);
+        xs[5] = clampToRange(maskBounds.x2, roi.x1, roi.x2);
+    }
+    std::sort(xs, xs + 6);
+
+    for (int y = roi.y1; y < roi.y2; ++y) {
+        const bool srcHasRow = src && (srcBounds.y1 <= y) && (y < srcBounds.y2);
+        const bool maskHasRow = mask && (maskBounds.y1 <= y) && (y < maskBounds.y2);
+        for (int i = 0; i < 5; ++i) {
+            const int x1 = xs[i];
+            const int n = xs[i + 1] - x1;
+            if (n <= 0) {
+                continue;
+            }
+            const PIX* srcPixels = 0;
+            if ( srcHasRow && (srcBounds.x1 <= x1) && (x1 < srcBounds.x2) ) {
+                srcPixels = pixelAt(src, srcBounds, srcNComps, x1, y);
+            }
+            const PIX* maskPixels = 0;
+            if ( maskHasRow && (maskBounds.x1 <= x1) && (x1 < maskBounds.x2) ) {
+                maskPixels = pixelAt(mask, maskBounds, 1, x1, y);
+            }
+            PIX* dstPixels = pixelAt(dst, dstBounds, dstNComps, x1, y);
+
+            // The mix reads the channels just restored while they are in the cache
+            if (copyChannelsRow) {
+                copyChannelsRow(srcPixels, n, dstPixels, level);
+            }
+            if (maskMixRow) {
+                maskMixRow(srcPixels, maskPixels, n, args.mix, dstPixels, level);
+            }
+        }
+    }
+} // processRowsForComponents
+
+template <typename PIX, int maxValue, int dstNComps>
+void
+processRowsForDstComponents(const PostRenderArgs & args,
+                            const RectI & roi,
+                            PIX* dst,
+                            const RectI & dstBounds,
+                            const PIX* src,
+                            const RectI & srcBounds,
+                            const PIX* mask,
+                            const RectI & maskBounds)
+{
+    switch (args.srcNComps) {
+    case 0:
+        processRowsForComponents<PIX, maxValue, 0, dstNComps>(args, roi, dst, dstBounds, 0, srcBounds, mask, maskBounds);
+        break;
+    case 1:
+        processRowsForComponents<PIX, maxValue, 1, dstNComps>(args, roi, dst, dstBounds, src, srcBounds, mask, maskBounds);
+        break;
+    case 2:
+        processRowsForComponents<PIX, maxValue, 2, dstNComps>(args, roi, dst, dstBounds, src, srcBounds, mask, maskBounds);
+        break;
+    case 3:
+        processRowsForComponents<PIX, maxValue, 3, dstNComps>(args, roi, dst, dstBounds, src, srcBounds, mask, maskBounds);
+        break;
+    case 4:
+        processRowsForComponents<PIX, maxValue, 4, dstNComps>(args, roi, dst, dstBounds, src, srcBounds, mask, maskBounds);
+        break;
+    default:
+        assert(false);
+        break;
+    }
+}
+
+template <typename PIX, int maxValue>
+void
+processRowsForDepth(const PostRenderArgs & args,
+                    const RectI & roi,
+                    void* dst,
+                    const RectI & dstBounds,
+                    const void* src,
+                    const RectI & srcBounds,
+                    const void* mask,
+                    const RectI & maskBounds)
+{
+    PIX* dstPixels = (PIX*)dst;
+    const PIX* srcPixels = (const PIX*)src;
+    const PIX* maskPixels = (const PIX*)mask;
+
+    switch (args.dstNComps) {
+    case 1:
+        processRowsForDstComponents<PIX, maxValue, 1>(args, roi, dstPixels, dstBounds, srcPixels, srcBounds, maskPixels, maskBounds);
+        break;
+    case 2:
+        processRowsForDstComponents<PIX, maxValue, 2>(args, roi, dstPixels, dstBounds, srcPixels, srcBounds, maskPixels, maskBounds);
+        break;
+    case 3:
+        processRowsForDstComponents<PIX, maxValue, 3>(args, roi, dstPixels, dstBounds, srcPixels, srcBounds, maskPixels, maskBounds);
+        break;
+    case 4:
+        processRowsForDstComponents<PIX, maxValue, 4>(args, roi, dstPixels, dstBounds, srcPixels, srcBounds, maskPixels, maskBounds);
+        break;
+    default:
+        assert(false);
+        break;
+    }
+}
+} // anon namespace
+
+namespace PostRenderKernels {
+
+void
+processRows(const PostRenderArgs & args,
+            const RectI & roi,
+            void* dst,
+            const RectI & dstBounds,
+            const void* src,
+            const RectI & srcBounds,
+            const void* mask,
+            const RectI & maskBounds)
+{
+    if ( roi.isNull() ) {
+        return;
+    }
+    assert( dstBounds.contains(roi) );
+
+    switch (args.depth) {
+    case eImageBitDepthByte:
+        processRowsForDepth<unsigned char, 255>(args, roi, dst, dstBounds, src, srcBounds, mask, maskBounds);
+        break;
+    case eImageBitDepthShort:
+        processRowsForDepth<unsigned short, 65535>(args, roi, dst, dstBounds, src, srcBounds, mask, maskBounds);
+        break;
+    case eImageBitDepthFloat:
+        processRowsForDepth<float, 1>(args, roi, dst, dstBounds, src, srcBounds, mask, maskBounds);
+        break;
+    default:
+        break;
+    }
+}
+} // namespace PostRenderKernels
+
+NATRON_NAMESPACE_EXIT;
@@ -0,0 +1,98 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_POSTRENDERKERNELS_H
+#define NATRON_ENGINE_POSTRENDERKERNELS_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <bitset>
+
+#include "Global/Enums.h"
+#include "Engine/RectI.h"
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief What is done to the output of a plug-in render, with respect to the original image (the source image of the effect)
+ **/
+struct PostRenderArgs
+{
+    ImageBitDepthEnum depth; //< the depth of the 3 images
+    int dstNComps;
+    int srcNComps; //< the components of the original image, 0 if there is none
+    bool copyChannels; //< restore the channels that were not processed from the original image
+    std::bitset<4> processChannels; //< the R, G, B and A channels processed by the plug-in
+    bool maskMix; //< blend the output with the original image, which is required
+    bool masked; //< the blend is weighted by an alpha mask, of the same depth
+    bool maskInvert;
+    float mix;
+
+    PostRenderArgs()
+        : depth(eImageBitDepthFloat)
+        , dstNComps(4)
+        , srcNComps(4)
+        , copyChannels(false)
+        , processChannels()
+        , maskMix(false)
+        , masked(false)
+        , maskInvert(false)
+        , mix(1.f)
+    {
+    }
+};
+
+/**
+ * @brief The post-render pass of the host-side masked and mixed effects, used by Image::copyUnProcessedChannelsAndApplyMaskMix().
+ * The channels are restored and then mixed row after row, so that each row is only read and written once while it is in the
+ * cache. The result is the same as the former separate passes of Image::copyUnProcessedChannels() and Image::applyMaskMix():
+ * - A channel that was not processed gets the channel of the original pixel, or 0 if the original does not have it. The alpha
+ * gets the alpha of the original, 1 if the original has no alpha and 0 if there is no original pixel. The channels are only
+ * copied: if the user unchecked a channel we do not want to change the values behind his back, the GUI displays a warning.
+ * - The mix with the original pixel is dst * alpha + src * (1 - alpha), clamped for integer depths, where alpha is
+ * mix * mask (or mix * (1 - mask) with maskInvert). Outside of the mask alpha is 0 (mix with maskInvert), outside of the
+ * original image the output is only multiplied by alpha.
+ *
+ * A row function specialized for the active options is selected once for the whole pass. RGBA float rows are done by SSE4.1
+ * or AVX2 kernels selected at runtime (@see getSimdLevel()).
+ **/
+namespace PostRenderKernels {
+
+/**
+ * @brief Applies the pass to the roi of dst, which must be within dstBounds. dst, src and mask point to the pixel at (x1,y1)
+ * of their bounds, the rows going upwards. src or mask is NULL if that image has no pixel.
+ **/
+void processRows(const PostRenderArgs & args,
+                 const RectI & roi,
+                 void* dst,
+                 const RectI & dstBounds,
+                 const void* src,
+                 const RectI & srcBounds,
+                 const void* mask,
+                 const RectI & maskBounds);
+} // namespace PostRenderKernels
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_POSTRENDERKERNELS_H
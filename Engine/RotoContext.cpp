@@ -49,7 +49,6 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/AppInstance.h"
 #include "Engine/Bezier.h"
 #include "Engine/BezierCP.h"
-#include "Engine/CoonsRegularization.h"
 #include "Engine/FeatherPoint.h"
 #include "Engine/Format.h"
 #include "Engine/Hash64.h"
@@ -60,8 +59,10 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/RotoContextSerialization.h"
 #include "Engine/RotoDrawableItem.h"
 #include "Engine/RotoLayer.h"
+#include "Engine/RotoShapeRasterizer.h"
 #include "Engine/RotoStrokeItem.h"
 #include "Engine/Settings.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/TimeLine.h"
 #include "Engine/Transform.h"
 #include "Engine/ViewerInstance.h"
@@ -84,14 +85,14 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #define kTransformParamResetCenter "resetCenter"
 #define kTransformParamBlackOutside "black_outside"
 
-//This will enable correct evaluation of beziers
-//#define ROTO_USE_MESH_PATTERN_ONLY
-
 // The number of pressure levels is 256 on an old Wacom Graphire 4, and 512 on an entry-level Wacom Bamboo
 // 512 should be OK, see:
 // http://www.davidrevoy.com/article182/calibrating-wacom-stylus-pressure-on-krita
 #define ROTO_PRESSURE_LEVELS 512
 
+///The strokes are rendered in tiles of this size, each with its own cairo surface
+#define kRotoStrokeTileSize 256
+
 #ifndef M_PI
 #define M_PI        3.14159265358979323846264338327950288   /* pi             */
 #endif
@@ -2082,22 +2083,10 @@ RotoContext::evaluateNeatStrokeRender()
     }
 }
 
-static void
-adjustToPointToScale(unsigned int mipmapLevel,
-                     double &x,
-                     double &y)
-{
-    if (mipmapLevel != 0) {
-        int pot = (1 << mipmapLevel);
-        x /= pot;
-        y /= pot;
-    }
-}
-
 template <typename PIX,int maxValue, int dstNComps, int srcNComps, bool useOpacity>
 static void
 convertCairoImageToNatronImageForDstComponents_noColor(cairo_surface_t* cairoImg,
-                                                       Image* image,
+                                                       Image::WriteAccess* acc,
                                                        const RectI & pixelRod,
                                                        double shapeColor[3],
                                                        double opacity)
@@ -2107,8 +2096,6 @@ convertCairoImageToNatronImageForDstComponents_noColor(cairo_surface_t* cairoImg
     unsigned char* srcPix = cdata;
     int stride = cairo_image_surface_get_stride(cairoImg);
     
-    Image::WriteAccess acc = image->getWriteRights();
-    
     double r = useOpacity ? shapeColor[0] * opacity : shapeColor[0];
     double g = useOpacity ? shapeColor[1] * opacity : shapeColor[1];
     double b = useOpacity ? shapeColor[2] * opacity : shapeColor[2];
@@ -2119,7 +2106,7 @@ convertCairoImageToNatronImageForDstComponents_noColor(cairo_surface_t* cairoImg
     for (int y = 0; y < pixelRod.height(); ++y,
          srcPix += (stride - srcNElements)) {
         
-        PIX* dstPix = (PIX*)acc.pixelAt(pixelRod.x1, pixelRod.y1 + y);
+        PIX* dstPix = (PIX*)acc->pixelAt(pixelRod.x1, pixelRod.y1 + y);
         assert(dstPix);
         
         for (int x = 0; x < width; ++x,
@@ -2163,16 +2150,16 @@ convertCairoImageToNatronImageForDstComponents_noColor(cairo_surface_t* cairoImg
 template <typename PIX,int maxValue, int dstNComps, int srcNComps>
 static void
 convertCairoImageToNatronImageForOpacity(cairo_surface_t* cairoImg,
-                                         Image* image,
+                                         Image::WriteAccess* acc,
                                          const RectI & pixelRod,
                                          double shapeColor[3],
                                          double opacity,
                                          bool useOpacity)
 {
     if (useOpacity) {
-        convertCairoImageToNatronImageForDstComponents_noColor<PIX,maxValue,dstNComps, srcNComps, true>(cairoImg, image,pixelRod, shapeColor, opacity);
+        convertCairoImageToNatronImageForDstComponents_noColor<PIX,maxValue,dstNComps, srcNComps, true>(cairoImg, acc, pixelRod, shapeColor, opacity);
     } else {
-        convertCairoImageToNatronImageForDstComponents_noColor<PIX,maxValue,dstNComps, srcNComps, false>(cairoImg, image,pixelRod, shapeColor, opacity);
+        convertCairoImageToNatronImageForDstComponents_noColor<PIX,maxValue,dstNComps, srcNComps, false>(cairoImg, acc, pixelRod, shapeColor, opacity);
     }
 
 }
@@ -2182,50 +2169,67 @@ template <typename PIX,int maxValue, int dstNComps>
 static void
 convertCairoImageToNatronImageForSrcComponents_noColor(cairo_surface_t* cairoImg,
                                                        int srcNComps,
-                                                       Image* image,
+                                                       Image::WriteAccess* acc,
                                                        const RectI & pixelRod,
                                                        double shapeColor[3],
                                                        double opacity,
                                                        bool useOpacity)
 {
     if (srcNComps == 1) {
-        convertCairoImageToNatronImageForOpacity<PIX,maxValue,dstNComps, 1>(cairoImg, image,pixelRod, shapeColor, opacity, useOpacity);
+        convertCairoImageToNatronImageForOpacity<PIX,maxValue,dstNComps, 1>(cairoImg, acc, pixelRod, shapeColor, opacity, useOpacity);
     } else if (srcNComps == 4) {
-        convertCairoImageToNatronImageForOpacity<PIX,maxValue,dstNComps, 4>(cairoImg, image,pixelRod, shapeColor, opacity, useOpacity);
+        convertCairoImageToNatronImageForOpacity<PIX,maxValue,dstNComps, 4>(cairoImg, acc, pixelRod, shapeColor, opacity, useOpacity);
     } else {
         assert(false);
     }
 }
 
+///Converts the cairo surface covering pixelRod into the image, whose write access is held by the caller:
+///the tiles of a mask are converted concurrently under the same access.
 template <typename PIX,int maxValue>
 static void
 convertCairoImageToNatronImage_noColor(cairo_surface_t* cairoImg,
                                        int srcNComps,
-                                       Image* image,
+                                       int dstNComps,
+                                       Image::WriteAccess* acc,
                                        const RectI & pixelRod,
                                        double shapeColor[3],
                                        double opacity,
                                        bool useOpacity)
 {
-    int comps = (int)image->getComponentsCount();
-    switch (comps) {
+    switch (dstNComps) {
         case 1:
-            convertCairoImageToNatronImageForSrcComponents_noColor<PIX,maxValue,1>(cairoImg, srcNComps, image,pixelRod, shapeColor, opacity, useOpacity);
+            convertCairoImageToNatronImageForSrcComponents_noColor<PIX,maxValue,1>(cairoImg, srcNComps, acc, pixelRod, shapeColor, opacity, useOpacity);
             break;
         case 2:
-            convertCairoImageToNatronImageForSrcComponents_noColor<PIX,maxValue,2>(cairoImg, srcNComps, image,pixelRod, shapeColor, opacity, useOpacity);
+            convertCairoImageToNatronImageForSrcComponents_noColor<PIX,maxValue,2>(cairoImg, srcNComps, acc, pixelRod, shapeColor, opacity, useOpacity);
             break;
         case 3:
-            convertCairoImageToNatronImageForSrcComponents_noColor<PIX,maxValue,3>(cairoImg, srcNComps, image,pixelRod, shapeColor, opacity, useOpacity);
+            convertCairoImageToNatronImageForSrcComponents_noColor<PIX,maxValue,3>(cairoImg, srcNComps, acc, pixelRod, shapeColor, opacity, useOpacity);
             break;
         case 4:
-            convertCairoImageToNatronImageForSrcComponents_noColor<PIX,maxValue,4>(cairoImg, srcNComps, image,pixelRod, shapeColor, opacity, useOpacity);
+            convertCairoImageToNatronImageForSrcComponents_noColor<PIX,maxValue,4>(cairoImg, srcNComps, acc, pixelRod, shapeColor, opacity, useOpacity);
             break;
         default:
             break;
     }
 }
 
+template <typename PIX,int maxValue>
+static void
+convertCairoImageToNatronImage_noColor(cairo_surface_t* cairoImg,
+                                       int srcNComps,
+                                       Image* image,
+                                       const RectI & pixelRod,
+                                       double shapeColor[3],
+                                       double opacity,
+                                       bool useOpacity)
+{
+    Image::WriteAccess acc = image->getWriteRights();
+    
+    convertCairoImageToNatronImage_noColor<PIX,maxValue>(cairoImg, srcNComps, (int)image->getComponentsCount(), &acc, pixelRod, shapeColor, opacity, useOpacity);
+}
+
 template <typename PIX,int maxValue, int srcNComps, int dstNComps>
 static void
 convertCairoImageToNatronImageForDstComponents(cairo_surface_t* cairoImg,
@@ -2767,6 +2771,143 @@ RotoContext::renderMaskFromStroke(const boost::shared_ptr<RotoDrawableItem>& str
 
 
 
+namespace {
+
+struct RotoStrokeTiles
+{
+    const std::vector<RotoStrokeDot>* dots;
+    std::vector<RectI> tiles;
+    std::vector<std::vector<int> > tileDots; //< the dots intersecting each tile, in the order of the stroke
+    cairo_format_t cairoImgFormat;
+    int srcNComps;
+    int dstNComps;
+    ImageBitDepthEnum depth;
+    bool doBuildUp;
+    double opacity;
+    double shapeColor[3];
+    bool useOpacity;
+    Image::WriteAccess* acc;
+};
+
+} // anon namespace
+
+static void
+renderStrokeTile(RotoStrokeTiles* args,
+                 unsigned int index)
+{
+    const RectI & tile = args->tiles[index];
+    
+    cairo_surface_t* cairoImg = cairo_image_surface_create(args->cairoImgFormat, tile.width(), tile.height() );
+    if (cairo_surface_status(cairoImg) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(cairoImg);
+        return;
+    }
+    cairo_surface_set_device_offset(cairoImg, -tile.x1, -tile.y1);
+    cairo_t* cr = cairo_create(cairoImg);
+    cairo_set_fill_rule(cr, CAIRO_FILL_RULE_WINDING);
+    cairo_set_antialias(cr, CAIRO_ANTIALIAS_NONE);
+    cairo_set_operator(cr, args->doBuildUp ? CAIRO_OPERATOR_OVER : CAIRO_OPERATOR_LIGHTEN);
+    
+    std::vector<cairo_pattern_t*> dotPatterns(ROTO_PRESSURE_LEVELS, (cairo_pattern_t*)0);
+    const std::vector<int> & tileDots = args->tileDots[index];
+    for (std::vector<int>::const_iterator it = tileDots.begin(); it != tileDots.end(); ++it) {
+        const RotoStrokeDot & dot = (*args->dots)[*it];
+        RotoContextPrivate::renderDot(cr, dotPatterns, dot.center, dot.internalDotRadius, dot.externalDotRadius, dot.pressure, args->doBuildUp, dot.opacityStops, args->opacity);
+    }
+    
+    ///A call to cairo_surface_flush() is required before accessing the pixel data
+    ///to ensure that all pending drawing operations are finished.
+    cairo_surface_flush(cairoImg);
+    
+    switch (args->depth) {
+        case eImageBitDepthFloat:
+            convertCairoImageToNatronImage_noColor<float, 1>(cairoImg, args->srcNComps, args->dstNComps, args->acc, tile, args->shapeColor, args->opacity, args->useOpacity);
+            break;
+        case eImageBitDepthByte:
+            convertCairoImageToNatronImage_noColor<unsigned char, 255>(cairoImg, args->srcNComps, args->dstNComps, args->acc, tile, args->shapeColor, args->opacity, args->useOpacity);
+            break;
+        case eImageBitDepthShort:
+            convertCairoImageToNatronImage_noColor<unsigned short, 65535>(cairoImg, args->srcNComps, args->dstNComps, args->acc, tile, args->shapeColor, args->opacity, args->useOpacity);
+            break;
+        case eImageBitDepthHalf:
+        case eImageBitDepthNone:
+            assert(false);
+            break;
+    }
+    
+    cairo_destroy(cr);
+    ////Free the buffer used by Cairo
+    cairo_surface_destroy(cairoImg);
+}
+
+void
+RotoContextPrivate::renderStrokeDots(const std::vector<RotoStrokeDot>& dots,
+                                     const RectI & roi,
+                                     int tileSize,
+                                     cairo_format_t cairoImgFormat,
+                                     bool doBuildUp,
+                                     double opacity,
+                                     const double shapeColor[3],
+                                     bool useOpacity,
+                                     Image* image)
+{
+    RotoStrokeTiles args;
+    args.dots = &dots;
+    args.cairoImgFormat = cairoImgFormat;
+    args.srcNComps = cairoImgFormat == CAIRO_FORMAT_A8 ? 1 : 4;
+    args.dstNComps = (int)image->getComponentsCount();
+    args.depth = image->getBitDepth();
+    args.doBuildUp = doBuildUp;
+    args.opacity = opacity;
+    for (int c = 0; c < 3; ++c) {
+        args.shapeColor[c] = shapeColor[c];
+    }
+    args.useOpacity = useOpacity;
+    
+    int nTilesX = (roi.width() + tileSize - 1) / tileSize;
+    int nTilesY = (roi.height() + tileSize - 1) / tileSize;
+    std::vector<std::vector<int> > tileDots(nTilesX * nTilesY);
+    for (std::size_t i = 0; i < dots.size(); ++i) {
+        const RotoStrokeDot & dot = dots[i];
+        int x1 = std::max( (int)std::floor(dot.center.x - dot.externalDotRadius), roi.x1 );
+        int x2 = std::min( (int)std::floor(dot.center.x + dot.externalDotRadius), roi.x2 - 1 );
+        int y1 = std::max( (int)std::floor(dot.center.y - dot.externalDotRadius), roi.y1 );
+        int y2 = std::min( (int)std::floor(dot.center.y + dot.externalDotRadius), roi.y2 - 1 );
+        if ( (x1 > x2) || (y1 > y2) ) {
+            continue;
+        }
+        for (int ty = (y1 - roi.y1) / tileSize; ty <= (y2 - roi.y1) / tileSize; ++ty) {
+            for (int tx = (x1 - roi.x1) / tileSize; tx <= (x2 - roi.x1) / tileSize; ++tx) {
+                tileDots[ty * nTilesX + tx].push_back( (int)i );
+            }
+        }
+    }
+    for (int ty = 0; ty < nTilesY; ++ty) {
+        for (int tx = 0; tx < nTilesX; ++tx) {
+            std::vector<int> & d = tileDots[ty * nTilesX + tx];
+            if ( d.empty() ) {
+                continue;
+            }
+            RectI tile(roi.x1 + tx * tileSize,
+                       roi.y1 + ty * tileSize,
+                       std::min(roi.x1 + (tx + 1) * tileSize, roi.x2),
+                       std::min(roi.y1 + (ty + 1) * tileSize, roi.y2) );
+            args.tiles.push_back(tile);
+            args.tileDots.push_back(std::vector<int>());
+            args.tileDots.back().swap(d);
+        }
+    }
+    
+    ///The tiles without any dot are left black
+    image->fillZero(roi);
+    
+    if ( !args.tiles.empty() ) {
+        Image::WriteAccess acc = image->getWriteRights();
+        args.acc = &acc;
+        appPTR->getTaskScheduler()->parallelFor( (unsigned int)args.tiles.size(), boost::bind(&renderStrokeTile, &args, _1) );
+    }
+}
+
 boost::shared_ptr<Image>
 RotoContext::renderMaskInternal(const boost::shared_ptr<RotoDrawableItem>& stroke,
                                 const RectI & roi,
@@ -2787,9 +2928,23 @@ RotoContext::renderMaskInternal(const boost::shared_ptr<RotoDrawableItem>& strok
     
     RotoStrokeItem* isStroke = dynamic_cast<RotoStrokeItem*>(stroke.get());
     Bezier* isBezier = dynamic_cast<Bezier*>(stroke.get());
+    
+    double shapeColor[3];
+    stroke->getColor(time, shapeColor);
+    
+    double opacity = stroke->getOpacity(time);
+    
+    if (isBezier && !isBezier->isOpenBezier()) {
+        ///Closed shapes are rendered in tiles by the RotoShapeRasterizer, directly in the image
+        RotoShapeRasterizer rasterizer;
+        _imp->renderBezier(isBezier, time, mipmapLevel, &rasterizer);
+        rasterizer.renderToImage(roi, shapeColor, opacity, true, image.get());
+        
+        return image;
+    }
+    
     cairo_format_t cairoImgFormat;
     
-    int srcNComps;
     bool doBuildUp = true;
     
     if (isStroke) {
@@ -2800,93 +2955,21 @@ RotoContext::renderMaskInternal(const boost::shared_ptr<RotoDrawableItem>& strok
         //For the non build-up case, we use the LIGHTEN compositing operator, which only works on colors
         if (!doBuildUp || components.getNumComponents() > 1) {
             cairoImgFormat = CAIRO_FORMAT_ARGB32;
-            srcNComps = 4;
         } else {
             cairoImgFormat = CAIRO_FORMAT_A8;
-            srcNComps = 1;
         }
         
     } else {
         cairoImgFormat = CAIRO_FORMAT_A8;
-        srcNComps = 1;
-    }
-    
-
-    ////Allocate the cairo temporary buffer
-    cairo_surface_t* cairoImg = cairo_image_surface_create(cairoImgFormat, roi.width(), roi.height() );
-    cairo_surface_set_device_offset(cairoImg, -roi.x1, -roi.y1);
-    if (cairo_surface_status(cairoImg) != CAIRO_STATUS_SUCCESS) {
-        return image;
     }
-    cairo_t* cr = cairo_create(cairoImg);
-    //cairo_set_fill_rule(cr, CAIRO_FILL_RULE_EVEN_ODD); // creates holes on self-overlapping shapes
-    cairo_set_fill_rule(cr, CAIRO_FILL_RULE_WINDING);
     
-    // these Roto shapes must be rendered WITHOUT antialias, or the junction between the inner
-    // polygon and the feather zone will have artifacts. This is partly due to the fact that cairo
-    // meshes are not antialiased.
-    // Use a default feather distance of 1 pixel instead!
-    // UPDATE: unfortunately, this produces less artifacts, but there are still some remaining (use opacity=0.5 to test)
-    // maybe the inner polygon should be made of mesh patterns too?
-    cairo_set_antialias(cr, CAIRO_ANTIALIAS_NONE);
-
-    
-    double shapeColor[3];
-    stroke->getColor(time, shapeColor);
-
-    double opacity = stroke->getOpacity(time);
-
     assert(isStroke || isBezier);
-    if (isStroke || !isBezier || (isBezier && isBezier->isOpenBezier())) {
-        std::vector<cairo_pattern_t*> dotPatterns(ROTO_PRESSURE_LEVELS);
-        for (std::size_t i = 0; i < dotPatterns.size(); ++i) {
-            dotPatterns[i] = (cairo_pattern_t*)0;
-        }
-        _imp->renderStroke(cr, dotPatterns, strokes, 0, stroke, doBuildUp, opacity, time, mipmapLevel);
-        
-        for (std::size_t i = 0; i < dotPatterns.size(); ++i) {
-            if (dotPatterns[i]) {
-                cairo_pattern_destroy(dotPatterns[i]);
-                dotPatterns[i] = 0;
-            }
-        }
-        
-        
-    } else {
-        _imp->renderBezier(cr, isBezier, opacity, time, mipmapLevel);
-    }
+    assert(depth == image->getBitDepth());
+    Q_UNUSED(depth);
+    std::vector<RotoStrokeDot> dots;
+    _imp->computeStrokeDots(strokes, 0, stroke, opacity, time, mipmapLevel, &dots);
     
-    bool useOpacityToConvert = (isBezier != 0);
-    
-    switch (depth) {
-        case eImageBitDepthFloat:
-            convertCairoImageToNatronImage_noColor<float, 1>(cairoImg, srcNComps, image.get(), roi, shapeColor, opacity, useOpacityToConvert);
-            break;
-        case eImageBitDepthByte:
-            convertCairoImageToNatronImage_noColor<unsigned char, 255>(cairoImg, srcNComps,  image.get(), roi,shapeColor, opacity, useOpacityToConvert);
-            break;
-        case eImageBitDepthShort:
-            convertCairoImageToNatronImage_noColor<unsigned short, 65535>(cairoImg, srcNComps, image.get(), roi,shapeColor, opacity, useOpacityToConvert);
-            break;
-        case eImageBitDepthHalf:
-        case eImageBitDepthNone:
-            assert(false);
-            break;
-    }
-
-    
-    assert(cairo_surface_status(cairoImg) == CAIRO_STATUS_SUCCESS);
-    
-    ///A call to cairo_surface_flush() is required before accessing the pixel data
-    ///to ensure that all pending drawing operations are finished.
-    cairo_surface_flush(cairoImg);
-    
-    
-    
-    cairo_destroy(cr);
-    ////Free the buffer used by Cairo
-    cairo_surface_destroy(cairoImg);
-
+    RotoContextPrivate::renderStrokeDots(dots, roi, kRotoStrokeTileSize, cairoImgFormat, doBuildUp, opacity, shapeColor, isBezier != 0, image.get() );
     
     return image;
 }
@@ -2921,6 +3004,7 @@ RotoContextPrivate::renderDot(cairo_t* cr,
                               double opacity)
 {
     
+    cairo_pattern_t* uncachedPattern = 0;
     if (!opacityStops.empty()) {
         cairo_pattern_t* pattern;
         // sometimes, Qt gives a pressure level > 1... so we clamp it
@@ -2938,6 +3022,7 @@ RotoContextPrivate::renderDot(cairo_t* cr,
                 }
             }
             //dotPatterns[pressureInt] = pattern;
+            uncachedPattern = pattern;
         }
         cairo_translate(cr, center.x, center.y);
         cairo_set_source(cr, pattern);
@@ -2950,17 +3035,20 @@ RotoContextPrivate::renderDot(cairo_t* cr,
         }
     }
 #ifdef DEBUG
-    //Make sure the dot we are about to render falls inside the clip region, otherwise the bounds of the image are mis-calculated.
+    //Make sure the dot we are about to render touches the clip region: the dots of a tile are only the ones intersecting it
     cairo_surface_t* target = cairo_get_target(cr);
     int w = cairo_image_surface_get_width(target);
     int h = cairo_image_surface_get_height(target);
     double x1,y1;
     cairo_surface_get_device_offset(target, &x1, &y1);
-    assert(std::floor(center.x - externalDotRadius) >= -x1 && std::floor(center.x + externalDotRadius) < -x1 + w &&
-           std::floor(center.y - externalDotRadius) >= -y1 && std::floor(center.y + externalDotRadius) < -y1 + h);
+    assert(std::floor(center.x + externalDotRadius) >= -x1 && std::floor(center.x - externalDotRadius) < -x1 + w &&
+           std::floor(center.y + externalDotRadius) >= -y1 && std::floor(center.y - externalDotRadius) < -y1 + h);
 #endif
     cairo_arc(cr, center.x, center.y, externalDotRadius, 0, M_PI * 2);
     cairo_fill(cr);
+    if (uncachedPattern) {
+        cairo_pattern_destroy(uncachedPattern);
+    }
 }
 
 static void getRenderDotParams(double alpha, double brushSizePixel, double brushHardness, double brushSpacing, double pressure, bool pressureAffectsOpacity, bool pressureAffectsSize, bool pressureAffectsHardness, double* internalDotRadius, double* externalDotRadius, double * spacing, std::vector<std::pair<double,double> >* opacityStops)
@@ -2996,15 +3084,13 @@ static void getRenderDotParams(double alpha, double brushSizePixel, double brush
 }
 
 double
-RotoContextPrivate::renderStroke(cairo_t* cr,
-                                 std::vector<cairo_pattern_t*>& dotPatterns,
-                                 const std::list<std::list<std::pair<Point,double> > >& strokes,
-                                 double distToNext,
-                                 const boost::shared_ptr<RotoDrawableItem>&  stroke,
-                                 bool doBuildup,
-                                 double alpha,
-                                 double time,
-                                 unsigned int mipmapLevel)
+RotoContextPrivate::computeStrokeDots(const std::list<std::list<std::pair<Point,double> > >& strokes,
+                                      double distToNext,
+                                      const boost::shared_ptr<RotoDrawableItem>&  stroke,
+                                      double alpha,
+                                      double time,
+                                      unsigned int mipmapLevel,
+                                      std::vector<RotoStrokeDot>* dots)
 {
     if (strokes.empty()) {
         return distToNext;
@@ -3014,8 +3100,6 @@ RotoContextPrivate::renderStroke(cairo_t* cr,
         return distToNext;
     }
     
-    assert(dotPatterns.size() == ROTO_PRESSURE_LEVELS);
-    
     boost::shared_ptr<KnobDouble> brushSizeKnob = stroke->getBrushSizeKnob();
     double brushSize = brushSizeKnob->getValueAtTime(time);
     boost::shared_ptr<KnobDouble> brushSpacingKnob = stroke->getBrushSpacingKnob();
@@ -3047,8 +3131,6 @@ RotoContextPrivate::renderStroke(cairo_t* cr,
     if (mipmapLevel != 0) {
         brushSizePixel = std::max(1.,brushSizePixel / (1 << mipmapLevel));
     }
-    cairo_set_operator(cr,doBuildup ? CAIRO_OPERATOR_OVER : CAIRO_OPERATOR_LIGHTEN);
-
     
     for (std::list<std::list<std::pair<Point,double> > >::const_iterator strokeIt = strokes.begin() ;strokeIt != strokes.end() ;++strokeIt) {
         int firstPoint = (int)std::floor((strokeIt->size() * writeOnStart));
@@ -3072,10 +3154,12 @@ RotoContextPrivate::renderStroke(cairo_t* cr,
         std::list<std::pair<Point,double> >::iterator it = visiblePortion.begin();
         
         if (visiblePortion.size() == 1) {
-            double internalDotRadius, externalDotRadius, spacing;
-            std::vector<std::pair<double,double> > opacityStops;
-            getRenderDotParams(alpha, brushSizePixel, brushHardness, brushSpacing, it->second, pressureAffectsOpacity, pressureAffectsSize, pressureAffectsHardness, &internalDotRadius, &externalDotRadius, &spacing, &opacityStops);
-            renderDot(cr, dotPatterns, it->first, internalDotRadius, externalDotRadius, it->second, doBuildup, opacityStops, alpha);
+            RotoStrokeDot dot;
+            double spacing;
+            dot.center = it->first;
+            dot.pressure = it->second;
+            getRenderDotParams(alpha, brushSizePixel, brushHardness, brushSpacing, it->second, pressureAffectsOpacity, pressureAffectsSize, pressureAffectsHardness, &dot.internalDotRadius, &dot.externalDotRadius, &spacing, &dot.opacityStops);
+            dots->push_back(dot);
             continue;
         }
         
@@ -3092,17 +3176,15 @@ RotoContextPrivate::renderStroke(cairo_t* cr,
             // while the next point can be drawn on this segment, draw a point and advance
             while (distToNext <= dist) {
                 double a = dist == 0. ? 0. : distToNext/dist;
-                Point center = {
-                    it->first.x * (1 - a) + next->first.x * a,
-                    it->first.y * (1 - a) + next->first.y * a
-                };
-                double pressure = it->second * (1 - a) + next->second * a;
+                RotoStrokeDot dot;
+                dot.center.x = it->first.x * (1 - a) + next->first.x * a;
+                dot.center.y = it->first.y * (1 - a) + next->first.y * a;
+                dot.pressure = it->second * (1 - a) + next->second * a;
                 
-                // draw the dot
-                double internalDotRadius, externalDotRadius, spacing;
-                std::vector<std::pair<double,double> > opacityStops;
-                getRenderDotParams(alpha, brushSizePixel, brushHardness, brushSpacing, pressure, pressureAffectsOpacity, pressureAffectsSize, pressureAffectsHardness, &internalDotRadius, &externalDotRadius, &spacing, &opacityStops);
-                renderDot(cr, dotPatterns, center, internalDotRadius, externalDotRadius, pressure, doBuildup, opacityStops, alpha);
+                // place the dot
+                double spacing;
+                getRenderDotParams(alpha, brushSizePixel, brushHardness, brushSpacing, dot.pressure, pressureAffectsOpacity, pressureAffectsSize, pressureAffectsHardness, &dot.internalDotRadius, &dot.externalDotRadius, &spacing, &dot.opacityStops);
+                dots->push_back(dot);
                 
                 distToNext += spacing;
             }
@@ -3118,10 +3200,37 @@ RotoContextPrivate::renderStroke(cairo_t* cr,
     return distToNext;
 }
 
+double
+RotoContextPrivate::renderStroke(cairo_t* cr,
+                                 std::vector<cairo_pattern_t*>& dotPatterns,
+                                 const std::list<std::list<std::pair<Point,double> > >& strokes,
+                                 double distToNext,
+                                 const boost::shared_ptr<RotoDrawableItem>&  stroke,
+                                 bool doBuildup,
+                                 double alpha,
+                                 double time,
+                                 unsigned int mipmapLevel)
+{
+    assert(dotPatterns.size() == ROTO_PRESSURE_LEVELS);
+    
+    std::vector<RotoStrokeDot> dots;
+    distToNext = computeStrokeDots(strokes, distToNext, stroke, alpha, time, mipmapLevel, &dots);
+    
+    cairo_set_operator(cr,doBuildup ? CAIRO_OPERATOR_OVER : CAIRO_OPERATOR_LIGHTEN);
+    for (std::vector<RotoStrokeDot>::const_iterator it = dots.begin(); it != dots.end(); ++it) {
+        renderDot(cr, dotPatterns, it->center, it->internalDotRadius, it->externalDotRadius, it->pressure, doBuildup, it->opacityStops, alpha);
+    }
+    
+    return distToNext;
+}
+
 
 
 void
-RotoContextPrivate::renderBezier(cairo_t* cr,const Bezier* bezier,double opacity, double time, unsigned int mipmapLevel)
+RotoContextPrivate::renderBezier(const Bezier* bezier,
+                                 double time,
+                                 unsigned int mipmapLevel,
+                                 RotoShapeRasterizer* rasterizer)
 {
     ///render the bezier only if finished (closed) and activated
     if ( !bezier->isCurveFinished() || !bezier->isActivated(time) || ( bezier->getControlPointsCount() <= 1 ) ) {
@@ -3131,91 +3240,36 @@ RotoContextPrivate::renderBezier(cairo_t* cr,const Bezier* bezier,double opacity
     
     double fallOff = bezier->getFeatherFallOff(time);
     double featherDist = bezier->getFeatherDistance(time);
-#ifdef NATRON_ROTO_INVERTIBLE
-    bool inverted = (*it2)->getInverted(time);
-#else
-    const bool inverted = false;
-#endif
-    double shapeColor[3];
-    bezier->getColor(time, shapeColor);
-    
-    cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
-    
-    BezierCPs cps = bezier->getControlPoints_mt_safe();
-    
-    BezierCPs fps = bezier->getFeatherPoints_mt_safe();
-    
-    assert( cps.size() == fps.size() );
-    
-    if ( cps.empty() ) {
-        return;
-    }
-    
-    cairo_new_path(cr);
-    
-    ////Define the feather edge pattern
-    cairo_pattern_t* mesh = cairo_pattern_create_mesh();
-    if (cairo_pattern_status(mesh) != CAIRO_STATUS_SUCCESS) {
-        cairo_pattern_destroy(mesh);
-        return;
-    }
     
     ///Adjust the feather distance so it takes the mipmap level into account
     if (mipmapLevel != 0) {
         featherDist /= (1 << mipmapLevel);
     }
     
-    Transform::Matrix3x3 transform;
-    bezier->getTransformAtTime(time, &transform);
-    
-    
-    renderFeather(bezier, time, mipmapLevel, inverted, shapeColor, opacity, featherDist, fallOff, mesh);
-    
-    
-    if (!inverted) {
-        // strangely, the above-mentioned cairo bug doesn't affect this function
-        renderInternalShape(time, mipmapLevel, shapeColor, opacity, transform, cr, mesh, cps);
-#ifdef NATRON_ROTO_INVERTIBLE
-    } else {
-#pragma message WARN("doesn't work! the image should be infinite for this to work!")
-        // Doesn't work! the image should be infinite for this to work!
-        // Or at least it should contain the Union of the source RoDs.
-        // Here, it only contains the boinding box of the Bezier.
-        // If there's a transform after the roto node, a black border will appear.
-        // The only solution would be to have a color parameter which specifies how on image is outside of its RoD.
-        // Unfortunately, the OFX definition is: "it is black and transparent"
-        
-        ///If inverted, draw an inverted rectangle on all the image first
-        // with a hole consisting of the feather polygon
-        
-        double xOffset, yOffset;
-        cairo_surface_get_device_offset(cairoImg, &xOffset, &yOffset);
-        int width = cairo_image_surface_get_width(cairoImg);
-        int height = cairo_image_surface_get_height(cairoImg);
-        
-        cairo_move_to(cr, -xOffset, -yOffset);
-        cairo_line_to(cr, -xOffset + width, -yOffset);
-        cairo_line_to(cr, -xOffset + width, -yOffset + height);
-        cairo_line_to(cr, -xOffset, -yOffset + height);
-        cairo_line_to(cr, -xOffset, -yOffset);
-        // strangely, the above-mentioned cairo bug doesn't affect this function
-#pragma message WARN("WRONG! should use the outer feather contour, *displaced* by featherDistance, not fps")
-        renderInternalShape(time, mipmapLevel, cr, fps);
-#endif
+    ///The polygon is the same as the inner side of the feather, so that they join without any gap
+    std::list<Point> bezierPolygon;
+    bezier->evaluateAtTime_DeCasteljau(false, time, mipmapLevel, 50, &bezierPolygon, NULL);
+    if ( bezierPolygon.empty() ) {
+        return;
     }
     
-    applyAndDestroyMask(cr, mesh);
-
+    rasterizer->setFeatherFallOff(fallOff);
+    rasterizer->addPolygon(bezierPolygon);
+    renderFeather(bezier, time, mipmapLevel, featherDist, bezierPolygon, rasterizer);
 }
 
 void
-RotoContextPrivate::renderFeather(const Bezier* bezier,double time, unsigned int mipmapLevel, bool inverted, double shapeColor[3], double /*opacity*/, double featherDist, double fallOff, cairo_pattern_t* mesh)
+RotoContextPrivate::renderFeather(const Bezier* bezier,
+                                  double time,
+                                  unsigned int mipmapLevel,
+                                  double featherDist,
+                                  const std::list<Point> & bezierPolygon,
+                                  RotoShapeRasterizer* rasterizer)
 {
     
     ///Note that we do not use the opacity when rendering the bezier, it is rendered with correct floating point opacity/color when converting
     ///to the Natron image.
     
-    double fallOffInverse = 1. / fallOff;
     /*
      * We descretize the feather control points to obtain a polygon so that the feather distance will be of the same thickness around all the shape.
      * If we were to extend only the end points, the resulting bezier interpolation would create a feather with different thickness around the shape,
@@ -3225,17 +3279,17 @@ RotoContextPrivate::renderFeather(const Bezier* bezier,double time, unsigned int
     ///This is used only if the feather distance is different of 0 and the feather points equal
     ///the control points in order to still be able to apply the feather distance.
     std::list<Point> featherPolygon;
-    std::list<Point> bezierPolygon;
     RectD featherPolyBBox;
     featherPolyBBox.setupInfinity();
     
     bezier->evaluateFeatherPointsAtTime_DeCasteljau(false, time, mipmapLevel, 50, true, &featherPolygon, &featherPolyBBox);
-    bezier->evaluateAtTime_DeCasteljau(false, time, mipmapLevel, 50, &bezierPolygon, NULL);
     
     bool clockWise = bezier->isFeatherPolygonClockwiseOriented(false, time);
     
     assert( !featherPolygon.empty() && !bezierPolygon.empty());
-
+    if ( featherPolygon.empty() ) {
+        return;
+    }
 
     std::list<Point> featherContour;
 
@@ -3247,8 +3301,8 @@ RotoContextPrivate::renderFeather(const Bezier* bezier,double time, unsigned int
     }
     std::list<Point>::iterator prev = featherPolygon.end();
     --prev; // can only be valid since we assert the list is not empty
-    std::list<Point>::iterator bezIT = bezierPolygon.begin();
-    std::list<Point>::iterator prevBez = bezierPolygon.end();
+    std::list<Point>::const_iterator bezIT = bezierPolygon.begin();
+    std::list<Point>::const_iterator prevBez = bezierPolygon.end();
     --prevBez; // can only be valid since we assert the list is not empty
 
     // prepare p1
@@ -3320,7 +3374,7 @@ RotoContextPrivate::renderFeather(const Bezier* bezier,double time, unsigned int
             continue;
         }
         
-        Point p0, p0p1, p1p0, p2, p2p3, p3p2, p3;
+        Point p0, p2, p3;
         p0.x = prevBez->x;
         p0.y = prevBez->y;
         p3.x = bezIT->x;
@@ -3345,50 +3399,8 @@ RotoContextPrivate::renderFeather(const Bezier* bezier,double time, unsigned int
         }
         featherContour.push_back(p2);
         
-        ///linear interpolation
-        p0p1.x = (p0.x * fallOff * 2. + fallOffInverse * p1.x) / (fallOff * 2. + fallOffInverse);
-        p0p1.y = (p0.y * fallOff * 2. + fallOffInverse * p1.y) / (fallOff * 2. + fallOffInverse);
-        p1p0.x = (p0.x * fallOff + 2. * fallOffInverse * p1.x) / (fallOff + 2. * fallOffInverse);
-        p1p0.y = (p0.y * fallOff + 2. * fallOffInverse * p1.y) / (fallOff + 2. * fallOffInverse);
-
-        
-        p2p3.x = (p3.x * fallOff + 2. * fallOffInverse * p2.x) / (fallOff + 2. * fallOffInverse);
-        p2p3.y = (p3.y * fallOff + 2. * fallOffInverse * p2.y) / (fallOff + 2. * fallOffInverse);
-        p3p2.x = (p3.x * fallOff * 2. + fallOffInverse * p2.x) / (fallOff * 2. + fallOffInverse);
-        p3p2.y = (p3.y * fallOff * 2. + fallOffInverse * p2.y) / (fallOff * 2. + fallOffInverse);
-
-        
-        ///move to the initial point
-        cairo_mesh_pattern_begin_patch(mesh);
-        cairo_mesh_pattern_move_to(mesh, p0.x, p0.y);
-        cairo_mesh_pattern_curve_to(mesh, p0p1.x, p0p1.y, p1p0.x, p1p0.y, p1.x, p1.y);
-        cairo_mesh_pattern_line_to(mesh, p2.x, p2.y);
-        cairo_mesh_pattern_curve_to(mesh, p2p3.x, p2p3.y, p3p2.x, p3p2.y, p3.x, p3.y);
-        cairo_mesh_pattern_line_to(mesh, p0.x, p0.y);
-        ///Set the 4 corners color
-        ///inner is full color
-        
-        // IMPORTANT NOTE:
-        // The two sqrt below are due to a probable cairo bug.
-        // To check wether the bug is present is a given cairo version,
-        // make any shape with a very large feather and set
-        // opacity to 0.5. Then, zoom on the polygon border to check if the intensity is continuous
-        // and approximately equal to 0.5.
-        // If the bug if ixed in cairo, please use #if CAIRO_VERSION>xxx to keep compatibility with
-        // older Cairo versions.
-        cairo_mesh_pattern_set_corner_color_rgba( mesh, 0, shapeColor[0], shapeColor[1], shapeColor[2],
-                                                 std::sqrt(inverted ? 0. : 1.) );
-        ///outter is faded
-        cairo_mesh_pattern_set_corner_color_rgba(mesh, 1, shapeColor[0], shapeColor[1], shapeColor[2],
-                                                 inverted ? 1. : 0.);
-        cairo_mesh_pattern_set_corner_color_rgba(mesh, 2, shapeColor[0], shapeColor[1], shapeColor[2],
-                                                 inverted ? 1. : 0.);
-        ///inner is full color
-        cairo_mesh_pattern_set_corner_color_rgba(mesh, 3, shapeColor[0], shapeColor[1], shapeColor[2],
-                                                 std::sqrt(inverted ? 0. : 1.));
-        assert(cairo_pattern_status(mesh) == CAIRO_STATUS_SUCCESS);
-        
-        cairo_mesh_pattern_end_patch(mesh);
+        ///inner is full color, outter is faded
+        rasterizer->addFeatherQuad(p0, p1, p2, p3);
         
         if (mustStop) {
             break;
@@ -3415,226 +3427,6 @@ RotoContextPrivate::renderFeather(const Bezier* bezier,double time, unsigned int
 
 }
 
-void
-RotoContextPrivate::renderInternalShape(double time,
-                                        unsigned int mipmapLevel,
-                                        double /*shapeColor*/[3],
-                                        double /*opacity*/,
-                                        const Transform::Matrix3x3& transform,
-                                        cairo_t* cr,
-#ifdef ROTO_USE_MESH_PATTERN_ONLY
-                                        cairo_pattern_t* mesh,
-#else
-                                        cairo_pattern_t* /*mesh*/,
-#endif
-                                        const BezierCPs & cps)
-{
-    assert(!cps.empty());
-#ifdef ROTO_USE_MESH_PATTERN_ONLY
-    std::list<BezierCPs> coonPatches;
-    bezulate(time, cps, &coonPatches);
-    
-    for (std::list<BezierCPs>::iterator it = coonPatches.begin(); it != coonPatches.end(); ++it) {
-        
-        std::list<BezierCPs> fixedPatch;
-        CoonsRegularization::regularize(*it, time, &fixedPatch);
-        for (std::list<BezierCPs>::iterator it2 = fixedPatch.begin(); it2 != fixedPatch.end(); ++it2) {
-            
-            
-            
-            std::size_t size = it2->size();
-            assert(size <= 4 && size >= 2);
-            
-            BezierCPs::iterator patchIT = it2->begin();
-            boost::shared_ptr<BezierCP> p0ptr,p1ptr,p2ptr,p3ptr;
-            p0ptr = *patchIT;
-            ++patchIT;
-            if (size == 2) {
-                p1ptr = p0ptr;
-                p2ptr = *patchIT;
-                p3ptr = p2ptr;
-            } else if (size == 3) {
-                p1ptr = *patchIT;
-                p2ptr = *patchIT;
-                ++patchIT;
-                p3ptr = *patchIT;
-            } else if (size == 4) {
-                p1ptr = *patchIT;
-                ++patchIT;
-                p2ptr = *patchIT;
-                ++patchIT;
-                p3ptr = *patchIT;
-            }
-            assert(p0ptr && p1ptr && p2ptr && p3ptr);
-            
-            Point p0,p0p1,p1p0,p1,p1p2,p2p1,p2p3,p3p2,p2,p3,p3p0,p0p3;
-            
-            p0ptr->getLeftBezierPointAtTime(time, &p0p3.x, &p0p3.y);
-            p0ptr->getPositionAtTime(time, &p0.x, &p0.y);
-            p0ptr->getRightBezierPointAtTime(time, &p0p1.x, &p0p1.y);
-            
-            p1ptr->getLeftBezierPointAtTime(time, &p1p0.x, &p1p0.y);
-            p1ptr->getPositionAtTime(time, &p1.x, &p1.y);
-            p1ptr->getRightBezierPointAtTime(time, &p1p2.x, &p1p2.y);
-            
-            p2ptr->getLeftBezierPointAtTime(time, &p2p1.x, &p2p1.y);
-            p2ptr->getPositionAtTime(time, &p2.x, &p2.y);
-            p2ptr->getRightBezierPointAtTime(time, &p2p3.x, &p2p3.y);
-            
-            p3ptr->getLeftBezierPointAtTime(time, &p3p2.x, &p3p2.y);
-            p3ptr->getPositionAtTime(time, &p3.x, &p3.y);
-            p3ptr->getRightBezierPointAtTime(time, &p3p0.x, &p3p0.y);
-            
-            
-            adjustToPointToScale(mipmapLevel, p0.x, p0.y);
-            adjustToPointToScale(mipmapLevel, p0p1.x, p0p1.y);
-            adjustToPointToScale(mipmapLevel, p1p0.x, p1p0.y);
-            adjustToPointToScale(mipmapLevel, p1.x, p1.y);
-            adjustToPointToScale(mipmapLevel, p1p2.x, p1p2.y);
-            adjustToPointToScale(mipmapLevel, p2p1.x, p2p1.y);
-            adjustToPointToScale(mipmapLevel, p2.x, p2.y);
-            adjustToPointToScale(mipmapLevel, p2p3.x, p2p3.y);
-            adjustToPointToScale(mipmapLevel, p3p2.x, p3p2.y);
-            adjustToPointToScale(mipmapLevel, p3.x, p3.y);
-            adjustToPointToScale(mipmapLevel, p3p0.x, p3p0.y);
-            adjustToPointToScale(mipmapLevel, p0p3.x, p0p3.y);
-            
-            
-            /*
-             Add a Coons patch such as:
-             
-             C1  Side 1   C2
-             +---------------+
-             |               |
-             |  P1       P2  |
-             |               |
-             Side 0 |               | Side 2
-             |               |
-             |               |
-             |  P0       P3  |
-             |               |
-             +---------------+
-             C0     Side 3   C3
-             
-             In the above drawing, C0 is p0, P0 is p0p1, P1 is p1p0, C1 is p1 and so on...
-             */
-            
-            ///move to C0
-            cairo_mesh_pattern_begin_patch(mesh);
-            cairo_mesh_pattern_move_to(mesh, p0.x, p0.y);
-            if (size == 4) {
-                cairo_mesh_pattern_curve_to(mesh, p0p1.x, p0p1.y, p1p0.x, p1p0.y, p1.x, p1.y);
-                cairo_mesh_pattern_curve_to(mesh, p1p2.x, p1p2.y, p2p1.x, p2p1.y, p2.x, p2.y);
-                cairo_mesh_pattern_curve_to(mesh, p2p3.x, p2p3.y, p3p2.x, p3p2.y, p3.x, p3.y);
-                cairo_mesh_pattern_curve_to(mesh, p3p0.x, p3p0.y, p0p3.x, p0p3.y, p0.x, p0.y);
-            } else if (size == 3) {
-                cairo_mesh_pattern_curve_to(mesh, p0p1.x, p0p1.y, p1p0.x, p1p0.y, p1.x, p1.y);
-                cairo_mesh_pattern_line_to(mesh, p2.x, p2.y);
-                cairo_mesh_pattern_curve_to(mesh, p2p3.x, p2p3.y, p3p2.x, p3p2.y, p3.x, p3.y);
-                cairo_mesh_pattern_curve_to(mesh, p3p0.x, p3p0.y, p0p3.x, p0p3.y, p0.x, p0.y);
-            } else {
-                assert(size == 2);
-                cairo_mesh_pattern_line_to(mesh, p1.x, p1.y);
-                cairo_mesh_pattern_curve_to(mesh, p1p2.x, p1p2.y, p2p1.x, p2p1.y, p2.x, p2.y);
-                cairo_mesh_pattern_line_to(mesh, p3.x, p3.y);
-                cairo_mesh_pattern_curve_to(mesh, p3p0.x, p3p0.y, p0p3.x, p0p3.y, p0.x, p0.y);
-            }
-            ///Set the 4 corners color
-            
-            // IMPORTANT NOTE:
-            // The two sqrt below are due to a probable cairo bug.
-            // To check wether the bug is present is a given cairo version,
-            // make any shape with a very large feather and set
-            // opacity to 0.5. Then, zoom on the polygon border to check if the intensity is continuous
-            // and approximately equal to 0.5.
-            // If the bug if ixed in cairo, please use #if CAIRO_VERSION>xxx to keep compatibility with
-            // older Cairo versions.
-            cairo_mesh_pattern_set_corner_color_rgba( mesh, 0, shapeColor[0], shapeColor[1], shapeColor[2],
-                                                     std::sqrt(opacity) );
-            cairo_mesh_pattern_set_corner_color_rgba(mesh, 1, shapeColor[0], shapeColor[1], shapeColor[2],
-                                                     opacity);
-            cairo_mesh_pattern_set_corner_color_rgba(mesh, 2, shapeColor[0], shapeColor[1], shapeColor[2],
-                                                     opacity);
-            cairo_mesh_pattern_set_corner_color_rgba(mesh, 3, shapeColor[0], shapeColor[1], shapeColor[2],
-                                                     std::sqrt(opacity));
-            assert(cairo_pattern_status(mesh) == CAIRO_STATUS_SUCCESS);
-            
-            cairo_mesh_pattern_end_patch(mesh);
-            
-        }
-    }
-#else
-    
-    cairo_set_source_rgba(cr, 1, 1, 1, 1);
-    
-    BezierCPs::const_iterator point = cps.begin();
-    assert(point != cps.end());
-    if (point == cps.end()) {
-        return;
-    }
-    BezierCPs::const_iterator nextPoint = point;
-    if (nextPoint != cps.end()) {
-        ++nextPoint;
-    }
-
-    
-    Transform::Point3D initCp;
-    (*point)->getPositionAtTime(false, time, ViewIdx(0), &initCp.x,&initCp.y);
-    initCp.z = 1.;
-    initCp = Transform::matApply(transform, initCp);
-    
-    adjustToPointToScale(mipmapLevel,initCp.x,initCp.y);
-
-    cairo_move_to(cr, initCp.x,initCp.y);
-
-    while ( point != cps.end() ) {
-        if ( nextPoint == cps.end() ) {
-            nextPoint = cps.begin();
-        }
-        
-        Transform::Point3D right,nextLeft,next;
-        (*point)->getRightBezierPointAtTime(false, time, ViewIdx(0), &right.x, &right.y);
-        right.z = 1;
-        (*nextPoint)->getLeftBezierPointAtTime(false, time, ViewIdx(0), &nextLeft.x, &nextLeft.y);
-        nextLeft.z = 1;
-        (*nextPoint)->getPositionAtTime(false, time, ViewIdx(0), &next.x, &next.y);
-        next.z = 1;
-
-        right = Transform::matApply(transform, right);
-        nextLeft = Transform::matApply(transform, nextLeft);
-        next = Transform::matApply(transform, next);
-        
-        adjustToPointToScale(mipmapLevel,right.x,right.y);
-        adjustToPointToScale(mipmapLevel,next.x,next.y);
-        adjustToPointToScale(mipmapLevel,nextLeft.x,nextLeft.y);
-        cairo_curve_to(cr, right.x, right.y, nextLeft.x, nextLeft.y, next.x, next.y);
-
-        // increment for next iteration
-        ++point;
-        if (nextPoint != cps.end()) {
-            ++nextPoint;
-        }
-    } // while()
-//    if (cairo_get_antialias(cr) != CAIRO_ANTIALIAS_NONE ) {
-//        cairo_fill_preserve(cr);
-//        // These line properties make for a nicer looking polygon mesh
-//        cairo_set_line_join(cr, CAIRO_LINE_JOIN_BEVEL);
-//        cairo_set_line_cap(cr, CAIRO_LINE_CAP_BUTT);
-//        // Comment out the following call to cairo_set_line width
-//        // since the hard-coded width value of 1.0 is not appropriate
-//        // for fills of small areas. Instead, use the line width that
-//        // has already been set by the user via the above call of
-//        // poly_line which in turn calls set_current_context which in
-//        // turn calls cairo_set_line_width for the user-specified
-//        // width.
-//        cairo_set_line_width(cr, 1.0);
-//        cairo_stroke(cr);
-//    } else {
-    cairo_fill(cr);
-//    }
-#endif
-}
-
 struct qpointf_compare_less
 {
     bool operator() (const QPointF& lhs,const QPointF& rhs) const
@@ -3865,19 +3657,6 @@ RotoContextPrivate::bezulate(double time, const BezierCPs& cps,std::list<BezierC
     }
 }
 
-void
-RotoContextPrivate::applyAndDestroyMask(cairo_t* cr,
-                                        cairo_pattern_t* mesh)
-{
-    assert(cairo_pattern_status(mesh) == CAIRO_STATUS_SUCCESS);
-    cairo_set_source(cr, mesh);
-
-    ///paint with the feather with the pattern as a mask
-    cairo_mask(cr, mesh);
-
-    cairo_pattern_destroy(mesh);
-}
-
 void
 RotoContext::changeItemScriptName(const std::string& oldFullyQualifiedName,const std::string& newFullyQUalifiedName)
 {
@@ -1239,6 +1239,16 @@ struct RotoStrokeItemPrivate
     }
 };
 
+///A dot of a paint stroke, in pixel coordinates
+struct RotoStrokeDot
+{
+    Point center;
+    double internalDotRadius;
+    double externalDotRadius;
+    double pressure;
+    std::vector<std::pair<double, double> > opacityStops;
+};
+
 struct RotoContextPrivate
 {
     mutable QMutex rotoContextMutex;
@@ -2131,17 +2141,44 @@ struct RotoContextPrivate
     }
     
     
-    void renderDot(cairo_t* cr,
-                   std::vector<cairo_pattern_t*>& dotPatterns,
-                   const Point &center,
-                   double internalDotRadius,
-                   double externalDotRadius,
-                   double pressure,
-                   bool doBuildUp,
-                   const std::vector<std::pair<double, double> >& opacityStops,
-                   double opacity);
+    static void renderDot(cairo_t* cr,
+                          std::vector<cairo_pattern_t*>& dotPatterns,
+                          const Point &center,
+                          double internalDotRadius,
+                          double externalDotRadius,
+                          double pressure,
+                          bool doBuildUp,
+                          const std::vector<std::pair<double, double> >& opacityStops,
+                          double opacity);
 
     
+    /**
+     * @brief Places the dots of the strokes, spaced along them from distToNext. Returns the distance to the next dot after
+     * the last stroke.
+     **/
+    double computeStrokeDots(const std::list<std::list<std::pair<Point,double> > >& strokes,
+                             double distToNext,
+                             const boost::shared_ptr<RotoDrawableItem>& stroke,
+                             double opacity,
+                             double time,
+                             unsigned int mipmapLevel,
+                             std::vector<RotoStrokeDot>* dots);
+    
+    /**
+     * @brief Renders the dots into the roi of the image, which is zeroed first. The roi is split in tiles of tileSize
+     * pixels, drawn in parallel on their own cairo surface of the given format: each tile only draws the dots
+     * intersecting it, in the order of the stroke.
+     **/
+    static void renderStrokeDots(const std::vector<RotoStrokeDot>& dots,
+                                 const RectI & roi,
+                                 int tileSize,
+                                 cairo_format_t cairoImgFormat,
+                                 bool doBuildUp,
+                                 double opacity,
+                                 const double shapeColor[3],
+                                 bool useOpacity,
+                                 Image* image);
+    
     double renderStroke(cairo_t* cr,
                         std::vector<cairo_pattern_t*>& dotPatterns,
                         const std::list<std::list<std::pair<Point,double> > >& strokes,
@@ -2152,15 +2189,11 @@ struct RotoContextPrivate
                         double time,
                         unsigned int mipmapLevel);
     
-    void renderBezier(cairo_t* cr,const Bezier* bezier, double opacity, double time, unsigned int mipmapLevel);
+    void renderBezier(const Bezier* bezier, double time, unsigned int mipmapLevel, RotoShapeRasterizer* rasterizer);
     
-    void renderFeather(const Bezier* bezier,double time, unsigned int mipmapLevel, bool inverted, double shapeColor[3], double opacity, double featherDist, double fallOff, cairo_pattern_t* mesh);
-
-    void renderInternalShape(double time,unsigned int mipmapLevel,double shapeColor[3], double opacity,const Transform::Matrix3x3& transform, cairo_t* cr, cairo_pattern_t* mesh, const BezierCPs & cps);
+    void renderFeather(const Bezier* bezier,double time, unsigned int mipmapLevel, double featherDist, const std::list<Point>& bezierPolygon, RotoShapeRasterizer* rasterizer);
     
     static void bezulate(double time,const BezierCPs& cps,std::list<BezierCPs>* patches);
-
-    void applyAndDestroyMask(cairo_t* cr,cairo_pattern_t* mesh);
 };
 
 NATRON_NAMESPACE_EXIT;
@@ -0,0 +1,748 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "RotoShapeRasterizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/bind.hpp>
+#endif
+
+#include "Engine/AppManager.h"
+#include "Engine/Image.h"
+#include "Engine/TaskScheduler.h"
+
+///The tiles rendered in parallel are squares of this size, aligned on multiples of it
+#define kRotoShapeTileSize 128
+
+///The number of values of the feather alpha look-up table across a quad
+#define kRotoShapeFallOffLutSize 1024
+
+NATRON_NAMESPACE_ENTER;
+
+namespace {
+
+inline int
+floorDiv(int a,
+         int b)
+{
+    return a >= 0 ? a / b : -( (-a + b - 1) / b );
+}
+
+inline double
+cross(double ax,
+      double ay,
+      double bx,
+      double by)
+{
+    return ax * by - ay * bx;
+}
+
+/**
+ * @brief Accumulates the signed area covered by the line (x0,y0)-(x1,y1) in the rows of the accumulation buffer of a tile,
+ * the coordinates being relative to the tile. The line must be within [0,width] horizontally. A row of the buffer has
+ * width + 2 values: the sum of the values of a row up to x is the coverage of the pixel x.
+ **/
+void
+accumulateLine(double x0,
+               double y0,
+               double x1,
+               double y1,
+               int width,
+               int height,
+               double* accumulation)
+{
+    if (y0 == y1) {
+        return;
+    }
+    double dir = 1.;
+    if (y0 > y1) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+        dir = -1.;
+    }
+    if ( (y1 <= 0.) || (y0 >= height) ) {
+        return;
+    }
+    double dxdy = (x1 - x0) / (y1 - y0);
+    double x = x0;
+    if (y0 < 0.) {
+        x -= y0 * dxdy;
+        y0 = 0.;
+    }
+    y1 = std::min(y1, (double)height);
+
+    int yStart = (int)std::floor(y0);
+    int yEnd = (int)std::ceil(y1);
+    double* row = accumulation + (std::size_t)yStart * (width + 2);
+    for (int y = yStart; y < yEnd; ++y, row += width + 2) {
+        double dy = std::min( (double)(y + 1), y1 ) - std::max( (double)y, y0 );
+        double xNext = x + dxdy * dy;
+        double d = dy * dir;
+        double xa = std::min(x, xNext);
+        double xb = std::max(x, xNext);
+        // clamp the rounding errors of the clipping
+        xa = std::min( std::max(xa, 0.), (double)width );
+        xb = std::min( std::max(xb, 0.), (double)width );
+        double xaFloor = std::floor(xa);
+        int xai = (int)xaFloor;
+        double xbCeil = std::ceil(xb);
+        int xbi = (int)xbCeil;
+        if (xbi <= xai + 1) {
+            // the line is within a pixel of this row: the part of the pixel on its right is covered
+            double xmf = 0.5 * (xa + xb) - xaFloor;
+            row[xai] += d - d * xmf;
+            row[xai + 1] += d * xmf;
+        } else {
+            // the line crosses several pixels: the area on its right increases linearly from a pixel to the next,
+            // quadratically in the first and last pixels
+            double s = 1. / (xb - xa);
+            double xaf = xa - xaFloor;
+            double a0 = 0.5 * s * (1. - xaf) * (1. - xaf);
+            double xbf = xb - xbCeil + 1.;
+            double am = 0.5 * s * xbf * xbf;
+            row[xai] += d * a0;
+            if (xbi == xai + 2) {
+                row[xai + 1] += d * (1. - a0 - am);
+            } else {
+                double a1 = s * (1.5 - xaf);
+                row[xai + 1] += d * (a1 - a0);
+                for (int xi = xai + 2; xi < xbi - 1; ++xi) {
+                    row[xi] += d * s;
+                }
+                double a2 = a1 + (xbi - xai - 3) * s;
+                row[xbi - 1] += d * (1. - a2 - am);
+            }
+            row[xbi] += d * am;
+        }
+        x = xNext;
+    }
+} // accumulateLine
+
+/**
+ * @brief Same as accumulateLine() for any line: the part on the left of the tile covers the whole rows it crosses,
+ * the part on the right does not cover any pixel of the tile.
+ **/
+void
+accumulateClippedLine(double x0,
+                      double y0,
+                      double x1,
+                      double y1,
+                      int width,
+                      int height,
+                      double* accumulation)
+{
+    if ( (y0 == y1) || ( (x0 >= width) && (x1 >= width) ) ) {
+        return;
+    }
+    if ( (x0 >= 0.) && (x1 >= 0.) && (x0 <= width) && (x1 <= width) ) {
+        accumulateLine(x0, y0, x1, y1, width, height, accumulation);
+
+        return;
+    }
+
+    // split the line where it crosses the sides of the tile
+    double t[4];
+    int nT = 0;
+    t[nT++] = 0.;
+    if (x0 != x1) {
+        double tLeft = (0. - x0) / (x1 - x0);
+        double tRight = (width - x0) / (x1 - x0);
+        if ( (tLeft > 0.) && (tLeft < 1.) ) {
+            t[nT++] = tLeft;
+        }
+        if ( (tRight > 0.) && (tRight < 1.) ) {
+            t[nT++] = tRight;
+        }
+    }
+    t[nT++] = 1.;
+    std::sort(t, t + nT);
+    for (int i = 0; i < nT - 1; ++i) {
+        double ya = y0 + (y1 - y0) * t[i];
+        double yb = y0 + (y1 - y0) * t[i + 1];
+        double xMid = x0 + (x1 - x0) * 0.5 * (t[i] + t[i + 1]);
+        if (xMid <= 0.) {
+            accumulateLine(0., ya, 0., yb, width, height, accumulation);
+        } else if (xMid < width) {
+            double xa = x0 + (x1 - x0) * t[i];
+            double xb = x0 + (x1 - x0) * t[i + 1];
+            accumulateLine(xa, ya, xb, yb, width, height, accumulation);
+        }
+    }
+}
+
+/**
+ * @brief Finds the position (u,s) of p in the bilinear quadrilateral p0 + u (p3 - p0) + s (p1 - p0) + u s (p0 - p3 + p2 - p1).
+ * s may be out of [sMin, 1] where sMin < 0: the quadrilateral is extended to the polygon side, u must be within [0,1].
+ * If the quadrilateral folds over p, the solution with the lowest s is returned.
+ **/
+bool
+invertBilinear(double px,
+               double py,
+               const Point & p0,
+               const Point & p1,
+               const Point & p2,
+               const Point & p3,
+               double sMin,
+               double* s)
+{
+    const double eps = 1e-7;
+    double ex = p3.x - p0.x, ey = p3.y - p0.y;
+    double fx = p1.x - p0.x, fy = p1.y - p0.y;
+    double gx = p0.x - p3.x + p2.x - p1.x, gy = p0.y - p3.y + p2.y - p1.y;
+    double hx = px - p0.x, hy = py - p0.y;
+    double k2 = cross(gx, gy, fx, fy);
+    double k1 = cross(ex, ey, fx, fy) + cross(hx, hy, gx, gy);
+    double k0 = cross(hx, hy, ex, ey);
+
+    // the roots of k2 s^2 + k1 s + k0, computed without cancellation, k2 being 0 when the sides are parallel
+    double roots[2];
+    int nRoots = 0;
+    double disc = k1 * k1 - 4. * k0 * k2;
+    if (disc < 0.) {
+        return false;
+    }
+    double q = -0.5 * ( k1 + (k1 >= 0. ? std::sqrt(disc) : -std::sqrt(disc) ) );
+    if (q != 0.) {
+        roots[nRoots++] = k0 / q;
+    }
+    if (k2 != 0.) {
+        roots[nRoots++] = q / k2;
+    }
+
+    bool found = false;
+    for (int i = 0; i < nRoots; ++i) {
+        double v = roots[i];
+        if ( (v < sMin) || (v > 1.) || ( found && (v >= *s) ) ) {
+            continue;
+        }
+        double dx = ex + gx * v;
+        double dy = ey + gy * v;
+        double u = std::abs(dx) > std::abs(dy) ? (hx - fx * v) / dx : (hy - fy * v) / dy;
+        if ( (u >= -eps) && (u <= 1. + eps) ) {
+            *s = v;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+template <typename PIX>
+PIX clampIfInt(float v);
+
+template <>
+inline unsigned char
+clampIfInt<unsigned char>(float v)
+{
+    return (unsigned char)std::min(std::max(v, 0.f), 255.f);
+}
+
+template <>
+inline unsigned short
+clampIfInt<unsigned short>(float v)
+{
+    return (unsigned short)std::min(std::max(v, 0.f), 65535.f);
+}
+
+template <>
+inline float
+clampIfInt<float>(float v)
+{
+    return v;
+}
+
+/**
+ * @brief Writes the alpha of a tile in the image as convertCairoImageToNatronImage_noColor() used to: the 2 components
+ * images get the red and green, the 3 components images the color.
+ **/
+template <typename PIX, int maxValue, int nComps>
+void
+writeRows(const float* alpha,
+          int alphaRowElements,
+          int width,
+          int height,
+          const float color[3],
+          float alphaScale,
+          PIX* dst,
+          std::size_t dstRowElements)
+{
+    for (int y = 0; y < height; ++y, alpha += alphaRowElements, dst += dstRowElements) {
+        PIX* dstPix = dst;
+        for (int x = 0; x < width; ++x, dstPix += nComps) {
+            float a = alpha[x] * maxValue;
+            switch (nComps) {
+            case 1:
+                dstPix[0] = clampIfInt<PIX>(a * alphaScale);
+                break;
+            case 2:
+                dstPix[0] = clampIfInt<PIX>(a * color[0]);
+                dstPix[1] = clampIfInt<PIX>(a * color[1]);
+                break;
+            case 3:
+                dstPix[0] = clampIfInt<PIX>(a * color[0]);
+                dstPix[1] = clampIfInt<PIX>(a * color[1]);
+                dstPix[2] = clampIfInt<PIX>(a * color[2]);
+                break;
+            case 4:
+                dstPix[0] = clampIfInt<PIX>(a * color[0]);
+                dstPix[1] = clampIfInt<PIX>(a * color[1]);
+                dstPix[2] = clampIfInt<PIX>(a * color[2]);
+                dstPix[3] = clampIfInt<PIX>(a * alphaScale);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+template <typename PIX, int maxValue>
+void
+writeRowsForComponents(int nComps,
+                       const float* alpha,
+                       int alphaRowElements,
+                       int width,
+                       int height,
+                       const float color[3],
+                       float alphaScale,
+                       void* dst,
+                       std::size_t dstRowElements)
+{
+    switch (nComps) {
+    case 1:
+        writeRows<PIX, maxValue, 1>(alpha, alphaRowElements, width, height, color, alphaScale, (PIX*)dst, dstRowElements);
+        break;
+    case 2:
+        writeRows<PIX, maxValue, 2>(alpha, alphaRowElements, width, height, color, alphaScale, (PIX*)dst, dstRowElements);
+        break;
+    case 3:
+        writeRows<PIX, maxValue, 3>(alpha, alphaRowElements, width, height, color, alphaScale, (PIX*)dst, dstRowElements);
+        break;
+    case 4:
+        writeRows<PIX, maxValue, 4>(alpha, alphaRowElements, width, height, color, alphaScale, (PIX*)dst, dstRowElements);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Splits the roi on the grid of kRotoShapeTileSize
+ **/
+void
+splitInTiles(const RectI & roi,
+             std::vector<RectI>* tiles)
+{
+    for (int y = floorDiv(roi.y1, kRotoShapeTileSize) * kRotoShapeTileSize; y < roi.y2; y += kRotoShapeTileSize) {
+        for (int x = floorDiv(roi.x1, kRotoShapeTileSize) * kRotoShapeTileSize; x < roi.x2; x += kRotoShapeTileSize) {
+            RectI tile;
+            tile.x1 = std::max(x, roi.x1);
+            tile.y1 = std::max(y, roi.y1);
+            tile.x2 = std::min(x + kRotoShapeTileSize, roi.x2);
+            tile.y2 = std::min(y + kRotoShapeTileSize, roi.y2);
+            tiles->push_back(tile);
+        }
+    }
+}
+} // anon namespace
+
+struct RotoShapeRasterizer::ImageTiles
+{
+    const RotoShapeRasterizer* rasterizer;
+    std::vector<RectI> tiles;
+    RectI roi;
+    ImageBitDepthEnum depth;
+    int nComps;
+    float color[3];
+    float alphaScale;
+    unsigned char* pixels; //< the pixel at (roi.x1, roi.y1)
+    std::size_t rowElements;
+    std::size_t pixelSize;
+};
+
+RotoShapeRasterizer::RotoShapeRasterizer()
+    : _edges()
+    , _quads()
+    , _fallOffLut()
+    , _bbox()
+    , _bandEdges()
+    , _bandQuads()
+    , _firstBand(0)
+    , _indexBuilt(false)
+{
+    setFeatherFallOff(1.);
+}
+
+RotoShapeRasterizer::~RotoShapeRasterizer()
+{
+}
+
+void
+RotoShapeRasterizer::addPolygon(const std::list<Point> & polygon)
+{
+    if ( polygon.empty() ) {
+        return;
+    }
+    const Point* prev = &polygon.back();
+    for (std::list<Point>::const_iterator it = polygon.begin(); it != polygon.end(); ++it) {
+        if (prev->y != it->y) {
+            Edge e;
+            e.x0 = prev->x;
+            e.y0 = prev->y;
+            e.x1 = it->x;
+            e.y1 = it->y;
+            _edges.push_back(e);
+        }
+        RectI pixel( (int)std::floor(it->x), (int)std::floor(it->y), (int)std::floor(it->x) + 1, (int)std::floor(it->y) + 1 );
+        if ( _bbox.isNull() ) {
+            _bbox = pixel;
+        } else {
+            _bbox.merge(pixel);
+        }
+        prev = &*it;
+    }
+    _indexBuilt = false;
+}
+
+void
+RotoShapeRasterizer::addFeatherQuad(const Point & inner0,
+                                    const Point & outer0,
+                                    const Point & outer1,
+                                    const Point & inner1)
+{
+    double width = 0.5 * ( std::sqrt( (outer0.x - inner0.x) * (outer0.x - inner0.x) + (outer0.y - inner0.y) * (outer0.y - inner0.y) ) +
+                           std::sqrt( (outer1.x - inner1.x) * (outer1.x - inner1.x) + (outer1.y - inner1.y) * (outer1.y - inner1.y) ) );
+
+    if (width < 1e-6) {
+        // no feather
+        return;
+    }
+    FeatherQuad q;
+    q.p0 = inner0;
+    q.p1 = outer0;
+    q.p2 = outer1;
+    q.p3 = inner1;
+    q.width = width;
+    q.margin = 0.;
+    double x1 = std::min( std::min(inner0.x, outer0.x), std::min(outer1.x, inner1.x) );
+    double x2 = std::max( std::max(inner0.x, outer0.x), std::max(outer1.x, inner1.x) );
+    double y1 = std::min( std::min(inner0.y, outer0.y), std::min(outer1.y, inner1.y) );
+    double y2 = std::max( std::max(inner0.y, outer0.y), std::max(outer1.y, inner1.y) );
+    q.bbox.x1 = (int)std::floor(x1) - 1;
+    q.bbox.y1 = (int)std::floor(y1) - 1;
+    q.bbox.x2 = (int)std::ceil(x2) + 1;
+    q.bbox.y2 = (int)std::ceil(y2) + 1;
+    _quads.push_back(q);
+    if ( _bbox.isNull() ) {
+        _bbox = q.bbox;
+    } else {
+        _bbox.merge(q.bbox);
+    }
+    _indexBuilt = false;
+}
+
+void
+RotoShapeRasterizer::setFeatherFallOff(double fallOff)
+{
+    // The former cairo mesh patch going from the polygon (v = 0) to the feather contour (v = 1) had an alpha of 1 - v, and it
+    // was painted with itself as the mask: the alpha is (1 - v)^2. Its sides were cubic curves with the control points at a
+    // and b along the side, so that the position across the patch is s = 3 (1 - v)^2 v a + 3 (1 - v) v^2 b + v^3.
+    fallOff = std::max(fallOff, 1e-3);
+    double a = 1. / (2. * fallOff * fallOff + 1.);
+    double b = 2. / (fallOff * fallOff + 2.);
+
+    _fallOffLut.resize(kRotoShapeFallOffLutSize + 1);
+    for (int i = 0; i <= kRotoShapeFallOffLutSize; ++i) {
+        double s = (double)i / kRotoShapeFallOffLutSize;
+        // s is increasing with v since 0 < a < b < 1
+        double vMin = 0., vMax = 1.;
+        for (int k = 0; k < 40; ++k) {
+            double v = 0.5 * (vMin + vMax);
+            double sv = 3. * (1. - v) * (1. - v) * v * a + 3. * (1. - v) * v * v * b + v * v * v;
+            if (sv < s) {
+                vMin = v;
+            } else {
+                vMax = v;
+            }
+        }
+        double v = 0.5 * (vMin + vMax);
+        _fallOffLut[i] = (float)( (1. - v) * (1. - v) );
+    }
+}
+
+RectI
+RotoShapeRasterizer::getBoundingBox() const
+{
+    return _bbox;
+}
+
+float
+RotoShapeRasterizer::featherAlpha(double s) const
+{
+    if (s <= 0.) {
+        return 1.f;
+    }
+    double pos = std::min(s, 1.) * kRotoShapeFallOffLutSize;
+    int i = std::min( (int)pos, kRotoShapeFallOffLutSize - 1 );
+    float t = (float)(pos - i);
+
+    return _fallOffLut[i] + ( _fallOffLut[i + 1] - _fallOffLut[i] ) * t;
+}
+
+void
+RotoShapeRasterizer::buildIndex()
+{
+    _bandEdges.clear();
+    _bandQuads.clear();
+    _indexBuilt = true;
+    if ( _bbox.isNull() ) {
+        return;
+    }
+
+    // The pixels within 1 pixel on the polygon side of a quad are in the feather as well, since the polygon only covers a part
+    // of them. This is only for the quads going outwards: the polygon side of the others is outside of the polygon.
+    double area = 0.;
+    for (std::size_t i = 0; i < _edges.size(); ++i) {
+        area += cross(_edges[i].x0, _edges[i].y0, _edges[i].x1, _edges[i].y1);
+    }
+    for (std::size_t i = 0; i < _quads.size(); ++i) {
+        FeatherQuad & q = _quads[i];
+        bool outwards = cross(q.p3.x - q.p0.x, q.p3.y - q.p0.y, q.p1.x - q.p0.x, q.p1.y - q.p0.y) * area < 0.;
+        q.margin = outwards ? -1. / q.width : 0.;
+    }
+
+    _firstBand = floorDiv(_bbox.y1, kRotoShapeTileSize);
+    int nBands = floorDiv(_bbox.y2 - 1, kRotoShapeTileSize) - _firstBand + 1;
+    _bandEdges.resize(nBands);
+    _bandQuads.resize(nBands);
+    for (std::size_t i = 0; i < _edges.size(); ++i) {
+        const Edge & e = _edges[i];
+        int b1 = floorDiv( (int)std::floor( std::min(e.y0, e.y1) ), kRotoShapeTileSize ) - _firstBand;
+        int b2 = floorDiv( (int)std::ceil( std::max(e.y0, e.y1) ) - 1, kRotoShapeTileSize ) - _firstBand;
+        for (int b = std::max(b1, 0); b <= std::min(b2, nBands - 1); ++b) {
+            _bandEdges[b].push_back( (int)i );
+        }
+    }
+    for (std::size_t i = 0; i < _quads.size(); ++i) {
+        const RectI & bbox = _quads[i].bbox;
+        int b1 = floorDiv(bbox.y1, kRotoShapeTileSize) - _firstBand;
+        int b2 = floorDiv(bbox.y2 - 1, kRotoShapeTileSize) - _firstBand;
+        for (int b = std::max(b1, 0); b <= std::min(b2, nBands - 1); ++b) {
+            _bandQuads[b].push_back( (int)i );
+        }
+    }
+}
+
+void
+RotoShapeRasterizer::renderTile(const RectI & tile,
+                                std::vector<double>* accumulation,
+                                std::vector<float>* feather,
+                                float* alpha,
+                                int alphaRowElements) const
+{
+    assert(_indexBuilt);
+    int width = tile.width();
+    int height = tile.height();
+    int band = floorDiv(tile.y1, kRotoShapeTileSize) - _firstBand;
+    assert( floorDiv(tile.y2 - 1, kRotoShapeTileSize) - _firstBand == band );
+
+    if ( !tile.intersects(_bbox) || (band < 0) || ( band >= (int)_bandEdges.size() ) ) {
+        for (int y = 0; y < height; ++y) {
+            std::fill(alpha + (std::size_t)y * alphaRowElements, alpha + (std::size_t)y * alphaRowElements + width, 0.f);
+        }
+
+        return;
+    }
+
+    // Coverage of the polygon
+    accumulation->assign( (std::size_t)(width + 2) * height, 0. );
+    const std::vector<int> & edges = _bandEdges[band];
+    for (std::vector<int>::const_iterator it = edges.begin(); it != edges.end(); ++it) {
+        const Edge & e = _edges[*it];
+        accumulateClippedLine(e.x0 - tile.x1, e.y0 - tile.y1, e.x1 - tile.x1, e.y1 - tile.y1, width, height, &accumulation->front() );
+    }
+
+    // Feather, the highest value of the quads covering the center of each pixel
+    const std::vector<int> & quads = _bandQuads[band];
+    bool hasFeather = false;
+    for (std::vector<int>::const_iterator it = quads.begin(); it != quads.end(); ++it) {
+        const FeatherQuad & q = _quads[*it];
+        RectI area;
+        if ( !q.bbox.intersect(tile, &area) ) {
+            continue;
+        }
+        if (!hasFeather) {
+            feather->assign( (std::size_t)width * height, 0.f );
+            hasFeather = true;
+        }
+        // The quad extended down to the margin has straight sides: only the pixels whose center is between its sides are evaluated
+        Point corners[4];
+        corners[0].x = q.p0.x + q.margin * (q.p1.x - q.p0.x);
+        corners[0].y = q.p0.y + q.margin * (q.p1.y - q.p0.y);
+        corners[1] = q.p1;
+        corners[2] = q.p2;
+        corners[3].x = q.p3.x + q.margin * (q.p2.x - q.p3.x);
+        corners[3].y = q.p3.y + q.margin * (q.p2.y - q.p3.y);
+        for (int y = area.y1; y < area.y2; ++y) {
+            double yCenter = y + 0.5;
+            double xMin = std::numeric_limits<double>::infinity();
+            double xMax = -std::numeric_limits<double>::infinity();
+            for (int k = 0; k < 4; ++k) {
+                const Point & a = corners[k];
+                const Point & b = corners[(k + 1) % 4];
+                if ( ( (a.y < yCenter) && (b.y < yCenter) ) || ( (a.y > yCenter) && (b.y > yCenter) ) ) {
+                    continue;
+                }
+                double xCross = (a.y == b.y) ? a.x : a.x + (yCenter - a.y) * (b.x - a.x) / (b.y - a.y);
+                xMin = std::min( xMin, std::min(xCross, a.y == b.y ? b.x : xCross) );
+                xMax = std::max( xMax, std::max(xCross, a.y == b.y ? b.x : xCross) );
+            }
+            if (xMin > xMax) {
+                continue;
+            }
+            int xStart = std::max( area.x1, (int)std::ceil(xMin - 0.5 - 1e-6) );
+            int xEnd = std::min( area.x2, (int)std::floor(xMax - 0.5 + 1e-6) + 1 );
+            float* featherRow = &feather->front() + (std::size_t)(y - tile.y1) * width - tile.x1;
+            for (int x = xStart; x < xEnd; ++x) {
+                double s;
+                if ( invertBilinear(x + 0.5, y + 0.5, q.p0, q.p1, q.p2, q.p3, q.margin, &s) ) {
+                    featherRow[x] = std::max( featherRow[x], featherAlpha(s) );
+                }
+            }
+        }
+    }
+
+    for (int y = 0; y < height; ++y) {
+        const double* accRow = &accumulation->front() + (std::size_t)y * (width + 2);
+        float* dst = alpha + (std::size_t)y * alphaRowElements;
+        double acc = 0.;
+        for (int x = 0; x < width; ++x) {
+            acc += accRow[x];
+            dst[x] = (float)std::min(std::abs(acc), 1.);
+        }
+        if (hasFeather) {
+            const float* featherRow = &feather->front() + (std::size_t)y * width;
+            for (int x = 0; x < width; ++x) {
+                dst[x] += (1.f - dst[x]) * featherRow[x];
+            }
+        }
+    }
+} // RotoShapeRasterizer::renderTile
+
+void
+RotoShapeRasterizer::renderAlpha(const RectI & roi,
+                                 float* alpha)
+{
+    if ( roi.isNull() ) {
+        return;
+    }
+    if (!_indexBuilt) {
+        buildIndex();
+    }
+    std::vector<RectI> tiles;
+    splitInTiles(roi, &tiles);
+    std::vector<double> accumulation;
+    std::vector<float> feather;
+    for (std::size_t i = 0; i < tiles.size(); ++i) {
+        const RectI & tile = tiles[i];
+        renderTile(tile, &accumulation, &feather, alpha + (std::size_t)(tile.y1 - roi.y1) * roi.width() + (tile.x1 - roi.x1), roi.width() );
+    }
+}
+
+void
+RotoShapeRasterizer::renderImageTile(const ImageTiles* tiles,
+                                     unsigned int index)
+{
+    const RectI & tile = tiles->tiles[index];
+    int width = tile.width();
+    int height = tile.height();
+    std::vector<double> accumulation;
+    std::vector<float> feather;
+    std::vector<float> alpha( (std::size_t)width * height );
+
+    tiles->rasterizer->renderTile(tile, &accumulation, &feather, &alpha.front(), width);
+
+    unsigned char* dst = tiles->pixels + ( (std::size_t)(tile.y1 - tiles->roi.y1) * tiles->rowElements +
+                                           (std::size_t)(tile.x1 - tiles->roi.x1) * tiles->nComps ) * tiles->pixelSize;
+    switch (tiles->depth) {
+    case eImageBitDepthFloat:
+        writeRowsForComponents<float, 1>(tiles->nComps, &alpha.front(), width, width, height, tiles->color, tiles->alphaScale, dst, tiles->rowElements);
+        break;
+    case eImageBitDepthByte:
+        writeRowsForComponents<unsigned char, 255>(tiles->nComps, &alpha.front(), width, width, height, tiles->color, tiles->alphaScale, dst, tiles->rowElements);
+        break;
+    case eImageBitDepthShort:
+        writeRowsForComponents<unsigned short, 65535>(tiles->nComps, &alpha.front(), width, width, height, tiles->color, tiles->alphaScale, dst, tiles->rowElements);
+        break;
+    case eImageBitDepthHalf:
+    case eImageBitDepthNone:
+        assert(false);
+        break;
+    }
+}
+
+void
+RotoShapeRasterizer::renderToImage(const RectI & roi,
+                                   const double shapeColor[3],
+                                   double opacity,
+                                   bool useOpacity,
+                                   Image* image)
+{
+    RectI area;
+    if ( !roi.intersect(image->getBounds(), &area) ) {
+        return;
+    }
+    if (!_indexBuilt) {
+        buildIndex();
+    }
+
+    ImageTiles tiles;
+    tiles.rasterizer = this;
+    splitInTiles(area, &tiles.tiles);
+    tiles.roi = area;
+    tiles.depth = image->getBitDepth();
+    tiles.nComps = (int)image->getComponentsCount();
+    for (int c = 0; c < 3; ++c) {
+        tiles.color[c] = (float)(useOpacity ? shapeColor[c] * opacity : shapeColor[c]);
+    }
+    tiles.alphaScale = (float)(useOpacity ? opacity : 1.);
+    tiles.rowElements = image->getRowElements();
+    tiles.pixelSize = getSizeOfForBitDepth(tiles.depth);
+
+    Image::WriteAccess acc = image->getWriteRights();
+    tiles.pixels = acc.pixelAt(area.x1, area.y1);
+    assert(tiles.pixels);
+    if (!tiles.pixels) {
+        return;
+    }
+
+    appPTR->getTaskScheduler()->parallelFor( (unsigned int)tiles.tiles.size(), boost::bind(&RotoShapeRasterizer::renderImageTile, &tiles, _1) );
+}
+
+NATRON_NAMESPACE_EXIT;
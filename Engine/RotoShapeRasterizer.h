@@ -0,0 +1,147 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_ROTOSHAPERASTERIZER_H
+#define NATRON_ENGINE_ROTOSHAPERASTERIZER_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <list>
+#include <vector>
+
+#include "Global/GlobalDefines.h"
+#include "Engine/RectI.h"
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER;
+
+/**
+ * @brief Renders the mask of a closed Roto shape in float: the polygon of the Bezier filled with the non-zero winding rule,
+ * and the feather around it, made of quadrilaterals going from an edge of the polygon to an edge of the feather contour.
+ *
+ * The polygon is antialiased with its exact coverage of each pixel: the signed area of its edges is accumulated along each row.
+ * A feather quadrilateral is evaluated at the center of the pixels: the alpha goes from 1 on the polygon side to 0 on the
+ * feather contour, following the fall-off curve. The feather is continuous from one quadrilateral to the next, as they share
+ * their sides, and with the polygon, whose boundary pixels are covered by the feather too. The result is the same as the former
+ * cairo mesh pattern painted with itself as the mask, without the seams between the patches.
+ *
+ * The coordinates are in pixels of the image, the pixel (x,y) covering [x,x+1]x[y,y+1]. Any region of interest can be rendered:
+ * only the edges and the quadrilaterals of each tile are drawn.
+ **/
+class RotoShapeRasterizer
+{
+public:
+
+    RotoShapeRasterizer();
+
+    ~RotoShapeRasterizer();
+
+    /**
+     * @brief Adds a closed polygon, the last point being joined to the first one
+     **/
+    void addPolygon(const std::list<Point> & polygon);
+
+    /**
+     * @brief Adds a feather quadrilateral, inner0 and inner1 being on the polygon, outer0 and outer1 on the feather contour
+     **/
+    void addFeatherQuad(const Point & inner0,
+                        const Point & outer0,
+                        const Point & outer1,
+                        const Point & inner1);
+
+    /**
+     * @brief Sets the fall-off of the feather (@see Bezier::getFeatherFallOff()), 1 being linear
+     **/
+    void setFeatherFallOff(double fallOff);
+
+    /**
+     * @brief Returns the pixels touched by the shape
+     **/
+    RectI getBoundingBox() const;
+
+    /**
+     * @brief Renders the alpha of the pixels of roi in a single thread. alpha holds the rows of roi.width() values, going upwards.
+     **/
+    void renderAlpha(const RectI & roi,
+                     float* alpha);
+
+    /**
+     * @brief Writes the shape into the roi of the image, the tiles being rendered in parallel by the TaskScheduler.
+     * The pixels are alpha * color for the color components and alpha for the alpha component. If useOpacity is true they are
+     * multiplied by opacity as well. The pixels of the roi outside of the shape are set to 0.
+     **/
+    void renderToImage(const RectI & roi,
+                       const double shapeColor[3],
+                       double opacity,
+                       bool useOpacity,
+                       Image* image);
+
+private:
+
+    struct ImageTiles;
+
+    struct Edge
+    {
+        double x0, y0, x1, y1;
+    };
+
+    struct FeatherQuad
+    {
+        Point p0, p1, p2, p3; //< inner0, outer0, outer1, inner1
+        RectI bbox;
+        double width; //< the average length of the sides going across the quad
+        double margin; //< the parameter across the quad, 0 or below, down to which the quad is extended on the polygon side
+    };
+
+    /**
+     * @brief Renders the alpha of a tile, which is within a band. The buffers are reused from one tile to the next.
+     **/
+    void renderTile(const RectI & tile,
+                    std::vector<double>* accumulation,
+                    std::vector<float>* feather,
+                    float* alpha,
+                    int alphaRowElements) const;
+
+    float featherAlpha(double s) const;
+
+    void buildIndex();
+
+    static void renderImageTile(const ImageTiles* tiles,
+                                unsigned int index);
+
+    std::vector<Edge> _edges;
+    std::vector<FeatherQuad> _quads;
+    std::vector<float> _fallOffLut; //< the feather alpha at regularly spaced positions across the quad
+    RectI _bbox;
+
+    ///The edges and the quads crossing each band of kRotoShapeTileSize rows, from the band containing _bbox.y1
+    std::vector<std::vector<int> > _bandEdges;
+    std::vector<std::vector<int> > _bandQuads;
+    int _firstBand;
+    bool _indexBuilt;
+};
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_ROTOSHAPERASTERIZER_H
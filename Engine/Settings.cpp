@@ -231,6 +231,18 @@ Settings::initializeKnobsGeneral()
     _numberOfParallelRenders->disableSlider();
     _numberOfParallelRenders->setAnimationEnabled(false);
     _generalTab->addKnob(_numberOfParallelRenders);
+    
+    _writerBufferSize = AppManager::createKnob<KnobInt>(this, "Disk render buffer size in MiB (0=\"guess\")");
+    _writerBufferSize->setHintToolTip("Controls how much RAM the frames rendered ahead of a writer may take while they wait to be written. "
+                                      "This lets the renderer keep working while a slow writer (e.g: a movie encoder) writes the previous frames, "
+                                      "without holding too many frames in RAM when they are large. "
+                                      "A value of 0 indicate that " NATRON_APPLICATION_NAME " should use 10% of the RAM of the system. "
+                                      "Fewer frames are rendered ahead when the system is running out of memory.");
+    _writerBufferSize->setName("writerBufferSize");
+    _writerBufferSize->setMinimum(0);
+    _writerBufferSize->disableSlider();
+    _writerBufferSize->setAnimationEnabled(false);
+    _generalTab->addKnob(_writerBufferSize);
 #endif
     
     _useThreadPool = AppManager::createKnob<KnobBool>(this, "Effects use thread-pool");
@@ -800,6 +812,15 @@ Settings::initializeKnobsViewers()
                                   " Hover each option with the mouse for a detailed description.");
     _viewersTab->addKnob(_texturesMode);
 
+    _displayIndependentViewerCache = AppManager::createKnob<KnobBool>(this, "Cache byte textures before the display transform");
+    _displayIndependentViewerCache->setName("displayIndependentViewerCache");
+    _displayIndependentViewerCache->setAnimationEnabled(false);
+    _displayIndependentViewerCache->setHintToolTip("Only used with byte textures. When checked, the viewer cache holds floating-point textures "
+                                                   "to which the gain, gamma and colorspace of the viewer are applied by the CPU when they "
+                                                   "are displayed, so that changing them does not render the frames again. "
+                                                   "Cached textures are 4 times larger.");
+    _viewersTab->addKnob(_displayIndependentViewerCache);
+
     _powerOf2Tiling = AppManager::createKnob<KnobInt>(this, "Viewer tile size is 2 to the power of...");
     _powerOf2Tiling->setName("viewerTiling");
     _powerOf2Tiling->setHintToolTip("The dimension of the viewer tiles is 2^n by 2^n (i.e. 256 by 256 pixels for n=8). "
@@ -1142,6 +1163,34 @@ Settings::initializeKnobsCaching()
     _maxPlaybackLabel->setAnimationEnabled(false);
     _cachingTab->addKnob(_maxPlaybackLabel);
 
+    _compressedCachePercent = AppManager::createKnob<KnobInt>(this, "Compressed image cache RAM percentage (% of the image cache RAM)");
+    _compressedCachePercent->setName("compressedCachePercent");
+    _compressedCachePercent->setAnimationEnabled(false);
+    _compressedCachePercent->setMinimum(0);
+    _compressedCachePercent->setMaximum(90);
+    _compressedCachePercent->setHintToolTip("When the RAM dedicated to caching images is full, the least recently used images are compressed "
+                                            "and kept in this portion of it instead of being discarded, so that they can be decompressed "
+                                            "when needed again instead of being rendered again. "
+                                            "0 disables the compression of images.");
+    _cachingTab->addKnob(_compressedCachePercent);
+
+    _imageCacheEvictionPolicy = AppManager::createKnob<KnobChoice>(this, "Image cache eviction policy");
+    _imageCacheEvictionPolicy->setName("imageCacheEvictionPolicy");
+    _imageCacheEvictionPolicy->setAnimationEnabled(false);
+    {
+        std::vector<std::string> policies;
+        std::vector<std::string> helpStringsPolicies;
+        policies.push_back("Least recently used");
+        helpStringsPolicies.push_back("The images that were not used for the longest time are discarded first.");
+        policies.push_back("Cost-aware");
+        helpStringsPolicies.push_back("The time it took to render an image is weighed against its size and how recently it was used, "
+                                      "so that images that are long to render are kept longer than images that are quick to render.");
+        _imageCacheEvictionPolicy->populateChoices(policies, helpStringsPolicies);
+    }
+    _imageCacheEvictionPolicy->setHintToolTip("How the images to discard are chosen when the image cache is full."
+                                              " Hover each option with the mouse for a detailed description.");
+    _cachingTab->addKnob(_imageCacheEvictionPolicy);
+
     _unreachableRAMPercent = AppManager::createKnob<KnobInt>(this, "System RAM to keep free (% of total RAM)");
     _unreachableRAMPercent->setName("unreachableRAMPercent");
     _unreachableRAMPercent->setAnimationEnabled(false);
@@ -1172,6 +1221,16 @@ Settings::initializeKnobsCaching()
     _maxViewerDiskCacheGB->setMaximum(100);
     _maxViewerDiskCacheGB->setHintToolTip("The maximum size that may be used by the playback cache on disk (in GiB)");
     _cachingTab->addKnob(_maxViewerDiskCacheGB);
+
+    _playbackReadAheadFrames = AppManager::createKnob<KnobInt>(this, "Playback cache read-ahead (frames)");
+    _playbackReadAheadFrames->setName("playbackReadAhead");
+    _playbackReadAheadFrames->setAnimationEnabled(false);
+    _playbackReadAheadFrames->setMinimum(0);
+    _playbackReadAheadFrames->setMaximum(100);
+    _playbackReadAheadFrames->setHintToolTip("During playback, the frames of the playback cache that are stored on disk are loaded in RAM "
+                                             "this number of frames ahead of the frame being displayed, so that reading them from the disk "
+                                             "does not slow down playback. 0 disables the read-ahead.");
+    _cachingTab->addKnob(_playbackReadAheadFrames);
     
     _maxDiskCacheNodeGB = AppManager::createKnob<KnobInt>(this, "Maximum DiskCache node disk usage (GiB)");
     _maxDiskCacheNodeGB->setName("maxDiskCacheNode");
@@ -1201,6 +1260,46 @@ Settings::initializeKnobsCaching()
                                    "This is provided in case " NATRON_APPLICATION_NAME " lost track of cached images "
                                    "for some reason.");
     _cachingTab->addKnob(_wipeDiskCache);
+
+    _persistentImageStorePath = AppManager::createKnob<KnobPath>(this, "Shared image cache path (empty = disabled)");
+    _persistentImageStorePath->setName("persistentImageCachePath");
+    _persistentImageStorePath->setAnimationEnabled(false);
+    _persistentImageStorePath->setMultiPath(false);
+    _persistentImageStorePath->setHintToolTip("A directory where the images rendered by the nodes during a render to disk are kept "
+                                              "across sessions. When the same project is rendered again, possibly by another computer "
+                                              "sharing this directory over the network, the images of the nodes that did not change "
+                                              "are read from this directory instead of being rendered again. "
+                                              "Leave empty to disable it.");
+    _cachingTab->addKnob(_persistentImageStorePath);
+
+    _maxPersistentImageStoreGB = AppManager::createKnob<KnobInt>(this, "Maximum shared image cache disk usage (GiB)");
+    _maxPersistentImageStoreGB->setName("maxPersistentImageCache");
+    _maxPersistentImageStoreGB->setAnimationEnabled(false);
+    _maxPersistentImageStoreGB->setMinimum(0);
+    _maxPersistentImageStoreGB->setMaximum(1000);
+    _maxPersistentImageStoreGB->setHintToolTip("The maximum size of the shared image cache on disk (in GiB). When it is exceeded, "
+                                               "the least recently written images are removed. 0 means no limit.");
+    _cachingTab->addKnob(_maxPersistentImageStoreGB);
+
+    _nCacheShards = AppManager::createKnob<KnobInt>(this, "Cache shards (0 = automatic)");
+    _nCacheShards->setName("cacheShards");
+    _nCacheShards->setAnimationEnabled(false);
+    _nCacheShards->setMinimum(0);
+    _nCacheShards->setMaximum(256);
+    _nCacheShards->setHintToolTip("WARNING: Changing this parameter requires a restart of the application. \n"
+                                  "The number of independent portions the image and playback caches are split into. "
+                                  "Each portion has its own lock so that render threads accessing different images do not wait on each other. "
+                                  "1 means a single lock is used for each cache, which may slow down renders on computers with many cores. "
+                                  "When 0, the number of portions is derived from the number of cores of the computer.");
+    _cachingTab->addKnob(_nCacheShards);
+
+    _useTransparentHugePages = AppManager::createKnob<KnobBool>(this, "Use huge pages for images");
+    _useTransparentHugePages->setName("transparentHugePages");
+    _useTransparentHugePages->setAnimationEnabled(false);
+    _useTransparentHugePages->setHintToolTip("When checked, the memory of the images of 2MB or more is allocated so that the system "
+                                             "may back it with huge pages, which reduces the cost of accessing large images. "
+                                             "This only has an effect on Linux when transparent huge pages are enabled in the kernel.");
+    _cachingTab->addKnob(_useTransparentHugePages);
 }
 
 void
@@ -1393,6 +1492,7 @@ Settings::setDefaultValues()
     
 #ifndef NATRON_PLAYBACK_USES_THREAD_POOL
     _numberOfParallelRenders->setDefaultValue(0,0);
+    _writerBufferSize->setDefaultValue(0,0);
 #endif
     
     _useThreadPool->setDefaultValue(true);
@@ -1411,6 +1511,7 @@ Settings::setDefaultValues()
     _preferBundledPlugins->setDefaultValue(true);
     _loadBundledPlugins->setDefaultValue(true);
     _texturesMode->setDefaultValue(0,0);
+    _displayIndependentViewerCache->setDefaultValue(false);
     _powerOf2Tiling->setDefaultValue(8,0);
     _checkerboardTileSize->setDefaultValue(5);
     _checkerboardColor1->setDefaultValue(0.5,0);
@@ -1432,9 +1533,15 @@ Settings::setDefaultValues()
     _aggressiveCaching->setDefaultValue(false);
     _maxRAMPercent->setDefaultValue(50,0);
     _maxPlayBackPercent->setDefaultValue(25,0);
+    _compressedCachePercent->setDefaultValue(0);
+    _imageCacheEvictionPolicy->setDefaultValue(0);
     _unreachableRAMPercent->setDefaultValue(5);
     _maxViewerDiskCacheGB->setDefaultValue(5,0);
+    _playbackReadAheadFrames->setDefaultValue(8);
     _maxDiskCacheNodeGB->setDefaultValue(10,0);
+    _maxPersistentImageStoreGB->setDefaultValue(50);
+    _nCacheShards->setDefaultValue(0);
+    _useTransparentHugePages->setDefaultValue(false);
     setCachingLabels();
     _autoTurbo->setDefaultValue(false);
     _usePluginIconsInNodeGraph->setDefaultValue(true);
@@ -1667,7 +1774,7 @@ Settings::warnChangedKnobs(const std::vector<KnobI*>& knobs)
                 }
 
             }
-        } else if (knobs[i] == _texturesMode.get()) {
+        } else if ( (knobs[i] == _texturesMode.get()) || (knobs[i] == _displayIndependentViewerCache.get()) ) {
             std::map<int,AppInstanceRef> apps = appPTR->getAppInstances();
             bool isFirstViewer = true;
             for (std::map<int,AppInstanceRef>::iterator it = apps.begin(); it != apps.end(); ++it) {
@@ -2028,8 +2135,28 @@ Settings::onKnobValueChanged(KnobI* k,
             appPTR->setPlaybackCacheMaximumSize( getRamPlaybackMaximumPercent() );
         }
         setCachingLabels();
+    } else if ( k == _compressedCachePercent.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setCompressedCacheMaximumSize( getRamCompressedCacheMaximumPercent() );
+        }
+    } else if ( k == _imageCacheEvictionPolicy.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setImageCacheEvictionPolicy( getImageCacheEvictionPolicy() );
+        }
     } else if ( k == _diskCachePath.get() ) {
         appPTR->setDiskCacheLocation(_diskCachePath->getValue().c_str());
+    } else if ( k == _persistentImageStorePath.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setPersistentImageStoreLocation( getPersistentImageStorePath() );
+        }
+    } else if ( k == _maxPersistentImageStoreGB.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setPersistentImageStoreMaximumSize( getMaximumPersistentImageStoreSize() );
+        }
+    } else if ( k == _useTransparentHugePages.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setUseTransparentHugePages( isTransparentHugePagesEnabled() );
+        }
     } else if ( k == _wipeDiskCache.get() ) {
         appPTR->wipeAndCreateDiskCacheStructure();
     } else if ( k == _numberOfThreads.get() ) {
@@ -2151,6 +2278,12 @@ Settings::getViewersBitDepth() const
     }
 }
 
+bool
+Settings::isViewerCacheDisplayIndependent() const
+{
+    return _displayIndependentViewerCache->getValue();
+}
+
 int
 Settings::getViewerTilesPowerOf2() const
 {
@@ -2169,6 +2302,18 @@ Settings::getRamPlaybackMaximumPercent() const
     return (double)_maxPlayBackPercent->getValue() / 100.;
 }
 
+double
+Settings::getRamCompressedCacheMaximumPercent() const
+{
+    return (double)_compressedCachePercent->getValue() / 100.;
+}
+
+CacheEvictionPolicyEnum
+Settings::getImageCacheEvictionPolicy() const
+{
+    return _imageCacheEvictionPolicy->getValue() == 1 ? eCacheEvictionPolicyGreedyDualSize : eCacheEvictionPolicyLRU;
+}
+
 U64
 Settings::getMaximumViewerDiskCacheSize() const
 {
@@ -2181,6 +2326,36 @@ Settings::getMaximumDiskCacheNodeSize() const
     return (U64)( _maxDiskCacheNodeGB->getValue() ) * std::pow(1024.,3.);
 }
 
+std::string
+Settings::getPersistentImageStorePath() const
+{
+    return _persistentImageStorePath->getValue();
+}
+
+U64
+Settings::getMaximumPersistentImageStoreSize() const
+{
+    return (U64)( _maxPersistentImageStoreGB->getValue() ) * std::pow(1024.,3.);
+}
+
+int
+Settings::getPlaybackReadAheadFrames() const
+{
+    return _playbackReadAheadFrames->getValue();
+}
+
+int
+Settings::getNumberOfCacheShards() const
+{
+    return _nCacheShards->getValue();
+}
+
+bool
+Settings::isTransparentHugePagesEnabled() const
+{
+    return _useTransparentHugePages->getValue();
+}
+
 double
 Settings::getUnreachableRamPercent() const
 {
@@ -2990,6 +3165,16 @@ Settings::setNumberOfParallelRenders(int nb)
 #endif
 }
 
+U64
+Settings::getWriterBufferSize() const
+{
+#ifndef NATRON_PLAYBACK_USES_THREAD_POOL
+    return (U64)_writerBufferSize->getValue() * 1024ULL * 1024ULL;
+#else
+    return 0;
+#endif
+}
+
 bool
 Settings::areRGBPixelComponentsSupported() const
 {
@@ -98,16 +98,32 @@ public:
 
     ImageBitDepthEnum getViewersBitDepth() const;
 
+    bool isViewerCacheDisplayIndependent() const;
+
     int getViewerTilesPowerOf2() const;
 
     double getRamMaximumPercent() const;
 
     double getRamPlaybackMaximumPercent() const;
 
+    double getRamCompressedCacheMaximumPercent() const;
+
+    CacheEvictionPolicyEnum getImageCacheEvictionPolicy() const;
+
     U64 getMaximumViewerDiskCacheSize() const;
+
+    int getPlaybackReadAheadFrames() const;
     
     U64 getMaximumDiskCacheNodeSize() const;
 
+    std::string getPersistentImageStorePath() const;
+
+    U64 getMaximumPersistentImageStoreSize() const;
+
+    int getNumberOfCacheShards() const;
+
+    bool isTransparentHugePagesEnabled() const;
+
     double getUnreachableRamPercent() const;
 
     bool getColorPickerLinear() const;
@@ -120,6 +136,11 @@ public:
     
     void setNumberOfParallelRenders(int nb);
     
+    /**
+     * @brief Returns the RAM in bytes that the frames rendered ahead of a writer may take, 0 if it should be guessed
+     **/
+    U64 getWriterBufferSize() const;
+    
     int getNumberOfThreadsPerEffect() const;
     
     bool useGlobalThreadPool() const;
@@ -392,6 +413,7 @@ private:
     boost::shared_ptr<KnobBool> _convertNaNValues;
     boost::shared_ptr<KnobInt> _numberOfThreads;
     boost::shared_ptr<KnobInt> _numberOfParallelRenders;
+    boost::shared_ptr<KnobInt> _writerBufferSize;
     boost::shared_ptr<KnobBool> _useThreadPool;
     boost::shared_ptr<KnobInt> _nThreadsPerEffect;
     boost::shared_ptr<KnobBool> _renderInSeparateProcess;
@@ -422,6 +444,10 @@ private:
     boost::shared_ptr<KnobInt> _maxPlayBackPercent;
     boost::shared_ptr<KnobString> _maxPlaybackLabel;
 
+    ///The percentage of the NodeCache RAM where the evicted images are kept compressed
+    boost::shared_ptr<KnobInt> _compressedCachePercent;
+    boost::shared_ptr<KnobChoice> _imageCacheEvictionPolicy;
+
     ///The percentage of the system total's RAM to dedicate to caching in theory. In practise this is limited
     ///by _unreachableRamPercent that determines how much RAM should be left free for other use on the computer
     boost::shared_ptr<KnobInt> _maxRAMPercent;
@@ -438,12 +464,22 @@ private:
     
     ///The total disk space allowed for all Natron's caches
     boost::shared_ptr<KnobInt> _maxViewerDiskCacheGB;
+    boost::shared_ptr<KnobInt> _playbackReadAheadFrames;
     boost::shared_ptr<KnobInt> _maxDiskCacheNodeGB;
     boost::shared_ptr<KnobPath> _diskCachePath;
     boost::shared_ptr<KnobButton> _wipeDiskCache;
+
+    ///A directory, possibly shared by several computers, where rendered images are kept across sessions
+    boost::shared_ptr<KnobPath> _persistentImageStorePath;
+    boost::shared_ptr<KnobInt> _maxPersistentImageStoreGB;
+
+    ///The number of independent portions the NodeCache and ViewerCache are split into, 0 = automatic
+    boost::shared_ptr<KnobInt> _nCacheShards;
+    boost::shared_ptr<KnobBool> _useTransparentHugePages;
     
     boost::shared_ptr<KnobPage> _viewersTab;
     boost::shared_ptr<KnobChoice> _texturesMode;
+    boost::shared_ptr<KnobBool> _displayIndependentViewerCache;
     boost::shared_ptr<KnobInt> _powerOf2Tiling;
     boost::shared_ptr<KnobInt> _checkerboardTileSize;
     boost::shared_ptr<KnobColor> _checkerboardColor1;
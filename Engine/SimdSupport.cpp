@@ -0,0 +1,96 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "SimdSupport.h"
+
+#if defined(NATRON_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h> // __cpuid, _xgetbv
+#endif
+
+NATRON_NAMESPACE_ENTER;
+
+static SimdLevelEnum
+detectSimdLevel()
+{
+#if !defined(NATRON_SIMD_X86)
+
+    return eSimdLevelNone;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int nIds = info[0];
+    if (nIds < 1) {
+        return eSimdLevelNone;
+    }
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool avx2 = false;
+    if ( (nIds >= 7) && osxsave && avx && fma && ( (_xgetbv(0) & 6) == 6 ) ) { // the OS saves the YMM registers
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+    if (avx2) {
+        return eSimdLevelAVX2;
+    }
+
+    return sse41 ? eSimdLevelSSE41 : eSimdLevelNone;
+#else
+    // also checks that the OS supports the AVX registers
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ) {
+        return eSimdLevelAVX2;
+    }
+
+    return __builtin_cpu_supports("sse4.1") ? eSimdLevelSSE41 : eSimdLevelNone;
+#endif
+}
+
+static SimdLevelEnum
+detectedSimdLevel()
+{
+    static const SimdLevelEnum level = detectSimdLevel();
+
+    return level;
+}
+
+static SimdLevelEnum maximumSimdLevel = eSimdLevelAVX2;
+
+SimdLevelEnum
+getSimdLevel()
+{
+    SimdLevelEnum level = detectedSimdLevel();
+
+    return level < maximumSimdLevel ? level : maximumSimdLevel;
+}
+
+void
+setMaximumSimdLevel(SimdLevelEnum level)
+{
+    maximumSimdLevel = level;
+}
+
+NATRON_NAMESPACE_EXIT;
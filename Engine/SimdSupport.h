@@ -0,0 +1,75 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_SIMDSUPPORT_H
+#define NATRON_ENGINE_SIMDSUPPORT_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+///NATRON_SIMD_X86 is defined when the SSE/AVX intrinsics may be used. The functions using instructions beyond SSE2
+///are compiled with NATRON_SIMD_TARGET_SSE41 or NATRON_SIMD_TARGET_AVX2 so that the rest of the code does not require
+///them, and must only be called when getSimdLevel() says the CPU has them. NATRON_SIMD_TARGET_AVX2 does not enable FMA, so
+///that the compiler cannot contract multiplies and adds and the kernels give the same results as the scalar code: the
+///kernels calling the FMA intrinsics use NATRON_SIMD_TARGET_AVX2_FMA (the eSimdLevelAVX2 CPUs have both).
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define NATRON_SIMD_X86
+#endif
+
+#ifdef NATRON_SIMD_X86
+#if defined(__GNUC__) || defined(__clang__)
+#define NATRON_SIMD_TARGET_SSE41 __attribute__( ( target("sse4.1") ) )
+#define NATRON_SIMD_TARGET_AVX2 __attribute__( ( target("avx2") ) )
+#define NATRON_SIMD_TARGET_AVX2_FMA __attribute__( ( target("avx2,fma") ) )
+#else
+// MSVC does not need the instruction set to be enabled to use the intrinsics
+#define NATRON_SIMD_TARGET_SSE41
+#define NATRON_SIMD_TARGET_AVX2
+#define NATRON_SIMD_TARGET_AVX2_FMA
+#endif
+#endif
+
+NATRON_NAMESPACE_ENTER;
+
+enum SimdLevelEnum
+{
+    eSimdLevelNone = 0, //< scalar code only
+    eSimdLevelSSE41,
+    eSimdLevelAVX2
+};
+
+/**
+ * @brief Returns the instruction set the vectorized image kernels use: the best one the CPU and the OS support,
+ * capped by setMaximumSimdLevel(). The detection is done once.
+ **/
+SimdLevelEnum getSimdLevel();
+
+/**
+ * @brief Caps the level returned by getSimdLevel(), e.g: to compare the kernels in benchmarks or to work around a faulty
+ * implementation. Not thread-safe with respect to the renders using the kernels.
+ **/
+void setMaximumSimdLevel(SimdLevelEnum level);
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_SIMDSUPPORT_H
@@ -36,15 +36,82 @@
 #include <QWaitCondition>
 #include <QThreadPool>
 #include <QThread>
+#include <QThreadStorage>
+#include <QMutex>
 #include <QDebug>
 
 NATRON_NAMESPACE_ENTER;
 
+namespace {
+
+///Gives the holders their slot in the ThreadTLSCache of the threads, the slots of the destroyed holders are reused
+///so that the caches do not grow with the number of holders ever created
+struct CacheSlotAllocator
+{
+    QMutex mutex;
+    std::vector<int> freeSlots;
+    int nSlots;
+    U64 lastID;
+
+    CacheSlotAllocator()
+        : mutex()
+        , freeSlots()
+        , nSlots(0)
+        , lastID(0)
+    {
+    }
+};
+
+static CacheSlotAllocator*
+getCacheSlotAllocator()
+{
+    static CacheSlotAllocator* allocator = new CacheSlotAllocator;
+
+    return allocator;
+}
+} // anon namespace
+
+///Qt deletes the cache of a thread when the thread exits
+ThreadTLSCache*
+ThreadTLSCache::current()
+{
+    static QThreadStorage<ThreadTLSCache*>* caches = new QThreadStorage<ThreadTLSCache*>;
+
+    if ( !caches->hasLocalData() ) {
+        caches->setLocalData(new ThreadTLSCache);
+    }
+
+    return caches->localData();
+}
+
+TLSHolderBase::TLSHolderBase()
+    : boost::enable_shared_from_this<TLSHolderBase>()
+    , _cacheSlot(0)
+    , _uniqueID(0)
+{
+    CacheSlotAllocator* allocator = getCacheSlotAllocator();
+    QMutexLocker k(&allocator->mutex);
+
+    if ( allocator->freeSlots.empty() ) {
+        _cacheSlot = allocator->nSlots++;
+    } else {
+        _cacheSlot = allocator->freeSlots.back();
+        allocator->freeSlots.pop_back();
+    }
+    _uniqueID = ++allocator->lastID;
+}
+
+TLSHolderBase::~TLSHolderBase()
+{
+    CacheSlotAllocator* allocator = getCacheSlotAllocator();
+    QMutexLocker k(&allocator->mutex);
+
+    allocator->freeSlots.push_back(_cacheSlot);
+}
 
 AppTLS::AppTLS()
 : _objectMutex()
 , _object(new GLobalTLSObject())
-, _spawns()
 {
 }
 
@@ -89,8 +156,9 @@ AppTLS::softCopy(const QThread* fromThread,const QThread* toThread)
     if (fromThread == toThread || !fromThread || !toThread) {
         return;
     }
-    QWriteLocker k(&_objectMutex);
-    _spawns[toThread] = fromThread;
+    //The spawner is stored on the cache of the spawned thread, only accessed by that thread
+    assert( toThread == QThread::currentThread() );
+    ThreadTLSCache::current()->setSpawner(fromThread);
 }
 
 void
@@ -98,18 +166,22 @@ AppTLS::cleanupTLSForThread()
 {
     
     QThread* curThread = QThread::currentThread();
+    ThreadTLSCache* cache = ThreadTLSCache::current();
+
+    //This thread was spawned, but TLS not used, do not bother to clean-up
+    if ( cache->getSpawner() ) {
+        cache->setSpawner(0);
+
+        return;
+    }
+
+    //The values of the thread are erased below, forget their address
+    cache->clear();
 
     //Cleanup any cached data on the TLSHolder
     {
         QWriteLocker k(&_objectMutex);
         
-        //This thread was spawned, but TLS not used, do not bother to clean-up
-        ThreadSpawnMap::iterator foundSpawned = _spawns.find(curThread);
-        if (foundSpawned != _spawns.end()) {
-            _spawns.erase(foundSpawned);
-            return;
-        }
-        
         TLSObjects newObjects;
         for (TLSObjects::iterator it = _object->objects.begin();
              it!=_object->objects.end(); ++it) {
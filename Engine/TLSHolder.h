@@ -49,6 +49,79 @@
 
 NATRON_NAMESPACE_ENTER;
 
+/**
+ * @brief The per-thread part of the TLS: for each TLSHolder used by the thread, the address of the value the holder stores
+ * for the thread. It is only accessed by its thread, so that the TLSHolder lookups do not take any lock.
+ * A slot is identified by the slot index of the holder and tagged with its unique id: holders recycle the slot indexes
+ * of the destroyed holders, a slot tagged with another id belongs to a dead holder and is ignored.
+ **/
+class ThreadTLSCache
+{
+public:
+
+    struct Slot
+    {
+        U64 holderId; //< 0 = empty
+        const void* value; //< the boost::shared_ptr<T> stored by the holder for this thread
+    };
+
+    ThreadTLSCache()
+        : _slots()
+        , _spawner(0)
+    {
+    }
+
+    /**
+     * @brief Returns the cache of the calling thread, created on first use and deleted when the thread exits
+     **/
+    static ThreadTLSCache* current();
+
+    const void* find(int slot,
+                     U64 holderId) const
+    {
+        if ( ( slot < (int)_slots.size() ) && (_slots[slot].holderId == holderId) ) {
+            return _slots[slot].value;
+        }
+
+        return 0;
+    }
+
+    void set(int slot,
+             U64 holderId,
+             const void* value)
+    {
+        if ( slot >= (int)_slots.size() ) {
+            Slot empty = { 0, 0 };
+            _slots.resize(slot + 1, empty);
+        }
+        _slots[slot].holderId = holderId;
+        _slots[slot].value = value;
+    }
+
+    void clear()
+    {
+        _slots.clear();
+    }
+
+    /**
+     * @brief The thread registered with AppTLS::softCopy() as the spawner of this thread, or NULL
+     **/
+    const QThread* getSpawner() const
+    {
+        return _spawner;
+    }
+
+    void setSpawner(const QThread* spawner)
+    {
+        _spawner = spawner;
+    }
+
+private:
+
+    std::vector<Slot> _slots;
+    const QThread* _spawner;
+};
+
 ///This must be stored as a shared_ptr
 class TLSHolderBase : public boost::enable_shared_from_this<TLSHolderBase>
 {
@@ -57,9 +130,9 @@ class TLSHolderBase : public boost::enable_shared_from_this<TLSHolderBase>
 
 public:
     
-    TLSHolderBase() {}
+    TLSHolderBase();
     
-    virtual ~TLSHolderBase() {}
+    virtual ~TLSHolderBase();
     
 protected:
     
@@ -73,6 +146,23 @@ protected:
      * @brief Copy all the TLS from fromThread to toThread
      **/
     virtual void copyTLS(const QThread* fromThread, const QThread* toThread) const = 0;
+
+    ///The slot of the holder in the ThreadTLSCache of the threads
+    int getCacheSlot() const
+    {
+        return _cacheSlot;
+    }
+
+    ///Never shared by 2 holders, even after one is destroyed
+    U64 getUniqueID() const
+    {
+        return _uniqueID;
+    }
+
+private:
+
+    int _cacheSlot;
+    U64 _uniqueID;
 };
 
 
@@ -94,9 +184,6 @@ class AppTLS
     
     typedef boost::shared_ptr<GLobalTLSObject> GLobalTLSObjectPtr;
     
-    //<spawned thread, spawner thread>
-    typedef std::map<const QThread*,const QThread*> ThreadSpawnMap;
-    
 public:
 
     AppTLS();
@@ -115,7 +202,8 @@ public:
     void copyTLS(const QThread* fromThread,const QThread* toThread);
 
     /**
-     * @brief This function registers fromThread as a thread who spawned toThread.
+     * @brief This function registers fromThread as a thread who spawned toThread, which must be the calling thread:
+     * this is done when a task starts.
      * The first time attempting to call getOrCreateTLSData() for toThread, it will 
      * call copyTLS() first before returning the TLS value.
      * This is to ensure that threads that "may" need TLS do not always copy the TLS 
@@ -127,13 +215,14 @@ public:
     void softCopy(const QThread* fromThread,const QThread* toThread);
     
     /**
-     * @brief Same as copyTLS() except that if a spawner thread was register for curThread beforehand
-     * with softCopy() then the TLS will be copied from the spawner thread.
+     * @brief If a spawner thread was registered for the calling thread curThread with softCopy(), copies the TLS
+     * from the spawner thread. The cache is the ThreadTLSCache of curThread.
      * This function also returns the TLS for the given holder for convenience.
      **/
     template <typename T>
     boost::shared_ptr<T> copyTLSFromSpawnerThread(const TLSHolderBase* holder,
-                                                  const QThread* curThread);
+                                                  const QThread* curThread,
+                                                  ThreadTLSCache* cache);
 
     
     /**
@@ -146,25 +235,24 @@ private:
     
     template <typename T>
     boost::shared_ptr<T> copyTLSFromSpawnerThreadInternal(const TLSHolderBase* holder,
-                                                  const QThread* curThread,
-                                                          ThreadSpawnMap::iterator foundSpawned);
+                                                          const QThread* spawnerThread,
+                                                          const QThread* curThread);
 
 
     
     //This is the "TLS" object: it stores a set of all TLSHolder's who used the TLS to clean it up afterwards
     mutable QReadWriteLock _objectMutex;
     GLobalTLSObjectPtr _object;
-    
-    //if a thread is a spawned thread, then copy the tls from the spawner thread instead
-    //of creating a new object and no longer mark it as spawned
-    ThreadSpawnMap _spawns;
 
-    
+    //if a thread is a spawned thread (its ThreadTLSCache has a spawner), then copy the tls from the spawner thread
+    //instead of creating a new object and no longer mark it as spawned
 };
 
 
 /**
  * @brief Use this class if you need to hold TLS data on an object. 
+ * The values are owned by the holder, in a map protected by a lock, and the ThreadTLSCache of each thread points to the
+ * value of the thread: once a thread has found its value, the lookups do not take any lock.
  * @param T is the data type held in the thread local storage.
  * @param multipleInstance If true, then the TLS object will be mapped against this object
  * so that there can be multiple instance of it in the global TLS. Otherwise only
@@ -200,7 +288,9 @@ private:
 
     boost::shared_ptr<T> copyAndReturnNewTLS(const QThread* fromThread, const QThread* toThread) const WARN_UNUSED_RETURN;
     
-    //Store a cache on the object to be faster than using the getOrCreate... function from AppTLS
+    //Store a cache on the object to be faster than using the getOrCreate... function from AppTLS.
+    //The nodes of the map are never moved: the ThreadTLSCache of a thread points to the value of its node until it is erased
+    //by cleanupPerThreadData(), which is called by the thread itself.
     mutable QReadWriteLock perThreadDataMutex;
     mutable ThreadDataMap perThreadData;
 };
@@ -100,20 +100,30 @@ template <typename T>
 boost::shared_ptr<T>
 TLSHolder<T>::getTLSData() const
 {
-    QThread* curThread  = QThread::currentThread();
-    
-    //This thread might be registered by a spawner thread, copy the TLS and attempt to find the TLS for this holder.
-    boost::shared_ptr<T> ret = appPTR->getAppTLS()->copyTLSFromSpawnerThread<T>(this, curThread);
-    if (ret) {
-        return ret;
+    ThreadTLSCache* cache = ThreadTLSCache::current();
+
+    if ( cache->getSpawner() ) {
+        //This thread was registered by a spawner thread, copy the TLS and attempt to find the TLS for this holder.
+        boost::shared_ptr<T> ret = appPTR->getAppTLS()->copyTLSFromSpawnerThread<T>(this, QThread::currentThread(), cache);
+        if (ret) {
+            return ret;
+        }
     }
-    
-    
+
+    //Fast path: the value was already looked up by this thread, no lock
+    const void* cached = cache->find( getCacheSlot(), getUniqueID() );
+    if (cached) {
+        return *static_cast<const boost::shared_ptr<T>*>(cached);
+    }
+
     //Attempt to find an object in the map. It will be there if we already called getOrCreateTLSData() for this thread
     {
+        QThread* curThread  = QThread::currentThread();
         QReadLocker k(&perThreadDataMutex);
         typename ThreadDataMap::iterator found = perThreadData.find(curThread);
         if (found != perThreadData.end()) {
+            cache->set( getCacheSlot(), getUniqueID(), &found->second.value );
+
             return found->second.value;
         }
     }
@@ -125,21 +135,31 @@ template <typename T>
 boost::shared_ptr<T>
 TLSHolder<T>::getOrCreateTLSData() const
 {
+    ThreadTLSCache* cache = ThreadTLSCache::current();
     QThread* curThread  = QThread::currentThread();
-    
-    //This thread might be registered by a spawner thread, copy the TLS and attempt to find the TLS for this holder.
-    boost::shared_ptr<T> ret = appPTR->getAppTLS()->copyTLSFromSpawnerThread<T>(this, curThread);
-    if (ret) {
-        return ret;
+
+    if ( cache->getSpawner() ) {
+        //This thread was registered by a spawner thread, copy the TLS and attempt to find the TLS for this holder.
+        boost::shared_ptr<T> ret = appPTR->getAppTLS()->copyTLSFromSpawnerThread<T>(this, curThread, cache);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    //Fast path: the value was already looked up by this thread, no lock
+    const void* cached = cache->find( getCacheSlot(), getUniqueID() );
+    if (cached) {
+        return *static_cast<const boost::shared_ptr<T>*>(cached);
     }
     
     //Attempt to find an object in the map. It will be there if we already called getOrCreateTLSData() for this thread
-    //Note that if present, this call is extremely fast as we do not block other threads
     {
         QReadLocker k(&perThreadDataMutex);
         typename ThreadDataMap::iterator found = perThreadData.find(curThread);
         if (found != perThreadData.end()) {
             assert(found->second.value);
+            cache->set( getCacheSlot(), getUniqueID(), &found->second.value );
+
             return found->second.value;
         }
     }
@@ -151,7 +171,8 @@ TLSHolder<T>::getOrCreateTLSData() const
     data.value.reset(new T);
     {
         QWriteLocker k(&perThreadDataMutex);
-        perThreadData.insert(std::make_pair(curThread,data));
+        typename ThreadDataMap::iterator inserted = perThreadData.insert( std::make_pair(curThread,data) ).first;
+        cache->set( getCacheSlot(), getUniqueID(), &inserted->second.value );
     }
     assert(data.value);
     return data.value;
@@ -161,35 +182,34 @@ TLSHolder<T>::getOrCreateTLSData() const
 template <typename T>
 boost::shared_ptr<T>
 AppTLS::copyTLSFromSpawnerThread(const TLSHolderBase* holder,
-                                 const QThread* curThread)
+                                 const QThread* curThread,
+                                 ThreadTLSCache* cache)
 {
     //3 cases where this function returns NULL:
     // 1) No spawner thread registered
     // 2) T is not a ParallelRenderArgs (see comments above copyAndReturnNewTLS explicit template instanciation
-    // 3) The spawner thread did not have TLS but was marked in the spawn map...
+    // 3) The spawner thread did not have TLS but was marked as spawned...
     // Either way: return a new object
 
-    
-    ThreadSpawnMap::iterator foundSpawned;
-    {
-        QReadLocker k(&_objectMutex);
-        foundSpawned = _spawns.find(curThread);
-        if (foundSpawned == _spawns.end()) {
-            //This is not a spawned thread and it did not have TLS already
-            return boost::shared_ptr<T>();
-        }
+    const QThread* spawnerThread = cache->getSpawner();
+    if (!spawnerThread) {
+        //This is not a spawned thread
+        return boost::shared_ptr<T>();
     }
+
+    //No longer mark the thread as spawned
+    cache->setSpawner(0);
     {
         QWriteLocker k(&_objectMutex);
-        return copyTLSFromSpawnerThreadInternal<T>(holder, curThread, foundSpawned);
+        return copyTLSFromSpawnerThreadInternal<T>(holder, spawnerThread, curThread);
     }
 }
 
 template <typename T>
 boost::shared_ptr<T>
 AppTLS::copyTLSFromSpawnerThreadInternal(const TLSHolderBase* holder,
-                                         const QThread* curThread,
-                                         ThreadSpawnMap::iterator foundSpawned)
+                                         const QThread* spawnerThread,
+                                         const QThread* curThread)
 {
     //Private - should be locked
     assert(!_objectMutex.tryLockForWrite());
@@ -207,20 +227,17 @@ AppTLS::copyTLSFromSpawnerThreadInternal(const TLSHolderBase* holder,
                 //the TLS data from the spawner thread and mark it to 'tls'.
                 foundHolder = dynamic_cast<const TLSHolder<T>*>(p.get());
                 if (foundHolder) {
-                    tls = foundHolder->copyAndReturnNewTLS(foundSpawned->second, curThread);
+                    tls = foundHolder->copyAndReturnNewTLS(spawnerThread, curThread);
                 }
             }
             
             if (!foundHolder) {
                 //Copy anyway
-                p->copyTLS(foundSpawned->second, curThread);
+                p->copyTLS(spawnerThread, curThread);
             }
         }
     }
     
-    
-    //Erase the thread from the spawn map
-    _spawns.erase(foundSpawned);
     return tls;
 
 }
@@ -0,0 +1,443 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "TaskScheduler.h"
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#endif
+
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#include "Global/GlobalDefines.h"
+
+NATRON_NAMESPACE_ENTER;
+
+namespace {
+
+/**
+ * @brief A loop started by TaskScheduler::parallelFor. Threads take its iterations one at a time until there is none left.
+ **/
+struct ParallelLoop
+{
+    boost::function<void (unsigned int)> func;
+    unsigned int count;
+    unsigned int maxConcurrency; //< 0 = no limit
+    boost::atomic<unsigned int> nextIndex; //< the next iteration to take, the loop is exhausted when it reaches count
+    boost::atomic<unsigned int> nRunners; //< the number of threads taking iterations of the loop
+    QMutex doneMutex; //< protects nDone, failed and error
+    QWaitCondition doneCond;
+    unsigned int nDone;
+    bool failed;
+    std::string error;
+
+    ParallelLoop(const boost::function<void (unsigned int)> & func,
+                 unsigned int count,
+                 unsigned int maxConcurrency)
+        : func(func)
+        , count(count)
+        , maxConcurrency(maxConcurrency)
+        , nextIndex(0)
+        , nRunners(0)
+        , doneMutex()
+        , doneCond()
+        , nDone(0)
+        , failed(false)
+        , error()
+    {
+    }
+
+    bool isExhausted() const
+    {
+        return nextIndex.load() >= count;
+    }
+
+    bool tryEnter()
+    {
+        unsigned int cur = nRunners.load();
+
+        do {
+            if ( maxConcurrency && (cur >= maxConcurrency) ) {
+                return false;
+            }
+        } while ( !nRunners.compare_exchange_weak(cur, cur + 1) );
+
+        return true;
+    }
+
+    void leave()
+    {
+        nRunners.fetch_sub(1);
+    }
+
+    void runIterations()
+    {
+        for (;; ) {
+            unsigned int i = nextIndex.fetch_add(1);
+            if (i >= count) {
+                return;
+            }
+
+            bool ok = true;
+            std::string err;
+            try {
+                func(i);
+            } catch (const std::exception & e) {
+                ok = false;
+                err = e.what();
+            } catch (...) {
+                ok = false;
+                err = "Unknown exception in a parallel loop";
+            }
+
+            QMutexLocker k(&doneMutex);
+            if (!ok && !failed) {
+                failed = true;
+                error = err;
+            }
+            ++nDone;
+            if (nDone == count) {
+                doneCond.wakeAll();
+            }
+        }
+    }
+};
+
+typedef boost::shared_ptr<ParallelLoop> ParallelLoopPtr;
+
+struct LoopQueue
+{
+    QMutex lock;
+    std::deque<ParallelLoopPtr> loops;
+};
+
+typedef boost::shared_ptr<LoopQueue> LoopQueuePtr;
+} // anon namespace
+
+class TaskSchedulerWorker;
+
+struct TaskSchedulerPrivate
+{
+    int nWorkers;
+
+    ///One queue per worker, the last one is shared by the threads which are not workers
+    std::vector<LoopQueuePtr> queues;
+    std::vector<TaskSchedulerWorker*> workers;
+
+    mutable QMutex stateMutex; //< protects all members below
+    QWaitCondition workAvailableCond;
+    bool workersStarted;
+    bool mustQuit;
+    U64 workGeneration; //< incremented every time a loop is started so that workers do not miss it
+    int maxConcurrency;
+
+    TaskSchedulerPrivate(int nWorkers)
+        : nWorkers(nWorkers)
+        , queues()
+        , workers()
+        , stateMutex()
+        , workAvailableCond()
+        , workersStarted(false)
+        , mustQuit(false)
+        , workGeneration(0)
+        , maxConcurrency(0)
+    {
+        for (int i = 0; i <= nWorkers; ++i) {
+            queues.push_back( LoopQueuePtr(new LoopQueue) );
+        }
+    }
+
+    int getCurrentWorkerIndex() const;
+
+    bool ensureWorkersStarted();
+
+    /**
+     * @brief Returns a loop with iterations left that the worker may run: the most recent loop of its own queue, otherwise
+     * the oldest loop of the other queues.
+     **/
+    ParallelLoopPtr findLoop(int workerIndex);
+
+    void runWorker(int workerIndex);
+};
+
+class TaskSchedulerWorker
+    : public QThread
+{
+    TaskSchedulerPrivate* _scheduler;
+    int _index;
+
+public:
+
+    TaskSchedulerWorker(TaskSchedulerPrivate* scheduler,
+                        int index)
+        : QThread()
+        , _scheduler(scheduler)
+        , _index(index)
+    {
+        setObjectName( QString::fromUtf8("TaskSchedulerWorker") + QString::number(index) );
+    }
+
+    virtual ~TaskSchedulerWorker()
+    {
+    }
+
+    const TaskSchedulerPrivate* getScheduler() const
+    {
+        return _scheduler;
+    }
+
+    int getIndex() const
+    {
+        return _index;
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        _scheduler->runWorker(_index);
+    }
+};
+
+int
+TaskSchedulerPrivate::getCurrentWorkerIndex() const
+{
+    TaskSchedulerWorker* worker = dynamic_cast<TaskSchedulerWorker*>( QThread::currentThread() );
+
+    if ( worker && (worker->getScheduler() == this) ) {
+        return worker->getIndex();
+    }
+
+    return -1;
+}
+
+bool
+TaskSchedulerPrivate::ensureWorkersStarted()
+{
+    QMutexLocker k(&stateMutex);
+
+    if (mustQuit) {
+        return false;
+    }
+    if (!workersStarted) {
+        for (int i = 0; i < nWorkers; ++i) {
+            TaskSchedulerWorker* worker = new TaskSchedulerWorker(this, i);
+            workers.push_back(worker);
+            worker->start();
+        }
+        workersStarted = true;
+    }
+
+    return true;
+}
+
+ParallelLoopPtr
+TaskSchedulerPrivate::findLoop(int workerIndex)
+{
+    // Own queue first, most recent loop first: these are the loops started by the iterations this worker is running
+    {
+        LoopQueue & queue = *queues[workerIndex];
+        QMutexLocker k(&queue.lock);
+        for (int i = (int)queue.loops.size() - 1; i >= 0; --i) {
+            ParallelLoopPtr loop = queue.loops[i];
+            if ( loop->isExhausted() ) {
+                queue.loops.erase( queue.loops.begin() + i );
+            } else if ( loop->tryEnter() ) {
+                return loop;
+            }
+        }
+    }
+
+    // Then steal the oldest loops of the other queues, starting with the next worker so that thieves spread
+    int nQueues = (int)queues.size();
+    for (int q = 1; q < nQueues; ++q) {
+        LoopQueue & queue = *queues[(workerIndex + q) % nQueues];
+        QMutexLocker k(&queue.lock);
+        for (std::deque<ParallelLoopPtr>::iterator it = queue.loops.begin(); it != queue.loops.end(); ) {
+            if ( (*it)->isExhausted() ) {
+                it = queue.loops.erase(it);
+            } else if ( (*it)->tryEnter() ) {
+                return *it;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    return ParallelLoopPtr();
+}
+
+void
+TaskSchedulerPrivate::runWorker(int workerIndex)
+{
+    for (;; ) {
+        U64 generation;
+        {
+            QMutexLocker k(&stateMutex);
+            // Workers beyond the maximum concurrency stay idle, the thread starting a loop counts as one
+            while ( !mustQuit && (maxConcurrency > 0) && (workerIndex >= maxConcurrency - 1) ) {
+                workAvailableCond.wait(&stateMutex);
+            }
+            if (mustQuit) {
+                return;
+            }
+            generation = workGeneration;
+        }
+
+        ParallelLoopPtr loop = findLoop(workerIndex);
+        if (loop) {
+            loop->runIterations();
+            loop->leave();
+            continue;
+        }
+
+        QMutexLocker k(&stateMutex);
+        while ( !mustQuit && (workGeneration == generation) ) {
+            workAvailableCond.wait(&stateMutex);
+        }
+    }
+}
+
+TaskScheduler::TaskScheduler(int nWorkers)
+    : _imp()
+{
+    if (nWorkers < 0) {
+        nWorkers = std::max(0, QThread::idealThreadCount() - 1);
+    }
+    _imp.reset( new TaskSchedulerPrivate(nWorkers) );
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    quitWorkers();
+}
+
+int
+TaskScheduler::getNumWorkers() const
+{
+    return _imp->nWorkers;
+}
+
+void
+TaskScheduler::setMaximumConcurrency(int nThreads)
+{
+    QMutexLocker k(&_imp->stateMutex);
+
+    _imp->maxConcurrency = std::max(0, nThreads);
+    _imp->workAvailableCond.wakeAll();
+}
+
+int
+TaskScheduler::getMaximumConcurrency() const
+{
+    QMutexLocker k(&_imp->stateMutex);
+
+    return _imp->maxConcurrency;
+}
+
+void
+TaskScheduler::parallelFor(unsigned int count,
+                           const boost::function<void (unsigned int)> & func,
+                           unsigned int maxConcurrency)
+{
+    if (count == 0) {
+        return;
+    }
+
+    ParallelLoopPtr loop( new ParallelLoop(func, count, maxConcurrency) );
+    bool runInCurrentThread = (count == 1) || (_imp->nWorkers == 0) || (maxConcurrency == 1) || (getMaximumConcurrency() == 1);
+    if (!runInCurrentThread) {
+        runInCurrentThread = !_imp->ensureWorkersStarted();
+    }
+
+    if (runInCurrentThread) {
+        loop->runIterations();
+    } else {
+        int workerIndex = _imp->getCurrentWorkerIndex();
+        LoopQueue & queue = *_imp->queues[workerIndex == -1 ? _imp->nWorkers : workerIndex];
+
+        // The calling thread is the first runner of the loop
+        loop->nRunners.store(1);
+        {
+            QMutexLocker k(&queue.lock);
+            queue.loops.push_back(loop);
+        }
+        {
+            QMutexLocker k(&_imp->stateMutex);
+            ++_imp->workGeneration;
+            _imp->workAvailableCond.wakeAll();
+        }
+
+        loop->runIterations();
+        loop->leave();
+
+        // Only the iterations taken by other threads are left: wait for them
+        {
+            QMutexLocker k(&loop->doneMutex);
+            while (loop->nDone < count) {
+                loop->doneCond.wait(&loop->doneMutex);
+            }
+        }
+
+        QMutexLocker k(&queue.lock);
+        std::deque<ParallelLoopPtr>::iterator found = std::find(queue.loops.begin(), queue.loops.end(), loop);
+        if ( found != queue.loops.end() ) {
+            queue.loops.erase(found);
+        }
+    }
+
+    if (loop->failed) {
+        throw std::runtime_error(loop->error);
+    }
+} // TaskScheduler::parallelFor
+
+void
+TaskScheduler::quitWorkers()
+{
+    {
+        QMutexLocker k(&_imp->stateMutex);
+        if (_imp->mustQuit) {
+            return;
+        }
+        _imp->mustQuit = true;
+        _imp->workAvailableCond.wakeAll();
+    }
+    for (std::size_t i = 0; i < _imp->workers.size(); ++i) {
+        _imp->workers[i]->wait();
+        delete _imp->workers[i];
+    }
+    _imp->workers.clear();
+}
+
+NATRON_NAMESPACE_EXIT;
@@ -0,0 +1,97 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_TASKSCHEDULER_H
+#define NATRON_ENGINE_TASKSCHEDULER_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER;
+
+struct TaskSchedulerPrivate;
+
+/**
+ * @brief A pool of worker threads running the parallel loops of the renders (the tiles of eRenderSafetyFullySafeFrame effects,
+ * the OpenFX multi-thread suite, the viewer).
+ *
+ * Each worker has its own queue of loops: the loops started by a worker go in its queue and the worker runs their iterations
+ * first, idle workers steal the oldest loops of the other queues. The thread starting a loop runs its iterations as well and
+ * only waits for the iterations already taken by other threads. Loops started from within an iteration (e.g: the render of a node
+ * upstream) therefore use the idle workers if any, and never wait for a worker that is itself waiting: nested loops cannot
+ * deadlock nor start more threads than there are workers.
+ *
+ * A thread waiting for its loop never runs the iterations of another loop, so that the thread local storage of the render
+ * it is doing is left untouched.
+ **/
+class TaskScheduler
+{
+public:
+
+    /**
+     * @brief Creates a scheduler with the given number of workers. The threads are only started on the first loop.
+     * -1 means one less than the number of cores since the thread starting a loop takes part in it.
+     **/
+    explicit TaskScheduler(int nWorkers = -1);
+
+    ~TaskScheduler();
+
+    int getNumWorkers() const;
+
+    /**
+     * @brief Limits the number of threads, including the thread starting a loop, running the iterations of loops.
+     * 0 means all the workers may be used.
+     **/
+    void setMaximumConcurrency(int nThreads);
+
+    int getMaximumConcurrency() const;
+
+    /**
+     * @brief Calls func(i) for each i in [0, count) and returns when all calls are done. The calling thread runs some of
+     * the iterations. At most maxConcurrency threads, including the caller, run the iterations at the same time, 0 means no limit.
+     * If an iteration throws, the remaining iterations are still run and a std::runtime_error is thrown in the calling thread.
+     **/
+    void parallelFor(unsigned int count,
+                     const boost::function<void (unsigned int)> & func,
+                     unsigned int maxConcurrency = 0);
+
+    /**
+     * @brief Stops the workers, to be called when no loop is running anymore
+     **/
+    void quitWorkers();
+
+private:
+
+    boost::scoped_ptr<TaskSchedulerPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_TASKSCHEDULER_H
@@ -69,6 +69,7 @@ public:
     , isSequential(false)
     , roi()
     , updateOnlyRoi(false)
+    , displayIndependent(false)
     {
     }
     
@@ -109,6 +110,7 @@ public:
     bool isSequential;
     RectI roi;
     bool updateOnlyRoi;
+    bool displayIndependent; //< ramBuffer is float and the gain, gamma and lut are applied to it in updateViewer()
 };
 
 
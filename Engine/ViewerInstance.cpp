@@ -38,7 +38,6 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 
 CLANG_DIAG_OFF(deprecated)
 #include <QtCore/QtGlobal>
-#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
 #include <QtCore/QFutureWatcher>
 #include <QtCore/QMutex>
 #include <QtCore/QWaitCondition>
@@ -52,6 +51,7 @@ CLANG_DIAG_ON(deprecated)
 #include "Engine/Cache.h"
 #include "Engine/Image.h"
 #include "Engine/ImageInfo.h"
+#include "Engine/ImageMinMax.h"
 #include "Engine/ImageInfo.h"
 #include "Engine/Log.h"
 #include "Engine/Lut.h"
@@ -60,16 +60,19 @@ CLANG_DIAG_ON(deprecated)
 #include "Engine/OfxEffectInstance.h"
 #include "Engine/OpenGLViewerI.h"
 #include "Engine/OutputSchedulerThread.h"
+#include "Engine/PixelConversion.h"
 #include "Engine/Project.h"
 #include "Engine/RenderStats.h"
 #include "Engine/RotoContext.h"
 #include "Engine/RotoPaint.h"
 #include "Engine/RotoStrokeItem.h"
 #include "Engine/Settings.h"
+#include "Engine/TaskScheduler.h"
 #include "Engine/TimeLine.h"
 #include "Engine/Timer.h"
 #include "Engine/UpdateViewerParams.h"
 #include "Engine/ViewIdx.h"
+#include "Engine/ViewerTextureConversion.h"
 
 
 #ifndef M_LN2
@@ -90,15 +93,26 @@ static void scaleToTexture8bits(const RectI& roi,
                                 U32* output);
 static void scaleToTexture32bits(const RectI& roi,
                                  const RenderViewerArgs & args,
+                                 ViewerInstance* viewer,
                                  float *output);
-static std::pair<double, double>
-findAutoContrastVminVmax(boost::shared_ptr<const Image> inputImage,
-                         DisplayChannelsEnum channels,
-                         const RectI & rect);
+static void findAutoContrastVminVmax(boost::shared_ptr<const Image> inputImage,
+                                     DisplayChannelsEnum channels,
+                                     const RectI & rect,
+                                     ImageMinMaxResult* result);
+static void findAutoContrastVminVmaxAt(boost::shared_ptr<const Image> inputImage,
+                                       DisplayChannelsEnum channels,
+                                       const std::vector<RectI>* rects,
+                                       std::vector<ImageMinMaxResult>* results,
+                                       unsigned int index);
 static void renderFunctor(const RectI& roi,
                           const RenderViewerArgs & args,
                           ViewerInstance* viewer,
                           void *buffer);
+static void renderFunctorAt(const std::vector<RectI>* rects,
+                            const RenderViewerArgs* args,
+                            ViewerInstance* viewer,
+                            void *buffer,
+                            unsigned int index);
 
 /**
  *@brief Actually converting to ARGB... but it is called BGRA by
@@ -1051,6 +1065,13 @@ ViewerInstance::getRenderViewerArgsAndCheckCache(SequenceTime time,
     
     assert(_imp->uiContext);
     outArgs->params->depth = _imp->uiContext->getBitDepth();
+    // Byte textures depend on the gain, gamma and lut: if the texture goes to the cache, cache a float texture instead
+    // and apply them in updateViewer(), so that changing them only needs the cached texture
+    if ( (outArgs->params->depth == eImageBitDepthByte) && !outArgs->userRoIEnabled && !outArgs->autoContrast && !rotoPaintNode &&
+         appPTR->getCurrentSettings()->isViewerCacheDisplayIndependent() ) {
+        outArgs->params->depth = eImageBitDepthFloat;
+        outArgs->params->displayIndependent = true;
+    }
     if (outArgs->params->depth == eImageBitDepthFloat) {
         outArgs->params->bytesCount *= sizeof(float);
     }
@@ -1095,7 +1116,8 @@ ViewerInstance::getRenderViewerArgsAndCheckCache(SequenceTime time,
                                         inputToRenderName,
                                         outArgs->params->layer,
                                         outArgs->params->alphaLayer.getLayerName() + outArgs->params->alphaChannelName,
-                                        outArgs->params->depth == eImageBitDepthFloat && supportsGLSL(),
+                                        outArgs->params->depth == eImageBitDepthFloat && supportsGLSL() && !outArgs->params->displayIndependent,
+                                        outArgs->params->displayIndependent,
                                         lookup == 1));
         
         bool isCached = false;
@@ -1582,17 +1604,21 @@ ViewerInstance::renderViewer_internal(ViewIdx view,
             lastPaintBboxPixel.intersect(viewerRenderRoI, &viewerRenderRoI);
         }
         
-        boost::shared_ptr<TimeLapse> viewerRenderTimeRecorder;
-        if (stats) {
-            viewerRenderTimeRecorder.reset(new TimeLapse());
-        }
+        ///Always recorded: this is the recompute cost of the texture. The ViewerCache only weighs it when evicting if it is
+        ///given the eCacheEvictionPolicyGreedyDualSize policy, by default it evicts the least recently used textures
+        boost::shared_ptr<TimeLapse> viewerRenderTimeRecorder(new TimeLapse());
         
         if (singleThreaded) {
             if (inArgs.autoContrast) {
-                double vmin, vmax;
-                std::pair<double,double> vMinMax = findAutoContrastVminVmax(colorImage, inArgs.channels, viewerRenderRoI);
-                vmin = vMinMax.first;
-                vmax = vMinMax.second;
+                ImageMinMaxResult vMinMax;
+                findAutoContrastVminVmax(colorImage, inArgs.channels, viewerRenderRoI, &vMinMax);
+                double vmin = vMinMax.vmin;
+                double vmax = vMinMax.vmax;
+                if (vmin > vmax) {
+                    // nothing was reduced
+                    vmin = 0.;
+                    vmax = 1.;
+                }
                 
                 ///if vmax - vmin is greater than 1 the gain will be really small and we won't see
                 ///anything in the image
@@ -1614,7 +1640,8 @@ ViewerInstance::renderViewer_internal(ViewIdx view,
                                         inArgs.params->offset,
                                         lutFromColorspace(srcColorSpace),
                                         lutFromColorspace(inArgs.params->lut),
-                                        alphaChannelIndex);
+                                        alphaChannelIndex,
+                                        inArgs.params->displayIndependent);
             
             QReadLocker k(&_imp->gammaLookupMutex);
             renderFunctor(viewerRenderRoI,
@@ -1623,11 +1650,9 @@ ViewerInstance::renderViewer_internal(ViewIdx view,
                           inArgs.params->ramBuffer);
         } else {
             
-            bool runInCurrentThread = QThreadPool::globalInstance()->activeThreadCount() >= QThreadPool::globalInstance()->maxThreadCount();
+            ///The tiles are already rendered in parallel: the TaskScheduler shares its workers among all the loops so there's no need to check whether the pool is busy
+            bool runInCurrentThread = splitRoi.size() > 1;
             std::vector<RectI> splitRects;
-            if (!runInCurrentThread && splitRoi.size() > 1) {
-                runInCurrentThread = true;
-            }
             if (!runInCurrentThread) {
                 splitRects = viewerRenderRoI.splitIntoSmallerRects(appPTR->getHardwareIdealThreadCount());
             }
@@ -1635,33 +1660,33 @@ ViewerInstance::renderViewer_internal(ViewIdx view,
             ///if autoContrast is enabled, find out the vmin/vmax before rendering and mapping against new values
             if (inArgs.autoContrast) {
                 
-                double vmin = std::numeric_limits<double>::infinity();
-                double vmax = -std::numeric_limits<double>::infinity();
+                ImageMinMaxResult vMinMax;
                 
                 if (!runInCurrentThread) {
                     
-                    QFuture<std::pair<double,double> > future = QtConcurrent::mapped( splitRects,
-                                                                                     boost::bind(findAutoContrastVminVmax,
-                                                                                                 colorImage,
-                                                                                                 inArgs.channels,
-                                                                                                 _1) );
-                    future.waitForFinished();
+                    std::vector<ImageMinMaxResult> results( splitRects.size() );
+                    appPTR->getTaskScheduler()->parallelFor( splitRects.size(),
+                                                             boost::bind(findAutoContrastVminVmaxAt,
+                                                                         colorImage,
+                                                                         inArgs.channels,
+                                                                         &splitRects,
+                                                                         &results,
+                                                                         _1) );
                     
-                    std::pair<double,double> vMinMax;
-                    Q_FOREACH ( vMinMax, future.results() ) {
-                        if (vMinMax.first < vmin) {
-                            vmin = vMinMax.first;
-                        }
-                        if (vMinMax.second > vmax) {
-                            vmax = vMinMax.second;
-                        }
+                    for (std::vector<ImageMinMaxResult>::const_iterator it = results.begin(); it != results.end(); ++it) {
+                        vMinMax.merge(*it);
                     }
                 } else { //!runInCurrentThread
-                    std::pair<double,double> vMinMax = findAutoContrastVminVmax(colorImage, inArgs.channels, viewerRenderRoI);
-                    vmin = vMinMax.first;
-                    vmax = vMinMax.second;
+                    findAutoContrastVminVmax(colorImage, inArgs.channels, viewerRenderRoI, &vMinMax);
                 }
                 
+                double vmin = vMinMax.vmin;
+                double vmax = vMinMax.vmax;
+                if (vmin > vmax) {
+                    // nothing was reduced
+                    vmin = 0.;
+                    vmax = 1.;
+                }
                 if (vmax == vmin) {
                     vmin = vmax - 1.;
                 }
@@ -1686,19 +1711,21 @@ ViewerInstance::renderViewer_internal(ViewIdx view,
                                         inArgs.params->offset,
                                         lutFromColorspace(srcColorSpace),
                                         lutFromColorspace(inArgs.params->lut),
-                                        alphaChannelIndex);
+                                        alphaChannelIndex,
+                                        inArgs.params->displayIndependent);
             if (runInCurrentThread) {
                 QReadLocker k(&_imp->gammaLookupMutex);
                 renderFunctor(viewerRenderRoI,
                               args, this, inArgs.params->ramBuffer);
             } else {
                 QReadLocker k(&_imp->gammaLookupMutex);
-                QtConcurrent::map( splitRects,
-                                  boost::bind(&renderFunctor,
-                                              _1,
-                                              args,
-                                              this,
-                                              inArgs.params->ramBuffer) ).waitForFinished();
+                appPTR->getTaskScheduler()->parallelFor( splitRects.size(),
+                                                         boost::bind(&renderFunctorAt,
+                                                                     &splitRects,
+                                                                     &args,
+                                                                     this,
+                                                                     inArgs.params->ramBuffer,
+                                                                     _1) );
             }
             
             if (splitRoi.size() > 1 && rectIndex < (splitRoi.size() -1)) {
@@ -1712,6 +1739,9 @@ ViewerInstance::renderViewer_internal(ViewIdx view,
         if (inArgs.params->cachedFrame && colorImage) {
             inArgs.params->cachedFrame->addOriginalTile(colorImage);
         }
+        if (inArgs.params->cachedFrame) {
+            inArgs.params->cachedFrame->addRecomputeCost( viewerRenderTimeRecorder->getTimeSinceCreation() );
+        }
         
         if (stats && stats->isInDepthProfilingEnabled()) {
             stats->addRenderInfosForNode(getNode(), NodePtr(), colorImage->getComponents().getComponentsGlobalName(), viewerRenderRoI, viewerRenderTimeRecorder->getTimeSinceCreation());
@@ -1787,133 +1817,59 @@ renderFunctor(const RectI& roi,
 
     if ( (args.bitDepth == eImageBitDepthFloat) ) {
         // image is stored as linear, the OpenGL shader with do gamma/sRGB/Rec709 decompression, as well as gain and offset
-        scaleToTexture32bits(roi, args, (float*)buffer);
+        scaleToTexture32bits(roi, args, viewer, (float*)buffer);
     } else {
         // texture is stored as sRGB/Rec709 compressed 8-bit RGBA
         scaleToTexture8bits(roi, args,viewer, (U32*)buffer);
     }
 }
 
-inline
-std::pair<double, double>
-findAutoContrastVminVmax_generic(boost::shared_ptr<const Image> inputImage,
-                                 int nComps,
-                                 DisplayChannelsEnum channels,
-                                 const RectI & rect)
-{
-    double localVmin = std::numeric_limits<double>::infinity();
-    double localVmax = -std::numeric_limits<double>::infinity();
-    
-    Image::ReadAccess acc = inputImage->getReadRights();
-    
-    for (int y = rect.bottom(); y < rect.top(); ++y) {
-        const float* src_pixels = (const float*)acc.pixelAt(rect.left(),y);
-        ///we fill the scan-line with all the pixels of the input image
-        for (int x = rect.left(); x < rect.right(); ++x) {
-            
-            double r = 0.;
-            double g = 0.;
-            double b = 0.;
-            double a = 0.;
-            switch (nComps) {
-                case 4:
-                    r = src_pixels[0];
-                    g = src_pixels[1];
-                    b = src_pixels[2];
-                    a = src_pixels[3];
-                    break;
-                case 3:
-                    r = src_pixels[0];
-                    g = src_pixels[1];
-                    b = src_pixels[2];
-                    a = 1.;
-                    break;
-                case 2:
-                    r = src_pixels[0];
-                    g = src_pixels[1];
-                    b = 0.;
-                    a = 1.;
-                    break;
-                case 1:
-                    a = src_pixels[0];
-                    r = g = b = 0.;
-                    break;
-                default:
-                    r = g = b = a = 0.;
-            }
-            
-            double mini, maxi;
-            switch (channels) {
-                case eDisplayChannelsRGB:
-                    mini = std::min(std::min(r,g),b);
-                    maxi = std::max(std::max(r,g),b);
-                    break;
-                case eDisplayChannelsY:
-                    mini = r = 0.299 * r + 0.587 * g + 0.114 * b;
-                    maxi = mini;
-                    break;
-                case eDisplayChannelsR:
-                    mini = r;
-                    maxi = mini;
-                    break;
-                case eDisplayChannelsG:
-                    mini = g;
-                    maxi = mini;
-                    break;
-                case eDisplayChannelsB:
-                    mini = b;
-                    maxi = mini;
-                    break;
-                case eDisplayChannelsA:
-                    mini = a;
-                    maxi = mini;
-                    break;
-                default:
-                    mini = 0.;
-                    maxi = 0.;
-                    break;
-            }
-            if (mini < localVmin) {
-                localVmin = mini;
-            }
-            if (maxi > localVmax) {
-                localVmax = maxi;
-            }
-            
-            src_pixels += nComps;
-        }
-    }
-    
-    return std::make_pair(localVmin, localVmax);
-}
-
-template <int nComps>
-std::pair<double, double>
-findAutoContrastVminVmax_internal(boost::shared_ptr<const Image> inputImage,
-                                  DisplayChannelsEnum channels,
-                                  const RectI & rect)
+void
+renderFunctorAt(const std::vector<RectI>* rects,
+                const RenderViewerArgs* args,
+                ViewerInstance* viewer,
+                void *buffer,
+                unsigned int index)
 {
-    return findAutoContrastVminVmax_generic(inputImage, nComps, channels, rect);
+    renderFunctor( (*rects)[index], *args, viewer, buffer );
 }
 
-std::pair<double, double>
+void
 findAutoContrastVminVmax(boost::shared_ptr<const Image> inputImage,
                          DisplayChannelsEnum channels,
-                         const RectI & rect)
-{
-    int nComps = inputImage->getComponents().getNumComponents();
-    if (nComps == 4) {
-        return findAutoContrastVminVmax_internal<4>(inputImage, channels, rect);
-    } else if (nComps == 3) {
-        return findAutoContrastVminVmax_internal<3>(inputImage, channels, rect);
-    } else if (nComps == 1) {
-        return findAutoContrastVminVmax_internal<1>(inputImage, channels, rect);
-    } else {
-        return findAutoContrastVminVmax_generic(inputImage, nComps, channels, rect);
+                         const RectI & rect,
+                         ImageMinMaxResult* result)
+{
+    ///Only float images are reduced, other images keep the result untouched
+    if ( (inputImage->getBitDepth() != eImageBitDepthFloat) || rect.isNull() ) {
+        return;
     }
-    
+
+    Image::ReadAccess acc = inputImage->getReadRights();
+    const float* pixels = (const float*)acc.pixelAt( rect.left(), rect.bottom() );
+    if (!pixels) {
+        return;
+    }
+
+    ImageMinMax::findChannelsMinMax(pixels,
+                                    (int)inputImage->getRowElements(),
+                                    rect.width(),
+                                    rect.height(),
+                                    (int)inputImage->getComponentsCount(),
+                                    channels,
+                                    result);
 } // findAutoContrastVminVmax
 
+void
+findAutoContrastVminVmaxAt(boost::shared_ptr<const Image> inputImage,
+                           DisplayChannelsEnum channels,
+                           const std::vector<RectI>* rects,
+                           std::vector<ImageMinMaxResult>* results,
+                           unsigned int index)
+{
+    findAutoContrastVminVmax(inputImage, channels, (*rects)[index], &(*results)[index]);
+}
+
 template <typename PIX,int maxValue,bool opaque, bool applyMatte,int rOffset,int gOffset,int bOffset>
 void
 scaleToTexture8bits_generic(const RectI& roi,
@@ -2277,6 +2233,92 @@ scaleToTexture8bitsForDepth(const RectI& roi,
     }
 }
 
+/**
+ * @brief Returns true if the image can be converted by the vectorized functions of ViewerTextureConversion:
+ * an RGB(A) image displayed as RGB, without matte overlay.
+ **/
+static bool
+getTextureConversionArgs(const RenderViewerArgs & args,
+                         ViewerInstance* viewer,
+                         ViewerTextureConversionArgs* convArgs)
+{
+    if ( (args.inputImage->getBitDepth() == eImageBitDepthHalf) || (args.channels != eDisplayChannelsRGB) ||
+         ( args.matteImage && (args.alphaChannelIndex >= 0) ) ) {
+        return false;
+    }
+    int nComps = args.inputImage->getComponents().getNumComponents();
+    if ( (nComps != 3) && (nComps != 4) ) {
+        return false;
+    }
+    convArgs->nComps = nComps;
+    convArgs->opaque = args.srcPremult == eImagePremultiplicationOpaque;
+    convArgs->clampFloat = !args.displayIndependent;
+    convArgs->gain = (float)args.gain;
+    convArgs->offset = (float)args.offset;
+    //args.gamma is in fact 1. / gamma at this point
+    if (args.gamma == 0) {
+        convArgs->gammaMode = eViewerTextureGammaZero;
+    } else if (args.gamma == 1.) {
+        convArgs->gammaMode = eViewerTextureGammaIdentity;
+    } else {
+        convArgs->gammaMode = eViewerTextureGammaLut;
+        convArgs->gammaLut = viewer->getGammaLookupTable(&convArgs->gammaLutNValues);
+    }
+    if (args.colorSpace) {
+        args.colorSpace->validate();
+        convArgs->colorSpaceTable = args.colorSpace->getUint8xxTable();
+    }
+
+    return true;
+}
+
+/**
+ * @brief Converts the roi of the input image with one of the functions of ViewerTextureConversion, dst points to the
+ * pixel of the texture at (roi.x1, roi.y1). Returns false if the image cannot be converted this way.
+ * The rows of the images which are not linear float are first converted to linear float by PixelConversion.
+ **/
+template <typename TEXPIX>
+static bool
+convertToTextureVectorized(const RectI& roi,
+                           const RenderViewerArgs & args,
+                           ViewerInstance* viewer,
+                           void (*convertRows)(const ViewerTextureConversionArgs &, const float*, int, int, int, TEXPIX*, int),
+                           TEXPIX* dst,
+                           int dstRowElements)
+{
+    ViewerTextureConversionArgs convArgs;
+    if ( !getTextureConversionArgs(args, viewer, &convArgs) ) {
+        return false;
+    }
+    Image::ReadAccess acc( args.inputImage.get() );
+    const unsigned char* src = acc.pixelAt(roi.x1, roi.y1);
+    if (!src) {
+        return false;
+    }
+    const ImageBitDepthEnum depth = args.inputImage->getBitDepth();
+    const int srcRowElements = (int)args.inputImage->getRowElements();
+    if ( (depth == eImageBitDepthFloat) && !args.srcColorSpace ) {
+        convertRows(convArgs, (const float*)src, srcRowElements, roi.width(), roi.height(), dst, dstRowElements);
+
+        return true;
+    }
+
+    PixelConversionArgs linearArgs;
+    linearArgs.srcDepth = depth;
+    linearArgs.srcNComps = convArgs.nComps;
+    linearArgs.srcLut = args.srcColorSpace;
+    linearArgs.dstDepth = eImageBitDepthFloat;
+    linearArgs.dstNComps = convArgs.nComps;
+    std::vector<float> linearRow(roi.width() * convArgs.nComps);
+    const std::size_t srcRowBytes = srcRowElements * getSizeOfForBitDepth(depth);
+    for (int y = 0; y < roi.height(); ++y, src += srcRowBytes, dst += dstRowElements) {
+        PixelConversion::convertRows(linearArgs, src, srcRowElements, roi.width(), 1, &linearRow[0], 0);
+        convertRows(convArgs, &linearRow[0], 0, roi.width(), 1, dst, dstRowElements);
+    }
+
+    return true;
+}
+
 void
 scaleToTexture8bits(const RectI& roi,
                     const RenderViewerArgs & args,
@@ -2284,6 +2326,12 @@ scaleToTexture8bits(const RectI& roi,
                     U32* output)
 {
     assert(output);
+
+    U32* dst_pixels = output + (roi.y1 - args.texRect.y1) * args.texRect.w + (roi.x1 - args.texRect.x1);
+    if ( convertToTextureVectorized(roi, args, viewer, &ViewerTextureConversion::convertToTexture8bits, dst_pixels, args.texRect.w) ) {
+        return;
+    }
+
     switch ( args.inputImage->getBitDepth() ) {
         case eImageBitDepthFloat:
             scaleToTexture8bitsForDepth<float, 1>(roi, args,viewer, output);
@@ -2308,6 +2356,15 @@ ViewerInstance::interpolateGammaLut(float value)
     return _imp->lookupGammaLut(value);
 }
 
+const float*
+ViewerInstance::getGammaLookupTable(int* nValues) const
+{
+    assert( !_imp->gammaLookup.empty() );
+    *nValues = GAMMA_LUT_NB_VALUES;
+
+    return &_imp->gammaLookup[0];
+}
+
 void
 ViewerInstance::markAllOnGoingRendersAsAborted()
 {
@@ -2467,10 +2524,17 @@ scaleToTexture32bitsGeneric(const RectI& roi,
             }
 
             
-            dst_pixels[x * 4] = Image::clamp(r, 0., 1.);
-            dst_pixels[x * 4 + 1] = Image::clamp(g, 0., 1.);
-            dst_pixels[x * 4 + 2] = Image::clamp(b, 0., 1.);
-            dst_pixels[x * 4 + 3] = Image::clamp(a, 0., 1.);
+            if (args.displayIndependent) {
+                dst_pixels[x * 4] = r;
+                dst_pixels[x * 4 + 1] = g;
+                dst_pixels[x * 4 + 2] = b;
+                dst_pixels[x * 4 + 3] = a;
+            } else {
+                dst_pixels[x * 4] = Image::clamp(r, 0., 1.);
+                dst_pixels[x * 4 + 1] = Image::clamp(g, 0., 1.);
+                dst_pixels[x * 4 + 2] = Image::clamp(b, 0., 1.);
+                dst_pixels[x * 4 + 3] = Image::clamp(a, 0., 1.);
+            }
 
         }
         if (src_pixels) {
@@ -2608,10 +2672,17 @@ scaleToTexture32bitsForPremult(const RectI& roi,
 void
 scaleToTexture32bits(const RectI& roi,
                      const RenderViewerArgs & args,
+                     ViewerInstance* viewer,
                      float *output)
 {
     assert(output);
 
+    const int dstRowElements = args.texRect.w * 4;
+    float* dst_pixels = output + (roi.y1 - args.texRect.y1) * dstRowElements + (roi.x1 - args.texRect.x1) * 4;
+    if ( convertToTextureVectorized(roi, args, viewer, &ViewerTextureConversion::convertToTexture32bits, dst_pixels, dstRowElements) ) {
+        return;
+    }
+
     switch ( args.inputImage->getBitDepth() ) {
         case eImageBitDepthFloat:
             scaleToTexture32bitsForPremult<float, 1>(roi, args, output);
@@ -2631,6 +2702,78 @@ scaleToTexture32bits(const RectI& roi,
 } // scaleToTexture32bits
 
 
+static void
+applyDisplayTransformAt(const ViewerTextureConversionArgs* convArgs,
+                        const float* src,
+                        int width,
+                        int height,
+                        unsigned int nChunks,
+                        U32* dst,
+                        unsigned int index)
+{
+    int y1 = (int)( (qint64)height * index / nChunks );
+    int y2 = (int)( (qint64)height * (index + 1) / nChunks );
+
+    ViewerTextureConversion::convertToTexture8bits(*convArgs, src + (std::size_t)y1 * width * 4, width * 4, width, y2 - y1,
+                                                   dst + (std::size_t)y1 * width, width);
+}
+
+boost::shared_ptr<UpdateViewerParams>
+ViewerInstance::ViewerInstancePrivate::applyDisplayTransform(const boost::shared_ptr<UpdateViewerParams>& params)
+{
+    assert(params->displayIndependent && params->depth == eImageBitDepthFloat);
+
+    ///When reporting progress the buffer only holds the roi
+    const int width = params->updateOnlyRoi ? params->roi.width() : params->textureRect.w;
+    const int height = params->updateOnlyRoi ? params->roi.height() : params->textureRect.h;
+    assert(params->bytesCount == (std::size_t)width * height * 4 * sizeof(float));
+
+    boost::shared_ptr<UpdateViewerParams> ret( new UpdateViewerParams(*params) );
+    ret->depth = eImageBitDepthByte;
+    ret->displayIndependent = false;
+    ret->bytesCount = (std::size_t)width * height * 4;
+    ret->ramBuffer = (unsigned char*)malloc(ret->bytesCount);
+    ret->mustFreeRamBuffer = true;
+    if (!ret->ramBuffer) {
+        return boost::shared_ptr<UpdateViewerParams>();
+    }
+
+    ViewerTextureConversionArgs convArgs;
+    convArgs.nComps = 4;
+    convArgs.gain = (float)params->gain;
+    convArgs.offset = (float)params->offset;
+    const Color::Lut* colorSpace = lutFromColorspace(params->lut);
+    if (colorSpace) {
+        colorSpace->validate();
+        convArgs.colorSpaceTable = colorSpace->getUint8xxTable();
+    }
+
+    QReadLocker k(&gammaLookupMutex);
+    if (params->gamma == 0.) {
+        convArgs.gammaMode = eViewerTextureGammaZero;
+    } else if (params->gamma == 1.) {
+        convArgs.gammaMode = eViewerTextureGammaIdentity;
+    } else {
+        convArgs.gammaMode = eViewerTextureGammaLut;
+        convArgs.gammaLut = &gammaLookup[0];
+        convArgs.gammaLutNValues = GAMMA_LUT_NB_VALUES;
+    }
+
+    ///This runs in the main thread: use the workers of the TaskScheduler so that the viewer stays responsive
+    unsigned int nChunks = (unsigned int)std::max( 1, std::min( height, appPTR->getHardwareIdealThreadCount() ) );
+    appPTR->getTaskScheduler()->parallelFor( nChunks,
+                                             boost::bind(&applyDisplayTransformAt,
+                                                         &convArgs,
+                                                         (const float*)params->ramBuffer,
+                                                         width,
+                                                         height,
+                                                         nChunks,
+                                                         (U32*)ret->ramBuffer,
+                                                         _1) );
+
+    return ret;
+}
+
 void
 ViewerInstance::ViewerInstancePrivate::updateViewer(boost::shared_ptr<UpdateViewerParams> params)
 {
@@ -2654,6 +2797,10 @@ ViewerInstance::ViewerInstancePrivate::updateViewer(boost::shared_ptr<UpdateView
     if (!params->updateOnlyRoi && !params->isSequential && !checkAndUpdateDisplayAge(params->textureIndex,params->renderAge)) {
         doUpdate = false;
     }
+    if (doUpdate && params->displayIndependent) {
+        params = applyDisplayTransform(params);
+        doUpdate = params.get() != 0;
+    }
     if (doUpdate) {
         
         ImageList tiles;
@@ -255,6 +255,12 @@ public:
     struct ViewerInstancePrivate;
     
     float interpolateGammaLut(float value);
+
+    /**
+     * @brief Returns the table interpolated by interpolateGammaLut(), which has nValues + 1 values.
+     * The caller must hold the gamma lookup read lock like for interpolateGammaLut().
+     **/
+    const float* getGammaLookupTable(int* nValues) const;
     
     void markAllOnGoingRendersAsAborted();
     
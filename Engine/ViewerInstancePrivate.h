@@ -75,7 +75,8 @@ struct RenderViewerArgs
                      double offset_,
                      const Color::Lut* srcColorSpace_,
                      const Color::Lut* colorSpace_,
-                     int alphaChannelIndex_)
+                     int alphaChannelIndex_,
+                     bool displayIndependent_)
     : inputImage(inputImage_)
     , matteImage(matteImage_)
     , texRect(texRect_)
@@ -88,6 +89,7 @@ struct RenderViewerArgs
     , srcColorSpace(srcColorSpace_)
     , colorSpace(colorSpace_)
     , alphaChannelIndex(alphaChannelIndex_)
+    , displayIndependent(displayIndependent_)
     {
     }
 
@@ -103,6 +105,7 @@ struct RenderViewerArgs
     const Color::Lut* srcColorSpace;
     const Color::Lut* colorSpace;
     int alphaChannelIndex;
+    bool displayIndependent; //< if true the float textures are not clamped to [0,1]
 };
 
 
@@ -362,6 +365,12 @@ public:
                         const boost::shared_ptr<RenderStats>& stats,
                         const boost::shared_ptr<RequestedFrame>& request);
 
+    /**
+     * @brief Returns a copy of the params whose ramBuffer is the byte texture obtained by applying the gain, gamma and lut
+     * to the float texture of the given display-independent params, or NULL if the buffer could not be allocated.
+     **/
+    boost::shared_ptr<UpdateViewerParams> applyDisplayTransform(const boost::shared_ptr<UpdateViewerParams>& params);
+
 public Q_SLOTS:
 
     /**
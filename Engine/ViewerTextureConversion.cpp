@@ -0,0 +1,514 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "ViewerTextureConversion.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstdlib> // rand
+#include <cassert>
+
+#include "Engine/SimdSupport.h"
+
+#ifdef NATRON_SIMD_X86
+#include <immintrin.h>
+#endif
+
+NATRON_NAMESPACE_ENTER;
+
+namespace {
+
+/// Same as Color::floatToInt<256>
+inline unsigned int
+floatToByte(float v)
+{
+    if (v <= 0.f) {
+        return 0;
+    } else if (v >= 1.f) {
+        return 255;
+    }
+
+    return (unsigned int)(v * 255.f + 0.5f);
+}
+
+/// The index of a float in Lut::getUint8xxTable(): its 16 most significant bits
+inline unsigned short
+floatHiPart(float v)
+{
+    union
+    {
+        float f;
+        U32 u;
+    } tmp;
+
+    tmp.f = v;
+
+    return (unsigned short)(tmp.u >> 16);
+}
+
+/// Same as ViewerInstance::interpolateGammaLut
+inline float
+lookupGamma(const ViewerTextureConversionArgs & args,
+            float value)
+{
+    if (value < 0.f) {
+        return 0.f;
+    } else if (value > 1.f) {
+        return 1.f;
+    }
+    const int n = args.gammaLutNValues;
+    int i = (int)(value * n);
+    float alpha = std::max( 0.f, std::min(value * n - i, 1.f) );
+    float a = args.gammaLut[i];
+    float b = (i < n) ? args.gammaLut[i + 1] : 0.f;
+
+    return a * (1.f - alpha) + b * alpha;
+}
+
+inline float
+applyGainGamma(const ViewerTextureConversionArgs & args,
+               float v)
+{
+    switch (args.gammaMode) {
+    case eViewerTextureGammaZero:
+
+        return 0.f;
+    case eViewerTextureGammaIdentity:
+
+        return v * args.gain + args.offset;
+    case eViewerTextureGammaLut:
+    default:
+
+        return lookupGamma(args, v * args.gain + args.offset);
+    }
+}
+
+inline U32
+toBGRA(unsigned int r,
+       unsigned int g,
+       unsigned int b,
+       unsigned int a)
+{
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+/**
+ * @brief Prepares the pixels [x1, x2) of a row: with a color-space, writes for each pixel the table indices of r,g,b followed
+ * by the alpha byte in indices, otherwise writes the final pixels to dst.
+ **/
+void
+prepareRowScalar(const ViewerTextureConversionArgs & args,
+                 const float* src,
+                 int x1,
+                 int x2,
+                 U32* dst,
+                 unsigned short* indices)
+{
+    const int nComps = args.nComps;
+    const bool hasAlpha = (nComps >= 4) && !args.opaque;
+
+    for (int x = x1; x < x2; ++x) {
+        const float* p = src + x * nComps;
+        float r = applyGainGamma(args, p[0]);
+        float g = applyGainGamma(args, p[1]);
+        float b = applyGainGamma(args, p[2]);
+        unsigned int a = hasAlpha ? floatToByte(p[3]) : 255;
+        if (args.colorSpaceTable) {
+            indices[x * 4] = floatHiPart(r);
+            indices[x * 4 + 1] = floatHiPart(g);
+            indices[x * 4 + 2] = floatHiPart(b);
+            indices[x * 4 + 3] = (unsigned short)a;
+        } else {
+            dst[x] = toBGRA( floatToByte(r), floatToByte(g), floatToByte(b), a );
+        }
+    }
+}
+
+/**
+ * @brief The error diffusion of the color-space conversion: goes forward from start to the end of the row, then backward
+ * from start to the beginning, carrying the quantization error from one pixel to the next.
+ **/
+void
+ditherRow(const unsigned short* table,
+          const unsigned short* indices,
+          int width,
+          int start,
+          U32* dst)
+{
+    for (int backward = 0; backward < 2; ++backward) {
+        unsigned int errorR = 0x80;
+        unsigned int errorG = 0x80;
+        unsigned int errorB = 0x80;
+        const int step = backward ? -1 : 1;
+        const int end = backward ? -1 : width;
+        for (int x = backward ? start - 1 : start; x != end; x += step) {
+            const unsigned short* idx = indices + x * 4;
+            errorR = (errorR & 0xff) + table[idx[0]];
+            errorG = (errorG & 0xff) + table[idx[1]];
+            errorB = (errorB & 0xff) + table[idx[2]];
+            dst[x] = toBGRA(errorR >> 8, errorG >> 8, errorB >> 8, idx[3]);
+        }
+    }
+}
+
+#ifdef NATRON_SIMD_X86
+
+NATRON_SIMD_TARGET_SSE41
+inline __m128
+applyGainGammaSSE41(const ViewerTextureConversionArgs & args,
+                    __m128 v)
+{
+    // the alpha lane goes through unchanged
+    switch (args.gammaMode) {
+    case eViewerTextureGammaZero:
+
+        return _mm_blend_ps(_mm_setzero_ps(), v, 0x8);
+    case eViewerTextureGammaIdentity:
+
+        return _mm_add_ps( _mm_mul_ps( v, _mm_setr_ps(args.gain, args.gain, args.gain, 1.f) ), _mm_setr_ps(args.offset, args.offset, args.offset, 0.f) );
+    case eViewerTextureGammaLut:
+    default: {
+        __m128 u = _mm_add_ps( _mm_mul_ps( v, _mm_set1_ps(args.gain) ), _mm_set1_ps(args.offset) );
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.f);
+        const int n = args.gammaLutNValues;
+        __m128 pos = _mm_mul_ps( _mm_min_ps( _mm_max_ps(u, zero), one ), _mm_set1_ps( (float)n ) );
+        __m128i i = _mm_cvttps_epi32(pos);
+        __m128 alpha = _mm_min_ps( _mm_max_ps( _mm_sub_ps( pos, _mm_cvtepi32_ps(i) ), zero ), one );
+        int i0 = _mm_cvtsi128_si32(i);
+        int i1 = _mm_extract_epi32(i, 1);
+        int i2 = _mm_extract_epi32(i, 2);
+        const float* lut = args.gammaLut;
+        __m128 a = _mm_setr_ps(lut[i0], lut[i1], lut[i2], 0.f);
+        __m128 b = _mm_setr_ps(i0 < n ? lut[i0 + 1] : 0.f, i1 < n ? lut[i1 + 1] : 0.f, i2 < n ? lut[i2 + 1] : 0.f, 0.f);
+        __m128 res = _mm_add_ps( _mm_mul_ps( a, _mm_sub_ps(one, alpha) ), _mm_mul_ps(b, alpha) );
+        res = _mm_blendv_ps( res, zero, _mm_cmplt_ps(u, zero) );
+        res = _mm_blendv_ps( res, one, _mm_cmpgt_ps(u, one) );
+
+        return _mm_blend_ps(res, v, 0x8);
+    }
+    }
+}
+
+/// floatToByte of the 4 lanes
+NATRON_SIMD_TARGET_SSE41
+inline __m128i
+floatToByteSSE41(__m128 v)
+{
+    __m128 c = _mm_min_ps( _mm_max_ps( v, _mm_setzero_ps() ), _mm_set1_ps(1.f) );
+
+    return _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( c, _mm_set1_ps(255.f) ), _mm_set1_ps(0.5f) ) );
+}
+
+/// Returns the RGBA bytes (as 32-bit lanes) of a pixel, or its table indices followed by the alpha byte
+NATRON_SIMD_TARGET_SSE41
+inline __m128i
+preparePixelSSE41(const ViewerTextureConversionArgs & args,
+                  const float* p)
+{
+    __m128 t = applyGainGammaSSE41( args, _mm_loadu_ps(p) );
+    __m128i bytes = floatToByteSSE41(t);
+
+    if (args.opaque) {
+        bytes = _mm_blend_epi16( bytes, _mm_set1_epi32(255), 0xC0 );
+    }
+    if (args.colorSpaceTable) {
+        return _mm_blend_epi16( _mm_srli_epi32(_mm_castps_si128(t), 16), bytes, 0xC0 );
+    }
+
+    // b,g,r,a
+    return _mm_shuffle_epi32( bytes, _MM_SHUFFLE(3, 0, 1, 2) );
+}
+
+NATRON_SIMD_TARGET_SSE41
+void
+prepareRowSSE41(const ViewerTextureConversionArgs & args,
+                const float* src,
+                int width,
+                U32* dst,
+                unsigned short* indices)
+{
+    assert(args.nComps == 4);
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i p0 = preparePixelSSE41(args, src + x * 4);
+        __m128i p1 = preparePixelSSE41(args, src + x * 4 + 4);
+        __m128i p2 = preparePixelSSE41(args, src + x * 4 + 8);
+        __m128i p3 = preparePixelSSE41(args, src + x * 4 + 12);
+        __m128i p01 = _mm_packus_epi32(p0, p1);
+        __m128i p23 = _mm_packus_epi32(p2, p3);
+        if (args.colorSpaceTable) {
+            _mm_storeu_si128( (__m128i*)(indices + x * 4), p01 );
+            _mm_storeu_si128( (__m128i*)(indices + x * 4 + 8), p23 );
+        } else {
+            _mm_storeu_si128( (__m128i*)(dst + x), _mm_packus_epi16(p01, p23) );
+        }
+    }
+    prepareRowScalar(args, src, x, width, dst, indices);
+}
+
+NATRON_SIMD_TARGET_AVX2_FMA
+inline __m256
+applyGainGammaAVX2(const ViewerTextureConversionArgs & args,
+                   __m256 v)
+{
+    // the alpha lanes go through unchanged
+    switch (args.gammaMode) {
+    case eViewerTextureGammaZero:
+
+        return _mm256_blend_ps(_mm256_setzero_ps(), v, 0x88);
+    case eViewerTextureGammaIdentity:
+
+        return _mm256_fmadd_ps( v, _mm256_setr_ps(args.gain, args.gain, args.gain, 1.f, args.gain, args.gain, args.gain, 1.f),
+                                _mm256_setr_ps(args.offset, args.offset, args.offset, 0.f, args.offset, args.offset, args.offset, 0.f) );
+    case eViewerTextureGammaLut:
+    default: {
+        __m256 u = _mm256_fmadd_ps( v, _mm256_set1_ps(args.gain), _mm256_set1_ps(args.offset) );
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.f);
+        const int n = args.gammaLutNValues;
+        __m256 pos = _mm256_mul_ps( _mm256_min_ps( _mm256_max_ps(u, zero), one ), _mm256_set1_ps( (float)n ) );
+        __m256i i = _mm256_cvttps_epi32(pos);
+        __m256 alpha = _mm256_min_ps( _mm256_max_ps( _mm256_sub_ps( pos, _mm256_cvtepi32_ps(i) ), zero ), one );
+        // i + 1 is only read when i < n, otherwise alpha is 0
+        __m256i iNext = _mm256_min_epi32( _mm256_add_epi32( i, _mm256_set1_epi32(1) ), _mm256_set1_epi32(n) );
+        __m256 a = _mm256_i32gather_ps(args.gammaLut, i, 4);
+        __m256 b = _mm256_i32gather_ps(args.gammaLut, iNext, 4);
+        __m256 res = _mm256_fmadd_ps( b, alpha, _mm256_fnmadd_ps(a, alpha, a) );
+        res = _mm256_blendv_ps( res, zero, _mm256_cmp_ps(u, zero, _CMP_LT_OQ) );
+        res = _mm256_blendv_ps( res, one, _mm256_cmp_ps(u, one, _CMP_GT_OQ) );
+
+        return _mm256_blend_ps(res, v, 0x88);
+    }
+    }
+}
+
+/// Same as preparePixelSSE41 for 2 pixels
+NATRON_SIMD_TARGET_AVX2_FMA
+inline __m256i
+preparePixelsAVX2(const ViewerTextureConversionArgs & args,
+                  const float* p)
+{
+    __m256 t = applyGainGammaAVX2( args, _mm256_loadu_ps(p) );
+    __m256 c = _mm256_min_ps( _mm256_max_ps( t, _mm256_setzero_ps() ), _mm256_set1_ps(1.f) );
+    __m256i bytes = _mm256_cvttps_epi32( _mm256_fmadd_ps( c, _mm256_set1_ps(255.f), _mm256_set1_ps(0.5f) ) );
+
+    if (args.opaque) {
+        bytes = _mm256_blend_epi32( bytes, _mm256_set1_epi32(255), 0x88 );
+    }
+    if (args.colorSpaceTable) {
+        return _mm256_blend_epi32( _mm256_srli_epi32(_mm256_castps_si256(t), 16), bytes, 0x88 );
+    }
+
+    return _mm256_shuffle_epi32( bytes, _MM_SHUFFLE(3, 0, 1, 2) );
+}
+
+NATRON_SIMD_TARGET_AVX2_FMA
+void
+prepareRowAVX2(const ViewerTextureConversionArgs & args,
+               const float* src,
+               int width,
+               U32* dst,
+               unsigned short* indices)
+{
+    assert(args.nComps == 4);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        // each vector holds 2 pixels, one per 128-bit lane: packing interleaves them, the permutations restore the order
+        __m256i p01 = preparePixelsAVX2(args, src + x * 4);
+        __m256i p23 = preparePixelsAVX2(args, src + x * 4 + 8);
+        __m256i p45 = preparePixelsAVX2(args, src + x * 4 + 16);
+        __m256i p67 = preparePixelsAVX2(args, src + x * 4 + 24);
+        __m256i p0213 = _mm256_packus_epi32(p01, p23);
+        __m256i p4657 = _mm256_packus_epi32(p45, p67);
+        if (args.colorSpaceTable) {
+            _mm256_storeu_si256( (__m256i*)(indices + x * 4), _mm256_permute4x64_epi64( p0213, _MM_SHUFFLE(3, 1, 2, 0) ) );
+            _mm256_storeu_si256( (__m256i*)(indices + x * 4 + 16), _mm256_permute4x64_epi64( p4657, _MM_SHUFFLE(3, 1, 2, 0) ) );
+        } else {
+            __m256i bytes = _mm256_packus_epi16(p0213, p4657);
+            _mm256_storeu_si256( (__m256i*)(dst + x), _mm256_permutevar8x32_epi32( bytes, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7) ) );
+        }
+    }
+    prepareRowScalar(args, src, x, width, dst, indices);
+}
+
+NATRON_SIMD_TARGET_SSE41
+void
+clampRowSSE41(const float* src,
+              int width,
+              bool opaque,
+              bool clamp,
+              float* dst)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+
+    for (int x = 0; x < width; ++x) {
+        __m128 c = _mm_loadu_ps(src + x * 4);
+        if (clamp) {
+            c = _mm_min_ps( _mm_max_ps(c, zero), one );
+        }
+        if (opaque) {
+            c = _mm_blend_ps(c, one, 0x8);
+        }
+        _mm_storeu_ps(dst + x * 4, c);
+    }
+}
+
+NATRON_SIMD_TARGET_AVX2_FMA
+void
+clampRowAVX2(const float* src,
+             int width,
+             bool opaque,
+             bool clamp,
+             float* dst)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.f);
+    int x = 0;
+
+    for (; x + 2 <= width; x += 2) {
+        __m256 c = _mm256_loadu_ps(src + x * 4);
+        if (clamp) {
+            c = _mm256_min_ps( _mm256_max_ps(c, zero), one );
+        }
+        if (opaque) {
+            c = _mm256_blend_ps(c, one, 0x88);
+        }
+        _mm256_storeu_ps(dst + x * 4, c);
+    }
+    if (x < width) {
+        clampRowSSE41(src + x * 4, width - x, opaque, clamp, dst + x * 4);
+    }
+}
+
+#endif // NATRON_SIMD_X86
+
+inline float
+clampToUnit(float v)
+{
+    return v < 0.f ? 0.f : (v > 1.f ? 1.f : v);
+}
+
+void
+clampRowScalar(const float* src,
+               int width,
+               int nComps,
+               bool opaque,
+               bool clamp,
+               float* dst)
+{
+    for (int x = 0; x < width; ++x) {
+        const float* p = src + x * nComps;
+        for (int c = 0; c < 3; ++c) {
+            dst[x * 4 + c] = clamp ? clampToUnit(p[c]) : p[c];
+        }
+        if ( (nComps >= 4) && !opaque ) {
+            dst[x * 4 + 3] = clamp ? clampToUnit(p[3]) : p[3];
+        } else {
+            dst[x * 4 + 3] = 1.f;
+        }
+    }
+}
+} // anon namespace
+
+namespace ViewerTextureConversion {
+
+void
+convertToTexture8bits(const ViewerTextureConversionArgs & args,
+                      const float* src,
+                      int srcRowElements,
+                      int width,
+                      int height,
+                      U32* dst,
+                      int dstRowElements)
+{
+    assert(args.nComps == 3 || args.nComps == 4);
+    assert(args.gammaMode != eViewerTextureGammaLut || args.gammaLut);
+    if (width <= 0) {
+        return;
+    }
+
+    const SimdLevelEnum level = args.nComps == 4 ? getSimdLevel() : eSimdLevelNone;
+    std::vector<unsigned short> indices;
+    if (args.colorSpaceTable) {
+        // the vectorized kernels write whole pixels
+        indices.resize(width * 4);
+    }
+
+    for (int y = 0; y < height; ++y, src += srcRowElements, dst += dstRowElements) {
+        // coverity[dont_call]
+        int start = (int)(rand() % width);
+        unsigned short* rowIndices = indices.empty() ? 0 : &indices[0];
+
+        switch (level) {
+#ifdef NATRON_SIMD_X86
+        case eSimdLevelAVX2:
+            prepareRowAVX2(args, src, width, dst, rowIndices);
+            break;
+        case eSimdLevelSSE41:
+            prepareRowSSE41(args, src, width, dst, rowIndices);
+            break;
+#endif
+        default:
+            prepareRowScalar(args, src, 0, width, dst, rowIndices);
+            break;
+        }
+        if (args.colorSpaceTable) {
+            ditherRow(args.colorSpaceTable, rowIndices, width, start, dst);
+        }
+    }
+} // convertToTexture8bits
+
+void
+convertToTexture32bits(const ViewerTextureConversionArgs & args,
+                       const float* src,
+                       int srcRowElements,
+                       int width,
+                       int height,
+                       float* dst,
+                       int dstRowElements)
+{
+    assert(args.nComps == 3 || args.nComps == 4);
+    const SimdLevelEnum level = args.nComps == 4 ? getSimdLevel() : eSimdLevelNone;
+
+    for (int y = 0; y < height; ++y, src += srcRowElements, dst += dstRowElements) {
+        switch (level) {
+#ifdef NATRON_SIMD_X86
+        case eSimdLevelAVX2:
+            clampRowAVX2(src, width, args.opaque, args.clampFloat, dst);
+            break;
+        case eSimdLevelSSE41:
+            clampRowSSE41(src, width, args.opaque, args.clampFloat, dst);
+            break;
+#endif
+        default:
+            clampRowScalar(src, width, args.nComps, args.opaque, args.clampFloat, dst);
+            break;
+        }
+    }
+}
+} // namespace ViewerTextureConversion
+
+NATRON_NAMESPACE_EXIT;
@@ -0,0 +1,106 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_VIEWERTEXTURECONVERSION_H
+#define NATRON_ENGINE_VIEWERTEXTURECONVERSION_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include "Global/GlobalDefines.h"
+
+NATRON_NAMESPACE_ENTER;
+
+enum ViewerTextureGammaEnum
+{
+    eViewerTextureGammaZero = 0, //< the output is black
+    eViewerTextureGammaIdentity, //< only the gain and offset are applied
+    eViewerTextureGammaLut //< the gain and offset are applied, then the gamma is interpolated in a lookup table
+};
+
+/**
+ * @brief The parameters of the conversion of a float RGB(A) image to a viewer texture
+ **/
+struct ViewerTextureConversionArgs
+{
+    int nComps; //< 3 or 4
+    bool opaque; //< if true the alpha of the texture is 1
+    float gain;
+    float offset;
+    ViewerTextureGammaEnum gammaMode;
+    const float* gammaLut; //< gammaLutNValues + 1 values for the inputs 0, 1 / gammaLutNValues, ..., 1
+    int gammaLutNValues;
+    const unsigned short* colorSpaceTable; //< @see Lut::getUint8xxTable(), NULL for a linear output
+    bool clampFloat; //< if false convertToTexture32bits() keeps the values out of [0,1]
+
+    ViewerTextureConversionArgs()
+        : nComps(4)
+        , opaque(false)
+        , gain(1.f)
+        , offset(0.f)
+        , gammaMode(eViewerTextureGammaIdentity)
+        , gammaLut(0)
+        , gammaLutNValues(0)
+        , colorSpaceTable(0)
+        , clampFloat(true)
+    {
+    }
+};
+
+/**
+ * @brief Vectorized conversions of the rows of a float image to the textures displayed by the viewer, used by the
+ * viewer for the common case of a float RGB(A) image displayed without matte overlay nor channel selection.
+ * They produce the same output as the per-pixel conversion of the viewer (up to the rounding of the computations done
+ * in float instead of double), including the error diffusion starting at a random position of each row which dithers the
+ * 8-bit textures. The SSE4.1 and AVX2 implementations are selected at runtime (@see getSimdLevel()).
+ **/
+namespace ViewerTextureConversion {
+
+/**
+ * @brief Converts height rows of width pixels to BGRA 8-bit pixels. The error diffusion of each row starts at
+ * rand() % width, like the per-pixel conversion.
+ **/
+void convertToTexture8bits(const ViewerTextureConversionArgs & args,
+                           const float* src,
+                           int srcRowElements,
+                           int width,
+                           int height,
+                           U32* dst,
+                           int dstRowElements);
+
+/**
+ * @brief Converts height rows of width pixels to RGBA float pixels, clamped to [0,1] if args.clampFloat is true. The gain,
+ * gamma and color-space of the arguments are not used: they are applied when the float textures are displayed.
+ **/
+void convertToTexture32bits(const ViewerTextureConversionArgs & args,
+                            const float* src,
+                            int srcRowElements,
+                            int width,
+                            int height,
+                            float* dst,
+                            int dstRowElements);
+} // namespace ViewerTextureConversion
+
+NATRON_NAMESPACE_EXIT;
+
+#endif // NATRON_ENGINE_VIEWERTEXTURECONVERSION_H
@@ -440,6 +440,12 @@ enum StorageModeEnum
     eStorageModeDisk //< will be allocated on virtual memory using mmap(). Fall-back on disk is assured by the operating system
 };
 
+enum CacheEvictionPolicyEnum
+{
+    eCacheEvictionPolicyLRU = 0, //< the least recently used entries are evicted first
+    eCacheEvictionPolicyGreedyDualSize //< recency is weighed against the time it took to compute an entry and its size
+};
+
 enum OrientationEnum
 {
     eOrientationHorizontal = 0x1,
@@ -94,6 +94,13 @@ namespace NATRON_NAMESPACE { }
 
 #define NATRON_PROJECT_ENV_VAR_MAX_RECURSION 100
 #define NATRON_MAX_CACHE_FILES_OPENED 20000
+//Disk cache entries are packed in files of this size (in bytes), see CachePackStore.
+//Entries that do not fit in a pack file get a file of their own.
+#define NATRON_CACHE_PACK_FILE_SIZE (256 * 1024 * 1024)
+//Allocation granularity in the pack files (in bytes): a multiple of the page size of all supported systems.
+#define NATRON_CACHE_PACK_BLOCK_SIZE (64 * 1024)
+//Entries evicted to the compressed portion of a cache are kept only if they compress to at most this ratio of their size.
+#define NATRON_CACHE_COMPRESSION_MAX_RATIO 0.9
 #define NATRON_CUSTOM_HTML_TAG_START "<" NATRON_APPLICATION_NAME ">"
 #define NATRON_CUSTOM_HTML_TAG_END "</" NATRON_APPLICATION_NAME ">"
 
@@ -229,6 +236,11 @@ NATRON_VERSION_REVISION)
 //In this context, the reader of the bitmap should then wait for the pixel to be available.
 #define NATRON_ENABLE_TRIMAP 1
 
+//The render state of the pixels of an image (the bitmap/trimap above) is stored per square tile of this size (as a power of 2).
+//Tiles are aligned on multiples of the tile size in pixel coordinates.
+#define NATRON_BITMAP_TILE_SIZE_LOG2 6
+#define NATRON_BITMAP_TILE_SIZE (1 << NATRON_BITMAP_TILE_SIZE_LOG2)
+
 //Uncomment to get access to ReadQt and WriteQt nodes. Note that they are no longer maintained and probably buggy.
 //#define NATRON_ENABLE_QT_IO_NODES
 
@@ -305,4 +305,39 @@ getAmountFreePhysicalRAM()
 #endif
 }
 
+/**
+ * @brief Returns the amount of physical RAM that can be allocated without swapping: unlike getAmountFreePhysicalRAM()
+ * this includes on Linux the page cache and the reclaimable memory the kernel gives back on demand.
+ **/
+inline size_t
+getAmountAvailablePhysicalRAM()
+{
+#if defined(__linux__) || defined(__linux) || defined(linux) || defined(__gnu_linux__)
+    /* Linux >= 3.14 estimates it in /proc/meminfo, in kB */
+    FILE* fp = fopen("/proc/meminfo", "r");
+    if (fp) {
+        char line[256];
+        unsigned long long availableKB = 0;
+        bool found = false;
+        while ( !found && fgets(line, sizeof(line), fp) ) {
+            found = sscanf(line, "MemAvailable: %llu kB", &availableKB) == 1;
+        }
+        fclose(fp);
+        if (found) {
+            return (size_t)(availableKB * 1024ULL);
+        }
+    }
+    /* Older kernels: the free RAM plus the buffers is a lower bound */
+    struct sysinfo memInfo;
+    sysinfo (&memInfo);
+    long long totalAvailableRAM = (long long)memInfo.freeram + (long long)memInfo.bufferram;
+    totalAvailableRAM *= memInfo.mem_unit;
+
+    return totalAvailableRAM;
+#else
+
+    return getAmountFreePhysicalRAM();
+#endif
+}
+
 #endif // ifndef NATRON_GLOBAL_MEMORYINFO_H
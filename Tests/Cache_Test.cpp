@@ -0,0 +1,835 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include <sstream>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <gtest/gtest.h>
+
+#include <QtCore/QThread>
+#include <QtCore/QDir>
+
+#include "Global/QtCompat.h"
+
+#include "BaseTest.h"
+
+#include "Engine/AppManager.h"
+#include "Engine/Cache.h"
+#include "Engine/CacheCompressor.h"
+#include "Engine/CachePackStore.h"
+#include "Engine/Image.h"
+#include "Engine/MemoryPool.h"
+#include "Engine/PersistentImageStore.h"
+#include "Engine/Timer.h"
+#include "Engine/ViewIdx.h"
+
+NATRON_NAMESPACE_USING
+
+namespace {
+
+/**
+ * @brief Hammers the cache with getOrCreate() calls on a pool of keys, creating the image when it is not cached,
+ * like the render threads do when rendering tiles of many nodes.
+ **/
+class CacheHammerThread
+    : public QThread
+{
+    const Cache<Image>* _cache;
+    int _nOps;
+    int _nKeys;
+    U64 _seed;
+
+public:
+
+    int nHits;
+
+    CacheHammerThread(const Cache<Image>* cache,
+                      int nOps,
+                      int nKeys,
+                      U64 seed)
+        : QThread()
+        , _cache(cache)
+        , _nOps(nOps)
+        , _nKeys(nKeys)
+        , _seed(seed)
+        , nHits(0)
+    {
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        boost::shared_ptr<ImageParams> params = Image::makeParams( 0, RectD(0, 0, 32, 32), 1., 0, false,
+                                                                   ImageComponents::getRGBAComponents(),
+                                                                   eImageBitDepthFloat,
+                                                                   eImagePremultiplicationPremultiplied,
+                                                                   eImageFieldingOrderNone );
+
+        for (int i = 0; i < _nOps; ++i) {
+            // a per-thread LCG: rand() is not thread-safe
+            _seed = _seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            U64 nodeHash = (_seed >> 33) % _nKeys;
+            ImageKey key = Image::makeKey(0, nodeHash, false, 0, ViewIdx(0), false, false);
+            ImagePtr image;
+            if ( _cache->getOrCreate(key, params, &image) ) {
+                ++nHits;
+            } else if (image) {
+                image->allocateMemory();
+            }
+        }
+    }
+};
+
+/**
+ * @brief Runs nThreads CacheHammerThread on a cache of nShards shards. Returns the number of cache hits, the
+ * throughput and the lock statistics of the cache.
+ **/
+void
+runCacheContention(unsigned int nShards,
+                   int nThreads,
+                   int nOpsPerThread,
+                   int nKeys,
+                   int* nHits,
+                   double* opsPerSecond,
+                   U64* nLocks,
+                   U64* nContendedLocks)
+{
+    // 16MiB: smaller than the key pool of the benchmark so that eviction happens during it
+    Cache<Image> cache("CacheContention", 0, 16 * 1024 * 1024, 1., nShards);
+    std::vector<CacheHammerThread*> threads;
+
+    for (int i = 0; i < nThreads; ++i) {
+        threads.push_back( new CacheHammerThread(&cache, nOpsPerThread, nKeys, i + 1) );
+    }
+
+    TimeLapse timer;
+    for (int i = 0; i < nThreads; ++i) {
+        threads[i]->start();
+    }
+    *nHits = 0;
+    for (int i = 0; i < nThreads; ++i) {
+        threads[i]->wait();
+        *nHits += threads[i]->nHits;
+        delete threads[i];
+    }
+    *opsPerSecond = (nThreads * nOpsPerThread) / std::max(timer.getTimeSinceCreation(), 1e-6);
+
+    double waitSeconds;
+    cache.getLockStats(nLocks, nContendedLocks, &waitSeconds);
+
+    cache.waitForDeleterThread();
+}
+
+class TestCacheHolder
+    : public CacheEntryHolder
+{
+public:
+
+    virtual std::string getCacheID() const OVERRIDE FINAL
+    {
+        return "TestCacheHolder";
+    }
+};
+
+
+/**
+ * @brief A cache entry of a recorded trace: only its cost and size matter to the eviction policy
+ **/
+struct TraceEntry
+{
+    double cost;
+    std::size_t bytes;
+
+    TraceEntry(double cost,
+               std::size_t bytes)
+        : cost(cost)
+        , bytes(bytes)
+    {
+    }
+
+    double getRecomputeCost() const
+    {
+        return cost;
+    }
+
+    std::size_t size() const
+    {
+        return bytes;
+    }
+};
+
+typedef boost::shared_ptr<TraceEntry> TraceEntryPtr;
+
+#ifdef NATRON_CACHE_USE_BOOST
+typedef BoostLRUHashTable<U64, TraceEntryPtr> TraceTable;
+#else
+typedef StlLRUHashTable<U64, TraceEntryPtr> TraceTable;
+#endif
+
+struct TraceAccess
+{
+    U64 key;
+    double cost;
+    std::size_t bytes;
+};
+
+/**
+ * @brief A render request of the trace: the images of the nodes from the output to the source,
+ * each node is rendered only if its output image is not cached.
+ **/
+typedef std::vector<TraceAccess> TraceRequest;
+
+/**
+ * @brief Records the accesses of an artist session on a comp: a chain of nodes mixing cheap nodes
+ * (Read, Grade, Merge...) and a few expensive ones (Defocus, Denoise), scrubbing around a frame range
+ * and tweaking the parameters of a node from time to time, which invalidates the images of that node
+ * and of all the nodes downstream.
+ **/
+void
+recordCompTrace(U64 seed,
+                std::vector<TraceRequest>* trace)
+{
+    const int nNodes = 12;
+    const int nFrames = 48;
+    const int nRequests = 4000;
+    const std::size_t fullFrame = 1920 * 1080 * 4 * sizeof(float);
+    double costs[nNodes];
+    std::size_t sizes[nNodes];
+    int versions[nNodes];
+
+    for (int i = 0; i < nNodes; ++i) {
+        costs[i] = 0.01 + 0.002 * i;
+        sizes[i] = (i % 3 == 2) ? fullFrame / 4 : fullFrame; // masks are single channel
+        versions[i] = 0;
+    }
+    costs[4] = 40.; // Defocus
+    costs[8] = 6.; // Denoise
+
+    int frame = 0;
+    for (int r = 0; r < nRequests; ++r) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        U64 rnd = seed >> 33;
+        if (rnd % 10 == 0) {
+            // tweak a node
+            ++versions[(rnd >> 4) % nNodes];
+        }
+        // mostly scrub around the current frame, sometimes jump
+        if (rnd % 16 == 1) {
+            frame = (rnd >> 8) % nFrames;
+        } else {
+            frame = (frame + nFrames + (int)( (rnd >> 12) % 5 ) - 2) % nFrames;
+        }
+        // the viewer looks at one of the 3 last nodes
+        int outputNode = nNodes - 1 - (int)( (rnd >> 20) % 3 );
+
+        std::vector<U64> hashes(nNodes);
+        U64 h = 0;
+        for (int i = 0; i < nNodes; ++i) {
+            h = (h ^ ( (U64)versions[i] + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2) ) ) * 1099511628211ULL + i;
+            hashes[i] = h;
+        }
+        TraceRequest request;
+        for (int i = outputNode; i >= 0; --i) {
+            TraceAccess access;
+            access.key = hashes[i] * 131 + frame;
+            access.cost = costs[i];
+            access.bytes = sizes[i];
+            request.push_back(access);
+        }
+        trace->push_back(request);
+    }
+}
+
+/**
+ * @brief Replays the trace on a cache of the given capacity and returns the total time spent recomputing images
+ **/
+double
+replayTrace(const std::vector<TraceRequest>& trace,
+            std::size_t capacity,
+            CacheEvictionPolicyEnum policy,
+            int* nHits)
+{
+    TraceTable table(policy);
+    std::size_t used = 0;
+    double recomputeTime = 0.;
+
+    *nHits = 0;
+    for (std::size_t r = 0; r < trace.size(); ++r) {
+        const TraceRequest& request = trace[r];
+        for (std::size_t i = 0; i < request.size(); ++i) {
+            if ( table(request[i].key) != table.end() ) {
+                // the image is cached, nothing upstream needs to be rendered
+                ++*nHits;
+                break;
+            }
+            recomputeTime += request[i].cost;
+            {
+                TraceEntryPtr entry( new TraceEntry(request[i].cost, request[i].bytes) );
+                table.insert(request[i].key, entry);
+                used += request[i].bytes;
+            }
+            while (used > capacity) {
+                std::pair<U64, TraceEntryPtr> evicted = table.evict();
+                if (!evicted.second) {
+                    break;
+                }
+                used -= evicted.second->bytes;
+            }
+        }
+    }
+
+    return recomputeTime;
+}
+} // anon namespace
+
+TEST_F(BaseTest, CacheConcurrentAccess)
+{
+    // A key pool that fits in the cache, accessed by a few threads with one lock and with several shards
+    const int nThreads = 4;
+    const int nOpsPerThread = 2000;
+    const int nKeys = 256;
+
+    for (unsigned int nShards = 1; nShards <= 4; nShards *= 4) {
+        int nHits;
+        double opsPerSecond;
+        U64 nLocks, nContendedLocks;
+        runCacheContention(nShards, nThreads, nOpsPerThread, nKeys, &nHits, &opsPerSecond, &nLocks, &nContendedLocks);
+
+        // each key is created once and then served from the cache
+        EXPECT_GE(nHits, nThreads * nOpsPerThread - nKeys) << nShards << " shard(s)";
+        // every look-up takes the locks of its shard, whatever the shard
+        EXPECT_GE(nLocks, (U64)nThreads * nOpsPerThread) << nShards << " shard(s)";
+        EXPECT_LE(nContendedLocks, nLocks);
+    }
+}
+
+TEST_F(BaseTest, DISABLED_CacheContentionBenchmark)
+{
+    const int nThreads = std::max(QThread::idealThreadCount(), 4) * 2;
+    const int nOpsPerThread = 20000;
+    const int nKeys = 4096;
+
+    unsigned int nShards = 1;
+
+    while ( nShards < (unsigned int)nThreads ) {
+        nShards *= 2;
+    }
+
+    int nHits;
+    double opsPerSecond;
+    U64 nLocks, nContendedLocks;
+    runCacheContention(1, nThreads, nOpsPerThread, nKeys, &nHits, &opsPerSecond, &nLocks, &nContendedLocks);
+    RecordProperty( "singleLockOpsPerSecond", (int)opsPerSecond );
+    RecordProperty( "singleLockContendedLocks", (int)nContendedLocks );
+    runCacheContention(nShards, nThreads, nOpsPerThread, nKeys, &nHits, &opsPerSecond, &nLocks, &nContendedLocks);
+    RecordProperty( "shardedOpsPerSecond", (int)opsPerSecond );
+    RecordProperty( "shardedContendedLocks", (int)nContendedLocks );
+}
+
+TEST(CachePackStoreTest, AllocateReleaseRestore)
+{
+    std::string directory = QDir::tempPath().toStdString() + "/CachePackStoreTest/";
+    QDir().mkpath( directory.c_str() );
+
+    const U64 packSize = 16 * NATRON_CACHE_PACK_BLOCK_SIZE;
+    CachePackSlot a, b, c;
+    {
+        CachePackStore store(packSize);
+
+        // entries larger than a pack must be stored in a file of their own
+        CachePackSlot tooLarge;
+        EXPECT_FALSE( store.allocate(directory, packSize + 1, &tooLarge) );
+        EXPECT_FALSE( tooLarge.isValid() );
+
+        ASSERT_TRUE( store.allocate(directory, 1, &a) );
+        ASSERT_TRUE( store.allocate(directory, 3 * NATRON_CACHE_PACK_BLOCK_SIZE, &b) );
+        ASSERT_TRUE( store.allocate(directory, NATRON_CACHE_PACK_BLOCK_SIZE + 1, &c) );
+        EXPECT_EQ(a.packIndex, b.packIndex);
+        EXPECT_EQ(a.capacity, (U64)NATRON_CACHE_PACK_BLOCK_SIZE);
+        EXPECT_EQ(c.capacity, (U64)2 * NATRON_CACHE_PACK_BLOCK_SIZE);
+        EXPECT_TRUE(b.offset >= a.offset + a.capacity || b.offset + b.capacity <= a.offset);
+
+        std::memset(store.getData(b), 0x5A, b.capacity);
+        std::memset(store.getData(c), 0xA5, c.capacity);
+
+        // a freed slot is reused by the next allocation that fits in it
+        U64 aOffset = a.offset;
+        store.release(&a);
+        EXPECT_FALSE( a.isValid() );
+        ASSERT_TRUE( store.allocate(directory, NATRON_CACHE_PACK_BLOCK_SIZE, &a) );
+        EXPECT_EQ(a.offset, aOffset);
+
+        // a full pack spills into a new pack file
+        CachePackSlot big;
+        ASSERT_TRUE( store.allocate(directory, packSize, &big) );
+        EXPECT_NE(big.packIndex, a.packIndex);
+
+        std::size_t nPacks;
+        U64 reserved, used;
+        store.getStats(&nPacks, &reserved, &used);
+        EXPECT_EQ(nPacks, (std::size_t)2);
+        EXPECT_EQ(used, a.capacity + b.capacity + c.capacity + big.capacity);
+
+        store.release(&big);
+        store.releaseUnusedPacks();
+        store.getStats(&nPacks, &reserved, &used);
+        EXPECT_EQ(nPacks, (std::size_t)1);
+        EXPECT_TRUE( store.flush() );
+    }
+
+    // re-opening the pack like when the cache is restored from its table of contents
+    {
+        CachePackStore store(packSize);
+        ASSERT_TRUE( store.restoreSlot(b) );
+        ASSERT_TRUE( store.restoreSlot(c) );
+        EXPECT_FALSE( store.restoreSlot(b) ); // already used
+        EXPECT_EQ( (unsigned char)store.getData(b)[b.capacity - 1], 0x5A );
+        EXPECT_EQ( (unsigned char)store.getData(c)[0], 0xA5 );
+
+        // new slots must not overlap the restored ones
+        CachePackSlot d;
+        ASSERT_TRUE( store.allocate(directory, 4 * NATRON_CACHE_PACK_BLOCK_SIZE, &d) );
+        EXPECT_TRUE(d.offset >= b.offset + b.capacity || d.offset + d.capacity <= b.offset);
+        EXPECT_TRUE(d.offset >= c.offset + c.capacity || d.offset + d.capacity <= c.offset);
+        store.release(&b);
+        store.release(&c);
+        store.release(&d);
+        store.releaseUnusedPacks();
+    }
+
+    QDir().rmdir( directory.c_str() );
+}
+
+TEST_F(BaseTest, CachePackStoreOpenedFiles)
+{
+    // The entries of a pack share its file: only the packs count in the limit of opened cache files
+    std::string directory = QDir::tempPath().toStdString() + "/CachePackStoreOpenedFiles/";
+    QDir().mkpath( directory.c_str() );
+
+    const U64 packSize = 16 * NATRON_CACHE_PACK_BLOCK_SIZE;
+    std::size_t nOpenedFiles = appPTR->getNCacheFilesOpened();
+    {
+        CachePackStore store(packSize);
+        std::vector<CachePackSlot> slots(24);
+        for (std::size_t i = 0; i < slots.size(); ++i) {
+            ASSERT_TRUE( store.allocate(directory, NATRON_CACHE_PACK_BLOCK_SIZE, &slots[i]) );
+        }
+        EXPECT_EQ(nOpenedFiles + 2, appPTR->getNCacheFilesOpened());
+
+        for (std::size_t i = 16; i < slots.size(); ++i) {
+            store.release(&slots[i]);
+        }
+        store.releaseUnusedPacks();
+        EXPECT_EQ(nOpenedFiles + 1, appPTR->getNCacheFilesOpened());
+
+        for (std::size_t i = 0; i < 16; ++i) {
+            store.release(&slots[i]);
+        }
+        store.releaseUnusedPacks();
+    }
+    EXPECT_EQ( nOpenedFiles, appPTR->getNCacheFilesOpened() );
+
+    QDir().rmdir( directory.c_str() );
+}
+
+TEST(CacheCompressorTest, RoundTrip)
+{
+    std::vector<std::vector<unsigned char> > inputs;
+    inputs.push_back( std::vector<unsigned char>() );
+    inputs.push_back( std::vector<unsigned char>(3, 7) );
+    inputs.push_back( std::vector<unsigned char>(100000, 0) );
+
+    // a smooth float ramp with some noise, like a rendered image
+    std::vector<unsigned char> ramp(256 * 256 * 4 * sizeof(float));
+    float* rampData = (float*)&ramp[0];
+    U64 seed = 1;
+    for (std::size_t i = 0; i < 256 * 256 * 4; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        rampData[i] = (float)(i % 1024) / 1024.f + (float)(seed >> 54) * 1e-5f;
+    }
+    inputs.push_back(ramp);
+
+    // random bytes
+    std::vector<unsigned char> noise(65537);
+    for (std::size_t i = 0; i < noise.size(); ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        noise[i] = (unsigned char)(seed >> 56);
+    }
+    inputs.push_back(noise);
+
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+        const std::vector<unsigned char>& input = inputs[i];
+        for (int elementSize = 1; elementSize <= 4; elementSize *= 2) {
+            std::vector<unsigned char> compressed;
+            std::size_t compressedSize = CacheCompressor::compress(input.empty() ? 0 : &input[0], input.size(), elementSize, &compressed);
+            ASSERT_EQ( compressedSize, compressed.size() );
+
+            std::vector<unsigned char> output(input.size() + 1);
+            ASSERT_TRUE( CacheCompressor::decompress(&compressed[0], compressedSize, elementSize, &output[0], input.size()) );
+            output.resize( input.size() );
+            EXPECT_TRUE(output == input);
+
+            // truncated data must be detected
+            if (compressedSize > 1) {
+                EXPECT_FALSE( CacheCompressor::decompress(&compressed[0], compressedSize / 2, elementSize, &output[0], input.size()) );
+            }
+        }
+    }
+
+    // a constant buffer must shrink to almost nothing
+    std::vector<unsigned char> compressedZeros;
+    EXPECT_LT( CacheCompressor::compress(&inputs[2][0], inputs[2].size(), 4, &compressedZeros), inputs[2].size() / 100 );
+}
+
+TEST_F(BaseTest, CacheCompressedPortion)
+{
+    // 64x64 RGBA float images: 64KiB each
+    boost::shared_ptr<ImageParams> params = Image::makeParams( 0, RectD(0, 0, 64, 64), 1., 0, false,
+                                                               ImageComponents::getRGBAComponents(),
+                                                               eImageBitDepthFloat,
+                                                               eImagePremultiplicationPremultiplied,
+                                                               eImageFieldingOrderNone );
+    // With several shards, the entries are compressed out of the shard locks and the compressed portion of every shard
+    // makes room for them
+    for (unsigned int nShards = 1; nShards <= 4; nShards += 3) {
+        TestCacheHolder holder;
+        Cache<Image> cache("CacheCompressedPortionTest", 0, 4 * 1024 * 1024, 1., nShards);
+        cache.setMaximumInMemorySize(0.5);
+        cache.setMaximumCompressedSize(0.5);
+
+        const int nImages = 64;
+        for (int i = 0; i < nImages; ++i) {
+            ImageKey key = Image::makeKey(&holder, i, false, 0, ViewIdx(0), false, false);
+            ImagePtr image;
+            ASSERT_FALSE( cache.getOrCreate(key, params, &image) );
+            ASSERT_TRUE(image);
+            image->allocateMemory();
+            image->fill(image->getBounds(), i / (float)nImages, 0.5f, 0.f, 1.f);
+        }
+        cache.clearExceedingEntries();
+
+        // The first images no longer fit in the in-memory portion but must be found compressed
+        EXPECT_LE( cache.getMemoryCacheSize(), cache.getMaximumMemorySize() );
+        EXPECT_GT( cache.getCompressedCacheSize(), (std::size_t)0 );
+        EXPECT_LE( cache.getCompressedCacheSize(), cache.getMaximumCompressedSize() );
+
+        ImageKey firstKey = Image::makeKey(&holder, 0, false, 0, ViewIdx(0), false, false);
+        std::list<ImagePtr> found;
+        ASSERT_TRUE( cache.get(firstKey, &found) );
+        ASSERT_EQ( found.size(), (std::size_t)1 );
+        {
+            Image::ReadAccess acc = found.front()->getReadRights();
+            const float* pix = (const float*)acc.pixelAt(10, 10);
+            ASSERT_TRUE(pix);
+            EXPECT_EQ( pix[0], 0.f );
+            EXPECT_EQ( pix[1], 0.5f );
+            EXPECT_EQ( pix[3], 1.f );
+        }
+
+        CacheEntryHolderStats stats;
+        cache.getMemoryStatsForCacheEntryHolder(&holder, &stats);
+        EXPECT_EQ(stats.misses, (U64)nImages);
+        EXPECT_EQ(stats.compressedHits, (U64)1);
+        EXPECT_GT(stats.ramOccupied, (std::size_t)0);
+
+        found.clear();
+        cache.clear();
+        cache.waitForDeleterThread();
+    }
+}
+
+// Memory allocated by plug-ins counts against the maximum size of the cache
+TEST_F(BaseTest, CacheExternalMemory)
+{
+    boost::shared_ptr<ImageParams> params = Image::makeParams( 0, RectD(0, 0, 64, 64), 1., 0, false,
+                                                               ImageComponents::getRGBAComponents(),
+                                                               eImageBitDepthFloat,
+                                                               eImagePremultiplicationPremultiplied,
+                                                               eImageFieldingOrderNone );
+    TestCacheHolder holder;
+    Cache<Image> cache("CacheExternalMemoryTest", 0, 4 * 1024 * 1024, 1.);
+
+    // 32 images of 64KiB: half of the cache
+    for (int i = 0; i < 32; ++i) {
+        ImageKey key = Image::makeKey(&holder, i, false, 0, ViewIdx(0), false, false);
+        ImagePtr image;
+        ASSERT_FALSE( cache.getOrCreate(key, params, &image) );
+        ASSERT_TRUE(image);
+        image->allocateMemory();
+    }
+    cache.clearExceedingEntries();
+    cache.waitForDeleterThread();
+    std::size_t sizeBefore = cache.getMemoryCacheSize();
+    EXPECT_GE( sizeBefore, (std::size_t)2 * 1024 * 1024 );
+
+    cache.notifyExternalMemoryChanged(3 * 1024 * 1024);
+    EXPECT_EQ( cache.getExternalMemorySize(), (std::size_t)3 * 1024 * 1024 );
+    cache.clearExceedingEntries();
+    cache.waitForDeleterThread();
+    EXPECT_LT( cache.getMemoryCacheSize(), sizeBefore );
+    EXPECT_LE( cache.getMemoryCacheSize() + cache.getExternalMemorySize(), cache.getMaximumMemorySize() );
+
+    // freeing more than what was registered does not underflow
+    cache.notifyExternalMemoryChanged(-4 * 1024 * 1024);
+    EXPECT_EQ( cache.getExternalMemorySize(), (std::size_t)0 );
+
+    cache.clear();
+    cache.waitForDeleterThread();
+}
+
+static void
+removeDirectory(const std::string & path)
+{
+#if QT_VERSION < 0x050000
+    QtCompat::removeRecursively( QString::fromUtf8( path.c_str() ) );
+#else
+    QDir( QString::fromUtf8( path.c_str() ) ).removeRecursively();
+#endif
+}
+
+TEST_F(BaseTest, PersistentImageStoreRoundTrip)
+{
+    std::string directory = QDir::tempPath().toStdString() + "/PersistentImageStoreTest/";
+    removeDirectory(directory);
+
+    boost::shared_ptr<ImageParams> params = Image::makeParams( 0, RectD(0, 0, 64, 48), 1., 0, false,
+                                                               ImageComponents::getRGBAComponents(),
+                                                               eImageBitDepthFloat,
+                                                               eImagePremultiplicationPremultiplied,
+                                                               eImageFieldingOrderNone );
+    TestCacheHolder holder;
+    Cache<Image> cache("PersistentImageStoreTest", 0, 4 * 1024 * 1024, 1.);
+    ImageKey key = Image::makeKey(&holder, 12345, false, 0, ViewIdx(0), false, false);
+    ImagePtr image;
+    ASSERT_FALSE( cache.getOrCreate(key, params, &image) );
+    image->allocateMemory();
+    image->fill(image->getBounds(), 0.25f, 0.5f, 0.75f, 1.f);
+
+    U64 contentHash = 0x0123456789abcdefULL;
+    ImageKey storeKey = PersistentImageStore::getStoreKey(key, contentHash);
+    PersistentImageStore store;
+    // disabled until a location is set
+    EXPECT_FALSE( store.storeBlocking(*image, storeKey) );
+    store.setLocation(directory);
+    ASSERT_TRUE( store.isEnabled() );
+
+    // partially rendered images are not stored
+    EXPECT_FALSE( store.storeBlocking(*image, storeKey) );
+    image->markForRendered( image->getBounds() );
+    EXPECT_TRUE( store.storeBlocking(*image, storeKey) );
+    // already stored
+    EXPECT_FALSE( store.storeBlocking(*image, storeKey) );
+
+    // another session, e.g: another process, has another node hash for the same content and finds it by content hash
+    TestCacheHolder otherHolder;
+    ImageKey otherKey = Image::makeKey(&otherHolder, 67890, false, 0, ViewIdx(0), false, false);
+    std::list<StoredImageInfo> stored;
+    ASSERT_TRUE( store.lookup(PersistentImageStore::getStoreKey(otherKey, contentHash), &stored) );
+    ASSERT_EQ( stored.size(), (std::size_t)1 );
+    EXPECT_EQ( stored.front().params->getBounds(), image->getBounds() );
+    EXPECT_EQ( stored.front().params->getBitDepth(), eImageBitDepthFloat );
+
+    ImagePtr loaded;
+    ASSERT_FALSE( cache.getOrCreate(otherKey, stored.front().params, &loaded) );
+    loaded->allocateMemory();
+    ASSERT_TRUE( PersistentImageStore::readPixels(stored.front().filePath, loaded.get()) );
+    {
+        Image::ReadAccess acc = loaded->getReadRights();
+        const float* pix = (const float*)acc.pixelAt(63, 47);
+        ASSERT_TRUE(pix);
+        EXPECT_EQ( pix[0], 0.25f );
+        EXPECT_EQ( pix[1], 0.5f );
+        EXPECT_EQ( pix[2], 0.75f );
+        EXPECT_EQ( pix[3], 1.f );
+    }
+
+    // the same node hash with another content, e.g: after the parameters or the files read changed, is not found
+    stored.clear();
+    EXPECT_FALSE( store.lookup(PersistentImageStore::getStoreKey(key, contentHash + 1), &stored) );
+    // the miss is remembered, but not once this process stored the image
+    EXPECT_FALSE( store.lookup(PersistentImageStore::getStoreKey(key, contentHash + 1), &stored) );
+    EXPECT_TRUE( store.storeBlocking( *image, PersistentImageStore::getStoreKey(key, contentHash + 1) ) );
+    EXPECT_TRUE( store.lookup(PersistentImageStore::getStoreKey(key, contentHash + 1), &stored) );
+
+    image.reset();
+    loaded.reset();
+    cache.clear();
+    cache.waitForDeleterThread();
+    removeDirectory(directory);
+}
+
+TEST(CacheEvictionPolicyTest, GreedyDualSizeOrder)
+{
+    // Without costs, the GreedyDual-Size policy evicts in the same order as LRU
+    TraceTable lru;
+    TraceTable gds(eCacheEvictionPolicyGreedyDualSize);
+    for (U64 k = 0; k < 8; ++k) {
+        lru.insert( k, TraceEntryPtr( new TraceEntry(0., 100) ) );
+        gds.insert( k, TraceEntryPtr( new TraceEntry(0., 100) ) );
+    }
+    lru(3);
+    gds(3);
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_EQ( lru.evict().first, gds.evict().first );
+    }
+    EXPECT_EQ( gds.size(), 0U );
+    EXPECT_FALSE( gds.evict().second );
+
+    // An expensive entry outlives cheap entries that were accessed more recently...
+    gds.insert( 100, TraceEntryPtr( new TraceEntry(40., 100) ) );
+    for (U64 k = 0; k < 8; ++k) {
+        gds.insert( k, TraceEntryPtr( new TraceEntry(0.01, 100) ) );
+    }
+    for (int i = 0; i < 8; ++i) {
+        EXPECT_NE( gds.evict().first, (U64)100 );
+    }
+    EXPECT_EQ( gds.evict().first, (U64)100 );
+
+    // ...but not forever: evicting cheap entries ages it
+    gds.insert( 100, TraceEntryPtr( new TraceEntry(1., 100) ) );
+    bool evicted = false;
+    for (U64 k = 0; k < 1000 && !evicted; ++k) {
+        gds.insert( k, TraceEntryPtr( new TraceEntry(0.5, 100) ) );
+        evicted = gds.evict().first == 100;
+    }
+    EXPECT_TRUE(evicted);
+
+    // Entries in use are never evicted
+    gds.clear();
+    TraceEntryPtr used( new TraceEntry(0., 100) );
+    gds.insert(0, used);
+    gds.insert( 1, TraceEntryPtr( new TraceEntry(1., 100) ) );
+    EXPECT_EQ( gds.evict().first, (U64)1 );
+    EXPECT_FALSE( gds.evict().second );
+
+    // Switching policy keeps the recency order of the entries
+    TraceTable switched;
+    for (U64 k = 0; k < 4; ++k) {
+        switched.insert( k, TraceEntryPtr( new TraceEntry(0., 100) ) );
+    }
+    switched(0);
+    switched.setEvictionPolicy(eCacheEvictionPolicyGreedyDualSize);
+    EXPECT_EQ( switched.evict().first, (U64)1 );
+
+    // The cost of an entry is known once it is rendered, after its insertion: it counts once the priority is refreshed
+    TraceTable rendered(eCacheEvictionPolicyGreedyDualSize);
+    TraceEntry* renderedEntry = new TraceEntry(0., 100);
+    rendered.insert( 0, TraceEntryPtr(renderedEntry) );
+    for (U64 k = 1; k < 4; ++k) {
+        rendered.insert( k, TraceEntryPtr( new TraceEntry(0.01, 100) ) );
+    }
+    renderedEntry->cost = 40.;
+    rendered.refreshPriority(0);
+    for (U64 k = 1; k < 4; ++k) {
+        EXPECT_EQ( rendered.evict().first, k );
+    }
+    EXPECT_EQ( rendered.evict().first, (U64)0 );
+}
+
+TEST(CacheEvictionPolicyTest, DISABLED_ReplayBenchmark)
+{
+    const std::size_t fullFrame = 1920 * 1080 * 4 * sizeof(float);
+
+    for (U64 seed = 1; seed <= 3; ++seed) {
+        std::vector<TraceRequest> trace;
+        recordCompTrace(seed, &trace);
+
+        // The cache holds a fraction of the working set of the session
+        const std::size_t capacities[] = { 16 * fullFrame, 64 * fullFrame, 128 * fullFrame };
+        for (int c = 0; c < 3; ++c) {
+            int lruHits, gdsHits;
+            TimeLapse timer;
+            double lruTime = replayTrace(trace, capacities[c], eCacheEvictionPolicyLRU, &lruHits);
+            double lruReplay = timer.getTimeElapsedReset();
+            double gdsTime = replayTrace(trace, capacities[c], eCacheEvictionPolicyGreedyDualSize, &gdsHits);
+            double gdsReplay = timer.getTimeElapsedReset();
+
+            // the simulated recompute times and the time taken by the replays, in milliseconds
+            std::stringstream prefix;
+            prefix << "trace" << seed << "Cache" << capacities[c] / fullFrame << "Frames";
+            RecordProperty( prefix.str() + "LruRecomputeMs", (int)(lruTime * 1000.) );
+            RecordProperty( prefix.str() + "LruHits", lruHits );
+            RecordProperty( prefix.str() + "LruReplayMs", (int)(lruReplay * 1000.) );
+            RecordProperty( prefix.str() + "GdsRecomputeMs", (int)(gdsTime * 1000.) );
+            RecordProperty( prefix.str() + "GdsHits", gdsHits );
+            RecordProperty( prefix.str() + "GdsReplayMs", (int)(gdsReplay * 1000.) );
+        }
+    }
+}
+
+TEST(MemoryPoolTest, AlignmentAndReuse)
+{
+    // the block sizes are at most 12.5% (or a cache line) larger than the requested size
+    const std::size_t sizes[] = { 1, 63, 64, 65, 1000, 4096, 5000, 1920 * 1080 * 16, 4096 * 2160 * 16 };
+    for (int i = 0; i < 9; ++i) {
+        std::size_t blockSize = MemoryPool::getBlockSize(sizes[i]);
+        EXPECT_GE(blockSize, sizes[i]);
+        EXPECT_LE( blockSize, sizes[i] + std::max( (std::size_t)64, sizes[i] / 8 ) );
+    }
+
+    MemoryPoolStats before;
+    MemoryPool::getStats(&before);
+
+    std::vector<void*> blocks;
+    for (int i = 0; i < 9; ++i) {
+        void* ptr = MemoryPool::allocate(sizes[i]);
+        ASSERT_TRUE(ptr != 0);
+        EXPECT_EQ( 0u, ( (std::size_t)ptr ) % 64 );
+        if (sizes[i] >= 4096) {
+            EXPECT_EQ( 0u, ( (std::size_t)ptr ) % 4096 );
+        }
+        memset(ptr, 0xff, sizes[i]);
+        blocks.push_back(ptr);
+    }
+
+    MemoryPoolStats allocated;
+    MemoryPool::getStats(&allocated);
+    std::size_t totalSize = 0;
+    for (int i = 0; i < 9; ++i) {
+        totalSize += sizes[i];
+    }
+    EXPECT_EQ(before.usedBytes + totalSize, allocated.usedBytes);
+    EXPECT_GE(allocated.reservedBytes, allocated.usedBytes);
+
+    for (int i = 0; i < 9; ++i) {
+        MemoryPool::deallocate(blocks[i], sizes[i]);
+    }
+
+    // freed blocks are handed out again for the same size class
+    void* again = MemoryPool::allocate(1920 * 1080 * 16 - 100);
+    EXPECT_TRUE(again == blocks[7]);
+    MemoryPool::deallocate(again, 1920 * 1080 * 16 - 100);
+
+    MemoryPoolStats freed;
+    MemoryPool::getStats(&freed);
+    EXPECT_EQ(before.usedBytes, freed.usedBytes);
+    EXPECT_GT(freed.nReused, before.nReused);
+
+    MemoryPool::trim();
+    MemoryPoolStats trimmed;
+    MemoryPool::getStats(&trimmed);
+    EXPECT_LE(trimmed.reservedBytes, before.reservedBytes);
+}
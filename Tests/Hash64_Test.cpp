@@ -23,9 +23,17 @@
 // ***** END PYTHON BLOCK *****
 
 #include <cstdlib>
+#include <vector>
+#include <algorithm>
 #include <gtest/gtest.h>
 
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/crc.hpp>
+#endif
+#include <QtCore/QString>
+
 #include "Engine/Hash64.h"
+#include "Engine/Timer.h"
 
 NATRON_NAMESPACE_USING
 
@@ -85,3 +93,90 @@ TEST(Hash64,GeneralTest) {
     EXPECT_NE( hash1.value(), hash2.value() );
     EXPECT_NE(hash1, hash2);
 }
+
+TEST(Hash64,XXH64Reference) {
+    // Values of XXH64 with seed 0 on the little-endian bytes of the appended values
+    Hash64 hash;
+
+    hash.append<U64>(3);
+    hash.computeHash();
+    EXPECT_EQ( hash.value(), 0x87b8166da7ec4841ULL );
+
+    // More than 32 bytes go through the 4 lanes
+    hash.reset();
+    for (U64 i = 0; i < 13; ++i) {
+        hash.append<U64>(i * 7919);
+    }
+    hash.computeHash();
+    EXPECT_EQ( hash.value(), 0xbbf72b9b45c06abbULL );
+
+    // The hash can be computed while values are appended
+    Hash64 incremental;
+    for (U64 i = 0; i < 13; ++i) {
+        incremental.append<U64>(i * 7919);
+        incremental.computeHash();
+    }
+    EXPECT_EQ(incremental, hash);
+}
+
+TEST(Hash64,AppendQString) {
+    Hash64 hash1, hash2;
+
+    Hash64_appendQString( &hash1, QString::fromUtf8("ab") );
+    Hash64_appendQString( &hash1, QString::fromUtf8("c") );
+    Hash64_appendQString( &hash2, QString::fromUtf8("a") );
+    Hash64_appendQString( &hash2, QString::fromUtf8("bc") );
+    hash1.computeHash();
+    hash2.computeHash();
+    EXPECT_NE(hash1, hash2);
+
+    hash1.reset();
+    hash2.reset();
+    Hash64_appendQString( &hash1, QString::fromUtf8("Blur1_Transform2") );
+    Hash64_appendQString( &hash2, QString::fromUtf8("Blur1_Transform2") );
+    hash1.computeHash();
+    hash2.computeHash();
+    EXPECT_EQ(hash1, hash2);
+}
+
+TEST(Hash64,DISABLED_Benchmark) {
+    // Roughly what Node::computeHashInternal appends: the knobs age, a few inputs, the script name and the project time.
+    // The reference is the byte-wise CRC-64 over the buffered values that Hash64 used to compute.
+    const int nNodes = 200000;
+    const QString scriptName = QString::fromUtf8("ColorCorrect12");
+    U64 checksums[2] = {0, 0};
+    TimeLapse timer;
+
+    for (int i = 0; i < nNodes; ++i) {
+        std::vector<U64> values;
+        values.push_back( (U64)i );
+        values.push_back(checksums[0] + 1);
+        values.push_back(checksums[0] + 2);
+        for (int c = 0; c < scriptName.size(); ++c) {
+            values.push_back( scriptName[c].unicode() );
+        }
+        values.push_back( (U64)1457000000000LL );
+        const unsigned char* data = reinterpret_cast<const unsigned char*>( &values.front() );
+        boost::crc_optimal<64,0x42F0E1EBA9EA3693ULL,0,0,false,false> crc_64;
+        crc_64 = std::for_each( data, data + values.size() * sizeof(values[0]), crc_64 );
+        checksums[0] ^= crc_64();
+    }
+    double crcTime = timer.getTimeElapsedReset();
+
+    Hash64 hash;
+    for (int i = 0; i < nNodes; ++i) {
+        hash.reset();
+        hash.append<unsigned long long>(i);
+        hash.append<U64>(checksums[1] + 1);
+        hash.append<U64>(checksums[1] + 2);
+        Hash64_appendQString(&hash, scriptName);
+        hash.append<long long>(1457000000000LL);
+        hash.computeHash();
+        checksums[1] ^= hash.value();
+    }
+    double xxhTime = timer.getTimeElapsedReset();
+
+    RecordProperty( "crc64Microseconds", (int)(crcTime * 1e6) );
+    RecordProperty( "xxh64Microseconds", (int)(xxhTime * 1e6) );
+    EXPECT_NE(checksums[0], checksums[1]);
+}
@@ -23,11 +23,28 @@
 // ***** END PYTHON BLOCK *****
 
 #include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <bitset>
+#include <limits>
+#include <vector>
 #include <gtest/gtest.h>
 
+#include "Engine/HistogramKernels.h"
 #include "Engine/Image.h"
+#include "Engine/ImageMinMax.h"
+#include "Engine/MipMapKernels.h"
+#include "Engine/PixelConversion.h"
+#include "Engine/PostRenderKernels.h"
+#include "Engine/Lut.h"
+#include "Engine/SimdSupport.h"
+#include "Engine/Timer.h"
+#include "Engine/ViewerTextureConversion.h"
 #include "Engine/ViewIdx.h"
 
+#include "SimdLevelTest.h"
+
 NATRON_NAMESPACE_USING
 
 TEST(BitmapTest,SimpleRect) {
@@ -46,8 +63,7 @@ TEST(BitmapTest,SimpleRect) {
     ASSERT_TRUE(rod == nonRenderedRectsUnion);
 
     ///assert that the "underlying" bitmap is clean
-    const char* map = bm.getBitmap();
-    ASSERT_TRUE( !memchr( map,1,rod.area() ) );
+    ASSERT_TRUE( bm.getStatesInRect(rod) == Bitmap::eBitmapStateNotRendered );
 
     RectI halfRoD(0,0,100,50);
     bm.markForRendered(halfRoD);
@@ -61,14 +77,12 @@ TEST(BitmapTest,SimpleRect) {
 
 
     ///assert that the underlying bitmap is marked as expected
-    const char* start = map;
 
     ///check that there are only ones in the rendered half
-    ASSERT_TRUE( !memchr( start,0,halfRoD.area() ) );
+    ASSERT_TRUE( bm.getStatesInRect(halfRoD) == Bitmap::eBitmapStateRendered );
 
     ///check that there are only 0s in the non rendered half
-    start = map + halfRoD.area();
-    ASSERT_TRUE( !memchr( start,1,halfRoD.area() ) );
+    ASSERT_TRUE( bm.getStatesInRect(nonRenderedHalf) == Bitmap::eBitmapStateNotRendered );
 
     ///mark for renderer the other half of the rod
     bm.markForRendered(nonRenderedHalf);
@@ -77,7 +91,7 @@ TEST(BitmapTest,SimpleRect) {
     nonRenderedRects.clear();
     bm.minimalNonMarkedRects(rod, nonRenderedRects);
     ASSERT_TRUE( nonRenderedRects.empty() );
-    ASSERT_TRUE( !memchr( map,0,rod.area() ) );
+    ASSERT_TRUE( bm.getStatesInRect(rod) == Bitmap::eBitmapStateRendered );
     
     ///More complex example where A,B,C,D are not rendered check that both trimap & bitmap yield the same result
     // BBBBBBBBBBBBBB
@@ -109,6 +123,42 @@ TEST(BitmapTest,SimpleRect) {
     EXPECT_TRUE(nonRenderedRects.size() == 3);
 }
 
+TEST(BitmapTest,TileBoundaries) {
+    ///bounds that are not aligned on the tiles and span negative coordinates
+    RectI rod(-70,-3,150,130);
+    Bitmap bm(rod);
+
+    ///a rect crossing tile borders must be reported exactly, not rounded to the tiles
+    RectI rendered(-10,5,67,90);
+    bm.markForRendered(rendered);
+    for (int y = rod.y1; y < rod.y2; ++y) {
+        for (int x = rod.x1; x < rod.x2; ++x) {
+            ASSERT_EQ( (int)bm.getPixelState(x, y), rendered.contains(x, y) ? 1 : 0 );
+        }
+    }
+    ASSERT_TRUE( bm.minimalNonMarkedBbox(rendered).isNull() );
+    RectI bigger(-11,5,67,90);
+    ASSERT_TRUE( bm.minimalNonMarkedBbox(bigger) == RectI(-11,5,-10,90) );
+
+    ///copy to a bitmap with other bounds: the whole state must follow
+    RectI otherRod(-40,0,100,100);
+    Bitmap other(otherRod);
+    other.copyBitmapPortion(otherRod, bm);
+    for (int y = otherRod.y1; y < otherRod.y2; ++y) {
+        for (int x = otherRod.x1; x < otherRod.x2; ++x) {
+            ASSERT_EQ( other.getPixelState(x, y), bm.getPixelState(x, y) );
+        }
+    }
+
+    ///a fully marked bitmap is stored as uniform tiles only
+    bm.markForRendered(rod);
+    ASSERT_TRUE( bm.getStatesInRect(rod) == Bitmap::eBitmapStateRendered );
+    ASSERT_TRUE( bm.getStorageSize() < (std::size_t)rod.area() );
+    std::list<RectI> nonRenderedRects;
+    bm.minimalNonMarkedRects(rod, nonRenderedRects);
+    ASSERT_TRUE( nonRenderedRects.empty() );
+}
+
 TEST(ImageKeyTest,Equality) {
     srand(2000);
     // coverity[dont_call]
@@ -152,3 +202,1027 @@ TEST(ImageKeyTest,Difference) {
     ASSERT_TRUE(keyHash1 != keyHash2);
 }
 
+
+///The per-pixel conversion of the viewer (scaleToTexture8bits_generic) for a float RGB(A) image displayed as RGB
+static void
+convertToTexture8bitsPerPixel(const ViewerTextureConversionArgs & args,
+                              const Color::Lut* colorSpace,
+                              const float* src,
+                              int width,
+                              int height,
+                              U32* dst)
+{
+    const int nComps = args.nComps;
+
+    for (int y = 0; y < height; ++y, src += width * nComps, dst += width) {
+        // coverity[dont_call]
+        int start = (int)(rand() % width);
+        for (int backward = 0; backward < 2; ++backward) {
+            unsigned error_r = 0x80;
+            unsigned error_g = 0x80;
+            unsigned error_b = 0x80;
+            for (int index = backward ? start - 1 : start; index < width && index >= 0; index += backward ? -1 : 1) {
+                double rgb[3];
+                for (int c = 0; c < 3; ++c) {
+                    double v = src[index * nComps + c];
+                    if (args.gammaMode == eViewerTextureGammaZero) {
+                        v = 0.;
+                    } else if (args.gammaMode == eViewerTextureGammaIdentity) {
+                        v = v * args.gain + args.offset;
+                    } else {
+                        float value = (float)(v * args.gain + args.offset);
+                        if (value < 0.) {
+                            v = 0.;
+                        } else if (value > 1.) {
+                            v = 1.;
+                        } else {
+                            const int n = args.gammaLutNValues;
+                            int i = (int)(value * n);
+                            float alpha = std::max( 0.f, std::min(value * n - i, 1.f) );
+                            float b = (i < n) ? args.gammaLut[i + 1] : 0.f;
+                            v = args.gammaLut[i] * (1.f - alpha) + b * alpha;
+                        }
+                    }
+                    rgb[c] = v;
+                }
+                int uA = (nComps == 4 && !args.opaque) ? Color::floatToInt<256>(src[index * nComps + 3]) : 255;
+                U8 uR, uG, uB;
+                if (!colorSpace) {
+                    uR = Color::floatToInt<256>(rgb[0]);
+                    uG = Color::floatToInt<256>(rgb[1]);
+                    uB = Color::floatToInt<256>(rgb[2]);
+                } else {
+                    error_r = (error_r & 0xff) + colorSpace->toColorSpaceUint8xxFromLinearFloatFast(rgb[0]);
+                    error_g = (error_g & 0xff) + colorSpace->toColorSpaceUint8xxFromLinearFloatFast(rgb[1]);
+                    error_b = (error_b & 0xff) + colorSpace->toColorSpaceUint8xxFromLinearFloatFast(rgb[2]);
+                    uR = (U8)(error_r >> 8);
+                    uG = (U8)(error_g >> 8);
+                    uB = (U8)(error_b >> 8);
+                }
+                dst[index] = ( (U32)uA << 24 ) | ( (U32)uR << 16 ) | ( (U32)uG << 8 ) | uB;
+            }
+        }
+    }
+}
+
+static void
+makeTestImage(int width,
+              int height,
+              int nComps,
+              std::vector<float>* pixels)
+{
+    pixels->resize(width * height * nComps);
+    srand(2000);
+    for (std::size_t i = 0; i < pixels->size(); ++i) {
+        // coverity[dont_call]
+        int r = rand() % 1000;
+        // values out of [0,1] and exactly 0 or 1 as well
+        (*pixels)[i] = (r < 50) ? 0.f : (r < 100) ? 1.f : (r - 200) / 600.f;
+    }
+}
+
+static void
+makeGammaLut(double gamma,
+             std::vector<float>* lut)
+{
+    // Same as ViewerInstancePrivate::fillGammaLut
+    const int nValues = 1023;
+
+    lut->resize(nValues + 1);
+    for (int i = 0; i <= nValues; ++i) {
+        (*lut)[i] = (float)std::pow(double(i) / nValues, gamma);
+    }
+}
+
+class ViewerTextureConversionTest
+    : public SimdLevelTest
+{
+};
+
+TEST_P(ViewerTextureConversionTest,SameAsPerPixel) {
+    const int width = 301; // not a multiple of the vector sizes
+    const int height = 7;
+    const Color::Lut* sRGB = Color::LutManager::sRGBLut();
+    std::vector<float> gammaLut;
+
+    sRGB->validate();
+    makeGammaLut(1. / 2.2, &gammaLut);
+
+    for (int nComps = 3; nComps <= 4; ++nComps) {
+        std::vector<float> src;
+        makeTestImage(width, height, nComps, &src);
+        for (int opaque = 0; opaque < 2; ++opaque) {
+            for (int gammaMode = eViewerTextureGammaZero; gammaMode <= eViewerTextureGammaLut; ++gammaMode) {
+                for (int useColorSpace = 0; useColorSpace < 2; ++useColorSpace) {
+                    ViewerTextureConversionArgs args;
+                    args.nComps = nComps;
+                    args.opaque = opaque;
+                    args.gain = 1.3f;
+                    args.offset = -0.05f;
+                    args.gammaMode = (ViewerTextureGammaEnum)gammaMode;
+                    args.gammaLut = &gammaLut[0];
+                    args.gammaLutNValues = (int)gammaLut.size() - 1;
+                    args.colorSpaceTable = useColorSpace ? sRGB->getUint8xxTable() : 0;
+
+                    std::vector<U32> expected(width * height), result(width * height);
+                    srand(3000);
+                    convertToTexture8bitsPerPixel(args, useColorSpace ? sRGB : 0, &src[0], width, height, &expected[0]);
+                    srand(3000);
+                    ViewerTextureConversion::convertToTexture8bits(args, &src[0], width * nComps, width, height, &result[0], width);
+
+                    // the computations are done in float instead of double: allow 1 of difference
+                    int maxDiff = 0;
+                    for (std::size_t i = 0; i < expected.size(); ++i) {
+                        for (int c = 0; c < 32; c += 8) {
+                            int diff = std::abs( (int)( (expected[i] >> c) & 0xff ) - (int)( (result[i] >> c) & 0xff ) );
+                            maxDiff = std::max(maxDiff, diff);
+                        }
+                    }
+                    EXPECT_LE(maxDiff, 1) << nComps << " components, opaque " << opaque
+                                          << ", gamma " << gammaMode << ", color-space " << useColorSpace;
+                }
+            }
+        }
+
+        // float textures, clamped or display-independent
+        for (int clamp = 0; clamp < 2; ++clamp) {
+            std::vector<float> expected(width * height * 4), result(width * height * 4);
+            for (int i = 0; i < width * height; ++i) {
+                for (int c = 0; c < 4; ++c) {
+                    float v = (c < nComps) ? src[i * nComps + c] : 1.f;
+                    expected[i * 4 + c] = clamp ? std::max( 0.f, std::min(v, 1.f) ) : v;
+                }
+            }
+            ViewerTextureConversionArgs args;
+            args.nComps = nComps;
+            args.clampFloat = clamp;
+            ViewerTextureConversion::convertToTexture32bits(args, &src[0], width * nComps, width, height, &result[0], width * 4);
+            EXPECT_TRUE(expected == result);
+        }
+    }
+}
+
+TEST_P(ViewerTextureConversionTest,DISABLED_Benchmark) {
+    // An HD float RGBA frame displayed in sRGB without gamma, the most common case
+    const int width = 1920;
+    const int height = 1080;
+    const int nFrames = 5;
+    const Color::Lut* sRGB = Color::LutManager::sRGBLut();
+    std::vector<float> src;
+    std::vector<U32> dst(width * height);
+
+    sRGB->validate();
+    makeTestImage(width, height, 4, &src);
+
+    ViewerTextureConversionArgs args;
+    args.colorSpaceTable = sRGB->getUint8xxTable();
+
+    if ( !isTestedSimdLevelSupported() ) {
+        return;
+    }
+    TimeLapse timer;
+    if (getTestedSimdLevel() == eSimdLevelNone) {
+        for (int f = 0; f < nFrames; ++f) {
+            convertToTexture8bitsPerPixel(args, sRGB, &src[0], width, height, &dst[0]);
+        }
+        recordThroughput( "perPixel", (double)width * height * nFrames, timer.getTimeElapsedReset() );
+    }
+    for (int f = 0; f < nFrames; ++f) {
+        ViewerTextureConversion::convertToTexture8bits(args, &src[0], width * 4, width, height, &dst[0], width);
+    }
+    recordThroughput( "kernels", (double)width * height * nFrames, timer.getTimeElapsedReset() );
+}
+
+NATRON_INSTANTIATE_SIMD_LEVEL_TESTS(ViewerTextureConversionTest, eSimdLevelAVX2);
+
+///The per-pixel reduction of the auto-contrast of the viewer (findAutoContrastVminVmax_generic)
+static void
+findChannelsMinMaxPerPixel(const float* src,
+                           int rowElements,
+                           int width,
+                           int height,
+                           int nComps,
+                           DisplayChannelsEnum channels,
+                           ImageMinMaxResult* result)
+{
+    for (int y = 0; y < height; ++y) {
+        const float* pix = src + y * rowElements;
+        for (int x = 0; x < width; ++x, pix += nComps) {
+            float r = 0.f, g = 0.f, b = 0.f, a = 0.f;
+            switch (nComps) {
+            case 4:
+                r = pix[0]; g = pix[1]; b = pix[2]; a = pix[3];
+                break;
+            case 3:
+                r = pix[0]; g = pix[1]; b = pix[2]; a = 1.f;
+                break;
+            case 2:
+                r = pix[0]; g = pix[1]; a = 1.f;
+                break;
+            case 1:
+                a = pix[0];
+                break;
+            }
+            float values[3];
+            int nValues = 1;
+            switch (channels) {
+            case eDisplayChannelsRGB:
+                values[0] = r;
+                values[1] = g;
+                values[2] = b;
+                nValues = 3;
+                break;
+            case eDisplayChannelsY:
+                values[0] = 0.299f * r + 0.587f * g + 0.114f * b;
+                break;
+            case eDisplayChannelsR:
+                values[0] = r;
+                break;
+            case eDisplayChannelsG:
+                values[0] = g;
+                break;
+            case eDisplayChannelsB:
+                values[0] = b;
+                break;
+            case eDisplayChannelsA:
+                values[0] = a;
+                break;
+            default:
+                values[0] = 0.f;
+                break;
+            }
+            for (int i = 0; i < nValues; ++i) {
+                if (values[i] != values[i]) {
+                    result->hasNaN = true;
+                } else {
+                    result->vmin = std::min(result->vmin, values[i]);
+                    result->vmax = std::max(result->vmax, values[i]);
+                }
+            }
+        }
+    }
+}
+
+class ImageMinMaxTest
+    : public SimdLevelTest
+{
+};
+
+TEST_P(ImageMinMaxTest,SameAsPerPixel) {
+    const int width = 67; // not a multiple of the vector sizes
+    const int height = 5;
+
+    for (int nComps = 1; nComps <= 4; ++nComps) {
+        // rows larger than the reduced ones, as when reducing a part of an image
+        const int rowElements = (width + 3) * nComps;
+        std::vector<float> src;
+        makeTestImage(width + 3, height, nComps, &src);
+        for (int withNaN = 0; withNaN < 2; ++withNaN) {
+            if (withNaN) {
+                src[rowElements * 2 + 5 * nComps + nComps - 1] = std::numeric_limits<float>::quiet_NaN();
+            }
+            for (int channels = eDisplayChannelsRGB; channels <= eDisplayChannelsMatte; ++channels) {
+                ImageMinMaxResult expected, result;
+                findChannelsMinMaxPerPixel(&src[0], rowElements, width, height, nComps, (DisplayChannelsEnum)channels, &expected);
+                ImageMinMax::findChannelsMinMax(&src[0], rowElements, width, height, nComps, (DisplayChannelsEnum)channels, &result);
+                EXPECT_NEAR(expected.vmin, result.vmin, 1e-6) << nComps << " components, channels " << channels;
+                EXPECT_NEAR(expected.vmax, result.vmax, 1e-6) << nComps << " components, channels " << channels;
+                EXPECT_EQ(expected.hasNaN, result.hasNaN) << nComps << " components, channels " << channels;
+            }
+
+            ImageMinMaxResult expected, components;
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width * nComps; ++x) {
+                    float v = src[y * rowElements + x];
+                    if (v == v) {
+                        expected.vmin = std::min(expected.vmin, v);
+                        expected.vmax = std::max(expected.vmax, v);
+                    }
+                }
+            }
+            ImageMinMax::findComponentsMinMax(&src[0], rowElements, width * nComps, height, &components);
+            EXPECT_EQ(withNaN != 0, components.hasNaN);
+            EXPECT_EQ(expected.vmin, components.vmin);
+            EXPECT_EQ(expected.vmax, components.vmax);
+        }
+    }
+}
+
+TEST_P(ImageMinMaxTest,DISABLED_Benchmark) {
+    // The auto-contrast of an HD float RGBA frame displayed as RGB
+    const int width = 1920;
+    const int height = 1080;
+    const int nFrames = 10;
+    std::vector<float> src;
+
+    makeTestImage(width, height, 4, &src);
+
+    if ( !isTestedSimdLevelSupported() ) {
+        return;
+    }
+    TimeLapse timer;
+    ImageMinMaxResult result;
+    if (getTestedSimdLevel() == eSimdLevelNone) {
+        for (int f = 0; f < nFrames; ++f) {
+            findChannelsMinMaxPerPixel(&src[0], width * 4, width, height, 4, eDisplayChannelsRGB, &result);
+        }
+        recordThroughput( "perPixel", (double)width * height * nFrames, timer.getTimeElapsedReset() );
+    }
+    for (int f = 0; f < nFrames; ++f) {
+        ImageMinMax::findChannelsMinMax(&src[0], width * 4, width, height, 4, eDisplayChannelsRGB, &result);
+    }
+    recordThroughput( "kernels", (double)width * height * nFrames, timer.getTimeElapsedReset() );
+}
+
+NATRON_INSTANTIATE_SIMD_LEVEL_TESTS(ImageMinMaxTest, eSimdLevelAVX2);
+
+class HistogramKernelsTest
+    : public SimdLevelTest
+{
+};
+
+TEST_P(HistogramKernelsTest,SameAsScalar) {
+    const int width = 67;
+    const float inf = std::numeric_limits<float>::infinity();
+    // values on and next to the bounds of the range and the bins, out of the range, and NaNs in every component
+    const float specials[] = {
+        0.f, -0.f, 1.f, 0.5f, 1.f / 256, 0.99999994f, 0.75f, 0.24999999f, -1e-38f, -0.25f, -1.f, 1.5f,
+        2.f, 1e30f, -1e30f, inf, -inf, std::numeric_limits<float>::quiet_NaN()
+    };
+    const int nSpecials = (int)( sizeof(specials) / sizeof(specials[0]) );
+    std::vector<float> row(width * 4);
+
+    srand(5000);
+    for (int i = 0; i < width * 4; ++i) {
+        // coverity[dont_call]
+        row[i] = (i % 3 == 0) ? specials[(i / 3) % nSpecials] : (rand() % 10000) / 5000.f - 0.5f;
+    }
+
+    // the channels of each display mode of the histogram: RGB, A, Y, R, G, B
+    const HistogramChannelEnum modes[6][3] = {
+        { eHistogramChannelR, eHistogramChannelG, eHistogramChannelB },
+        { eHistogramChannelA }, { eHistogramChannelY }, { eHistogramChannelR }, { eHistogramChannelG }, { eHistogramChannelB }
+    };
+    const int modeChannels[6] = { 3, 1, 1, 1, 1, 1 };
+    const float ranges[3][2] = { { 0.f, 1.f }, { -1.f, 2.f }, { 0.25f, 0.75f } };
+
+    for (int m = 0; m < 6; ++m) {
+        for (int r = 0; r < 3; ++r) {
+            for (int nBins = 1; nBins <= 256; nBins *= 16) {
+                HistogramPass pass;
+                pass.pixels = &row[0];
+                pass.rowElements = width * 4;
+                pass.nComps = 4;
+                pass.width = width;
+                pass.height = 1;
+                pass.nBins = nBins;
+                pass.vmin = ranges[r][0];
+                pass.vmax = ranges[r][1];
+                pass.scale = nBins / (pass.vmax - pass.vmin);
+                pass.nChannels = modeChannels[m];
+                for (int c = 0; c < pass.nChannels; ++c) {
+                    pass.channels[c] = modes[m][c];
+                }
+                pass.nChunks = 1;
+
+                std::vector<U32> expected(pass.nChannels * (nBins + 1), 0);
+                std::vector<U32> result(pass.nChannels * (nBins + 1), 0);
+                HistogramKernels::binRowScalar(pass, &row[0], &expected[0]);
+                HistogramKernels::binRow(pass, &row[0], &result[0]);
+                for (std::size_t i = 0; i < expected.size(); ++i) {
+                    EXPECT_EQ(expected[i], result[i]) << "mode " << m << ", range " << pass.vmin << " " << pass.vmax
+                                                      << ", " << nBins << " bins, channel " << i / (nBins + 1)
+                                                      << ", bin " << i % (nBins + 1);
+                }
+                // every pixel is counted once per channel, the out of range values and NaNs in the last bin
+                for (int c = 0; c < pass.nChannels; ++c) {
+                    U32 total = 0;
+                    for (int b = 0; b <= nBins; ++b) {
+                        total += result[c * (nBins + 1) + b];
+                    }
+                    EXPECT_EQ( (U32)width, total );
+                    EXPECT_GT( result[c * (nBins + 1) + nBins], (U32)0 );
+                }
+            }
+        }
+    }
+}
+
+NATRON_INSTANTIATE_SIMD_LEVEL_TESTS(HistogramKernelsTest, eSimdLevelSSE41);
+
+///The per-pixel halving of the former Image::halveRoIForDepth, from src covering srcBounds to dst covering dstBounds
+template <typename PIX>
+static void
+halveRoIPerPixel(int nComps,
+                 const std::vector<PIX> & src,
+                 const RectI & srcBounds,
+                 const RectI & roi,
+                 std::vector<PIX>* dst,
+                 const RectI & dstBounds)
+{
+    RectI srcRoI;
+    roi.intersect(srcBounds, &srcRoI);
+    RectI dstRoI = srcRoI.downscalePowerOfTwoSmallestEnclosing(1);
+    int srcRowSize = srcBounds.width() * nComps;
+    int dstRowSize = dstBounds.width() * nComps;
+
+    for (int y = dstRoI.y1; y < dstRoI.y2; ++y) {
+        int srcy = y * 2;
+        bool pickThisRow = srcBounds.y1 <= srcy && srcy < srcBounds.y2;
+        bool pickNextRow = srcBounds.y1 <= (srcy + 1) && (srcy + 1) < srcBounds.y2;
+        for (int x = dstRoI.x1; x < dstRoI.x2; ++x) {
+            int srcx = x * 2;
+            bool pickThisCol = srcBounds.x1 <= srcx && srcx < srcBounds.x2;
+            bool pickNextCol = srcBounds.x1 <= (srcx + 1) && (srcx + 1) < srcBounds.x2;
+            const int sum = ( (int)pickThisCol + (int)pickNextCol ) * ( (int)pickThisRow + (int)pickNextRow );
+            const PIX* srcPix = &src[0] + (srcy - srcBounds.y1) * srcRowSize + (srcx - srcBounds.x1) * nComps;
+            PIX* dstPix = &(*dst)[0] + (y - dstBounds.y1) * dstRowSize + (x - dstBounds.x1) * nComps;
+            for (int k = 0; k < nComps; ++k) {
+                const PIX a = (pickThisCol && pickThisRow) ? srcPix[k] : 0;
+                const PIX b = (pickNextCol && pickThisRow) ? srcPix[k + nComps] : 0;
+                const PIX c = (pickThisCol && pickNextRow) ? srcPix[k + srcRowSize] : 0;
+                const PIX d = (pickNextCol && pickNextRow) ? srcPix[k + srcRowSize + nComps] : 0;
+                dstPix[k] = (a + b + c + d) / sum;
+            }
+        }
+    }
+}
+
+///Builds the mipmap level the former way: halving the whole image once per level
+template <typename PIX>
+static void
+buildMipMapLevelPerPixel(int nComps,
+                         const std::vector<PIX> & src,
+                         const RectI & srcBounds,
+                         const RectI & roi,
+                         unsigned int levels,
+                         std::vector<PIX>* dst,
+                         RectI* dstBounds)
+{
+    *dst = src;
+    *dstBounds = srcBounds;
+    RectI levelRoI = roi;
+    for (unsigned int i = 1; i <= levels; ++i) {
+        RectI halvedRoI = levelRoI.downscalePowerOfTwoSmallestEnclosing(1);
+        std::vector<PIX> halved(halvedRoI.width() * halvedRoI.height() * nComps);
+        halveRoIPerPixel<PIX>(nComps, *dst, *dstBounds, levelRoI, &halved, halvedRoI);
+        dst->swap(halved);
+        *dstBounds = halvedRoI;
+        levelRoI = halvedRoI;
+    }
+}
+
+template <typename PIX>
+static PIX
+makeMipMapTestValue()
+{
+    // coverity[dont_call]
+    return (PIX)(rand() % 256);
+}
+
+template <>
+unsigned short
+makeMipMapTestValue<unsigned short>()
+{
+    // coverity[dont_call]
+    return (unsigned short)(rand() % 65536);
+}
+
+template <>
+float
+makeMipMapTestValue<float>()
+{
+    // coverity[dont_call]
+    return (rand() % 10000) / 777.f - 2.f;
+}
+
+template <typename PIX>
+static void
+checkMipMapKernels()
+{
+    srand(4000);
+    for (int nComps = 1; nComps <= 4; ++nComps) {
+        for (int i = 0; i < 20; ++i) {
+            // odd and negative coordinates, a roi smaller than the bounds
+            // coverity[dont_call]
+            RectI srcBounds(-7 + rand() % 5, -5 + rand() % 5, 30 + rand() % 40, 20 + rand() % 30);
+            // coverity[dont_call]
+            RectI roi(srcBounds.x1 + rand() % 4, srcBounds.y1 + rand() % 4, srcBounds.x2 - rand() % 4, srcBounds.y2 - rand() % 4);
+            // coverity[dont_call]
+            unsigned int levels = 1 + rand() % 4;
+            std::vector<PIX> src(srcBounds.width() * srcBounds.height() * nComps);
+            for (std::size_t j = 0; j < src.size(); ++j) {
+                src[j] = makeMipMapTestValue<PIX>();
+            }
+
+            std::vector<PIX> expected;
+            RectI expectedBounds;
+            buildMipMapLevelPerPixel<PIX>(nComps, src, srcBounds, roi, levels, &expected, &expectedBounds);
+
+            // an output larger than the last level
+            RectI dstBounds(expectedBounds.x1 - 1, expectedBounds.y1 - 2, expectedBounds.x2 + 3, expectedBounds.y2 + 1);
+            std::vector<PIX> result(dstBounds.width() * dstBounds.height() * nComps);
+            MipMapKernels::buildMipMapLevel<PIX>(nComps, &src[0], srcBounds.width() * nComps, srcBounds, roi, levels,
+                                                 &result[0], dstBounds.width() * nComps, dstBounds);
+
+            bool same = true;
+            for (int y = expectedBounds.y1; y < expectedBounds.y2 && same; ++y) {
+                const PIX* expectedRow = &expected[0] + (y - expectedBounds.y1) * expectedBounds.width() * nComps;
+                const PIX* resultRow = &result[0] + ( (y - dstBounds.y1) * dstBounds.width() + expectedBounds.x1 - dstBounds.x1 ) * nComps;
+                same = std::equal(expectedRow, expectedRow + expectedBounds.width() * nComps, resultRow);
+            }
+            EXPECT_TRUE(same) << sizeof(PIX) << " bytes per component, " << nComps << " components, " << levels << " levels";
+
+            // upscale a row of the source, starting and ending in the middle of the replicated pixels
+            // coverity[dont_call]
+            int scale = 1 << (1 + rand() % 3);
+            int dstX1 = roi.x1 * scale + 1;
+            int dstX2 = roi.x2 * scale - 1;
+            std::vector<PIX> upscaled( (dstX2 - dstX1) * nComps );
+            const PIX* srcRow = &src[0] + ( (roi.y1 - srcBounds.y1) * srcBounds.width() + roi.x1 - srcBounds.x1 ) * nComps;
+            MipMapKernels::upscaleRow<PIX>(nComps, srcRow, roi.x1, &upscaled[0], dstX1, dstX2, scale);
+            same = true;
+            for (int x = dstX1; x < dstX2 && same; ++x) {
+                const PIX* srcPix = srcRow + ( (int)std::floor( (double)x / scale ) - roi.x1 ) * nComps;
+                same = std::equal(srcPix, srcPix + nComps, &upscaled[0] + (x - dstX1) * nComps);
+            }
+            EXPECT_TRUE(same) << "upscale by " << scale << ", " << nComps << " components";
+        }
+    }
+}
+
+class MipMapKernelsTest
+    : public SimdLevelTest
+{
+};
+
+TEST_P(MipMapKernelsTest,SameAsPerPixel) {
+    checkMipMapKernels<unsigned char>();
+    checkMipMapKernels<unsigned short>();
+    checkMipMapKernels<float>();
+}
+
+TEST_P(MipMapKernelsTest,DISABLED_Benchmark) {
+    // The proxy level 3 of an HD float RGBA frame
+    const int width = 1920;
+    const int height = 1080;
+    const int nFrames = 5;
+    const unsigned int levels = 3;
+    const RectI bounds(0, 0, width, height);
+    const RectI last = bounds.downscalePowerOfTwoSmallestEnclosing(levels);
+    std::vector<float> src;
+    std::vector<float> dst(last.width() * last.height() * 4);
+
+    makeTestImage(width, height, 4, &src);
+
+    if ( !isTestedSimdLevelSupported() ) {
+        return;
+    }
+    TimeLapse timer;
+    if (getTestedSimdLevel() == eSimdLevelNone) {
+        // level by level
+        for (int f = 0; f < nFrames; ++f) {
+            RectI dstBounds;
+            buildMipMapLevelPerPixel<float>(4, src, bounds, bounds, levels, &dst, &dstBounds);
+        }
+        recordThroughput( "perPixel", (double)width * height * nFrames, timer.getTimeElapsedReset() );
+    }
+    // single pass
+    for (int f = 0; f < nFrames; ++f) {
+        MipMapKernels::buildMipMapLevel<float>(4, &src[0], width * 4, bounds, bounds, levels, &dst[0], last.width() * 4, last);
+    }
+    recordThroughput( "kernels", (double)width * height * nFrames, timer.getTimeElapsedReset() );
+}
+
+NATRON_INSTANTIATE_SIMD_LEVEL_TESTS(MipMapKernelsTest, eSimdLevelSSE41);
+
+static float
+lutToLinear(const Color::Lut* lut,
+            unsigned char v)
+{
+    return lut->fromColorSpaceUint8ToLinearFloatFast(v);
+}
+
+static float
+lutToLinear(const Color::Lut* lut,
+            unsigned short v)
+{
+    return lut->fromColorSpaceUint16ToLinearFloatFast(v);
+}
+
+static float
+lutToLinear(const Color::Lut* lut,
+            float v)
+{
+    return lut->fromColorSpaceFloatToLinearFloat(v);
+}
+
+template <typename PIX>
+static PIX
+makeConversionTestValue()
+{
+    return makeMipMapTestValue<PIX>();
+}
+
+template <>
+float
+makeConversionTestValue<float>()
+{
+    // coverity[dont_call]
+    int r = rand() % 1000;
+
+    // values out of [0,1] and exactly 0 or 1 as well
+    return (r < 50) ? 0.f : (r < 100) ? 1.f : (r - 200) / 600.f;
+}
+
+///The per-pixel conversion of the former Image::convertToFormatInternal_sameComps and convertToFormatInternalForColorSpace
+template <typename SRCPIX, typename DSTPIX>
+static void
+convertRowsPerPixel(const PixelConversionArgs & args,
+                    const SRCPIX* src,
+                    int width,
+                    int height,
+                    DSTPIX* dst)
+{
+    const int srcN = args.srcNComps;
+    const int dstN = args.dstNComps;
+    const bool throughLinear = (srcN == 1) == (dstN == 1) && ( (srcN != dstN) || args.srcLut || args.dstLut || args.unpremult );
+    int channelForAlpha = (args.channelForAlpha == -1 && srcN == 4) ? 3 : args.channelForAlpha;
+
+    if (channelForAlpha >= srcN) {
+        channelForAlpha = -1;
+    }
+    for (int y = 0; y < height; ++y, src += width * srcN, dst += width * dstN) {
+        // coverity[dont_call]
+        int start = rand() % width;
+        for (int backward = 0; backward < 2; ++backward) {
+            unsigned error[3] = {
+                0x80, 0x80, 0x80
+            };
+            for (int x = backward ? start - 1 : start; x < width && x >= 0; x += backward ? -1 : 1) {
+                const SRCPIX* s = src + x * srcN;
+                DSTPIX* d = dst + x * dstN;
+                for (int k = 0; k < dstN; ++k) {
+                    if (!throughLinear) {
+                        if (srcN == 1) {
+                            d[k] = Image::convertPixelDepth<SRCPIX, DSTPIX>(s[0]);
+                        } else if (dstN == 1) {
+                            d[k] = channelForAlpha == -1 ? 0 : Image::convertPixelDepth<SRCPIX, DSTPIX>(s[channelForAlpha]);
+                        } else {
+                            d[k] = Image::convertPixelDepth<SRCPIX, DSTPIX>(s[k]);
+                        }
+                    } else if (k == 3) {
+                        d[k] = srcN == 4 ? Image::convertPixelDepth<SRCPIX, DSTPIX>(s[3]) : Image::convertPixelDepth<float, DSTPIX>(args.useAlpha0 ? 0.f : 1.f);
+                    } else {
+                        const SRCPIX sourcePixel = k < srcN ? s[k] : 0;
+                        float v;
+                        if (args.unpremult) {
+                            float alpha = Image::convertPixelDepth<SRCPIX, float>(s[3]);
+                            v = Image::convertPixelDepth<SRCPIX, float>(sourcePixel);
+                            v = alpha == 0.f ? 0.f : v / alpha;
+                            if (args.srcLut) {
+                                v = args.srcLut->fromColorSpaceFloatToLinearFloat(v);
+                            }
+                        } else {
+                            v = args.srcLut ? lutToLinear(args.srcLut, sourcePixel) : Image::convertPixelDepth<SRCPIX, float>(sourcePixel);
+                        }
+                        if (sizeof(DSTPIX) == 1) {
+                            error[k] = (error[k] & 0xff) + ( args.dstLut ? args.dstLut->toColorSpaceUint8xxFromLinearFloatFast(v) : Color::floatToInt<0xff01>(v) );
+                            d[k] = (DSTPIX)(error[k] >> 8);
+                        } else if (sizeof(DSTPIX) == 2) {
+                            d[k] = args.dstLut ? (DSTPIX)args.dstLut->toColorSpaceUint16FromLinearFloatFast(v) : Image::convertPixelDepth<float, DSTPIX>(v);
+                        } else {
+                            d[k] = args.dstLut ? (DSTPIX)args.dstLut->toColorSpaceFloatFromLinearFloat(v) : (DSTPIX)v;
+                        }
+                    }
+                }
+            }
+        }
+    }
+} // convertRowsPerPixel
+
+template <typename SRCPIX, typename DSTPIX>
+static void
+checkPixelConversion(const Color::Lut* luts[3])
+{
+    PixelConversionArgs args;
+    args.srcDepth = sizeof(SRCPIX) == 1 ? eImageBitDepthByte : sizeof(SRCPIX) == 2 ? eImageBitDepthShort : eImageBitDepthFloat;
+    args.dstDepth = sizeof(DSTPIX) == 1 ? eImageBitDepthByte : sizeof(DSTPIX) == 2 ? eImageBitDepthShort : eImageBitDepthFloat;
+
+    srand(5000);
+    for (int i = 0; i < 200; ++i) {
+        // coverity[dont_call]
+        args.srcNComps = 1 + rand() % 4;
+        // coverity[dont_call]
+        args.dstNComps = 1 + rand() % 4;
+        // coverity[dont_call]
+        args.srcLut = luts[rand() % 3];
+        // coverity[dont_call]
+        args.dstLut = luts[rand() % 3];
+        // coverity[dont_call]
+        args.unpremult = args.srcNComps == 4 && args.dstNComps == 3 && (rand() % 2);
+        // coverity[dont_call]
+        args.channelForAlpha = -1 + rand() % 5;
+        // coverity[dont_call]
+        args.useAlpha0 = rand() % 2;
+        // coverity[dont_call]
+        const int width = 1 + rand() % 40;
+        const int height = 3;
+        std::vector<SRCPIX> src(width * height * args.srcNComps);
+        for (std::size_t j = 0; j < src.size(); ++j) {
+            src[j] = makeConversionTestValue<SRCPIX>();
+        }
+        std::vector<DSTPIX> expected(width * height * args.dstNComps);
+        std::vector<DSTPIX> result( expected.size() );
+        // the same random starts for the error diffusion
+        // coverity[dont_call]
+        unsigned int seed = rand();
+        srand(seed);
+        convertRowsPerPixel(args, &src[0], width, height, &expected[0]);
+        srand(seed);
+        PixelConversion::convertRows(args, &src[0], width * args.srcNComps, width, height, &result[0], width * args.dstNComps);
+        EXPECT_TRUE( std::equal( expected.begin(), expected.end(), result.begin() ) )
+            << sizeof(SRCPIX) << " to " << sizeof(DSTPIX) << " bytes per component, "
+            << args.srcNComps << " to " << args.dstNComps << " components";
+    }
+}
+
+class PixelConversionTest
+    : public SimdLevelTest
+{
+};
+
+TEST_P(PixelConversionTest,SameAsPerPixel) {
+    const Color::Lut* luts[3] = { 0, Color::LutManager::sRGBLut(), Color::LutManager::Rec709Lut() };
+
+    luts[1]->validate();
+    luts[2]->validate();
+    checkPixelConversion<unsigned char, unsigned char>(luts);
+    checkPixelConversion<unsigned char, unsigned short>(luts);
+    checkPixelConversion<unsigned char, float>(luts);
+    checkPixelConversion<unsigned short, unsigned char>(luts);
+    checkPixelConversion<unsigned short, unsigned short>(luts);
+    checkPixelConversion<unsigned short, float>(luts);
+    checkPixelConversion<float, unsigned char>(luts);
+    checkPixelConversion<float, unsigned short>(luts);
+    checkPixelConversion<float, float>(luts);
+}
+
+TEST_P(PixelConversionTest,DISABLED_Benchmark) {
+    // An HD RGBA frame: a float image converted to an sRGB byte image and back, and to a short image
+    const int width = 1920;
+    const int height = 1080;
+    const int nFrames = 5;
+    const Color::Lut* sRGB = Color::LutManager::sRGBLut();
+    std::vector<float> floatImage;
+    std::vector<unsigned char> byteImage(width * height * 4);
+    std::vector<unsigned short> shortImage(width * height * 4);
+
+    sRGB->validate();
+    makeTestImage(width, height, 4, &floatImage);
+
+    PixelConversionArgs toByte;
+    toByte.dstDepth = eImageBitDepthByte;
+    toByte.dstLut = sRGB;
+    PixelConversionArgs fromByte;
+    fromByte.srcDepth = eImageBitDepthByte;
+    fromByte.srcLut = sRGB;
+    PixelConversionArgs toShort;
+    toShort.dstDepth = eImageBitDepthShort;
+
+    if ( !isTestedSimdLevelSupported() ) {
+        return;
+    }
+    TimeLapse timer;
+    if (getTestedSimdLevel() == eSimdLevelNone) {
+        for (int f = 0; f < nFrames; ++f) {
+            convertRowsPerPixel(toByte, &floatImage[0], width, height, &byteImage[0]);
+            convertRowsPerPixel(fromByte, &byteImage[0], width, height, &floatImage[0]);
+            convertRowsPerPixel(toShort, &floatImage[0], width, height, &shortImage[0]);
+        }
+        recordThroughput( "perPixel", (double)width * height * nFrames * 3, timer.getTimeElapsedReset() );
+    }
+    for (int f = 0; f < nFrames; ++f) {
+        PixelConversion::convertRows(toByte, &floatImage[0], width * 4, width, height, &byteImage[0], width * 4);
+        PixelConversion::convertRows(fromByte, &byteImage[0], width * 4, width, height, &floatImage[0], width * 4);
+        PixelConversion::convertRows(toShort, &floatImage[0], width * 4, width, height, &shortImage[0], width * 4);
+    }
+    recordThroughput( "kernels", (double)width * height * nFrames * 3, timer.getTimeElapsedReset() );
+}
+
+NATRON_INSTANTIATE_SIMD_LEVEL_TESTS(PixelConversionTest, eSimdLevelAVX2);
+
+template <typename PIX>
+static const PIX*
+testPixelAt(const std::vector<PIX> & pixels,
+            const RectI & bounds,
+            int nComps,
+            int x,
+            int y)
+{
+    if ( pixels.empty() || !bounds.contains(x, y) ) {
+        return 0;
+    }
+
+    return &pixels[0] + ( (y - bounds.y1) * bounds.width() + x - bounds.x1 ) * nComps;
+}
+
+///The former Image::copyUnProcessedChannels followed by Image::applyMaskMix, pixel by pixel
+template <typename PIX, int maxValue>
+static void
+postRenderPerPixel(const PostRenderArgs & args,
+                   const RectI & roi,
+                   std::vector<PIX>* dst,
+                   const RectI & dstBounds,
+                   const std::vector<PIX> & src,
+                   const RectI & srcBounds,
+                   const std::vector<PIX> & mask,
+                   const RectI & maskBounds)
+{
+    const int dstN = args.dstNComps;
+    const int srcN = args.srcNComps;
+
+    if (args.copyChannels) {
+        const bool doR = !args.processChannels[0] && (dstN >= 2);
+        const bool doG = !args.processChannels[1] && (dstN >= 2);
+        const bool doB = !args.processChannels[2] && (dstN >= 3);
+        const bool doA = !args.processChannels[3] && (dstN == 1 || dstN == 4);
+        for (int y = roi.y1; y < roi.y2; ++y) {
+            for (int x = roi.x1; x < roi.x2; ++x) {
+                PIX* d = const_cast<PIX*>( testPixelAt(*dst, dstBounds, dstN, x, y) );
+                const PIX* s = testPixelAt(src, srcBounds, srcN, x, y);
+                PIX srcA = s ? maxValue : 0;
+                if ( (srcN == 1 || srcN == 4) && s ) {
+                    srcA = s[srcN - 1];
+                }
+                const bool doChannel[3] = { doR, doG, doB };
+                for (int c = 0; c < 3; ++c) {
+                    if (doChannel[c]) {
+                        d[c] = (!s || c >= srcN) ? 0 : s[c];
+                    }
+                }
+                if (doA) {
+                    d[dstN - 1] = srcA;
+                }
+            }
+        }
+    }
+    if ( !args.maskMix || (srcN == 0) ) {
+        return;
+    }
+    for (int y = roi.y1; y < roi.y2; ++y) {
+        for (int x = roi.x1; x < roi.x2; ++x) {
+            PIX* d = const_cast<PIX*>( testPixelAt(*dst, dstBounds, dstN, x, y) );
+            const PIX* s = testPixelAt(src, srcBounds, srcN, x, y);
+            float alpha = args.mix;
+            if (args.masked) {
+                const PIX* m = testPixelAt(mask, maskBounds, 1, x, y);
+                float maskScale;
+                if (!m) {
+                    maskScale = args.maskInvert ? 1.f : 0.f;
+                } else {
+                    maskScale = *m / float(maxValue);
+                    if (args.maskInvert) {
+                        maskScale = 1.f - maskScale;
+                    }
+                }
+                alpha = args.mix * maskScale;
+            }
+            for (int c = 0; c < dstN; ++c) {
+                if (s) {
+                    if (c < srcN) {
+                        d[c] = Image::clampIfInt<PIX>( float(d[c]) * alpha + (1.f - alpha) * float(s[c]) );
+                    }
+                } else {
+                    d[c] = Image::clampIfInt<PIX>( float(d[c]) * alpha );
+                }
+            }
+        }
+    }
+} // postRenderPerPixel
+
+static RectI
+makePostRenderTestBounds(const RectI & roi)
+{
+    // coverity[dont_call]
+    int x1 = roi.x1 - 3 + rand() % 8;
+    // coverity[dont_call]
+    int y1 = roi.y1 - 2 + rand() % 4;
+    // coverity[dont_call]
+    int x2 = roi.x2 - 4 + rand() % 8;
+    // coverity[dont_call]
+    int y2 = roi.y2 - 1 + rand() % 4;
+
+    return RectI( x1, y1, std::max(x1, x2), std::max(y1, y2) );
+}
+
+template <typename PIX, int maxValue>
+static void
+checkPostRenderKernels()
+{
+    PostRenderArgs args;
+    args.depth = sizeof(PIX) == 1 ? eImageBitDepthByte : sizeof(PIX) == 2 ? eImageBitDepthShort : eImageBitDepthFloat;
+
+    srand(6000);
+    for (int i = 0; i < 300; ++i) {
+        // coverity[dont_call]
+        args.dstNComps = 1 + rand() % 4;
+        // coverity[dont_call]
+        args.srcNComps = (rand() % 3) ? args.dstNComps : rand() % 5;
+        // coverity[dont_call]
+        args.processChannels = std::bitset<4>(rand() % 16);
+        // coverity[dont_call]
+        args.copyChannels = rand() % 3;
+        // coverity[dont_call]
+        args.maskMix = !args.copyChannels || (rand() % 2);
+        // coverity[dont_call]
+        args.masked = rand() % 3;
+        // coverity[dont_call]
+        args.maskInvert = rand() % 2;
+        // coverity[dont_call]
+        args.mix = (rand() % 2) ? 1.f : (rand() % 100) / 99.f;
+
+        // the original image and the mask cover parts of the roi only
+        // coverity[dont_call]
+        RectI roi(-5 + rand() % 5, -3 + rand() % 5, 10 + rand() % 40, 2 + rand() % 10);
+        RectI dstBounds(roi.x1 - rand() % 3, roi.y1 - rand() % 3, roi.x2 + rand() % 3, roi.y2 + rand() % 3);
+        RectI srcBounds = makePostRenderTestBounds(roi);
+        RectI maskBounds = makePostRenderTestBounds(roi);
+        std::vector<PIX> dst(dstBounds.area() * args.dstNComps);
+        std::vector<PIX> src(srcBounds.area() * args.srcNComps);
+        // coverity[dont_call]
+        std::vector<PIX> mask( (rand() % 4) ? maskBounds.area() : 0 );
+        for (std::size_t j = 0; j < dst.size(); ++j) {
+            dst[j] = makeMipMapTestValue<PIX>();
+        }
+        for (std::size_t j = 0; j < src.size(); ++j) {
+            src[j] = makeMipMapTestValue<PIX>();
+        }
+        for (std::size_t j = 0; j < mask.size(); ++j) {
+            mask[j] = makeMipMapTestValue<PIX>();
+        }
+
+        std::vector<PIX> expected = dst;
+        postRenderPerPixel<PIX, maxValue>(args, roi, &expected, dstBounds, src, srcBounds, mask, maskBounds);
+        PostRenderKernels::processRows(args, roi, &dst[0], dstBounds, src.empty() ? 0 : &src[0], srcBounds,
+                                       mask.empty() ? 0 : &mask[0], maskBounds);
+
+        bool same = true;
+        for (std::size_t j = 0; j < dst.size() && same; ++j) {
+            same = dst[j] == expected[j];
+        }
+        EXPECT_TRUE(same) << sizeof(PIX) << " bytes per component, " << args.srcNComps
+                          << " to " << args.dstNComps << " components, channels " << args.processChannels.to_ulong()
+                          << ", copy " << args.copyChannels << ", mix " << args.maskMix << ", masked " << args.masked;
+    }
+}
+
+class PostRenderKernelsTest
+    : public SimdLevelTest
+{
+};
+
+TEST_P(PostRenderKernelsTest,SameAsPerPixel) {
+    checkPostRenderKernels<unsigned char, 255>();
+    checkPostRenderKernels<unsigned short, 65535>();
+    checkPostRenderKernels<float, 1>();
+}
+
+TEST_P(PostRenderKernelsTest,DISABLED_Benchmark) {
+    // An HD float RGBA frame rendered with the alpha unchecked, masked and mixed with the original image
+    const int width = 1920;
+    const int height = 1080;
+    const int nFrames = 10;
+    const RectI bounds(0, 0, width, height);
+    std::vector<float> src;
+    std::vector<float> mask;
+    std::vector<float> dst(width * height * 4);
+
+    makeTestImage(width, height, 4, &src);
+    makeTestImage(width, height, 1, &mask);
+
+    PostRenderArgs args;
+    args.copyChannels = true;
+    args.processChannels = std::bitset<4>(7);
+    args.maskMix = true;
+    args.masked = true;
+    args.mix = 0.8f;
+
+    if ( !isTestedSimdLevelSupported() ) {
+        return;
+    }
+    TimeLapse timer;
+    if (getTestedSimdLevel() == eSimdLevelNone) {
+        // two passes: the render and the mask/mix with the original image
+        for (int f = 0; f < nFrames; ++f) {
+            postRenderPerPixel<float, 1>(args, bounds, &dst, bounds, src, bounds, mask, bounds);
+        }
+        recordThroughput( "perPixel", (double)width * height * nFrames, timer.getTimeElapsedReset() );
+    }
+    for (int f = 0; f < nFrames; ++f) {
+        PostRenderKernels::processRows(args, bounds, &dst[0], bounds, &src[0], bounds, &mask[0], bounds);
+    }
+    recordThroughput( "kernels", (double)width * height * nFrames, timer.getTimeElapsedReset() );
+}
+
+NATRON_INSTANTIATE_SIMD_LEVEL_TESTS(PostRenderKernelsTest, eSimdLevelAVX2);
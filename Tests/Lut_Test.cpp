@@ -23,8 +23,17 @@
 // ***** END PYTHON BLOCK *****
 
 #include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <vector>
 #include <gtest/gtest.h>
 #include "Engine/Lut.h"
+#include "Engine/RectI.h"
+#include "Engine/SimdSupport.h"
+#include "Engine/Timer.h"
+
+#include "SimdLevelTest.h"
 
 NATRON_NAMESPACE_USING
 using namespace NATRON_NAMESPACE::Color;
@@ -49,3 +58,409 @@ TEST(Lut,IntConversions) {
         EXPECT_EQ( i, uint8xxToChar( charToUint8xx(i) ) );
     }
 }
+
+static std::vector<const Lut*>
+getBuiltinLuts()
+{
+    std::vector<const Lut*> luts;
+
+    luts.push_back( LutManager::sRGBLut() );
+    luts.push_back( LutManager::Rec709Lut() );
+    luts.push_back( LutManager::CineonLut() );
+    luts.push_back( LutManager::Gamma1_8Lut() );
+    luts.push_back( LutManager::Gamma2_2Lut() );
+    luts.push_back( LutManager::PanaLogLut() );
+    luts.push_back( LutManager::ViperLogLut() );
+    luts.push_back( LutManager::RedLogLut() );
+    luts.push_back( LutManager::AlexaV3LogCLut() );
+    for (std::size_t i = 0; i < luts.size(); ++i) {
+        luts[i]->validate();
+    }
+
+    return luts;
+}
+
+static bool
+isFinite(float v)
+{
+    return std::fabs(v) <= std::numeric_limits<float>::max();
+}
+
+TEST(Lut,FloatInterpolation) {
+    // The interpolated tables follow the transfer functions, the error is larger next to the discontinuities of
+    // the piecewise functions (e.g: Rec709)
+    std::vector<const Lut*> luts = getBuiltinLuts();
+
+    for (std::size_t l = 0; l < luts.size(); ++l) {
+        for (int i = 0; i <= 10000; ++i) {
+            float v = i / 10000.f;
+            float to = luts[l]->toColorSpaceFloatFromLinearFloat(v);
+            if ( isFinite(to) ) {
+                EXPECT_NEAR( to, luts[l]->toColorSpaceFloatFromLinearFloatFast(v), 1e-3 * std::max( 1.f, std::fabs(to) ) )
+                    << luts[l]->getName() << " to " << v;
+            }
+            float from = luts[l]->fromColorSpaceFloatToLinearFloat(v);
+            if ( isFinite(from) ) {
+                EXPECT_NEAR( from, luts[l]->fromColorSpaceFloatToLinearFloatFast(v), 1e-3 * std::max( 1.f, std::fabs(from) ) )
+                    << luts[l]->getName() << " from " << v;
+            }
+        }
+    }
+}
+
+static void
+getTestPackingOffsets(PixelPackingEnum packing,
+                      int offsets[4])
+{
+    // r, g, b, a
+    offsets[0] = packing == ePixelPackingBGRA ? 2 : 0;
+    offsets[1] = 1;
+    offsets[2] = packing == ePixelPackingBGRA ? 0 : 2;
+    offsets[3] = packing == ePixelPackingRGB ? -1 : 3;
+}
+
+///The per-pixel conversion of the to_X_packed functions of an RGBA image, the output rows being flipped
+static void
+toPackedPerPixel(const Lut* lut,
+                 const float* from,
+                 int width,
+                 int height,
+                 PixelPackingEnum outputPacking,
+                 bool premult,
+                 unsigned char* to)
+{
+    int off[4];
+
+    getTestPackingOffsets(outputPacking, off);
+    const int outN = off[3] == -1 ? 3 : 4;
+    for (int y = 0; y < height; ++y) {
+        const float* src = from + y * width * 4;
+        unsigned char* dst = to + (height - 1 - y) * width * outN;
+        // coverity[dont_call]
+        int start = rand() % width;
+        for (int c = 0; c < 3; ++c) {
+            for (int backward = 0; backward < 2; ++backward) {
+                unsigned error = 0x80;
+                for (int x = backward ? start - 1 : start; x >= 0 && x < width; x += backward ? -1 : 1) {
+                    float a = premult ? src[x * 4 + 3] : 1.f;
+                    error = (error & 0xff) + lut->toColorSpaceUint8xxFromLinearFloatFast(src[x * 4 + c] * a);
+                    dst[x * outN + off[c]] = (unsigned char)(error >> 8);
+                }
+            }
+        }
+        if (outN == 4) {
+            for (int x = 0; x < width; ++x) {
+                dst[x * 4 + off[3]] = floatToInt<256>(premult ? src[x * 4 + 3] : 1.f);
+            }
+        }
+    }
+}
+
+static void
+toPackedPerPixel(const Lut* lut,
+                 const float* from,
+                 int width,
+                 int height,
+                 PixelPackingEnum outputPacking,
+                 bool premult,
+                 unsigned short* to)
+{
+    int off[4];
+
+    getTestPackingOffsets(outputPacking, off);
+    const int outN = off[3] == -1 ? 3 : 4;
+    for (int y = 0; y < height; ++y) {
+        const float* src = from + y * width * 4;
+        unsigned short* dst = to + (height - 1 - y) * width * outN;
+        for (int x = 0; x < width; ++x) {
+            float a = premult ? src[x * 4 + 3] : 1.f;
+            for (int c = 0; c < 3; ++c) {
+                dst[x * outN + off[c]] = floatToInt<65536>( lut->toColorSpaceFloatFromLinearFloatFast(src[x * 4 + c] * a) );
+            }
+            if (outN == 4) {
+                dst[x * 4 + off[3]] = floatToInt<65536>(a);
+            }
+        }
+    }
+}
+
+static void
+toPackedPerPixel(const Lut* lut,
+                 const float* from,
+                 int width,
+                 int height,
+                 PixelPackingEnum outputPacking,
+                 bool premult,
+                 float* to)
+{
+    int off[4];
+
+    getTestPackingOffsets(outputPacking, off);
+    const int outN = off[3] == -1 ? 3 : 4;
+    for (int y = 0; y < height; ++y) {
+        const float* src = from + y * width * 4;
+        float* dst = to + (height - 1 - y) * width * outN;
+        for (int x = 0; x < width; ++x) {
+            float a = premult ? src[x * 4 + 3] : 1.f;
+            for (int c = 0; c < 3; ++c) {
+                dst[x * outN + off[c]] = lut->toColorSpaceFloatFromLinearFloatFast(src[x * 4 + c] * a);
+            }
+            if (outN == 4) {
+                dst[x * 4 + off[3]] = a;
+            }
+        }
+    }
+}
+
+///The per-pixel conversion of the from_X_packed functions to an RGBA image, without premultiplication
+static void
+fromPackedPerPixel(const Lut* lut,
+                   const unsigned char* from,
+                   int width,
+                   int height,
+                   float* to)
+{
+    for (int i = 0; i < width * height; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            to[i * 4 + c] = lut->fromColorSpaceUint8ToLinearFloatFast(from[i * 4 + c]);
+        }
+        to[i * 4 + 3] = intToFloat<256>(from[i * 4 + 3]);
+    }
+}
+
+static void
+fromPackedPerPixel(const Lut* lut,
+                   const unsigned short* from,
+                   int width,
+                   int height,
+                   float* to)
+{
+    for (int i = 0; i < width * height; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            to[i * 4 + c] = lut->fromColorSpaceFloatToLinearFloatFast( intToFloat<65536>(from[i * 4 + c]) );
+        }
+        to[i * 4 + 3] = intToFloat<65536>(from[i * 4 + 3]);
+    }
+}
+
+static void
+fromPackedPerPixel(const Lut* lut,
+                   const float* from,
+                   int width,
+                   int height,
+                   float* to)
+{
+    for (int i = 0; i < width * height; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            to[i * 4 + c] = lut->fromColorSpaceFloatToLinearFloatFast(from[i * 4 + c]);
+        }
+        to[i * 4 + 3] = 1.f;
+    }
+}
+
+template <typename PIX>
+static PIX makeLutTestValue();
+
+template <>
+unsigned char
+makeLutTestValue<unsigned char>()
+{
+    // coverity[dont_call]
+    return (unsigned char)(rand() % 256);
+}
+
+template <>
+unsigned short
+makeLutTestValue<unsigned short>()
+{
+    // coverity[dont_call]
+    return (unsigned short)(rand() % 65536);
+}
+
+template <>
+float
+makeLutTestValue<float>()
+{
+    // coverity[dont_call]
+    return -0.1f + 1.3f * rand() / (float)RAND_MAX;
+}
+
+template <typename PIX>
+static void
+checkToPacked(const Lut* lut,
+              PixelPackingEnum outputPacking,
+              bool premult)
+{
+    const int width = 37;
+    const int height = 5;
+    const int outN = outputPacking == ePixelPackingRGB ? 3 : 4;
+    const RectI bounds(0, 0, width, height);
+    std::vector<float> src(width * height * 4);
+
+    for (std::size_t i = 0; i < src.size(); ++i) {
+        src[i] = makeLutTestValue<float>();
+    }
+    std::vector<PIX> expected(width * height * outN);
+    std::vector<PIX> result( expected.size() );
+    // the same random starts for the error diffusion
+    srand(1000);
+    toPackedPerPixel(lut, &src[0], width, height, outputPacking, premult, &expected[0]);
+    srand(1000);
+    // to_byte_packed flips the input rows unless invertY is true
+    if (sizeof(PIX) == 1) {
+        lut->to_byte_packed( (unsigned char*)&result[0], &src[0], bounds, bounds, bounds, ePixelPackingRGBA, outputPacking, true, premult );
+    } else if (sizeof(PIX) == 2) {
+        lut->to_short_packed( (unsigned short*)&result[0], &src[0], bounds, bounds, bounds, ePixelPackingRGBA, outputPacking, false, premult );
+    } else {
+        lut->to_float_packed( (float*)&result[0], &src[0], bounds, bounds, bounds, ePixelPackingRGBA, outputPacking, false, premult );
+    }
+    EXPECT_TRUE(expected == result) << sizeof(PIX) << " bytes per component, "
+                                                            << lut->getName() << ", packing " << outputPacking << ", premult " << premult;
+}
+
+template <typename PIX>
+static void
+checkFromPacked(const Lut* lut)
+{
+    const int width = 37;
+    const int height = 5;
+    const RectI bounds(0, 0, width, height);
+    std::vector<PIX> src(width * height * 4);
+
+    for (std::size_t i = 0; i < src.size(); ++i) {
+        src[i] = makeLutTestValue<PIX>();
+    }
+    std::vector<float> expected(width * height * 4);
+    std::vector<float> result( expected.size() );
+    fromPackedPerPixel(lut, &src[0], width, height, &expected[0]);
+    if (sizeof(PIX) == 1) {
+        lut->from_byte_packed( &result[0], (const unsigned char*)&src[0], bounds, bounds, bounds, ePixelPackingRGBA, ePixelPackingRGBA, false, false );
+    } else if (sizeof(PIX) == 2) {
+        lut->from_short_packed( &result[0], (const unsigned short*)&src[0], bounds, bounds, bounds, ePixelPackingRGBA, ePixelPackingRGBA, false, false );
+    } else {
+        lut->from_float_packed( &result[0], (const float*)&src[0], bounds, bounds, bounds, ePixelPackingRGBA, ePixelPackingRGBA, false, false );
+    }
+    EXPECT_TRUE(expected == result) << sizeof(PIX) << " bytes per component, " << lut->getName();
+}
+
+class LutConversionTest
+    : public SimdLevelTest
+{
+};
+
+TEST_P(LutConversionTest,PackedConversions) {
+    const Lut* luts[2] = {
+        LutManager::sRGBLut(), LutManager::AlexaV3LogCLut()
+    };
+    const PixelPackingEnum packings[3] = {
+        ePixelPackingRGBA, ePixelPackingBGRA, ePixelPackingRGB
+    };
+
+    for (int l = 0; l < 2; ++l) {
+        luts[l]->validate();
+        for (int p = 0; p < 3; ++p) {
+            for (int premult = 0; premult < 2; ++premult) {
+                checkToPacked<unsigned char>(luts[l], packings[p], premult);
+                checkToPacked<unsigned short>(luts[l], packings[p], premult);
+                checkToPacked<float>(luts[l], packings[p], premult);
+            }
+        }
+        checkFromPacked<unsigned char>(luts[l]);
+        checkFromPacked<unsigned short>(luts[l]);
+        checkFromPacked<float>(luts[l]);
+    }
+}
+
+TEST_P(LutConversionTest,PlanarConversions) {
+    // A planar buffer of 3 channels and one of alpha, converted channel by channel
+    const Lut* lut = LutManager::Rec709Lut();
+    const int width = 45;
+    std::vector<float> src(width * 3);
+    std::vector<float> alpha(width);
+
+    lut->validate();
+    for (std::size_t i = 0; i < src.size(); ++i) {
+        src[i] = makeLutTestValue<float>();
+    }
+    for (int i = 0; i < width; ++i) {
+        alpha[i] = makeLutTestValue<float>();
+    }
+    for (int c = 0; c < 3; ++c) {
+        const float* from = &src[c * width];
+        std::vector<unsigned short> shorts(width);
+        std::vector<float> floats(width);
+        std::vector<float> linear(width);
+        lut->to_short_planar(&shorts[0], from, width, &alpha[0]);
+        lut->to_float_planar(&floats[0], from, width);
+        lut->from_float_planar(&linear[0], &floats[0], width);
+        for (int x = 0; x < width; ++x) {
+            unsigned short expectedShort = floatToInt<65536>( lut->toColorSpaceFloatFromLinearFloatFast(from[x] * alpha[x]) );
+            EXPECT_EQ(expectedShort, shorts[x]) << "x " << x;
+            EXPECT_EQ(lut->toColorSpaceFloatFromLinearFloatFast(from[x]), floats[x]) << "x " << x;
+            EXPECT_EQ(lut->fromColorSpaceFloatToLinearFloatFast(floats[x]), linear[x]) << "x " << x;
+        }
+
+        // the bytes of every other pixel
+        std::vector<unsigned char> bytes(width * 2);
+        std::vector<float> bytesLinear(width);
+        srand(c);
+        lut->to_byte_planar(&bytes[0], from, width, NULL, 1, 2);
+        lut->from_byte_planar(&bytesLinear[0], &bytes[0], width, NULL, 2, 1);
+        srand(c);
+        // coverity[dont_call]
+        int start = rand() % width;
+        for (int backward = 0; backward < 2; ++backward) {
+            unsigned error = 0x80;
+            for (int x = backward ? start - 1 : start; x >= 0 && x < width; x += backward ? -1 : 1) {
+                error = (error & 0xff) + lut->toColorSpaceUint8xxFromLinearFloatFast(from[x]);
+                EXPECT_EQ( (unsigned char)(error >> 8), bytes[x * 2] ) << "x " << x;
+                EXPECT_EQ( lut->fromColorSpaceUint8ToLinearFloatFast(bytes[x * 2]), bytesLinear[x] ) << "x " << x;
+            }
+        }
+    }
+}
+
+TEST_P(LutConversionTest,DISABLED_Benchmark) {
+    // An HD RGBA frame converted from linear to sRGB floats and bytes, and 16-bit sRGB converted to linear
+    const int width = 1920;
+    const int height = 1080;
+    const int nFrames = 3;
+    const Lut* sRGB = LutManager::sRGBLut();
+    const RectI bounds(0, 0, width, height);
+    std::vector<float> floatImage(width * height * 4);
+    std::vector<float> outImage( floatImage.size() );
+    std::vector<unsigned char> byteImage(width * height * 4);
+    std::vector<unsigned short> shortImage(width * height * 4);
+
+    sRGB->validate();
+    for (std::size_t i = 0; i < floatImage.size(); ++i) {
+        floatImage[i] = makeLutTestValue<float>();
+        shortImage[i] = makeLutTestValue<unsigned short>();
+    }
+
+    if ( !isTestedSimdLevelSupported() ) {
+        return;
+    }
+    TimeLapse timer;
+    if (getTestedSimdLevel() == eSimdLevelNone) {
+        // the former per-pixel conversions: the transfer functions for floats, one lookup at a time for the others
+        for (int f = 0; f < nFrames; ++f) {
+            for (int i = 0; i < width * height * 4; ++i) {
+                outImage[i] = (i % 4) == 3 ? floatImage[i] : sRGB->toColorSpaceFloatFromLinearFloat(floatImage[i]);
+            }
+            toPackedPerPixel(sRGB, &floatImage[0], width, height, ePixelPackingRGBA, false, &byteImage[0]);
+            for (int i = 0; i < width * height * 4; ++i) {
+                outImage[i] = (i % 4) == 3 ? intToFloat<65536>(shortImage[i]) : sRGB->fromColorSpaceUint16ToLinearFloatFast(shortImage[i]);
+            }
+        }
+        recordThroughput( "perPixel", (double)width * height * nFrames * 3, timer.getTimeElapsedReset() );
+    }
+    for (int f = 0; f < nFrames; ++f) {
+        sRGB->to_float_packed(&outImage[0], &floatImage[0], bounds, bounds, bounds, ePixelPackingRGBA, ePixelPackingRGBA, false, false);
+        sRGB->to_byte_packed(&byteImage[0], &floatImage[0], bounds, bounds, bounds, ePixelPackingRGBA, ePixelPackingRGBA, true, false);
+        sRGB->from_short_packed(&outImage[0], &shortImage[0], bounds, bounds, bounds, ePixelPackingRGBA, ePixelPackingRGBA, false, false);
+    }
+    recordThroughput( "kernels", (double)width * height * nFrames * 3, timer.getTimeElapsedReset() );
+}
+
+NATRON_INSTANTIATE_SIMD_LEVEL_TESTS(LutConversionTest, eSimdLevelAVX2);
@@ -0,0 +1,180 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include <algorithm>
+#include <list>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "Engine/ParallelRenderController.h"
+
+NATRON_NAMESPACE_USING
+
+namespace {
+
+///A render whose throughput goes up with the number of parallel renders until the memory bandwidth is saturated:
+///the frames per second are n / (1 + contention * n^2), the best count being 1 / sqrt(contention)
+static double
+simulatedFramesPerSecond(int nParallelRenders,
+                         double contention)
+{
+    return nParallelRenders / (1. + contention * nParallelRenders * nParallelRenders);
+}
+
+///Renders nFrames from time and returns the number of frames rendered with each number of parallel renders
+static std::vector<int>
+continueRender(ParallelRenderController* controller,
+               double contention,
+               int nFrames,
+               double memoryPressure,
+               double* time)
+{
+    std::vector<int> nFramesPerCount(33, 0);
+
+    for (int i = 0; i < nFrames; ++i) {
+        int n = controller->getParallelRenders();
+        ++nFramesPerCount[n];
+        // +/- 2% of noise on the time of each frame
+        *time += ( 1. + 0.02 * ( (i * 7919) % 5 - 2 ) / 2. ) / simulatedFramesPerSecond(n, contention);
+        controller->notifyFrameRendered(*time, memoryPressure);
+    }
+
+    return nFramesPerCount;
+}
+
+static std::vector<int>
+simulateRender(ParallelRenderController* controller,
+               double contention,
+               int nFrames,
+               double memoryPressure)
+{
+    double time = 0.;
+
+    controller->reset(4, 1, 32, time);
+
+    return continueRender(controller, contention, nFrames, memoryPressure, &time);
+}
+
+///The counts giving at least 90% of the best throughput are equally good
+static double
+goodFramesPerSecond(double contention)
+{
+    double bestFPS = simulatedFramesPerSecond(1, contention);
+
+    for (int k = 2; k <= 32; ++k) {
+        bestFPS = std::max( bestFPS, simulatedFramesPerSecond(k, contention) );
+    }
+
+    return 0.9 * bestFPS;
+}
+
+static int
+mostUsedCount(const std::vector<int> & nFramesPerCount)
+{
+    int best = 1;
+
+    for (std::size_t i = 1; i < nFramesPerCount.size(); ++i) {
+        if (nFramesPerCount[i] > nFramesPerCount[best]) {
+            best = (int)i;
+        }
+    }
+
+    return best;
+}
+} // anon namespace
+
+TEST(ParallelRenderController, ConvergesToBestThroughput) {
+    const double contentions[] = { 0.2, 0.02, 0.005 };
+
+    for (int i = 0; i < 3; ++i) {
+        ParallelRenderController controller;
+        std::vector<int> nFramesPerCount = simulateRender(&controller, contentions[i], 20000, 0.5);
+        int n = mostUsedCount(nFramesPerCount);
+        EXPECT_GE( simulatedFramesPerSecond(n, contentions[i]), goodFramesPerSecond(contentions[i]) );
+        EXPECT_GT(controller.getFramesPerSecond(), 0.);
+
+        // Every change is logged with its reason
+        std::list<ParallelRenderDecision> decisions = controller.getDecisions();
+        ASSERT_FALSE( decisions.empty() );
+        for (std::list<ParallelRenderDecision>::const_iterator it = decisions.begin(); it != decisions.end(); ++it) {
+            EXPECT_GE(it->nParallelRenders, 1);
+            EXPECT_LE(it->nParallelRenders, 32);
+            EXPECT_FALSE( it->reason.empty() );
+        }
+    }
+}
+
+TEST(ParallelRenderController, MemoryPressure) {
+    // Even when more renders would be faster, they are removed while the free RAM is too low
+    ParallelRenderController controller;
+
+    simulateRender(&controller, 0.001, 2000, 1.);
+    EXPECT_EQ( 1, controller.getParallelRenders() );
+    ASSERT_FALSE( controller.getDecisions().empty() );
+    EXPECT_EQ( std::string("memory pressure"), controller.getDecisions().back().reason );
+}
+
+TEST(ParallelRenderController, PageCacheIsNotPressure) {
+    const double gb = 1024. * 1024. * 1024.;
+
+    // 16 GB with 200 MB free but 12 GB available: the rest is page cache the kernel gives back on demand
+    double pressure = ParallelRenderController::computeMemoryPressure(16. * gb, 12. * gb, 0.05);
+    EXPECT_LT(pressure, 0.3);
+    EXPECT_DOUBLE_EQ( 1., ParallelRenderController::computeMemoryPressure(16. * gb, 0.5 * gb, 0.05) );
+    EXPECT_DOUBLE_EQ( 0., ParallelRenderController::computeMemoryPressure(16. * gb, 16. * gb, 0.05) );
+
+    ParallelRenderController controller;
+    std::vector<int> nFramesPerCount = simulateRender(&controller, 0.02, 20000, pressure);
+    EXPECT_GE( simulatedFramesPerSecond(mostUsedCount(nFramesPerCount), 0.02), goodFramesPerSecond(0.02) );
+    std::list<ParallelRenderDecision> decisions = controller.getDecisions();
+    for (std::list<ParallelRenderDecision>::const_iterator it = decisions.begin(); it != decisions.end(); ++it) {
+        EXPECT_NE( std::string("memory pressure"), it->reason );
+    }
+}
+
+TEST(ParallelRenderController, MemoryPressureRecovers) {
+    // The renders removed while the RAM was short are added back once it is available again
+    ParallelRenderController controller;
+    double time = 0.;
+
+    controller.reset(4, 1, 32, time);
+    continueRender(&controller, 0.02, 2000, 1., &time);
+    EXPECT_EQ( 1, controller.getParallelRenders() );
+
+    std::vector<int> nFramesPerCount = continueRender(&controller, 0.02, 20000, 0.5, &time);
+    EXPECT_GE( simulatedFramesPerSecond(mostUsedCount(nFramesPerCount), 0.02), goodFramesPerSecond(0.02) );
+}
+
+TEST(ParallelRenderController, Bounds) {
+    ParallelRenderController controller;
+
+    controller.reset(10, 2, 3, 0.);
+    EXPECT_EQ( 3, controller.getParallelRenders() );
+    controller.reset(0, 2, 3, 0.);
+    EXPECT_EQ( 2, controller.getParallelRenders() );
+    // A single frame is not a measure
+    EXPECT_FALSE( controller.notifyFrameRendered(100., 0.) );
+    EXPECT_EQ( 2, controller.getParallelRenders() );
+}
@@ -0,0 +1,428 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include <cmath>
+#include <algorithm>
+#include <list>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <cairo/cairo.h>
+
+#include "Engine/Image.h"
+#include "Engine/ImageComponents.h"
+#include "Engine/RotoShapeRasterizer.h"
+#include "Engine/Timer.h"
+
+#include "BaseTest.h"
+
+NATRON_NAMESPACE_USING
+
+namespace {
+
+static Point
+makePoint(double x,
+          double y)
+{
+    Point p;
+
+    p.x = x;
+    p.y = y;
+
+    return p;
+}
+
+///The polygon of a shape and its feather contour, the quad i going from the points i to the points i + 1
+struct Contour
+{
+    std::vector<Point> inner;
+    std::vector<Point> outer;
+};
+
+///A circle of n points, counter-clockwise in the image unless clockWise is true
+static void
+makeCircle(double cx,
+           double cy,
+           double radius,
+           double featherRadius,
+           int n,
+           bool clockWise,
+           Contour* contour)
+{
+    for (int i = 0; i < n; ++i) {
+        double a = 2. * M_PI * i / n * (clockWise ? -1. : 1.);
+        contour->inner.push_back( makePoint( cx + radius * std::cos(a), cy + radius * std::sin(a) ) );
+        contour->outer.push_back( makePoint( cx + featherRadius * std::cos(a), cy + featherRadius * std::sin(a) ) );
+    }
+}
+
+///A star with nBranches, each branch being made of 2 control points evaluated at nPointsPerSegment like Bezier::evaluateAtTime_DeCasteljau
+static void
+makeStar(double cx,
+         double cy,
+         double radius,
+         double featherDist,
+         int nBranches,
+         int nPointsPerSegment,
+         Contour* contour)
+{
+    int n = 2 * nBranches * nPointsPerSegment;
+
+    for (int i = 0; i < n; ++i) {
+        double a = 2. * M_PI * i / n;
+        double r = radius * ( 0.8 + 0.2 * std::cos(nBranches * a) );
+        contour->inner.push_back( makePoint( cx + r * std::cos(a), cy + r * std::sin(a) ) );
+        contour->outer.push_back( makePoint( cx + (r + featherDist) * std::cos(a), cy + (r + featherDist) * std::sin(a) ) );
+    }
+}
+
+static void
+setupRasterizer(const Contour & contour,
+                bool withFeather,
+                double fallOff,
+                RotoShapeRasterizer* rasterizer)
+{
+    rasterizer->addPolygon( std::list<Point>( contour.inner.begin(), contour.inner.end() ) );
+    if (withFeather) {
+        rasterizer->setFeatherFallOff(fallOff);
+        std::size_t n = contour.inner.size();
+        for (std::size_t i = 0; i < n; ++i) {
+            std::size_t next = (i + 1) % n;
+            rasterizer->addFeatherQuad(contour.inner[i], contour.outer[i], contour.outer[next], contour.inner[next]);
+        }
+    }
+}
+
+///What RotoContext used to do: the polygon filled without antialiasing in a cairo A8 surface, the feather painted with a mesh
+///pattern masked by itself, and the conversion to float
+static void
+renderWithCairo(const Contour & contour,
+                double fallOff,
+                const RectI & roi,
+                float* alpha)
+{
+    cairo_surface_t* cairoImg = cairo_image_surface_create( CAIRO_FORMAT_A8, roi.width(), roi.height() );
+
+    cairo_surface_set_device_offset(cairoImg, -roi.x1, -roi.y1);
+    cairo_t* cr = cairo_create(cairoImg);
+    cairo_set_fill_rule(cr, CAIRO_FILL_RULE_WINDING);
+    cairo_set_antialias(cr, CAIRO_ANTIALIAS_NONE);
+
+    double fallOffInverse = 1. / fallOff;
+    cairo_pattern_t* mesh = cairo_pattern_create_mesh();
+    std::size_t n = contour.inner.size();
+    for (std::size_t i = 0; i < n; ++i) {
+        std::size_t next = (i + 1) % n;
+        const Point & p0 = contour.inner[i];
+        const Point & p1 = contour.outer[i];
+        const Point & p2 = contour.outer[next];
+        const Point & p3 = contour.inner[next];
+        Point p0p1, p1p0, p2p3, p3p2;
+        p0p1.x = (p0.x * fallOff * 2. + fallOffInverse * p1.x) / (fallOff * 2. + fallOffInverse);
+        p0p1.y = (p0.y * fallOff * 2. + fallOffInverse * p1.y) / (fallOff * 2. + fallOffInverse);
+        p1p0.x = (p0.x * fallOff + 2. * fallOffInverse * p1.x) / (fallOff + 2. * fallOffInverse);
+        p1p0.y = (p0.y * fallOff + 2. * fallOffInverse * p1.y) / (fallOff + 2. * fallOffInverse);
+        p2p3.x = (p3.x * fallOff + 2. * fallOffInverse * p2.x) / (fallOff + 2. * fallOffInverse);
+        p2p3.y = (p3.y * fallOff + 2. * fallOffInverse * p2.y) / (fallOff + 2. * fallOffInverse);
+        p3p2.x = (p3.x * fallOff * 2. + fallOffInverse * p2.x) / (fallOff * 2. + fallOffInverse);
+        p3p2.y = (p3.y * fallOff * 2. + fallOffInverse * p2.y) / (fallOff * 2. + fallOffInverse);
+
+        cairo_mesh_pattern_begin_patch(mesh);
+        cairo_mesh_pattern_move_to(mesh, p0.x, p0.y);
+        cairo_mesh_pattern_curve_to(mesh, p0p1.x, p0p1.y, p1p0.x, p1p0.y, p1.x, p1.y);
+        cairo_mesh_pattern_line_to(mesh, p2.x, p2.y);
+        cairo_mesh_pattern_curve_to(mesh, p2p3.x, p2p3.y, p3p2.x, p3p2.y, p3.x, p3.y);
+        cairo_mesh_pattern_line_to(mesh, p0.x, p0.y);
+        cairo_mesh_pattern_set_corner_color_rgba(mesh, 0, 1., 1., 1., 1.);
+        cairo_mesh_pattern_set_corner_color_rgba(mesh, 1, 1., 1., 1., 0.);
+        cairo_mesh_pattern_set_corner_color_rgba(mesh, 2, 1., 1., 1., 0.);
+        cairo_mesh_pattern_set_corner_color_rgba(mesh, 3, 1., 1., 1., 1.);
+        cairo_mesh_pattern_end_patch(mesh);
+    }
+
+    cairo_set_source_rgba(cr, 1, 1, 1, 1);
+    cairo_move_to(cr, contour.inner[0].x, contour.inner[0].y);
+    for (std::size_t i = 1; i < n; ++i) {
+        cairo_line_to(cr, contour.inner[i].x, contour.inner[i].y);
+    }
+    cairo_fill(cr);
+
+    cairo_set_source(cr, mesh);
+    cairo_mask(cr, mesh);
+    cairo_pattern_destroy(mesh);
+
+    cairo_surface_flush(cairoImg);
+    const unsigned char* data = cairo_image_surface_get_data(cairoImg);
+    int stride = cairo_image_surface_get_stride(cairoImg);
+    for (int y = 0; y < roi.height(); ++y) {
+        for (int x = 0; x < roi.width(); ++x) {
+            alpha[y * roi.width() + x] = data[y * stride + x] / 255.f;
+        }
+    }
+
+    cairo_destroy(cr);
+    cairo_surface_destroy(cairoImg);
+} // renderWithCairo
+} // anon namespace
+
+TEST(RotoShapeRasterizer, Coverage) {
+    // A square whose sides are in the middle of the pixels: each pixel gets the area it covers
+    RotoShapeRasterizer rasterizer;
+    std::list<Point> square;
+
+    square.push_back( makePoint(10.25, 10.25) );
+    square.push_back( makePoint(20.75, 10.25) );
+    square.push_back( makePoint(20.75, 20.75) );
+    square.push_back( makePoint(10.25, 20.75) );
+    rasterizer.addPolygon(square);
+    EXPECT_TRUE( rasterizer.getBoundingBox() == RectI(10, 10, 21, 21) );
+
+    RectI roi(0, 0, 32, 32);
+    std::vector<float> alpha( roi.area() );
+    rasterizer.renderAlpha(roi, &alpha[0]);
+    double sum = 0.;
+    for (std::size_t i = 0; i < alpha.size(); ++i) {
+        sum += alpha[i];
+    }
+    EXPECT_NEAR(10.5 * 10.5, sum, 1e-3);
+    EXPECT_NEAR(1., alpha[15 * 32 + 15], 1e-6);
+    EXPECT_NEAR(0.75, alpha[15 * 32 + 10], 1e-6);
+    EXPECT_NEAR(0.75, alpha[15 * 32 + 20], 1e-6);
+    EXPECT_NEAR(0.5625, alpha[10 * 32 + 10], 1e-6);
+    EXPECT_NEAR(0., alpha[15 * 32 + 9], 1e-6);
+    EXPECT_NEAR(0., alpha[15 * 32 + 21], 1e-6);
+
+    // Overlapping polygons are filled with the non-zero winding rule
+    RotoShapeRasterizer overlap;
+    std::list<Point> first, second;
+    first.push_back( makePoint(0., 0.) );
+    first.push_back( makePoint(10., 0.) );
+    first.push_back( makePoint(10., 10.) );
+    first.push_back( makePoint(0., 10.) );
+    for (std::list<Point>::iterator it = first.begin(); it != first.end(); ++it) {
+        second.push_back( makePoint(it->x + 5., it->y + 5.) );
+    }
+    overlap.addPolygon(first);
+    overlap.addPolygon(second);
+    overlap.renderAlpha(roi, &alpha[0]);
+    sum = 0.;
+    for (std::size_t i = 0; i < alpha.size(); ++i) {
+        sum += alpha[i];
+    }
+    EXPECT_NEAR(175., sum, 1e-3);
+    EXPECT_NEAR(1., alpha[7 * 32 + 7], 1e-6);
+}
+
+TEST(RotoShapeRasterizer, Tiles) {
+    // A circle larger than a tile, across the origin: its area is the same in both orientations and any roi gets the same pixels
+    for (int clockWise = 0; clockWise < 2; ++clockWise) {
+        Contour circle;
+        makeCircle(-37.3, 251.7, 200., 200., 4000, clockWise, &circle);
+        RotoShapeRasterizer rasterizer;
+        setupRasterizer(circle, false, 1., &rasterizer);
+
+        RectI roi(-300, 0, 200, 500);
+        std::vector<float> alpha( roi.area() );
+        rasterizer.renderAlpha(roi, &alpha[0]);
+        double sum = 0.;
+        for (std::size_t i = 0; i < alpha.size(); ++i) {
+            sum += alpha[i];
+        }
+        double area = 0.5 * 4000 * 200. * 200. * std::sin(2. * M_PI / 4000);
+        EXPECT_NEAR(area, sum, 1e-3 * area);
+
+        RectI subRoi(-171, 37, 77, 301);
+        std::vector<float> subAlpha( subRoi.area() );
+        rasterizer.renderAlpha(subRoi, &subAlpha[0]);
+        for (int y = subRoi.y1; y < subRoi.y2; ++y) {
+            for (int x = subRoi.x1; x < subRoi.x2; ++x) {
+                ASSERT_NEAR(alpha[(y - roi.y1) * roi.width() + x - roi.x1], subAlpha[(y - subRoi.y1) * subRoi.width() + x - subRoi.x1], 1e-6);
+            }
+        }
+    }
+}
+
+TEST(RotoShapeRasterizer, Feather) {
+    Contour ring;
+
+    makeCircle(300., 300., 100., 140., 2000, false, &ring);
+    RotoShapeRasterizer rasterizer;
+    setupRasterizer(ring, true, 1., &rasterizer);
+
+    RectI roi(150, 150, 450, 450);
+    std::vector<float> alpha( roi.area() );
+    rasterizer.renderAlpha(roi, &alpha[0]);
+    for (int y = roi.y1; y < roi.y2; ++y) {
+        for (int x = roi.x1; x < roi.x2; ++x) {
+            double r = std::sqrt( (x + 0.5 - 300.) * (x + 0.5 - 300.) + (y + 0.5 - 300.) * (y + 0.5 - 300.) );
+            float a = alpha[(y - roi.y1) * roi.width() + x - roi.x1];
+            if (r < 99.) {
+                ASSERT_NEAR(1., a, 1e-6);
+            } else if (r > 141.) {
+                ASSERT_NEAR(0., a, 1e-6);
+            } else if ( (r > 101.) && (r < 139.) ) {
+                // a linear fall-off is the former cairo mesh going linearly from 1 to 0, masked by itself
+                double s = (r - 100.) / 40.;
+                ASSERT_NEAR( (1. - s) * (1. - s), a, 1e-2 );
+            } else if (r <= 101.) {
+                // no seam between the polygon and the feather
+                ASSERT_GT(a, 0.9f);
+            }
+        }
+    }
+
+    // The fall-off moves the alpha down (> 1) or up (< 1) at the middle of the feather
+    float linear = alpha[(300 - roi.y1) * roi.width() + 420 - roi.x1];
+    for (int i = 0; i < 2; ++i) {
+        RotoShapeRasterizer fallOff;
+        setupRasterizer(ring, true, i == 0 ? 0.5 : 2., &fallOff);
+        std::vector<float> fallOffAlpha( roi.area() );
+        fallOff.renderAlpha(roi, &fallOffAlpha[0]);
+        float a = fallOffAlpha[(300 - roi.y1) * roi.width() + 420 - roi.x1];
+        if (i == 0) {
+            EXPECT_GT(a, linear);
+        } else {
+            EXPECT_LT(a, linear);
+        }
+    }
+
+    // A feather going inwards does not grow the shape
+    for (int clockWise = 0; clockWise < 2; ++clockWise) {
+        Contour inwards;
+        makeCircle(300., 300., 100., 80., 2000, clockWise, &inwards);
+        RotoShapeRasterizer inwardsRasterizer;
+        setupRasterizer(inwards, true, 1., &inwardsRasterizer);
+        inwardsRasterizer.renderAlpha(roi, &alpha[0]);
+        for (int y = roi.y1; y < roi.y2; ++y) {
+            for (int x = roi.x1; x < roi.x2; ++x) {
+                double r = std::sqrt( (x + 0.5 - 300.) * (x + 0.5 - 300.) + (y + 0.5 - 300.) * (y + 0.5 - 300.) );
+                if (r > 100.8) {
+                    ASSERT_NEAR(0., alpha[(y - roi.y1) * roi.width() + x - roi.x1], 1e-6);
+                }
+            }
+        }
+    }
+}
+
+TEST_F(BaseTest, RotoShapeRasterizerImage) {
+    Contour ring;
+
+    makeCircle(100., 100., 50., 60., 500, false, &ring);
+    RotoShapeRasterizer rasterizer;
+    setupRasterizer(ring, true, 1., &rasterizer);
+
+    RectI roi(0, 0, 300, 200);
+    std::vector<float> alpha( roi.area() );
+    rasterizer.renderAlpha(roi, &alpha[0]);
+
+    // The tiles rendered in parallel are written with the color and the opacity
+    RectI bounds(-10, -10, 310, 210);
+    RectD rod(bounds.x1, bounds.y1, bounds.x2, bounds.y2);
+    Image rgba(ImageComponents::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    double shapeColor[3] = { 0.5, 1., 0.25 };
+    rasterizer.renderToImage(roi, shapeColor, 0.5, true, &rgba);
+    {
+        Image::ReadAccess acc = rgba.getReadRights();
+        for (int y = roi.y1; y < roi.y2; ++y) {
+            const float* pix = (const float*)acc.pixelAt(roi.x1, y);
+            for (int x = 0; x < roi.width(); ++x, pix += 4) {
+                float a = alpha[(y - roi.y1) * roi.width() + x];
+                ASSERT_NEAR(a * 0.25f, pix[0], 1e-6);
+                ASSERT_NEAR(a * 0.5f, pix[1], 1e-6);
+                ASSERT_NEAR(a * 0.125f, pix[2], 1e-6);
+                ASSERT_NEAR(a * 0.5f, pix[3], 1e-6);
+            }
+        }
+    }
+
+    Image alpha8(ImageComponents::getAlphaComponents(), rod, bounds, 0, 1., eImageBitDepthByte, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    rasterizer.renderToImage(roi, shapeColor, 0.5, false, &alpha8);
+    {
+        Image::ReadAccess acc = alpha8.getReadRights();
+        EXPECT_EQ( 255, *(const unsigned char*)acc.pixelAt(100, 100) );
+        EXPECT_EQ( 0, *(const unsigned char*)acc.pixelAt(0, 0) );
+    }
+}
+
+TEST(RotoShapeRasterizer, SameAsCairo) {
+    // The shape of the benchmark, rendered once by both
+    const double fallOff = 1.;
+    Contour star;
+
+    makeStar(1000., 1000., 900., 20., 200, 50, &star);
+    RectI roi(0, 0, 2000, 2000);
+    std::vector<float> cairoAlpha( roi.area() ), alpha( roi.area() );
+
+    renderWithCairo(star, fallOff, roi, &cairoAlpha[0]);
+    RotoShapeRasterizer rasterizer;
+    setupRasterizer(star, true, fallOff, &rasterizer);
+    rasterizer.renderAlpha(roi, &alpha[0]);
+
+    // Both differ by the antialiasing of the polygon and the quantization of the A8 surface only
+    double diff = 0.;
+    for (std::size_t i = 0; i < alpha.size(); ++i) {
+        diff += std::abs(alpha[i] - cairoAlpha[i]);
+    }
+    EXPECT_LT(diff / alpha.size(), 0.02);
+}
+
+TEST_F(BaseTest, DISABLED_RotoShapeRasterizerBenchmark) {
+    // A shape of 400 control points with a 20 pixels feather, evaluated like Bezier::evaluateAtTime_DeCasteljau, on a 2K image
+    const int nFrames = 3;
+    const double fallOff = 1.;
+    Contour star;
+
+    makeStar(1000., 1000., 900., 20., 200, 50, &star);
+    RectI roi(0, 0, 2000, 2000);
+    std::vector<float> cairoAlpha( roi.area() ), alpha( roi.area() );
+
+    {
+        TimeLapse timer;
+        for (int f = 0; f < nFrames; ++f) {
+            renderWithCairo(star, fallOff, roi, &cairoAlpha[0]);
+        }
+        RecordProperty( "cairoMillisecondsPerFrame", (int)(timer.getTimeSinceCreation() * 1000. / nFrames) );
+    }
+    {
+        TimeLapse timer;
+        for (int f = 0; f < nFrames; ++f) {
+            RotoShapeRasterizer rasterizer;
+            setupRasterizer(star, true, fallOff, &rasterizer);
+            rasterizer.renderAlpha(roi, &alpha[0]);
+        }
+        RecordProperty( "singleThreadMillisecondsPerFrame", (int)(timer.getTimeSinceCreation() * 1000. / nFrames) );
+    }
+    {
+        RectD rod(roi.x1, roi.y1, roi.x2, roi.y2);
+        Image image(ImageComponents::getAlphaComponents(), rod, roi, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+        double shapeColor[3] = { 1., 1., 1. };
+        TimeLapse timer;
+        for (int f = 0; f < nFrames; ++f) {
+            RotoShapeRasterizer rasterizer;
+            setupRasterizer(star, true, fallOff, &rasterizer);
+            rasterizer.renderToImage(roi, shapeColor, 1., true, &image);
+        }
+        RecordProperty( "tilesMillisecondsPerFrame", (int)(timer.getTimeSinceCreation() * 1000. / nFrames) );
+    }
+}
@@ -0,0 +1,108 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <cairo/cairo.h>
+
+#include "Engine/Image.h"
+#include "Engine/ImageComponents.h"
+#include "Engine/RotoContextPrivate.h"
+
+#include "BaseTest.h"
+
+NATRON_NAMESPACE_USING
+
+namespace {
+/// A line of dots 4 pixels apart, every other dot being soft: a gradient from its internal to its external radius
+void
+makeStrokeDots(double x1,
+               double y1,
+               double x2,
+               double y2,
+               std::vector<RotoStrokeDot>* dots)
+{
+    int n = (int)(std::sqrt( (x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1) ) / 4.) + 1;
+
+    for (int i = 0; i < n; ++i) {
+        double a = n == 1 ? 0. : i / (double)(n - 1);
+        RotoStrokeDot dot;
+        dot.center.x = x1 * (1 - a) + x2 * a;
+        dot.center.y = y1 * (1 - a) + y2 * a;
+        dot.pressure = 0.2 + 0.8 * a;
+        dot.externalDotRadius = 12.;
+        dot.internalDotRadius = (i % 2) ? 12. : 4.;
+        if (i % 2 == 0) {
+            dot.opacityStops.push_back( std::make_pair(0., 0.6) );
+            dot.opacityStops.push_back( std::make_pair(1., 0.) );
+        }
+        dots->push_back(dot);
+    }
+}
+} // anon namespace
+
+TEST_F(BaseTest, RotoStrokeTiles) {
+    // The tile corners of the roi are at (216, 226) and (472, 482): a diagonal goes through both of them, a line follows
+    // the edge between two rows of tiles and a dot lies on a corner. The strokes also leave the roi.
+    const RectI roi(-40, -30, 600, 560);
+    const int tileSize = 256;
+    std::vector<RotoStrokeDot> dots;
+
+    makeStrokeDots(-60., -50., 600., 610., &dots);
+    makeStrokeDots(-40., 226., 600., 226., &dots);
+    makeStrokeDots(472., 226., 472., 226., &dots);
+
+    RectD rod(roi.x1, roi.y1, roi.x2, roi.y2);
+    double shapeColor[3] = { 1., 1., 1. };
+    for (int doBuildUp = 0; doBuildUp < 2; ++doBuildUp) {
+        for (int rgba = 0; rgba < 2; ++rgba) {
+            // the formats of RotoContext::renderMaskInternal: the LIGHTEN operator of the non build-up case only works on colors
+            cairo_format_t format = (!doBuildUp || rgba) ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_A8;
+            const ImageComponents & components = rgba ? ImageComponents::getRGBAComponents() : ImageComponents::getAlphaComponents();
+            Image tiled(components, rod, roi, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+            Image single(components, rod, roi, 0, 1., eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+            RotoContextPrivate::renderStrokeDots(dots, roi, tileSize, format, doBuildUp, 0.7, shapeColor, false, &tiled);
+            RotoContextPrivate::renderStrokeDots(dots, roi, std::max( roi.width(), roi.height() ), format, doBuildUp, 0.7, shapeColor, false, &single);
+
+            Image::ReadAccess tiledAcc = tiled.getReadRights();
+            Image::ReadAccess singleAcc = single.getReadRights();
+            int nComps = (int)components.getNumComponents();
+            double sum = 0.;
+            for (int y = roi.y1; y < roi.y2; ++y) {
+                const float* tiledPix = (const float*)tiledAcc.pixelAt(roi.x1, y);
+                const float* singlePix = (const float*)singleAcc.pixelAt(roi.x1, y);
+                for (int i = 0; i < roi.width() * nComps; ++i) {
+                    // the gradients of the soft dots may round differently on surfaces of different origins
+                    ASSERT_NEAR(singlePix[i], tiledPix[i], 1.01 / 255) << "build-up " << doBuildUp << ", components " << nComps
+                                                                       << ", x " << roi.x1 + i / nComps << ", y " << y;
+                    sum += singlePix[i];
+                }
+            }
+            EXPECT_GT(sum, 0.);
+        }
+    }
+}
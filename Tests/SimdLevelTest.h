@@ -0,0 +1,82 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef SIMDLEVELTEST_H
+#define SIMDLEVELTEST_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include <string>
+
+#include "Global/Macros.h"
+#include <gtest/gtest.h>
+
+#include "Engine/SimdSupport.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Fixture of the tests of the vectorized image kernels. Each test is run once per SIMD level, the kernels being
+ * limited to that level (@see NATRON_INSTANTIATE_SIMD_LEVEL_TESTS). A level the CPU does not have runs the best one it has.
+ **/
+class SimdLevelTest
+    : public ::testing::TestWithParam<int>
+{
+protected:
+
+    virtual void SetUp()
+    {
+        setMaximumSimdLevel( getTestedSimdLevel() );
+    }
+
+    virtual void TearDown()
+    {
+        setMaximumSimdLevel(eSimdLevelAVX2);
+    }
+
+    SimdLevelEnum getTestedSimdLevel() const
+    {
+        return (SimdLevelEnum)GetParam();
+    }
+
+    ///False if the CPU does not have the tested level: benchmarks would measure the level below
+    bool isTestedSimdLevelSupported() const
+    {
+        return getSimdLevel() == getTestedSimdLevel();
+    }
+
+    ///Records the throughput of a benchmark in the test properties (e.g: in the XML output of the tests)
+    static void recordThroughput(const std::string & name,
+                                 double nPixels,
+                                 double seconds)
+    {
+        RecordProperty( name + "MegapixelsPerSecond", (int)(nPixels / 1e6 / seconds) );
+    }
+};
+
+///Runs the TEST_P of fixture, a class deriving SimdLevelTest, for each level from eSimdLevelNone to maxLevel
+#define NATRON_INSTANTIATE_SIMD_LEVEL_TESTS(fixture, maxLevel) \
+    INSTANTIATE_TEST_CASE_P( SimdLevels, fixture, ::testing::Range( (int)eSimdLevelNone, (int)(maxLevel) + 1 ) )
+
+NATRON_NAMESPACE_EXIT
+
+#endif // SIMDLEVELTEST_H
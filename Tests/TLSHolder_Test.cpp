@@ -0,0 +1,208 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include <vector>
+#include <gtest/gtest.h>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#endif
+#include <QtCore/QThread>
+
+#include "Engine/AppManager.h"
+#include "Engine/Knob.h"
+#include "Engine/TLSHolder.h"
+#include "Engine/Timer.h"
+
+#include "BaseTest.h"
+
+NATRON_NAMESPACE_USING
+
+namespace {
+
+typedef TLSHolder<KnobHelper::KnobTLSData> TestTLSHolder;
+typedef boost::shared_ptr<TestTLSHolder> TestTLSHolderPtr;
+
+class TLSTestThread
+    : public QThread
+{
+    boost::function<void ()> _func;
+
+public:
+
+    TLSTestThread(const boost::function<void ()> & func)
+        : QThread()
+        , _func(func)
+    {
+    }
+
+    virtual ~TLSTestThread()
+    {
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        _func();
+    }
+};
+
+static void
+runInThreads(int nThreads,
+             const boost::function<void ()> & func)
+{
+    std::vector<TLSTestThread*> threads;
+
+    for (int i = 0; i < nThreads; ++i) {
+        threads.push_back( new TLSTestThread(func) );
+    }
+    for (int i = 0; i < nThreads; ++i) {
+        threads[i]->start();
+    }
+    for (int i = 0; i < nThreads; ++i) {
+        threads[i]->wait();
+        delete threads[i];
+    }
+}
+
+///Each thread gets its own value, which is the same on every call until the thread cleans up its TLS
+static void
+checkThreadData(const TestTLSHolderPtr & holder,
+                const KnobHelper::KnobDataTLSPtr & mainThreadData,
+                boost::atomic<int>* nErrors)
+{
+    if ( holder->getTLSData() ) {
+        nErrors->fetch_add(1);
+    }
+    KnobHelper::KnobDataTLSPtr data = holder->getOrCreateTLSData();
+    if ( !data || (data == mainThreadData) || (data->expressionRecursionLevel != 0) ) {
+        nErrors->fetch_add(1);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        if ( (holder->getTLSData() != data) || (holder->getOrCreateTLSData() != data) ) {
+            nErrors->fetch_add(1);
+        }
+        ++data->expressionRecursionLevel;
+    }
+    appPTR->getAppTLS()->cleanupTLSForThread();
+    if ( holder->getTLSData() ) {
+        nErrors->fetch_add(1);
+    }
+}
+
+///A thread spawned by the main thread, as the threads of the OpenFX multi-thread suite
+static void
+checkSoftCopy(const TestTLSHolderPtr & holder,
+              const QThread* spawnerThread,
+              const KnobHelper::KnobDataTLSPtr & spawnerData,
+              boost::atomic<int>* nErrors)
+{
+    appPTR->getAppTLS()->softCopy( spawnerThread, QThread::currentThread() );
+    KnobHelper::KnobDataTLSPtr data = holder->getOrCreateTLSData();
+    // Only the EffectInstance TLS is copied to the spawned threads
+    if ( !data || (data == spawnerData) || (holder->getTLSData() != data) ) {
+        nErrors->fetch_add(1);
+    }
+    appPTR->getAppTLS()->cleanupTLSForThread();
+
+    // The thread may also not use the TLS at all
+    appPTR->getAppTLS()->softCopy( spawnerThread, QThread::currentThread() );
+    appPTR->getAppTLS()->cleanupTLSForThread();
+    if ( holder->getTLSData() ) {
+        nErrors->fetch_add(1);
+    }
+}
+
+///The lookups done by the render threads, e.g: the recursion level of the expressions of a knob
+static void
+readTLSData(const TestTLSHolderPtr & holder,
+            int nCalls,
+            boost::atomic<int>* nErrors)
+{
+    holder->getOrCreateTLSData();
+    int sum = 0;
+    for (int i = 0; i < nCalls; ++i) {
+        sum += holder->getTLSData()->expressionRecursionLevel;
+    }
+    if (sum != 0) {
+        nErrors->fetch_add(1);
+    }
+    appPTR->getAppTLS()->cleanupTLSForThread();
+}
+} // anon namespace
+
+TEST_F(BaseTest, TLSHolderPerThreadData) {
+    TestTLSHolderPtr holder(new TestTLSHolder);
+
+    EXPECT_FALSE( holder->getTLSData() );
+    KnobHelper::KnobDataTLSPtr mainThreadData = holder->getOrCreateTLSData();
+    ASSERT_TRUE(mainThreadData);
+    mainThreadData->expressionRecursionLevel = 42;
+    EXPECT_EQ( mainThreadData, holder->getTLSData() );
+
+    boost::atomic<int> nErrors(0);
+    runInThreads( 8, boost::bind(checkThreadData, holder, mainThreadData, &nErrors) );
+    runInThreads( 2, boost::bind(checkSoftCopy, holder, QThread::currentThread(), mainThreadData, &nErrors) );
+    EXPECT_EQ(0, nErrors.load());
+
+    // The other threads did not touch the data of the main thread
+    EXPECT_EQ( mainThreadData, holder->getTLSData() );
+    EXPECT_EQ(42, mainThreadData->expressionRecursionLevel);
+
+    appPTR->getAppTLS()->cleanupTLSForThread();
+    EXPECT_FALSE( holder->getTLSData() );
+}
+
+TEST_F(BaseTest, TLSHolderDestroyedHolder) {
+    // A new holder may get the cache slot of a destroyed holder, it must not see its data
+    {
+        TestTLSHolderPtr holder(new TestTLSHolder);
+        holder->getOrCreateTLSData()->expressionRecursionLevel = 7;
+    }
+    TestTLSHolderPtr holder(new TestTLSHolder);
+    EXPECT_FALSE( holder->getTLSData() );
+    KnobHelper::KnobDataTLSPtr data = holder->getOrCreateTLSData();
+    ASSERT_TRUE(data);
+    EXPECT_EQ(0, data->expressionRecursionLevel);
+    appPTR->getAppTLS()->cleanupTLSForThread();
+}
+
+TEST_F(BaseTest, DISABLED_TLSHolderBenchmark) {
+    TestTLSHolderPtr holder(new TestTLSHolder);
+    const int nCalls = 1000000;
+    const int threadCounts[] = { 1, 32 };
+
+    for (int i = 0; i < 2; ++i) {
+        boost::atomic<int> nErrors(0);
+        TimeLapse timer;
+        runInThreads( threadCounts[i], boost::bind(readTLSData, holder, nCalls, &nErrors) );
+        double t = timer.getTimeSinceCreation();
+        EXPECT_EQ(0, nErrors.load());
+        RecordProperty( i == 0 ? "singleThreadNanosecondsPerCall" : "32ThreadsNanosecondsPerCall", (int)( (t * 1e9) / ( (double)nCalls * threadCounts[i] ) ) );
+    }
+}
@@ -0,0 +1,169 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <http://www.natron.fr/>,
+ * Copyright (C) 2016 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <gtest/gtest.h>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#endif
+#include <QtCore/QMutex>
+
+#include "Engine/TaskScheduler.h"
+
+NATRON_NAMESPACE_USING
+
+namespace {
+
+struct NestedLoopsData
+{
+    TaskScheduler* scheduler;
+    boost::atomic<int> nLeaves;
+    boost::atomic<int> nErrors;
+
+    NestedLoopsData(TaskScheduler* scheduler)
+        : scheduler(scheduler)
+        , nLeaves(0)
+        , nErrors(0)
+    {
+    }
+};
+
+static void
+leafIteration(NestedLoopsData* data,
+              std::vector<unsigned int>* values,
+              unsigned int i)
+{
+    (*values)[i] = i * 2;
+    data->nLeaves.fetch_add(1);
+}
+
+static void
+middleIteration(NestedLoopsData* data,
+                unsigned int /*i*/)
+{
+    std::vector<unsigned int> values(37);
+
+    data->scheduler->parallelFor( values.size(), boost::bind(leafIteration, data, &values, _1) );
+    for (unsigned int k = 0; k < values.size(); ++k) {
+        if (values[k] != k * 2) {
+            data->nErrors.fetch_add(1);
+        }
+    }
+}
+
+static void
+topIteration(NestedLoopsData* data,
+             unsigned int /*i*/)
+{
+    data->scheduler->parallelFor( 16, boost::bind(middleIteration, data, _1) );
+}
+
+struct ConcurrencyData
+{
+    QMutex mutex;
+    int nRunning;
+    int maxRunning;
+
+    ConcurrencyData()
+        : mutex()
+        , nRunning(0)
+        , maxRunning(0)
+    {
+    }
+};
+
+static void
+countingIteration(ConcurrencyData* data,
+                  unsigned int /*i*/)
+{
+    {
+        QMutexLocker k(&data->mutex);
+        ++data->nRunning;
+        data->maxRunning = std::max(data->maxRunning, data->nRunning);
+    }
+    volatile double x = 0.;
+    for (int k = 0; k < 100000; ++k) {
+        x += k;
+    }
+    QMutexLocker k(&data->mutex);
+    --data->nRunning;
+}
+
+static void
+throwingIteration(unsigned int i)
+{
+    if (i == 5) {
+        throw std::runtime_error("iteration failed");
+    }
+}
+} // anon namespace
+
+// Loops started from within iterations must all complete without deadlocking, even with more loops than workers
+TEST(TaskScheduler, NestedLoops)
+{
+    TaskScheduler scheduler(3);
+    NestedLoopsData data(&scheduler);
+
+    for (int i = 0; i < 10; ++i) {
+        scheduler.parallelFor( 8, boost::bind(topIteration, &data, _1) );
+    }
+    EXPECT_EQ(10 * 8 * 16 * 37, data.nLeaves.load());
+    EXPECT_EQ(0, data.nErrors.load());
+}
+
+TEST(TaskScheduler, ConcurrencyLimit)
+{
+    TaskScheduler scheduler(7);
+    ConcurrencyData perLoop;
+
+    scheduler.parallelFor( 200, boost::bind(countingIteration, &perLoop, _1), 3 );
+    EXPECT_LE(perLoop.maxRunning, 3);
+
+    ConcurrencyData global;
+    scheduler.setMaximumConcurrency(2);
+    scheduler.parallelFor( 200, boost::bind(countingIteration, &global, _1) );
+    EXPECT_LE(global.maxRunning, 2);
+
+    ConcurrencyData singleThreaded;
+    scheduler.setMaximumConcurrency(1);
+    scheduler.parallelFor( 50, boost::bind(countingIteration, &singleThreaded, _1) );
+    EXPECT_EQ(1, singleThreaded.maxRunning);
+}
+
+TEST(TaskScheduler, Exception)
+{
+    TaskScheduler scheduler(3);
+
+    EXPECT_THROW( scheduler.parallelFor(10, throwingIteration), std::runtime_error );
+
+    // Loops keep working after the workers have quit, in the calling thread
+    scheduler.quitWorkers();
+    ConcurrencyData data;
+    scheduler.parallelFor( 20, boost::bind(countingIteration, &data, _1) );
+    EXPECT_EQ(1, data.maxRunning);
+}
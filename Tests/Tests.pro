@@ -217,11 +217,18 @@ SOURCES += \
     google-test/src/gtest_main.cc \
     google-mock/src/gmock-all.cc \
     BaseTest.cpp \
+    Cache_Test.cpp \
     Hash64_Test.cpp \
+    TaskScheduler_Test.cpp \
+    TLSHolder_Test.cpp \
+    ParallelRenderController_Test.cpp \
     Image_Test.cpp \
     Lut_Test.cpp \
     KnobFile_Test.cpp \
-    Curve_Test.cpp
+    Curve_Test.cpp \
+    RotoShapeRasterizer_Test.cpp \
+    RotoStrokeTiles_Test.cpp
 
 HEADERS += \
-    BaseTest.h
+    BaseTest.h \
+    SimdLevelTest.h